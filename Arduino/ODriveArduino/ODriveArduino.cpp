@@ -2,22 +2,81 @@
 #include "Arduino.h"
 #include "ODriveArduino.h"
 
-static const int kMotorOffsetFloat = 2;
-static const int kMotorStrideFloat = 28;
-static const int kMotorOffsetInt32 = 0;
-static const int kMotorStrideInt32 = 4;
-static const int kMotorOffsetBool = 0;
-static const int kMotorStrideBool = 4;
-static const int kMotorOffsetUint16 = 0;
-static const int kMotorStrideUint16 = 2;
-
-// Print with stream operator
-template<class T> inline Print& operator <<(Print &obj,     T arg) { obj.print(arg);    return obj; }
-template<>        inline Print& operator <<(Print &obj, float arg) { obj.print(arg, 4); return obj; }
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+/* Line formatting ------------------------------------------------------------
+* Commands are assembled in a fixed stack buffer and written with a single
+* Stream::write() call. This avoids the String heap churn of the old
+* implementation (which fragments small AVR/ESP heaps) and the many one-byte
+* writes of the Print << chain. Floats are formatted with 4 decimals by
+* integer math because AVR's printf has no %f support.
+*/
+
+static size_t append_int(char* buf, long value) {
+    size_t len = 0;
+    if (value < 0) {
+        buf[len++] = '-';
+        value = -value;
+    }
+    char digits[12];
+    size_t n = 0;
+    do {
+        digits[n++] = '0' + (value % 10);
+        value /= 10;
+    } while (value);
+    while (n)
+        buf[len++] = digits[--n];
+    return len;
+}
+
+static size_t append_float(char* buf, float value) {
+    size_t len = 0;
+    if (value < 0.0f) {
+        buf[len++] = '-';
+        value = -value;
+    }
+    long whole = (long)value;
+    long frac = (long)((value - (float)whole) * 10000.0f + 0.5f);
+    if (frac >= 10000) { // rounding overflowed into the integer part
+        whole++;
+        frac = 0;
+    }
+    len += append_int(buf + len, whole);
+    buf[len++] = '.';
+    for (long div = 1000; div; div /= 10)
+        buf[len++] = '0' + (frac / div) % 10;
+    return len;
+}
 
 ODriveArduino::ODriveArduino(Stream& serial)
     : serial_(serial) {}
 
+// @brief Appends the optional checksum and newline to a command that
+// starts at buf and ends at len. Returns the new length.
+size_t ODriveArduino::FinishLine(char* buf, size_t len) {
+    if (use_checksum_) {
+        uint8_t checksum = 0;
+        for (size_t i = 0; i < len; ++i)
+            checksum ^= buf[i];
+        buf[len++] = '*';
+        len += append_int(buf + len, checksum);
+    }
+    buf[len++] = '\n';
+    return len;
+}
+
+// @brief Finishes and writes a single line in one call.
+void ODriveArduino::SendLine(const char* line) {
+    char buf[80];
+    size_t len = strlen(line);
+    if (len > sizeof(buf) - 6)
+        len = sizeof(buf) - 6; // leave room for "*NNN\n"
+    memcpy(buf, line, len);
+    serial_.write((const uint8_t*)buf, FinishLine(buf, len));
+}
+
 void ODriveArduino::SetPosition(int motor_number, float position) {
     SetPosition(motor_number, position, 0.0f, 0.0f);
 }
@@ -27,7 +86,19 @@ void ODriveArduino::SetPosition(int motor_number, float position, float velocity
 }
 
 void ODriveArduino::SetPosition(int motor_number, float position, float velocity_feedforward, float current_feedforward) {
-    serial_ << "p " << motor_number  << " " << position << " " << velocity_feedforward << " " << current_feedforward << "\n";
+    char line[64];
+    size_t len = 0;
+    line[len++] = 'p';
+    line[len++] = ' ';
+    len += append_int(line + len, motor_number);
+    line[len++] = ' ';
+    len += append_float(line + len, position);
+    line[len++] = ' ';
+    len += append_float(line + len, velocity_feedforward);
+    line[len++] = ' ';
+    len += append_float(line + len, current_feedforward);
+    line[len] = 0;
+    SendLine(line);
 }
 
 void ODriveArduino::SetVelocity(int motor_number, float velocity) {
@@ -35,57 +106,233 @@ void ODriveArduino::SetVelocity(int motor_number, float velocity) {
 }
 
 void ODriveArduino::SetVelocity(int motor_number, float velocity, float current_feedforward) {
-    serial_ << "v " << motor_number  << " " << velocity << " " << current_feedforward << "\n";
+    char line[48];
+    size_t len = 0;
+    line[len++] = 'v';
+    line[len++] = ' ';
+    len += append_int(line + len, motor_number);
+    line[len++] = ' ';
+    len += append_float(line + len, velocity);
+    line[len++] = ' ';
+    len += append_float(line + len, current_feedforward);
+    line[len] = 0;
+    SendLine(line);
 }
 
 void ODriveArduino::SetCurrent(int motor_number, float current) {
-    serial_ << "c " << motor_number << " " << current << "\n";
+    char line[32];
+    size_t len = 0;
+    line[len++] = 'c';
+    line[len++] = ' ';
+    len += append_int(line + len, motor_number);
+    line[len++] = ' ';
+    len += append_float(line + len, current);
+    line[len] = 0;
+    SendLine(line);
 }
 
-void ODriveArduino::TrapezoidalMove(int motor_number, float position){
-    serial_ << "t " << motor_number << " " << position << "\n";
+void ODriveArduino::TrapezoidalMove(int motor_number, float position) {
+    char line[32];
+    size_t len = 0;
+    line[len++] = 't';
+    line[len++] = ' ';
+    len += append_int(line + len, motor_number);
+    line[len++] = ' ';
+    len += append_float(line + len, position);
+    line[len] = 0;
+    SendLine(line);
 }
 
-float ODriveArduino::readFloat() {
-    return readString().toFloat();
+bool ODriveArduino::RequestFeedback(bool include_current) {
+    if (busy_)
+        return false;
+    SendLine(include_current ? "fi" : "f");
+    fb_stride_ = include_current ? 3 : 2;
+    busy_ = true;
+    reply_ready_ = false;
+    rx_len_ = 0;
+    return true;
+}
+
+bool ODriveArduino::SetPositionWithFeedback(int motor_number, float position,
+        float velocity_feedforward, float current_feedforward, bool include_current) {
+    if (busy_)
+        return false;
+    // setpoint and feedback request share one write; only the feedback
+    // line produces a reply
+    char buf[80];
+    size_t len = 0;
+    buf[len++] = 'p';
+    buf[len++] = ' ';
+    len += append_int(buf + len, motor_number);
+    buf[len++] = ' ';
+    len += append_float(buf + len, position);
+    buf[len++] = ' ';
+    len += append_float(buf + len, velocity_feedforward);
+    buf[len++] = ' ';
+    len += append_float(buf + len, current_feedforward);
+    len = FinishLine(buf, len);
+    buf[len++] = 'f';
+    if (include_current)
+        buf[len++] = 'i';
+    size_t line_start = len - (include_current ? 2 : 1);
+    len = line_start + FinishLine(buf + line_start, len - line_start);
+    serial_.write((const uint8_t*)buf, len);
+    fb_stride_ = include_current ? 3 : 2;
+    busy_ = true;
+    reply_ready_ = false;
+    rx_len_ = 0;
+    return true;
+}
+
+bool ODriveArduino::RequestProperty(const char* path) {
+    if (busy_)
+        return false;
+    char line[64];
+    line[0] = 'r';
+    line[1] = ' ';
+    size_t len = strlen(path);
+    if (len > sizeof(line) - 3)
+        len = sizeof(line) - 3;
+    memcpy(line + 2, path, len);
+    line[2 + len] = 0;
+    SendLine(line);
+    busy_ = true;
+    reply_ready_ = false;
+    rx_len_ = 0;
+    return true;
+}
+
+bool ODriveArduino::Poll() {
+    while (serial_.available()) {
+        char c = serial_.read();
+        if (c == '\r')
+            continue;
+        if (c != '\n') {
+            if (rx_len_ < kRxBufLen)
+                rx_buf_[rx_len_++] = c;
+            continue;
+        }
+
+        // end of line: validate the checksum (if any) and strip it
+        rx_buf_[rx_len_] = 0;
+        size_t len = rx_len_;
+        rx_len_ = 0;
+        if (use_checksum_) {
+            uint8_t checksum = 0;
+            size_t star = 0;
+            while (star < len && rx_buf_[star] != '*')
+                checksum ^= rx_buf_[star++];
+            if (star >= len || (uint8_t)atoi(rx_buf_ + star + 1) != checksum)
+                continue; // corrupted or unchecksummed line: drop it
+            rx_buf_[star] = 0;
+        }
+        if (!busy_)
+            continue; // unsolicited line (e.g. startup noise)
+        busy_ = false;
+        reply_ready_ = true;
+        return true;
+    }
+    return false;
+}
+
+// @brief Returns the index-th whitespace-separated float of the reply.
+float ODriveArduino::NthFloat(int index) const {
+    const char* cursor = rx_buf_;
+    for (int i = 0; i < index; ++i) {
+        cursor = strchr(cursor, ' ');
+        if (!cursor)
+            return 0.0f;
+        ++cursor;
+    }
+    return strtod(cursor, nullptr);
+}
+
+float ODriveArduino::Position(int motor_number) const {
+    return NthFloat(fb_stride_ * motor_number);
+}
+
+float ODriveArduino::Velocity(int motor_number) const {
+    return NthFloat(fb_stride_ * motor_number + 1);
+}
+
+float ODriveArduino::Current(int motor_number) const {
+    return fb_stride_ < 3 ? 0.0f : NthFloat(fb_stride_ * motor_number + 2);
 }
 
-float ODriveArduino::GetVelocity(int motor_number){
-	serial_<< "r axis" << motor_number << ".encoder.vel_estimate\n";
-	return ODriveArduino::readFloat();
+float ODriveArduino::ReplyFloat() const {
+    return reply_ready_ ? strtod(rx_buf_, nullptr) : 0.0f;
+}
+
+int32_t ODriveArduino::ReplyInt() const {
+    return reply_ready_ ? atol(rx_buf_) : 0;
+}
+
+bool ODriveArduino::WaitForReply(unsigned long timeout_ms) {
+    unsigned long start = millis();
+    while (!Poll()) {
+        if (millis() - start >= timeout_ms) {
+            busy_ = false; // allow the next request despite the lost reply
+            return false;
+        }
+    }
+    return true;
+}
+
+float ODriveArduino::GetPosition(int motor_number, unsigned long timeout_ms) {
+    char path[32];
+    size_t len = 0;
+    memcpy(path + len, "axis", 4); len += 4;
+    len += append_int(path + len, motor_number);
+    memcpy(path + len, ".encoder.pos_estimate", 22); // includes terminator
+    RequestProperty(path);
+    return WaitForReply(timeout_ms) ? ReplyFloat() : 0.0f;
+}
+
+float ODriveArduino::GetVelocity(int motor_number, unsigned long timeout_ms) {
+    char path[32];
+    size_t len = 0;
+    memcpy(path + len, "axis", 4); len += 4;
+    len += append_int(path + len, motor_number);
+    memcpy(path + len, ".encoder.vel_estimate", 22); // includes terminator
+    RequestProperty(path);
+    return WaitForReply(timeout_ms) ? ReplyFloat() : 0.0f;
+}
+
+float ODriveArduino::readFloat() {
+    busy_ = true; // a request was issued out-of-band
+    return WaitForReply(1000) ? ReplyFloat() : 0.0f;
 }
 
 int32_t ODriveArduino::readInt() {
-    return readString().toInt();
+    busy_ = true;
+    return WaitForReply(1000) ? ReplyInt() : 0;
 }
 
 bool ODriveArduino::run_state(int axis, int requested_state, bool wait) {
     int timeout_ctr = 100;
-    serial_ << "w axis" << axis << ".requested_state " << requested_state << '\n';
+
+    char line[48];
+    size_t len = 0;
+    memcpy(line + len, "w axis", 6); len += 6;
+    len += append_int(line + len, axis);
+    memcpy(line + len, ".requested_state ", 17); len += 17;
+    len += append_int(line + len, requested_state);
+    line[len] = 0;
+    SendLine(line);
+
     if (wait) {
+        char path[32];
+        len = 0;
+        memcpy(path + len, "axis", 4); len += 4;
+        len += append_int(path + len, axis);
+        memcpy(path + len, ".current_state", 15); // includes terminator
         do {
             delay(100);
-            serial_ << "r axis" << axis << ".current_state\n";
-        } while (readInt() != AXIS_STATE_IDLE && --timeout_ctr > 0);
+            RequestProperty(path);
+            WaitForReply(1000);
+        } while (ReplyInt() != AXIS_STATE_IDLE && --timeout_ctr > 0);
     }
 
     return timeout_ctr > 0;
 }
-
-String ODriveArduino::readString() {
-    String str = "";
-    static const unsigned long timeout = 1000;
-    unsigned long timeout_start = millis();
-    for (;;) {
-        while (!serial_.available()) {
-            if (millis() - timeout_start >= timeout) {
-                return str;
-            }
-        }
-        char c = serial_.read();
-        if (c == '\n')
-            break;
-        str += c;
-    }
-    return str;
-}
@@ -20,7 +20,12 @@ public:
 
     ODriveArduino(Stream& serial);
 
-    // Commands
+    // @brief Appends a GCode style checksum ("*NN") to every command and
+    // verifies it on every reply. Corrupted replies are silently dropped,
+    // so a request may time out instead of returning garbage.
+    void SetChecksum(bool enable) { use_checksum_ = enable; }
+
+    // Commands (fire-and-forget, never block)
     void SetPosition(int motor_number, float position);
     void SetPosition(int motor_number, float position, float velocity_feedforward);
     void SetPosition(int motor_number, float position, float velocity_feedforward, float current_feedforward);
@@ -28,18 +33,75 @@ public:
     void SetVelocity(int motor_number, float velocity, float current_feedforward);
     void SetCurrent(int motor_number, float current);
     void TrapezoidalMove(int motor_number, float position);
-    // Getters
-    float GetVelocity(int motor_number);
-    // General params
+
+    /* Non-blocking request interface ------------------------------------
+    * Issue a request, keep running the control loop, and consume the
+    * reply once Poll() reports it complete:
+    *
+    *     odrive.RequestFeedback();
+    *     ...
+    *     if (odrive.Poll()) {
+    *         float pos = odrive.Position(0);
+    *         float vel = odrive.Velocity(0);
+    *     }
+    *
+    * Only one request may be outstanding at a time; Busy() tells whether
+    * the previous reply is still pending.
+    */
+
+    // @brief Requests position and velocity of all axes in a single
+    // round trip (the "f" command: "pos0 vel0 pos1 vel1"). With
+    // include_current the "fi" form is used and each axis group also
+    // carries the measured motor current.
+    bool RequestFeedback(bool include_current = false);
+    // @brief Sends a position setpoint and requests feedback in the same
+    // transaction: both lines go out in one write and only the feedback
+    // reply comes back, so the common control-loop pattern costs a
+    // single round trip per cycle.
+    bool SetPositionWithFeedback(int motor_number, float position,
+            float velocity_feedforward = 0.0f, float current_feedforward = 0.0f,
+            bool include_current = false);
+    // @brief Requests a single property ("r <path>").
+    bool RequestProperty(const char* path);
+    // @brief Consumes pending serial bytes. Returns true once a complete
+    // (and, with checksums enabled, valid) reply line has been received.
+    // Call this from the main loop; it never blocks.
+    bool Poll();
+    bool Busy() const { return busy_; }
+
+    // Reply accessors, valid after Poll() returned true
+    float Position(int motor_number) const;  // from RequestFeedback()
+    float Velocity(int motor_number) const;  // from RequestFeedback()
+    float Current(int motor_number) const;   // from RequestFeedback(true)
+    float ReplyFloat() const;
+    int32_t ReplyInt() const;
+    const char* Reply() const { return rx_buf_; }
+
+    // Blocking getters (built on the non-blocking machinery, fixed
+    // buffers only). They spin for at most timeout_ms.
+    float GetPosition(int motor_number, unsigned long timeout_ms = 1000);
+    float GetVelocity(int motor_number, unsigned long timeout_ms = 1000);
     float readFloat();
     int32_t readInt();
 
     // State helper
     bool run_state(int axis, int requested_state, bool wait);
+
 private:
-    String readString();
+    size_t FinishLine(char* buf, size_t len);
+    void SendLine(const char* line);
+    bool WaitForReply(unsigned long timeout_ms);
+    float NthFloat(int index) const;
+
+    static const size_t kRxBufLen = 160; // matches the firmware's feedback line bound
 
     Stream& serial_;
+    char rx_buf_[kRxBufLen + 1];
+    size_t rx_len_ = 0;
+    bool busy_ = false;
+    bool reply_ready_ = false;
+    bool use_checksum_ = false;
+    int fb_stride_ = 2; // floats per axis group in the last feedback reply
 };
 
 #endif //ODriveArduino_h
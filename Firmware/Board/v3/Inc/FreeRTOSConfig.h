@@ -93,7 +93,15 @@
 #endif
 
 #define configUSE_PREEMPTION                     1
+#ifdef STATIC_ALLOCATION_ONLY
+/* Static allocation build (CONFIG_STATIC_ALLOCATION): long-lived objects
+ * come from link-time storage (see freertos_vars.h); the heap only backs
+ * the transient self-deleting threads and is sized for their worst-case
+ * concurrency (both axis service threads + one-shot setup/save threads). */
+#define configSUPPORT_STATIC_ALLOCATION          1
+#else
 #define configSUPPORT_STATIC_ALLOCATION          0
+#endif
 #define configSUPPORT_DYNAMIC_ALLOCATION         1
 #define configUSE_IDLE_HOOK                      1
 #define configUSE_TICK_HOOK                      0
@@ -101,7 +109,11 @@
 #define configTICK_RATE_HZ                       ((TickType_t)1000)
 #define configMAX_PRIORITIES                     ( 7 )
 #define configMINIMAL_STACK_SIZE                 ((uint16_t)128)
+#ifdef STATIC_ALLOCATION_ONLY
+#define configTOTAL_HEAP_SIZE                    ((size_t)28672)
+#else
 #define configTOTAL_HEAP_SIZE                    ((size_t)65536)
+#endif
 #define configMAX_TASK_NAME_LEN                  ( 16 )
 #define configUSE_16_BIT_TICKS                   0
 #define configUSE_MUTEXES                        1
@@ -109,6 +121,34 @@
 #define configCHECK_FOR_STACK_OVERFLOW           1
 #define configUSE_PORT_OPTIMISED_TASK_SELECTION  1
 
+/* Tickless idle: stop the 1kHz scheduler tick and WFI in the idle task when
+nothing is runnable. The control path is unaffected - the TIM/ADC interrupts
+fire and wake the core from sleep regardless of the scheduler. The sleep
+hooks (MotorControl/main.cpp) keep the standby bookkeeping in system_stats;
+note the run time stats counter below is the DWT cycle counter, which halts
+while the core sleeps, so slept time is charged to no thread at all rather
+than to the idle task. */
+#define configUSE_TICKLESS_IDLE                  1
+#if defined(__ICCARM__) || defined(__CC_ARM) || defined(__GNUC__)
+    extern void tickless_pre_sleep(uint32_t* modifiable_idle_ticks);
+    extern void tickless_post_sleep(uint32_t* expected_idle_ticks);
+#endif
+#define configPRE_SLEEP_PROCESSING( x )          tickless_pre_sleep( x )
+#define configPOST_SLEEP_PROCESSING( x )         tickless_post_sleep( x )
+
+/* Run time and task stats gathering, used for the per-thread CPU load
+accounting in system_stats (see update_cpu_load in MotorControl/main.cpp).
+The run time counter is the DWT cycle counter (32 bit at the core clock,
+enabled by Profiler::init); TIM13 is only 16 bit and would wrap within a
+single time slice. */
+#define configUSE_TRACE_FACILITY                 1
+#define configGENERATE_RUN_TIME_STATS            1
+#if defined(__ICCARM__) || defined(__CC_ARM) || defined(__GNUC__)
+    extern uint32_t thread_cpu_runtime_counter(void);
+#endif
+#define portCONFIGURE_TIMER_FOR_RUN_TIME_STATS()
+#define portGET_RUN_TIME_COUNTER_VALUE()         thread_cpu_runtime_counter()
+
 /* Co-routine definitions. */
 #define configUSE_CO_ROUTINES                    0
 #define configMAX_CO_ROUTINE_PRIORITIES          ( 2 )
@@ -124,6 +164,7 @@ to exclude the API function. */
 #define INCLUDE_vTaskDelay                  1
 #define INCLUDE_xTaskGetSchedulerState      1
 #define INCLUDE_uxTaskGetStackHighWaterMark 1
+#define INCLUDE_xTaskGetIdleTaskHandle      1
 
 /* Cortex-M specific definitions. */
 #ifdef __NVIC_PRIO_BITS
@@ -2,11 +2,49 @@
 #ifndef __FREERTOS_H
 #define __FREERTOS_H
 
+/* Static allocation build mode ----------------------------------------------
+ * With CONFIG_STATIC_ALLOCATION=true (-DSTATIC_ALLOCATION_ONLY) RAM
+ * budgeting becomes a link-time exercise instead of trial and error
+ * against min_heap_space:
+ *  - every long-lived thread, semaphore and mutex is created from
+ *    link-time storage via the os*DefStatic macros below (stacks go to
+ *    CCM, where the heap that used to back them lives in the default
+ *    build), so each stack and buffer is a named symbol in the .map file
+ *  - the large runtime buffers (blackbox ring, anticogging maps, the
+ *    one-shot tree-build stack) become static arrays at their call sites
+ *  - newlib's _sbrk traps (syscalls.c), so any hidden malloc halts
+ *    loudly instead of silently eating RAM
+ *  - the FreeRTOS heap shrinks (FreeRTOSConfig.h) and only backs the
+ *    transient self-deleting threads (axis service threads, config save,
+ *    axis setup, CAN server restarts). Those must stay heap-allocated:
+ *    a statically allocated TCB may only be reused after the idle task
+ *    has processed the deleted task, which recreated threads can't
+ *    guarantee.
+ */
+#ifdef STATIC_ALLOCATION_ONLY
+#define osThreadDefStatic(name, thread, priority, instances, stacksz) \
+    static __attribute__((section(".ccmram"))) StackType_t os_thread_stack_##name[stacksz]; \
+    static __attribute__((section(".ccmram"))) StaticTask_t os_thread_control_##name; \
+    osThreadStaticDef(name, (thread), (priority), (instances), (stacksz), os_thread_stack_##name, &os_thread_control_##name)
+#define osSemaphoreDefStatic(name) \
+    static StaticSemaphore_t os_semaphore_control_##name; \
+    osSemaphoreStaticDef(name, &os_semaphore_control_##name)
+#define osMutexDefStatic(name) \
+    static StaticSemaphore_t os_mutex_control_##name; \
+    osMutexStaticDef(name, &os_mutex_control_##name)
+#else
+#define osThreadDefStatic osThreadDef
+#define osSemaphoreDefStatic osSemaphoreDef
+#define osMutexDefStatic osMutexDef
+#endif
+
 // List of semaphores
 extern osSemaphoreId sem_usb_irq;
 extern osSemaphoreId sem_uart_dma;
 extern osSemaphoreId sem_usb_rx;
 extern osSemaphoreId sem_usb_tx;
+extern osSemaphoreId sem_usb_tx_native;
+extern osSemaphoreId sem_telemetry;
 
 extern osThreadId defaultTaskHandle;
 extern osThreadId usb_irq_thread;
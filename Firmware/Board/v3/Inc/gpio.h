@@ -71,6 +71,7 @@ void MX_GPIO_Init(void);
 /* USER CODE BEGIN Prototypes */
 
 void SetGPIO12toUART();
+void SetGPIO12toGPIO();
 bool GPIO_subscribe(GPIO_TypeDef* GPIO_port, uint16_t GPIO_pin,
     uint32_t pull_up_down,
     void (*callback)(void*), void* ctx);
@@ -72,7 +72,14 @@
 #define TIM_APB1_CLOCK_HZ 84000000
 #define TIM_APB1_PERIOD_CLOCKS 4096
 #define TIM_APB1_DEADTIME_CLOCKS 40
+// The repetition counter selects the control loop rate as a fraction of the
+// PWM carrier (see CURRENT_MEAS_HZ). It can be overridden from the build
+// config (CONFIG_CONTROL_FREQ in tup.config) for high or low rate builds.
+#ifdef TIM_1_8_RCR_OVERRIDE
+#define TIM_1_8_RCR TIM_1_8_RCR_OVERRIDE
+#else
 #define TIM_1_8_RCR 2
+#endif
 
 #define M0_nCS_Pin GPIO_PIN_13
 #define M0_nCS_GPIO_Port GPIOC
@@ -0,0 +1,63 @@
+#ifndef __NVIC_PRIORITIES_H
+#define __NVIC_PRIORITIES_H
+
+/*
+* Central NVIC preemption priority map (NVIC_PRIORITYGROUP_4: 4 preemption
+* bits, no sub-priority). All HAL_NVIC_SetPriority calls in Board/v3/Src
+* take their priority from here, so the partitioning is declared and
+* checked in one place instead of being scattered through init code:
+*
+*     fault >= control timer > control ADC > encoder > comm > OS tick
+*
+* Rationale per tier:
+*  - control timer: TIM1/TIM8 update events apply the SVM timings and the
+*    PWM safety logic; nothing may delay them.
+*  - control ADC: the current sampling / control hot path. Pinned at the
+*    FreeRTOS syscall limit (configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY
+*    = 5) because the handler signals RTOS semaphores; it cannot be raised
+*    above that without losing the RTOS API.
+*  - encoder: index pulse and step/dir EXTI lines plus the encoder SPI DMA
+*    streams. These used to run at priority 0, where any GPIO edge could
+*    preempt the control timer handler.
+*  - comm: UART DMA, USB, I2C, CAN and PWM input capture. These used to
+*    share priority 5 with the ADC, so a comm burst could hold off current
+*    sampling by a full handler - the inversion this table removes.
+*/
+
+#define NVIC_PRIO_FAULT          0  // MemManage / BusFault / UsageFault / SVCall
+#define NVIC_PRIO_CONTROL_TIMER  0  // TIM1/TIM8 update: PWM safety and SVM timing
+#define NVIC_PRIO_CONTROL_ADC    5  // current sampling and in-ISR control
+#define NVIC_PRIO_ENCODER        6  // index / step-dir EXTI, encoder SPI DMA
+#define NVIC_PRIO_COMM           7  // UART DMA, USB, I2C, CAN, PWM input capture
+#define NVIC_PRIO_OS_TICK       15  // SysTick / PendSV
+
+// [TIM_1_8 clocks] Trigger-to-entry latency budget for the ADC handler:
+// conversion time plus dispatch overhead with generous margin. With the
+// comm tier strictly below the ADC priority, exceeding this means the
+// handler was held off by something at or above its own level (or a
+// PRIMASK section) - a priority inversion in the partition above.
+#define NVIC_AUDIT_ADC_LATENCY_BUDGET 1000
+
+// The partitioning is part of the control loop's timing contract; break
+// the build rather than silently reordering it. (Preprocessor checks so
+// this header stays usable from both the C HAL code and C++.)
+#if NVIC_PRIO_FAULT > NVIC_PRIO_CONTROL_TIMER
+#error "fault handlers must not run below the control timer"
+#endif
+#if NVIC_PRIO_CONTROL_TIMER >= NVIC_PRIO_CONTROL_ADC
+#error "the control timer must preempt the ADC handler"
+#endif
+#if NVIC_PRIO_CONTROL_ADC != 5
+#error "the ADC handler must sit exactly at configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY (it signals RTOS semaphores)"
+#endif
+#if NVIC_PRIO_CONTROL_ADC >= NVIC_PRIO_ENCODER
+#error "encoder interrupts must not delay current sampling"
+#endif
+#if NVIC_PRIO_ENCODER >= NVIC_PRIO_COMM
+#error "comm interrupts must not delay encoder interrupts"
+#endif
+#if NVIC_PRIO_COMM >= NVIC_PRIO_OS_TICK
+#error "the OS tick must be the lowest priority"
+#endif
+
+#endif // __NVIC_PRIORITIES_H
@@ -80,6 +80,12 @@
 /* It's up to user to redefine and/or remove those define */
 #define USB_RX_DATA_SIZE  64
 #define USB_TX_DATA_SIZE  64
+/* The vendor-specific (native) interface accepts multi-packet bulk
+   transfers: one submission covers up to 8 packets, which the OTG core
+   sends back-to-back without waking the communication thread in between.
+   The CDC pipe keeps single-packet transfers (its line-discipline framing
+   gains nothing from larger transfers). */
+#define ODRIVE_USB_TX_DATA_SIZE  512
 #define APP_RX_DATA_SIZE  USB_RX_DATA_SIZE
 #define APP_TX_DATA_SIZE  USB_TX_DATA_SIZE
 /* USER CODE END EXPORTED_DEFINES */
@@ -135,6 +141,7 @@ extern USBD_CDC_ItfTypeDef USBD_Interface_fops_FS;
 uint8_t CDC_Transmit_FS(uint8_t* Buf, uint16_t Len, uint8_t endpoint_pair);
 
 /* USER CODE BEGIN EXPORTED_FUNCTIONS */
+uint8_t CDC_Transmit_Busy(uint8_t endpoint_pair);
 /* USER CODE END EXPORTED_FUNCTIONS */
 
 /**
@@ -49,6 +49,7 @@
 
 /* Includes ------------------------------------------------------------------*/
 #include "can.h"
+#include "nvic_priorities.h"
 
 #include "gpio.h"
 
@@ -105,13 +106,13 @@ void HAL_CAN_MspInit(CAN_HandleTypeDef* canHandle)
     HAL_GPIO_Init(GPIOB, &GPIO_InitStruct);
 
     /* CAN1 interrupt Init */
-    HAL_NVIC_SetPriority(CAN1_TX_IRQn, 6, 0);
+    HAL_NVIC_SetPriority(CAN1_TX_IRQn, NVIC_PRIO_COMM, 0);
     HAL_NVIC_EnableIRQ(CAN1_TX_IRQn);
-    HAL_NVIC_SetPriority(CAN1_RX0_IRQn, 6, 0);
+    HAL_NVIC_SetPriority(CAN1_RX0_IRQn, NVIC_PRIO_COMM, 0);
     HAL_NVIC_EnableIRQ(CAN1_RX0_IRQn);
-    HAL_NVIC_SetPriority(CAN1_RX1_IRQn, 6, 0);
+    HAL_NVIC_SetPriority(CAN1_RX1_IRQn, NVIC_PRIO_COMM, 0);
     HAL_NVIC_EnableIRQ(CAN1_RX1_IRQn);
-    HAL_NVIC_SetPriority(CAN1_SCE_IRQn, 6, 0);
+    HAL_NVIC_SetPriority(CAN1_SCE_IRQn, NVIC_PRIO_COMM, 0);
     HAL_NVIC_EnableIRQ(CAN1_SCE_IRQn);
   /* USER CODE BEGIN CAN1_MspInit 1 */
 
@@ -58,6 +58,8 @@
 /* USER CODE BEGIN Includes */     
 #include "freertos_vars.h"
 #include "usb_device.h"
+#include <communication/interface_usb.h>
+#include <MotorControl/utils.h>
 extern PCD_HandleTypeDef hpcd_USB_OTG_FS;
 int odrive_main(void);
 int load_configuration(void);
@@ -85,6 +87,8 @@ osSemaphoreId sem_usb_irq;
 osSemaphoreId sem_uart_dma;
 osSemaphoreId sem_usb_rx;
 osSemaphoreId sem_usb_tx;
+osSemaphoreId sem_usb_tx_native;
+osSemaphoreId sem_telemetry;
 
 osThreadId usb_irq_thread;
 
@@ -138,8 +142,17 @@ void usb_deferred_interrupt_thread(void * ctx) {
         // Wait for signalling from USB interrupt (OTG_FS_IRQHandler)
         osStatus semaphore_status = osSemaphoreWait(sem_usb_irq, osWaitForever);
         if (semaphore_status == osOK) {
-            // We have a new incoming USB transmission: handle it
+            // We have a new incoming USB transmission: handle it.
+            // This runs the HAL FIFO handling and the CDC callbacks; the
+            // callbacks only hand buffers off to the USB server thread, so
+            // this pass is bounded by the FIFO copies. The worst case is
+            // tracked so bench measurements of streaming-induced jitter
+            // have a number to correlate against.
+            uint32_t start_us = micros();
             HAL_PCD_IRQHandler(&hpcd_USB_OTG_FS);
+            uint32_t duration_us = micros() - start_us;
+            if (duration_us > usb_stats_.max_irq_duration_us)
+                usb_stats_.max_irq_duration_us = duration_us;
             // Let the irq (OTG_FS_IRQHandler) fire again.
             HAL_NVIC_EnableIRQ(OTG_FS_IRQn);
         }
@@ -148,10 +161,24 @@ void usb_deferred_interrupt_thread(void * ctx) {
 
 void init_deferred_interrupts(void) {
     // Start USB interrupt handler thread
-    osThreadDef(task_usb_pump, usb_deferred_interrupt_thread, osPriorityAboveNormal, 0, 512);
+    osThreadDefStatic(task_usb_pump, usb_deferred_interrupt_thread, osPriorityAboveNormal, 0, 512);
     usb_irq_thread = osThreadCreate(osThread(task_usb_pump), NULL);
 }
 
+#ifdef STATIC_ALLOCATION_ONLY
+// With configSUPPORT_STATIC_ALLOCATION the kernel asks the application for
+// the idle task's storage instead of taking it from the heap.
+static StaticTask_t idle_task_control;
+static __attribute__((section(".ccmram"))) StackType_t idle_task_stack[configMINIMAL_STACK_SIZE];
+void vApplicationGetIdleTaskMemory(StaticTask_t **ppxIdleTaskTCBBuffer,
+                                   StackType_t **ppxIdleTaskStackBuffer,
+                                   uint32_t *pulIdleTaskStackSize) {
+    *ppxIdleTaskTCBBuffer = &idle_task_control;
+    *ppxIdleTaskStackBuffer = idle_task_stack;
+    *pulIdleTaskStackSize = configMINIMAL_STACK_SIZE;
+}
+#endif
+
 /* USER CODE END 4 */
 
 /**
@@ -170,22 +197,43 @@ void MX_FREERTOS_Init(void) {
 
   /* USER CODE BEGIN RTOS_SEMAPHORES */
   // Init usb irq binary semaphore, and start with no tokens by removing the starting one.
-  osSemaphoreDef(sem_usb_irq);
+  osSemaphoreDefStatic(sem_usb_irq);
   sem_usb_irq = osSemaphoreCreate(osSemaphore(sem_usb_irq), 1);
   osSemaphoreWait(sem_usb_irq, 0);
 
   // Create a semaphore for UART DMA and remove a token
-  osSemaphoreDef(sem_uart_dma);
+  osSemaphoreDefStatic(sem_uart_dma);
   sem_uart_dma = osSemaphoreCreate(osSemaphore(sem_uart_dma), 1);
+#ifdef STATIC_ALLOCATION_ONLY
+  // statically created binary semaphores start empty (dynamically created
+  // ones start with a token), so the token-holding ones get theirs here
+  osSemaphoreRelease(sem_uart_dma);
+#endif
 
   // Create a semaphore for USB RX
-  osSemaphoreDef(sem_usb_rx);
+  osSemaphoreDefStatic(sem_usb_rx);
   sem_usb_rx = osSemaphoreCreate(osSemaphore(sem_usb_rx), 1);
   osSemaphoreWait(sem_usb_rx, 0);  // Remove a token.
 
   // Create a semaphore for USB TX
-  osSemaphoreDef(sem_usb_tx);
+  osSemaphoreDefStatic(sem_usb_tx);
   sem_usb_tx = osSemaphoreCreate(osSemaphore(sem_usb_tx), 1);
+#ifdef STATIC_ALLOCATION_ONLY
+  osSemaphoreRelease(sem_usb_tx);
+#endif
+
+  // Create a separate TX semaphore for the vendor-specific (native)
+  // endpoint pair so bulk transfers don't serialize against the CDC pipe
+  osSemaphoreDefStatic(sem_usb_tx_native);
+  sem_usb_tx_native = osSemaphoreCreate(osSemaphore(sem_usb_tx_native), 1);
+#ifdef STATIC_ALLOCATION_ONLY
+  osSemaphoreRelease(sem_usb_tx_native);
+#endif
+
+  // Create a semaphore to signal pending telemetry frames and remove the starting token
+  osSemaphoreDefStatic(sem_telemetry);
+  sem_telemetry = osSemaphoreCreate(osSemaphore(sem_telemetry), 1);
+  osSemaphoreWait(sem_telemetry, 0);
 
   init_deferred_interrupts();
 
@@ -199,7 +247,7 @@ void MX_FREERTOS_Init(void) {
 
   /* Create the thread(s) */
   /* definition and creation of defaultTask */
-  osThreadDef(defaultTask, StartDefaultTask, osPriorityNormal, 0, 256);
+  osThreadDefStatic(defaultTask, StartDefaultTask, osPriorityNormal, 0, 256);
   defaultTaskHandle = osThreadCreate(osThread(defaultTask), NULL);
 
   /* USER CODE BEGIN RTOS_THREADS */
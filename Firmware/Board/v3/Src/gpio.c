@@ -49,6 +49,7 @@
 
 /* Includes ------------------------------------------------------------------*/
 #include "gpio.h"
+#include "nvic_priorities.h"
 /* USER CODE BEGIN 0 */
 #include <stdbool.h>
 
@@ -191,15 +192,35 @@ void SetGPIO12toUART() {
   HAL_GPIO_Init(GPIO_2_GPIO_Port, &GPIO_InitStruct);
 }
 
-// Expected subscriptions: 2x step signal + 2x encoder index signal
-#define MAX_SUBSCRIPTIONS 10
+// @brief Reverts GPIO's 1 and 2 from UART mode back to plain inputs,
+// the inverse of SetGPIO12toUART. Used by the runtime interface
+// reconfiguration; interrupt subscribers have to re-subscribe.
+void SetGPIO12toGPIO() {
+  GPIO_InitTypeDef GPIO_InitStruct;
+  GPIO_InitStruct.Mode = GPIO_MODE_INPUT;
+  GPIO_InitStruct.Pull = GPIO_NOPULL;
+
+  GPIO_InitStruct.Pin = GPIO_1_Pin;
+  HAL_GPIO_Init(GPIO_1_GPIO_Port, &GPIO_InitStruct);
+  GPIO_InitStruct.Pin = GPIO_2_Pin;
+  HAL_GPIO_Init(GPIO_2_GPIO_Port, &GPIO_InitStruct);
+}
+
+// One slot per EXTI line, resolved at subscribe time. EXTI line n can only
+// be connected to pin n of a single port (via SYSCFG), so the line number
+// fully identifies a subscription and the interrupt dispatch is a direct
+// table index instead of a list scan.
+#define NUM_EXTI_LINES 16
 struct subscription_t {
   GPIO_TypeDef* GPIO_port;
-  uint16_t GPIO_pin;
   void (*callback)(void*);
   void* ctx;
-} subscriptions[MAX_SUBSCRIPTIONS] = { 0 };
-size_t n_subscriptions = 0;
+} subscriptions[NUM_EXTI_LINES] = { 0 };
+
+// @brief Returns the EXTI line number of a GPIO_PIN_x bitmask.
+static inline uint32_t get_exti_line(uint16_t pin) {
+  return POSITION_VAL(pin);
+}
 
 // Sets up the specified GPIO to trigger the specified callback
 // on a rising edge of the GPIO.
@@ -207,27 +228,19 @@ size_t n_subscriptions = 0;
 bool GPIO_subscribe(GPIO_TypeDef* GPIO_port, uint16_t GPIO_pin,
     uint32_t pull_up_down,
     void (*callback)(void*), void* ctx) {
-  
-  // Register handler (or reuse existing registration)
-  // TODO: make thread safe
-  struct subscription_t* subscription = NULL;
-  for (size_t i = 0; i < n_subscriptions; ++i) {
-    if (subscriptions[i].GPIO_port == GPIO_port &&
-        subscriptions[i].GPIO_pin == GPIO_pin)
-      subscription = &subscriptions[i];
-  }
-  if (!subscription) {
-    if (n_subscriptions >= MAX_SUBSCRIPTIONS)
-      return false;
-    subscription = &subscriptions[n_subscriptions++];
-  }
 
-  *subscription = (struct subscription_t){
-    .GPIO_port = GPIO_port,
-    .GPIO_pin = GPIO_pin,
-    .callback = callback,
-    .ctx = ctx
-  };
+  uint32_t line = get_exti_line(GPIO_pin);
+  if (line >= NUM_EXTI_LINES)
+    return false;
+
+  // Register handler (or replace the previous owner of the line). The
+  // callback is written last so a pending interrupt never sees a half
+  // initialized slot.
+  struct subscription_t* subscription = &subscriptions[line];
+  subscription->callback = NULL;
+  subscription->GPIO_port = GPIO_port;
+  subscription->ctx = ctx;
+  subscription->callback = callback;
 
   // Set up GPIO
   GPIO_InitTypeDef GPIO_InitStruct;
@@ -239,24 +252,32 @@ bool GPIO_subscribe(GPIO_TypeDef* GPIO_port, uint16_t GPIO_pin,
   // Clear any previous triggers
   __HAL_GPIO_EXTI_CLEAR_IT(GPIO_pin);
   // Enable interrupt
-  HAL_NVIC_SetPriority(get_irq_number(GPIO_pin), 0, 0);
+  HAL_NVIC_SetPriority(get_irq_number(GPIO_pin), NVIC_PRIO_ENCODER, 0);
   HAL_NVIC_EnableIRQ(get_irq_number(GPIO_pin));
   return true;
 }
 
 void GPIO_unsubscribe(GPIO_TypeDef* GPIO_port, uint16_t GPIO_pin) {
-  bool is_pin_in_use = false;
-  for (size_t i = 0; i < n_subscriptions; ++i) {
-    if (subscriptions[i].GPIO_port == GPIO_port &&
-        subscriptions[i].GPIO_pin == GPIO_pin) {
-      subscriptions[i].callback = NULL;
-      subscriptions[i].ctx = NULL;
-    } else if (subscriptions[i].GPIO_pin == GPIO_pin) {
-      is_pin_in_use = true;
-    }
+  uint32_t line = get_exti_line(GPIO_pin);
+  if (line >= NUM_EXTI_LINES)
+    return;
+  struct subscription_t* subscription = &subscriptions[line];
+  if (subscription->GPIO_port != NULL && subscription->GPIO_port != GPIO_port)
+    return; // the line is currently owned by a different port
+  subscription->callback = NULL;
+  subscription->ctx = NULL;
+  subscription->GPIO_port = NULL;
+
+  // Only disable the NVIC line if no other active subscription shares it
+  // (EXTI5..9 and EXTI10..15 are grouped interrupts).
+  IRQn_Type irqn = get_irq_number(GPIO_pin);
+  bool irq_in_use = false;
+  for (size_t i = 0; i < NUM_EXTI_LINES; ++i) {
+    if (subscriptions[i].callback && get_irq_number(1 << i) == irqn)
+      irq_in_use = true;
   }
-  if (!is_pin_in_use)
-    HAL_NVIC_DisableIRQ(get_irq_number(GPIO_pin));
+  if (!irq_in_use)
+    HAL_NVIC_DisableIRQ(irqn);
 }
 
 // @brief Configures the specified GPIO as an analog input.
@@ -272,11 +293,10 @@ void GPIO_set_to_analog(GPIO_TypeDef* GPIO_port, uint16_t GPIO_pin) {
 
 //Dispatch processing of external interrupts based on source
 void HAL_GPIO_EXTI_Callback(uint16_t GPIO_pin) {
-  for (size_t i = 0; i < n_subscriptions; ++i) {
-    if (subscriptions[i].GPIO_pin == GPIO_pin) // TODO: check for port
-      if (subscriptions[i].callback)
-        subscriptions[i].callback(subscriptions[i].ctx);
-  }
+  struct subscription_t* subscription = &subscriptions[get_exti_line(GPIO_pin)];
+  void (*callback)(void*) = subscription->callback;
+  if (callback)
+    callback(subscription->ctx);
 }
 
 GPIO_TypeDef* get_gpio_port_by_pin(uint16_t GPIO_pin){
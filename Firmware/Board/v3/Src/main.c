@@ -48,6 +48,7 @@
   */
 /* Includes ------------------------------------------------------------------*/
 #include "main.h"
+#include "nvic_priorities.h"
 #include "stm32f4xx_hal.h"
 #include "cmsis_os.h"
 #include "adc.h"
@@ -275,7 +276,7 @@ void SystemClock_Config(void)
   HAL_SYSTICK_CLKSourceConfig(SYSTICK_CLKSOURCE_HCLK);
 
   /* SysTick_IRQn interrupt configuration */
-  HAL_NVIC_SetPriority(SysTick_IRQn, 15, 0);
+  HAL_NVIC_SetPriority(SysTick_IRQn, NVIC_PRIO_OS_TICK, 0);
 }
 
 /* USER CODE BEGIN 4 */
@@ -65,7 +65,7 @@ void MX_GPIO_Init(void)
   HAL_GPIO_Init(nFAULT_GPIO_Port, &GPIO_InitStruct);
 
   /* EXTI interrupt init*/
-  HAL_NVIC_SetPriority(EXTI2_IRQn, 0, 0);
+  HAL_NVIC_SetPriority(EXTI2_IRQn, NVIC_PRIO_ENCODER, 0);
   HAL_NVIC_EnableIRQ(EXTI2_IRQn);
 
 }
@@ -49,6 +49,7 @@
 
 /* Includes ------------------------------------------------------------------*/
 #include "spi.h"
+#include "nvic_priorities.h"
 
 #include "gpio.h"
 #include "dma.h"
@@ -146,7 +147,7 @@ void HAL_SPI_MspInit(SPI_HandleTypeDef* spiHandle)
     __HAL_LINKDMA(spiHandle,hdmarx,hdma_spi3_rx);
 
     /* SPI3 interrupt Init */
-    HAL_NVIC_SetPriority(SPI3_IRQn, 5, 0);
+    HAL_NVIC_SetPriority(SPI3_IRQn, NVIC_PRIO_ENCODER, 0);
     HAL_NVIC_EnableIRQ(SPI3_IRQn);
   /* USER CODE BEGIN SPI3_MspInit 1 */
 
@@ -42,15 +42,15 @@
 
 typedef void (*ADC_handler_t)(ADC_HandleTypeDef* hadc, bool injected);
 void ADC_IRQ_Dispatch(ADC_HandleTypeDef* hadc, ADC_handler_t callback);
-
-typedef void (*TIM_capture_callback_t)(int channel, uint32_t timestamp);
-void decode_tim_capture(TIM_HandleTypeDef *htim, TIM_capture_callback_t callback);
+void odometer_checkpoint(void); // defined in MotorControl/main.cpp
+void adc_irq_entry_snapshot(void);
+void adc_analog_watchdog_cb(ADC_HandleTypeDef* hadc);
 
 // TODO: move somewhere else
 void pwm_trig_adc_cb(ADC_HandleTypeDef* hadc, bool injected);
+void uart4_idle_cb(void);
 void vbus_sense_adc_cb(ADC_HandleTypeDef* hadc, bool injected);
 void tim_update_cb(TIM_HandleTypeDef* htim);
-void pwm_in_cb(int channel, uint32_t timestamp);
 
 extern TIM_HandleTypeDef htim1;
 extern I2C_HandleTypeDef hi2c1;
@@ -275,6 +275,7 @@ void ADC_IRQHandler(void)
   // The HAL's ADC handling mechanism adds many clock cycles of overhead
   // So we bypass it and handle the logic ourselves.
   //@TODO add vbus measurement on adc1 here
+  adc_irq_entry_snapshot();
   ADC_IRQ_Dispatch(&hadc1, &vbus_sense_adc_cb);
   ADC_IRQ_Dispatch(&hadc2, &pwm_trig_adc_cb);
   ADC_IRQ_Dispatch(&hadc3, &pwm_trig_adc_cb);
@@ -369,8 +370,8 @@ void TIM5_IRQHandler(void)
 {
   /* USER CODE BEGIN TIM5_IRQn 0 */
 
-  // We know we only use capture mode here, so bypass HAL
-  decode_tim_capture(&htim5, &pwm_in_cb);
+  // The RC PWM captures are drained by DMA (see pwm_in_init), so this
+  // interrupt no longer fires for them.
 
   /* USER CODE END TIM5_IRQn 0 */
   HAL_TIM_IRQHandler(&htim5);
@@ -399,7 +400,7 @@ void SPI3_IRQHandler(void)
 void UART4_IRQHandler(void)
 {
   /* USER CODE BEGIN UART4_IRQn 0 */
-
+  uart4_idle_cb();
   /* USER CODE END UART4_IRQn 0 */
   HAL_UART_IRQHandler(&huart4);
   /* USER CODE BEGIN UART4_IRQn 1 */
@@ -430,8 +431,31 @@ void OTG_FS_IRQHandler(void)
 
 /* USER CODE BEGIN 1 */
 
+/**
+* @brief This function handles the PVD interrupt (EXTI line 16).
+* VDD dropped below the programmable voltage detector threshold: journal
+* the odometer counters while the regulator still holds (see
+* odometer_checkpoint in MotorControl/main.cpp).
+*/
+void PVD_IRQHandler(void)
+{
+  __HAL_PWR_PVD_EXTI_CLEAR_FLAG();
+  odometer_checkpoint();
+}
+
+// Runs from RAM: a flash prefetch miss here would add jitter ahead of
+// every control-loop callback (see RAMFUNC in utils.h)
+__attribute__((section(".ram_func")))
 void ADC_IRQ_Dispatch(ADC_HandleTypeDef* hadc, ADC_handler_t callback) {
 
+  // Analog watchdog: hardware overcurrent trip, armed in low_level.cpp
+  uint32_t AWD = __HAL_ADC_GET_FLAG(hadc, ADC_FLAG_AWD);
+  uint32_t AWD_IT_EN = __HAL_ADC_GET_IT_SOURCE(hadc, ADC_IT_AWD);
+  if (AWD && AWD_IT_EN) {
+    __HAL_ADC_CLEAR_FLAG(hadc, ADC_FLAG_AWD);
+    adc_analog_watchdog_cb(hadc);
+  }
+
   // Injected measurements
   uint32_t JEOC = __HAL_ADC_GET_FLAG(hadc, ADC_FLAG_JEOC);
   uint32_t JEOC_IT_EN = __HAL_ADC_GET_IT_SOURCE(hadc, ADC_IT_JEOC);
@@ -448,25 +472,6 @@ void ADC_IRQ_Dispatch(ADC_HandleTypeDef* hadc, ADC_handler_t callback) {
   }
 }
 
-void decode_tim_capture(TIM_HandleTypeDef *htim, TIM_capture_callback_t callback) {
-  if(__HAL_TIM_GET_FLAG(htim, TIM_FLAG_CC1)) {
-    __HAL_TIM_CLEAR_IT(htim, TIM_IT_CC1);
-    callback(1, htim->Instance->CCR1);
-  }
-  if(__HAL_TIM_GET_FLAG(htim, TIM_FLAG_CC2)) {
-    __HAL_TIM_CLEAR_IT(htim, TIM_IT_CC2);
-    callback(2, htim->Instance->CCR2);
-  }
-  if(__HAL_TIM_GET_FLAG(htim, TIM_FLAG_CC3)) {
-    __HAL_TIM_CLEAR_IT(htim, TIM_IT_CC3);
-    callback(3, htim->Instance->CCR3);
-  }
-  if(__HAL_TIM_GET_FLAG(htim, TIM_FLAG_CC4)) {
-    __HAL_TIM_CLEAR_IT(htim, TIM_IT_CC4);
-    callback(4, htim->Instance->CCR4);
-  }
-}
-
 /**
 * @brief This function handles TIM1 update interrupt and TIM10 global interrupt.
 */
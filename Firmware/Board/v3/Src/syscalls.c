@@ -40,6 +40,14 @@ void* heap_end_ptr = 0;
 *         or -1 otherwise.
 */
 intptr_t _sbrk(size_t size) {
+#ifdef STATIC_ALLOCATION_ONLY
+    // Static allocation build: nothing may malloc at runtime. Halt where
+    // the debugger can see the offending call stack - returning -1 would
+    // let the hidden allocation limp along unnoticed.
+    (void) size;
+    taskDISABLE_INTERRUPTS();
+    for (;;);
+#else
     intptr_t ptr;
 	vTaskSuspendAll();
 	{
@@ -54,6 +62,7 @@ intptr_t _sbrk(size_t size) {
 	}
 	(void)xTaskResumeAll();
     return ptr;
+#endif
 }
 
 // _write is defined in communication.cpp
@@ -122,7 +122,7 @@ uint8_t ODRIVERxBufferFS[APP_RX_DATA_SIZE];
 
 /** Data to send over USB CDC are stored in this buffer   */
 uint8_t CDCTxBufferFS[APP_TX_DATA_SIZE];
-uint8_t ODRIVETxBufferFS[APP_TX_DATA_SIZE];
+uint8_t ODRIVETxBufferFS[ODRIVE_USB_TX_DATA_SIZE];
 
 /* USER CODE BEGIN PRIVATE_VARIABLES */
 /* USER CODE END PRIVATE_VARIABLES */
@@ -315,26 +315,29 @@ uint8_t CDC_Transmit_FS(uint8_t* Buf, uint16_t Len, uint8_t endpoint_pair)
 {
   uint8_t result = USBD_OK;
   /* USER CODE BEGIN 7 */
-  
-  //Check length
-  if (Len > USB_TX_DATA_SIZE)
-    return USBD_FAIL;
 
   USBD_CDC_HandleTypeDef* hcdc = (USBD_CDC_HandleTypeDef*) hUsbDeviceFS.pClassData;
 
-  // Select EP
+  // Select EP (the native interface takes multi-packet bulk transfers)
   USBD_CDC_EP_HandleTypeDef* hEP_Tx;
   uint8_t* TxBuff;
+  uint16_t MaxLen;
   if (endpoint_pair == CDC_OUT_EP) {
     hEP_Tx = &hcdc->CDC_Tx;
     TxBuff = CDCTxBufferFS;
+    MaxLen = USB_TX_DATA_SIZE;
   } else if (endpoint_pair == ODRIVE_OUT_EP) {
     hEP_Tx = &hcdc->ODRIVE_Tx;
     TxBuff = ODRIVETxBufferFS;
+    MaxLen = ODRIVE_USB_TX_DATA_SIZE;
   } else {
     return USBD_FAIL;
   }
 
+  //Check length
+  if (Len > MaxLen)
+    return USBD_FAIL;
+
   // Check for ongoing transmission
   if (hEP_Tx->State != 0)
       return USBD_BUSY;
@@ -348,6 +351,32 @@ uint8_t CDC_Transmit_FS(uint8_t* Buf, uint16_t Len, uint8_t endpoint_pair)
 }
 
 /* USER CODE BEGIN PRIVATE_FUNCTIONS_IMPLEMENTATION */
+
+/**
+  * @brief  CDC_Transmit_Busy
+  *         Non-destructive congestion probe: reports whether the given
+  *         endpoint pair still has a transfer in flight, i.e. whether a
+  *         CDC_Transmit_FS call right now would return USBD_BUSY. Used
+  *         for flow control by best-effort producers (telemetry) that
+  *         prefer decimating their output over blocking on the TX
+  *         semaphore and clobbering the buffer in flight.
+  *
+  * @param  endpoint_pair: endpoint pair to query
+  * @retval 1 while a transmission is ongoing (or the device is not
+  *         configured yet), 0 if a new transfer can be accepted
+  */
+uint8_t CDC_Transmit_Busy(uint8_t endpoint_pair)
+{
+  USBD_CDC_HandleTypeDef* hcdc = (USBD_CDC_HandleTypeDef*) hUsbDeviceFS.pClassData;
+  if (hcdc == NULL)
+    return 1;
+  if (endpoint_pair == CDC_OUT_EP)
+    return hcdc->CDC_Tx.State != 0;
+  if (endpoint_pair == ODRIVE_OUT_EP)
+    return hcdc->ODRIVE_Tx.State != 0;
+  return 1;
+}
+
 /* USER CODE END PRIVATE_FUNCTIONS_IMPLEMENTATION */
 
 /**
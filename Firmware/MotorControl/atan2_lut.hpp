@@ -0,0 +1,77 @@
+#ifndef __ATAN2_LUT_HPP
+#define __ATAN2_LUT_HPP
+
+#include <stddef.h>
+#include <math.h>
+
+// LUT tier of fast_atan2 for per-cycle call sites.
+//
+// The polynomial fast_atan2 in utils.c stays as the accuracy reference for
+// calibration paths; this variant replaces the polynomial core with a
+// compile time table of atan over the reduced octant argument [0, 1] plus
+// linear interpolation, keeping the same quadrant fixups. With 256 intervals
+// the interpolation error is below 1e-5 rad, i.e. it is both cheaper and
+// tighter than the 3 term polynomial (~5e-3 rad), at the cost of 1KB of
+// flash. The table is generated by a constexpr evaluation of atan (half
+// angle reduction + Taylor series in double), so there is no codegen step.
+
+constexpr double atan2_lut_sqrt(double x) {
+    double r = (x > 1.0) ? x : 1.0;
+    for (int i = 0; i < 60; ++i)
+        r = 0.5 * (r + x / r);
+    return r;
+}
+
+constexpr double atan2_lut_atan(double a) {
+    // Two half angle reductions take a from [0, 1] down to [0, 0.199],
+    // where the Taylor series converges quickly.
+    double a1 = a / (1.0 + atan2_lut_sqrt(1.0 + a * a));
+    double a2 = a1 / (1.0 + atan2_lut_sqrt(1.0 + a1 * a1));
+    double a2sq = a2 * a2;
+    double term = a2;
+    double sum = a2;
+    for (int k = 1; k < 30; ++k) {
+        term *= -a2sq;
+        sum += term / (double)(2 * k + 1);
+    }
+    return 4.0 * sum;
+}
+
+struct Atan2Lut_t {
+    static constexpr size_t intervals = 256;
+    float val[intervals + 1];
+
+    constexpr Atan2Lut_t() : val() {
+        for (size_t i = 0; i <= intervals; ++i)
+            val[i] = (float)atan2_lut_atan((double)i / (double)intervals);
+    }
+};
+
+constexpr Atan2Lut_t atan2_lut{};
+
+// @brief atan2 with the octant reduction of fast_atan2 and a table
+// interpolated core. Returns the angle in (-pi, pi].
+inline float fast_atan2_lut(float y, float x) {
+    float abs_y = fabsf(y);
+    float abs_x = fabsf(x);
+    // a := min (|x|, |y|) / max (|x|, |y|), in [0, 1]
+    // inject FLT_MIN in denominator to avoid division by zero
+    float a = ((abs_x < abs_y) ? abs_x : abs_y)
+            / (((abs_x > abs_y) ? abs_x : abs_y) + 1.17549435e-38f);
+    float pos = a * (float)Atan2Lut_t::intervals;
+    size_t idx = (size_t)pos;
+    if (idx >= Atan2Lut_t::intervals)
+        idx = Atan2Lut_t::intervals - 1;
+    float frac = pos - (float)idx;
+    float r = atan2_lut.val[idx]
+            + (atan2_lut.val[idx + 1] - atan2_lut.val[idx]) * frac;
+    if (abs_y > abs_x)
+        r = 1.57079637f - r;
+    if (x < 0.0f)
+        r = 3.14159274f - r;
+    if (y < 0.0f)
+        r = -r;
+    return r;
+}
+
+#endif // __ATAN2_LUT_HPP
@@ -3,6 +3,7 @@
 #include <functional>
 #include "gpio.h"
 
+#include <freertos_vars.h>
 #include "utils.h"
 #include "odrive_main.h"
 
@@ -72,23 +73,70 @@ void Axis::setup() {
     motor_.setup();
 }
 
-static void run_state_machine_loop_wrapper(void* ctx) {
-    reinterpret_cast<Axis*>(ctx)->run_state_machine_loop();
-    reinterpret_cast<Axis*>(ctx)->thread_id_valid_ = false;
+// Thread architecture
+// -------------------
+// The steady states (AXIS_STATE_IDLE and AXIS_STATE_CLOSED_LOOP_CONTROL)
+// are serviced cooperatively: one shared worker thread steps each axis's
+// state machine once per current measurement. The transient states
+// (calibration sequences, lockin, sensorless spin-up, homing) keep their
+// sequential blocking style and run on a short-lived service thread that
+// is created when such a state is requested and terminates once the task
+// chain is back at a steady state. In steady operation - which is
+// virtually always - only the worker thread and its single stack exist,
+// and since the two axes' current measurements are only half a PWM period
+// apart, one worker wakeup usually services both axes.
+
+osThreadId Axis::worker_thread_id = nullptr;
+
+// @brief True for states that run on the service thread in blocking style.
+bool Axis::is_transient_state(State_t state) {
+    return state != AXIS_STATE_UNDEFINED
+        && state != AXIS_STATE_IDLE
+        && state != AXIS_STATE_CLOSED_LOOP_CONTROL;
+}
+
+// @brief Starts the shared worker thread that services all axes.
+void Axis::start_worker() {
+    osThreadDefStatic(axis_worker, worker_loop, axes[0]->hw_config_.thread_priority, 0, 4*512);
+    worker_thread_id = osThreadCreate(osThread(axis_worker), NULL);
+}
+
+static void service_thread_wrapper(void* ctx) {
+    Axis* axis = reinterpret_cast<Axis*>(ctx);
+    axis->run_transient_states();
+    // After this the current meas signal routes back to the worker. The
+    // idle task frees the stack and TCB.
+    axis->thread_id_valid_ = false;
+    vTaskDelete(nullptr);
 }
 
-// @brief Starts run_state_machine_loop in a new thread
-void Axis::start_thread() {
-    osThreadDef(thread_def, run_state_machine_loop_wrapper, hw_config_.thread_priority, 0, 4*512);
-    thread_id_ = osThreadCreate(osThread(thread_def), this);
-    thread_id_valid_ = true;
+// @brief Spawns the service thread for a requested transient state.
+// Runs on the worker thread; the axis is handed over to the new thread
+// before it can observe any signal.
+// Deliberately heap-allocated even in the static allocation build: the
+// thread is recreated per transient-state request, and a static TCB may
+// only be reused after the idle task processed the previous instance
+// (see freertos_vars.h). The static build's heap is sized for this.
+void Axis::start_service_thread() {
+    osThreadDef(axis_service, service_thread_wrapper, hw_config_.thread_priority, 0, 4*512);
+    thread_id_ = osThreadCreate(osThread(axis_service), this);
+    if (thread_id_) {
+        thread_id_valid_ = true;
+    } else {
+        // Heap exhausted: fail the request into the safe state instead of
+        // silently ignoring it.
+        set_error(ERROR_INVALID_STATE);
+        current_state_ = AXIS_STATE_IDLE;
+    }
 }
 
-// @brief Unblocks the control loop thread.
+// @brief Unblocks whichever thread currently services this axis.
 // This is called from the current sense interrupt handler.
 void Axis::signal_current_meas() {
     if (thread_id_valid_)
         osSignalSet(thread_id_, M_SIGNAL_PH_CURRENT_MEAS);
+    else if (worker_thread_id)
+        osSignalSet(worker_thread_id, M_SIGNAL_PH_CURRENT_MEAS << axis_num_);
 }
 
 // @brief Blocks until a current measurement is completed
@@ -98,14 +146,81 @@ bool Axis::wait_for_current_meas() {
 }
 
 // step/direction interface
+// Called on every rising edge of the step pin. Kept to a bare counter
+// update so the sustainable step rate is bounded by EXTI entry/exit cost
+// alone; the float math and the setpoint write happen once per control
+// cycle in apply_step_dir_counts().
+//
+// Step-to-PWM fast lane: edges accumulate here, the batch is consumed at
+// the top of the next control cycle (apply_step_dir_counts runs first in
+// do_updates), and the resulting position error feeds Controller::update
+// and FOC_current in that same cycle, so the software path from edge to
+// enqueued PWM timings is at most one control period plus the loop's own
+// execution time. The oldest unconsumed edge is timestamped so the actual
+// figure is continuously measured and reported as step_to_pwm_latency_us
+// (see step_steady_state); the hardware adds at most one more PWM period
+// until the timer latches the enqueued timings.
 void Axis::step_cb() {
     if (step_dir_active_) {
-        GPIO_PinState dir_pin = HAL_GPIO_ReadPin(dir_port_, dir_pin_);
-        float dir = (dir_pin == GPIO_PIN_SET) ? 1.0f : -1.0f;
-        controller_.pos_setpoint_ += dir * config_.counts_per_step;
+        if (dir_port_->IDR & dir_pin_) // direct register read, HAL_GPIO_ReadPin costs too much here
+            ++step_count_delta_;
+        else
+            --step_count_delta_;
+        if (!step_edge_timestamp_)
+            step_edge_timestamp_ = DWT->CYCCNT | 1; // 0 means none pending
     }
 };
 
+// @brief Applies the steps accumulated by step_cb() to the position setpoint.
+// Runs once per control cycle, so the setpoint advances at a defined point
+// in the cycle no matter how the step edges were spaced.
+//
+// With config.step_filter_length >= 2 the per-cycle step increments run
+// through a boxcar FIR: each increment is applied in N equal slices over
+// the next N cycles, so the applied total still equals the steps received
+// (no drift), but a burst from a software stepper (bit-banged step pins
+// on a Raspberry Pi arrive in clumps at scheduler granularity) turns into
+// a ramp instead of a setpoint staircase that the position loop would
+// amplify into current spikes. The smoothed step rate doubles as a
+// velocity feedforward, so the stiffness of pos_gain no longer has to be
+// traded away to filter input artifacts. Cost: N/2 cycles of command
+// delay (16 cycles = 2ms at 8kHz worst case).
+void Axis::apply_step_dir_counts() {
+    if (!step_dir_active_)
+        return;
+    uint32_t mask = cpu_enter_critical();
+    int32_t steps = step_count_delta_;
+    step_count_delta_ = 0;
+    uint32_t edge_timestamp = step_edge_timestamp_;
+    step_edge_timestamp_ = 0;
+    cpu_exit_critical(mask);
+    // the latency probe completes once this cycle's PWM timings are
+    // enqueued (see step_steady_state)
+    if (steps)
+        step_latency_timestamp_ = edge_timestamp;
+
+    uint32_t length = config_.step_filter_length;
+    if (length <= 1) {
+        if (steps)
+            controller_.pos_setpoint_ += steps * config_.counts_per_step;
+        return;
+    }
+    if (length > MAX_STEP_FILTER_LENGTH)
+        length = MAX_STEP_FILTER_LENGTH;
+
+    step_filter_window_[step_filter_index_] = (float)steps;
+    if (++step_filter_index_ >= length)
+        step_filter_index_ = 0;
+    float steps_avg = 0.0f;
+    for (uint32_t i = 0; i < length; ++i)
+        steps_avg += step_filter_window_[i];
+    steps_avg /= (float)length;
+
+    float delta_counts = steps_avg * config_.counts_per_step;
+    controller_.pos_setpoint_ += delta_counts;
+    controller_.vel_setpoint_ = delta_counts * (float)current_meas_hz;
+}
+
 void Axis::load_default_step_dir_pin_config(
         const AxisHardwareConfig_t& hw_config, Config_t* config) {
     config->step_gpio_pin = hw_config.step_gpio_pin;
@@ -119,7 +234,26 @@ void Axis::decode_step_dir_pins() {
     dir_pin_ = get_gpio_pin_by_pin(config_.dir_gpio_pin);
 }
 
-// @brief: Setup the watchdog reset value from the configuration watchdog timeout interval. 
+// @brief Stages a property-write hook to run at the axis thread sync point.
+//
+// Hooks like update_watchdog_settings() and decode_step_dir_pins() used to
+// run synchronously in the comm thread during the endpoint write, while the
+// control loop reads the fields they recompute. Staging keeps the packet
+// handler constant-time and moves the work to run_deferred_hooks(), which
+// the axis thread runs between control cycles.
+void Axis::stage_deferred_hook(uint32_t hook) {
+    deferred_hooks_.fetch_or(hook, std::memory_order_release);
+}
+
+void Axis::run_deferred_hooks() {
+    uint32_t hooks = deferred_hooks_.exchange(0, std::memory_order_acquire);
+    if (hooks & DEFERRED_HOOK_WATCHDOG_SETTINGS)
+        update_watchdog_settings();
+    if (hooks & DEFERRED_HOOK_STEP_DIR_PINS)
+        decode_step_dir_pins();
+}
+
+// @brief: Setup the watchdog reset value from the configuration watchdog timeout interval.
 void Axis::update_watchdog_settings() {
 
     if(config_.watchdog_timeout <= 0.0f) { // watchdog disabled 
@@ -144,6 +278,12 @@ void Axis::set_step_dir_active(bool active) {
         GPIO_InitStruct.Pull = GPIO_NOPULL;
         HAL_GPIO_Init(dir_port_, &GPIO_InitStruct);
 
+        // Start the step smoothing window from rest so stale contents
+        // can't replay old motion
+        for (uint32_t i = 0; i < MAX_STEP_FILTER_LENGTH; ++i)
+            step_filter_window_[i] = 0.0f;
+        step_filter_index_ = 0;
+
         // Subscribe to rising edges of the step GPIO
         GPIO_subscribe(step_port_, step_pin_, GPIO_PULLDOWN,
                 step_cb_wrapper, this);
@@ -157,18 +297,61 @@ void Axis::set_step_dir_active(bool active) {
     }
 }
 
+// @brief Appends the newly set error bits of one component to the
+// first-failure log, latching the very first event in first_error_.
+// Callable from interrupt context: one compare and a bounded append.
+// The log only records the first occurrence of each cascade step -
+// new_bits is pre-masked by the callers to bits not yet set.
+void Axis::log_error(ErrorSource_t source, uint32_t new_bits) {
+    if (!new_bits)
+        return;
+    if (first_error_ == 0) {
+        first_error_ = ((uint32_t)source << 24) | (new_bits & 0xFFFFFF);
+        first_error_time_ = loop_counter_;
+    }
+    if (error_log_count_ < ERROR_LOG_DEPTH) {
+        error_log_[error_log_count_].loop_counter = loop_counter_;
+        error_log_[error_log_count_].source = source;
+        error_log_[error_log_count_].error_bits = new_bits;
+        ++error_log_count_; // bump last so concurrent readers see complete entries
+    }
+}
+
+void Axis::set_error(Error_t error) {
+    log_error(ERROR_SOURCE_AXIS, (uint32_t)(error & ~error_));
+    error_ |= error;
+}
+
+// @brief Returns one first-failure log entry, packed for the protocol:
+// loop counter in the high word, source in bits 24-31, error bits below.
+// Returns 0 past the end of the log.
+uint64_t Axis::get_error_event(uint32_t index) {
+    if (index >= error_log_count_)
+        return 0;
+    const ErrorEvent_t& e = error_log_[index];
+    return ((uint64_t)e.loop_counter << 32)
+         | ((uint64_t)(e.source & 0xFF) << 24)
+         | (e.error_bits & 0xFFFFFF);
+}
+
+void Axis::clear_error_log() {
+    error_log_count_ = 0;
+    first_error_ = 0;
+    first_error_time_ = 0;
+}
+
 // @brief Do axis level checks and call subcomponent do_checks
 // Returns true if everything is ok.
 bool Axis::do_checks() {
     if (!brake_resistor_armed)
-        error_ |= ERROR_BRAKE_RESISTOR_DISARMED;
+        set_error(ERROR_BRAKE_RESISTOR_DISARMED);
     if ((current_state_ != AXIS_STATE_IDLE) && (motor_.armed_state_ == Motor::ARMED_STATE_DISARMED))
         // motor got disarmed in something other than the idle loop
-        error_ |= ERROR_MOTOR_DISARMED;
+        set_error(ERROR_MOTOR_DISARMED);
     if (!(vbus_voltage >= board_config.dc_bus_undervoltage_trip_level))
-        error_ |= ERROR_DC_BUS_UNDER_VOLTAGE;
+        set_error(ERROR_DC_BUS_UNDER_VOLTAGE);
     if (!(vbus_voltage <= board_config.dc_bus_overvoltage_trip_level))
-        error_ |= ERROR_DC_BUS_OVER_VOLTAGE;
+        set_error(ERROR_DC_BUS_OVER_VOLTAGE);
 
     // Sub-components should use set_error which will propegate to this error_
     motor_.do_checks();
@@ -176,14 +359,189 @@ bool Axis::do_checks() {
     // sensorless_estimator_.do_checks();
     // controller_.do_checks();
 
+    // While the observer carries the axis, encoder failures are expected
+    // and must not fault it; the encoder's own error register stays latched
+    // for diagnosis (see try_sensorless_fallback)
+    if (sensorless_fallback_active_)
+        error_ &= ~ERROR_ENCODER_FAILED;
+
     return check_for_errors();
 }
 
+// @brief Maintains the persistent odometer counters at control rate.
+// Only cheap integer updates happen here; persistence is handled by the
+// periodic checkpoint (and the PVD brown-out checkpoint) in main.cpp,
+// which journals the AxisOdometer_t structs to NVM.
+void Axis::update_odometer() {
+    AxisOdometer_t& odo = odometers[axis_num_];
+
+    // full mechanical turns, in either direction
+    int32_t count = encoder_.shadow_count_;
+    int32_t delta = count - odo_last_count_;
+    odo_last_count_ = count;
+    odo_rev_accum_counts_ += (uint32_t)(delta < 0 ? -delta : delta);
+    uint32_t cpr = (uint32_t)encoder_.config_.cpr;
+    while (cpr && odo_rev_accum_counts_ >= cpr) {
+        odo_rev_accum_counts_ -= cpr;
+        odo.revolutions++;
+    }
+
+    // time with the gate drivers armed
+    if (motor_.armed_state_ == Motor::ARMED_STATE_ARMED) {
+        if (++odo_energized_cycles_ >= (uint32_t)current_meas_hz) {
+            odo_energized_cycles_ = 0;
+            odo.energized_seconds++;
+        }
+    }
+
+    // motor error bits that newly appeared (clearing the error re-arms
+    // the count, so recurring faults keep counting)
+    uint32_t new_bits = (uint32_t)motor_.error_ & ~odo_prev_motor_error_;
+    odo_prev_motor_error_ = (uint32_t)motor_.error_;
+    if (new_bits)
+        TRACE_ERROR(axis_num_, new_bits);
+    while (new_bits) {
+        uint32_t bit = (uint32_t)__builtin_ctz(new_bits);
+        new_bits &= new_bits - 1;
+        if (bit < sizeof(odo.error_counts) / sizeof(odo.error_counts[0]))
+            odo.error_counts[bit]++;
+    }
+}
+
+uint32_t Axis::get_odometer_error_count(uint32_t bit) {
+    if (bit >= sizeof(odometers[0].error_counts) / sizeof(odometers[0].error_counts[0]))
+        return 0;
+    return odometers[axis_num_].error_counts[bit];
+}
+
+// @brief Packs the per-axis health state into two 64-bit words so a
+// supervisory host can watchdog a drive in one or two transactions
+// instead of a dozen per-field reads.
+//
+// status_word layout:
+//   [7:0]   current_state
+//   [15:8]  axis error (low 8 bits)
+//   [31:16] motor error (low 16 bits)
+//   [39:32] encoder error (low 8 bits)
+//   [47:40] controller error (low 8 bits)
+//   [63:48] loop counter (low 16 bits; a stuck value means the control
+//           loop died even if no error bit is set)
+//
+// status_measurements layout (quantized, two's complement where signed):
+//   [15:0]  vbus voltage [10mV]
+//   [31:16] Iq measured [10mA]
+//   [47:32] inverter temperature [0.1 degC]
+//   [63:48] encoder velocity estimate [16 counts/s]
+//
+// Each word is rewritten in one place once per control cycle, so the
+// fields within a word are coherent. The protocol read may still tear
+// between the 32-bit halves of a word; with this layout that only pairs
+// a one-cycle-old loop counter or velocity with the rest, which is
+// harmless for monitoring.
+void Axis::update_status_snapshot() {
+    uint64_t w = (uint64_t)(uint8_t)current_state_;
+    w |= (uint64_t)((uint32_t)error_ & 0xff) << 8;
+    w |= (uint64_t)((uint32_t)motor_.error_ & 0xffff) << 16;
+    w |= (uint64_t)((uint32_t)encoder_.error_ & 0xff) << 32;
+    w |= (uint64_t)((uint32_t)controller_.error_ & 0xff) << 40;
+    w |= (uint64_t)(loop_counter_ & 0xffff) << 48;
+    status_word_ = w;
+
+    uint64_t m = (uint64_t)(uint16_t)(int32_t)(vbus_voltage * 100.0f);
+    m |= (uint64_t)(uint16_t)(int16_t)(motor_.current_control_.Iq_measured * 100.0f) << 16;
+    m |= (uint64_t)(uint16_t)(int16_t)(motor_.get_inverter_temp() * 10.0f) << 32;
+    m |= (uint64_t)(uint16_t)(int16_t)(encoder_.vel_estimate_ * (1.0f / 16.0f)) << 48;
+    status_measurements_ = m;
+}
+
+// @brief Publishes a coherent snapshot of the comm-facing control-rate
+// fields. Comm-thread reads of the live fields race with the control ISR:
+// each aligned 32-bit load is atomic on the M4, but a multi-field read
+// (pos + vel) can pair values from different cycles. The writer fills the
+// back buffer and release-publishes the sequence count, so readers never
+// block the control loop; the decimation also keeps comm reads off the
+// cache lines the ISR is writing every cycle.
+void Axis::update_telemetry_mirror() {
+    if (++telemetry_decimation_cnt_ < TELEMETRY_DECIMATION)
+        return;
+    telemetry_decimation_cnt_ = 0;
+    uint32_t seq = telemetry_seq_.load(std::memory_order_relaxed);
+    Telemetry_t& back = telemetry_buf_[(seq + 1) & 1];
+    // copied from the packed frame refreshed earlier in this do_updates call
+    back.pos_estimate = estimate_frame_.pos;
+    back.vel_estimate = estimate_frame_.vel;
+    back.Iq_setpoint = motor_.current_control_.Iq_setpoint;
+    back.Iq_measured = motor_.current_control_.Iq_measured;
+    back.loop_counter = loop_counter_;
+    telemetry_seq_.store(seq + 1, std::memory_order_release);
+}
+
+// @brief Copies the newest published telemetry block. Retries if the
+// writer flipped buffers mid-copy; with publishes TELEMETRY_DECIMATION
+// cycles apart a second retry is practically impossible.
+Axis::Telemetry_t Axis::read_telemetry() {
+    Telemetry_t snapshot;
+    uint32_t seq;
+    do {
+        seq = telemetry_seq_.load(std::memory_order_acquire);
+        snapshot = telemetry_buf_[seq & 1];
+    } while (telemetry_seq_.load(std::memory_order_acquire) != seq);
+    return snapshot;
+}
+
+// @brief Packs the active estimator's per-cycle output into estimate_frame_.
+// Runs right after the estimator updates in do_updates, so every downstream
+// stage of the same cycle (controller, motor, telemetry mirror, blackbox)
+// reads one coherent frame from one cache line instead of chasing fields
+// scattered across the encoder, sensorless estimator and fallback state.
+void Axis::update_estimate_frame() {
+    EstimateFrame_t& frame = estimate_frame_;
+    if (sensorless_fallback_active_ && current_state_ == AXIS_STATE_CLOSED_LOOP_CONTROL) {
+        // Degraded mode: the loop closes on the flux observer instead of
+        // the failed encoder. Observer estimates are in electrical rad;
+        // rescale to counts so controller gains keep their meaning.
+        float scale = (float)encoder_.config_.cpr
+                    / (2.0f * M_PI * (float)motor_.config_.pole_pairs);
+        frame.vel = sensorless_estimator_.vel_estimate_ * scale;
+        fallback_pos_counts_ += frame.vel * current_meas_period;
+        frame.pos = fallback_pos_counts_;
+        // The observer phase is absolute, no realignment needed
+        frame.phase = sensorless_estimator_.phase_;
+        frame.phase_vel = sensorless_estimator_.vel_estimate_;
+        frame.flags = ESTIMATE_FLAG_SENSORLESS | ESTIMATE_FLAG_FALLBACK;
+    } else if (current_state_ == AXIS_STATE_SENSORLESS_CONTROL) {
+        // Controller gains act on the raw electrical units in this mode
+        frame.pos = sensorless_estimator_.pll_pos_;
+        frame.vel = sensorless_estimator_.vel_estimate_;
+        frame.phase = sensorless_estimator_.phase_;
+        frame.phase_vel = sensorless_estimator_.vel_estimate_;
+        frame.flags = ESTIMATE_FLAG_SENSORLESS;
+    } else {
+        // pos_estimate_comp_ equals pos_estimate_ unless the encoder's
+        // delay compensation is enabled (see Encoder::update)
+        frame.pos = encoder_.pos_estimate_comp_;
+        frame.vel = encoder_.vel_estimate_;
+        frame.phase = encoder_.phase_;
+        frame.phase_vel = 2*M_PI * encoder_.vel_estimate_
+                        / (float)encoder_.config_.cpr * motor_.config_.pole_pairs;
+        frame.flags = 0;
+    }
+}
+
 // @brief Update all esitmators
 bool Axis::do_updates() {
     // Sub-components should use set_error which will propegate to this error_
+    uint32_t profiler_start = Profiler::enter();
+    run_deferred_hooks();
+    apply_step_dir_counts();
     encoder_.update();
     sensorless_estimator_.update();
+    sensorless_cross_check();
+    update_estimate_frame();
+    update_odometer();
+    update_status_snapshot();
+    update_telemetry_mirror();
+    profiler_.leave(PROFILER_STAGE_ESTIMATOR_UPDATES, profiler_start);
     return check_for_errors();
 }
 
@@ -202,11 +560,21 @@ bool Axis::watchdog_check() {
         watchdog_current_value_--;
         return true;
     } else {
-        error_ |= ERROR_WATCHDOG_TIMER_EXPIRED;
+        set_error(ERROR_WATCHDOG_TIMER_EXPIRED);
         return false;
     }
 }
 
+// @brief Board-level host heartbeat: feeds every axis watchdog in one call
+// so a supervisory host pays one message per period for the whole board
+// instead of one call per axis. Feeding a disabled watchdog is a no-op,
+// so no per-axis filtering is needed. The per-transport enables
+// (board_config.enable_watchdog_feed_*) are checked by the callers.
+void feed_all_watchdogs(void) {
+    for (size_t i = 0; i < AXIS_COUNT; ++i)
+        axes[i]->watchdog_feed();
+}
+
 bool Axis::run_lockin_spin(const LockinConfig_t &lockin_config) {
     // Spiral up current for softer rotor lock-in
     lockin_state_ = LOCKIN_STATE_RAMP;
@@ -270,101 +638,452 @@ bool Axis::run_lockin_spin(const LockinConfig_t &lockin_config) {
     return check_for_errors();
 }
 
+// @brief Runs the motor at zero current while the sensorless observer
+// converges on the back-EMF of a (possibly) spinning rotor. Returns true
+// if the estimate settled at a speed usable for direct closed loop entry;
+// false means the caller should fall back to the lockin ramp.
+bool Axis::run_flying_start() {
+    size_t settle_cycles = (size_t)(sensorless_estimator_.config_.flying_start_settle_time
+                                    / current_meas_period);
+    size_t cycle = 0;
+    run_control_loop([&]() {
+        if (!motor_.update(0.0f, sensorless_estimator_.phase_, sensorless_estimator_.vel_estimate_))
+            return false;
+        return ++cycle < settle_cycles;
+    });
+    if (!check_for_errors())
+        return false;
+    return fabsf(sensorless_estimator_.vel_estimate_)
+        >= sensorless_estimator_.config_.flying_start_min_vel;
+}
+
 // Note run_sensorless_control_loop and run_closed_loop_control_loop are very similar and differ only in where we get the estimate from.
 bool Axis::run_sensorless_control_loop() {
     run_control_loop([this](){
         if (controller_.config_.control_mode >= Controller::CTRL_MODE_POSITION_CONTROL)
-            return error_ |= ERROR_POS_CTRL_DURING_SENSORLESS, false;
+            return set_error(ERROR_POS_CTRL_DURING_SENSORLESS), false;
 
-        // Note that all estimators are updated in the loop prefix in run_control_loop
+        // Note that all estimators are updated in the loop prefix in
+        // run_control_loop, which also packs them into estimate_frame_
+        const EstimateFrame_t& frame = estimate_frame_;
         float current_setpoint;
-        if (!controller_.update(sensorless_estimator_.pll_pos_, sensorless_estimator_.vel_estimate_, &current_setpoint))
-            return error_ |= ERROR_CONTROLLER_FAILED, false;
-        if (!motor_.update(current_setpoint, sensorless_estimator_.phase_, sensorless_estimator_.vel_estimate_))
+        if (!controller_.update(frame.pos, frame.vel, &current_setpoint))
+            return set_error(ERROR_CONTROLLER_FAILED), false;
+        if (!motor_.update(current_setpoint, frame.phase, frame.phase_vel))
             return false; // set_error should update axis.error_
         return true;
     });
     return check_for_errors();
 }
 
-bool Axis::run_closed_loop_control_loop() {
-    // To avoid any transient on startup, we intialize the setpoint to be the current position
+static void endstop_cb_wrapper(void* ctx) {
+    reinterpret_cast<Axis*>(ctx)->endstop_cb();
+}
+
+// Runs in EXTI interrupt context when the endstop switch closes; the
+// actual stop and re-reference happen on the control thread in run_homing.
+void Axis::endstop_cb() {
+    endstop_pressed_ = true;
+}
+
+// @brief Drives the axis towards the endstop switch in velocity mode and
+// re-references the encoder count to config_.homing_offset at the contact
+// point. The switch edge is caught by the same GPIO subscription machinery
+// the encoder index pulse uses; the pin level is also polled every control
+// cycle so active-low switches (falling edge at contact) work too.
+bool Axis::run_homing() {
+    endstop_port_ = get_gpio_port_by_pin(config_.endstop_gpio_pin);
+    endstop_pin_ = get_gpio_pin_by_pin(config_.endstop_gpio_pin);
+    endstop_pressed_ = false;
+    GPIO_subscribe(endstop_port_, endstop_pin_,
+            config_.endstop_active_high ? GPIO_PULLDOWN : GPIO_PULLUP,
+            endstop_cb_wrapper, this);
+
+    // Approach under velocity control, starting from the current position
+    Controller::ControlMode_t stored_mode = controller_.config_.control_mode;
+    controller_.drop_pending_setpoints();
     controller_.pos_setpoint_ = encoder_.pos_estimate_;
-    set_step_dir_active(config_.enable_step_dir);
-    run_control_loop([this](){
-        // Note that all estimators are updated in the loop prefix in run_control_loop
+    controller_.vel_setpoint_ = config_.homing_vel;
+    controller_.current_setpoint_ = 0.0f;
+    controller_.config_.control_mode = Controller::CTRL_MODE_VELOCITY_CONTROL;
+
+    run_control_loop([this]() {
+        bool at_endstop = (HAL_GPIO_ReadPin(endstop_port_, endstop_pin_) != GPIO_PIN_RESET)
+                        == config_.endstop_active_high;
+        if (endstop_pressed_ || at_endstop) {
+            endstop_pressed_ = true;
+            return false; // contact - done
+        }
         float current_setpoint;
-        if (!controller_.update(encoder_.pos_estimate_, encoder_.vel_estimate_, &current_setpoint))
-            return error_ |= ERROR_CONTROLLER_FAILED, false; //TODO: Make controller.set_error
+        if (!controller_.update(encoder_.pos_estimate_comp_, encoder_.vel_estimate_, &current_setpoint))
+            return set_error(ERROR_CONTROLLER_FAILED), false;
         float phase_vel = 2*M_PI * encoder_.vel_estimate_ / (float)encoder_.config_.cpr * motor_.config_.pole_pairs;
-        if (!motor_.update(current_setpoint, encoder_.phase_, phase_vel))
-            return false; // set_error should update axis.error_
-        return true;
+        return motor_.update(current_setpoint, encoder_.phase_, phase_vel);
     });
-    set_step_dir_active(false);
-    return check_for_errors();
+    GPIO_unsubscribe(endstop_port_, endstop_pin_);
+
+    bool success = endstop_pressed_ && check_for_errors();
+    if (success) {
+        // The contact point becomes the position reference
+        encoder_.set_linear_count((int32_t)config_.homing_offset);
+        controller_.pos_setpoint_ = config_.homing_offset;
+        controller_.vel_setpoint_ = 0.0f;
+    }
+    controller_.config_.control_mode = stored_mode;
+    return success;
 }
 
-bool Axis::run_idle_loop() {
-    // run_control_loop ignores missed modulation timing updates
-    // if and only if we're in AXIS_STATE_IDLE
-    safety_critical_disarm_motor_pwm(motor_);
-    run_control_loop([this](){
-        return true;
+// @brief Holds the control loop for one second at zero drive voltage and
+// checks the timing invariants the rest of the firmware relies on: the
+// service thread must be released once per current measurement with low
+// jitter, and the current-sample and DC-calibration ADC callbacks must stay
+// locked half a PWM period apart (see pwm_trig_adc_cb). Safe with the motor
+// disconnected or shorted back-to-back since no voltage is applied; comm
+// round-trip under load can be exercised from the host against this state
+// since it keeps the loop at its normal duty. Measured numbers and the
+// verdict land in self_test_results_; a fail also idles the axis.
+bool Axis::run_self_test() {
+    SelfTestResults_t results; // accumulate locally, publish on exit
+
+    uint32_t last_timestamp = 0;
+    uint32_t period_min = 0, period_max = 0;
+    uint64_t period_sum = 0;
+    uint16_t phase_min = 0, phase_max = 0;
+    int i = 0;
+
+    run_control_loop([&]() {
+        // Keep the armed motor fed; zero voltage means zero torque
+        if (!motor_.enqueue_voltage_timings(0.0f, 0.0f))
+            return false; // error set inside enqueue_voltage_timings
+
+        uint32_t now = DWT->CYCCNT;
+        if (i > 0) { // the first release has no reference timestamp
+            uint32_t period = now - last_timestamp;
+            if (i == 1 || period < period_min) period_min = period;
+            if (i == 1 || period > period_max) period_max = period;
+            period_sum += period;
+
+            // Both slots are in timer clocks, captured half a PWM period
+            // apart; the unsigned difference is wrap-safe
+            uint16_t phase = (uint16_t)(motor_.timing_log_[Motor::TIMING_LOG_ADC_CB_I]
+                                      - motor_.timing_log_[Motor::TIMING_LOG_ADC_CB_DC]);
+            if (i == 1 || phase < phase_min) phase_min = phase;
+            if (i == 1 || phase > phase_max) phase_max = phase;
+        }
+        last_timestamp = now;
+        return ++i < current_meas_hz; // ~1s window
     });
-    return check_for_errors();
+
+    results.cycles = (i > 0) ? (uint32_t)(i - 1) : 0;
+    if (results.cycles > 0) {
+        float clocks_per_us = (float)(SystemCoreClock / 1000000);
+        results.period_mean_us = (float)(period_sum / results.cycles) / clocks_per_us;
+        results.period_min_us = (float)period_min / clocks_per_us;
+        results.period_max_us = (float)period_max / clocks_per_us;
+        float nominal_us = 1e6f * current_meas_period;
+        results.period_max_dev_us = std::max(fabsf(results.period_max_us - nominal_us),
+                                             fabsf(results.period_min_us - nominal_us));
+        results.adc_phase_spread = (uint32_t)(phase_max - phase_min);
+        // Thread release jitter beyond 20% of the control period means
+        // deadline headroom is gone; the ADC callback pair drifting by more
+        // than 1/8 PWM period means current and DC calibration samples are
+        // no longer taken where the SVM cycle expects them.
+        results.pass = check_for_errors()
+                    && results.cycles >= (uint32_t)(current_meas_hz / 2)
+                    && results.period_max_dev_us < 0.2f * nominal_us
+                    && results.adc_phase_spread < TIM_1_8_PERIOD_CLOCKS / 8;
+    }
+    self_test_results_ = results;
+    return self_test_results_.pass;
+}
+
+// @brief Cross-checks the encoder against the flux observer while in
+// encoder-based closed loop. Runs from do_updates at a decimated rate;
+// sustained disagreement latches ERROR_ESTIMATE_MISMATCH on the encoder,
+// which funnels into the same ERROR_ENCODER_FAILED degradation path as the
+// signal integrity monitor (see try_sensorless_fallback).
+void Axis::sensorless_cross_check() {
+    if (!config_.enable_sensorless_fallback || sensorless_fallback_active_)
+        return;
+    if (current_state_ != AXIS_STATE_CLOSED_LOOP_CONTROL || !encoder_.is_ready_)
+        return;
+    // The observer is only trustworthy above its back-EMF floor, and a
+    // full-rate comparison isn't needed to catch a failing cable
+    if (++fallback_check_cycle_ < 16)
+        return;
+    fallback_check_cycle_ = 0;
+
+    float vel_enc_el = 2.0f * M_PI * encoder_.vel_estimate_
+                     / (float)encoder_.config_.cpr * (float)motor_.config_.pole_pairs;
+    float vel_obs_el = sensorless_estimator_.vel_estimate_;
+    float min_vel = sensorless_estimator_.config_.flying_start_min_vel;
+    if (fabsf(vel_enc_el) < min_vel && fabsf(vel_obs_el) < min_vel) {
+        fallback_disagree_cnt_ = 0;
+        return; // too slow for the observer to judge
+    }
+    float tolerance = std::max(0.5f * fabsf(vel_obs_el), min_vel);
+    if (fabsf(vel_enc_el - vel_obs_el) > tolerance) {
+        // ~0.25s of sustained disagreement at the decimated rate
+        if (++fallback_disagree_cnt_ > 125)
+            encoder_.set_error(Encoder::ERROR_ESTIMATE_MISMATCH);
+    } else if (fallback_disagree_cnt_ > 0) {
+        --fallback_disagree_cnt_;
+    }
+}
+
+// @brief Attempts the handoff from encoder to sensorless operation after an
+// encoder failure in closed loop. Only engages if the encoder failure is the
+// sole axis error and the observer sees a usable speed; position reference
+// is lost, so position control demotes to velocity control. Returns true if
+// the axis keeps running in degraded mode.
+bool Axis::try_sensorless_fallback() {
+    if (!config_.enable_sensorless_fallback || sensorless_fallback_active_)
+        return false;
+    if (current_state_ != AXIS_STATE_CLOSED_LOOP_CONTROL)
+        return false;
+    if (error_ & ~ERROR_ENCODER_FAILED)
+        return false; // only an encoder failure is recoverable
+    if (fabsf(sensorless_estimator_.vel_estimate_)
+            < sensorless_estimator_.config_.flying_start_min_vel)
+        return false; // observer can't carry the loop at this speed
+
+    // Hand over: seed the velocity loop with the observer estimate so the
+    // takeover is bumpless (same pattern as the sensorless warm start)
+    if (controller_.config_.control_mode >= Controller::CTRL_MODE_POSITION_CONTROL)
+        controller_.config_.control_mode = Controller::CTRL_MODE_VELOCITY_CONTROL;
+    controller_.drop_pending_setpoints();
+    float scale = (float)encoder_.config_.cpr
+                / (2.0f * M_PI * (float)motor_.config_.pole_pairs);
+    controller_.vel_setpoint_ = sensorless_estimator_.vel_estimate_ * scale;
+    fallback_pos_counts_ = encoder_.pos_estimate_;
+    error_ &= ~ERROR_ENCODER_FAILED; // encoder_.error_ stays latched for diagnosis
+    sensorless_fallback_active_ = true;
+    ++fallback_engage_cnt_;
+    return true;
 }
 
-// Infinite loop that does calibration and enters main control loop as appropriate
-void Axis::run_state_machine_loop() {
+// @brief Runs the entry/exit actions of the steady states when the worker
+// observes a state change. Guard checks that the old state machine did with
+// goto invalid_state_label happen here for the cooperative states.
+void Axis::sync_steady_state() {
+    if (entered_steady_state_ == current_state_)
+        return;
+
+    // exit actions
+    if (entered_steady_state_ == AXIS_STATE_CLOSED_LOOP_CONTROL)
+        set_step_dir_active(false);
+
+    // guards
+    if (current_state_ == AXIS_STATE_CLOSED_LOOP_CONTROL
+        && (!motor_.is_calibrated_ || motor_.config_.direction == 0 || !encoder_.is_ready_)) {
+        set_error(ERROR_INVALID_STATE);
+        current_state_ = AXIS_STATE_IDLE;
+    }
+
+    // entry actions
+    switch (current_state_) {
+        case AXIS_STATE_CLOSED_LOOP_CONTROL: {
+            // To avoid any transient on startup, we initialize the setpoint
+            // to be the current position (and discard any setpoint command
+            // still pending from before the state change)
+            controller_.drop_pending_setpoints();
+            controller_.pos_setpoint_ = encoder_.pos_estimate_;
+            set_step_dir_active(config_.enable_step_dir);
+        } break;
+        case AXIS_STATE_IDLE: {
+            safety_critical_disarm_motor_pwm(motor_);
+        } break;
+        default: break;
+    }
+    entered_steady_state_ = current_state_;
+}
 
-    // Allocate the map for anti-cogging algorithm and initialize all values to 0.0f
-    // TODO: Move this somewhere else
-    // TODO: respect changes of CPR
-    int encoder_cpr = encoder_.config_.cpr;
-    controller_.anticogging_.cogging_map = (float*)malloc(encoder_cpr * sizeof(float));
+// @brief One control-cycle step of the current steady state. Returns false
+// on failure, which sends the axis to idle.
+bool Axis::step_steady_state() {
+    switch (current_state_) {
+        case AXIS_STATE_CLOSED_LOOP_CONTROL: {
+            // The estimate source (encoder or, in degraded mode, the flux
+            // observer) was resolved into one packed frame by
+            // update_estimate_frame in the do_updates prefix of this cycle.
+            const EstimateFrame_t& frame = estimate_frame_;
+            float current_setpoint;
+            if (!controller_.update(frame.pos, frame.vel, &current_setpoint))
+                return set_error(ERROR_CONTROLLER_FAILED), false;
+            if (!motor_.update(current_setpoint, frame.phase, frame.phase_vel))
+                return false;
+            // Step-to-PWM latency probe: the PWM timings reflecting the
+            // consumed steps are enqueued at this point; the timer latches
+            // them at its next update event (at most one PWM period later).
+            if (step_latency_timestamp_) {
+                step_to_pwm_latency_us_ = (float)((DWT->CYCCNT - step_latency_timestamp_)
+                                        / (SystemCoreClock / 1000000));
+                step_latency_timestamp_ = 0;
+            }
+            return true;
+        }
+        case AXIS_STATE_IDLE:
+        default:
+            return true; // idling is always fine
+    }
+}
+
+
+// @brief Allocates and restores the anti-cogging feed-forward map.
+// TODO: respect changes of CPR
+void Axis::setup_anticogging_map() {
+    int anticogging_bins = controller_.config_.anticogging_bins;
+    if (anticogging_bins > encoder_.config_.cpr)
+        anticogging_bins = encoder_.config_.cpr;
+    if (anticogging_bins < 1)
+        anticogging_bins = 1;
+#ifdef STATIC_ALLOCATION_ONLY
+    // Static allocation build: one worst-case map per axis at link time.
+    // The cap bounds the static RAM spend; raise it (and re-check the map
+    // file) if a finer map is needed.
+    static constexpr int STATIC_ANTICOGGING_BINS = 2048;
+    static int16_t static_maps[AXIS_COUNT][STATIC_ANTICOGGING_BINS];
+    if (anticogging_bins > STATIC_ANTICOGGING_BINS)
+        anticogging_bins = STATIC_ANTICOGGING_BINS;
+    controller_.anticogging_.cogging_map = static_maps[axis_num_];
+#else
+    // Allocated from the FreeRTOS heap (core coupled memory): the map is read
+    // every control cycle and never touched by DMA.
+    controller_.anticogging_.cogging_map = (int16_t*)pvPortMalloc(anticogging_bins * sizeof(int16_t));
+#endif
     if (controller_.anticogging_.cogging_map != NULL) {
-        for (int i = 0; i < encoder_cpr; i++) {
-            controller_.anticogging_.cogging_map[i] = 0.0f;
+        for (int i = 0; i < anticogging_bins; i++) {
+            controller_.anticogging_.cogging_map[i] = 0;
         }
+        controller_.anticogging_.map_size = anticogging_bins;
+        // Power-of-two bin counts let the feed-forward lookup wrap with a
+        // mask instead of an integer division
+        controller_.anticogging_.map_mask =
+            ((anticogging_bins & (anticogging_bins - 1)) == 0) ? (anticogging_bins - 1) : 0;
+        // Restore a previously calibrated map from NVM (if one was saved)
+        controller_.anticogging_unpack_map(&anticogging_stores[axis_num_]);
     }
+}
 
-    // arm!
-    motor_.arm();
-    
+// @brief Consumes requested_state_ into a fresh task chain.
+// Mirrors the old outer state machine loop: leaving idle re-arms the motor
+// before the first state of the new chain runs.
+void Axis::load_task_chain() {
+    size_t pos = 0;
+    if (requested_state_ == AXIS_STATE_STARTUP_SEQUENCE) {
+        if (config_.startup_motor_calibration)
+            task_chain_[pos++] = AXIS_STATE_MOTOR_CALIBRATION;
+        if (config_.startup_encoder_index_search && encoder_.config_.use_index)
+            task_chain_[pos++] = AXIS_STATE_ENCODER_INDEX_SEARCH;
+        if (config_.startup_encoder_offset_calibration)
+            task_chain_[pos++] = AXIS_STATE_ENCODER_OFFSET_CALIBRATION;
+        if (config_.startup_homing && config_.endstop_gpio_pin != 0)
+            task_chain_[pos++] = AXIS_STATE_HOMING;
+        if (config_.startup_closed_loop_control)
+            task_chain_[pos++] = AXIS_STATE_CLOSED_LOOP_CONTROL;
+        else if (config_.startup_sensorless_control)
+            task_chain_[pos++] = AXIS_STATE_SENSORLESS_CONTROL;
+        task_chain_[pos++] = AXIS_STATE_IDLE;
+    } else if (requested_state_ == AXIS_STATE_FULL_CALIBRATION_SEQUENCE) {
+        task_chain_[pos++] = AXIS_STATE_MOTOR_CALIBRATION;
+        if (encoder_.config_.use_index)
+            task_chain_[pos++] = AXIS_STATE_ENCODER_INDEX_SEARCH;
+        task_chain_[pos++] = AXIS_STATE_ENCODER_OFFSET_CALIBRATION;
+        task_chain_[pos++] = AXIS_STATE_IDLE;
+    } else if (requested_state_ != AXIS_STATE_UNDEFINED) {
+        task_chain_[pos++] = requested_state_;
+        task_chain_[pos++] = AXIS_STATE_IDLE;
+    }
+    task_chain_[pos++] = AXIS_STATE_UNDEFINED; // TODO: bounds checking
+    requested_state_ = AXIS_STATE_UNDEFINED;
+    // Auto-clear any invalid state error
+    error_ &= ~ERROR_INVALID_STATE;
+    // A new state request counts as operator intervention: leave the
+    // degraded sensorless fallback mode (see try_sensorless_fallback)
+    sensorless_fallback_active_ = false;
+}
+
+// Shared startup current budget (see BoardConfig_t::startup_current_budget).
+// The transient-state procedures of both axes run concurrently on their
+// service threads, so a dual-axis startup can stack two calibration
+// currents onto the supply. Each procedure reserves its peak current
+// before energizing and waits until the reservation fits, which keeps the
+// cross-axis pipelining and bounds the combined draw.
+static float startup_budget_reserved_ = 0.0f;
+
+// @brief Peak phase current a transient-state procedure can draw. Only the
+// calibration-class procedures are budgeted; the open-ended states
+// (sensorless control, homing) run under the normal current limit and
+// must not hold a reservation indefinitely.
+float Axis::startup_peak_current(State_t state) {
+    switch (state) {
+        case AXIS_STATE_MOTOR_CALIBRATION:
+            return motor_.config_.calibration_current;
+        case AXIS_STATE_ENCODER_INDEX_SEARCH:
+        case AXIS_STATE_ENCODER_DIR_FIND:
+            return config_.calibration_lockin.current;
+        case AXIS_STATE_ENCODER_OFFSET_CALIBRATION:
+            // drives calibration_current open loop, then the lockin scan
+            return std::max(motor_.config_.calibration_current,
+                            config_.calibration_lockin.current);
+        case AXIS_STATE_LOCKIN_SPIN:
+            return config_.lockin.current;
+        default:
+            return 0.0f;
+    }
+}
+
+// @brief Reserves `amps` from the shared startup budget, waiting until the
+// reservation fits. Returns false if a new state request preempts the wait.
+bool Axis::acquire_startup_budget(float amps) {
+    if (amps <= 0.0f)
+        return true;
     for (;;) {
-        // Load the task chain if a specific request is pending
-        if (requested_state_ != AXIS_STATE_UNDEFINED) {
-            size_t pos = 0;
-            if (requested_state_ == AXIS_STATE_STARTUP_SEQUENCE) {
-                if (config_.startup_motor_calibration)
-                    task_chain_[pos++] = AXIS_STATE_MOTOR_CALIBRATION;
-                if (config_.startup_encoder_index_search && encoder_.config_.use_index)
-                    task_chain_[pos++] = AXIS_STATE_ENCODER_INDEX_SEARCH;
-                if (config_.startup_encoder_offset_calibration)
-                    task_chain_[pos++] = AXIS_STATE_ENCODER_OFFSET_CALIBRATION;
-                if (config_.startup_closed_loop_control)
-                    task_chain_[pos++] = AXIS_STATE_CLOSED_LOOP_CONTROL;
-                else if (config_.startup_sensorless_control)
-                    task_chain_[pos++] = AXIS_STATE_SENSORLESS_CONTROL;
-                task_chain_[pos++] = AXIS_STATE_IDLE;
-            } else if (requested_state_ == AXIS_STATE_FULL_CALIBRATION_SEQUENCE) {
-                task_chain_[pos++] = AXIS_STATE_MOTOR_CALIBRATION;
-                if (encoder_.config_.use_index)
-                    task_chain_[pos++] = AXIS_STATE_ENCODER_INDEX_SEARCH;
-                task_chain_[pos++] = AXIS_STATE_ENCODER_OFFSET_CALIBRATION;
-                task_chain_[pos++] = AXIS_STATE_IDLE;
-            } else if (requested_state_ != AXIS_STATE_UNDEFINED) {
-                task_chain_[pos++] = requested_state_;
-                task_chain_[pos++] = AXIS_STATE_IDLE;
-            }
-            task_chain_[pos++] = AXIS_STATE_UNDEFINED; // TODO: bounds checking
-            requested_state_ = AXIS_STATE_UNDEFINED;
-            // Auto-clear any invalid state error
-            error_ &= ~ERROR_INVALID_STATE;
-        }
+        uint32_t mask = cpu_enter_critical();
+        float budget = board_config.startup_current_budget;
+        // A procedure bigger than the whole budget may still run alone,
+        // otherwise it could never start at all.
+        bool fits = (budget <= 0.0f) || (startup_budget_reserved_ == 0.0f)
+                 || (startup_budget_reserved_ + amps <= budget);
+        if (fits)
+            startup_budget_reserved_ += amps;
+        cpu_exit_critical(mask);
+        if (fits)
+            return true;
+        if (requested_state_ != AXIS_STATE_UNDEFINED)
+            return false;
+        osDelay(1);
+    }
+}
 
-        // Note that current_state is a reference to task_chain_[0]
+void Axis::release_startup_budget(float amps) {
+    if (amps <= 0.0f)
+        return;
+    uint32_t mask = cpu_enter_critical();
+    startup_budget_reserved_ -= amps;
+    if (startup_budget_reserved_ < 0.0f)
+        startup_budget_reserved_ = 0.0f;
+    cpu_exit_critical(mask);
+}
+
+// @brief Executes transient states sequentially in blocking style until the
+// task chain head is a steady state again. Runs on the service thread; the
+// worker does not touch this axis while thread_id_valid_ is set.
+void Axis::run_transient_states() {
+    for (;;) {
+        // Load the task chain if a specific request is pending (the axis
+        // cannot be in idle here, so no re-arm is needed)
+        if (requested_state_ != AXIS_STATE_UNDEFINED)
+            load_task_chain();
+        if (!is_transient_state(current_state_))
+            return; // steady state - hand back to the worker
+
+        // Reserve the procedure's peak current from the shared startup
+        // budget; a concurrently calibrating axis queues here instead of
+        // stacking its current draw on top
+        float budget_amps = startup_peak_current(current_state_);
+        if (!acquire_startup_budget(budget_amps))
+            continue; // preempted by a new state request while waiting
 
         // Run the specified state
         // Handlers should exit if requested_state != AXIS_STATE_UNDEFINED
@@ -405,34 +1124,52 @@ void Axis::run_state_machine_loop() {
             case AXIS_STATE_SENSORLESS_CONTROL: {
                 if (!motor_.is_calibrated_ || motor_.config_.direction==0)
                         goto invalid_state_label;
-                status = run_lockin_spin(config_.sensorless_ramp); // TODO: restart if desired
-                if (status) {
+                // Warm start: a fresh checkpoint or the back-EMF of an
+                // already spinning rotor lets us skip the lockin ramp.
+                bool warm_started = false;
+                if (sensorless_estimator_.config_.enable_warm_start) {
+                    if (!sensorless_estimator_.try_restore_checkpoint())
+                        sensorless_estimator_.seed_flying_start();
+                    warm_started = run_flying_start();
+                }
+                if (warm_started) {
+                    status = true;
                     // call to controller.reset() that happend when arming means that vel_setpoint
-                    // is zeroed. So we make the setpoint the spinup target for smooth transition.
+                    // is zeroed. So we make the setpoint the estimated speed for smooth takeover.
+                    controller_.vel_setpoint_ = sensorless_estimator_.vel_estimate_;
+                } else {
+                    status = check_for_errors() && run_lockin_spin(config_.sensorless_ramp);
+                    // see above; here the setpoint is the spinup target
                     controller_.vel_setpoint_ = config_.sensorless_ramp.vel;
-                    status = run_sensorless_control_loop();
                 }
+                if (status)
+                    status = run_sensorless_control_loop();
+                // Checkpoint the estimator on a clean exit so a prompt
+                // restart can warm start.
+                if (error_ == ERROR_NONE)
+                    sensorless_estimator_.checkpoint();
             } break;
 
-            case AXIS_STATE_CLOSED_LOOP_CONTROL: {
+            case AXIS_STATE_HOMING: {
                 if (!motor_.is_calibrated_ || motor_.config_.direction==0)
                     goto invalid_state_label;
-                if (!encoder_.is_ready_)
+                if (!encoder_.is_ready_ || config_.endstop_gpio_pin == 0)
                     goto invalid_state_label;
-                status = run_closed_loop_control_loop();
+                status = run_homing();
             } break;
 
-            case AXIS_STATE_IDLE: {
-                run_idle_loop();
-                status = motor_.arm(); // done with idling - try to arm the motor
+            case AXIS_STATE_SELF_TEST: {
+                // no calibration preconditions: the test applies no voltage
+                status = run_self_test();
             } break;
 
             default:
             invalid_state_label:
-                error_ |= ERROR_INVALID_STATE;
+                set_error(ERROR_INVALID_STATE);
                 status = false; // this will set the state to idle
                 break;
         }
+        release_startup_budget(budget_amps);
 
         // If the state failed, go to idle, else advance task chain
         if (!status)
@@ -441,3 +1178,99 @@ void Axis::run_state_machine_loop() {
             memcpy(task_chain_, task_chain_ + 1, sizeof(task_chain_) - sizeof(task_chain_[0]));
     }
 }
+
+// @brief One worker invocation for this axis: triages a pending state
+// request and runs one control-cycle step of the current steady state
+// (the same body run_control_loop executes per cycle on the service
+// thread, minus the blocking wait).
+void Axis::state_machine_tick() {
+    if (requested_state_ != AXIS_STATE_UNDEFINED) {
+        bool was_idle = entered_steady_state_ == AXIS_STATE_IDLE;
+        load_task_chain();
+        if (was_idle) {
+            entered_steady_state_ = AXIS_STATE_UNDEFINED;
+            motor_.arm(); // done with idling - try to arm the motor
+        }
+        if (is_transient_state(current_state_)) {
+            // run the exit actions of the steady state we're leaving
+            if (entered_steady_state_ == AXIS_STATE_CLOSED_LOOP_CONTROL)
+                set_step_dir_active(false);
+            entered_steady_state_ = AXIS_STATE_UNDEFINED;
+            start_service_thread();
+            return;
+        }
+    }
+    sync_steady_state();
+
+    // look for errors at axis level and also all subcomponents
+    bool checks_ok = do_checks();
+    // Update all estimators
+    // Note: updates run even if checks fail
+    bool updates_ok = do_updates();
+    // make sure the watchdog is being fed.
+    bool watchdog_ok = watchdog_check();
+
+    bool status = true;
+    if (!checks_ok || !updates_ok || !watchdog_ok) {
+        // It's not useful to quit idle since that is the safe action
+        // Also leaving idle would rearm the motors
+        if (current_state_ != AXIS_STATE_IDLE) {
+            // An encoder failure in closed loop may still be recoverable by
+            // degrading to the sensorless observer (see try_sensorless_fallback)
+            if (!try_sensorless_fallback())
+                status = false;
+        }
+    } else {
+        uint32_t profiler_start = Profiler::enter();
+        status = step_steady_state();
+        profiler_.leave(PROFILER_STAGE_CONTROL_LOOP, profiler_start);
+    }
+    ++loop_counter_;
+
+    if (!status)
+        current_state_ = AXIS_STATE_IDLE; // next tick disarms via sync_steady_state
+}
+
+// @brief The shared worker thread body. Waits for the per-axis current
+// meas signals and steps whichever axes are pending; both can usually be
+// serviced from one wakeup since their measurements are only half a PWM
+// period apart.
+void Axis::worker_loop(void* ctx) {
+    (void) ctx;
+    uint32_t now = osKernelSysTick();
+    for (size_t i = 0; i < AXIS_COUNT; ++i) {
+        axes[i]->setup_anticogging_map();
+        axes[i]->last_meas_tick_ = now;
+        // arm!
+        axes[i]->motor_.arm();
+    }
+
+    // This CMSIS port's osSignalWait wakes on any signal and clears exactly
+    // the bits passed in, so ask for every axis bit to avoid stale signals.
+    const int32_t all_axis_signals =
+            ((M_SIGNAL_PH_CURRENT_MEAS << AXIS_COUNT) - 1) & ~(M_SIGNAL_PH_CURRENT_MEAS - 1);
+    for (;;) {
+        osEvent evt = osSignalWait(all_axis_signals, PH_CURRENT_MEAS_TIMEOUT);
+        now = osKernelSysTick();
+        int32_t signals = (evt.status == osEventSignal) ? evt.value.signals : 0;
+        for (size_t i = 0; i < AXIS_COUNT; ++i) {
+            Axis* axis = axes[i];
+            if (axis->thread_id_valid_) {
+                // serviced by its transient-state thread right now
+                axis->last_meas_tick_ = now;
+                continue;
+            }
+            if (signals & (M_SIGNAL_PH_CURRENT_MEAS << i)) {
+                axis->last_meas_tick_ = now;
+                axis->state_machine_tick();
+            } else if ((now - axis->last_meas_tick_) > PH_CURRENT_MEAS_TIMEOUT) {
+                // maybe the interrupt handler is dead, let's be
+                // safe and float the phases
+                safety_critical_disarm_motor_pwm(axis->motor_);
+                update_brake_current();
+                axis->set_error(ERROR_CURRENT_MEASUREMENT_TIMEOUT);
+                axis->last_meas_tick_ = now; // rate-limit the error path
+            }
+        }
+    }
+}
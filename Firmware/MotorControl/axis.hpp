@@ -5,6 +5,17 @@
 #error "This file should not be included directly. Include odrive_main.h instead."
 #endif
 
+// Persistent odometer-class counters, one per axis. Maintained at control
+// rate by Axis::update_odometer() and journaled to NVM by the periodic
+// checkpoint and the PVD brown-out interrupt (see odometer_checkpoint in
+// main.cpp).
+struct AxisOdometer_t {
+    uint32_t revolutions = 0;        // full mechanical turns, either direction
+    uint32_t energized_seconds = 0;  // time with the gate drivers armed
+    uint32_t error_counts[16] = {0}; // occurrences per Motor::Error_t bit
+};
+extern AxisOdometer_t odometers[AXIS_COUNT];
+
 class Axis {
 public:
     enum Error_t {
@@ -35,6 +46,9 @@ public:
         AXIS_STATE_CLOSED_LOOP_CONTROL = 8,  //<! run closed loop control
         AXIS_STATE_LOCKIN_SPIN = 9,       //<! run lockin spin
         AXIS_STATE_ENCODER_DIR_FIND = 10,
+        AXIS_STATE_HOMING = 11,           //<! drive to the endstop and re-reference the position
+        AXIS_STATE_SELF_TEST = 12,        //<! loopback self-test: timing invariants with
+                                          //<! zero drive voltage (see run_self_test)
     };
 
     struct LockinConfig_t {
@@ -58,11 +72,23 @@ public:
         bool startup_encoder_index_search = false; //<! run encoder index search after startup, skip otherwise
                                                 // this only has an effect if encoder.config.use_index is also true
         bool startup_encoder_offset_calibration = false; //<! run encoder offset calibration after startup, skip otherwise
+        bool startup_homing = false; //<! home to the endstop after calibration, skip otherwise
         bool startup_closed_loop_control = false; //<! enable closed loop control after calibration/startup
         bool startup_sensorless_control = false; //<! enable sensorless control after calibration/startup
         bool enable_step_dir = false; //<! enable step/dir input after calibration
                                     //   For M0 this has no effect if enable_uart is true
         float counts_per_step = 2.0f;
+        uint32_t step_filter_length = 1; //<! [control cycles] boxcar smoothing of the
+                                         //<! step input, for bursty step sources
+                                         //<! (see apply_step_dir_counts). 1 = off,
+                                         //<! clamped to 16. Adds length/2 cycles of
+                                         //<! command delay.
+
+        // Sensorless fallback: the encoder stays primary, the flux observer
+        // cross-checks it at a decimated rate, and an encoder failure in
+        // closed loop degrades the axis to velocity control on the observer
+        // estimates instead of faulting (see try_sensorless_fallback).
+        bool enable_sensorless_fallback = false;
 
         float watchdog_timeout = 0.0f; // [s] (0 disables watchdog)
 
@@ -70,6 +96,12 @@ public:
         uint16_t step_gpio_pin = 0;
         uint16_t dir_gpio_pin = 0;
 
+        // Homing to an endstop switch (AXIS_STATE_HOMING)
+        uint16_t endstop_gpio_pin = 0;    // 0 = homing unavailable
+        bool endstop_active_high = true;
+        float homing_vel = -2000.0f;      // [counts/s] approach velocity, sign = direction
+        float homing_offset = 0.0f;       // [counts] position assigned at the endstop
+
         LockinConfig_t calibration_lockin = default_calibration();
         LockinConfig_t sensorless_ramp = default_sensorless();
         LockinConfig_t lockin;
@@ -79,6 +111,26 @@ public:
         M_SIGNAL_PH_CURRENT_MEAS = 1u << 0
     };
 
+    // First-failure capture: error bits only ever get OR'ed into the
+    // per-component error fields, which destroys the ordering a cascade
+    // (encoder -> controller -> motor disarm) needs for root-causing.
+    // Every newly set bit is therefore also appended to a small per-axis
+    // event log with the loop counter at that moment, and the very first
+    // event is latched in a dedicated register.
+    enum ErrorSource_t : uint8_t {
+        ERROR_SOURCE_AXIS = 0,
+        ERROR_SOURCE_MOTOR = 1,
+        ERROR_SOURCE_ENCODER = 2,
+        ERROR_SOURCE_CONTROLLER = 3,
+        ERROR_SOURCE_SENSORLESS = 4,
+    };
+    static constexpr size_t ERROR_LOG_DEPTH = 8;
+    struct ErrorEvent_t {
+        uint32_t loop_counter = 0;
+        uint32_t source = 0;     // ErrorSource_t
+        uint32_t error_bits = 0; // bits that were newly set by this event
+    };
+
     enum LockinState_t {
         LOCKIN_STATE_INACTIVE,
         LOCKIN_STATE_RAMP,
@@ -96,18 +148,71 @@ public:
             TrapezoidalTrajectory& trap);
 
     void setup();
-    void start_thread();
+    static void start_worker();
     void signal_current_meas();
     bool wait_for_current_meas();
 
     void step_cb();
+    void apply_step_dir_counts();
     void set_step_dir_active(bool enable);
     void decode_step_dir_pins();
     void update_watchdog_settings();
 
+    // Property-write hooks staged by the comm thread and run at the axis
+    // thread sync point (see stage_deferred_hook / run_deferred_hooks)
+    enum DeferredHook_t : uint32_t {
+        DEFERRED_HOOK_WATCHDOG_SETTINGS = 0x01,
+        DEFERRED_HOOK_STEP_DIR_PINS = 0x02,
+    };
+    void stage_deferred_hook(uint32_t hook);
+    void run_deferred_hooks();
+
+    void update_odometer();
+    uint32_t get_odometer_error_count(uint32_t bit);
+
+    void update_status_snapshot();
+
+    // Coherent telemetry mirror (see update_telemetry_mirror). The control
+    // loop publishes these fields together once per TELEMETRY_DECIMATION
+    // cycles; comm-side consumers that report multi-field groups (ASCII
+    // feedback, cyclic CAN frames) copy the whole block via read_telemetry()
+    // instead of picking live fields from different control cycles.
+    struct Telemetry_t {
+        float pos_estimate = 0.0f; // [counts]
+        float vel_estimate = 0.0f; // [counts/s]
+        float Iq_setpoint = 0.0f;  // [A]
+        float Iq_measured = 0.0f;  // [A]
+        uint32_t loop_counter = 0; // control cycle the block was captured on
+    };
+    void update_telemetry_mirror();
+    Telemetry_t read_telemetry();
+
+    // Unified estimator output (see update_estimate_frame). The active
+    // estimator's view of the rotor is packed into one struct so the
+    // controller/motor stages and the per-cycle copiers (telemetry mirror,
+    // blackbox) read one cache line per cycle instead of chasing fields
+    // scattered across the encoder, sensorless estimator and fallback state.
+    enum EstimateFlags_t : uint32_t {
+        ESTIMATE_FLAG_SENSORLESS = 0x01, // source is the flux observer
+        ESTIMATE_FLAG_FALLBACK = 0x02,   // degraded mode after encoder failure
+    };
+    struct EstimateFrame_t {
+        float pos = 0.0f;       // [counts] ([rad] electrical when SENSORLESS)
+        float vel = 0.0f;       // [counts/s] ([rad/s] electrical when SENSORLESS)
+        float phase = 0.0f;     // [rad] electrical rotor phase for FOC
+        float phase_vel = 0.0f; // [rad/s] electrical
+        uint32_t flags = 0;     // EstimateFlags_t
+    };
+    void update_estimate_frame();
+
     static void load_default_step_dir_pin_config(
         const AxisHardwareConfig_t& hw_config, Config_t* config);
 
+    void set_error(Error_t error);
+    void log_error(ErrorSource_t source, uint32_t new_bits);
+    uint64_t get_error_event(uint32_t index);
+    void clear_error_log();
+
     bool check_DRV_fault();
     bool check_PSU_brownout();
     bool do_checks();
@@ -145,6 +250,7 @@ public:
     template<typename T>
     void run_control_loop(const T& update_handler) {
         while (requested_state_ == AXIS_STATE_UNDEFINED) {
+            TRACE_LOOP_START(axis_num_);
             // look for errors at axis level and also all subcomponents
             bool checks_ok = do_checks();
             // Update all estimators
@@ -163,7 +269,10 @@ public:
 
             // Run main loop function, defer quitting for after wait
             // TODO: change arming logic to arm after waiting
+            uint32_t profiler_start = Profiler::enter();
             bool main_continue = update_handler();
+            profiler_.leave(PROFILER_STAGE_CONTROL_LOOP, profiler_start);
+            TRACE_LOOP_END(axis_num_);
 
             // Check we meet deadlines after queueing
             ++loop_counter_;
@@ -174,7 +283,7 @@ public:
                 // safe and float the phases
                 safety_critical_disarm_motor_pwm(motor_);
                 update_brake_current();
-                error_ |= ERROR_CURRENT_MEASUREMENT_TIMEOUT;
+                set_error(ERROR_CURRENT_MEASUREMENT_TIMEOUT);
                 break;
             }
 
@@ -184,11 +293,44 @@ public:
     }
 
     bool run_lockin_spin(const LockinConfig_t &lockin_config);
+    bool run_flying_start();
     bool run_sensorless_control_loop();
-    bool run_closed_loop_control_loop();
-    bool run_idle_loop();
-
-    void run_state_machine_loop();
+    bool run_homing();
+    bool run_self_test();
+
+    // Results of the last AXIS_STATE_SELF_TEST run (see run_self_test)
+    struct SelfTestResults_t {
+        bool pass = false;
+        uint32_t cycles = 0;            // control cycles measured
+        float period_mean_us = 0.0f;    // mean thread-level control period
+        float period_min_us = 0.0f;
+        float period_max_us = 0.0f;
+        float period_max_dev_us = 0.0f; // worst deviation from nominal
+        uint32_t adc_phase_spread = 0;  // [timer clocks] spread of the current-sample
+                                        // to DC-calibration-sample distance
+    } self_test_results_;
+    void endstop_cb();
+
+    // Sensorless fallback (see config_.enable_sensorless_fallback)
+    void sensorless_cross_check();
+    bool try_sensorless_fallback();
+
+    // Cooperative state machine (see axis.cpp for the architecture notes).
+    // The steady states are stepped once per current measurement by the
+    // shared worker thread; the transient states run sequentially on a
+    // short-lived service thread.
+    static bool is_transient_state(State_t state);
+    float startup_peak_current(State_t state);
+    bool acquire_startup_budget(float amps);
+    static void release_startup_budget(float amps);
+    void setup_anticogging_map();
+    void load_task_chain();
+    void state_machine_tick();
+    void sync_steady_state();
+    bool step_steady_state();
+    void start_service_thread();
+    void run_transient_states();
+    static void worker_loop(void* ctx);
 
     int axis_num_;
     const AxisHardwareConfig_t& hw_config_;
@@ -200,12 +342,36 @@ public:
     Motor& motor_;
     TrapezoidalTrajectory& trap_;
 
+    // Shared worker thread that services the steady states of all axes
+    static osThreadId worker_thread_id;
+    // Service thread for transient states; exists only while one runs
     osThreadId thread_id_;
     volatile bool thread_id_valid_ = false;
+    // Steady state whose entry actions have run (see sync_steady_state)
+    State_t entered_steady_state_ = AXIS_STATE_UNDEFINED;
+    // osKernelSysTick of the last current meas signal seen by the worker
+    uint32_t last_meas_tick_ = 0;
 
     // variables exposed on protocol
     Error_t error_ = ERROR_NONE;
+    // First-failure capture (see log_error). first_error_ packs the source
+    // in bits 24-31 and the newly set error bits below; 0 = no error yet.
+    uint32_t first_error_ = 0;
+    uint32_t first_error_time_ = 0; // [loop_counter_] when first_error_ latched
+    ErrorEvent_t error_log_[ERROR_LOG_DEPTH];
+    uint32_t error_log_count_ = 0;
     bool step_dir_active_ = false; // auto enabled after calibration, based on config.enable_step_dir
+    volatile int32_t step_count_delta_ = 0; // steps accumulated by step_cb() since the last control cycle
+    volatile uint32_t step_edge_timestamp_ = 0; // DWT cycle count of the oldest unconsumed
+                                                // step edge, 0 = none pending
+    uint32_t step_latency_timestamp_ = 0; // edge timestamp of the setpoint fold in flight
+    float step_to_pwm_latency_us_ = 0.0f; // last measured step edge -> PWM timings latency
+                                          // (see Axis::step_cb)
+
+    // step smoothing working state (see apply_step_dir_counts)
+    static constexpr uint32_t MAX_STEP_FILTER_LENGTH = 16;
+    float step_filter_window_[MAX_STEP_FILTER_LENGTH] = { 0 };
+    uint32_t step_filter_index_ = 0;
 
     // updated from config in constructor, and on protocol hook
     GPIO_TypeDef* step_port_;
@@ -213,39 +379,100 @@ public:
     GPIO_TypeDef* dir_port_;
     uint16_t dir_pin_;
 
+    // resolved from config_.endstop_gpio_pin by run_homing()
+    GPIO_TypeDef* endstop_port_ = nullptr;
+    uint16_t endstop_pin_ = 0;
+    volatile bool endstop_pressed_ = false; // set by endstop_cb() in interrupt context
+
     State_t requested_state_ = AXIS_STATE_STARTUP_SEQUENCE;
     State_t task_chain_[10] = { AXIS_STATE_UNDEFINED };
     State_t& current_state_ = task_chain_[0];
     uint32_t loop_counter_ = 0;
     LockinState_t lockin_state_ = LOCKIN_STATE_INACTIVE;
 
+    // per-cycle packed estimator output (see update_estimate_frame)
+    EstimateFrame_t estimate_frame_;
+
+    // Sensorless fallback state (see try_sensorless_fallback)
+    bool sensorless_fallback_active_ = false;
+    uint32_t fallback_engage_cnt_ = 0;   // fallback engagements since boot
+    float fallback_pos_counts_ = 0.0f;   // [count] position integrated from the
+                                         // observer velocity in degraded mode
+    uint8_t fallback_check_cycle_ = 0;   // decimation counter of the cross-check
+    uint32_t fallback_disagree_cnt_ = 0; // consecutive disagreeing cross-checks
+
     // watchdog
     uint32_t watchdog_reset_value_ = 0; //computed from config_.watchdog_timeout in update_watchdog_settings()
     uint32_t watchdog_current_value_= 0;
 
+    // bitmask of DeferredHook_t, staged by the comm thread
+    std::atomic<uint32_t> deferred_hooks_{0};
+
+    // odometer working state (see update_odometer)
+    int32_t odo_last_count_ = 0;
+    uint32_t odo_rev_accum_counts_ = 0;
+    uint32_t odo_energized_cycles_ = 0;
+    uint32_t odo_prev_motor_error_ = 0;
+
+    // packed health snapshot, refreshed once per control cycle
+    // (see update_status_snapshot for the bit layout)
+    uint64_t status_word_ = 0;
+    uint64_t status_measurements_ = 0;
+
+    // telemetry double buffer; telemetry_seq_ counts publishes and the
+    // front buffer is telemetry_buf_[telemetry_seq_ & 1]
+    static constexpr uint32_t TELEMETRY_DECIMATION = 8;
+    Telemetry_t telemetry_buf_[2];
+    std::atomic<uint32_t> telemetry_seq_{0};
+    uint32_t telemetry_decimation_cnt_ = 0;
+
     // Communication protocol definitions
     auto make_protocol_definitions() {
         return make_protocol_member_list(
             make_protocol_property("error", &error_),
+            make_protocol_ro_property("first_error", &first_error_),
+            make_protocol_ro_property("first_error_time", &first_error_time_),
+            make_protocol_ro_property("error_log_count", &error_log_count_),
+            make_protocol_function("get_error_event", *this, &Axis::get_error_event, "index"),
+            make_protocol_function("clear_error_log", *this, &Axis::clear_error_log),
             make_protocol_ro_property("step_dir_active", &step_dir_active_),
+            make_protocol_ro_property("step_to_pwm_latency_us", &step_to_pwm_latency_us_),
             make_protocol_ro_property("current_state", &current_state_),
             make_protocol_property("requested_state", &requested_state_),
             make_protocol_ro_property("loop_counter", &loop_counter_),
             make_protocol_ro_property("lockin_state", &lockin_state_),
+            make_protocol_ro_property("sensorless_fallback_active", &sensorless_fallback_active_),
+            make_protocol_ro_property("fallback_engage_cnt", &fallback_engage_cnt_),
+            make_protocol_object("self_test_results",
+                make_protocol_ro_property("pass", &self_test_results_.pass),
+                make_protocol_ro_property("cycles", &self_test_results_.cycles),
+                make_protocol_ro_property("period_mean_us", &self_test_results_.period_mean_us),
+                make_protocol_ro_property("period_min_us", &self_test_results_.period_min_us),
+                make_protocol_ro_property("period_max_us", &self_test_results_.period_max_us),
+                make_protocol_ro_property("period_max_dev_us", &self_test_results_.period_max_dev_us),
+                make_protocol_ro_property("adc_phase_spread", &self_test_results_.adc_phase_spread)
+            ),
             make_protocol_object("config",
                 make_protocol_property("startup_motor_calibration", &config_.startup_motor_calibration),
                 make_protocol_property("startup_encoder_index_search", &config_.startup_encoder_index_search),
                 make_protocol_property("startup_encoder_offset_calibration", &config_.startup_encoder_offset_calibration),
+                make_protocol_property("startup_homing", &config_.startup_homing),
                 make_protocol_property("startup_closed_loop_control", &config_.startup_closed_loop_control),
                 make_protocol_property("startup_sensorless_control", &config_.startup_sensorless_control),
+                make_protocol_property("enable_sensorless_fallback", &config_.enable_sensorless_fallback),
                 make_protocol_property("enable_step_dir", &config_.enable_step_dir),
                 make_protocol_property("counts_per_step", &config_.counts_per_step),
+                make_protocol_property("step_filter_length", &config_.step_filter_length),
                 make_protocol_property("watchdog_timeout", &config_.watchdog_timeout,
-                    [](void* ctx) { static_cast<Axis*>(ctx)->update_watchdog_settings(); }, this),
+                    [](void* ctx) { static_cast<Axis*>(ctx)->stage_deferred_hook(DEFERRED_HOOK_WATCHDOG_SETTINGS); }, this),
                 make_protocol_property("step_gpio_pin", &config_.step_gpio_pin,
-                    [](void* ctx) { static_cast<Axis*>(ctx)->decode_step_dir_pins(); }, this),
+                    [](void* ctx) { static_cast<Axis*>(ctx)->stage_deferred_hook(DEFERRED_HOOK_STEP_DIR_PINS); }, this),
                 make_protocol_property("dir_gpio_pin", &config_.dir_gpio_pin,
-                    [](void* ctx) { static_cast<Axis*>(ctx)->decode_step_dir_pins(); }, this),
+                    [](void* ctx) { static_cast<Axis*>(ctx)->stage_deferred_hook(DEFERRED_HOOK_STEP_DIR_PINS); }, this),
+                make_protocol_property("endstop_gpio_pin", &config_.endstop_gpio_pin),
+                make_protocol_property("endstop_active_high", &config_.endstop_active_high),
+                make_protocol_property("homing_vel", &config_.homing_vel),
+                make_protocol_property("homing_offset", &config_.homing_offset),
                 make_protocol_object("calibration_lockin",
                     make_protocol_property("current", &config_.calibration_lockin.current),
                     make_protocol_property("ramp_time", &config_.calibration_lockin.ramp_time),
@@ -281,6 +508,15 @@ public:
             make_protocol_object("encoder", encoder_.make_protocol_definitions()),
             make_protocol_object("sensorless_estimator", sensorless_estimator_.make_protocol_definitions()),
             make_protocol_object("trap_traj", trap_.make_protocol_definitions()),
+            make_protocol_object("odometer",
+                make_protocol_ro_property("revolutions", &odometers[axis_num_].revolutions),
+                make_protocol_ro_property("energized_seconds", &odometers[axis_num_].energized_seconds),
+                make_protocol_function("get_error_count", *this, &Axis::get_odometer_error_count, "bit")
+            ),
+            make_protocol_object("status",
+                make_protocol_ro_property("word", &status_word_),
+                make_protocol_ro_property("measurements", &status_measurements_)
+            ),
             make_protocol_function("watchdog_feed", *this, &Axis::watchdog_feed)
         );
     }
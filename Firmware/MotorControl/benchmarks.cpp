@@ -0,0 +1,143 @@
+/* On-target microbenchmark suite.
+ *
+ * Built into the firmware with CONFIG_BENCHMARK=true (see tup.config) and
+ * run once at boot, after profiler_.init() and before start_adc_pwm(), so
+ * the DWT cycle counter is live and no control interrupt skews the numbers.
+ * Results go out over UART4 as plain text at the configured baud rate.
+ *
+ * Motor::FOC_current is deliberately not benchmarked here: it needs armed
+ * gate drivers and live current samples. Its cycle cost is measured in
+ * normal operation by the foc_current profiler stage instead.
+ */
+
+#include "odrive_main.h"
+
+#ifdef RUN_BENCHMARKS
+
+#include "atan2_lut.hpp"
+#include "thermistor_lut.hpp"
+#include <fibre/crc.hpp>
+#include <usart.h>
+#include <stdio.h>
+#include <string.h>
+
+// volatile sinks keep the optimizer from deleting the measured calls
+static volatile float sink_f_ = 0.0f;
+static volatile uint32_t sink_u_ = 0;
+
+static uint8_t crc_buf_[64];
+
+static void print_line(const char* line) {
+    HAL_UART_Transmit(&huart4, (uint8_t*)line, strlen(line), HAL_MAX_DELAY);
+}
+
+static void report(const char* name, uint32_t cycles_per_iter) {
+    char buf[48];
+    snprintf(buf, sizeof(buf), "%-14s %6lu cycles\r\n", name,
+             (unsigned long)cycles_per_iter);
+    print_line(buf);
+}
+
+// @brief Runs body 1024 times with interrupts masked and returns the mean
+// DWT cycle count per iteration (including ~3 cycles of loop overhead,
+// reported separately as loop_overhead).
+template<typename F>
+static uint32_t measure(const F& body) {
+    constexpr uint32_t iters = 1024;
+    body(0); // warm the flash accelerator and branch predictor
+    uint32_t mask = cpu_enter_critical();
+    uint32_t start = DWT->CYCCNT;
+    for (uint32_t i = 0; i < iters; ++i)
+        body(i);
+    uint32_t cycles = DWT->CYCCNT - start;
+    cpu_exit_critical(mask);
+    return cycles / iters;
+}
+
+void run_benchmarks(void) {
+    print_line("\r\n--- microbenchmarks (mean cycles/iteration) ---\r\n");
+
+    report("loop_overhead", measure([](uint32_t i) {
+        sink_u_ = i;
+    }));
+
+    report("our_arm_cos", measure([](uint32_t i) {
+        sink_f_ = our_arm_cos_f32(0.001f * (float)(i & 1023));
+    }));
+
+    report("fast_sincos", measure([](uint32_t i) {
+        float s, c;
+        fast_sincos(0.001f * (float)(i & 1023), &s, &c);
+        sink_f_ = s + c;
+    }));
+
+    report("SVM", measure([](uint32_t i) {
+        float tA, tB, tC;
+        float alpha = 0.0005f * (float)(i & 1023) - 0.25f;
+        SVM(alpha, 0.3f, &tA, &tB, &tC);
+        sink_f_ = tA + tB + tC;
+    }));
+
+    report("SVM_timings", measure([](uint32_t i) {
+        uint16_t tA, tB, tC;
+        float alpha = 0.0005f * (float)(i & 1023) - 0.25f;
+        SVM_timings(alpha, 0.3f, TIM_1_8_PERIOD_CLOCKS, &tA, &tB, &tC);
+        sink_u_ = (uint32_t)tA + tB + tC;
+    }));
+
+    report("SVM_sector", measure([](uint32_t i) {
+        float tA, tB, tC;
+        float alpha = 0.0005f * (float)(i & 1023) - 0.25f;
+        SVM_sector(alpha, 0.3f, &tA, &tB, &tC);
+        sink_f_ = tA + tB + tC;
+    }));
+
+    // Equivalence check: the min/max SVM must match the sector reference
+    // within float rounding over the modulation disc. Points where the two
+    // disagree on validity (rounding at the exact [0,1] boundary) are
+    // skipped.
+    {
+        float max_dev = 0.0f;
+        for (int ia = -50; ia <= 50; ++ia) {
+            for (int ib = -50; ib <= 50; ++ib) {
+                float alpha = 0.016f * (float)ia;
+                float beta = 0.016f * (float)ib;
+                float tA, tB, tC, rA, rB, rC;
+                if (SVM(alpha, beta, &tA, &tB, &tC) != 0)
+                    continue;
+                if (SVM_sector(alpha, beta, &rA, &rB, &rC) != 0)
+                    continue;
+                float dev = fabsf(tA - rA);
+                dev = MACRO_MAX(dev, fabsf(tB - rB));
+                dev = MACRO_MAX(dev, fabsf(tC - rC));
+                max_dev = MACRO_MAX(max_dev, dev);
+            }
+        }
+        char buf[48];
+        snprintf(buf, sizeof(buf), "%-14s %6lu nano\r\n", "SVM_max_dev",
+                 (unsigned long)(max_dev * 1e9f));
+        print_line(buf);
+    }
+
+    report("fast_atan2", measure([](uint32_t i) {
+        sink_f_ = fast_atan2(0.001f * (float)(i & 1023) - 0.5f, 0.4f);
+    }));
+
+    report("fast_atan2_lut", measure([](uint32_t i) {
+        sink_f_ = fast_atan2_lut(0.001f * (float)(i & 1023) - 0.5f, 0.4f);
+    }));
+
+    report("thermistor_lut", measure([](uint32_t i) {
+        sink_f_ = thermistor_lut_temp(0.001f * (float)(i & 1023));
+    }));
+
+    for (size_t i = 0; i < sizeof(crc_buf_); ++i)
+        crc_buf_[i] = (uint8_t)i;
+    report("crc16_64B", measure([](uint32_t i) {
+        sink_u_ = calc_crc16<0x3d65>((uint16_t)i, crc_buf_, sizeof(crc_buf_));
+    }));
+
+    print_line("--- end of benchmarks ---\r\n");
+}
+
+#endif // RUN_BENCHMARKS
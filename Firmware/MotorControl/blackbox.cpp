@@ -0,0 +1,63 @@
+#include "odrive_main.h"
+
+#include <stdlib.h>
+
+BlackBox blackbox_;
+
+// @brief Allocates the ring buffer and starts recording.
+// Allocated from the FreeRTOS heap (core coupled memory) so the per-cycle
+// writes never contend with DMA traffic in the main SRAM; falls back to the
+// regular heap if the CCM heap is exhausted.
+bool BlackBox::init() {
+#ifdef STATIC_ALLOCATION_ONLY
+    // Static allocation build: the ring lives in main SRAM (the CCM
+    // budget goes to the thread stacks, see freertos_vars.h)
+    static Record_t static_buffer[DEPTH];
+    buffer_ = static_buffer;
+#else
+    buffer_ = (Record_t*)pvPortMalloc(DEPTH * sizeof(Record_t));
+    if (!buffer_)
+        buffer_ = (Record_t*)malloc(DEPTH * sizeof(Record_t));
+    if (!buffer_)
+        return false;
+#endif
+    for (size_t i = 0; i < DEPTH; ++i)
+        buffer_[i] = Record_t();
+    write_index_ = 0;
+    state_ = STATE_RECORDING;
+    return true;
+}
+
+void BlackBox::sample() {
+    if (state_ != STATE_RECORDING)
+        return;
+
+    for (size_t i = 0; i < AXIS_COUNT; ++i) {
+        Axis& axis = *axes[i];
+        Record_t& record = buffer_[write_index_];
+        record.Iq_measured = axis.motor_.current_control_.Iq_measured;
+        record.vel_estimate = axis.estimate_frame_.vel;
+        record.vbus_voltage = vbus_voltage;
+        record.deadline_margin = axis.motor_.isr_deadline_margin_;
+        record.armed_state = (uint8_t)axis.motor_.armed_state_;
+        record.axis = (uint8_t)i;
+        write_index_ = (write_index_ + 1) % DEPTH;
+    }
+
+    // Freeze on any error so the ring preserves the run-up to the fault.
+    // Motor errors are checked directly (not just the axis error) because
+    // they are set from interrupt context and only propagate to the axis
+    // error on the next thread iteration.
+    for (size_t i = 0; i < AXIS_COUNT; ++i) {
+        if (axes[i]->error_ != Axis::ERROR_NONE
+            || axes[i]->motor_.error_ != Motor::ERROR_NONE) {
+            state_ = STATE_FROZEN;
+            break;
+        }
+    }
+}
+
+void BlackBox::rearm() {
+    if (state_ == STATE_FROZEN)
+        state_ = STATE_RECORDING;
+}
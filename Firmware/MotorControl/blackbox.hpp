@@ -0,0 +1,79 @@
+#ifndef __BLACKBOX_HPP
+#define __BLACKBOX_HPP
+
+#ifndef __ODRIVE_MAIN_H
+#error "This file should not be included directly. Include odrive_main.h instead."
+#endif
+
+// @brief Always-on post-mortem flight recorder.
+//
+// Unlike the oscilloscope, which has to be configured and armed per capture,
+// this continuously records one compact record per axis per control cycle
+// into a ring buffer in core coupled memory and freezes the moment any axis
+// or motor reports an error. The frozen ring then holds the last DEPTH /
+// AXIS_COUNT cycles leading up to the fault, so a field failure can be
+// diagnosed from the actual run-up instead of just the error bitmask.
+//
+// The ring is read back in bulk through the "data" array endpoint as raw
+// 32 bit words; write_index points at the oldest record (i.e. the next one
+// that would have been overwritten) and record_size gives the number of
+// words per record.
+class BlackBox {
+public:
+    enum State_t {
+        STATE_DISABLED = 0, // buffer allocation failed
+        STATE_RECORDING = 1,
+        STATE_FROZEN = 2,
+    };
+
+    // 16 bytes per record so the ring holds a useful pre-fault window
+    // without starving the CCM heap the control objects live on.
+    struct Record_t {
+        float Iq_measured;        // [A]
+        float vel_estimate;       // [counts/s] from the axis estimate frame;
+                                  // [rad/s] electrical while the sensorless
+                                  // estimator is the source
+        float vbus_voltage;       // [V]
+        uint16_t deadline_margin; // [timer clocks] headroom left in the cycle
+        uint8_t armed_state;      // Motor::ArmedState_t
+        uint8_t axis;             // which axis this record describes
+    };
+
+    static constexpr size_t DEPTH = 512; // records (8KB), 32ms per axis at 8kHz
+
+    // @brief Allocates the ring buffer and starts recording. Must be called
+    // before the protocol endpoint tree is built.
+    bool init();
+
+    // @brief Records one snapshot per axis. Called once per current
+    // measurement cycle in interrupt context.
+    void sample();
+
+    // @brief Restarts recording after a frozen capture was read out.
+    void rearm();
+
+    State_t state_ = STATE_DISABLED;
+    uint32_t write_index_ = 0; // oldest record while frozen
+
+    // Communication protocol definitions
+    auto make_protocol_definitions() {
+        return make_protocol_member_list(
+            make_protocol_ro_property("state", &state_),
+            make_protocol_ro_property("write_index", &write_index_),
+            make_protocol_ro_property("depth", &depth_),
+            make_protocol_ro_property("record_size", &record_size_),
+            make_protocol_ro_array_property("data", (uint32_t*)buffer_,
+                    DEPTH * (sizeof(Record_t) / sizeof(uint32_t))),
+            make_protocol_function("rearm", *this, &BlackBox::rearm)
+        );
+    }
+
+private:
+    Record_t* buffer_ = nullptr;
+    const uint32_t depth_ = DEPTH;
+    const uint32_t record_size_ = sizeof(Record_t) / sizeof(uint32_t); // [words]
+};
+
+extern BlackBox blackbox_;
+
+#endif // __BLACKBOX_HPP
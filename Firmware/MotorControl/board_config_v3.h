@@ -19,6 +19,52 @@
 #endif
 #endif
 
+#ifdef __cplusplus
+// Compile-time revision matrix. The preprocessor ladders (here, in gpio.h
+// and in low_level.cpp/main.cpp) still select the features; this struct
+// pins down the combinations they are allowed to produce. Mis-sized
+// GPIO/PWM mapping tables from an inconsistent ladder only show up as
+// memory corruption on the affected revision, so the derived counts are
+// cross-checked with static_asserts (below, in odrive_main.h and in
+// low_level.h) and an invalid combination fails the build instead.
+struct BoardRevision_t {
+    int hw_major;
+    int hw_minor;
+    int gpio_count;           // user GPIO pads = extent of the mapping tables
+    int adc_channel_count;    // ADC1 regular conversion sequence length
+    int m0_thermistor_adc_ch; // inverter thermistor channels, must be part
+    int m1_thermistor_adc_ch; // of the regular sequence
+    int m1_step_gpio_pin;     // default M1 step/dir pads (user GPIO
+    int m1_dir_gpio_pin;      // numbers, 1-based)
+};
+
+static constexpr BoardRevision_t board_rev = {
+    HW_VERSION_MAJOR,
+    HW_VERSION_MINOR,
+    /*.gpio_count =*/ (HW_VERSION_MINOR <= 4) ? 5 : 8,
+    /*.adc_channel_count =*/ 16,
+    /*.m0_thermistor_adc_ch =*/ 15,
+    /*.m1_thermistor_adc_ch =*/ (HW_VERSION_MINOR >= 3) ? 4 : 1,
+    /*.m1_step_gpio_pin =*/ (HW_VERSION_MINOR >= 5) ? 7 : 3,
+    /*.m1_dir_gpio_pin =*/ (HW_VERSION_MINOR >= 5) ? 8 : 4,
+};
+
+static_assert(board_rev.hw_major == 3,
+    "this board definition only covers ODrive v3.x");
+static_assert(board_rev.gpio_count == GPIO_COUNT,
+    "GPIO_COUNT ladder in gpio.h disagrees with the revision matrix");
+static_assert(board_rev.m1_step_gpio_pin <= board_rev.gpio_count &&
+              board_rev.m1_dir_gpio_pin <= board_rev.gpio_count,
+    "default M1 step/dir pads must be user GPIOs present on this revision");
+static_assert(board_rev.m0_thermistor_adc_ch < board_rev.adc_channel_count &&
+              board_rev.m1_thermistor_adc_ch < board_rev.adc_channel_count,
+    "thermistor channels must be within the ADC regular sequence");
+// control_deadline is a uint16_t; the M1 deadline is 1.5 PWM periods, so a
+// CONFIG_CONTROL_FREQ override that stretches the carrier must not let it
+// wrap
+static_assert((3 * TIM_1_8_PERIOD_CLOCKS) / 2 <= UINT16_MAX,
+    "M1 control deadline does not fit the timer compare width");
+#endif // __cplusplus
 
 typedef struct {
     uint16_t step_gpio_pin;
@@ -28,8 +74,14 @@ typedef struct {
 
 typedef struct {
     TIM_HandleTypeDef* timer;
+    SPI_HandleTypeDef* spi; // for absolute encoders (shared with the gate drivers)
     GPIO_TypeDef* index_port;
     uint16_t index_pin;
+    // Input capture channel of `timer` the index pin routes to via
+    // `index_capture_af`, or UINT32_MAX if the pin has no such routing
+    // (the index then falls back to the EXTI path).
+    uint32_t index_capture_channel;
+    uint8_t index_capture_af;
     GPIO_TypeDef* hallA_port;
     uint16_t hallA_pin;
     GPIO_TypeDef* hallB_port;
@@ -60,15 +112,9 @@ typedef struct {
 } BoardHardwareConfig_t;
 
 extern const BoardHardwareConfig_t hw_configs[2];
-extern const float thermistor_poly_coeffs[];
-extern const size_t thermistor_num_coeffs;
 
 //TODO stick this in a C file
 #ifdef __MAIN_CPP__
-const float thermistor_poly_coeffs[] =
-    {363.93910201f, -462.15369634f, 307.55129571f, -27.72569531f};
-const size_t thermistor_num_coeffs = sizeof(thermistor_poly_coeffs)/sizeof(thermistor_poly_coeffs[1]);
-
 const BoardHardwareConfig_t hw_configs[2] = { {
     //M0
     .axis_config = {
@@ -78,8 +124,13 @@ const BoardHardwareConfig_t hw_configs[2] = { {
     },
     .encoder_config = {
         .timer = &htim3,
+        .spi = &hspi3,
         .index_port = M0_ENC_Z_GPIO_Port,
         .index_pin = M0_ENC_Z_Pin,
+        // M0_ENC_Z (PC9) is TIM3_CH4, i.e. a capture channel of the
+        // encoder's own counting timer
+        .index_capture_channel = TIM_CHANNEL_4,
+        .index_capture_af = GPIO_AF2_TIM3,
         .hallA_port = M0_ENC_A_GPIO_Port,
         .hallA_pin = M0_ENC_A_Pin,
         .hallB_port = M0_ENC_B_GPIO_Port,
@@ -91,7 +142,7 @@ const BoardHardwareConfig_t hw_configs[2] = { {
         .timer = &htim1,
         .control_deadline = TIM_1_8_PERIOD_CLOCKS,
         .shunt_conductance = 1.0f / SHUNT_RESISTANCE,  //[S]
-        .inverter_thermistor_adc_ch = 15,
+        .inverter_thermistor_adc_ch = (size_t)board_rev.m0_thermistor_adc_ch,
     },
     .gate_driver_config = {
         .spi = &hspi3,
@@ -106,19 +157,18 @@ const BoardHardwareConfig_t hw_configs[2] = { {
 },{
     //M1
     .axis_config = {
-#if HW_VERSION_MAJOR == 3 && HW_VERSION_MINOR >= 5
-        .step_gpio_pin = 7,
-        .dir_gpio_pin = 8,
-#else
-        .step_gpio_pin = 3,
-        .dir_gpio_pin = 4,
-#endif
+        .step_gpio_pin = (uint16_t)board_rev.m1_step_gpio_pin,
+        .dir_gpio_pin = (uint16_t)board_rev.m1_dir_gpio_pin,
         .thread_priority = osPriorityHigh,
     },
     .encoder_config = {
         .timer = &htim4,
+        .spi = &hspi3,
         .index_port = M1_ENC_Z_GPIO_Port,
         .index_pin = M1_ENC_Z_Pin,
+        // M1_ENC_Z (PC15) has no timer routing, EXTI only
+        .index_capture_channel = UINT32_MAX,
+        .index_capture_af = 0,
         .hallA_port = M1_ENC_A_GPIO_Port,
         .hallA_pin = M1_ENC_A_Pin,
         .hallB_port = M1_ENC_B_GPIO_Port,
@@ -130,11 +180,7 @@ const BoardHardwareConfig_t hw_configs[2] = { {
         .timer = &htim8,
         .control_deadline = (3 * TIM_1_8_PERIOD_CLOCKS) / 2,
         .shunt_conductance = 1.0f / SHUNT_RESISTANCE,  //[S]
-#if HW_VERSION_MAJOR == 3 && HW_VERSION_MINOR >= 3
-        .inverter_thermistor_adc_ch = 4,
-#else
-        .inverter_thermistor_adc_ch = 1,
-#endif
+        .inverter_thermistor_adc_ch = (size_t)board_rev.m1_thermistor_adc_ch,
     },
     .gate_driver_config = {
         .spi = &hspi3,
@@ -0,0 +1,111 @@
+/* Distributed clock over CAN, EtherCAT-DC style.
+*
+* A master (normally the host) broadcasts its microsecond clock in a TIME
+* frame (StdId 0x001, u32 time [us], see interface_can.cpp). Each drive
+* disciplines an offset between its local micros() clock and the master
+* clock, and trims the TIM1/TIM8 period by a few counts per cycle until
+* its control cycle boundary falls on a multiple of the control period in
+* master time. All drives on the bus then run their control loops
+* phase-locked to the same wall clock instead of beating against each
+* other at the difference of their crystal errors, and timestamps are
+* comparable across the fleet.
+*
+* The offset is a plain IIR average over the received frames: a single
+* frame's latency is dominated by CAN arbitration (up to ~100us behind a
+* max-length frame at 500k), but that delay is zero-mean as long as the
+* master sends at a rate uncorrelated with the bus load. 10Hz broadcasts
+* are plenty; the trim loop's bandwidth is far below that.
+*
+* The trim moves the shared SVM timing reference of both motors, so the
+* applied duty cycles are off by up to trim/TIM_1_8_PERIOD_CLOCKS (0.4%
+* at the clamp) until the phase has converged - harmless, the current
+* controller absorbs it. When no TIME frame arrives for a second the trim
+* is removed and the timers fall back to their nominal period.
+*
+* The 32-bit microsecond clock wraps every ~71 minutes and the wrap point
+* is not a multiple of the control period, so the phase reference jumps
+* by a fixed 46us once per wrap; the trim loop walks that off within a
+* few milliseconds.
+*/
+
+#include "odrive_main.h"
+#include "clock_sync.hpp"
+
+#include <tim.h>
+
+// [us] master broadcast timeout after which the PWM returns to nominal
+#define CLOCK_SYNC_TIMEOUT_US 1000000
+
+// Period trim clamp [counts]. One count stretches the cycle by
+// 2*(TIM_1_8_RCR+1) timer clocks (~36ns), so the clamp slews the phase by
+// ~0.5us per cycle: worst-case lock from half a period off takes ~125
+// cycles, and the frequency error stays under 0.5%.
+#define CLOCK_SYNC_MAX_TRIM 14
+
+ClockSyncState_t clock_sync_state;
+
+static constexpr uint32_t control_period_us =
+        (uint32_t)(CURRENT_MEAS_PERIOD * 1e6f + 0.5f);
+
+static bool locked_ = false;
+static int32_t offset_us_ = 0;       // master - local micros()
+static uint32_t last_frame_us_ = 0;  // local micros() of the last TIME frame
+
+void clock_sync_handle_time_frame(uint32_t master_time_us) {
+    uint32_t local = micros();
+    int32_t raw_offset = (int32_t)(master_time_us - local);
+    if (!locked_) {
+        offset_us_ = raw_offset;
+        locked_ = true;
+    } else {
+        // IIR over ~8 frames to average out the arbitration latency
+        offset_us_ += (raw_offset - offset_us_) / 8;
+    }
+    last_frame_us_ = local;
+    clock_sync_state.offset_us = offset_us_;
+    clock_sync_state.time_frame_cnt++;
+}
+
+uint32_t clock_sync_time_us(void) {
+    return micros() + (locked_ ? (uint32_t)offset_us_ : 0u);
+}
+
+RAMFUNC void clock_sync_update(void) {
+    if (!locked_)
+        return;
+
+    if (micros() - last_frame_us_ > CLOCK_SYNC_TIMEOUT_US) {
+        // master went away: restore the nominal period and unlock
+        locked_ = false;
+        htim1.Instance->ARR = TIM_1_8_PERIOD_CLOCKS;
+        htim8.Instance->ARR = TIM_1_8_PERIOD_CLOCKS;
+        clock_sync_state.locked = false;
+        clock_sync_state.period_trim = 0;
+        return;
+    }
+
+    // Phase of this cycle boundary on the master time grid, mapped to
+    // [-T/2, T/2). Positive = our boundary comes late.
+    int32_t phase = (int32_t)((micros() + (uint32_t)offset_us_) % control_period_us);
+    if (phase >= (int32_t)(control_period_us / 2))
+        phase -= control_period_us;
+
+    // Proportional trim, one count per microsecond of phase error: the
+    // phase then converges exponentially with a ~3.5ms time constant,
+    // slow enough that the per-frame offset jitter averages out.
+    int32_t trim = -phase;
+    if (trim > CLOCK_SYNC_MAX_TRIM) trim = CLOCK_SYNC_MAX_TRIM;
+    if (trim < -CLOCK_SYNC_MAX_TRIM) trim = -CLOCK_SYNC_MAX_TRIM;
+
+    // With ARR preload enabled the new period latches at the next update
+    // event, so the write is safe anywhere in the cycle. Both timers get
+    // the same trim to preserve their half-period stagger.
+    htim1.Instance->CR1 |= TIM_CR1_ARPE;
+    htim8.Instance->CR1 |= TIM_CR1_ARPE;
+    htim1.Instance->ARR = TIM_1_8_PERIOD_CLOCKS + trim;
+    htim8.Instance->ARR = TIM_1_8_PERIOD_CLOCKS + trim;
+
+    clock_sync_state.locked = true;
+    clock_sync_state.phase_error_us = phase;
+    clock_sync_state.period_trim = trim;
+}
@@ -0,0 +1,32 @@
+#ifndef __CLOCK_SYNC_HPP
+#define __CLOCK_SYNC_HPP
+
+#include <stdint.h>
+
+// Distributed clock over CAN (see clock_sync.cpp). The CAN RX interrupt
+// feeds master TIME frames to clock_sync_handle_time_frame; the control
+// ISR calls clock_sync_update once per PWM period to trim the timers.
+
+// Telemetry, exposed under can.time_sync in the protocol tree.
+struct ClockSyncState_t {
+    bool locked = false;        // disciplining the PWM phase to the master clock
+    int32_t offset_us = 0;      // master time minus local micros()
+    int32_t phase_error_us = 0; // control cycle boundary vs. master time grid
+    int32_t period_trim = 0;    // current TIM1/TIM8 period trim [counts]
+    uint32_t time_frame_cnt = 0;
+};
+extern ClockSyncState_t clock_sync_state;
+
+// @brief Handles a master TIME broadcast. Only does RAM work, safe in the
+// RX interrupt.
+void clock_sync_handle_time_frame(uint32_t master_time_us);
+
+// @brief Trims the PWM period towards the master time grid. Called once
+// per PWM period from the control interrupt.
+void clock_sync_update(void);
+
+// @brief Local microsecond clock disciplined to the master (falls back to
+// plain micros() while unlocked). Wraps like micros().
+uint32_t clock_sync_time_us(void);
+
+#endif // __CLOCK_SYNC_HPP
@@ -1,19 +1,38 @@
 
 #include "odrive_main.h"
+#include "mini_fmt.h"
 
 
 Controller::Controller(Config_t& config) :
     config_(config)
-{}
+{
+    // Arm the stored gain schedule (if any); a table that fails
+    // validation simply leaves the scalar gains in effect
+    validate_gain_schedule();
+}
 
 void Controller::reset() {
+    // Integrator preload (see config_.integrator_preload_enable): keep the
+    // holding current of the previous disarm instead of rewinding it from
+    // zero, clamped to the current limit in case the last run ended in a
+    // fault with a wound-up integrator.
+    float integrator_preload = 0.0f;
+    if (config_.integrator_preload_enable && axis_) {
+        float Ilim = axis_->motor_.effective_current_lim();
+        integrator_preload = std::max(-Ilim, std::min(Ilim, vel_integrator_current_));
+    }
     pos_setpoint_ = 0.0f;
     vel_setpoint_ = 0.0f;
-    vel_integrator_current_ = 0.0f;
+    vel_integrator_current_ = integrator_preload;
     current_setpoint_ = 0.0f;
+    current_setpoint_shaped_ = 0.0f;
+    pos_err_lpf1_ = 0.0f;
+    pos_err_lpf2_ = 0.0f;
+    drop_pending_setpoints();
 }
 
 void Controller::set_error(Error_t error) {
+    axis_->log_error(Axis::ERROR_SOURCE_CONTROLLER, (uint32_t)(error & ~error_));
     error_ |= error;
     axis_->error_ |= Axis::ERROR_CONTROLLER_FAILED;
 }
@@ -22,40 +41,83 @@ void Controller::set_error(Error_t error) {
 // Command Handling
 //--------------------------------
 
+// @brief Publishes a complete setpoint block to the control loop. The
+// inactive mailbox slot is filled first, then the sequence store (release)
+// makes it visible as one unit, so the 8kHz consumer can never observe a
+// torn mode/setpoint combination. Producers are not serialized against
+// each other; commands are expected to arrive through one channel at a
+// time (this was equally unserialized with the old direct stores).
+void Controller::publish_setpoint(ControlMode_t mode, float pos, float vel, float current) {
+    uint32_t seq = setpoint_seq_.load(std::memory_order_relaxed);
+    Setpoint_t& slot = setpoint_buf_[~seq & 1u];
+    slot.mode = mode;
+    slot.pos = pos;
+    slot.vel = vel;
+    slot.current = current;
+    setpoint_seq_.store(seq + 1, std::memory_order_release);
+    // Every published setpoint also feeds the axis watchdog, so hosts that
+    // stream commands don't need to spend a second call per period on
+    // watchdog_feed(). This covers all command channels (ASCII, CAN,
+    // native protocol) in one place.
+    axis_->watchdog_feed();
+}
+
+// @brief Discards any published but unconsumed setpoint block, e.g. when
+// (re)entering closed loop control where the setpoint is re-seeded from
+// the current position.
+void Controller::drop_pending_setpoints() {
+    setpoint_consumed_ = setpoint_seq_.load(std::memory_order_relaxed);
+}
+
 void Controller::set_pos_setpoint(float pos_setpoint, float vel_feed_forward, float current_feed_forward) {
-    pos_setpoint_ = pos_setpoint;
-    vel_setpoint_ = vel_feed_forward;
-    current_setpoint_ = current_feed_forward;
-    config_.control_mode = CTRL_MODE_POSITION_CONTROL;
+    publish_setpoint(CTRL_MODE_POSITION_CONTROL, pos_setpoint, vel_feed_forward, current_feed_forward);
 #ifdef DEBUG_PRINT
-    printf("POSITION_CONTROL %6.0f %3.3f %3.3f\n", pos_setpoint, vel_setpoint_, current_setpoint_);
+    mini_printf("POSITION_CONTROL %6.0f %3.3f %3.3f\n", pos_setpoint, vel_feed_forward, current_feed_forward);
 #endif
 }
 
 void Controller::set_vel_setpoint(float vel_setpoint, float current_feed_forward) {
-    vel_setpoint_ = vel_setpoint;
-    current_setpoint_ = current_feed_forward;
-    config_.control_mode = CTRL_MODE_VELOCITY_CONTROL;
+    // pos is unused in velocity mode; carry the present value through
+    publish_setpoint(CTRL_MODE_VELOCITY_CONTROL, pos_setpoint_, vel_setpoint, current_feed_forward);
 #ifdef DEBUG_PRINT
-    printf("VELOCITY_CONTROL %3.3f %3.3f\n", vel_setpoint_, motor->current_setpoint_);
+    mini_printf("VELOCITY_CONTROL %3.3f %3.3f\n", vel_setpoint, current_feed_forward);
 #endif
 }
 
 void Controller::set_current_setpoint(float current_setpoint) {
-    current_setpoint_ = current_setpoint;
-    config_.control_mode = CTRL_MODE_CURRENT_CONTROL;
+    publish_setpoint(CTRL_MODE_CURRENT_CONTROL, pos_setpoint_, vel_setpoint_, current_setpoint);
 #ifdef DEBUG_PRINT
-    printf("CURRENT_CONTROL %3.3f\n", current_setpoint_);
+    mini_printf("CURRENT_CONTROL %3.3f\n", current_setpoint);
 #endif
 }
 
 void Controller::move_to_pos(float goal_point) {
-    axis_->trap_.planTrapezoidal(goal_point, pos_setpoint_, vel_setpoint_,
-                                 axis_->trap_.config_.vel_limit,
-                                 axis_->trap_.config_.accel_limit,
-                                 axis_->trap_.config_.decel_limit);
-    traj_start_loop_count_ = axis_->loop_counter_;
+    // Hand the current acceleration state to the planner so a goal update
+    // mid-move retargets smoothly instead of replanning from zero
+    // acceleration (the S-curve plan inserts a jerk-limited lead-in).
+    float Ai = 0.0f;
+    uint32_t start_loop_count = axis_->loop_counter_;
+    if (config_.control_mode == CTRL_MODE_TRAJECTORY_CONTROL) {
+        float t = (start_loop_count - traj_start_loop_count_) * current_meas_period;
+        if (t <= axis_->trap_.Tf_)
+            Ai = axis_->trap_.eval(t).Ydd;
+    }
+    // Plan into a scratch object and swap the result in under a critical
+    // section: planning can take tens of microseconds (S-curve bisection)
+    // and the 8kHz loop must never evaluate a half-written plan. The start
+    // count is captured before planning, so by the time the plan goes
+    // live, eval() is already past the planning delay instead of
+    // rewinding the setpoints to where planning began.
+    TrapezoidalTrajectory plan(axis_->trap_.config_);
+    plan.planTrapezoidal(goal_point, pos_setpoint_, vel_setpoint_, Ai,
+                         axis_->trap_.config_.vel_limit,
+                         axis_->trap_.config_.accel_limit,
+                         axis_->trap_.config_.decel_limit);
+    uint32_t mask = cpu_enter_critical();
+    axis_->trap_.adopt_plan(plan);
+    traj_start_loop_count_ = start_loop_count;
     config_.control_mode = CTRL_MODE_TRAJECTORY_CONTROL;
+    cpu_exit_critical(mask);
     goal_point_ = goal_point;
 }
 
@@ -67,6 +129,77 @@ void Controller::move_incremental(float displacement, bool from_goal_point = tru
     }
 }
 
+void Controller::start_trajectory_stream() {
+    // Seed the first segment from the current setpoints so the stream
+    // starts without a step; the next update() pops the first real knot.
+    traj_seg_end_ = {pos_setpoint_, vel_setpoint_, 0.0f};
+    traj_seg_t_ = 0.0f;
+    config_.control_mode = CTRL_MODE_TRAJECTORY_STREAM;
+}
+
+void Controller::stop_trajectory_stream() {
+    if (config_.control_mode == CTRL_MODE_TRAJECTORY_STREAM) {
+        config_.control_mode = CTRL_MODE_POSITION_CONTROL;
+        vel_setpoint_ = 0.0f;
+        current_setpoint_ = 0.0f;
+    }
+    traj_knot_buffer_.clear();
+}
+
+// @brief Locks this axis' position setpoint to the master axis' encoder
+// (ratio plus optional cam table), closing the coupling loop on-device at
+// the full control rate instead of over the host link. The offset is
+// captured from the current setpoints so engaging doesn't step the
+// setpoint. Returns false on an invalid master configuration.
+bool Controller::start_gearing() {
+    if (config_.gear_master_axis < 0 || config_.gear_master_axis >= AXIS_COUNT
+        || axes[config_.gear_master_axis] == axis_)
+        return false;
+    Axis* master = axes[config_.gear_master_axis];
+    gear_pos_offset_ = pos_setpoint_ - config_.gear_ratio * master->encoder_.pos_estimate_;
+    config_.control_mode = CTRL_MODE_GEARING;
+    return true;
+}
+
+void Controller::stop_gearing() {
+    if (config_.control_mode == CTRL_MODE_GEARING) {
+        config_.control_mode = CTRL_MODE_POSITION_CONTROL;
+        vel_setpoint_ = 0.0f;
+        current_setpoint_ = 0.0f;
+    }
+}
+
+bool Controller::push_traj_knot(float pos, float vel, float dt) {
+    if (!(dt >= 0.0f)) // reject negative durations and NaN
+        return false;
+    return traj_knot_buffer_.push({pos, vel, dt});
+}
+
+uint32_t Controller::get_traj_knot_free_space() {
+    return traj_knot_buffer_.free_space();
+}
+
+// @brief Checks the gain schedule table and arms it for use by the
+// control loop. Breakpoints must be non-negative, strictly ascending and
+// not NaN; all gains must be non-negative and not NaN. Returns false and
+// disarms the schedule otherwise, so a half-edited table is never
+// interpolated. Must be called after the host edits the table.
+bool Controller::validate_gain_schedule() {
+    bool valid = true;
+    if (!(config_.gain_sched_vel[0] >= 0.0f))
+        valid = false;
+    for (size_t i = 0; i < GAIN_SCHED_SIZE; ++i) {
+        if (i > 0 && !(config_.gain_sched_vel[i] > config_.gain_sched_vel[i - 1]))
+            valid = false;
+        if (!(config_.gain_sched_pos_gain[i] >= 0.0f) ||
+            !(config_.gain_sched_vel_gain[i] >= 0.0f) ||
+            !(config_.gain_sched_vel_integrator_gain[i] >= 0.0f))
+            valid = false;
+    }
+    gain_sched_valid_ = valid;
+    return valid;
+}
+
 void Controller::start_anticogging_calibration() {
     // Ensure the cogging map was correctly allocated earlier and that the motor is capable of calibrating
     if (anticogging_.cogging_map != NULL && axis_->error_ == Axis::ERROR_NONE) {
@@ -74,22 +207,185 @@ void Controller::start_anticogging_calibration() {
     }
 }
 
+// @brief Starts the fast (frequency domain) anticogging calibration: spin
+// at `vel` counts/s, correlate the velocity integrator current against the
+// first `n_harmonics` rotation harmonics over `n_revs` mechanical
+// revolutions, then synthesize the cogging map from the fit. The scan
+// velocity should be slow enough that the velocity loop tracks the cogging
+// ripple (the integrator's phase lag grows with scan speed); one to a few
+// revolutions per second works well in practice.
+void Controller::start_anticogging_calibration_fast(float vel, uint32_t n_harmonics, uint32_t n_revs) {
+    if (anticogging_.cogging_map == NULL || axis_->error_ != Axis::ERROR_NONE)
+        return;
+    if (!(fabsf(vel) > 0.0f)) // reject 0 and NaN
+        return;
+    if (n_harmonics < 1)
+        n_harmonics = 1;
+    if (n_harmonics > ANTICOGGING_MAX_HARMONICS)
+        n_harmonics = ANTICOGGING_MAX_HARMONICS;
+    if (n_revs < 1)
+        n_revs = 1;
+    anticogging_fast_.n_harmonics = n_harmonics;
+    anticogging_fast_.vel = vel;
+    anticogging_fast_.travel_target = (float)n_revs * (float)axis_->encoder_.config_.cpr;
+    // One second at speed before accumulating, so the velocity loop
+    // transient from the start command doesn't pollute the fit
+    anticogging_fast_.settle_countdown = (uint32_t)(1.0f / current_meas_period);
+    anticogging_fast_.state = 1;
+    set_vel_setpoint(vel, 0.0f);
+}
+
+// @brief Non-blocking per-cycle worker of the fast calibration; runs from
+// update_kernel() while anticogging_fast_.state is nonzero. Accumulation
+// uses a Chebyshev recurrence over the harmonics, so each cycle costs one
+// sincos plus a handful of multiply-adds; synthesis writes one map bin per
+// cycle for the same reason.
+void Controller::anticogging_calibration_fast(float pos_estimate) {
+    AnticoggingFast_t& fast = anticogging_fast_;
+    float cpr = (float)axis_->encoder_.config_.cpr;
+
+    if (fast.state == 1) { // settle at scan velocity
+        if (--fast.settle_countdown == 0) {
+            for (size_t h = 0; h < fast.n_harmonics; ++h) {
+                fast.cos_acc[h] = 0.0f;
+                fast.sin_acc[h] = 0.0f;
+            }
+            fast.start_pos = pos_estimate;
+            fast.n_samples = 0;
+            fast.state = 2;
+        }
+    } else if (fast.state == 2) { // accumulate harmonic correlations
+        float theta = (2.0f * M_PI / cpr) * fmodf_pos(pos_estimate, cpr);
+        float s1, c1;
+        fast_sincos(theta, &s1, &c1);
+        float I = vel_integrator_current_;
+        float sh = s1, ch = c1;
+        for (size_t h = 0; h < fast.n_harmonics; ++h) {
+            fast.cos_acc[h] += I * ch;
+            fast.sin_acc[h] += I * sh;
+            float ch_next = ch * c1 - sh * s1; // angle sum: (h+1) * theta
+            sh = sh * c1 + ch * s1;
+            ch = ch_next;
+        }
+        ++fast.n_samples;
+        if (fabsf(pos_estimate - fast.start_pos) >= fast.travel_target) {
+            fast.synth_index = 0;
+            fast.state = 3;
+        }
+    } else if (fast.state == 3) { // synthesize one map bin per cycle
+        float scale = 2.0f / (float)fast.n_samples;
+        float theta = (2.0f * M_PI / (float)anticogging_.map_size) * (float)fast.synth_index;
+        float s1, c1;
+        fast_sincos(theta, &s1, &c1);
+        float sh = s1, ch = c1;
+        float value = 0.0f;
+        for (size_t h = 0; h < fast.n_harmonics; ++h) {
+            value += scale * (fast.cos_acc[h] * ch + fast.sin_acc[h] * sh);
+            float ch_next = ch * c1 - sh * s1;
+            sh = sh * c1 + ch * s1;
+            ch = ch_next;
+        }
+        anticogging_set_entry((int)fast.synth_index, value);
+        if (++fast.synth_index >= anticogging_.map_size) {
+            fast.state = 0;
+            anticogging_.use_anticogging = true;
+            set_vel_setpoint(0.0f, 0.0f);
+        }
+    }
+}
+
+// @brief Serializes the quantized cogging map into its delta encoded NVM
+// staging form. Stores an empty map (and returns false) if there is no
+// calibrated map or the encoding doesn't fit the staging buffer.
+bool Controller::anticogging_pack_map(AnticoggingStore_t* store) {
+    store->num_bins = 0;
+    store->stream_length = 0;
+    store->scale = anticogging_.scale;
+    if (!anticogging_.use_anticogging || anticogging_.cogging_map == NULL)
+        return false;
+    size_t pos = 0;
+    int16_t prev = 0;
+    for (size_t i = 0; i < anticogging_.map_size; ++i) {
+        int16_t value = anticogging_.cogging_map[i];
+        int32_t delta = (int32_t)value - (int32_t)prev;
+        if (delta >= -127 && delta <= 127) {
+            if (pos + 1 > sizeof(store->stream))
+                return false;
+            store->stream[pos++] = (int8_t)delta;
+        } else {
+            if (pos + 3 > sizeof(store->stream))
+                return false;
+            store->stream[pos++] = -128;
+            store->stream[pos++] = (int8_t)(value & 0xff);
+            store->stream[pos++] = (int8_t)((value >> 8) & 0xff);
+        }
+        prev = value;
+    }
+    store->num_bins = (uint16_t)anticogging_.map_size;
+    store->stream_length = (uint16_t)pos;
+    return true;
+}
+
+// @brief Restores the cogging map from its NVM staging form and enables
+// anticogging. Expects the map buffer to already be allocated with the
+// same bin count as the stored map.
+bool Controller::anticogging_unpack_map(const AnticoggingStore_t* store) {
+    if (store->num_bins == 0 || anticogging_.cogging_map == NULL)
+        return false;
+    if (store->num_bins != anticogging_.map_size)
+        return false; // anticogging_bins changed since the map was saved
+    size_t pos = 0;
+    int16_t value = 0;
+    for (size_t i = 0; i < store->num_bins; ++i) {
+        if (pos >= store->stream_length)
+            return false;
+        int8_t delta = store->stream[pos++];
+        if (delta == -128) {
+            if (pos + 2 > store->stream_length)
+                return false;
+            value = (int16_t)((uint8_t)store->stream[pos] | ((uint16_t)(uint8_t)store->stream[pos + 1] << 8));
+            pos += 2;
+        } else {
+            value = (int16_t)(value + delta);
+        }
+        anticogging_.cogging_map[i] = value;
+    }
+    anticogging_.scale = store->scale;
+    anticogging_.use_anticogging = true;
+    return true;
+}
+
+// @brief Writes one quantized entry into the cogging map. If the value
+// doesn't fit into an int16 at the current scale, the scale is doubled
+// (and all existing entries halved) until it does.
+void Controller::anticogging_set_entry(int index, float current) {
+    float quantized = current / anticogging_.scale;
+    while (quantized > 32767.0f || quantized < -32767.0f) {
+        for (size_t i = 0; i < anticogging_.map_size; ++i)
+            anticogging_.cogging_map[i] /= 2;
+        anticogging_.scale *= 2.0f;
+        quantized *= 0.5f;
+    }
+    anticogging_.cogging_map[index] = (int16_t)(quantized + (quantized >= 0.0f ? 0.5f : -0.5f));
+}
+
 /*
- * This anti-cogging implementation iterates through each encoder position,
- * waits for zero velocity & position error,
+ * This anti-cogging implementation iterates through the map bins (evenly
+ * spaced encoder positions), waits for zero velocity & position error,
  * then samples the current required to maintain that position.
- * 
+ *
  * This holding current is added as a feedforward term in the control loop.
  */
 bool Controller::anticogging_calibration(float pos_estimate, float vel_estimate) {
     if (anticogging_.calib_anticogging && anticogging_.cogging_map != NULL) {
-        float pos_err = anticogging_.index - pos_estimate;
+        float counts_per_bin = (float)axis_->encoder_.config_.cpr / (float)anticogging_.map_size;
+        float pos_err = (float)anticogging_.index * counts_per_bin - pos_estimate;
         if (fabsf(pos_err) <= anticogging_.calib_pos_threshold &&
             fabsf(vel_estimate) < anticogging_.calib_vel_threshold) {
-            anticogging_.cogging_map[anticogging_.index++] = vel_integrator_current_;
+            anticogging_set_entry(anticogging_.index++, vel_integrator_current_);
         }
-        if (anticogging_.index < axis_->encoder_.config_.cpr) { // TODO: remove the dependency on encoder CPR
-            set_pos_setpoint(anticogging_.index, 0.0f, 0.0f);
+        if (anticogging_.index < (int)anticogging_.map_size) {
+            set_pos_setpoint((float)anticogging_.index * counts_per_bin, 0.0f, 0.0f);
             return false;
         } else {
             anticogging_.index = 0;
@@ -102,13 +398,23 @@ bool Controller::anticogging_calibration(float pos_estimate, float vel_estimate)
     return false;
 }
 
-bool Controller::update(float pos_estimate, float vel_estimate, float* current_setpoint_output) {
+// @brief Mode-specialized body of Controller::update. MODE is a template
+// parameter, so the mode comparisons below are compile time constants and
+// each instantiation contains only the code of its own mode. Note that the
+// kernel may drop config_.control_mode to position control mid-cycle (end of
+// trajectory, stream underrun); that is fine because the remaining stages
+// behave identically for both modes, and update() re-dispatches next cycle.
+template<Controller::ControlMode_t MODE>
+bool Controller::update_kernel(float pos_estimate, float vel_estimate, float* current_setpoint_output) {
     // Only runs if anticogging_.calib_anticogging is true; non-blocking
     anticogging_calibration(pos_estimate, vel_estimate);
+    // Fast harmonic calibration, likewise idle unless started
+    if (anticogging_fast_.state != 0)
+        anticogging_calibration_fast(pos_estimate);
     float anticogging_pos = pos_estimate;
 
     // Trajectory control
-    if (config_.control_mode == CTRL_MODE_TRAJECTORY_CONTROL) {
+    if (MODE == CTRL_MODE_TRAJECTORY_CONTROL) {
         // Note: uint32_t loop count delta is OK across overflow
         // Beware of negative deltas, as they will not be well behaved due to uint!
         float t = (axis_->loop_counter_ - traj_start_loop_count_) * current_meas_period;
@@ -127,8 +433,80 @@ bool Controller::update(float pos_estimate, float vel_estimate, float* current_s
         anticogging_pos = pos_setpoint_; // FF the position setpoint instead of the pos_estimate
     }
 
+    // Streamed trajectory control
+    if (MODE == CTRL_MODE_TRAJECTORY_STREAM) {
+        traj_seg_t_ += current_meas_period;
+        // Advance over completed segments. This also consumes the 0-length
+        // seed segment installed by start_trajectory_stream().
+        while (traj_seg_t_ >= traj_seg_end_.dt) {
+            TrajKnot_t next;
+            if (traj_knot_buffer_.pop(&next)) {
+                traj_seg_t_ -= traj_seg_end_.dt;
+                traj_seg_start_ = traj_seg_end_;
+                traj_seg_end_ = next;
+            } else {
+                // Buffer underrun (or host finished the stream): hold the
+                // last knot position and drop into position control.
+                config_.control_mode = CTRL_MODE_POSITION_CONTROL;
+                pos_setpoint_ = traj_seg_end_.pos;
+                vel_setpoint_ = 0.0f;
+                current_setpoint_ = 0.0f;
+                break;
+            }
+        }
+        if (config_.control_mode == CTRL_MODE_TRAJECTORY_STREAM) {
+            // Cubic Hermite interpolation between the segment endpoints,
+            // matching both position and velocity at each knot.
+            float T = traj_seg_end_.dt;
+            float tau = traj_seg_t_ / T;
+            float tau2 = tau * tau;
+            float tau3 = tau2 * tau;
+            float p0 = traj_seg_start_.pos, p1 = traj_seg_end_.pos;
+            float v0 = traj_seg_start_.vel, v1 = traj_seg_end_.vel;
+            pos_setpoint_ = (2.0f * tau3 - 3.0f * tau2 + 1.0f) * p0
+                          + (tau3 - 2.0f * tau2 + tau) * T * v0
+                          + (-2.0f * tau3 + 3.0f * tau2) * p1
+                          + (tau3 - tau2) * T * v1;
+            vel_setpoint_ = (6.0f * tau2 - 6.0f * tau) * (p0 - p1) / T
+                          + (3.0f * tau2 - 4.0f * tau + 1.0f) * v0
+                          + (3.0f * tau2 - 2.0f * tau) * v1;
+            current_setpoint_ = 0.0f;
+            anticogging_pos = pos_setpoint_; // FF the position setpoint instead of the pos_estimate
+        }
+    }
+
+    // Electronic gearing: track the master axis' encoder through the
+    // ratio, plus the cam table as a position offset over one master
+    // revolution. The master's estimates were updated earlier in this
+    // same control cycle (axes update in order), so the coupling runs at
+    // the full control rate with no host in the loop.
+    if (MODE == CTRL_MODE_GEARING) {
+        size_t master_idx = (config_.gear_master_axis >= 0
+                && config_.gear_master_axis < AXIS_COUNT)
+                ? (size_t)config_.gear_master_axis : 0;
+        Axis* master = axes[master_idx];
+        float master_pos = master->encoder_.pos_estimate_;
+        float master_vel = master->encoder_.vel_estimate_;
+        pos_setpoint_ = gear_pos_offset_ + config_.gear_ratio * master_pos;
+        vel_setpoint_ = config_.gear_ratio * master_vel;
+        if (config_.gear_use_cam) {
+            float bins_per_count = (float)GEAR_CAM_SIZE / (float)master->encoder_.config_.cpr;
+            float bin_pos = master_pos * bins_per_count;
+            float bin_floor = floorf(bin_pos);
+            float frac = bin_pos - bin_floor;
+            // The mask wraps correctly for negative positions (two's complement)
+            int idx0 = (int)bin_floor & ((int)GEAR_CAM_SIZE - 1);
+            int idx1 = (idx0 + 1) & ((int)GEAR_CAM_SIZE - 1);
+            float c0 = gear_cam_table_[idx0];
+            float c1 = gear_cam_table_[idx1];
+            pos_setpoint_ += c0 + (c1 - c0) * frac;
+            vel_setpoint_ += (c1 - c0) * bins_per_count * master_vel;
+        }
+        anticogging_pos = pos_setpoint_; // FF the position setpoint instead of the pos_estimate
+    }
+
     // Ramp rate limited velocity setpoint
-    if (config_.control_mode == CTRL_MODE_VELOCITY_CONTROL && vel_ramp_enable_) {
+    if (MODE == CTRL_MODE_VELOCITY_CONTROL && vel_ramp_enable_) {
         float max_step_size = current_meas_period * config_.vel_ramp_rate;
         float full_step = vel_ramp_target_ - vel_setpoint_;
         float step;
@@ -140,24 +518,77 @@ bool Controller::update(float pos_estimate, float vel_estimate, float* current_s
         vel_setpoint_ += step;
     }
 
+    // Gain scheduling: interpolate the loop gains over |vel_estimate|
+    // between the table breakpoints, clamped at the ends. Only a table
+    // accepted by validate_gain_schedule() is used, so the search below
+    // can assume strictly ascending breakpoints.
+    float pos_gain = config_.pos_gain;
+    float vel_gain = config_.vel_gain;
+    float vel_integrator_gain = config_.vel_integrator_gain;
+    if (config_.gain_sched_enable && gain_sched_valid_) {
+        float v = fabsf(vel_estimate);
+        const float* vels = config_.gain_sched_vel;
+        size_t i = 0;
+        float frac = 0.0f;
+        if (v >= vels[GAIN_SCHED_SIZE - 1]) {
+            i = GAIN_SCHED_SIZE - 2;
+            frac = 1.0f;
+        } else if (v > vels[0]) {
+            while (v >= vels[i + 1])
+                ++i;
+            frac = (v - vels[i]) / (vels[i + 1] - vels[i]);
+        }
+        pos_gain = config_.gain_sched_pos_gain[i]
+                 + frac * (config_.gain_sched_pos_gain[i + 1] - config_.gain_sched_pos_gain[i]);
+        vel_gain = config_.gain_sched_vel_gain[i]
+                 + frac * (config_.gain_sched_vel_gain[i + 1] - config_.gain_sched_vel_gain[i]);
+        vel_integrator_gain = config_.gain_sched_vel_integrator_gain[i]
+                 + frac * (config_.gain_sched_vel_integrator_gain[i + 1] - config_.gain_sched_vel_integrator_gain[i]);
+    }
+
     // Position control
     // TODO Decide if we want to use encoder or pll position here
     float vel_des = vel_setpoint_;
-    if (config_.control_mode >= CTRL_MODE_POSITION_CONTROL) {
+    if (MODE >= CTRL_MODE_POSITION_CONTROL) {
         float pos_err;
         if (config_.setpoints_in_cpr) {
             // TODO this breaks the semantics that estimates come in on the arguments.
             // It's probably better to call a get_estimate that will arbitrate (enc vs sensorless) instead.
             float cpr = (float)(axis_->encoder_.config_.cpr);
-            // Keep pos setpoint from drifting
-            pos_setpoint_ = fmodf_pos(pos_setpoint_, cpr);
-            // Circular delta
-            pos_err = pos_setpoint_ - axis_->encoder_.pos_cpr_;
-            pos_err = wrap_pm(pos_err, 0.5f * cpr);
+            // Keep pos setpoint from drifting. In steady state the setpoint
+            // moves by much less than one revolution per cycle, so wrapping
+            // is a conditional add/subtract; newlib's fmodf is only needed
+            // to recover from an arbitrary host write.
+            if (pos_setpoint_ >= 2.0f * cpr || pos_setpoint_ < -cpr)
+                pos_setpoint_ = fmodf_pos(pos_setpoint_, cpr);
+            else if (pos_setpoint_ >= cpr)
+                pos_setpoint_ -= cpr;
+            else if (pos_setpoint_ < 0.0f)
+                pos_setpoint_ += cpr;
+            // Circular delta: both operands are in [0, cpr), so the error is
+            // in (-cpr, cpr) and one conditional add/subtract wraps it
+            pos_err = pos_setpoint_ - axis_->encoder_.pos_cpr_comp_;
+            if (pos_err >= 0.5f * cpr)
+                pos_err -= cpr;
+            else if (pos_err < -0.5f * cpr)
+                pos_err += cpr;
         } else {
             pos_err = pos_setpoint_ - pos_estimate;
         }
-        vel_des += config_.pos_gain * pos_err;
+        // Input shaping: 2-pole low-pass on the error injection, so step
+        // position commands don't kick the velocity loop. The filter state
+        // tracks the raw error while disabled (no step on enabling).
+        if (config_.input_shaping && config_.pos_err_filter_bandwidth > 0.0f) {
+            float alpha = config_.pos_err_filter_bandwidth * current_meas_period;
+            if (alpha > 1.0f) alpha = 1.0f;
+            pos_err_lpf1_ += alpha * (pos_err - pos_err_lpf1_);
+            pos_err_lpf2_ += alpha * (pos_err_lpf1_ - pos_err_lpf2_);
+            pos_err = pos_err_lpf2_;
+        } else {
+            pos_err_lpf1_ = pos_err;
+            pos_err_lpf2_ = pos_err;
+        }
+        vel_des += pos_gain * pos_err;
     }
 
     // Velocity limiting
@@ -174,18 +605,46 @@ bool Controller::update(float pos_estimate, float vel_estimate, float* current_s
     }
 
     // Velocity control
-    float Iq = current_setpoint_;
+    // Input shaping: slew-limit the current command so step current
+    // commands (PLC masters, streamed setpoints) don't spike the current
+    // loop. Same structure as the velocity ramp above.
+    float Iq;
+    if (config_.input_shaping && config_.current_slew_rate > 0.0f) {
+        float max_step_size = current_meas_period * config_.current_slew_rate;
+        float full_step = current_setpoint_ - current_setpoint_shaped_;
+        if (fabsf(full_step) > max_step_size) {
+            current_setpoint_shaped_ += std::copysignf(max_step_size, full_step);
+        } else {
+            current_setpoint_shaped_ = current_setpoint_;
+        }
+        Iq = current_setpoint_shaped_;
+    } else {
+        current_setpoint_shaped_ = current_setpoint_;
+        Iq = current_setpoint_;
+    }
 
     // Anti-cogging is enabled after calibration
-    // We get the current position and apply a current feed-forward
+    // We get the current position and apply a current feed-forward, linearly
+    // interpolated between the two adjacent map bins and scaled back to amps,
     // ensuring that we handle negative encoder positions properly (-1 == motor->encoder.encoder_cpr - 1)
     if (anticogging_.use_anticogging) {
-        Iq += anticogging_.cogging_map[mod(static_cast<int>(anticogging_pos), axis_->encoder_.config_.cpr)];
+        float bin_pos = anticogging_pos * ((float)anticogging_.map_size / (float)axis_->encoder_.config_.cpr);
+        float bin_floor = floorf(bin_pos);
+        float frac = bin_pos - bin_floor;
+        // Power-of-two maps wrap with a mask (correct for negative counts in
+        // two's complement); others fall back to the integer modulo
+        int idx0 = anticogging_.map_mask
+                 ? ((int)bin_floor & anticogging_.map_mask)
+                 : mod((int)bin_floor, (int)anticogging_.map_size);
+        int idx1 = (idx0 + 1 < (int)anticogging_.map_size) ? (idx0 + 1) : 0;
+        float c0 = (float)anticogging_.cogging_map[idx0];
+        float c1 = (float)anticogging_.cogging_map[idx1];
+        Iq += (c0 + (c1 - c0) * frac) * anticogging_.scale;
     }
 
     float v_err = vel_des - vel_estimate;
-    if (config_.control_mode >= CTRL_MODE_VELOCITY_CONTROL) {
-        Iq += config_.vel_gain * v_err;
+    if (MODE >= CTRL_MODE_VELOCITY_CONTROL) {
+        Iq += vel_gain * v_err;
     }
 
     // Velocity integral action before limiting
@@ -204,7 +663,7 @@ bool Controller::update(float pos_estimate, float vel_estimate, float* current_s
     }
 
     // Velocity integrator (behaviour dependent on limiting)
-    if (config_.control_mode < CTRL_MODE_VELOCITY_CONTROL) {
+    if (MODE < CTRL_MODE_VELOCITY_CONTROL) {
         // reset integral if not in use
         vel_integrator_current_ = 0.0f;
     } else {
@@ -212,10 +671,104 @@ bool Controller::update(float pos_estimate, float vel_estimate, float* current_s
             // TODO make decayfactor configurable
             vel_integrator_current_ *= 0.99f;
         } else {
-            vel_integrator_current_ += (config_.vel_integrator_gain * current_meas_period) * v_err;
+            vel_integrator_current_ += (vel_integrator_gain * current_meas_period) * v_err;
+        }
+    }
+
+    // Background anticogging adaptation: at near-constant velocity the
+    // velocity loop is a cogging observer - any position-correlated
+    // residual in the integrator current is exactly what the map failed to
+    // feed forward. Leak that residual into the map with a tiny learning
+    // rate so the compensation tracks temperature and wear drift during
+    // normal operation. The slow baseline filter removes the friction/load
+    // DC (which is position independent and must not enter the map), and
+    // sub-LSB updates are carried in a float accumulator per visited bin.
+    if (MODE >= CTRL_MODE_VELOCITY_CONTROL && config_.anticogging_adapt_enable
+        && anticogging_.use_anticogging && !anticogging_.calib_anticogging
+        && anticogging_fast_.state == 0) {
+        float cpr = (float)axis_->encoder_.config_.cpr;
+        float accel = (vel_estimate - anticogging_.adapt_prev_vel) / current_meas_period;
+        anticogging_.adapt_prev_vel = vel_estimate;
+        anticogging_.adapt_accel_lpf += (accel - anticogging_.adapt_accel_lpf)
+                                      * (current_meas_period / 0.01f); // 10ms accel filter
+        anticogging_.adapt_baseline += (vel_integrator_current_ - anticogging_.adapt_baseline)
+                                     * (current_meas_period / 0.5f);   // 500ms DC tracker
+        // Adapt only while moving (at standstill the holding current also
+        // carries the external load torque) and while not accelerating or
+        // current limited (transients are not cogging).
+        if (!limited
+            && fabsf(anticogging_.adapt_accel_lpf) < config_.anticogging_adapt_accel_threshold
+            && fabsf(vel_estimate) > cpr / 60.0f) {
+            float bin_pos = anticogging_pos * ((float)anticogging_.map_size / cpr);
+            int idx = anticogging_.map_mask
+                    ? ((int)floorf(bin_pos) & anticogging_.map_mask)
+                    : mod((int)floorf(bin_pos), (int)anticogging_.map_size);
+            if (idx != anticogging_.adapt_last_idx) {
+                // New bin: drop the sub-LSB remainder of the previous one
+                anticogging_.adapt_accum = 0.0f;
+                anticogging_.adapt_last_idx = idx;
+            }
+            float residual = vel_integrator_current_ - anticogging_.adapt_baseline;
+            anticogging_.adapt_accum += config_.anticogging_adapt_gain * residual;
+            int32_t lsbs = (int32_t)(anticogging_.adapt_accum / anticogging_.scale);
+            if (lsbs != 0) {
+                anticogging_.adapt_accum -= (float)lsbs * anticogging_.scale;
+                int32_t value = (int32_t)anticogging_.cogging_map[idx] + lsbs;
+                if (value > 32767) value = 32767;
+                if (value < -32767) value = -32767;
+                anticogging_.cogging_map[idx] = (int16_t)value;
+            }
         }
     }
 
     if (current_setpoint_output) *current_setpoint_output = Iq;
     return true;
 }
+
+// @brief Re-binds update_kernel_ to the specialization matching the
+// configured control mode. Called from update() whenever the cached mode
+// goes stale, i.e. once after boot and after each mode change.
+void Controller::select_update_kernel() {
+    kernel_mode_ = config_.control_mode;
+    switch (kernel_mode_) {
+        case CTRL_MODE_CURRENT_CONTROL:
+            update_kernel_ = &Controller::update_kernel<CTRL_MODE_CURRENT_CONTROL>;
+            break;
+        case CTRL_MODE_VELOCITY_CONTROL:
+            update_kernel_ = &Controller::update_kernel<CTRL_MODE_VELOCITY_CONTROL>;
+            break;
+        case CTRL_MODE_POSITION_CONTROL:
+            update_kernel_ = &Controller::update_kernel<CTRL_MODE_POSITION_CONTROL>;
+            break;
+        case CTRL_MODE_TRAJECTORY_CONTROL:
+            update_kernel_ = &Controller::update_kernel<CTRL_MODE_TRAJECTORY_CONTROL>;
+            break;
+        case CTRL_MODE_TRAJECTORY_STREAM:
+            update_kernel_ = &Controller::update_kernel<CTRL_MODE_TRAJECTORY_STREAM>;
+            break;
+        case CTRL_MODE_GEARING:
+            update_kernel_ = &Controller::update_kernel<CTRL_MODE_GEARING>;
+            break;
+        case CTRL_MODE_VOLTAGE_CONTROL:
+        default:
+            update_kernel_ = &Controller::update_kernel<CTRL_MODE_VOLTAGE_CONTROL>;
+            break;
+    }
+}
+
+bool Controller::update(float pos_estimate, float vel_estimate, float* current_setpoint_output) {
+    // Consume a pending command block first: mode and all three setpoints
+    // become effective within the same cycle (see publish_setpoint)
+    uint32_t seq = setpoint_seq_.load(std::memory_order_acquire);
+    if (seq != setpoint_consumed_) {
+        const Setpoint_t& sp = setpoint_buf_[seq & 1u];
+        pos_setpoint_ = sp.pos;
+        vel_setpoint_ = sp.vel;
+        current_setpoint_ = sp.current;
+        config_.control_mode = sp.mode;
+        setpoint_consumed_ = seq;
+    }
+    if (config_.control_mode != kernel_mode_ || !update_kernel_)
+        select_update_kernel();
+    return (this->*update_kernel_)(pos_estimate, vel_estimate, current_setpoint_output);
+}
@@ -19,7 +19,24 @@ public:
         CTRL_MODE_CURRENT_CONTROL = 1,
         CTRL_MODE_VELOCITY_CONTROL = 2,
         CTRL_MODE_POSITION_CONTROL = 3,
-        CTRL_MODE_TRAJECTORY_CONTROL = 4
+        CTRL_MODE_TRAJECTORY_CONTROL = 4,
+        CTRL_MODE_TRAJECTORY_STREAM = 5,
+        CTRL_MODE_GEARING = 6
+    };
+
+    // Electronic cam resolution: one cycle per master revolution, linearly
+    // interpolated. Power of two so the index wraps with a mask.
+    static constexpr size_t GEAR_CAM_SIZE = 32;
+
+    // Gain schedule breakpoints (on |vel_estimate|, ascending)
+    static constexpr size_t GAIN_SCHED_SIZE = 4;
+
+    // One segment endpoint of a streamed trajectory. dt is the time to get
+    // here from the previous knot, so the host controls the timebase.
+    struct TrajKnot_t {
+        float pos;  // [counts]
+        float vel;  // [counts/s]
+        float dt;   // [s]
     };
 
     struct Config_t {
@@ -31,7 +48,37 @@ public:
         float vel_limit = 20000.0f;        // [counts/s]
         float vel_limit_tolerance = 1.2f;  // ratio to vel_lim. 0.0f to disable
         float vel_ramp_rate = 10000.0f;  // [(counts/s) / s]
+        // Bumpless re-engagement: a statically loaded (vertical) axis sags
+        // on every arm while the velocity integrator winds the holding
+        // current back up from zero. When enabled, reset() preloads the
+        // integrator with the value it carried at the previous disarm
+        // (or with whatever the host wrote to vel_integrator_current
+        // beforehand as a feedforward estimate) instead of zeroing it.
+        bool integrator_preload_enable = false;
         bool setpoints_in_cpr = false;
+        int32_t anticogging_bins = 256;  // cogging map resolution (clamped to cpr)
+        // Background map adaptation (see the adaptation block in
+        // update_kernel): while anticogging is active and the axis moves at
+        // near-constant velocity, the position-correlated residual of the
+        // velocity integrator current leaks into the map with a tiny
+        // learning rate, tracking temperature and wear drift.
+        bool anticogging_adapt_enable = false;
+        float anticogging_adapt_gain = 0.001f; // residual fraction accumulated per cycle
+        float anticogging_adapt_accel_threshold = 2000.0f; // [counts/s^2] adapt only below this
+        int32_t gear_master_axis = 0;    // axis whose encoder drives CTRL_MODE_GEARING
+        float gear_ratio = 1.0f;         // slave counts per master count
+        bool gear_use_cam = false;       // add the cam table on top of the ratio
+        bool input_shaping = false;      // enable the slew/shaping stage in update()
+        float current_slew_rate = 500.0f;       // [A/s] max rate of the current command, 0 = unlimited
+        float pos_err_filter_bandwidth = 0.0f;  // [rad/s] 2-pole low-pass on the position error, 0 = off
+        // Gain schedule: loop gains interpolated over |vel_estimate| between
+        // ascending breakpoints (clamped at the ends). Only used after
+        // validate_gain_schedule() accepts the table.
+        bool gain_sched_enable = false;
+        float gain_sched_vel[GAIN_SCHED_SIZE] = {0.0f, 5000.0f, 10000.0f, 20000.0f};  // [counts/s]
+        float gain_sched_pos_gain[GAIN_SCHED_SIZE] = {20.0f, 20.0f, 20.0f, 20.0f};
+        float gain_sched_vel_gain[GAIN_SCHED_SIZE] = {5.0f / 10000.0f, 5.0f / 10000.0f, 5.0f / 10000.0f, 5.0f / 10000.0f};
+        float gain_sched_vel_integrator_gain[GAIN_SCHED_SIZE] = {10.0f / 10000.0f, 10.0f / 10000.0f, 10.0f / 10000.0f, 10.0f / 10000.0f};
     };
 
     explicit Controller(Config_t& config);
@@ -42,16 +89,56 @@ public:
     void set_vel_setpoint(float vel_setpoint, float current_feed_forward);
     void set_current_setpoint(float current_setpoint);
 
+    // Atomic setpoint handoff: the set_*_setpoint commands write a complete
+    // block (mode + all three setpoints) into the inactive mailbox slot and
+    // publish it with a single atomic sequence store; update() consumes the
+    // latest block at the top of the control cycle. One producer at a time
+    // (command handlers), one consumer (the control loop); no critical
+    // section on either side.
+    struct Setpoint_t {
+        ControlMode_t mode;
+        float pos;
+        float vel;
+        float current;
+    };
+    void publish_setpoint(ControlMode_t mode, float pos, float vel, float current);
+    void drop_pending_setpoints();
+
     // Trajectory-Planned control
     void move_to_pos(float goal_point);
     void move_incremental(float displacement, bool from_goal_point);
-    
+
+    // Streamed trajectory control
+    void start_trajectory_stream();
+    void stop_trajectory_stream();
+    bool push_traj_knot(float pos, float vel, float dt);
+    uint32_t get_traj_knot_free_space();
+
+    // Electronic gearing/camming off another axis' encoder
+    bool start_gearing();
+    void stop_gearing();
+
+    // Gain scheduling: must be called (and return true) after the host
+    // edits the table before the schedule is applied
+    bool validate_gain_schedule();
+
     // TODO: make this more similar to other calibration loops
     void start_anticogging_calibration();
     bool anticogging_calibration(float pos_estimate, float vel_estimate);
+    void start_anticogging_calibration_fast(float vel, uint32_t n_harmonics, uint32_t n_revs);
+    void anticogging_calibration_fast(float pos_estimate);
+    void anticogging_set_entry(int index, float current);
 
     bool update(float pos_estimate, float vel_estimate, float* current_setpoint);
 
+    // Mode specialized update kernel. The control mode rarely changes, so
+    // update() re-dispatches only when it does: each kernel is instantiated
+    // for one mode, all mode comparisons inside it fold to compile time
+    // constants, and the steady state cycle runs straight-line code.
+    template<ControlMode_t MODE>
+    bool update_kernel(float pos_estimate, float vel_estimate, float* current_setpoint);
+    void select_update_kernel();
+
     Config_t& config_;
     Axis* axis_ = nullptr; // set by Axis constructor
 
@@ -63,21 +150,74 @@ public:
 
     typedef struct {
         int index;
-        float *cogging_map;
+        int16_t *cogging_map; // quantized [scale A per LSB], config_.anticogging_bins entries per revolution
+        size_t map_size; // number of entries, set when the map is allocated
+        int map_mask; // map_size - 1 if map_size is a power of two, else 0 (use mod)
+        float scale;     // [A] current represented by one map LSB
         bool use_anticogging;
         bool calib_anticogging;
         float calib_pos_threshold;
         float calib_vel_threshold;
+        // Background adaptation state (see config_.anticogging_adapt_enable)
+        float adapt_baseline;  // [A] slow LPF of the integrator current (friction/load DC)
+        float adapt_accel_lpf; // [counts/s^2] filtered acceleration estimate
+        float adapt_prev_vel;  // [counts/s] vel_estimate of the previous cycle
+        float adapt_accum;     // [A] sub-LSB learning carry for the current bin
+        int adapt_last_idx;    // bin the carry belongs to
     } Anticogging_t;
     Anticogging_t anticogging_ = {
         .index = 0,
         .cogging_map = nullptr,
+        .map_size = 0,
+        .map_mask = 0,
+        .scale = 8.0f / 32768.0f, // +-8A initial full range; doubled on demand
         .use_anticogging = false,
         .calib_anticogging = false,
         .calib_pos_threshold = 1.0f,
         .calib_vel_threshold = 1.0f,
+        .adapt_baseline = 0.0f,
+        .adapt_accel_lpf = 0.0f,
+        .adapt_prev_vel = 0.0f,
+        .adapt_accum = 0.0f,
+        .adapt_last_idx = 0,
     };
 
+    // Fast (frequency domain) anticogging calibration. Instead of visiting
+    // every map bin and waiting for settle, the motor spins at a constant
+    // slow velocity while the velocity integrator current is correlated
+    // against the first n_harmonics rotation harmonics; the map is then
+    // synthesized from the fitted coefficients. Cogging torque is dominated
+    // by a few harmonics of the slot/pole counts, so this captures the same
+    // map 20-50x faster. See anticogging_calibration_fast().
+    static constexpr size_t ANTICOGGING_MAX_HARMONICS = 32;
+    struct AnticoggingFast_t {
+        uint8_t state = 0;             // 0 idle, 1 settle, 2 accumulate, 3 synthesize
+        uint32_t n_harmonics = 16;     // fitted rotation harmonics
+        float vel = 0.0f;              // [counts/s] commanded scan velocity
+        uint32_t settle_countdown = 0; // [cycles] until accumulation starts
+        float travel_target = 0.0f;    // [counts] accumulation span (n_revs * cpr)
+        float start_pos = 0.0f;        // [counts] pos_estimate at accumulation start
+        uint32_t n_samples = 0;
+        uint32_t synth_index = 0;      // next map bin to synthesize
+        float cos_acc[ANTICOGGING_MAX_HARMONICS]; // [0] = fundamental (DC excluded:
+        float sin_acc[ANTICOGGING_MAX_HARMONICS]; // that's friction, not cogging)
+    };
+    AnticoggingFast_t anticogging_fast_;
+
+    // Serialized form of the cogging map for NVM storage. The int16 map
+    // entries are delta encoded: each delta fits into one int8, or is
+    // escaped with -128 followed by the full value (little endian int16).
+    // 3 bytes per bin worst case, so a 256 bin map is guaranteed to fit.
+    static constexpr size_t ANTICOGGING_STORE_CAPACITY = 3 * 256;
+    struct AnticoggingStore_t {
+        uint16_t num_bins = 0;      // 0 = no map stored
+        uint16_t stream_length = 0; // used bytes of stream
+        float scale = 0.0f;         // [A] per LSB at the time of saving
+        int8_t stream[ANTICOGGING_STORE_CAPACITY];
+    };
+    bool anticogging_pack_map(AnticoggingStore_t* store);
+    bool anticogging_unpack_map(const AnticoggingStore_t* store);
+
     Error_t error_ = ERROR_NONE;
     // variables exposed on protocol
     float pos_setpoint_ = 0.0f;
@@ -88,10 +228,44 @@ public:
     float vel_ramp_target_ = 0.0f;
     bool vel_ramp_enable_ = false;
 
+    // Input shaping state (see config_.input_shaping). The states track the
+    // raw inputs while shaping is disabled so enabling it mid-run doesn't
+    // step the command.
+    float current_setpoint_shaped_ = 0.0f; // slew-limited current command
+    float pos_err_lpf1_ = 0.0f;            // first pole of the pos error filter
+    float pos_err_lpf2_ = 0.0f;            // second pole (the injected error)
+
+    // Set by validate_gain_schedule(); cleared there on a bad table so a
+    // half-edited schedule is never interpolated
+    bool gain_sched_valid_ = false;
+
     uint32_t traj_start_loop_count_ = 0;
 
+    // Setpoint mailbox (see publish_setpoint)
+    Setpoint_t setpoint_buf_[2];
+    std::atomic<uint32_t> setpoint_seq_{0}; // LSB selects the published slot
+    uint32_t setpoint_consumed_ = 0;        // last sequence consumed by update()
+
+    // Streamed trajectory state. The ring buffer is filled by the
+    // communication thread (or CAN) and drained by the control loop; the
+    // SPSC contract means no critical section is needed on either side.
+    SpscRingBuffer<TrajKnot_t, 16> traj_knot_buffer_;
+    TrajKnot_t traj_seg_start_ = {0.0f, 0.0f, 0.0f};
+    TrajKnot_t traj_seg_end_ = {0.0f, 0.0f, 0.0f};
+    float traj_seg_t_ = 0.0f; // time elapsed within the current segment [s]
+
     float goal_point_ = 0.0f;
 
+    // Gearing state. The offset is captured by start_gearing() so engaging
+    // doesn't step the setpoint; the cam table adds a position offset as a
+    // function of the master position within one master revolution.
+    float gear_pos_offset_ = 0.0f;
+    float gear_cam_table_[GEAR_CAM_SIZE] = {0.0f};
+
+    // Active mode-specialized update kernel, swapped by select_update_kernel()
+    bool (Controller::*update_kernel_)(float, float, float*) = nullptr;
+    ControlMode_t kernel_mode_ = CTRL_MODE_VOLTAGE_CONTROL; // mode update_kernel_ was selected for
+
     // Communication protocol definitions
     auto make_protocol_definitions() {
         return make_protocol_member_list(
@@ -102,6 +276,11 @@ public:
             make_protocol_property("current_setpoint", &current_setpoint_),
             make_protocol_property("vel_ramp_target", &vel_ramp_target_),
             make_protocol_property("vel_ramp_enable", &vel_ramp_enable_),
+            // Indirect because the map is only malloc'd once the axis thread
+            // starts; requests are rejected until then.
+            make_protocol_indirect_array_property("cogging_map",
+                &anticogging_.cogging_map, &anticogging_.map_size),
+            make_protocol_ro_property("cogging_map_scale", &anticogging_.scale),
             make_protocol_object("config",
                 make_protocol_property("control_mode", &config_.control_mode),
                 make_protocol_property("pos_gain", &config_.pos_gain),
@@ -110,8 +289,25 @@ public:
                 make_protocol_property("vel_limit", &config_.vel_limit),
                 make_protocol_property("vel_limit_tolerance", &config_.vel_limit_tolerance),
                 make_protocol_property("vel_ramp_rate", &config_.vel_ramp_rate),
-                make_protocol_property("setpoints_in_cpr", &config_.setpoints_in_cpr)
+                make_protocol_property("integrator_preload_enable", &config_.integrator_preload_enable),
+                make_protocol_property("setpoints_in_cpr", &config_.setpoints_in_cpr),
+                make_protocol_property("anticogging_bins", &config_.anticogging_bins),
+                make_protocol_property("anticogging_adapt_enable", &config_.anticogging_adapt_enable),
+                make_protocol_property("anticogging_adapt_gain", &config_.anticogging_adapt_gain),
+                make_protocol_property("anticogging_adapt_accel_threshold", &config_.anticogging_adapt_accel_threshold),
+                make_protocol_property("gear_master_axis", &config_.gear_master_axis),
+                make_protocol_property("gear_ratio", &config_.gear_ratio),
+                make_protocol_property("gear_use_cam", &config_.gear_use_cam),
+                make_protocol_property("input_shaping", &config_.input_shaping),
+                make_protocol_property("current_slew_rate", &config_.current_slew_rate),
+                make_protocol_property("pos_err_filter_bandwidth", &config_.pos_err_filter_bandwidth),
+                make_protocol_property("gain_sched_enable", &config_.gain_sched_enable),
+                make_protocol_array_property("gain_sched_vel", config_.gain_sched_vel, GAIN_SCHED_SIZE),
+                make_protocol_array_property("gain_sched_pos_gain", config_.gain_sched_pos_gain, GAIN_SCHED_SIZE),
+                make_protocol_array_property("gain_sched_vel_gain", config_.gain_sched_vel_gain, GAIN_SCHED_SIZE),
+                make_protocol_array_property("gain_sched_vel_integrator_gain", config_.gain_sched_vel_integrator_gain, GAIN_SCHED_SIZE)
             ),
+            make_protocol_array_property("gear_cam_table", gear_cam_table_, GEAR_CAM_SIZE),
             make_protocol_function("set_pos_setpoint", *this, &Controller::set_pos_setpoint,
                 "pos_setpoint", "vel_feed_forward", "current_feed_forward"),
             make_protocol_function("set_vel_setpoint", *this, &Controller::set_vel_setpoint,
@@ -120,11 +316,24 @@ public:
                                    "current_setpoint"),
             make_protocol_function("move_to_pos", *this, &Controller::move_to_pos, "pos_setpoint"),
             make_protocol_function("move_incremental", *this, &Controller::move_incremental, "displacement", "from_goal_point"),
-            make_protocol_function("start_anticogging_calibration", *this, &Controller::start_anticogging_calibration)
+            make_protocol_function("start_trajectory_stream", *this, &Controller::start_trajectory_stream),
+            make_protocol_function("stop_trajectory_stream", *this, &Controller::stop_trajectory_stream),
+            make_protocol_function("push_traj_knot", *this, &Controller::push_traj_knot, "pos", "vel", "dt"),
+            make_protocol_function("get_traj_knot_free_space", *this, &Controller::get_traj_knot_free_space),
+            make_protocol_function("start_gearing", *this, &Controller::start_gearing),
+            make_protocol_function("stop_gearing", *this, &Controller::stop_gearing),
+            make_protocol_function("validate_gain_schedule", *this, &Controller::validate_gain_schedule),
+            make_protocol_function("start_anticogging_calibration", *this, &Controller::start_anticogging_calibration),
+            make_protocol_ro_property("anticogging_fast_state", &anticogging_fast_.state),
+            make_protocol_function("start_anticogging_calibration_fast", *this,
+                &Controller::start_anticogging_calibration_fast, "vel", "n_harmonics", "n_revs")
         );
     }
 };
 
 DEFINE_ENUM_FLAG_OPERATORS(Controller::Error_t)
 
+// NVM staging buffers for the cogging maps, part of the stored configuration
+extern Controller::AnticoggingStore_t anticogging_stores[AXIS_COUNT];
+
 #endif // __CONTROLLER_HPP
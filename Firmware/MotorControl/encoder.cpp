@@ -1,5 +1,6 @@
 
 #include "odrive_main.h"
+#include "atan2_lut.hpp"
 
 
 Encoder::Encoder(const EncoderHardwareConfig_t& hw_config,
@@ -9,7 +10,7 @@ Encoder::Encoder(const EncoderHardwareConfig_t& hw_config,
 {
     update_pll_gains();
 
-    if (config.pre_calibrated && (config.mode == Encoder::MODE_HALL || config.mode == Encoder::MODE_SINCOS)) {
+    if (config.pre_calibrated && (config.mode == Encoder::MODE_HALL || config.mode == Encoder::MODE_SINCOS || is_abs_spi_mode())) {
         is_ready_ = true;
     }
 }
@@ -21,9 +22,48 @@ static void enc_index_cb_wrapper(void* ctx) {
 void Encoder::setup() {
     HAL_TIM_Encoder_Start(hw_config_.timer, TIM_CHANNEL_ALL);
     set_idx_subscribe();
+
+    // Resolve the hall decode mapping once so the ADC callback doesn't
+    // have to search for the ports every control cycle
+    const GPIO_TypeDef* hall_ports[] = {
+        hw_config_.hallC_port,
+        hw_config_.hallB_port,
+        hw_config_.hallA_port,
+    };
+    const uint16_t hall_pins[] = {
+        hw_config_.hallC_pin,
+        hw_config_.hallB_pin,
+        hw_config_.hallA_pin,
+    };
+    for (int i = 0; i < 3; ++i) {
+        int port_idx = get_gpio_samp_port_index(hall_ports[i]);
+        hall_port_idx_[i] = (port_idx >= 0) ? (uint8_t)port_idx : 0;
+        hall_pin_mask_[i] = hall_pins[i];
+    }
+
+    // Only encoders configured for hall feedback register their ports for
+    // coherent sampling; with no hall encoders the sampled-port set stays
+    // empty and the per-cycle GPIO reads in tim_update_cb are skipped.
+    if (config_.mode == MODE_HALL) {
+        for (int i = 0; i < 3; ++i)
+            gpio_samp_add_port(hall_ports[i]);
+    }
+
+    if (is_abs_spi_mode())
+        abs_spi_init();
+
+    // Sin/cos encoders ride ranks 2 and 3 of the ADC1 injected (vbus)
+    // sequence, so the analog pair is converted at the PWM midpoint like
+    // the current measurement. This runs before start_adc_pwm() enables
+    // the trigger.
+    if (config_.mode == MODE_SINCOS) {
+        if (!arm_sincos_injected_sampling(&sincos_sample_s_, &sincos_sample_c_))
+            set_error(ERROR_UNSUPPORTED_ENCODER_MODE);
+    }
 }
 
 void Encoder::set_error(Error_t error) {
+    axis_->log_error(Axis::ERROR_SOURCE_ENCODER, (uint32_t)(error & ~error_));
     error_ |= error;
     axis_->error_ |= Axis::ERROR_ENCODER_FAILED;
 }
@@ -39,11 +79,48 @@ bool Encoder::do_checks(){
 // Triggered when an encoder passes over the "Index" pin
 // TODO: only arm index edge interrupt when we know encoder has powered up
 // (maybe by attaching the interrupt on start search, synergistic with following)
+// Runs in EXTI interrupt context at full rotation speed during the index
+// search, so it only latches the hardware count at the pulse and sets a
+// flag. The actual count reset (and the unsubscribe) happens in update()
+// on the control thread, relative to this snapshot, so the deferral costs
+// no accuracy.
 void Encoder::enc_index_cb() {
+    index_cnt_sample_ = (uint16_t)hw_config_.timer->Instance->CNT;
+    index_pending_ = true;
+}
+
+// @brief Applies the deferred index-pulse handling from enc_index_cb.
+void Encoder::process_index_pulse() {
+    if (index_found_ && config_.enable_integrity_monitor
+            && config_.mode == MODE_INCREMENTAL) {
+        // Integrity check: between two index edges the encoder must deliver
+        // a whole multiple of cpr counts. A residual means edges were lost
+        // to (or counterfeited by) EMI on the cable. The low 16 bits of
+        // shadow_count_ track the hardware count exactly, so the count at
+        // the edge can be reconstructed without racing the running timer.
+        int32_t count_at_edge = shadow_count_
+                + (int16_t)((uint16_t)index_cnt_sample_ - (uint16_t)shadow_count_);
+        int32_t residual = mod(count_at_edge - index_check_count_, config_.cpr);
+        if (residual > config_.cpr / 2)
+            residual -= config_.cpr;
+        if (residual != 0) {
+            ++index_count_error_cnt_;
+            if (config_.integrity_error_limit &&
+                    index_count_error_cnt_ + illegal_hall_state_cnt_ > config_.integrity_error_limit)
+                set_error(ERROR_INDEX_COUNT_MISMATCH);
+        }
+        index_check_count_ = count_at_edge;
+        // Leave the pulse source armed for the next revolution
+        return;
+    }
+
     if (config_.use_index) {
-        set_circular_count(0, false);
+        // The index pulse is 'elapsed' counts behind the current hardware
+        // count, so setting the count to 'elapsed' zeroes it at the pulse.
+        int16_t elapsed = (int16_t)((uint16_t)hw_config_.timer->Instance->CNT - index_cnt_sample_);
+        set_circular_count(elapsed, false);
         if (config_.zero_count_on_find_idx)
-            set_linear_count(0); // Avoid position control transient after search
+            set_linear_count(elapsed); // Avoid position control transient after search
         if (config_.pre_calibrated) {
             is_ready_ = true;
         } else {
@@ -53,18 +130,76 @@ void Encoder::enc_index_cb() {
             is_ready_ = false;
         }
         index_found_ = true;
+        // Seed the integrity reference with the count at this edge (zero
+        // when the count was just reset to the pulse above)
+        index_check_count_ = config_.zero_count_on_find_idx ? 0
+                : shadow_count_ + (int16_t)((uint16_t)index_cnt_sample_ - (uint16_t)shadow_count_);
     }
 
-    // Disable interrupt
-    GPIO_unsubscribe(hw_config_.index_port, hw_config_.index_pin);
+    // Disarm the pulse source, unless the integrity monitor wants to see
+    // every revolution
+    if (config_.enable_integrity_monitor && config_.mode == MODE_INCREMENTAL)
+        return;
+    if (has_index_capture())
+        disarm_index_capture();
+    else
+        GPIO_unsubscribe(hw_config_.index_port, hw_config_.index_pin);
+}
+
+// @brief Routes the index pin to its input capture channel on the encoder
+// timer. The capture register then latches the exact encoder count at the
+// pulse edge in hardware, so interrupt latency (or the PRIMASK critical
+// sections) can no longer smear the zero reference at speed. No capture
+// interrupt is enabled: the CC flag is polled in update(), which already
+// deferred the EXTI-path processing there, and the deferral costs no
+// accuracy since the captured count doesn't age.
+void Encoder::arm_index_capture() {
+    GPIO_InitTypeDef GPIO_InitStruct;
+    GPIO_InitStruct.Pin = hw_config_.index_pin;
+    GPIO_InitStruct.Mode = GPIO_MODE_AF_PP;
+    GPIO_InitStruct.Pull = GPIO_PULLDOWN;
+    GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_LOW;
+    GPIO_InitStruct.Alternate = hw_config_.index_capture_af;
+    HAL_GPIO_Init(hw_config_.index_port, &GPIO_InitStruct);
+
+    TIM_IC_InitTypeDef sConfigIC;
+    sConfigIC.ICPolarity = TIM_INPUTCHANNELPOLARITY_RISING;
+    sConfigIC.ICSelection = TIM_ICSELECTION_DIRECTTI;
+    sConfigIC.ICPrescaler = TIM_ICPSC_DIV1;
+    sConfigIC.ICFilter = 4; // reject sub-microsecond glitches
+    HAL_TIM_IC_ConfigChannel(hw_config_.timer, &sConfigIC, hw_config_.index_capture_channel);
+    // Discard any capture latched while disarmed
+    __HAL_TIM_CLEAR_FLAG(hw_config_.timer, TIM_FLAG_CC1 << (hw_config_.index_capture_channel >> 2u));
+    HAL_TIM_IC_Start(hw_config_.timer, hw_config_.index_capture_channel);
+}
+
+void Encoder::disarm_index_capture() {
+    HAL_TIM_IC_Stop(hw_config_.timer, hw_config_.index_capture_channel);
+}
+
+// @brief Polled from update(): feeds a hardware-captured index pulse
+// through the same deferred handling as the EXTI path.
+void Encoder::check_index_capture() {
+    uint32_t cc_flag = TIM_FLAG_CC1 << (hw_config_.index_capture_channel >> 2u);
+    if (__HAL_TIM_GET_FLAG(hw_config_.timer, cc_flag)) {
+        __HAL_TIM_CLEAR_FLAG(hw_config_.timer, cc_flag);
+        index_cnt_sample_ = (uint16_t)HAL_TIM_ReadCapturedValue(hw_config_.timer, hw_config_.index_capture_channel);
+        index_pending_ = true;
+    }
 }
 
 void Encoder::set_idx_subscribe(bool override_enable) {
     if (config_.use_index && (override_enable || !config_.find_idx_on_lockin_only)) {
-        GPIO_subscribe(hw_config_.index_port, hw_config_.index_pin, GPIO_PULLDOWN,
-                enc_index_cb_wrapper, this);
+        if (has_index_capture())
+            arm_index_capture();
+        else
+            GPIO_subscribe(hw_config_.index_port, hw_config_.index_pin, GPIO_PULLDOWN,
+                    enc_index_cb_wrapper, this);
     } else if (!config_.use_index || config_.find_idx_on_lockin_only) {
-        GPIO_unsubscribe(hw_config_.index_port, hw_config_.index_pin);
+        if (has_index_capture())
+            disarm_index_capture();
+        else
+            GPIO_unsubscribe(hw_config_.index_port, hw_config_.index_pin);
     }
 }
 
@@ -127,8 +262,35 @@ bool Encoder::run_index_search() {
     }
     set_idx_subscribe();
 
-    bool status = axis_->run_lockin_spin(axis_->config_.calibration_lockin);
-    return status;
+    // Single-phase search at the calibration speed. The two-phase variant
+    // needs a reverse pass, so a unidirectional search also ends up here.
+    if (!(config_.idx_search_fast_vel > 0.0f) || config_.idx_search_unidirectional)
+        return axis_->run_lockin_spin(axis_->config_.calibration_lockin);
+
+    // Two-phase search. Phase 1: fast traverse until the first edge. The
+    // edge is latched in interrupt context, so the count error after this
+    // phase is bounded by interrupt latency times the traverse speed -
+    // good enough to know where the index is, not good enough to zero on.
+    Axis::LockinConfig_t fast = axis_->config_.calibration_lockin;
+    float speedup = config_.idx_search_fast_vel / fast.vel;
+    fast.vel = config_.idx_search_fast_vel;
+    fast.accel *= speedup; // keep the same time-to-speed
+    if (!axis_->run_lockin_spin(fast) || !index_found_)
+        return false;
+
+    // Phase 2: verification pass. Back up over the edge at the original
+    // (slow) speed; the reverse crossing re-latches the count with a
+    // proportionally smaller latency error and confirms the fast edge was
+    // genuine. The distance bail-out of the lockin config limits how far
+    // we search if the rotor coasted past the bail-out window.
+    index_found_ = false;
+    set_idx_subscribe(true);
+    Axis::LockinConfig_t slow = axis_->config_.calibration_lockin;
+    slow.ramp_distance = -slow.ramp_distance;
+    slow.accel = -slow.accel;
+    slow.vel = -slow.vel;
+    bool status = axis_->run_lockin_spin(slow);
+    return status && index_found_;
 }
 
 bool Encoder::run_direction_find() {
@@ -158,10 +320,20 @@ bool Encoder::run_direction_find() {
 // @brief Turns the motor in one direction for a bit and then in the other
 // direction in order to find the offset between the electrical phase 0
 // and the encoder state 0.
+//
+// At commanded (unwrapped) scan phase p the rotor rests at
+// shadow = offset + direction * p / elec_rad_per_enc plus a friction
+// dependent lag, so every control cycle yields an offset estimate with a
+// lag bias of one sign per scan direction; averaging the two directions
+// cancels the bias. The estimates are tracked with running mean/variance
+// (Welford), and once the standard error of the averaged offset is inside
+// config_.calib_offset_tolerance the remainder of the scan is skipped —
+// a clean encoder finishes in a fraction of calib_scan_distance while a
+// noisy one still gets the full scan.
 // TODO: Do the scan with current, not voltage!
 bool Encoder::run_offset_calibration() {
     static const float start_lock_duration = 1.0f;
-    static const int num_steps = (int)(config_.calib_scan_distance / config_.calib_scan_omega * (float)current_meas_hz);
+    const int num_steps = (int)(config_.calib_scan_distance / config_.calib_scan_omega * (float)current_meas_hz);
 
     // Require index found if enabled
     if (config_.use_index && !index_found_) {
@@ -193,42 +365,83 @@ bool Encoder::run_offset_calibration() {
         return false;
 
     int32_t init_enc_val = shadow_count_;
-    int64_t encvaluesum = 0;
+
+    //TODO avoid recomputing elec_rad_per_enc every time
+    float elec_rad_per_enc = axis_->motor_.config_.pole_pairs * 2 * M_PI * (1.0f / (float)(config_.cpr));
+
+    // Running mean/variance of the per-cycle offset estimates (Welford).
+    // The estimates are decimated to ~100 Hz so the variance isn't taken
+    // from back-to-back control cycles of the same mechanical position.
+    struct OffsetStats_t {
+        static constexpr uint32_t MIN_SAMPLES = 16;
+        uint32_t n = 0;
+        float mean = 0.0f;
+        float m2 = 0.0f;
+        void add(float x) {
+            n++;
+            float delta = x - mean;
+            mean += delta / (float)n;
+            m2 += delta * (x - mean);
+        }
+        // standard error of the mean; only call with n >= 2
+        float std_error() const { return sqrtf(m2 / (float)(n - 1) / (float)n); }
+        bool converged(float tolerance) const {
+            return n >= MIN_SAMPLES && std_error() <= tolerance;
+        }
+    } forward_stats, backward_stats;
+    const int stats_decimation = (int)((float)current_meas_hz / 100.0f);
+    const bool allow_early_exit = config_.calib_offset_tolerance > 0.0f;
+    // the CPR check compares the response against the scanned distance, so
+    // the early exit only engages after at least two electrical revolutions
+    const int min_scan_steps = (int)((4.0f * M_PI) / config_.calib_scan_distance * (float)num_steps);
+    // steps per electrical revolution; used to discard the samples taken
+    // while stiction reverses the lag at the start of the backward scan
+    const int reversal_skip_steps = (int)((2.0f * M_PI) / config_.calib_scan_distance * (float)num_steps);
+
+    int direction = 0;
 
     // scan forward
     i = 0;
     axis_->run_control_loop([&](){
-        float phase = wrap_pm_pi(config_.calib_scan_distance * (float)i / (float)num_steps - config_.calib_scan_distance / 2.0f);
-        float v_alpha = voltage_magnitude * our_arm_cos_f32(phase);
-        float v_beta = voltage_magnitude * our_arm_sin_f32(phase);
+        float phase = config_.calib_scan_distance * (float)i / (float)num_steps - config_.calib_scan_distance / 2.0f;
+        float v_alpha = voltage_magnitude * our_arm_cos_f32(wrap_pm_pi(phase));
+        float v_beta = voltage_magnitude * our_arm_sin_f32(wrap_pm_pi(phase));
         if (!axis_->motor_.enqueue_voltage_timings(v_alpha, v_beta))
             return false; // error set inside enqueue_voltage_timings
         axis_->motor_.log_timing(Motor::TIMING_LOG_ENC_CALIB);
 
-        encvaluesum += shadow_count_;
-        
-        return ++i < num_steps;
+        if (direction == 0) {
+            // no offset samples until the rotor demonstrably moves
+            if (shadow_count_ > init_enc_val + 8)
+                direction = 1;
+            else if (shadow_count_ < init_enc_val - 8)
+                direction = -1;
+        } else if (stats_decimation == 0 || (i % stats_decimation) == 0) {
+            forward_stats.add((float)shadow_count_ - (float)direction * phase / elec_rad_per_enc);
+        }
+
+        ++i;
+        if (allow_early_exit && direction != 0 && i >= min_scan_steps
+            && forward_stats.converged(config_.calib_offset_tolerance))
+            return false; // confident enough; skip the rest of the scan
+        return i < num_steps;
     });
     if (axis_->error_ != Axis::ERROR_NONE)
         return false;
 
     // Check response and direction
-    if (shadow_count_ > init_enc_val + 8) {
-        // motor same dir as encoder
-        axis_->motor_.config_.direction = 1;
-    } else if (shadow_count_ < init_enc_val - 8) {
-        // motor opposite dir as encoder
-        axis_->motor_.config_.direction = -1;
+    if (direction != 0) {
+        axis_->motor_.config_.direction = direction;
     } else {
         // Encoder response error
         set_error(ERROR_NO_RESPONSE);
         return false;
     }
 
-    //TODO avoid recomputing elec_rad_per_enc every time
-    // Check CPR
-    float elec_rad_per_enc = axis_->motor_.config_.pole_pairs * 2 * M_PI * (1.0f / (float)(config_.cpr));
-    float expected_encoder_delta = config_.calib_scan_distance / elec_rad_per_enc;
+    // Check CPR against the distance actually scanned
+    const int forward_steps = i;
+    float scanned_distance = config_.calib_scan_distance * (float)forward_steps / (float)num_steps;
+    float expected_encoder_delta = scanned_distance / elec_rad_per_enc;
     calib_scan_response_ = fabsf(shadow_count_-init_enc_val);
     if(fabsf(calib_scan_response_ - expected_encoder_delta)/expected_encoder_delta > config_.calib_range)
     {
@@ -236,31 +449,157 @@ bool Encoder::run_offset_calibration() {
         return false;
     }
 
-    // scan backwards
+    // scan backwards over the range the forward scan covered
+    float phase_end = config_.calib_scan_distance * (float)forward_steps / (float)num_steps - config_.calib_scan_distance / 2.0f;
     i = 0;
     axis_->run_control_loop([&](){
-        float phase = wrap_pm_pi(-config_.calib_scan_distance * (float)i / (float)num_steps + config_.calib_scan_distance / 2.0f);
-        float v_alpha = voltage_magnitude * our_arm_cos_f32(phase);
-        float v_beta = voltage_magnitude * our_arm_sin_f32(phase);
+        float phase = phase_end - config_.calib_scan_distance * (float)i / (float)num_steps;
+        float v_alpha = voltage_magnitude * our_arm_cos_f32(wrap_pm_pi(phase));
+        float v_beta = voltage_magnitude * our_arm_sin_f32(wrap_pm_pi(phase));
         if (!axis_->motor_.enqueue_voltage_timings(v_alpha, v_beta))
             return false; // error set inside enqueue_voltage_timings
         axis_->motor_.log_timing(Motor::TIMING_LOG_ENC_CALIB);
 
-        encvaluesum += shadow_count_;
-        
-        return ++i < num_steps;
+        if (i >= reversal_skip_steps && (stats_decimation == 0 || (i % stats_decimation) == 0))
+            backward_stats.add((float)shadow_count_ - (float)direction * phase / elec_rad_per_enc);
+
+        ++i;
+        // the final offset averages both directions, so the bound applies
+        // to the combined standard error
+        if (allow_early_exit && forward_stats.n >= OffsetStats_t::MIN_SAMPLES
+            && backward_stats.n >= OffsetStats_t::MIN_SAMPLES) {
+            float se_f = forward_stats.std_error();
+            float se_b = backward_stats.std_error();
+            calib_offset_stderr_ = 0.5f * sqrtf(se_f * se_f + se_b * se_b);
+            if (calib_offset_stderr_ <= config_.calib_offset_tolerance)
+                return false; // confident enough; skip the rest of the scan
+        }
+        return i < forward_steps;
     });
     if (axis_->error_ != Axis::ERROR_NONE)
         return false;
 
-    config_.offset = encvaluesum / (num_steps * 2);
-    int32_t residual = encvaluesum - ((int64_t)config_.offset * (int64_t)(num_steps * 2));
-    config_.offset_float = (float)residual / (float)(num_steps * 2) + 0.5f; // add 0.5 to center-align state to phase
+    if (forward_stats.n < 2 || backward_stats.n < 2) {
+        // the rotor barely moved or the backward scan never got past the
+        // reversal region; too few samples for a trustworthy average
+        set_error(ERROR_NO_RESPONSE);
+        return false;
+    }
+    float se_f = forward_stats.std_error();
+    float se_b = backward_stats.std_error();
+    calib_offset_stderr_ = 0.5f * sqrtf(se_f * se_f + se_b * se_b);
+
+    float offset_mean = 0.5f * (forward_stats.mean + backward_stats.mean);
+    config_.offset = (int32_t)offset_mean;
+    config_.offset_float = offset_mean - (float)config_.offset + 0.5f; // add 0.5 to center-align state to phase
 
     is_ready_ = true;
     return true;
 }
 
+//--------------------
+// SPI absolute encoders (AS5047-style and MA702-style)
+//
+// The read is timer-triggered: sample_now() runs in the PWM update interrupt
+// at the SVM vector 0 midpoint (the same instant the current measurement is
+// taken) and only starts a DMA-driven full-duplex transfer on the shared
+// SPI3 bus. The CPU is not involved in moving the data; abs_spi_cb() runs
+// from the DMA transfer-complete interrupt, raises the chip select and
+// stores the decoded angle for Encoder::update() to consume on the control
+// thread. The gate drivers use the same bus with blocking transfers during
+// startup and fault readout, and for gain autoranging writes while the
+// control loop is running; the latter claim the bus via
+// Motor::gate_driver_spi_busy_ and the transaction here is simply skipped
+// for the few affected cycles (see abs_spi_miss_cnt_ tolerance).
+//--------------------
+
+// The encoder with a transaction in flight on the shared bus (ISR context only)
+static Encoder* abs_spi_active_encoder_ = nullptr;
+
+// @brief Checks the even parity bit (bit 15) that AS5047-style encoders
+// append to every frame.
+static bool ams_parity_ok(uint16_t v) {
+    v ^= v >> 8;
+    v ^= v >> 4;
+    v ^= v >> 2;
+    v ^= v >> 1;
+    return (v & 1) == 0;
+}
+
+bool Encoder::abs_spi_init() {
+    if (!is_abs_spi_mode())
+        return false;
+
+    abs_spi_cs_port_ = get_gpio_port_by_pin(config_.abs_spi_cs_gpio_pin);
+    abs_spi_cs_pin_ = get_gpio_pin_by_pin(config_.abs_spi_cs_gpio_pin);
+
+    GPIO_InitTypeDef GPIO_InitStruct;
+    GPIO_InitStruct.Pin = abs_spi_cs_pin_;
+    GPIO_InitStruct.Mode = GPIO_MODE_OUTPUT_PP;
+    GPIO_InitStruct.Pull = GPIO_PULLUP;
+    GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_LOW;
+    HAL_GPIO_Init(abs_spi_cs_port_, &GPIO_InitStruct);
+    HAL_GPIO_WritePin(abs_spi_cs_port_, abs_spi_cs_pin_, GPIO_PIN_SET);
+
+    // AS5047: read ANGLECOM (addr 0x3FFF), read bit and even parity set -> 0xFFFF
+    // MA702: returns the current angle for an all-zero frame
+    abs_spi_dma_tx_[0] = (config_.mode == MODE_SPI_ABS_AMS) ? 0xFFFF : 0x0000;
+    return true;
+}
+
+bool Encoder::abs_spi_start_transaction() {
+    SPI_HandleTypeDef* spi = hw_config_.spi;
+    if (Motor::gate_driver_spi_busy_)
+        return false; // gate driver gain write in progress or imminent
+    if (spi->State != HAL_SPI_STATE_READY)
+        return false; // bus busy (other axis or gate driver traffic)
+
+    HAL_GPIO_WritePin(abs_spi_cs_port_, abs_spi_cs_pin_, GPIO_PIN_RESET);
+    abs_spi_active_encoder_ = this;
+    if (HAL_SPI_TransmitReceive_DMA(spi, (uint8_t*)abs_spi_dma_tx_, (uint8_t*)abs_spi_dma_rx_, 1) != HAL_OK) {
+        abs_spi_active_encoder_ = nullptr;
+        HAL_GPIO_WritePin(abs_spi_cs_port_, abs_spi_cs_pin_, GPIO_PIN_SET);
+        return false;
+    }
+    return true;
+}
+
+// Called from the SPI DMA transfer-complete interrupt.
+void Encoder::abs_spi_cb() {
+    HAL_GPIO_WritePin(abs_spi_cs_port_, abs_spi_cs_pin_, GPIO_PIN_SET);
+
+    uint16_t rawVal = abs_spi_dma_rx_[0];
+    int32_t pos;
+    switch (config_.mode) {
+        case MODE_SPI_ABS_AMS: {
+            if (!ams_parity_ok(rawVal) || (rawVal & 0x4000)) { // bit 14 = error flag
+                spi_error_cnt_++;
+                return;
+            }
+            pos = rawVal & 0x3fff;
+        } break;
+
+        case MODE_SPI_ABS_MA702: {
+            pos = rawVal >> 2; // 14 bit angle in the upper bits
+        } break;
+
+        default: {
+            return;
+        } break;
+    }
+
+    abs_spi_pos_sample_ = pos;
+    abs_spi_pos_updated_ = true;
+}
+
+void HAL_SPI_TxRxCpltCallback(SPI_HandleTypeDef *hspi) {
+    (void) hspi;
+    Encoder* enc = abs_spi_active_encoder_;
+    abs_spi_active_encoder_ = nullptr;
+    if (enc)
+        enc->abs_spi_cb();
+}
+
 static bool decode_hall(uint8_t hall_state, int32_t* hall_cnt) {
     switch (hall_state) {
         case 0b001: *hall_cnt = 0; return true;
@@ -276,7 +615,10 @@ static bool decode_hall(uint8_t hall_state, int32_t* hall_cnt) {
 void Encoder::sample_now() {
     switch (config_.mode) {
         case MODE_INCREMENTAL: {
-            tim_cnt_sample_ = (int16_t)hw_config_.timer->Instance->CNT;
+            // do nothing: CNT is captured into a two-slot ring by the
+            // update-event DMA stream and latched into tim_cnt_sample_ from
+            // the current measurement ISR (see low_level.cpp). That path
+            // also works when this interrupt is not enabled at all.
         } break;
 
         case MODE_HALL: {
@@ -284,8 +626,17 @@ void Encoder::sample_now() {
         } break;
 
         case MODE_SINCOS: {
-            sincos_sample_s_ = (get_adc_voltage(GPIO_3_GPIO_Port, GPIO_3_Pin) / 3.3f) - 0.5f;
-            sincos_sample_c_ = (get_adc_voltage(GPIO_4_GPIO_Port, GPIO_4_Pin) / 3.3f) - 0.5f;
+            // do nothing: the sin/cos pair is converted on the ADC1 injected
+            // sequence at the PWM midpoint and written into sincos_sample_s_/
+            // sincos_sample_c_ from the injected-complete interrupt
+            // (see arm_sincos_injected_sampling), before update() runs.
+        } break;
+
+        case MODE_SPI_ABS_AMS:
+        case MODE_SPI_ABS_MA702: {
+            // Kick off the DMA transaction; the result arrives via abs_spi_cb()
+            // well before update() runs on the control thread.
+            abs_spi_start_transaction();
         } break;
 
         default: {
@@ -295,6 +646,14 @@ void Encoder::sample_now() {
 }
 
 bool Encoder::update() {
+    if (config_.use_index && (!index_found_ || config_.enable_integrity_monitor)
+            && has_index_capture())
+        check_index_capture();
+    if (index_pending_) {
+        index_pending_ = false;
+        process_index_pulse();
+    }
+
     // update internal encoder state.
     int32_t delta_enc = 0;
     switch (config_.mode) {
@@ -313,15 +672,23 @@ bool Encoder::update() {
                 if (delta_enc > 3)
                     delta_enc -= 6;
             } else {
+                // 0b000/0b111 can only come from a disconnected or glitched
+                // hall input; count them even when they're tolerated.
+                ++illegal_hall_state_cnt_;
                 if (!config_.ignore_illegal_hall_state) {
                     set_error(ERROR_ILLEGAL_HALL_STATE);
                     return false;
                 }
+                if (config_.integrity_error_limit &&
+                        index_count_error_cnt_ + illegal_hall_state_cnt_ > config_.integrity_error_limit) {
+                    set_error(ERROR_ILLEGAL_HALL_STATE);
+                    return false;
+                }
             }
         } break;
 
         case MODE_SINCOS: {
-            float phase = fast_atan2(sincos_sample_s_, sincos_sample_c_);
+            float phase = fast_atan2_lut(sincos_sample_s_, sincos_sample_c_);
             int fake_count = (int)(1000.0f * phase);
             //CPR = 6283 = 2pi * 1k
 
@@ -330,35 +697,148 @@ bool Encoder::update() {
             if (delta_enc > 6283/2)
                 delta_enc -= 6283;
         } break;
-        
+
+        case MODE_SPI_ABS_AMS:
+        case MODE_SPI_ABS_MA702: {
+            if (abs_spi_pos_updated_) {
+                abs_spi_pos_updated_ = false;
+                abs_spi_miss_cnt_ = 0;
+                delta_enc = abs_spi_pos_sample_ - count_in_cpr_;
+                delta_enc = mod(delta_enc, config_.cpr);
+                if (delta_enc > config_.cpr / 2)
+                    delta_enc -= config_.cpr;
+            } else {
+                // The transaction was skipped (bus busy) or the frame failed
+                // the parity check. Coast on the PLL prediction, but give up
+                // if the encoder stays silent.
+                if (++abs_spi_miss_cnt_ > 32) {
+                    set_error(ERROR_ABS_SPI_COM_FAIL);
+                    return false;
+                }
+            }
+        } break;
+
         default: {
            set_error(ERROR_UNSUPPORTED_ENCODER_MODE);
            return false;
         } break;
     }
 
+    //// 1/T (delta-time) velocity measurement
+    // The count delta quantizes to whole counts per cycle, which is very
+    // coarse at low speed. Timing the interval between observed count changes
+    // instead gives a relative error of ~1/n after n cycles between edges,
+    // so the slower the motion the finer this estimate gets. Edges are only
+    // observed at the sampling instants (for halls: the coherent GPIO
+    // snapshot in tim_update_cb), so the interval is measured in whole
+    // control cycles. This matters most for MODE_HALL, where the position
+    // resolution is only six counts per electrical revolution and the PLL
+    // alone is too noisy for a useful vel_gain.
+    if (config_.enable_vel_1t &&
+            (config_.mode == MODE_INCREMENTAL || config_.mode == MODE_HALL)) {
+        if (cycles_since_edge_ < UINT32_MAX)
+            ++cycles_since_edge_;
+        if (delta_enc != 0) {
+            vel_estimate_1t_ = (float)delta_enc / (current_meas_period * (float)cycles_since_edge_);
+            cycles_since_edge_ = 0;
+        } else {
+            // No edge seen: the speed can be at most one count per elapsed interval
+            float vel_bound = 1.0f / (current_meas_period * (float)cycles_since_edge_);
+            if (vel_estimate_1t_ > vel_bound) vel_estimate_1t_ = vel_bound;
+            if (vel_estimate_1t_ < -vel_bound) vel_estimate_1t_ = -vel_bound;
+        }
+    }
+
     shadow_count_ += delta_enc;
     count_in_cpr_ += delta_enc;
-    count_in_cpr_ = mod(count_in_cpr_, config_.cpr);
+    // Conditional add/subtract instead of an integer division: delta_enc is
+    // at most a few counts per cycle in steady state, so these loops almost
+    // never iterate (and at most a handful of times after a glitch).
+    while (count_in_cpr_ >= config_.cpr)
+        count_in_cpr_ -= config_.cpr;
+    while (count_in_cpr_ < 0)
+        count_in_cpr_ += config_.cpr;
+
+    // Sub-count interpolation of the count measurement (the same arc
+    // interpolation as the phase interpolation below): between edges the
+    // true position keeps advancing inside the count, so blending the
+    // phase-detector input along the velocity estimate removes most of the
+    // one-count quantization that otherwise limits the usable vel_gain on
+    // low-CPR encoders - halls, at six counts per electrical revolution,
+    // are the extreme case. An edge pins the fraction to the boundary it
+    // was crossed from, so accumulated interpolation error never survives
+    // an actual measurement.
+    if (config_.enable_count_interpolation &&
+            (config_.mode == MODE_INCREMENTAL || config_.mode == MODE_HALL)) {
+        if (delta_enc > 0) {
+            count_interp_frac_ = 0.0f;
+        } else if (delta_enc < 0) {
+            count_interp_frac_ = 1.0f;
+        } else {
+            count_interp_frac_ += current_meas_period * vel_estimate_;
+            if (count_interp_frac_ > 1.0f) count_interp_frac_ = 1.0f;
+            if (count_interp_frac_ < 0.0f) count_interp_frac_ = 0.0f;
+        }
+    } else {
+        count_interp_frac_ = 0.0f;
+    }
 
     //// run pll (for now pll is in units of encoder counts)
     // Predict current pos
     pos_estimate_ += current_meas_period * vel_estimate_;
     pos_cpr_      += current_meas_period * vel_estimate_;
-    // discrete phase detector
-    float delta_pos     = (float)(shadow_count_ - (int32_t)floorf(pos_estimate_));
-    float delta_pos_cpr = (float)(count_in_cpr_ - (int32_t)floorf(pos_cpr_));
+    float delta_pos, delta_pos_cpr;
+    if (config_.enable_count_interpolation &&
+            (config_.mode == MODE_INCREMENTAL || config_.mode == MODE_HALL)) {
+        // continuous phase detector on the interpolated measurement
+        delta_pos     = ((float)shadow_count_ + count_interp_frac_) - pos_estimate_;
+        delta_pos_cpr = ((float)count_in_cpr_ + count_interp_frac_) - pos_cpr_;
+    } else {
+        // discrete phase detector
+        delta_pos     = (float)(shadow_count_ - (int32_t)floorf(pos_estimate_));
+        delta_pos_cpr = (float)(count_in_cpr_ - (int32_t)floorf(pos_cpr_));
+    }
     delta_pos_cpr = wrap_pm(delta_pos_cpr, 0.5f * (float)(config_.cpr));
     // pll feedback
     pos_estimate_ += current_meas_period * pll_kp_ * delta_pos;
     pos_cpr_      += current_meas_period * pll_kp_ * delta_pos_cpr;
-    pos_cpr_ = fmodf_pos(pos_cpr_, (float)(config_.cpr));
+    // pos_cpr_ moves by well under one revolution per cycle, so wrapping is
+    // a conditional add/subtract rather than newlib's fmodf
+    if (pos_cpr_ >= (float)(config_.cpr))
+        pos_cpr_ -= (float)(config_.cpr);
+    else if (pos_cpr_ < 0.0f)
+        pos_cpr_ += (float)(config_.cpr);
     vel_estimate_      += current_meas_period * pll_ki_ * delta_pos_cpr;
     bool snap_to_zero_vel = false;
     if (fabsf(vel_estimate_) < 0.5f * current_meas_period * pll_ki_) {
         vel_estimate_ = 0.0f; //align delta-sigma on zero to prevent jitter
         snap_to_zero_vel = true;
     }
+    // Complementary fusion: pull the PLL velocity state towards the 1/T
+    // measurement. This doesn't change the PLL position dynamics, so
+    // config_.bandwidth can stay high.
+    if (config_.enable_vel_1t &&
+            (config_.mode == MODE_INCREMENTAL || config_.mode == MODE_HALL)) {
+        vel_estimate_ += (current_meas_period * config_.vel_1t_bandwidth) * (vel_estimate_1t_ - vel_estimate_);
+    }
+
+    // Delay compensation: the estimates are based on the sample taken at
+    // the start of this cycle, but the voltage commanded from them takes
+    // effect ~1.5 PWM periods later (the same delay Motor::update
+    // compensates on the phase). Extrapolate along the PLL velocity so the
+    // position loops see the position at actuation time.
+    if (config_.enable_delay_compensation) {
+        float delay_comp = 1.5f * current_meas_period * vel_estimate_;
+        pos_estimate_comp_ = pos_estimate_ + delay_comp;
+        pos_cpr_comp_ = pos_cpr_ + delay_comp;
+        if (pos_cpr_comp_ >= (float)(config_.cpr))
+            pos_cpr_comp_ -= (float)(config_.cpr);
+        else if (pos_cpr_comp_ < 0.0f)
+            pos_cpr_comp_ += (float)(config_.cpr);
+    } else {
+        pos_estimate_comp_ = pos_estimate_;
+        pos_cpr_comp_ = pos_cpr_;
+    }
 
     //// run encoder count interpolation
     int32_t corrected_enc = count_in_cpr_ - config_.offset;
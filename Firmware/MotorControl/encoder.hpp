@@ -15,12 +15,18 @@ public:
         ERROR_UNSUPPORTED_ENCODER_MODE = 0x08,
         ERROR_ILLEGAL_HALL_STATE = 0x10,
         ERROR_INDEX_NOT_FOUND_YET = 0x20,
+        ERROR_ABS_SPI_COM_FAIL = 0x40,
+        ERROR_INDEX_COUNT_MISMATCH = 0x80,
+        ERROR_ESTIMATE_MISMATCH = 0x100, //<! sustained disagreement with the flux
+                                         //<! observer (see Axis::sensorless_cross_check)
     };
 
     enum Mode_t {
         MODE_INCREMENTAL,
         MODE_HALL,
-        MODE_SINCOS
+        MODE_SINCOS,
+        MODE_SPI_ABS_AMS,   // AS5047/AS5048 style
+        MODE_SPI_ABS_MA702  // MA702/MA732 style
     };
 
     struct Config_t {
@@ -36,13 +42,34 @@ public:
         int32_t offset = 0;        // Offset between encoder count and rotor electrical phase
         float offset_float = 0.0f; // Sub-count phase alignment offset
         bool enable_phase_interpolation = true; // Use velocity to interpolate inside the count state
+        bool enable_count_interpolation = false; // feed a sub-count interpolated count measurement
+                                                 // to the position PLL (MODE_INCREMENTAL only)
         float calib_range = 0.02f; // Accuracy required to pass encoder cpr check
         float calib_scan_distance = 16.0f * M_PI; // rad electrical
         float calib_scan_omega = 4.0f * M_PI; // rad/s electrical
+        float calib_offset_tolerance = 2.0f; // [counts] 1-sigma bound on the averaged
+                                             // offset below which the calibration scan
+                                             // exits early; 0 = always scan the full
+                                             // distance
         float bandwidth = 1000.0f;
         bool find_idx_on_lockin_only = false; // Only be sensitive during lockin scan constant vel state
         bool idx_search_unidirectional = false; // Only allow index search in known direction
+        float idx_search_fast_vel = 0.0f; // [rad/s el] fast traverse speed for the two-phase
+                                          // index search, 0 = single-phase at the lockin speed
         bool ignore_illegal_hall_state = false; // dont error on bad states like 000 or 111
+        uint16_t abs_spi_cs_gpio_pin = 1; // GPIO number of the absolute encoder chip select
+        bool enable_vel_1t = false; // fuse a 1/T (delta-time) velocity measurement into the PLL
+                                    // (incremental and hall modes)
+        float vel_1t_bandwidth = 100.0f; // [rad/s] pull rate of the PLL velocity towards the 1/T measurement
+        bool enable_delay_compensation = false; // extrapolate pos_estimate_comp_ to the actuation time
+        // Signal integrity monitor: keep the index pulse armed after the
+        // first find and verify that a whole multiple of cpr counts passed
+        // between consecutive edges (MODE_INCREMENTAL), catching EMI count
+        // corruption long before it blows up the position loop. Illegal
+        // hall states are counted in the same budget.
+        bool enable_integrity_monitor = false;
+        uint32_t integrity_error_limit = 10; // total integrity errors before the axis
+                                             // faults; 0 = count only, never trip
     };
 
     Encoder(const EncoderHardwareConfig_t& hw_config,
@@ -53,7 +80,16 @@ public:
     bool do_checks();
 
     void enc_index_cb();
+    void process_index_pulse();
     void set_idx_subscribe(bool override_enable = false);
+    // True if the index pin routes to an input capture channel of the
+    // encoder timer, so the count at the pulse edge is latched in hardware
+    bool has_index_capture() {
+        return hw_config_.index_capture_channel != UINT32_MAX;
+    }
+    void arm_index_capture();
+    void disarm_index_capture();
+    void check_index_capture();
     void update_pll_gains();
     void check_pre_calibrated();
 
@@ -67,6 +103,13 @@ public:
     void sample_now();
     bool update();
 
+    bool abs_spi_init();
+    bool abs_spi_start_transaction();
+    void abs_spi_cb();
+    bool is_abs_spi_mode() {
+        return config_.mode == MODE_SPI_ABS_AMS || config_.mode == MODE_SPI_ABS_MA702;
+    }
+
 
 
     const EncoderHardwareConfig_t& hw_config_;
@@ -74,25 +117,68 @@ public:
     Axis* axis_ = nullptr; // set by Axis constructor
 
     Error_t error_ = ERROR_NONE;
+    // Written by enc_index_cb in interrupt context, consumed by update()
+    volatile uint16_t index_cnt_sample_ = 0;
+    volatile bool index_pending_ = false;
     bool index_found_ = false;
     bool is_ready_ = false;
     int32_t shadow_count_ = 0;
     int32_t count_in_cpr_ = 0;
     float interpolation_ = 0.0f;
+    float count_interp_frac_ = 0.0f; // [count] sub-count fraction of the measured
+                                     // count (see enable_count_interpolation)
     float phase_ = 0.0f;    // [count]
     float pos_estimate_ = 0.0f;  // [count]
     float pos_cpr_ = 0.0f;  // [count]
     float vel_estimate_ = 0.0f;  // [count/s]
     float pll_kp_ = 0.0f;   // [count/s / count]
     float pll_ki_ = 0.0f;   // [(count/s^2) / count]
+    // Estimates extrapolated to the actuation time along vel_estimate_
+    // (equal to the raw estimates when delay compensation is disabled).
+    // These are what the position/velocity loops consume.
+    float pos_estimate_comp_ = 0.0f; // [count]
+    float pos_cpr_comp_ = 0.0f;      // [count]
     float calib_scan_response_ = 0.0f; // debug report from offset calib
+    float calib_offset_stderr_ = 0.0f; // debug report from offset calib: standard
+                                       // error of the averaged offset [counts]
 
-    int16_t tim_cnt_sample_ = 0; // 
+    int16_t tim_cnt_sample_ = 0; // MODE_INCREMENTAL: latched by the current
+                                 // meas ISR from the update-event DMA capture
+                                 // (see low_level.cpp)
     // Updated by low_level pwm_adc_cb
     uint8_t hall_state_ = 0x0; // bit[0] = HallA, .., bit[2] = HallC
+    // Written from the ADC1 injected-complete interrupt (PWM midpoint
+    // sample, see arm_sincos_injected_sampling), consumed by update()
     float sincos_sample_s_ = 0.0f;
     float sincos_sample_c_ = 0.0f;
 
+    // Hall decode mapping into the sampled GPIO ports, resolved once in
+    // setup() so decode_hall_samples doesn't search ports in the ADC
+    // callback. Order: C, B, A (matches the hall_state_ bit order).
+    uint8_t hall_port_idx_[3] = { 0, 0, 0 };
+    uint16_t hall_pin_mask_[3] = { 0, 0, 0 };
+
+    // Absolute SPI encoder state (MODE_SPI_ABS_*). sample_now() kicks off a
+    // DMA transaction from the PWM update interrupt and abs_spi_cb() stores
+    // the result from the SPI DMA complete interrupt; update() only consumes.
+    GPIO_TypeDef* abs_spi_cs_port_ = nullptr;
+    uint16_t abs_spi_cs_pin_ = 0;
+    uint16_t abs_spi_dma_tx_[1] = { 0xFFFF };
+    uint16_t abs_spi_dma_rx_[1] = { 0 };
+    volatile bool abs_spi_pos_updated_ = false;
+    int32_t abs_spi_pos_sample_ = 0;
+    uint8_t abs_spi_miss_cnt_ = 0;
+    uint32_t spi_error_cnt_ = 0;
+
+    // Signal integrity monitor state (see process_index_pulse)
+    int32_t index_check_count_ = 0;        // [count] shadow count at the last index edge
+    uint32_t index_count_error_cnt_ = 0;   // revolutions that didn't deliver cpr counts
+    uint32_t illegal_hall_state_cnt_ = 0;  // 0b000/0b111 hall samples observed
+
+    // 1/T (delta-time) velocity estimation (MODE_INCREMENTAL only)
+    uint32_t cycles_since_edge_ = 0; // [control cycles] since the last observed count change
+    float vel_estimate_1t_ = 0.0f;   // [count/s]
+
     // Communication protocol definitions
     auto make_protocol_definitions() {
         return make_protocol_member_list(
@@ -104,10 +190,16 @@ public:
             make_protocol_property("interpolation", &interpolation_),
             make_protocol_ro_property("phase", &phase_),
             make_protocol_property("pos_estimate", &pos_estimate_),
+            make_protocol_ro_property("pos_estimate_comp", &pos_estimate_comp_),
             make_protocol_property("pos_cpr", &pos_cpr_),
             make_protocol_ro_property("hall_state", &hall_state_),
             make_protocol_property("vel_estimate", &vel_estimate_),
             make_protocol_ro_property("calib_scan_response", &calib_scan_response_),
+            make_protocol_ro_property("calib_offset_stderr", &calib_offset_stderr_),
+            make_protocol_ro_property("spi_error_cnt", &spi_error_cnt_),
+            make_protocol_ro_property("index_count_error_cnt", &index_count_error_cnt_),
+            make_protocol_ro_property("illegal_hall_state_cnt", &illegal_hall_state_cnt_),
+            make_protocol_ro_property("vel_estimate_1t", &vel_estimate_1t_),
             // make_protocol_property("pll_kp", &pll_kp_),
             // make_protocol_property("pll_ki", &pll_ki_),
             make_protocol_object("config",
@@ -123,13 +215,24 @@ public:
                 make_protocol_property("offset", &config_.offset),
                 make_protocol_property("offset_float", &config_.offset_float),
                 make_protocol_property("enable_phase_interpolation", &config_.enable_phase_interpolation),
+                make_protocol_property("enable_count_interpolation", &config_.enable_count_interpolation),
                 make_protocol_property("bandwidth", &config_.bandwidth,
                     [](void* ctx) { static_cast<Encoder*>(ctx)->update_pll_gains(); }, this),
                 make_protocol_property("calib_range", &config_.calib_range),
                 make_protocol_property("calib_scan_distance", &config_.calib_scan_distance),
                 make_protocol_property("calib_scan_omega", &config_.calib_scan_omega),
+                make_protocol_property("calib_offset_tolerance", &config_.calib_offset_tolerance),
                 make_protocol_property("idx_search_unidirectional", &config_.idx_search_unidirectional),
-                make_protocol_property("ignore_illegal_hall_state", &config_.ignore_illegal_hall_state)
+                make_protocol_property("idx_search_fast_vel", &config_.idx_search_fast_vel),
+                make_protocol_property("ignore_illegal_hall_state", &config_.ignore_illegal_hall_state),
+                make_protocol_property("abs_spi_cs_gpio_pin", &config_.abs_spi_cs_gpio_pin,
+                    [](void* ctx) { static_cast<Encoder*>(ctx)->abs_spi_init(); }, this),
+                make_protocol_property("enable_vel_1t", &config_.enable_vel_1t),
+                make_protocol_property("vel_1t_bandwidth", &config_.vel_1t_bandwidth),
+                make_protocol_property("enable_delay_compensation", &config_.enable_delay_compensation),
+                make_protocol_property("enable_integrity_monitor", &config_.enable_integrity_monitor,
+                    [](void* ctx) { static_cast<Encoder*>(ctx)->set_idx_subscribe(); }, this),
+                make_protocol_property("integrity_error_limit", &config_.integrity_error_limit)
             ),
             make_protocol_function("set_linear_count", *this, &Encoder::set_linear_count, "count")
         );
@@ -0,0 +1,312 @@
+/* In-application firmware update over CAN.
+*
+* Flash layout
+* ------------
+* The F405 has a single flash bank, so the new image is staged in the top
+* two sectors of the application flash region and copied over the running
+* image at activation time:
+*
+*   sectors 0-7   0x08000000..0x0807FFFF  application (512K, see linker script)
+*   sectors 8-9   0x08080000..0x080BFFFF  update staging area (256K)
+*   sectors 10-11 0x080C0000..0x080FFFFF  config NVM (see nvm.c)
+*
+* The copy runs from RAM (RAMFUNC) with interrupts off, erases the
+* application sectors and programs the staged image word by word, then
+* resets. A power loss during this window bricks the board - the window is
+* a few seconds, the staged image was CRC-verified beforehand, and the
+* host is expected to keep the supply up during activation.
+*
+* Frame format (opcode 7, host -> drive; byte 0 selects the subcommand)
+* ---------------------------------------------------------------------
+*   0x00 STATUS:   no payload; request a status frame
+*   0x01 BEGIN:    u32 image_size, u16 image_crc16; erases the staging area
+*   0x02 DATA:     up to 7 payload bytes, appended to the current row
+*   0x03 ROW_END:  u32 row_offset, u16 row_crc16; verifies the buffered row
+*                  against the CRC and programs it to the staging area
+*   0x04 VERIFY:   no payload; CRC-checks the complete staged image
+*   0x05 ACTIVATE: u16 delay_ms (max 10000); reboots into the new image
+*                  after the delay, so the host can give every node on the
+*                  bus the same activation deadline
+*
+* The drive answers each completed operation with a status frame on the
+* same opcode: byte 0 = 0x80 | subcommand, byte 1 = error code, bytes 2-5 =
+* u32 value (bytes received so far, or the computed CRC after VERIFY).
+* Rows must be sent in order; a CRC or ordering error drops the row and
+* the host resends it. CRC16 parameters are the same as the config NVM
+* (polynomial 0x3d65, init 0xabcd).
+*/
+
+#include "odrive_main.h"
+#include "fw_update.hpp"
+#include <fibre/crc.hpp>
+#include <string.h>
+
+#define FW_UPDATE_CRC16_INIT        0xabcd
+#define FW_UPDATE_CRC16_POLYNOMIAL  0x3d65
+
+// same as in nvm.c
+#define HAL_FLASH_ClearError() __HAL_FLASH_CLEAR_FLAG(FLASH_FLAG_EOP | FLASH_FLAG_OPERR | FLASH_FLAG_WRPERR | FLASH_FLAG_PGAERR | FLASH_FLAG_PGSERR | FLASH_FLAG_PGPERR)
+
+#define FW_STAGING_BASE             0x08080000UL
+#define FW_STAGING_SIZE             0x40000UL
+#define FW_STAGING_FIRST_SECTOR     FLASH_SECTOR_8
+#define FW_STAGING_SECTOR_COUNT     2
+#define FW_APP_BASE                 0x08000000UL
+#define FW_APP_SIZE                 0x80000UL
+
+#define FW_ROW_BUFFER_SIZE          512
+#define FW_MAX_ACTIVATE_DELAY_MS    10000
+
+// subcommands (host -> drive; status frames echo them with bit 7 set)
+#define FW_SUB_STATUS               0x00
+#define FW_SUB_BEGIN                0x01
+#define FW_SUB_DATA                 0x02
+#define FW_SUB_ROW_END              0x03
+#define FW_SUB_VERIFY               0x04
+#define FW_SUB_ACTIVATE             0x05
+
+// error codes (byte 1 of the status frame)
+#define FW_ERR_NONE                 0
+#define FW_ERR_BUSY                 1 // previous operation still in progress
+#define FW_ERR_STATE                2 // subcommand not valid in this state
+#define FW_ERR_RANGE                3 // size/offset out of range or out of order
+#define FW_ERR_CRC                  4 // row or image CRC mismatch
+#define FW_ERR_FLASH                5 // flash erase/program failed
+#define FW_ERR_NOT_IDLE             6 // an axis is not in the idle state
+
+// Transfer state. Written by the RX interrupt, consumed by the CAN server
+// thread; pending_op_ is the handover flag between the two.
+#define FW_OP_NONE 0xff
+static volatile uint8_t pending_op_ = FW_OP_NONE; // staged subcommand waiting for the server thread
+static bool active_ = false;        // BEGIN accepted, transfer in progress
+static bool staged_valid_ = false;  // staged image passed VERIFY
+static uint32_t image_size_ = 0;
+static uint16_t image_crc_ = 0;
+static uint32_t bytes_programmed_ = 0;
+static uint16_t activate_delay_ms_ = 0;
+static uint32_t row_offset_arg_ = 0;
+static uint16_t row_crc_arg_ = 0;
+static uint8_t row_buffer_[FW_ROW_BUFFER_SIZE];
+static uint32_t row_length_ = 0;
+static uint8_t isr_error_ = FW_ERR_NONE; // first error seen while buffering DATA
+static bool activate_armed_ = false;
+static uint32_t activate_deadline_ = 0; // [ms], osKernelSysTick domain
+
+bool fw_update_active(void) {
+    return active_;
+}
+
+bool fw_update_handle_frame(const uint8_t* data, uint8_t dlc) {
+    if (dlc < 1)
+        return false;
+    uint8_t sub = data[0];
+
+    // DATA frames are pure RAM appends and don't go through pending_op_
+    if (sub == FW_SUB_DATA) {
+        if (!active_ || pending_op_ != FW_OP_NONE) {
+            isr_error_ = FW_ERR_BUSY;
+        } else if (row_length_ + (uint32_t)(dlc - 1) > sizeof(row_buffer_)) {
+            isr_error_ = FW_ERR_RANGE;
+        } else {
+            memcpy(&row_buffer_[row_length_], &data[1], dlc - 1);
+            row_length_ += dlc - 1;
+        }
+        return false;
+    }
+
+    if (pending_op_ != FW_OP_NONE)
+        return false; // previous operation not processed yet; host retries
+
+    switch (sub) {
+        case FW_SUB_BEGIN:
+            if (dlc < 7)
+                return false;
+            read_le(&image_size_, &data[1]);
+            read_le(&image_crc_, &data[5]);
+            active_ = true; // makes the server thread poll promptly
+            break;
+        case FW_SUB_ROW_END:
+            if (dlc < 7)
+                return false;
+            read_le(&row_offset_arg_, &data[1]);
+            read_le(&row_crc_arg_, &data[5]);
+            break;
+        case FW_SUB_ACTIVATE:
+            if (dlc < 3)
+                return false;
+            read_le(&activate_delay_ms_, &data[1]);
+            break;
+        case FW_SUB_STATUS:
+        case FW_SUB_VERIFY:
+            break;
+        default:
+            return false;
+    }
+    pending_op_ = sub;
+    return true;
+}
+
+// @brief Programs the buffered row to the staging area.
+static uint8_t program_row(void) {
+    if (row_offset_arg_ != bytes_programmed_ || row_length_ == 0 ||
+        bytes_programmed_ + row_length_ > image_size_)
+        return FW_ERR_RANGE;
+    if (calc_crc16<FW_UPDATE_CRC16_POLYNOMIAL>(FW_UPDATE_CRC16_INIT,
+            row_buffer_, row_length_) != row_crc_arg_)
+        return FW_ERR_CRC;
+
+    HAL_FLASH_Unlock();
+    HAL_FLASH_ClearError();
+    for (uint32_t pos = 0; pos < row_length_; ++pos) {
+        if (HAL_FLASH_Program(FLASH_TYPEPROGRAM_BYTE,
+                FW_STAGING_BASE + bytes_programmed_ + pos, row_buffer_[pos]) != HAL_OK) {
+            HAL_FLASH_Lock();
+            return FW_ERR_FLASH;
+        }
+    }
+    HAL_FLASH_Lock();
+    bytes_programmed_ += row_length_;
+    return FW_ERR_NONE;
+}
+
+// @brief Erases the staging sectors and resets the transfer state.
+static uint8_t erase_staging(void) {
+    if (image_size_ == 0 || image_size_ > FW_STAGING_SIZE)
+        return FW_ERR_RANGE;
+    FLASH_EraseInitTypeDef erase_struct = {
+        .TypeErase = FLASH_TYPEERASE_SECTORS,
+        .Banks = 0, // only used for mass erase
+        .Sector = FW_STAGING_FIRST_SECTOR,
+        .NbSectors = FW_STAGING_SECTOR_COUNT,
+        .VoltageRange = FLASH_VOLTAGE_RANGE_3
+    };
+    HAL_FLASH_Unlock();
+    HAL_FLASH_ClearError();
+    uint32_t sector_error;
+    HAL_StatusTypeDef status = HAL_FLASHEx_Erase(&erase_struct, &sector_error);
+    HAL_FLASH_Lock();
+    if (status != HAL_OK)
+        return FW_ERR_FLASH;
+    bytes_programmed_ = 0;
+    row_length_ = 0;
+    staged_valid_ = false;
+    isr_error_ = FW_ERR_NONE;
+    return FW_ERR_NONE;
+}
+
+// @brief Copies the staged image over the application and resets.
+//
+// Runs from RAM with interrupts off; everything in here must be register
+// level since the code it would call (and the vector table) is being
+// erased. Does not return.
+static RAMFUNC __attribute__((noinline)) void activate_copier(uint32_t image_size) {
+    #define FW_FLASH_WAIT() while (FLASH->SR & FLASH_SR_BSY) {}
+
+    FW_FLASH_WAIT();
+    FLASH->KEYR = 0x45670123;
+    FLASH->KEYR = 0xCDEF89AB;
+
+    // erase the application sectors covering the image
+    // (sectors 0-3: 16K, sector 4: 64K, sectors 5-7: 128K)
+    uint32_t addr = 0;
+    for (uint32_t s = 0; s < 8 && addr < image_size; ++s) {
+        FLASH->CR = FLASH_CR_SER | (s << FLASH_CR_SNB_Pos) | FLASH_CR_PSIZE_1;
+        FLASH->CR |= FLASH_CR_STRT;
+        FW_FLASH_WAIT();
+        addr += (s < 4) ? 0x4000u : (s == 4) ? 0x10000u : 0x20000u;
+    }
+
+    // program the staged image word by word
+    volatile uint32_t* src = (volatile uint32_t*)FW_STAGING_BASE;
+    volatile uint32_t* dst = (volatile uint32_t*)FW_APP_BASE;
+    uint32_t n_words = (image_size + 3) >> 2;
+    FLASH->CR = FLASH_CR_PG | FLASH_CR_PSIZE_1;
+    for (uint32_t i = 0; i < n_words; ++i) {
+        dst[i] = src[i];
+        FW_FLASH_WAIT();
+    }
+    FLASH->CR = FLASH_CR_LOCK;
+
+    SCB->AIRCR = (0x5FAuL << SCB_AIRCR_VECTKEY_Pos) | SCB_AIRCR_SYSRESETREQ_Msk;
+    for (;;) {}
+    #undef FW_FLASH_WAIT
+}
+
+bool fw_update_poll(uint8_t status_out[8]) {
+    if (activate_armed_ && !is_in_the_future(activate_deadline_)) {
+        __disable_irq();
+        activate_copier(image_size_);
+    }
+
+    uint8_t sub = pending_op_;
+    if (sub == FW_OP_NONE)
+        return false;
+
+    uint8_t error = FW_ERR_NONE;
+    uint32_t value = bytes_programmed_;
+
+    switch (sub) {
+        case FW_SUB_STATUS:
+            error = isr_error_;
+            break;
+        case FW_SUB_BEGIN:
+            error = erase_staging();
+            if (error != FW_ERR_NONE)
+                active_ = false;
+            break;
+        case FW_SUB_ROW_END:
+            if (!active_) {
+                error = FW_ERR_STATE;
+            } else if (isr_error_ != FW_ERR_NONE) {
+                error = isr_error_;
+            } else {
+                error = program_row();
+            }
+            // the row is consumed either way; on error the host resends it
+            row_length_ = 0;
+            isr_error_ = FW_ERR_NONE;
+            value = bytes_programmed_;
+            break;
+        case FW_SUB_VERIFY: {
+            if (!active_ || bytes_programmed_ != image_size_) {
+                error = FW_ERR_STATE;
+                break;
+            }
+            uint16_t crc = calc_crc16<FW_UPDATE_CRC16_POLYNOMIAL>(FW_UPDATE_CRC16_INIT,
+                    (const uint8_t*)FW_STAGING_BASE, image_size_);
+            value = crc;
+            if (crc != image_crc_)
+                error = FW_ERR_CRC;
+            else
+                staged_valid_ = true;
+        } break;
+        case FW_SUB_ACTIVATE: {
+            if (!staged_valid_ || activate_delay_ms_ > FW_MAX_ACTIVATE_DELAY_MS) {
+                error = staged_valid_ ? FW_ERR_RANGE : FW_ERR_STATE;
+                break;
+            }
+            for (size_t i = 0; i < AXIS_COUNT; ++i) {
+                if (axes[i] && axes[i]->current_state_ != Axis::AXIS_STATE_IDLE)
+                    error = FW_ERR_NOT_IDLE;
+            }
+            if (error != FW_ERR_NONE)
+                break;
+            // Arm the deadline instead of rebooting right here, so that the
+            // ack still goes out and the host can give every drive on the
+            // bus the same activation instant.
+            activate_deadline_ = timeout_to_deadline(activate_delay_ms_);
+            activate_armed_ = true;
+        } break;
+        default:
+            error = FW_ERR_STATE;
+            break;
+    }
+
+    status_out[0] = 0x80 | sub;
+    status_out[1] = error;
+    write_le<uint32_t>(value, &status_out[2]);
+    status_out[6] = 0;
+    status_out[7] = 0;
+    pending_op_ = FW_OP_NONE;
+    return true;
+}
@@ -0,0 +1,26 @@
+#ifndef __FW_UPDATE_HPP
+#define __FW_UPDATE_HPP
+
+#include <stdint.h>
+
+// In-application firmware update over CAN (see fw_update.cpp for the
+// frame format and the flash layout). The CAN RX interrupt feeds frames
+// to fw_update_handle_frame; the CAN server thread drives the flash work
+// through fw_update_poll and sends the returned status frames.
+
+// @brief Handles one firmware update command frame (opcode 7). Only does
+// RAM work, so it is safe in the RX interrupt. Returns true if the CAN
+// server thread should be woken to process a staged operation.
+bool fw_update_handle_frame(const uint8_t* data, uint8_t dlc);
+
+// @brief True while an update transfer is in progress. The CAN server
+// thread polls more often then, so flash operations start promptly.
+bool fw_update_active(void);
+
+// @brief Executes at most one staged flash operation (erase, row program,
+// verify or activate). Returns true if status_out was filled with a status
+// frame that should be sent to the host. Must only be called from thread
+// context: the erase and verify steps take many milliseconds.
+bool fw_update_poll(uint8_t status_out[8]);
+
+#endif // __FW_UPDATE_HPP
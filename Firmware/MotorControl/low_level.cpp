@@ -8,6 +8,7 @@
 #include <arm_math.h>
 
 #include <cmsis_os.h>
+#include <freertos_vars.h>
 #include <math.h>
 #include <stdint.h>
 #include <stdlib.h>
@@ -15,11 +16,13 @@
 #include <adc.h>
 #include <gpio.h>
 #include <main.h>
+#include <nvic_priorities.h>
 #include <spi.h>
 #include <tim.h>
 #include <utils.h>
 
 #include "odrive_main.h"
+#include "clock_sync.hpp"
 
 /* Private defines -----------------------------------------------------------*/
 
@@ -35,14 +38,44 @@ const float adc_ref_voltage = 3.3f;
 // This value is updated by the DC-bus reading ADC.
 // Arbitrary non-zero inital value to avoid division by zero if ADC reading is late
 float vbus_voltage = 12.0f;
+// Slope-extrapolated bus voltage for the modulation path (see
+// vbus_sense_adc_cb); protection thresholds use the raw value above.
+float vbus_voltage_pred = 12.0f;
+uint32_t nvic_audit_inversion_cnt = 0;
+// Initialized coherently with the initial vbus_voltage value above
+VbusConstants_t vbus_constants = {
+    .mod_to_V = (2.0f / 3.0f) * 12.0f,
+    .V_to_mod = 1.0f / ((2.0f / 3.0f) * 12.0f),
+    .inv_vbus_voltage = 1.0f / 12.0f,
+};
 bool brake_resistor_armed = false;
 /* Private constant data -----------------------------------------------------*/
+// Vbus slope extrapolation (see vbus_sense_adc_cb): one-pole filter gain on
+// the per-cycle voltage difference (~8 samples of history) and the lookahead
+// from the sample instant to when the derived timings hit the FETs.
+static const float vbus_slope_filter_k = 0.125f;
+static const float vbus_pred_horizon = 1.5f; // [PWM cycles]
 static const GPIO_TypeDef* GPIOs_to_samp[] = { GPIOA, GPIOB, GPIOC };
 static const int num_GPIO = sizeof(GPIOs_to_samp) / sizeof(GPIOs_to_samp[0]); 
 /* Private variables ---------------------------------------------------------*/
 
 // Two motors, sampling port A,B,C (coherent with current meas timing)
 static uint16_t GPIO_port_samples [2][num_GPIO];
+
+// Ports actually sampled, one bit per entry of GPIOs_to_samp. Registered
+// from Encoder::setup() based on the configured encoder modes; deployments
+// without hall sensors keep this empty and the sampling loop in
+// tim_update_cb is a no-op.
+static uint8_t GPIO_samp_port_mask = 0;
+
+// Per-axis DMA capture of the incremental encoder counter, triggered by the
+// PWM timer update event (TIM1_UP -> DMA2 stream 5 ch 6, TIM8_UP -> DMA2
+// stream 1 ch 7). The hardware copies CNT into a two-slot ring on every
+// update event, so the sample aligns to the PWM midpoint to the cycle with
+// no interrupt in the path; the current measurement ISR latches the newest
+// slot into the encoder (see pwm_trig_adc_cb).
+static DMA_HandleTypeDef enc_cnt_snapshot_dma_[AXIS_COUNT];
+static volatile uint16_t enc_cnt_snapshot_[AXIS_COUNT][2];
 /* CPU critical section helpers ----------------------------------------------*/
 
 /* Safety critical functions -------------------------------------------------*/
@@ -101,6 +134,7 @@ void safety_critical_arm_motor_pwm(Motor& motor) {
         motor.armed_state_ = Motor::ARMED_STATE_WAITING_FOR_TIMINGS;
     }
     cpu_exit_critical(mask);
+    tickless_note_motor_arm();
 }
 
 // @brief Disarms the motor PWM.
@@ -122,7 +156,7 @@ bool safety_critical_disarm_motor_pwm(Motor& motor) {
 // If this is called at a rate higher than the motor's timer period,
 // the actual PMW timings on the pins can be undefined for up to one
 // timer period.
-void safety_critical_apply_motor_pwm_timings(Motor& motor, uint16_t timings[3]) {
+RAMFUNC void safety_critical_apply_motor_pwm_timings(Motor& motor, uint16_t timings[3]) {
     uint32_t mask = cpu_enter_critical();
     if (!brake_resistor_armed) {
         motor.armed_state_ = Motor::ARMED_STATE_DISARMED;
@@ -158,6 +192,9 @@ void safety_critical_arm_brake_resistor() {
     brake_resistor_armed = true;
     htim2.Instance->CCR3 = 0;
     htim2.Instance->CCR4 = TIM_APB1_PERIOD_CLOCKS + 1;
+    // CCR3/4 are preloaded (see start_adc_pwm); latch the safe values now
+    // instead of at the next rollover
+    htim2.Instance->EGR = TIM_EGR_UG;
     cpu_exit_critical(mask);
 }
 
@@ -170,6 +207,10 @@ void safety_critical_disarm_brake_resistor() {
     brake_resistor_armed = false;
     htim2.Instance->CCR3 = 0;
     htim2.Instance->CCR4 = TIM_APB1_PERIOD_CLOCKS + 1;
+    // CCR3/4 are preloaded (see start_adc_pwm); force the safe values into
+    // the active registers immediately, disarming must not wait for the
+    // next rollover
+    htim2.Instance->EGR = TIM_EGR_UG;
     for (size_t i = 0; i < AXIS_COUNT; ++i) {
         safety_critical_disarm_motor_pwm(axes[i]->motor_);
     }
@@ -178,24 +219,117 @@ void safety_critical_disarm_brake_resistor() {
 
 // @brief Updates the brake resistor PWM timings unless
 // the brake resistor is disarmed.
-void safety_critical_apply_brake_resistor_timings(uint32_t low_off, uint32_t high_on) {
+RAMFUNC void safety_critical_apply_brake_resistor_timings(uint32_t low_off, uint32_t high_on) {
     if (high_on - low_off < TIM_APB1_DEADTIME_CLOCKS)
         low_level_fault(Motor::ERROR_BRAKE_DEADTIME_VIOLATION);
     uint32_t mask = cpu_enter_critical();
     if (brake_resistor_armed) {
-        // Safe update of low and high side timings
-        // To avoid race condition, first reset timings to safe state
-        // ch3 is low side, ch4 is high side
-        htim2.Instance->CCR3 = 0;
-        htim2.Instance->CCR4 = TIM_APB1_PERIOD_CLOCKS + 1;
+        // ch3 is low side, ch4 is high side.
+        // CCR3/4 are preloaded (see start_adc_pwm), so both compare values
+        // transfer to the active registers together at the update event:
+        // the timer can never run a period with one new and one old
+        // threshold, which is the race the old reset-to-safe-state double
+        // write protected against. The update event is suppressed across
+        // the two stores so it can't fire between them and latch a torn
+        // pair; a suppressed rollover only defers the transfer to the next
+        // one.
+        htim2.Instance->CR1 |= TIM_CR1_UDIS;
         htim2.Instance->CCR3 = low_off;
         htim2.Instance->CCR4 = high_on;
+        htim2.Instance->CR1 &= ~TIM_CR1_UDIS;
     }
     cpu_exit_critical(mask);
 }
 
 /* Function implementations --------------------------------------------------*/
 
+// @brief Arms the ADC analog watchdog on both current sense ADCs.
+//
+// The watchdog compares every phase current sample against a window around
+// mid-scale in hardware and fires ADC_IRQHandler on violation, so a gross
+// overcurrent floats the phases within one ADC conversion instead of one
+// control cycle later when FOC_current runs its software compare. Both
+// motors share each ADC and the watchdog has a single window, so the window
+// is sized for the motor with the larger linear range (from the trip levels
+// DRV8301_setup computed); the software compare in FOC_current stays as the
+// tighter per-axis check.
+static void arm_overcurrent_watchdog() {
+    float margin_counts = 0.0f;
+    for (size_t i = 0; i < AXIS_COUNT; ++i) {
+        Motor& motor = axes[i]->motor_;
+        // Inverse of phase_current_from_adcval's counts-to-amps scaling
+        float amps_per_count = (adc_ref_voltage / adc_full_scale)
+                             * motor.phase_current_rev_gain_
+                             * motor.hw_config_.shunt_conductance;
+        float trip_counts = motor.current_control_.overcurrent_trip_level / amps_per_count;
+        if (trip_counts > margin_counts)
+            margin_counts = trip_counts;
+    }
+
+    uint32_t mid_scale = 1u << 11;
+    uint32_t margin = (uint32_t)margin_counts;
+    uint32_t high = mid_scale + margin;
+    if (high > 0xFFFu)
+        high = 0xFFFu;
+    uint32_t low = (margin < mid_scale) ? (mid_scale - margin) : 0u;
+
+    ADC_AnalogWDGConfTypeDef awd_config;
+#if AXIS_COUNT >= 2
+    awd_config.WatchdogMode = ADC_ANALOGWATCHDOG_ALL_REGINJEC;
+#else
+    // Single-axis build: only the injected (M0) conversions carry currents
+    awd_config.WatchdogMode = ADC_ANALOGWATCHDOG_ALL_INJEC;
+#endif
+    awd_config.HighThreshold = high;
+    awd_config.LowThreshold = low;
+    awd_config.Channel = 0; // unused in all-channel mode
+    awd_config.ITMode = ENABLE;
+    awd_config.WatchdogNumber = 0;
+    HAL_ADC_AnalogWDGConfig(&hadc2, &awd_config);
+    HAL_ADC_AnalogWDGConfig(&hadc3, &awd_config);
+    __HAL_ADC_CLEAR_FLAG(&hadc2, ADC_FLAG_AWD);
+    __HAL_ADC_CLEAR_FLAG(&hadc3, ADC_FLAG_AWD);
+}
+
+// @brief Called from ADC_IRQHandler when the analog watchdog on one of the
+// current sense ADCs saw a sample outside the configured window: the
+// hardware overcurrent trip.
+void adc_analog_watchdog_cb(ADC_HandleTypeDef* hadc) {
+    (void) hadc; // both current sense ADCs share one trip action
+    low_level_fault(Motor::ERROR_CURRENT_SENSE_SATURATION);
+}
+
+// @brief Starts the per-axis encoder counter capture streams. Runs after
+// the axis objects exist (for the encoder timer mapping) so the capture is
+// in place before the PWM timers get their update DMA request enabled.
+static void start_encoder_snapshot_dma() {
+    static const struct {
+        DMA_Stream_TypeDef* stream;
+        uint32_t channel;
+        TIM_HandleTypeDef* pwm_timer;
+    } stream_map[] = {
+        { DMA2_Stream5, DMA_CHANNEL_6, &htim1 }, // TIM1_UP
+        { DMA2_Stream1, DMA_CHANNEL_7, &htim8 }, // TIM8_UP
+    };
+    for (size_t i = 0; i < AXIS_COUNT; ++i) {
+        DMA_HandleTypeDef* hdma = &enc_cnt_snapshot_dma_[i];
+        hdma->Instance = stream_map[i].stream;
+        hdma->Init.Channel = stream_map[i].channel;
+        hdma->Init.Direction = DMA_PERIPH_TO_MEMORY;
+        hdma->Init.PeriphInc = DMA_PINC_DISABLE;
+        hdma->Init.MemInc = DMA_MINC_ENABLE;
+        hdma->Init.PeriphDataAlignment = DMA_PDATAALIGN_HALFWORD;
+        hdma->Init.MemDataAlignment = DMA_MDATAALIGN_HALFWORD;
+        hdma->Init.Mode = DMA_CIRCULAR;
+        hdma->Init.Priority = DMA_PRIORITY_HIGH;
+        hdma->Init.FIFOMode = DMA_FIFOMODE_DISABLE;
+        HAL_DMA_Init(hdma);
+        HAL_DMA_Start(hdma, (uint32_t)&axes[i]->encoder_.hw_config_.timer->Instance->CNT,
+                      (uint32_t)&enc_cnt_snapshot_[i][0], 2);
+        __HAL_TIM_ENABLE_DMA(stream_map[i].pwm_timer, TIM_DMA_UPDATE);
+    }
+}
+
 void start_adc_pwm() {
     // Enable ADC and interrupts
     __HAL_ADC_ENABLE(&hadc1);
@@ -206,16 +340,25 @@ void start_adc_pwm() {
     __HAL_ADC_ENABLE_IT(&hadc1, ADC_IT_JEOC);
     __HAL_ADC_ENABLE_IT(&hadc2, ADC_IT_JEOC);
     __HAL_ADC_ENABLE_IT(&hadc3, ADC_IT_JEOC);
+#if AXIS_COUNT >= 2
+    // The regular (EOC) conversions carry the M1 current samples
     __HAL_ADC_ENABLE_IT(&hadc2, ADC_IT_EOC);
     __HAL_ADC_ENABLE_IT(&hadc3, ADC_IT_EOC);
+#endif
+    // Hardware overcurrent trip (the DRV amp gains were set up by now)
+    arm_overcurrent_watchdog();
 
     // Ensure that debug halting of the core doesn't leave the motor PWM running
     __HAL_DBGMCU_FREEZE_TIM1();
     __HAL_DBGMCU_FREEZE_TIM8();
 
     start_pwm(&htim1);
+#if AXIS_COUNT >= 2
     start_pwm(&htim8);
+#endif
     // TODO: explain why this offset
+    // (TIM8 stays the sync slave even in single-axis builds so that TIM13,
+    // the reference timebase, keeps its usual phase relation to TIM1)
     sync_timers(&htim1, &htim8, TIM_CLOCKSOURCE_ITR0, TIM_1_8_PERIOD_CLOCKS / 2 - 1 * 128,
             &htim13);
 
@@ -223,13 +366,29 @@ void start_adc_pwm() {
     __HAL_TIM_MOE_DISABLE_UNCONDITIONALLY(&htim1);
     __HAL_TIM_MOE_DISABLE_UNCONDITIONALLY(&htim8);
 
-    // Enable the update interrupt (used to coherently sample GPIO)
-    __HAL_TIM_ENABLE_IT(&htim1, TIM_IT_UPDATE);
-    __HAL_TIM_ENABLE_IT(&htim8, TIM_IT_UPDATE);
+    // The incremental encoder count is captured by DMA on the same update
+    // event; the update interrupt is only needed when a configured encoder
+    // requires software work there (hall GPIO sampling, SPI kick-off).
+    // Encoder::setup() has run by this point so the need is known; encoder
+    // mode changes require a reboot anyway.
+    start_encoder_snapshot_dma();
+    bool update_irq_needed = GPIO_samp_port_mask != 0;
+    for (size_t i = 0; i < AXIS_COUNT; ++i)
+        update_irq_needed |= axes[i]->encoder_.is_abs_spi_mode();
+    if (update_irq_needed) {
+        __HAL_TIM_ENABLE_IT(&htim1, TIM_IT_UPDATE);
+#if AXIS_COUNT >= 2
+        __HAL_TIM_ENABLE_IT(&htim8, TIM_IT_UPDATE);
+#endif
+    }
 
-    // Start brake resistor PWM in floating output configuration
+    // Start brake resistor PWM in floating output configuration.
+    // CCR3/4 preload is enabled so that later timing updates latch as a
+    // coherent pair at the update event
+    // (see safety_critical_apply_brake_resistor_timings).
     htim2.Instance->CCR3 = 0;
     htim2.Instance->CCR4 = TIM_APB1_PERIOD_CLOCKS + 1;
+    htim2.Instance->CCMR2 |= TIM_CCMR2_OC3PE | TIM_CCMR2_OC4PE;
     HAL_TIM_PWM_Start(&htim2, TIM_CHANNEL_3);
     HAL_TIM_PWM_Start(&htim2, TIM_CHANNEL_4);
 
@@ -373,7 +532,18 @@ void start_general_purpose_adc() {
 //  21000kHz / (15+26) / 16 = 32kHz
 // The true frequency is slightly lower because of the injected vbus
 // measurements
+static uint32_t get_adc1_channel(GPIO_TypeDef* GPIO_port, uint16_t GPIO_pin);
 float get_adc_voltage(GPIO_TypeDef* GPIO_port, uint16_t GPIO_pin) {
+    uint32_t channel = get_adc1_channel(GPIO_port, GPIO_pin);
+    if (channel < ADC_CHANNEL_COUNT)
+        return ((float)adc_measurements_[channel]) * (adc_ref_voltage / adc_full_scale);
+    else
+        return 0.0f / 0.0f; // NaN
+}
+
+// @brief Returns the ADC1 channel associated with the specified pin,
+// or UINT32_MAX if the pin has no associated ADC1 channel.
+static uint32_t get_adc1_channel(GPIO_TypeDef* GPIO_port, uint16_t GPIO_pin) {
     uint32_t channel = UINT32_MAX;
     if (GPIO_port == GPIOA) {
         if (GPIO_pin == GPIO_PIN_0)
@@ -411,62 +581,163 @@ float get_adc_voltage(GPIO_TypeDef* GPIO_port, uint16_t GPIO_pin) {
         else if (GPIO_pin == GPIO_PIN_5)
             channel = 15;
     }
-    if (channel < ADC_CHANNEL_COUNT)
-        return ((float)adc_measurements_[channel]) * (adc_ref_voltage / adc_full_scale);
-    else
-        return 0.0f / 0.0f; // NaN
+    return channel;
+}
+
+// Destinations for the sin/cos encoder samples taken on ranks 2 and 3 of
+// the ADC1 injected sequence. Written by vbus_sense_adc_cb, registered by
+// arm_sincos_injected_sampling (nullptr = no sin/cos encoder configured).
+static float* sincos_sample_s_dest_ = nullptr;
+static float* sincos_sample_c_dest_ = nullptr;
+
+// @brief Extends the ADC1 injected sequence (vbus, triggered by TIM1 at
+// the PWM midpoint) with the sin/cos encoder pair on GPIO_3/GPIO_4, so the
+// analog encoder is sampled synchronously with the current measurement
+// instead of riding the ~32kHz round-robin regular sequence. The results
+// are normalized to [-0.5, 0.5] and stored to the given destinations from
+// the injected-conversion-complete interrupt, well before the control
+// thread consumes them.
+// Must be called before start_adc_pwm() enables the trigger.
+// Returns false if either pin has no ADC1 channel.
+bool arm_sincos_injected_sampling(float* sample_s_dest, float* sample_c_dest) {
+    uint32_t sin_channel = get_adc1_channel(GPIO_3_GPIO_Port, GPIO_3_Pin);
+    uint32_t cos_channel = get_adc1_channel(GPIO_4_GPIO_Port, GPIO_4_Pin);
+    if (sin_channel == UINT32_MAX || cos_channel == UINT32_MAX)
+        return false;
+
+    ADC_InjectionConfTypeDef sConfigInjected;
+    sConfigInjected.InjectedNbrOfConversion = 3;
+    sConfigInjected.InjectedSamplingTime = ADC_SAMPLETIME_15CYCLES;
+    sConfigInjected.ExternalTrigInjecConvEdge = ADC_EXTERNALTRIGINJECCONVEDGE_RISING;
+    sConfigInjected.ExternalTrigInjecConv = ADC_EXTERNALTRIGINJECCONV_T1_TRGO;
+    sConfigInjected.AutoInjectedConv = DISABLE;
+    sConfigInjected.InjectedDiscontinuousConvMode = DISABLE;
+    sConfigInjected.InjectedOffset = 0;
+    // vbus stays at rank 1 (see MX_ADC1_Init)
+    sConfigInjected.InjectedChannel = ADC_CHANNEL_6;
+    sConfigInjected.InjectedRank = 1;
+    if (HAL_ADCEx_InjectedConfigChannel(&hadc1, &sConfigInjected) != HAL_OK)
+        return false;
+    sConfigInjected.InjectedChannel = sin_channel;
+    sConfigInjected.InjectedRank = 2;
+    if (HAL_ADCEx_InjectedConfigChannel(&hadc1, &sConfigInjected) != HAL_OK)
+        return false;
+    sConfigInjected.InjectedChannel = cos_channel;
+    sConfigInjected.InjectedRank = 3;
+    if (HAL_ADCEx_InjectedConfigChannel(&hadc1, &sConfigInjected) != HAL_OK)
+        return false;
+
+    sincos_sample_s_dest_ = sample_s_dest;
+    sincos_sample_c_dest_ = sample_c_dest;
+    return true;
 }
 
 //--------------------------------
 // IRQ Callbacks
 //--------------------------------
 
-void vbus_sense_adc_cb(ADC_HandleTypeDef* hadc, bool injected) {
+RAMFUNC void vbus_sense_adc_cb(ADC_HandleTypeDef* hadc, bool injected) {
     static const float voltage_scale = adc_ref_voltage * VBUS_S_DIVIDER_RATIO / adc_full_scale;
-    // Only one conversion in sequence, so only rank1
+    // vbus is on rank 1 of the injected sequence
     uint32_t ADCValue = HAL_ADCEx_InjectedGetValue(hadc, ADC_INJECTED_RANK_1);
     vbus_voltage = ADCValue * voltage_scale;
-    if (axes[0] && !axes[0]->error_ && axes[1] && !axes[1]->error_) {
-        if (oscilloscope_pos >= OSCILLOSCOPE_SIZE)
-            oscilloscope_pos = 0;
-        oscilloscope[oscilloscope_pos++] = vbus_voltage;
+    // The timings derived from this sample are applied to the FETs about
+    // one PWM cycle later. Under steady bus that lag is irrelevant, but a
+    // regen transient can slew vbus fast enough that the modulation (and
+    // the brake duty, which must dissipate at the voltage actually present)
+    // is computed against a stale bus. Extrapolate along a one-pole
+    // filtered slope to the application instant; the filter suppresses the
+    // per-sample ADC noise that a raw difference would amplify.
+    static float vbus_prev = 0.0f;
+    static float vbus_slope = 0.0f; // [V/cycle]
+    if (vbus_prev == 0.0f)
+        vbus_prev = vbus_voltage; // first sample: no history for a slope
+    vbus_slope += vbus_slope_filter_k * ((vbus_voltage - vbus_prev) - vbus_slope);
+    vbus_prev = vbus_voltage;
+    vbus_voltage_pred = vbus_voltage + vbus_slope * vbus_pred_horizon;
+    // The extrapolation must never drive the modulation constants towards
+    // a division blowup on a spurious slope
+    if (vbus_voltage_pred < 0.5f * vbus_voltage)
+        vbus_voltage_pred = 0.5f * vbus_voltage;
+    // Refresh the vbus-derived constants once per cycle so the current
+    // control hot path doesn't have to divide. These use the predicted
+    // voltage; protection thresholds (axis do_checks, brake resistor
+    // saturation) keep reading the raw vbus_voltage.
+    float mod_to_V = (2.0f / 3.0f) * vbus_voltage_pred;
+    vbus_constants.mod_to_V = mod_to_V;
+    vbus_constants.V_to_mod = 1.0f / mod_to_V;
+    vbus_constants.inv_vbus_voltage = 1.0f / vbus_voltage_pred;
+    // Sin/cos encoder samples ride ranks 2 and 3 of the same sequence
+    // (see arm_sincos_injected_sampling)
+    if (sincos_sample_s_dest_) {
+        *sincos_sample_s_dest_ = ((float)HAL_ADCEx_InjectedGetValue(hadc, ADC_INJECTED_RANK_2) / adc_full_scale) - 0.5f;
+        *sincos_sample_c_dest_ = ((float)HAL_ADCEx_InjectedGetValue(hadc, ADC_INJECTED_RANK_3) / adc_full_scale) - 0.5f;
     }
 }
 
-static void decode_hall_samples(Encoder& enc, uint16_t GPIO_samples[num_GPIO]) {
-    GPIO_TypeDef* hall_ports[] = {
-        enc.hw_config_.hallC_port,
-        enc.hw_config_.hallB_port,
-        enc.hw_config_.hallA_port,
-    };
-    uint16_t hall_pins[] = {
-        enc.hw_config_.hallC_pin,
-        enc.hw_config_.hallB_pin,
-        enc.hw_config_.hallA_pin,
-    };
+// @brief Returns the index of the given port in the set of GPIO ports that
+// are sampled coherently with the current measurement, or -1 if the port
+// is not sampled.
+int get_gpio_samp_port_index(const GPIO_TypeDef* GPIO_port) {
+    for (int i = 0; i < num_GPIO; ++i) {
+        if (GPIOs_to_samp[i] == GPIO_port)
+            return i;
+    }
+    return -1;
+}
 
+// @brief Adds a port to the set that tim_update_cb samples coherently with
+// the current measurement. Unknown ports are ignored.
+void gpio_samp_add_port(const GPIO_TypeDef* GPIO_port) {
+    int idx = get_gpio_samp_port_index(GPIO_port);
+    if (idx >= 0)
+        GPIO_samp_port_mask |= (uint8_t)(1 << idx);
+}
+
+// The port-index/pin-mask mapping is resolved once in Encoder::setup(),
+// so this only does three masked loads in the ADC callback.
+static RAMFUNC void decode_hall_samples(Encoder& enc, uint16_t GPIO_samples[num_GPIO]) {
     uint8_t hall_state = 0x0;
     for (int i = 0; i < 3; ++i) {
-        int port_idx = 0;
-        for (;;) {
-            auto port = GPIOs_to_samp[port_idx];
-            if (port == hall_ports[i])
-                break;
-            ++port_idx;
-        }
-
         hall_state <<= 1;
-        hall_state |= (GPIO_samples[port_idx] & hall_pins[i]) ? 1 : 0;
+        hall_state |= (GPIO_samples[enc.hall_port_idx_[i]] & enc.hall_pin_mask_[i]) ? 1 : 0;
     }
 
     enc.hall_state_ = hall_state;
 }
 
+// @brief Returns the newest slot of the encoder counter capture ring. NDTR
+// counts down as the stream fills slot 0 then slot 1, so it identifies the
+// slot the last update event wrote. With RCR = 2 the update events
+// alternate between SVM vector 0 and vector 7, so read from the current
+// measurement ISR the newest slot is always this cycle's vector 0 sample.
+static RAMFUNC int16_t enc_cnt_snapshot_latest(int axis_num) {
+    DMA_Stream_TypeDef* stream = enc_cnt_snapshot_dma_[axis_num].Instance;
+    return (int16_t)enc_cnt_snapshot_[axis_num][(stream->NDTR == 1) ? 0 : 1];
+}
+
+// PWM timer counters as sampled at ADC_IRQHandler entry, before any
+// dispatch work. Indexed like axes[] (TIM1 for M0, TIM8 for M1).
+static struct {
+    uint32_t cnt[2];
+    bool counting_down[2];
+} adc_irq_snapshot_;
+
+// @brief Called first thing in ADC_IRQHandler so the latency figure in
+// pwm_trig_adc_cb excludes the handler's own dispatch overhead.
+RAMFUNC void adc_irq_entry_snapshot(void) {
+    adc_irq_snapshot_.cnt[0] = htim1.Instance->CNT;
+    adc_irq_snapshot_.counting_down[0] = htim1.Instance->CR1 & TIM_CR1_DIR;
+    adc_irq_snapshot_.cnt[1] = htim8.Instance->CNT;
+    adc_irq_snapshot_.counting_down[1] = htim8.Instance->CR1 & TIM_CR1_DIR;
+}
+
 // This is the callback from the ADC that we expect after the PWM has triggered an ADC conversion.
 // TODO: Document how the phasing is done, link to timing diagram
-void pwm_trig_adc_cb(ADC_HandleTypeDef* hadc, bool injected) {
-#define calib_tau 0.2f  //@TOTO make more easily configurable
+RAMFUNC void pwm_trig_adc_cb(ADC_HandleTypeDef* hadc, bool injected) {
+#define calib_tau CALIB_TAU // defined in low_level.h so the boot code can size its settle delay
     static const float calib_filter_k = CURRENT_MEAS_PERIOD / calib_tau;
+    uint32_t profiler_start = Profiler::enter();
 
     // Ensure ADCs are expected ones to simplify the logic below
     if (!(hadc == &hadc2 || hadc == &hadc3)) {
@@ -478,12 +749,44 @@ void pwm_trig_adc_cb(ADC_HandleTypeDef* hadc, bool injected) {
     // Motor 1 is on Timer 8, which triggers ADC 2 and 3 on a regular conversion
     // If the corresponding timer is counting up, we just sampled in SVM vector 0, i.e. real current
     // If we are counting down, we just sampled in SVM vector 7, with zero current
+#if AXIS_COUNT >= 2
     Axis& axis = injected ? *axes[0] : *axes[1];
     int axis_num = injected ? 0 : 1;
     Axis& other_axis = injected ? *axes[1] : *axes[0];
+#else
+    // Single-axis build: the regular (M1) conversion interrupts are never
+    // enabled, and M0 applies its own timings at the vector 7 sample.
+    if (!injected) {
+        low_level_fault(Motor::ERROR_ADC_FAILED);
+        return;
+    }
+    Axis& axis = *axes[0];
+    int axis_num = 0;
+    Axis& other_axis = *axes[0];
+#endif
     bool counting_down = axis.motor_.hw_config_.timer->Instance->CR1 & TIM_CR1_DIR;
     bool current_meas_not_DC_CAL = !counting_down;
 
+    // Trigger-to-entry interrupt latency watermark (ADC2 is dispatched
+    // first, so record once per trigger event). The sample trigger fired at
+    // this timer's last counter reversal - the valley when counting up, the
+    // peak when counting down - so the counter distance from that point is
+    // the latency in timer clocks (equal to CPU cycles), including the ADC
+    // conversion time and whatever PRIMASK section delayed the IRQ.
+    if (hadc == &hadc2) {
+        uint32_t latency = adc_irq_snapshot_.counting_down[axis_num]
+                         ? (TIM_1_8_PERIOD_CLOCKS - adc_irq_snapshot_.cnt[axis_num])
+                         : adc_irq_snapshot_.cnt[axis_num];
+        profiler_.record(PROFILER_STAGE_ADC_IRQ_LATENCY, latency);
+        // NVIC partition audit: with the comm tier strictly below this
+        // handler's priority, a latency beyond the budget means something
+        // at or above our level (or a PRIMASK section) held us off - a
+        // priority inversion worth investigating before raising the loop
+        // rate.
+        if (latency > NVIC_AUDIT_ADC_LATENCY_BUDGET)
+            ++nvic_audit_inversion_cnt;
+    }
+
     // Check the timing of the sequencing
     if (current_meas_not_DC_CAL)
         axis.motor_.log_timing(Motor::TIMING_LOG_ADC_CB_I);
@@ -491,29 +794,76 @@ void pwm_trig_adc_cb(ADC_HandleTypeDef* hadc, bool injected) {
         axis.motor_.log_timing(Motor::TIMING_LOG_ADC_CB_DC);
 
     bool update_timings = false;
+    // Work shared by both axes (currently the brake resistor duty) runs on
+    // exactly one of the per-period trigger events instead of per axis.
+    bool shared_period_work = false;
     if (hadc == &hadc2) {
-        if (&axis == axes[1] && counting_down)
+#if AXIS_COUNT >= 2
+        if (&axis == axes[1] && counting_down) {
             update_timings = true; // update timings of M0
-        else if (&axis == axes[0] && !counting_down)
+            shared_period_work = true;
+        } else if (&axis == axes[0] && !counting_down) {
             update_timings = true; // update timings of M1
+        }
+#else
+        if (counting_down) {
+            update_timings = true; // update timings of M0 at its own vector 7 sample
+            shared_period_work = true;
+        }
+#endif
     }
 
     // Load next timings for the motor that we're not currently sampling
     if (update_timings) {
         if (!other_axis.motor_.next_timings_valid_) {
-            // the motor control loop failed to update the timings in time
-            // we must assume that it died and therefore float all phases
-            bool was_armed = safety_critical_disarm_motor_pwm(other_axis.motor_);
-            if (was_armed) {
-                other_axis.motor_.error_ |= Motor::ERROR_CONTROL_DEADLINE_MISSED;
+            // The motor control loop failed to update the timings in time.
+            // Configurably tolerate a bounded number of consecutive misses
+            // by holding the previous PWM timings for one more cycle (the
+            // timer keeps its compare values when we don't reload them);
+            // past the tolerance we must assume the loop died and float
+            // all phases.
+            if (other_axis.motor_.consecutive_deadline_misses_
+                    < other_axis.motor_.config_.deadline_miss_tolerance) {
+                ++other_axis.motor_.consecutive_deadline_misses_;
+                ++other_axis.motor_.deadline_near_miss_count_;
+            } else {
+                bool was_armed = safety_critical_disarm_motor_pwm(other_axis.motor_);
+                if (was_armed) {
+                    other_axis.motor_.error_ |= Motor::ERROR_CONTROL_DEADLINE_MISSED;
+                }
             }
         } else {
             other_axis.motor_.next_timings_valid_ = false;
+            other_axis.motor_.consecutive_deadline_misses_ = 0;
             safety_critical_apply_motor_pwm_timings(
                 other_axis.motor_, other_axis.motor_.next_timings_
             );
         }
+    }
+
+    // The brake duty sums the Ibus of both motors, so recomputing it on
+    // both per-axis timing events was pure duplication: once per PWM
+    // period each motor's contribution is at most half a period old.
+    if (shared_period_work) {
         update_brake_current();
+        // distributed clock: trim the PWM period towards the master grid
+        clock_sync_update();
+        // analog input mappings, served from the ADC1 DMA buffer
+        update_analog_inputs();
+    }
+
+    if (!current_meas_not_DC_CAL) {
+        // The DC offset only drifts on a thermal timescale, so the vector 7
+        // samples may be decimated: only one in config_.dc_calib_decimation
+        // of them is processed and the rest of the ISR work is skipped.
+        // (These samples are taken with the low side FETs off, so they can
+        // never carry real phase current on this board.)
+        if (hadc == &hadc2) { // ADC2 is dispatched first; advance once per cycle
+            if (++axis.motor_.dc_calib_cycle_ >= axis.motor_.config_.dc_calib_decimation)
+                axis.motor_.dc_calib_cycle_ = 0;
+        }
+        if (axis.motor_.dc_calib_cycle_ != 0)
+            return;
     }
 
     uint32_t ADCValue;
@@ -522,6 +872,11 @@ void pwm_trig_adc_cb(ADC_HandleTypeDef* hadc, bool injected) {
     } else {
         ADCValue = HAL_ADC_GetValue(hadc);
     }
+    // Raw ADC burst capture for current sensor commissioning: record the
+    // unprocessed counts before any scaling or DC offset subtraction.
+    if (current_meas_not_DC_CAL)
+        osc_.sample_raw_adc(axis_num, hadc == &hadc2, ADCValue);
+
     float current = axis.motor_.phase_current_from_adcval(ADCValue);
 
     if (current_meas_not_DC_CAL) {
@@ -531,29 +886,63 @@ void pwm_trig_adc_cb(ADC_HandleTypeDef* hadc, bool injected) {
         // Therefore we store the value from ADC2 and signal the thread that the
         // measurement is ready when we receive the ADC3 measurement
 
+        // While a shunt amplifier gain change settles the ADC counts don't
+        // correspond to any valid gain: hold the previous sample instead of
+        // storing a garbage conversion (see Motor::set_shunt_amp_gain).
+        bool blank_sample = axis.motor_.current_meas_blank_cycles_ != 0;
+
         // return or continue
         if (hadc == &hadc2) {
-            axis.motor_.current_meas_.phB = current - axis.motor_.DC_calib_.phB;
+            if (!blank_sample)
+                axis.motor_.current_meas_.phB = current - axis.motor_.DC_calib_.phB;
             return;
         } else {
-            axis.motor_.current_meas_.phC = current - axis.motor_.DC_calib_.phC;
+            if (!blank_sample)
+                axis.motor_.current_meas_.phC = current - axis.motor_.DC_calib_.phC;
+            else
+                --axis.motor_.current_meas_blank_cycles_;
         }
         // Prepare hall readings
         // TODO move this to inside encoder update function
         decode_hall_samples(axis.encoder_, GPIO_port_samples[axis_num]);
+        // Latch the DMA-captured encoder count from this cycle's vector 0
+        // update event (exactly the current measurement instant).
+        if (axis.encoder_.config_.mode == Encoder::MODE_INCREMENTAL)
+            axis.encoder_.tim_cnt_sample_ = enc_cnt_snapshot_latest(axis_num);
+        // Run the fast current control path in interrupt context if configured.
+        // The slow path (do_checks, watchdog, state machine) stays on the
+        // axis thread, which is signalled below as usual.
+        if (axis.motor_.config_.current_control_in_isr
+            && axis.motor_.armed_state_ != Motor::ARMED_STATE_DISARMED) {
+            axis.motor_.FOC_update_isr();
+        }
+        // Record oscilloscope channels, blackbox and telemetry once per control cycle
+        if (axis_num == 0) {
+            osc_.sample();
+            blackbox_.sample();
+            telemetry_.sample();
+            watch_.sample();
+        }
         // Trigger axis thread
         axis.signal_current_meas();
+        profiler_.leave(PROFILER_STAGE_ADC_CB, profiler_start);
     } else {
         // DC_CAL measurement
+        // Scale the filter gain by the decimation so the effective time
+        // constant stays at calib_tau regardless of the sample rate.
+        float decimated_filter_k = calib_filter_k * (float)axis.motor_.config_.dc_calib_decimation;
+        // Don't fold gain-change settling transients into the offset filter
+        if (axis.motor_.current_meas_blank_cycles_ != 0)
+            return;
         if (hadc == &hadc2) {
-            axis.motor_.DC_calib_.phB += (current - axis.motor_.DC_calib_.phB) * calib_filter_k;
+            axis.motor_.DC_calib_.phB += (current - axis.motor_.DC_calib_.phB) * decimated_filter_k;
         } else {
-            axis.motor_.DC_calib_.phC += (current - axis.motor_.DC_calib_.phC) * calib_filter_k;
+            axis.motor_.DC_calib_.phC += (current - axis.motor_.DC_calib_.phC) * decimated_filter_k;
         }
     }
 }
 
-void tim_update_cb(TIM_HandleTypeDef* htim) {
+RAMFUNC void tim_update_cb(TIM_HandleTypeDef* htim) {
     
     // If the corresponding timer is counting up, we just sampled in SVM vector 0, i.e. real current
     // If we are counting down, we just sampled in SVM vector 7, with zero current
@@ -566,9 +955,11 @@ void tim_update_cb(TIM_HandleTypeDef* htim) {
     if (htim == &htim1) {
         sample_ch = 0;
         axis = axes[0];
+#if AXIS_COUNT >= 2
     } else if (htim == &htim8) {
         sample_ch = 1;
         axis = axes[1];
+#endif
     } else {
         low_level_fault(Motor::ERROR_UNEXPECTED_TIMER_CALLBACK);
         return;
@@ -576,24 +967,56 @@ void tim_update_cb(TIM_HandleTypeDef* htim) {
 
     axis->encoder_.sample_now();
 
-    for (int i = 0; i < num_GPIO; ++i) {
-        GPIO_port_samples[sample_ch][i] = GPIOs_to_samp[i]->IDR;
+    // Only the ports registered by the configured encoders are read; an
+    // empty set costs a single load and compare.
+    uint8_t mask = GPIO_samp_port_mask;
+    for (int i = 0; mask; ++i, mask >>= 1) {
+        if (mask & 1)
+            GPIO_port_samples[sample_ch][i] = GPIOs_to_samp[i]->IDR;
     }
 }
 
+// Regen energy accounting, exposed on the protocol (see communication.cpp)
+float regen_energy_absorbed = 0.0f;   // [J] returned to the supply/battery
+float brake_energy_dissipated = 0.0f; // [J] chopped into the brake resistor
+// Latched by the voltage hysteresis band below
+static bool brake_chop_forced = false;
+
 // @brief Sums up the Ibus contribution of each motor and updates the
-// brake resistor PWM accordingly.
-void update_brake_current() {
+// brake resistor PWM accordingly. Regen up to regen_current_allowed is
+// left on the bus for the supply/battery to absorb; only the excess is
+// chopped into the resistor. A hysteresis band below the overvoltage trip
+// level overrides the dispatch: a rising bus means the sink is not
+// actually absorbing, so everything goes to the resistor until the
+// voltage recovers.
+RAMFUNC void update_brake_current() {
     float Ibus_sum = 0.0f;
     for (size_t i = 0; i < AXIS_COUNT; ++i) {
         if (axes[i]->motor_.armed_state_ == Motor::ARMED_STATE_ARMED) {
             Ibus_sum += axes[i]->motor_.current_control_.Ibus;
         }
     }
-    float brake_current = -Ibus_sum;
+    float regen_current = -Ibus_sum;
     // Clip negative values to 0.0f
-    if (brake_current < 0.0f) brake_current = 0.0f;
-    float brake_duty = brake_current * board_config.brake_resistance / vbus_voltage;
+    if (regen_current < 0.0f) regen_current = 0.0f;
+
+    float vtrip = board_config.dc_bus_overvoltage_trip_level;
+    if (vbus_voltage > vtrip - board_config.regen_hysteresis_engage)
+        brake_chop_forced = true;
+    else if (vbus_voltage < vtrip - board_config.regen_hysteresis_release)
+        brake_chop_forced = false;
+
+    float brake_current = regen_current;
+    if (!brake_chop_forced) {
+        brake_current -= board_config.regen_current_allowed;
+        if (brake_current < 0.0f) brake_current = 0.0f;
+    }
+
+    // Energy counters; this runs once per PWM period
+    regen_energy_absorbed += (regen_current - brake_current) * vbus_voltage * current_meas_period;
+    brake_energy_dissipated += brake_current * vbus_voltage * current_meas_period;
+
+    float brake_duty = brake_current * board_config.brake_resistance * vbus_constants.inv_vbus_voltage;
 
     // Duty limit at 90% to allow bootstrap caps to charge
     // If brake_duty is NaN, this expression will also evaluate to false
@@ -611,26 +1034,6 @@ void update_brake_current() {
 
 /* RC PWM input --------------------------------------------------------------*/
 
-// @brief Returns the ODrive GPIO number for a given
-// TIM2 or TIM5 input capture channel number.
-int tim_2_5_channel_num_to_gpio_num(int channel) {
-#if HW_VERSION_MAJOR == 3 && HW_VERSION_MINOR >= 3
-    if (channel >= 1 && channel <= 4) {
-        // the channel numbers just happen to coincide with
-        // the GPIO numbers
-        return channel;
-    } else {
-        return -1;
-    }
-#else
-    // Only ch4 is available on v3.2
-    if (channel == 4) {
-        return 4;
-    } else {
-        return -1;
-    }
-#endif
-}
 // @brief Returns the TIM2 or TIM5 channel number
 // for a given GPIO number.
 uint32_t gpio_num_to_tim_2_5_channel(int gpio_num) {
@@ -652,6 +1055,72 @@ uint32_t gpio_num_to_tim_2_5_channel(int gpio_num) {
 #endif
 }
 
+// The edge timestamps are captured by DMA into a small circular buffer
+// per channel and decoded in batches by a low priority thread, so the RC
+// PWM inputs cost zero interrupts: the old per-edge TIM5 interrupt (with
+// a GPIO read inside the handler) added load and jitter proportional to
+// the input frequency, which with four channels at flight-controller
+// rates (400Hz, both edges) was 3200 interrupts per second.
+//
+// TIM5 CCx DMA requests land on DMA1 channel 6: CH1 -> Stream2,
+// CH2 -> Stream4, CH3 -> Stream0, CH4 -> Stream1. Streams 2/4 belong to
+// UART4, but GPIO1/2 are the UART pins, so the UART and those PWM inputs
+// can never be active at the same time (enforced below). Stream0 is
+// linked to SPI3/I2C1 RX by the generated MspInit code, but neither ever
+// starts a DMA transfer in this firmware (the DRV8301 driver uses
+// blocking SPI, the I2C slave runs in interrupt mode) and their init
+// runs at boot, before this, so the stream is free at runtime.
+#define PWM_IN_CHANNEL_COUNT 4
+#define PWM_IN_RING_SIZE 16 // power of two; at 400Hz input and a 5ms
+                            // decode period a batch is 4 edges, so the
+                            // ring tolerates several missed decode slots
+#define PWM_IN_DECODE_PERIOD_MS 5
+static uint32_t pwm_in_ring_[PWM_IN_CHANNEL_COUNT][PWM_IN_RING_SIZE];
+static struct {
+    DMA_Stream_TypeDef* stream = nullptr; // nullptr = channel not active
+    uint32_t read_index = 0;    // next unconsumed ring entry
+    uint32_t last_rising = 0;   // timestamp of the last rising edge
+    bool last_rising_valid = false;
+} pwm_in_state_[PWM_IN_CHANNEL_COUNT];
+
+static void pwm_in_decode_thread(void *);
+
+static DMA_Stream_TypeDef* pwm_in_dma_stream(int gpio_num) {
+    switch (gpio_num) {
+        case 1: return DMA1_Stream2;
+        case 2: return DMA1_Stream4;
+        case 3: return DMA1_Stream0;
+        case 4: return DMA1_Stream1;
+        default: return nullptr;
+    }
+}
+
+// @brief Sets up one DMA stream to copy TIM5->CCRx into the channel's
+// ring buffer in circular mode. Register-level because these streams have
+// no HAL handles of their own (and need none: circular mode runs forever
+// without any interrupt).
+static void pwm_in_config_dma(DMA_Stream_TypeDef* stream, int gpio_num, uint32_t tim_channel) {
+    __HAL_RCC_DMA1_CLK_ENABLE();
+    stream->CR &= ~DMA_SxCR_EN;
+    while (stream->CR & DMA_SxCR_EN);
+    // clear the stream's event flags (streams 0-3 -> LIFCR, 4-7 -> HIFCR)
+    static const uint8_t flag_shift[4] = { 0, 6, 16, 22 };
+    uint32_t stream_num = ((uint32_t)stream - (uint32_t)DMA1_Stream0) / sizeof(DMA_Stream_TypeDef);
+    uint32_t flag_mask = 0x3Du << flag_shift[stream_num & 3];
+    if (stream_num < 4)
+        DMA1->LIFCR = flag_mask;
+    else
+        DMA1->HIFCR = flag_mask;
+    stream->PAR = (uint32_t)&htim5.Instance->CCR1 + (tim_channel & 0x1C); // TIM_CHANNEL_x = 4*(x-1)
+    stream->M0AR = (uint32_t)pwm_in_ring_[gpio_num - 1];
+    stream->NDTR = PWM_IN_RING_SIZE;
+    stream->FCR = 0; // direct mode
+    stream->CR = (6u << DMA_SxCR_CHSEL_Pos) // TIM5 request channel
+               | DMA_SxCR_MSIZE_1 | DMA_SxCR_PSIZE_1 // 32-bit transfers
+               | DMA_SxCR_MINC | DMA_SxCR_CIRC;
+    stream->CR |= DMA_SxCR_EN;
+}
+
 void pwm_in_init() {
     GPIO_InitTypeDef GPIO_InitStruct;
     GPIO_InitStruct.Mode = GPIO_MODE_AF_PP;
@@ -665,19 +1134,34 @@ void pwm_in_init() {
     sConfigIC.ICPrescaler = TIM_ICPSC_DIV1;
     sConfigIC.ICFilter = 15;
 
+    bool any_channel_active = false;
 #if HW_VERSION_MAJOR == 3 && HW_VERSION_MINOR >= 3
     for (int gpio_num = 1; gpio_num <= 4; ++gpio_num) {
 #else
     int gpio_num = 4; {
 #endif
-        if (is_endpoint_ref_valid(board_config.pwm_mappings[gpio_num - 1].endpoint)) {
+        // GPIO1/2 double as the UART pins and their DMA streams as the
+        // UART DMA streams, so those channels require the UART to be off.
+        bool conflicts_with_uart = (gpio_num <= 2) && board_config.enable_uart;
+        if (!conflicts_with_uart &&
+            is_endpoint_ref_valid(board_config.pwm_mappings[gpio_num - 1].endpoint)) {
+            uint32_t tim_channel = gpio_num_to_tim_2_5_channel(gpio_num);
             GPIO_InitStruct.Pin = get_gpio_pin_by_pin(gpio_num);
             HAL_GPIO_DeInit(get_gpio_port_by_pin(gpio_num), get_gpio_pin_by_pin(gpio_num));
             HAL_GPIO_Init(get_gpio_port_by_pin(gpio_num), &GPIO_InitStruct);
-            HAL_TIM_IC_ConfigChannel(&htim5, &sConfigIC, gpio_num_to_tim_2_5_channel(gpio_num));
-            HAL_TIM_IC_Start_IT(&htim5, gpio_num_to_tim_2_5_channel(gpio_num));
+            HAL_TIM_IC_ConfigChannel(&htim5, &sConfigIC, tim_channel);
+            pwm_in_config_dma(pwm_in_dma_stream(gpio_num), gpio_num, tim_channel);
+            HAL_TIM_IC_Start(&htim5, tim_channel); // capture without interrupt
+            __HAL_TIM_ENABLE_DMA(&htim5, TIM_DMA_CC1 << ((tim_channel & 0x1C) >> 2));
+            pwm_in_state_[gpio_num - 1].stream = pwm_in_dma_stream(gpio_num);
+            any_channel_active = true;
         }
     }
+
+    if (any_channel_active) {
+        osThreadDefStatic(pwm_in_thread_def, pwm_in_decode_thread, osPriorityLow, 0, 2*512);
+        osThreadCreate(osThread(pwm_in_thread_def), NULL);
+    }
 }
 
 //TODO: These expressions have integer division by 1MHz, so it will be incorrect for clock speeds of not-integer MHz
@@ -707,52 +1191,157 @@ void handle_pulse(int gpio_num, uint32_t high_time) {
     endpoint->set_from_float(value);
 }
 
-void pwm_in_cb(int channel, uint32_t timestamp) {
-    static uint32_t last_timestamp[GPIO_COUNT] = { 0 };
-    static bool last_pin_state[GPIO_COUNT] = { false };
-    static bool last_sample_valid[GPIO_COUNT] = { false };
+// @brief Drains one channel's DMA ring and feeds the completed high
+// periods to handle_pulse.
+//
+// Both-edge capture by DMA records timestamps but not edge directions.
+// Edges alternate, so one pin read anchors the parity of the whole batch:
+// if the pin is high now, the newest captured edge was rising, and so on
+// backwards. A glitch that slips through the capture filter breaks the
+// parity for the remainder of its batch, but the resulting bogus widths
+// fall outside the legal-pulse window in handle_pulse and the parity
+// re-anchors on the next batch, so a glitch never corrupts more than one
+// decode period.
+static void pwm_in_decode_channel(int gpio_num) {
+    auto& state = pwm_in_state_[gpio_num - 1];
+    if (!state.stream)
+        return;
 
-    int gpio_num = tim_2_5_channel_num_to_gpio_num(channel);
-    if (gpio_num < 1 || gpio_num > GPIO_COUNT)
+    // Snapshot the DMA write position and the pin level together: if an
+    // edge lands between the two reads the position moves, so retry.
+    uint32_t write_index;
+    bool pin_high;
+    do {
+        write_index = PWM_IN_RING_SIZE - state.stream->NDTR;
+        pin_high = HAL_GPIO_ReadPin(get_gpio_port_by_pin(gpio_num),
+                                    get_gpio_pin_by_pin(gpio_num)) != GPIO_PIN_RESET;
+    } while (write_index != PWM_IN_RING_SIZE - state.stream->NDTR);
+
+    uint32_t count = (write_index - state.read_index) & (PWM_IN_RING_SIZE - 1);
+    if (count == 0)
         return;
-    bool current_pin_state = HAL_GPIO_ReadPin(get_gpio_port_by_pin(gpio_num), get_gpio_pin_by_pin(gpio_num)) != GPIO_PIN_RESET;
 
-    if (last_sample_valid[gpio_num - 1]
-        && (last_pin_state[gpio_num - 1] != PWM_INVERT_INPUT)
-        && (current_pin_state == PWM_INVERT_INPUT)) {
-        handle_pulse(gpio_num, timestamp - last_timestamp[gpio_num - 1]);
+    // edge j of the batch (0-based) is rising if its distance from the
+    // newest edge has the right parity
+    bool newest_edge_rising = (pin_high != PWM_INVERT_INPUT);
+    for (uint32_t j = 0; j < count; ++j) {
+        uint32_t timestamp = pwm_in_ring_[gpio_num - 1][(state.read_index + j) & (PWM_IN_RING_SIZE - 1)];
+        bool rising = (((count - 1 - j) & 1) == 0) == newest_edge_rising;
+        if (rising) {
+            state.last_rising = timestamp;
+            state.last_rising_valid = true;
+        } else if (state.last_rising_valid) {
+            handle_pulse(gpio_num, timestamp - state.last_rising);
+            state.last_rising_valid = false;
+        }
     }
-
-    last_timestamp[gpio_num - 1] = timestamp;
-    last_pin_state[gpio_num - 1] = current_pin_state;
-    last_sample_valid[gpio_num - 1] = true;
+    state.read_index = write_index;
 }
 
-
-/* Analog speed control input */
-
-static void update_analog_endpoint(const struct PWMMapping_t *map, int gpio)
+static void pwm_in_decode_thread(void *)
 {
-    float fraction = get_adc_voltage(get_gpio_port_by_pin(gpio), get_gpio_pin_by_pin(gpio)) / 3.3f;
-    float value = map->min + (fraction * (map->max - map->min));
-    get_endpoint(map->endpoint)->set_from_float(value);
+    for (;;) {
+        for (int gpio_num = 1; gpio_num <= PWM_IN_CHANNEL_COUNT; ++gpio_num)
+            pwm_in_decode_channel(gpio_num);
+        osDelay(PWM_IN_DECODE_PERIOD_MS);
+    }
 }
 
-static void analog_polling_thread(void *)
-{
-    while (true) {
-        for (int i = 0; i < GPIO_COUNT; i++) {
-            struct PWMMapping_t *map = &board_config.analog_mappings[i];
 
-            if (is_endpoint_ref_valid(map->endpoint))
-                update_analog_endpoint(map, i + 1);
+/* Analog speed control input */
+
+// Per-GPIO analog input state. The ADC1 channel of each GPIO is fixed by
+// the pinout, so it is resolved once at startup (instead of running the
+// get_adc1_channel if-chain on every sample) and the ISR tail only does a
+// table read plus one multiply-add per input.
+static struct {
+    uint32_t adc_channel = UINT32_MAX; // ADC1 regular channel, UINT32_MAX = not an ADC pin
+    float filtered_adc = 0.0f;         // exponential average of adc_measurements_ [counts]
+    float applied_adc = -1.0f;         // filtered value at the last endpoint write
+                                       // (-1 never matches, forcing the first write)
+} analog_inputs_[GPIO_COUNT];
+static float analog_filter_alpha_ = 1.0f;  // per-period IIR coefficient, 1 = unfiltered
+static uint32_t analog_apply_divider_ = 1; // PWM periods between endpoint applications
+static uint32_t analog_apply_countdown_ = 1;
+static float analog_change_threshold_ = 0.0f; // [counts] minimum filtered delta to rewrite
+                                              // the mapped endpoint, 0 = always rewrite
+static uint32_t analog_refresh_divider_ = 0;  // apply ticks between forced full rewrites
+static uint32_t analog_refresh_countdown_ = 1;
+static bool analog_inputs_active_ = false;
+
+// @brief Maintains the analog input mappings. Called from the shared
+// per-PWM-period block of pwm_trig_adc_cb, replacing the 10ms polling
+// thread: the samples come straight out of the ADC1 DMA buffer, so input
+// latency is bounded by the filter and the application divider instead of
+// a 10ms thread period.
+//
+// The exponential average runs every period; the mapped endpoints are
+// written every analog_apply_divider_ periods. With a change threshold
+// configured (analog_change_threshold) the endpoint write is additionally
+// gated on the filtered value having moved by at least that many counts
+// since the last write, so a quiet input costs no endpoint lookups or
+// writes at all; a forced full rewrite about once a second re-converges
+// endpoints that another writer touched in the meantime. Endpoint writes
+// here are plain float stores (same as handle_pulse in the PWM input
+// capture ISR), so they are safe in interrupt context.
+RAMFUNC void update_analog_inputs() {
+    if (!analog_inputs_active_)
+        return;
+    bool apply = (--analog_apply_countdown_ == 0);
+    if (apply)
+        analog_apply_countdown_ = analog_apply_divider_;
+    bool force = false;
+    if (apply && analog_refresh_divider_ && --analog_refresh_countdown_ == 0) {
+        analog_refresh_countdown_ = analog_refresh_divider_;
+        force = true;
+    }
+    for (int i = 0; i < GPIO_COUNT; i++) {
+        if (analog_inputs_[i].adc_channel >= ADC_CHANNEL_COUNT)
+            continue;
+        float sample = (float)adc_measurements_[analog_inputs_[i].adc_channel];
+        analog_inputs_[i].filtered_adc +=
+                analog_filter_alpha_ * (sample - analog_inputs_[i].filtered_adc);
+        if (apply) {
+            if (!force && fabsf(analog_inputs_[i].filtered_adc - analog_inputs_[i].applied_adc)
+                    < analog_change_threshold_)
+                continue;
+            const PWMMapping_t& map = board_config.analog_mappings[i];
+            Endpoint* endpoint = get_endpoint(map.endpoint); // nullptr if unmapped
+            if (!endpoint)
+                continue;
+            float fraction = analog_inputs_[i].filtered_adc * (1.0f / adc_full_scale);
+            endpoint->set_from_float(map.min + fraction * (map.max - map.min));
+            analog_inputs_[i].applied_adc = analog_inputs_[i].filtered_adc;
         }
-        osDelay(10);
     }
 }
 
-void start_analog_thread()
+// @brief Resolves the ADC channel table and filter coefficients for the
+// analog input mappings and enables their servicing from the control ISR.
+// Mapping endpoints may still be changed at runtime (they are re-resolved
+// on every application); the filter bandwidth and application rate are
+// latched here, i.e. take effect on reboot.
+void start_analog_mappings()
 {
-    osThreadDef(thread_def, analog_polling_thread, osPriorityLow, 0, 4*512);
-    osThreadCreate(osThread(thread_def), NULL);
+    for (int i = 0; i < GPIO_COUNT; i++) {
+        uint32_t channel = get_adc1_channel(get_gpio_port_by_pin(i + 1), get_gpio_pin_by_pin(i + 1));
+        analog_inputs_[i].adc_channel = channel;
+        // seed the filter with the live sample to avoid a turn-on ramp
+        if (channel < ADC_CHANNEL_COUNT)
+            analog_inputs_[i].filtered_adc = (float)adc_measurements_[channel];
+    }
+    if (board_config.analog_filter_bandwidth > 0.0f)
+        analog_filter_alpha_ = 1.0f - expf(-board_config.analog_filter_bandwidth * current_meas_period);
+    else
+        analog_filter_alpha_ = 1.0f;
+    uint32_t rate = board_config.analog_mapping_rate;
+    analog_apply_divider_ = (rate > 0 && rate < (uint32_t)current_meas_hz)
+                          ? (uint32_t)current_meas_hz / rate : 1;
+    analog_apply_countdown_ = analog_apply_divider_;
+    analog_change_threshold_ = board_config.analog_change_threshold;
+    // with change gating active, force a full rewrite about once a second
+    analog_refresh_divider_ = (analog_change_threshold_ > 0.0f)
+                            ? (uint32_t)current_meas_hz / analog_apply_divider_ : 0;
+    analog_refresh_countdown_ = analog_refresh_divider_ ? analog_refresh_divider_ : 1;
+    analog_inputs_active_ = true;
 }
@@ -18,12 +18,37 @@ extern "C" {
 /* Exported types ------------------------------------------------------------*/
 /* Exported constants --------------------------------------------------------*/
 #define ADC_CHANNEL_COUNT 16
+// The thermistor channel checks in board_config_v3.h assume this sequence
+// length; keep the two in sync.
+static_assert(ADC_CHANNEL_COUNT == board_rev.adc_channel_count,
+    "ADC regular sequence length disagrees with the board revision matrix");
+#define CALIB_TAU 0.2f //!< [s] time constant of the DC offset calibration filter
 extern const float adc_full_scale;
 extern const float adc_ref_voltage;
+/* Exported types ------------------------------------------------------------*/
+
+// Constants derived from the predicted bus voltage (raw sample slope-
+// extrapolated to the timing application instant, see vbus_sense_adc_cb),
+// refreshed once per PWM cycle and consumed by both axes. This keeps the
+// redundant FDIVs out of the 8kHz current control path.
+typedef struct {
+    float mod_to_V;         // (2/3) * vbus_voltage [V]
+    float V_to_mod;         // 1 / mod_to_V [1/V]
+    float inv_vbus_voltage; // 1 / vbus_voltage [1/V]
+} VbusConstants_t;
+
 /* Exported variables --------------------------------------------------------*/
 extern float vbus_voltage;
+extern float vbus_voltage_pred;
+extern float regen_energy_absorbed;
+extern float brake_energy_dissipated;
+extern VbusConstants_t vbus_constants;
 extern bool brake_resistor_armed;
 extern uint16_t adc_measurements_[ADC_CHANNEL_COUNT];
+// NVIC priority partition audit (see Board/v3/Inc/nvic_priorities.h):
+// counts ADC trigger-to-entry latencies beyond the budget, i.e. cycles
+// where something held off the current sampling handler.
+extern uint32_t nvic_audit_inversion_cnt;
 /* Exported macro ------------------------------------------------------------*/
 /* Exported functions --------------------------------------------------------*/
 
@@ -36,10 +61,11 @@ void safety_critical_apply_brake_resistor_timings(uint32_t low_off, uint32_t hig
 
 // called from STM platform code
 extern "C" {
+void adc_irq_entry_snapshot(void);
+void adc_analog_watchdog_cb(ADC_HandleTypeDef* hadc);
 void pwm_trig_adc_cb(ADC_HandleTypeDef* hadc, bool injected);
 void vbus_sense_adc_cb(ADC_HandleTypeDef* hadc, bool injected);
 void tim_update_cb(TIM_HandleTypeDef* htim);
-void pwm_in_cb(int channel, uint32_t timestamp);
 }
 
 // Initalisation
@@ -50,10 +76,14 @@ void sync_timers(TIM_HandleTypeDef* htim_a, TIM_HandleTypeDef* htim_b,
                  TIM_HandleTypeDef* htim_refbase = nullptr);
 void start_general_purpose_adc();
 float get_adc_voltage(GPIO_TypeDef* GPIO_port, uint16_t GPIO_pin);
+bool arm_sincos_injected_sampling(float* sample_s_dest, float* sample_c_dest);
+int get_gpio_samp_port_index(const GPIO_TypeDef* GPIO_port);
+void gpio_samp_add_port(const GPIO_TypeDef* GPIO_port);
 void pwm_in_init();
-void start_analog_thread();
+void start_analog_mappings();
 
 void update_brake_current();
+void update_analog_inputs();
 
 inline uint32_t cpu_enter_critical() {
     uint32_t primask = __get_PRIMASK();
@@ -5,9 +5,12 @@
 
 #include "freertos_vars.h"
 #include <communication/interface_usb.h>
+#include <communication/interface_can.hpp>
 #include <communication/interface_uart.h>
 #include <communication/interface_i2c.h>
 
+#include <new>
+
 BoardConfig_t board_config;
 Encoder::Config_t encoder_configs[AXIS_COUNT];
 SensorlessEstimator::Config_t sensorless_configs[AXIS_COUNT];
@@ -15,7 +18,11 @@ Controller::Config_t controller_configs[AXIS_COUNT];
 Motor::Config_t motor_configs[AXIS_COUNT];
 Axis::Config_t axis_configs[AXIS_COUNT];
 TrapezoidalTrajectory::Config_t trap_configs[AXIS_COUNT];
+Controller::AnticoggingStore_t anticogging_stores[AXIS_COUNT];
+AxisOdometer_t odometers[AXIS_COUNT];
+CANConfig_t can_config;
 bool user_config_loaded_;
+bool config_save_pending_ = false; // true while a background save is in flight
 
 SystemStats_t system_stats_ = { 0 };
 
@@ -28,24 +35,125 @@ typedef Config<
     Controller::Config_t[AXIS_COUNT],
     Motor::Config_t[AXIS_COUNT],
     TrapezoidalTrajectory::Config_t[AXIS_COUNT],
-    Axis::Config_t[AXIS_COUNT]> ConfigFormat;
+    Axis::Config_t[AXIS_COUNT],
+    Controller::AnticoggingStore_t[AXIS_COUNT],
+    AxisOdometer_t[AXIS_COUNT],
+    CANConfig_t> ConfigFormat;
+
+// position of the AxisOdometer_t[] object in the ConfigFormat list above,
+// used for targeted journal appends by odometer_checkpoint()
+static constexpr size_t CONFIG_INDEX_ODOMETERS = 8;
+
+// RAM staging buffer for save_configuration_async()
+static uint8_t config_snapshot_[ConfigFormat::get_size() + 2];
+
+// @brief Copies the volatile parts of the config (currently the anticogging
+// maps) into their NVM staging structs.
+static void pack_config_staging(void) {
+    for (size_t i = 0; i < AXIS_COUNT; ++i) {
+        if (axes[i])
+            axes[i]->controller_.anticogging_pack_map(&anticogging_stores[i]);
+    }
+}
 
 void save_configuration(void) {
-    if (ConfigFormat::safe_store_config(
+    if (config_save_pending_)
+        return; // a background save is still writing the NVM
+    // also keeps the brown-out odometer checkpoint off the flash meanwhile
+    config_save_pending_ = true;
+    pack_config_staging();
+    // Only append the structs that changed if the NVM already holds a valid
+    // config, otherwise rewrite the whole block.
+    int status;
+    if (user_config_loaded_) {
+        status = ConfigFormat::safe_update_config(
+                &board_config,
+                &encoder_configs,
+                &sensorless_configs,
+                &controller_configs,
+                &motor_configs,
+                &trap_configs,
+                &axis_configs,
+                &anticogging_stores,
+                &odometers,
+                &can_config);
+    } else {
+        status = ConfigFormat::safe_store_config(
+                &board_config,
+                &encoder_configs,
+                &sensorless_configs,
+                &controller_configs,
+                &motor_configs,
+                &trap_configs,
+                &axis_configs,
+                &anticogging_stores,
+                &odometers,
+                &can_config);
+    }
+    if (status) {
+        //printf("saving configuration failed\r\n"); osDelay(5);
+    } else {
+        user_config_loaded_ = true;
+    }
+    config_save_pending_ = false;
+}
+
+static void config_save_yield(void) {
+    osDelay(1);
+}
+
+// One-shot worker for save_configuration_async(). Runs at low priority so
+// the flash writes only happen when nothing else wants the CPU; the stack
+// is returned to the FreeRTOS heap on termination.
+static void config_save_thread(void * ctx) {
+    (void) ctx; // unused parameter
+    int status;
+    if (user_config_loaded_) {
+        status = ConfigFormat::update_snapshot(config_snapshot_, &config_save_yield);
+        // Compact while we're already on the low priority thread: once the
+        // journal area can't hold another worst-case record, a future save
+        // would pay for the full rewrite at a time nobody chose. The full
+        // store folds all journal records into a fresh base block in the
+        // other sector.
+        if (!status && ConfigFormat::needs_compaction())
+            status = ConfigFormat::store_snapshot(config_snapshot_, &config_save_yield);
+    } else {
+        status = ConfigFormat::store_snapshot(config_snapshot_, &config_save_yield);
+    }
+    if (!status)
+        user_config_loaded_ = true;
+    config_save_pending_ = false;
+    osThreadTerminate(osThreadGetId());
+}
+
+// @brief Like save_configuration, but only takes a RAM snapshot of the
+// config and leaves the flash writes to a one-shot low priority thread, so
+// the caller doesn't block for the duration of the save. config_save_pending_
+// reads true until the write completed; config changes made in the meantime
+// are not part of the snapshot.
+void save_configuration_async(void) {
+    if (config_save_pending_)
+        return; // a save is already in progress
+    pack_config_staging();
+    ConfigFormat::snapshot_config(config_snapshot_,
             &board_config,
             &encoder_configs,
             &sensorless_configs,
             &controller_configs,
             &motor_configs,
             &trap_configs,
-            &axis_configs)) {
-        //printf("saving configuration failed\r\n"); osDelay(5);
-    } else {
-        user_config_loaded_ = true;
-    }
+            &axis_configs,
+            &anticogging_stores,
+            &odometers,
+            &can_config);
+    config_save_pending_ = true;
+    osThreadDef(task_config_save, config_save_thread, osPriorityLow, 0, 512);
+    if (osThreadCreate(osThread(task_config_save), NULL) == NULL)
+        config_save_pending_ = false; // out of memory; the caller can retry
 }
 
 extern "C" int load_configuration(void) {
+    uint32_t start_ms = HAL_GetTick();
     // Try to load configs
     if (NVM_init() ||
         ConfigFormat::safe_load_config(
@@ -55,9 +163,13 @@ extern "C" int load_configuration(void) {
                 &controller_configs,
                 &motor_configs,
                 &trap_configs,
-                &axis_configs)) {
+                &axis_configs,
+                &anticogging_stores,
+                &odometers,
+                &can_config)) {
         //If loading failed, restore defaults
         board_config = BoardConfig_t();
+        can_config = CANConfig_t();
         for (size_t i = 0; i < AXIS_COUNT; ++i) {
             encoder_configs[i] = Encoder::Config_t();
             sensorless_configs[i] = SensorlessEstimator::Config_t();
@@ -65,12 +177,15 @@ extern "C" int load_configuration(void) {
             motor_configs[i] = Motor::Config_t();
             trap_configs[i] = TrapezoidalTrajectory::Config_t();
             axis_configs[i] = Axis::Config_t();
+            anticogging_stores[i] = Controller::AnticoggingStore_t();
+            odometers[i] = AxisOdometer_t();
             // Default step/dir pins are different, so we need to explicitly load them
             Axis::load_default_step_dir_pin_config(hw_configs[i].axis_config, &axis_configs[i]);
         }
     } else {
         user_config_loaded_ = true;
     }
+    system_stats_.boot_timings.config_load = HAL_GetTick() - start_ms;
     return user_config_loaded_;
 }
 
@@ -78,6 +193,236 @@ void erase_configuration(void) {
     NVM_erase();
 }
 
+/* Odometer checkpointing -----------------------------------------------------*/
+
+#define ODOMETER_CHECKPOINT_PERIOD_MS (10 * 60 * 1000)
+
+// @brief Journals the odometer structs to NVM if they changed since the
+// last checkpoint. Called about every ODOMETER_CHECKPOINT_PERIOD_MS from
+// the idle hook, and from the PVD brown-out interrupt so the counters
+// survive power loss even without a host attached. A targeted journal
+// append costs one small record, not a config rewrite; when the journal
+// area is used up the counters are simply picked up by the next regular
+// save.
+extern "C" void odometer_checkpoint(void) {
+    if (!user_config_loaded_ || config_save_pending_)
+        return;
+    static AxisOdometer_t checkpointed[AXIS_COUNT];
+    if (memcmp(checkpointed, odometers, sizeof(odometers)) == 0)
+        return;
+    config_save_pending_ = true; // keep saves off the flash meanwhile
+    if (ConfigFormat::journal_append_one(CONFIG_INDEX_ODOMETERS,
+            &board_config,
+            &encoder_configs,
+            &sensorless_configs,
+            &controller_configs,
+            &motor_configs,
+            &trap_configs,
+            &axis_configs,
+            &anticogging_stores,
+            &odometers,
+            &can_config) == 0)
+        memcpy(checkpointed, odometers, sizeof(odometers));
+    config_save_pending_ = false;
+}
+
+/* Bulk config export/import --------------------------------------------------
+*
+* Cloning a configuration through the regular endpoints reads and writes
+* every field individually. These functions instead expose the serialized
+* config image (the same version- and CRC-tagged layout that the NVM base
+* block uses, see nvm_config.hpp), staged in config_snapshot_, so the host
+* can move the whole configuration in word-sized bulk accesses: export is
+* config_export_begin() followed by config_read_word() over the image;
+* import is config_write_word() over the image followed by
+* config_import_commit() and a save.
+*/
+
+uint32_t get_config_image_size(void) {
+    return sizeof(config_snapshot_);
+}
+
+// @brief Serializes the live config into the snapshot buffer for export.
+// Returns 0 on success, -1 while a background save owns the buffer.
+int32_t config_export_begin(void) {
+    if (config_save_pending_)
+        return -1;
+    pack_config_staging();
+    ConfigFormat::snapshot_config(config_snapshot_,
+            &board_config,
+            &encoder_configs,
+            &sensorless_configs,
+            &controller_configs,
+            &motor_configs,
+            &trap_configs,
+            &axis_configs,
+            &anticogging_stores,
+            &odometers,
+            &can_config);
+    return 0;
+}
+
+// @brief Reads a little-endian word from the snapshot buffer. Bytes past
+// the end of the image read as zero.
+uint32_t config_read_word(uint32_t offset) {
+    uint32_t word = 0;
+    for (uint32_t i = 0; i < 4; ++i) {
+        if (offset + i < sizeof(config_snapshot_))
+            word |= (uint32_t)config_snapshot_[offset + i] << (8 * i);
+    }
+    return word;
+}
+
+// @brief Writes a little-endian word into the snapshot buffer. Bytes past
+// the end of the image are dropped; writes are ignored while a background
+// save owns the buffer.
+void config_write_word(uint32_t offset, uint32_t word) {
+    if (config_save_pending_)
+        return;
+    for (uint32_t i = 0; i < 4; ++i) {
+        if (offset + i < sizeof(config_snapshot_))
+            config_snapshot_[offset + i] = (uint8_t)(word >> (8 * i));
+    }
+}
+
+// @brief Validates the CRC of an imported image and copies it into the
+// live config objects. Returns 0 on success, -1 on a CRC or version
+// mismatch (the live config is untouched then). On success the derived
+// state is recomputed: anticogging maps are unpacked and the axis
+// property-write hooks run at the next control cycle. The caller still
+// has to save_configuration() to persist the import.
+// @brief Recomputes the state derived from the config structs after their
+// contents were replaced in bulk (import commit, trial begin/revert):
+// anticogging maps are unpacked and the axis property-write hooks run at
+// the next control cycle.
+static void config_apply_derived(void) {
+    for (size_t i = 0; i < AXIS_COUNT; ++i) {
+        if (axes[i]) {
+            axes[i]->controller_.anticogging_unpack_map(&anticogging_stores[i]);
+            axes[i]->stage_deferred_hook(Axis::DEFERRED_HOOK_WATCHDOG_SETTINGS |
+                                         Axis::DEFERRED_HOOK_STEP_DIR_PINS);
+        }
+    }
+}
+
+// @brief Validates the CRC of an imported image and copies it into the
+// live config objects. Returns 0 on success, -1 on a CRC or version
+// mismatch (the live config is untouched then). On success the derived
+// state is recomputed (see config_apply_derived). The caller still
+// has to save_configuration() to persist the import.
+int32_t config_import_commit(void) {
+    if (config_save_pending_)
+        return -1;
+    if (ConfigFormat::restore_snapshot(config_snapshot_,
+            &board_config,
+            &encoder_configs,
+            &sensorless_configs,
+            &controller_configs,
+            &motor_configs,
+            &trap_configs,
+            &axis_configs,
+            &anticogging_stores,
+            &odometers,
+            &can_config))
+        return -1;
+    config_apply_derived();
+    return 0;
+}
+
+/* Config trial mode ----------------------------------------------------------
+*
+* Lets a host try a full parameter set without the save + reboot cycle: the
+* candidate config is staged into the snapshot buffer (config_write_word,
+* same image format as the bulk import), config_trial_begin() applies it to
+* RAM after backing up the running config, and nothing touches the NVM. The
+* trial either ends in config_trial_commit() (followed by a regular save to
+* persist it) or in a revert to the backed-up config -- explicitly via
+* config_trial_revert(), or automatically when the host stops calling
+* config_trial_feed() before the timeout runs out, so a crashed tuning
+* script cannot leave experimental gains running unattended. Fields
+* documented as "requires a reboot" keep their old effective values for the
+* duration of the trial, exactly like editing them through their endpoints.
+*/
+
+static uint8_t config_trial_backup_[sizeof(config_snapshot_)];
+static uint32_t config_trial_deadline_ms_ = 0;
+static uint32_t config_trial_timeout_ms_ = 0;
+bool config_trial_active_ = false;
+uint32_t config_trial_revert_cnt_ = 0;
+
+// @brief Backs up the running config and applies the staged image to RAM.
+// Reverts automatically unless config_trial_feed() is called at least every
+// timeout_ms. Returns 0 on success, -1 while a save or another trial is in
+// progress or when the staged image fails CRC/version validation.
+int32_t config_trial_begin(uint32_t timeout_ms) {
+    if (config_trial_active_ || config_save_pending_ || timeout_ms == 0)
+        return -1;
+    pack_config_staging();
+    ConfigFormat::snapshot_config(config_trial_backup_,
+            &board_config,
+            &encoder_configs,
+            &sensorless_configs,
+            &controller_configs,
+            &motor_configs,
+            &trap_configs,
+            &axis_configs,
+            &anticogging_stores,
+            &odometers,
+            &can_config);
+    if (config_import_commit())
+        return -1;
+    config_trial_timeout_ms_ = timeout_ms;
+    config_trial_deadline_ms_ = HAL_GetTick() + timeout_ms;
+    config_trial_active_ = true;
+    return 0;
+}
+
+// @brief Pushes the auto-revert deadline out by the trial's timeout.
+void config_trial_feed(void) {
+    if (config_trial_active_)
+        config_trial_deadline_ms_ = HAL_GetTick() + config_trial_timeout_ms_;
+}
+
+// @brief Keeps the trial config as the running config and ends the trial.
+// The caller still has to save_configuration() to persist it.
+int32_t config_trial_commit(void) {
+    if (!config_trial_active_)
+        return -1;
+    config_trial_active_ = false;
+    return 0;
+}
+
+// @brief Restores the config backed up at config_trial_begin() and ends the
+// trial. Also called from the idle hook when the trial deadline expires.
+int32_t config_trial_revert(void) {
+    if (!config_trial_active_)
+        return -1;
+    config_trial_active_ = false;
+    // can't fail: the backup was serialized from the live structs
+    ConfigFormat::restore_snapshot(config_trial_backup_,
+            &board_config,
+            &encoder_configs,
+            &sensorless_configs,
+            &controller_configs,
+            &motor_configs,
+            &trap_configs,
+            &axis_configs,
+            &anticogging_stores,
+            &odometers,
+            &can_config);
+    config_apply_derived();
+    return 0;
+}
+
+// @brief Idle-hook helper: reverts an expired trial.
+static void config_trial_check_deadline(void) {
+    if (config_trial_active_ &&
+            (int32_t)(HAL_GetTick() - config_trial_deadline_ms_) >= 0) {
+        if (config_trial_revert() == 0)
+            config_trial_revert_cnt_++;
+    }
+}
+
 void enter_dfu_mode() {
     if ((hw_version_major == 3) && (hw_version_minor >= 5)) {
         __asm volatile ("CPSID I\n\t":::"memory"); // disable interrupts
@@ -96,48 +441,202 @@ void enter_dfu_mode() {
     }
 }
 
+// Tickless idle bookkeeping. The DWT cycle counter halts while the core
+// sleeps, so slept time is measured on TIM14 instead (the HAL tick
+// timebase: APB-clocked, counts microseconds, keeps running through WFI).
+extern TIM_HandleTypeDef htim14; // defined in stm32f4xx_hal_timebase_TIM.c
+static uint64_t slept_us_total_ = 0;
+static uint32_t sleep_enter_us_ = 0;
+static volatile uint32_t last_wakeup_us_ = 0;
+
+// @brief Microsecond wall clock assembled from the HAL tick and the TIM14
+// count. Around the WFI the port masks all interrupts with PRIMASK, so a
+// rollover may be pending without the 1ms ISR having run yet.
+static uint32_t wall_clock_us(void) {
+    uint32_t tick, cnt;
+    do {
+        tick = HAL_GetTick();
+        cnt = htim14.Instance->CNT;
+    } while (tick != HAL_GetTick());
+    if (__HAL_TIM_GET_FLAG(&htim14, TIM_FLAG_UPDATE) && cnt < 500)
+        tick++; // rolled over while masked
+    return tick * 1000u + cnt;
+}
+
+// @brief Converts the FreeRTOS runtime counters into per-thread CPU load
+// figures over the window since the previous call. Runs from the idle hook
+// about once a second; one pass over the task list under a scheduler
+// suspension is cheap enough not to disturb the control deadlines.
+static void update_cpu_load(void) {
+    static TaskStatus_t task_statuses[12];
+    static uint32_t prev_total_runtime = 0;
+    static uint64_t prev_isr_cycles = 0;
+
+    uint32_t total_runtime = 0;
+    UBaseType_t n_tasks = uxTaskGetSystemState(task_statuses,
+            sizeof(task_statuses) / sizeof(task_statuses[0]), &total_runtime);
+    uint32_t window = total_runtime - prev_total_runtime;
+    prev_total_runtime = total_runtime;
+    if (window == 0)
+        return; // counter not running yet (or task list overflowed the array)
+
+    auto thread_load = [&](TaskHandle_t thread, uint32_t* prev_runtime) {
+        for (UBaseType_t i = 0; i < n_tasks; ++i) {
+            if (task_statuses[i].xHandle == thread) {
+                uint32_t delta = task_statuses[i].ulRunTimeCounter - *prev_runtime;
+                *prev_runtime = task_statuses[i].ulRunTimeCounter;
+                return (uint16_t)(((uint64_t)delta * 1000u) / window);
+            }
+        }
+        return (uint16_t)0;
+    };
+
+    static uint32_t prev_axis_worker, prev_comms, prev_usb,
+                    prev_uart, prev_usb_irq, prev_startup, prev_idle;
+    // The transient-state service threads are short-lived and not tracked
+    // separately; their cycles show up in nothing below (like ISRs, they
+    // are visible in the total only).
+    system_stats_.cpu_load_axis_worker = thread_load(Axis::worker_thread_id, &prev_axis_worker);
+    system_stats_.cpu_load_comms = thread_load(comm_thread, &prev_comms);
+    system_stats_.cpu_load_usb = thread_load(usb_thread, &prev_usb);
+    system_stats_.cpu_load_uart = thread_load(uart_thread, &prev_uart);
+    system_stats_.cpu_load_usb_irq = thread_load(usb_irq_thread, &prev_usb_irq);
+    system_stats_.cpu_load_startup = thread_load(defaultTaskHandle, &prev_startup);
+    system_stats_.cpu_load_idle = thread_load(xTaskGetIdleTaskHandle(), &prev_idle);
+
+    // The scheduler charges interrupt cycles to whichever thread they
+    // preempted; the ADC callback cycle sum from the profiler covers the
+    // whole control ISR chain (sampling, FOC, PWM timings) in the same
+    // unit as the runtime counter, so report its share separately.
+    uint64_t isr_cycles = profiler_.stages_[PROFILER_STAGE_ADC_CB].sum;
+    system_stats_.cpu_load_control_isr =
+            (uint16_t)(((isr_cycles - prev_isr_cycles) * 1000u) / window);
+    prev_isr_cycles = isr_cycles;
+
+    // Sleep share over the same cadence, but measured against wall time:
+    // 'window' above is DWT cycles and the DWT halts while the core sleeps,
+    // so slept time is invisible to the per-thread figures.
+    static uint64_t prev_slept_us = 0;
+    static uint32_t prev_wall_us = 0;
+    uint32_t wall_us = wall_clock_us();
+    uint32_t wall_window = wall_us - prev_wall_us;
+    if (prev_wall_us != 0 && wall_window != 0)
+        system_stats_.sleep_ratio =
+                (uint16_t)(((slept_us_total_ - prev_slept_us) * 1000u) / wall_window);
+    prev_wall_us = wall_us;
+    prev_slept_us = slept_us_total_;
+}
+
 extern "C" {
 int odrive_main(void);
 void vApplicationStackOverflowHook(xTaskHandle *pxTask, signed portCHAR *pcTaskName) {
     for (;;); // TODO: safe action
 }
+// @brief FreeRTOS run time stats counter (see FreeRTOSConfig.h). The DWT
+// cycle counter is enabled by Profiler::init before the control interrupts
+// start; slices scheduled before that read as zero, which only affects the
+// first sampling window.
+uint32_t thread_cpu_runtime_counter(void) {
+    return DWT->CYCCNT;
+}
+// @brief Sleep hooks for tickless idle (configPRE/POST_SLEEP_PROCESSING,
+// see FreeRTOSConfig.h). Called from the port with interrupts masked; keep
+// them to a couple of timer reads. The 8kHz current sampling interrupt
+// bounds every sleep window, so individual sleeps are short - the WFI
+// between interrupts is still where the standby power goes.
+void tickless_pre_sleep(uint32_t* modifiable_idle_ticks) {
+    (void)modifiable_idle_ticks; // left nonzero: the port's own WFI is fine
+    sleep_enter_us_ = wall_clock_us();
+}
+void tickless_post_sleep(uint32_t* expected_idle_ticks) {
+    (void)expected_idle_ticks;
+    uint32_t now = wall_clock_us();
+    last_wakeup_us_ = now;
+    slept_us_total_ += now - sleep_enter_us_;
+    ++system_stats_.sleep_entry_cnt;
+}
+// @brief Called when a motor PWM arms; records the wakeup-to-armed latency
+// so standby responsiveness shows up in system_stats.
+void tickless_note_motor_arm(void) {
+    uint32_t wake = last_wakeup_us_;
+    if (wake != 0)
+        system_stats_.wakeup_to_arm_us = wall_clock_us() - wake;
+}
 void vApplicationIdleHook(void) {
     if (system_stats_.fully_booted) {
         system_stats_.uptime = xTaskGetTickCount();
         system_stats_.min_heap_space = xPortGetMinimumEverFreeHeapSize();
         system_stats_.min_stack_space_comms = uxTaskGetStackHighWaterMark(comm_thread) * sizeof(StackType_t);
-        system_stats_.min_stack_space_axis0 = uxTaskGetStackHighWaterMark(axes[0]->thread_id_) * sizeof(StackType_t);
-        system_stats_.min_stack_space_axis1 = uxTaskGetStackHighWaterMark(axes[1]->thread_id_) * sizeof(StackType_t);
+        system_stats_.min_stack_space_axis_worker = uxTaskGetStackHighWaterMark(Axis::worker_thread_id) * sizeof(StackType_t);
         system_stats_.min_stack_space_usb = uxTaskGetStackHighWaterMark(usb_thread) * sizeof(StackType_t);
         system_stats_.min_stack_space_uart = uxTaskGetStackHighWaterMark(uart_thread) * sizeof(StackType_t);
         system_stats_.min_stack_space_usb_irq = uxTaskGetStackHighWaterMark(usb_irq_thread) * sizeof(StackType_t);
         system_stats_.min_stack_space_startup = uxTaskGetStackHighWaterMark(defaultTaskHandle) * sizeof(StackType_t);
+        static uint32_t next_cpu_load_ms = 0;
+        if ((int32_t)(system_stats_.uptime - next_cpu_load_ms) >= 0) {
+            next_cpu_load_ms = system_stats_.uptime + 1000;
+            update_cpu_load();
+        }
+        // Checkpoint the odometer counters now and then; a cheap journal
+        // append that runs in idle so it never displaces real work.
+        static uint32_t next_odometer_ms = ODOMETER_CHECKPOINT_PERIOD_MS;
+        if ((int32_t)(system_stats_.uptime - next_odometer_ms) >= 0) {
+            next_odometer_ms = system_stats_.uptime + ODOMETER_CHECKPOINT_PERIOD_MS;
+            odometer_checkpoint();
+        }
+        // Auto-revert a config trial whose host went away (see main.cpp
+        // config trial section).
+        config_trial_check_deadline();
+    }
+}
+}
+
+// One-shot thread that sets up the axis hardware in fast-boot mode, so the
+// gate driver SPI setup and encoder timer start overlap with the endpoint
+// tree build. The two axes are still set up one after the other because
+// their gate drivers share the SPI bus.
+static bool axis_setup_done_ = false;
+static void axis_setup_thread(void * ctx) {
+    (void) ctx; // unused parameter
+    for (size_t i = 0; i < AXIS_COUNT; ++i) {
+        axes[i]->setup();
     }
+    axis_setup_done_ = true;
+    osThreadTerminate(osThreadGetId());
 }
+
+// @brief Senses the I2C address straps and initializes the I2C peripheral.
+// Split out of odrive_main so the runtime interface reconfiguration can
+// bring I2C up again after tearing down CAN (they share the pins).
+void init_i2c_auto_addr(void) {
+#if HW_VERSION_MAJOR == 3 && HW_VERSION_MINOR >= 3
+    // Set up the direction GPIO as input
+    GPIO_InitTypeDef GPIO_InitStruct;
+    GPIO_InitStruct.Mode = GPIO_MODE_INPUT;
+    GPIO_InitStruct.Pull = GPIO_PULLUP;
+
+    GPIO_InitStruct.Pin = I2C_A0_PIN;
+    HAL_GPIO_Init(I2C_A0_PORT, &GPIO_InitStruct);
+    GPIO_InitStruct.Pin = I2C_A1_PIN;
+    HAL_GPIO_Init(I2C_A1_PORT, &GPIO_InitStruct);
+    GPIO_InitStruct.Pin = I2C_A2_PIN;
+    HAL_GPIO_Init(I2C_A2_PORT, &GPIO_InitStruct);
+
+    osDelay(1);
+    i2c_stats_.addr = (0xD << 3);
+    i2c_stats_.addr |= HAL_GPIO_ReadPin(I2C_A0_PORT, I2C_A0_PIN) != GPIO_PIN_RESET ? 0x1 : 0;
+    i2c_stats_.addr |= HAL_GPIO_ReadPin(I2C_A1_PORT, I2C_A1_PIN) != GPIO_PIN_RESET ? 0x2 : 0;
+    i2c_stats_.addr |= HAL_GPIO_ReadPin(I2C_A2_PORT, I2C_A2_PIN) != GPIO_PIN_RESET ? 0x4 : 0;
+    MX_I2C1_Init(i2c_stats_.addr);
+#endif
 }
 
 int odrive_main(void) {
+    uint32_t stage_start_ms = HAL_GetTick();
 
 #if HW_VERSION_MAJOR == 3 && HW_VERSION_MINOR >= 3
     if (board_config.enable_i2c_instead_of_can) {
-        // Set up the direction GPIO as input
-        GPIO_InitTypeDef GPIO_InitStruct;
-        GPIO_InitStruct.Mode = GPIO_MODE_INPUT;
-        GPIO_InitStruct.Pull = GPIO_PULLUP;
-
-        GPIO_InitStruct.Pin = I2C_A0_PIN;
-        HAL_GPIO_Init(I2C_A0_PORT, &GPIO_InitStruct);
-        GPIO_InitStruct.Pin = I2C_A1_PIN;
-        HAL_GPIO_Init(I2C_A1_PORT, &GPIO_InitStruct);
-        GPIO_InitStruct.Pin = I2C_A2_PIN;
-        HAL_GPIO_Init(I2C_A2_PORT, &GPIO_InitStruct);
-
-        osDelay(1);
-        i2c_stats_.addr = (0xD << 3);
-        i2c_stats_.addr |= HAL_GPIO_ReadPin(I2C_A0_PORT, I2C_A0_PIN) != GPIO_PIN_RESET ? 0x1 : 0;
-        i2c_stats_.addr |= HAL_GPIO_ReadPin(I2C_A1_PORT, I2C_A1_PIN) != GPIO_PIN_RESET ? 0x2 : 0;
-        i2c_stats_.addr |= HAL_GPIO_ReadPin(I2C_A2_PORT, I2C_A2_PIN) != GPIO_PIN_RESET ? 0x4 : 0;
-        MX_I2C1_Init(i2c_stats_.addr);
+        init_i2c_auto_addr();
     } else
 #endif
         MX_CAN1_Init();
@@ -159,17 +658,27 @@ int odrive_main(void) {
     HAL_GPIO_Init(GPIO_5_GPIO_Port, &GPIO_InitStruct);
 #endif
 
-    // Construct all objects.
+    // Construct all objects. The hot per-axis control objects are allocated
+    // from the FreeRTOS heap, which lives in the F405's core coupled memory:
+    // zero wait states and no DMA masters on that bus, so the current loop
+    // never contends with the ADC/UART DMA traffic in the main SRAM. The
+    // encoders must stay on the regular heap because they contain the SPI
+    // DMA buffers for the absolute encoder modes.
     for (size_t i = 0; i < AXIS_COUNT; ++i) {
         Encoder *encoder = new Encoder(hw_configs[i].encoder_config,
                                        encoder_configs[i]);
-        SensorlessEstimator *sensorless_estimator = new SensorlessEstimator(sensorless_configs[i]);
-        Controller *controller = new Controller(controller_configs[i]);
-        Motor *motor = new Motor(hw_configs[i].motor_config,
-                                 hw_configs[i].gate_driver_config,
-                                 motor_configs[i]);
-        TrapezoidalTrajectory *trap = new TrapezoidalTrajectory(trap_configs[i]);
-        axes[i] = new Axis(i, hw_configs[i].axis_config, axis_configs[i],
+        SensorlessEstimator *sensorless_estimator = new (pvPortMalloc(sizeof(SensorlessEstimator)))
+                SensorlessEstimator(sensorless_configs[i]);
+        Controller *controller = new (pvPortMalloc(sizeof(Controller)))
+                Controller(controller_configs[i]);
+        Motor *motor = new (pvPortMalloc(sizeof(Motor)))
+                Motor(hw_configs[i].motor_config,
+                      hw_configs[i].gate_driver_config,
+                      motor_configs[i]);
+        TrapezoidalTrajectory *trap = new (pvPortMalloc(sizeof(TrapezoidalTrajectory)))
+                TrapezoidalTrajectory(trap_configs[i]);
+        axes[i] = new (pvPortMalloc(sizeof(Axis)))
+                Axis(i, hw_configs[i].axis_config, axis_configs[i],
                 *encoder, *sensorless_estimator, *controller, *motor, *trap);
     }
     
@@ -182,6 +691,22 @@ int odrive_main(void) {
         SetGPIO12toUART();
     }
 #endif
+    system_stats_.boot_timings.peripheral_init = HAL_GetTick() - stage_start_ms;
+    stage_start_ms = HAL_GetTick();
+
+    // In fast-boot mode the axis hardware setup runs on a one-shot thread
+    // concurrently with the communication init (they touch disjoint
+    // peripherals); otherwise it runs inline after pwm_in_init as before.
+    bool setup_in_background = false;
+    if (board_config.enable_fast_boot) {
+        osThreadDef(task_axis_setup, axis_setup_thread, osPriorityNormal, 0, 512);
+        setup_in_background = osThreadCreate(osThread(task_axis_setup), NULL) != NULL;
+    }
+
+    // Start the blackbox flight recorder (the protocol tree below exposes
+    // its capture RAM, so the buffer must be allocated first)
+    blackbox_.init();
+
     //osDelay(100);
     // Init communications (this requires the axis objects to be constructed)
     init_communication();
@@ -190,31 +715,70 @@ int odrive_main(void) {
     // must happen after communication is initialized
     pwm_in_init();
 
+    system_stats_.boot_timings.comm_init = HAL_GetTick() - stage_start_ms;
+    stage_start_ms = HAL_GetTick();
+
     // Setup hardware for all components
-    for (size_t i = 0; i < AXIS_COUNT; ++i) {
-        axes[i]->setup();
+    if (setup_in_background) {
+        while (!axis_setup_done_)
+            osDelay(1);
+    } else {
+        for (size_t i = 0; i < AXIS_COUNT; ++i) {
+            axes[i]->setup();
+        }
     }
 
+    system_stats_.boot_timings.axis_setup = HAL_GetTick() - stage_start_ms;
+
+    // Enable the DWT cycle counter for the hot-path profiler
+    profiler_.init();
+
+#ifdef RUN_BENCHMARKS
+    // Benchmark build: measure the hot kernels now, before the control
+    // interrupts start competing for cycles, and report on UART.
+    run_benchmarks();
+#endif
+
     // Start PWM and enable adc interrupts/callbacks
     start_adc_pwm();
 
+    stage_start_ms = HAL_GetTick();
+
     // This delay serves two purposes:
     //  - Let the current sense calibration converge (the current
     //    sense interrupts are firing in background by now)
     //  - Allow a user to interrupt the code, e.g. by flashing a new code,
     //    before it does anything crazy
-    // TODO make timing a function of calibration filter tau
-    osDelay(1500);
+    // In fast-boot mode the wait is sized from the calibration filter time
+    // constant (5 tau, <1% residual error) instead of the conservative
+    // fixed delay.
+    if (board_config.enable_fast_boot)
+        osDelay((uint32_t)(5.0f * CALIB_TAU * 1000.0f));
+    else
+        osDelay(1500);
 
-    // Start state machine threads. Each thread will go through various calibration
-    // procedures and then run the actual controller loops.
-    // TODO: generalize for AXIS_COUNT != 2
-    for (size_t i = 0; i < AXIS_COUNT; ++i) {
-        axes[i]->start_thread();
-    }
+    system_stats_.boot_timings.current_calib_wait = HAL_GetTick() - stage_start_ms;
+
+    // Start the shared axis worker thread. It steps the steady states of
+    // all axes cooperatively and spawns a short-lived service thread for
+    // calibration procedures and other transient states.
+    Axis::start_worker();
+
+    start_analog_mappings();
 
-    start_analog_thread();
+    // Brown-out checkpoint: the programmable voltage detector fires when
+    // VDD drops below ~2.9V, which leaves enough margin on the bulk caps
+    // to journal the odometer counters before the core browns out.
+    PWR_PVDTypeDef pvd_config = {
+        .PVDLevel = PWR_PVDLEVEL_6,
+        .Mode = PWR_PVD_MODE_IT_RISING,
+    };
+    HAL_PWR_ConfigPVD(&pvd_config);
+    HAL_PWR_EnablePVD();
+    HAL_NVIC_SetPriority(PVD_IRQn, 10, 0); // below the control interrupts
+    HAL_NVIC_EnableIRQ(PVD_IRQn);
 
+    system_stats_.boot_timings.total = HAL_GetTick();
     system_stats_.fully_booted = true;
     return 0;
 }
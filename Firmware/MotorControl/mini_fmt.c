@@ -0,0 +1,175 @@
+
+#include "mini_fmt.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Retargeted to the stream sinks in communication.cpp
+extern int _write(int file, const char* data, int len);
+
+// Bounded output cursor. 'pos' keeps counting past the end so the return
+// value reports the untruncated length, like snprintf.
+typedef struct {
+    char* buf;
+    size_t cap; // space excluding the terminator
+    size_t pos;
+} out_t;
+
+static void out_char(out_t* o, char c) {
+    if (o->pos < o->cap)
+        o->buf[o->pos] = c;
+    o->pos++;
+}
+
+// Emits 'val' in 'base' with at least 'min_digits' digits (zero padded).
+// 32-bit unsigned max is 10 decimal digits, so 12 covers every case.
+static void out_uint(out_t* o, uint32_t val, unsigned base, bool uppercase, int min_digits) {
+    char tmp[12];
+    int n = 0;
+    do {
+        unsigned digit = val % base;
+        tmp[n++] = (char)(digit < 10 ? '0' + digit
+                                     : (uppercase ? 'A' : 'a') + digit - 10);
+        val /= base;
+    } while (val && n < (int)sizeof(tmp));
+    while (n < min_digits && n < (int)sizeof(tmp))
+        tmp[n++] = '0';
+    while (n)
+        out_char(o, tmp[--n]);
+}
+
+static void out_float(out_t* o, float val, int precision) {
+    if (val != val) {
+        out_char(o, 'n'); out_char(o, 'a'); out_char(o, 'n');
+        return;
+    }
+    if (val < 0.0f) {
+        out_char(o, '-');
+        val = -val;
+    }
+    if (val >= 4294967040.0f) { // not representable in the uint32 path
+        out_char(o, 'o'); out_char(o, 'v'); out_char(o, 'f');
+        return;
+    }
+    uint32_t int_part = (uint32_t)val;
+    float frac = val - (float)int_part;
+    out_uint(o, int_part, 10, false, 1);
+    if (precision <= 0)
+        return;
+    out_char(o, '.');
+    while (precision--) {
+        frac *= 10.0f;
+        unsigned digit = (unsigned)frac;
+        if (digit > 9) digit = 9; // guard against float rounding up
+        out_char(o, (char)('0' + digit));
+        frac -= (float)digit;
+    }
+}
+
+int mini_vsnprintf(char* buf, size_t size, const char* fmt, va_list ap) {
+    out_t o = { buf, size ? size - 1 : 0, 0 };
+
+    for (; *fmt; ++fmt) {
+        if (*fmt != '%') {
+            out_char(&o, *fmt);
+            continue;
+        }
+        ++fmt;
+
+        // flags and field width (only zero padding is honored; the other
+        // flags are skipped so the argument list stays aligned)
+        bool zero_pad = false;
+        for (bool in_flags = true; in_flags; ) {
+            switch (*fmt) {
+                case '0': zero_pad = true; ++fmt; break;
+                case '-': case '+': case ' ': case '#': ++fmt; break;
+                default: in_flags = false; break;
+            }
+        }
+        int width = 0;
+        while (*fmt >= '0' && *fmt <= '9')
+            width = width * 10 + (*fmt++ - '0');
+
+        // %f precision
+        int precision = 6;
+        if (*fmt == '.') {
+            ++fmt;
+            precision = 0;
+            while (*fmt >= '0' && *fmt <= '9')
+                precision = precision * 10 + (*fmt++ - '0');
+        }
+
+        // length modifiers are a no-op: int and long are both 32 bit here
+        while (*fmt == 'l')
+            ++fmt;
+
+        switch (*fmt) {
+            case 'c':
+                out_char(&o, (char)va_arg(ap, int));
+                break;
+            case 's': {
+                const char* s = va_arg(ap, const char*);
+                if (!s) s = "(null)";
+                while (*s)
+                    out_char(&o, *s++);
+            } break;
+            case 'd':
+            case 'i': {
+                int32_t v = va_arg(ap, int32_t);
+                if (v < 0) {
+                    out_char(&o, '-');
+                    if (width) --width;
+                    v = -v;
+                }
+                out_uint(&o, (uint32_t)v, 10, false, zero_pad ? width : 1);
+            } break;
+            case 'u':
+                out_uint(&o, va_arg(ap, uint32_t), 10, false, zero_pad ? width : 1);
+                break;
+            case 'x':
+            case 'X':
+                out_uint(&o, va_arg(ap, uint32_t), 16, *fmt == 'X', zero_pad ? width : 1);
+                break;
+            case 'f':
+                out_float(&o, (float)va_arg(ap, double), precision);
+                break;
+            case '%':
+                out_char(&o, '%');
+                break;
+            case '\0':
+                --fmt; // let the loop terminate on the stray '%'
+                break;
+            default:
+                // Unknown conversion: emit it literally so the mistake is
+                // visible in the output instead of silently dropped
+                out_char(&o, '%');
+                out_char(&o, *fmt);
+                break;
+        }
+    }
+
+    if (size)
+        buf[o.pos < o.cap ? o.pos : o.cap] = '\0';
+    return (int)o.pos;
+}
+
+int mini_snprintf(char* buf, size_t size, const char* fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    int len = mini_vsnprintf(buf, size, fmt, ap);
+    va_end(ap);
+    return len;
+}
+
+int mini_printf(const char* fmt, ...) {
+    char buf[128];
+    va_list ap;
+    va_start(ap, fmt);
+    int len = mini_vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    if (len > (int)sizeof(buf) - 1)
+        len = sizeof(buf) - 1;
+    if (len > 0)
+        _write(0, buf, len);
+    return len;
+}
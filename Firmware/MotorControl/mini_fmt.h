@@ -0,0 +1,32 @@
+#ifndef __MINI_FMT_H
+#define __MINI_FMT_H
+
+// Minimal formatted diagnostic output.
+//
+// newlib's printf drags in the full formatting machinery plus heap use
+// (~20 kB of flash for a single boot banner) and is not safe to call
+// from control-adjacent contexts. This writer supports the subset the
+// firmware's diagnostics actually use - %c %s %d %i %u %x %X %f with
+// optional zero-pad flag, field width, %f precision and an ignored 'l'
+// length modifier - formats into bounded caller/stack buffers and never
+// allocates.
+
+#include <stdarg.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int mini_vsnprintf(char* buf, size_t size, const char* fmt, va_list ap);
+int mini_snprintf(char* buf, size_t size, const char* fmt, ...);
+// Formats into a bounded stack buffer and hands the bytes to _write(),
+// i.e. the same stream sinks printf retargets to in communication.cpp.
+// Output longer than one buffer (128 bytes) is truncated.
+int mini_printf(const char* fmt, ...);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __MINI_FMT_H
@@ -3,6 +3,7 @@
 
 #include "drv8301.h"
 #include "odrive_main.h"
+#include "thermistor_lut.hpp"
 
 
 Motor::Motor(const MotorHardwareConfig_t& hw_config,
@@ -50,6 +51,9 @@ bool Motor::arm() {
 void Motor::reset_current_control() {
     current_control_.v_current_control_integral_d = 0.0f;
     current_control_.v_current_control_integral_q = 0.0f;
+    Id_fw_ = 0.0f;
+    fw_mod_margin_ = 2.0f;
+    isr_setpoint_.valid = false;
 }
 
 // @brief Tune the current controller based on phase resistance and inductance
@@ -62,6 +66,25 @@ void Motor::update_current_controller_gains() {
     current_control_.i_gain = plant_pole * current_control_.p_gain;
 }
 
+// Shunt amplifier gain settings, in increasing gain = decreasing range order
+static const std::array<std::pair<float, DRV8301_ShuntAmpGain_e>, 4> kShuntAmpGainChoices = {
+    std::make_pair(10.0f, DRV8301_ShuntAmpGain_10VpV),
+    std::make_pair(20.0f, DRV8301_ShuntAmpGain_20VpV),
+    std::make_pair(40.0f, DRV8301_ShuntAmpGain_40VpV),
+    std::make_pair(80.0f, DRV8301_ShuntAmpGain_80VpV)
+};
+static constexpr float kMargin = 0.90f;
+static constexpr float kTripMargin = 1.0f; // Trip level is at edge of linear range of amplifer
+// Autoranging tuning (see run_gain_autoranging)
+static constexpr float kAutorangeEnvTau = 0.1f;          // [s] current envelope decay time constant
+static constexpr float kAutorangeBackoffFrac = 0.85f;    // back off when the envelope exceeds this fraction of the range
+static constexpr float kAutorangeRaiseHeadroom = 0.7f;   // raise gain only if the envelope fits the halved range with this margin
+static constexpr float kAutorangeDwell = 0.25f;          // [s] minimum time between gain raises
+static constexpr uint8_t kGainSettleCycles = 4;          // current samples to blank around a gain write
+static constexpr uint8_t kSaturationRideThrough = 8;     // clipped cycles tolerated while a backoff is pending
+
+volatile bool Motor::gate_driver_spi_busy_ = false;
+
 // @brief Set up the gate drivers
 void Motor::DRV8301_setup() {
     // for reference:
@@ -72,36 +95,21 @@ void Motor::DRV8301_setup() {
 
     // Solve for exact gain, then snap down to have equal or larger range as requested
     // or largest possible range otherwise
-    static const float kMargin = 0.90f;
-    static const float kTripMargin = 1.0f; // Trip level is at edge of linear range of amplifer
     static const float max_output_swing = 1.35f; // [V] out of amplifier
-    float max_unity_gain_current = kMargin * max_output_swing * hw_config_.shunt_conductance; // [A]
-    float requested_gain = max_unity_gain_current / config_.requested_current_range; // [V/V]
-
-    // Decoding array for snapping gain
-    std::array<std::pair<float, DRV8301_ShuntAmpGain_e>, 4> gain_choices = { 
-        std::make_pair(10.0f, DRV8301_ShuntAmpGain_10VpV),
-        std::make_pair(20.0f, DRV8301_ShuntAmpGain_20VpV),
-        std::make_pair(40.0f, DRV8301_ShuntAmpGain_40VpV),
-        std::make_pair(80.0f, DRV8301_ShuntAmpGain_80VpV)
-    };
-
-    // We use lower_bound in reverse because it snaps up by default, we want to snap down.
-    auto gain_snap_down = std::lower_bound(gain_choices.crbegin(), gain_choices.crend(), requested_gain, 
-    [](std::pair<float, DRV8301_ShuntAmpGain_e> pair, float val){
-        return pair.first > val;
-    });
-
-    // If we snap to outside the array, clip to smallest val
-    if(gain_snap_down == gain_choices.crend())
-       --gain_snap_down;
+    max_unity_gain_current_ = kMargin * max_output_swing * hw_config_.shunt_conductance; // [A]
+    float requested_gain = max_unity_gain_current_ / config_.requested_current_range; // [V/V]
+
+    // Snap down: the highest table gain whose range still covers the
+    // request, or the lowest gain (largest range) if none does
+    uint8_t gain_idx = 0;
+    for (uint8_t i = 0; i < kShuntAmpGainChoices.size(); ++i) {
+        if (kShuntAmpGainChoices[i].first <= requested_gain)
+            gain_idx = i;
+    }
+    gain_idx_min_ = gain_idx;
 
     // Values for current controller
-    phase_current_rev_gain_ = 1.0f / gain_snap_down->first;
-    // Clip all current control to actual usable range
-    current_control_.max_allowed_current = max_unity_gain_current * phase_current_rev_gain_;
-    // Set trip level
-    current_control_.overcurrent_trip_level = (kTripMargin / kMargin) * current_control_.max_allowed_current;
+    apply_shunt_amp_gain(gain_idx);
 
     // We now have the gain settings we want to use, lets set up DRV chip
     DRV_SPI_8301_Vars_t* local_regs = &gate_driver_regs_;
@@ -111,7 +119,7 @@ void Motor::DRV8301_setup() {
     local_regs->Ctrl_Reg_1.OC_MODE = DRV8301_OcMode_LatchShutDown;
     // Overcurrent set to approximately 150A at 100degC. This may need tweaking.
     local_regs->Ctrl_Reg_1.OC_ADJ_SET = DRV8301_VdsLevel_0p730_V;
-    local_regs->Ctrl_Reg_2.GAIN = gain_snap_down->second;
+    local_regs->Ctrl_Reg_2.GAIN = kShuntAmpGainChoices[gain_idx].second;
 
     local_regs->SndCmd = true;
     DRV8301_writeData(&gate_driver_, local_regs);
@@ -119,6 +127,87 @@ void Motor::DRV8301_setup() {
     DRV8301_readData(&gate_driver_, local_regs);
 }
 
+// @brief Derives the software-side conversion factor and current limits
+// from a shunt amplifier gain table entry.
+void Motor::apply_shunt_amp_gain(uint8_t gain_idx) {
+    gain_idx_ = gain_idx;
+    phase_current_rev_gain_ = 1.0f / kShuntAmpGainChoices[gain_idx].first;
+    // Clip all current control to actual usable range
+    current_control_.max_allowed_current = max_unity_gain_current_ * phase_current_rev_gain_;
+    // Set trip level
+    current_control_.overcurrent_trip_level = (kTripMargin / kMargin) * current_control_.max_allowed_current;
+}
+
+// @brief Programs a new shunt amplifier gain into the DRV8301 at runtime.
+// Runs on the axis worker thread. The shared SPI bus is claimed so the
+// encoder ISR skips its DMA transactions meanwhile (that path tolerates
+// missed cycles), and the current samples are blanked across the write
+// plus the amplifier settling time so no sample is ever converted with
+// the wrong rev gain.
+bool Motor::set_shunt_amp_gain(uint8_t gain_idx) {
+    SPI_HandleTypeDef* spi = gate_driver_config_.spi;
+    gate_driver_spi_busy_ = true;
+    // Wait out an encoder transaction already in flight (a single 16-bit
+    // frame); bounded in case the bus wedged
+    uint32_t patience = 10000;
+    while (spi->State != HAL_SPI_STATE_READY) {
+        if (--patience == 0) {
+            gate_driver_spi_busy_ = false;
+            return false;
+        }
+    }
+    current_meas_blank_cycles_ = kGainSettleCycles;
+    gate_driver_regs_.Ctrl_Reg_2.GAIN = kShuntAmpGainChoices[gain_idx].second;
+    gate_driver_regs_.SndCmd = true;
+    DRV8301_writeData(&gate_driver_, &gate_driver_regs_);
+    gate_driver_spi_busy_ = false;
+    apply_shunt_amp_gain(gain_idx);
+    return true;
+}
+
+// @brief Dynamic current sense autoranging. Loads that cruise far below
+// requested_current_range pay the full-range quantization noise all the
+// time; this tracks a decaying envelope of the phase current amplitude and
+// raises the amplifier gain (shrinking the range and the noise floor) when
+// the envelope comfortably fits a smaller range, backing off immediately
+// when it approaches the current one. A fast transient that clips the
+// amplifier before the backoff lands is ridden through by FOC_current
+// (see the saturation check there). Runs once per control cycle on the
+// worker thread.
+void Motor::run_gain_autoranging() {
+    if (!config_.enable_gain_autoranging)
+        return;
+
+    float I_phase_max = std::max(fabsf(current_meas_.phB), fabsf(current_meas_.phC));
+    current_envelope_ *= 1.0f - current_meas_period / kAutorangeEnvTau;
+    if (I_phase_max > current_envelope_)
+        current_envelope_ = I_phase_max;
+    if (gain_dwell_cycles_ < UINT32_MAX)
+        ++gain_dwell_cycles_;
+    if (current_meas_blank_cycles_)
+        return; // a gain write is still settling
+
+    // Back off (lower gain, larger range) as soon as the range gets tight
+    if ((gain_downshift_pending_ ||
+            current_envelope_ > kAutorangeBackoffFrac * current_control_.max_allowed_current)) {
+        gain_downshift_pending_ = false;
+        if (gain_idx_ > gain_idx_min_ && set_shunt_amp_gain(gain_idx_ - 1))
+            gain_dwell_cycles_ = 0;
+        return;
+    }
+
+    // Raise the gain only after a quiet dwell period, and only if the
+    // envelope fits the halved range with margin
+    if (gain_idx_ + 1u < kShuntAmpGainChoices.size() &&
+            gain_dwell_cycles_ >= (uint32_t)(kAutorangeDwell * (float)current_meas_hz)) {
+        float next_range = 0.5f * current_control_.max_allowed_current;
+        if (current_envelope_ < kAutorangeRaiseHeadroom * next_range) {
+            if (set_shunt_amp_gain(gain_idx_ + 1))
+                gain_dwell_cycles_ = 0;
+        }
+    }
+}
+
 // @brief Checks if the gate driver is in operational state.
 // @returns: true if the gate driver is OK (no fault), false otherwise
 bool Motor::check_DRV_fault() {
@@ -137,7 +226,10 @@ bool Motor::check_DRV_fault() {
 }
 
 void Motor::set_error(Motor::Error_t error){
+    axis_->log_error(Axis::ERROR_SOURCE_MOTOR, (uint32_t)(error & ~error_));
     error_ |= error;
+    // Derived summary bit; deliberately not logged so the first-failure
+    // log points at the component-level root cause
     axis_->error_ |= Axis::ERROR_MOTOR_FAILED;
     safety_critical_disarm_motor_pwm(*this);
     update_brake_current();
@@ -146,14 +238,31 @@ void Motor::set_error(Motor::Error_t error){
 float Motor::get_inverter_temp() {
     float adc = adc_measurements_[hw_config_.inverter_thermistor_adc_ch];
     float normalized_voltage = adc / adc_full_scale;
-    return horner_fma(normalized_voltage, thermistor_poly_coeffs, thermistor_num_coeffs);
+    return thermistor_lut_temp(normalized_voltage);
 }
 
+// @brief Derates the current limit linearly from full current_lim at
+// inverter_temp_limit_lower down to zero at inverter_temp_limit_upper.
+// With the shared heatsink policy enabled (both DRV stages sit on the
+// same heatsink) the hottest stage on the board additionally derates
+// every axis through the board-level curve, weighted per axis, so one
+// hot axis can't cook its neighbor while the neighbor's own thermistor
+// still reports a comfortable margin.
 bool Motor::update_thermal_limits() {
     float fet_temp = get_inverter_temp();
     float temp_margin = config_.inverter_temp_limit_upper - fet_temp;
     float derating_range = config_.inverter_temp_limit_upper - config_.inverter_temp_limit_lower;
-    thermal_current_lim_ = config_.current_lim * (temp_margin / derating_range);
+    float derating = temp_margin / derating_range;
+    if (board_config.enable_shared_thermal_derating) {
+        float board_temp = fet_temp;
+        for (size_t i = 0; i < AXIS_COUNT; ++i)
+            board_temp = std::max(board_temp, axes[i]->motor_.get_inverter_temp());
+        float shared_margin = board_config.shared_thermal_limit_upper - board_temp;
+        float shared_range = board_config.shared_thermal_limit_upper - board_config.shared_thermal_limit_lower;
+        float shared_derating = 1.0f - config_.shared_thermal_weight * (1.0f - shared_margin / shared_range);
+        derating = std::min(derating, shared_derating);
+    }
+    thermal_current_lim_ = config_.current_lim * derating;
     if (!(thermal_current_lim_ >= 0.0f)) { //Funny polarity to also catch NaN
         thermal_current_lim_ = 0.0f;
     }
@@ -164,31 +273,89 @@ bool Motor::update_thermal_limits() {
     return true;
 }
 
+// @brief Winding I^2t observer: a one-pole filter of the measured I^2 with
+// the winding thermal time constant stands in for the (unmeasurable) copper
+// temperature rise. While the filtered value sits below the continuous
+// rating's I^2, a budget for transient overcurrent remains and the limit is
+// interpolated between current_lim (peak) and motor_current_continuous;
+// once the budget is spent the limit collapses to the continuous rating,
+// which is sustainable indefinitely. Runs every control cycle - decimating
+// it would alias the current waveform into the integral.
+bool Motor::update_motor_thermal_model() {
+    if (!config_.motor_thermal_model_enable || !(config_.motor_thermal_tau > 0.0f)) {
+        motor_I_sq_filt_ = 0.0f;
+        motor_thermal_budget_ = 1.0f;
+        motor_thermal_current_lim_ = config_.current_lim;
+        return true;
+    }
+    float I_cont_sq = SQ(config_.motor_current_continuous);
+    float I_sq = SQ(current_control_.Iq_measured) + SQ(current_control_.Id_measured);
+    motor_I_sq_filt_ += (I_sq - motor_I_sq_filt_) * (current_meas_period / config_.motor_thermal_tau);
+    float budget = 1.0f - motor_I_sq_filt_ / I_cont_sq;
+    if (budget < 0.0f)
+        budget = 0.0f;
+    motor_thermal_budget_ = budget;
+    motor_thermal_current_lim_ = sqrtf(I_cont_sq + (SQ(config_.current_lim) - I_cont_sq) * budget);
+    // The foldback should keep the observer pinned at the continuous rating;
+    // getting past it by the trip tolerance means the limit is not holding.
+    if (motor_I_sq_filt_ > SQ(config_.current_lim_tolerance) * I_cont_sq) {
+        set_error(ERROR_MOTOR_THERMAL_BUDGET_EXHAUSTED);
+        return false;
+    }
+    return true;
+}
+
 bool Motor::do_checks() {
     if (!check_DRV_fault()) {
         set_error(ERROR_DRV_FAULT);
         return false;
     }
-    if (!update_thermal_limits()) {
+    // Temperature moves on a timescale of seconds, so the thermal check is
+    // decimated instead of running every control cycle. The derating uses
+    // the thermal_current_lim_ computed at the last check.
+    if (thermal_check_cycle_ == 0) {
+        if (!update_thermal_limits()) {
+            //error already set in function
+            return false;
+        }
+    }
+    if (++thermal_check_cycle_ >= config_.thermal_check_decimation)
+        thermal_check_cycle_ = 0;
+    if (!update_motor_thermal_model()) {
         //error already set in function
         return false;
     }
+    // Refresh the cached limit every cycle: the gimbal hardware limit
+    // tracks vbus_voltage, which is sampled continuously.
+    update_effective_current_lim();
     return true;
 }
 
-float Motor::effective_current_lim() {
+// @brief Recomputes the effective current limit and the squared trip
+// threshold derived from it. Runs once per control cycle (from do_checks)
+// so that Controller::update and FOC_current both consume the cached
+// values instead of re-evaluating the min chain.
+void Motor::update_effective_current_lim() {
     // Configured limit
     float current_lim = config_.current_lim;
     // Hardware limit
-    if (axis_->motor_.config_.motor_type == Motor::MOTOR_TYPE_GIMBAL) {
+    if (config_.motor_type == Motor::MOTOR_TYPE_GIMBAL) {
         current_lim = std::min(current_lim, 0.98f*one_by_sqrt3*vbus_voltage);
     } else {
-        current_lim = std::min(current_lim, axis_->motor_.current_control_.max_allowed_current);
+        current_lim = std::min(current_lim, current_control_.max_allowed_current);
     }
     // Thermal limit
     current_lim = std::min(current_lim, thermal_current_lim_);
+    // Winding thermal budget (I^2t observer)
+    if (config_.motor_thermal_model_enable)
+        current_lim = std::min(current_lim, motor_thermal_current_lim_);
 
-    return current_lim;
+    effective_current_lim_ = current_lim;
+    I_trip_squared_ = SQ(config_.current_lim_tolerance * current_lim);
+}
+
+float Motor::effective_current_lim() {
+    return effective_current_lim_;
 }
 
 void Motor::log_timing(TimingLog_t log_idx) {
@@ -214,8 +381,8 @@ float Motor::phase_current_from_adcval(uint32_t ADCValue) {
 
 // TODO check Ibeta balance to verify good motor connection
 bool Motor::measure_phase_resistance(float test_current, float max_voltage) {
-    static const float kI = 10.0f;                                 // [(V/s)/A]
-    static const int num_test_cycles = static_cast<int>(3.0f / CURRENT_MEAS_PERIOD); // Test runs for 3s
+    static constexpr float kI = 10.0f;                                 // [(V/s)/A]
+    static constexpr int num_test_cycles = static_cast<int>(3.0f / CURRENT_MEAS_PERIOD); // Test runs for 3s
     float test_voltage = 0.0f;
     
     size_t i = 0;
@@ -282,13 +449,127 @@ bool Motor::measure_phase_inductance(float voltage_low, float voltage_high) {
 }
 
 
+// @brief Combined phase resistance and inductance estimation.
+// Excites the motor with a square wave voltage along phase A whose DC bias is
+// servoed towards test_current, and fits the discrete first order model
+//   delta_i = (T/L) * u - (T*R/L) * i
+// with a recursive least squares estimator, so both parameters converge
+// concurrently. The enqueue-to-measurement transport delay is between one and
+// two cycles, so the voltage gain is spread over two taps (u[k-1], u[k-2])
+// and L is recovered from their sum, which is exact for any delay in that
+// range. Exits early once the derived R and L estimates have settled.
+bool Motor::measure_phase_R_L(float test_current, float max_voltage) {
+    static constexpr float kI = 10.0f; // [(V/s)/A] DC bias servo gain
+    static constexpr int max_cycles = static_cast<int>(1.5f / CURRENT_MEAS_PERIOD);
+    static constexpr int check_interval = 256; // convergence check period [cycles]
+    static constexpr int settle_checks = 4;    // consecutive stable checks to exit
+
+    float bias_voltage = 0.0f;
+    float prev_Ialpha = 0.0f;
+    float u_nm1 = 0.0f, u_nm2 = 0.0f; // enqueued voltage history
+
+    // RLS state: theta = [a1, a2, T*R/L] for
+    // delta_i = a1 * u[k-1] + a2 * u[k-2] - (T*R/L) * i, with a1+a2 = T/L.
+    // P starts large enough that the zero initial guess carries no weight.
+    float theta[3] = { 0.0f, 0.0f, 0.0f };
+    float P[3][3] = {
+        { 1e2f, 0.0f, 0.0f },
+        { 0.0f, 1e2f, 0.0f },
+        { 0.0f, 0.0f, 1e2f },
+    };
+
+    int cycle = 0;
+    int stable_count = 0;
+    float R_prev = 0.0f, L_prev = 0.0f;
+    bool converged = false;
+
+    axis_->run_control_loop([&](){
+        float Ialpha = -(current_meas_.phB + current_meas_.phC);
+
+        if (cycle >= 2) {
+            float y = Ialpha - prev_Ialpha;
+            float x[3] = { u_nm1, u_nm2, -prev_Ialpha };
+            float Px[3];
+            for (int i = 0; i < 3; ++i)
+                Px[i] = P[i][0] * x[0] + P[i][1] * x[1] + P[i][2] * x[2];
+            float denom = 1.0f + x[0] * Px[0] + x[1] * Px[1] + x[2] * Px[2];
+            float err = y - (theta[0] * x[0] + theta[1] * x[1] + theta[2] * x[2]);
+            for (int i = 0; i < 3; ++i) {
+                float k = Px[i] / denom;
+                theta[i] += k * err;
+                for (int j = 0; j < 3; ++j)
+                    P[i][j] -= k * Px[j];
+            }
+        }
+        prev_Ialpha = Ialpha;
+
+        // Excitation: square wave at half the sample rate on top of the
+        // servoed DC bias. The clamped (actually applied) voltage goes into
+        // the regressor history, so clamping doesn't bias the fit.
+        bias_voltage += (kI * current_meas_period) * (test_current - Ialpha);
+        if (bias_voltage > max_voltage || bias_voltage < -max_voltage)
+            return set_error(ERROR_PHASE_RESISTANCE_OUT_OF_RANGE), false;
+        float test_voltage = bias_voltage + ((cycle & 1) ? 0.5f : -0.5f) * max_voltage;
+        if (test_voltage > max_voltage) test_voltage = max_voltage;
+        if (test_voltage < -max_voltage) test_voltage = -max_voltage;
+
+        if (!enqueue_voltage_timings(test_voltage, 0.0f))
+            return false; // error set inside enqueue_voltage_timings
+        log_timing(TIMING_LOG_MEAS_R);
+        u_nm2 = u_nm1;
+        u_nm1 = test_voltage;
+
+        // Early exit once the derived parameters stop moving
+        float T_by_L = theta[0] + theta[1];
+        if ((++cycle % check_interval) == 0 && T_by_L > 0.0f) {
+            float L = current_meas_period / T_by_L;
+            float R = theta[2] / T_by_L;
+            if (fabsf(R - R_prev) < 0.01f * fabsf(R)
+                && fabsf(L - L_prev) < 0.01f * fabsf(L))
+                ++stable_count;
+            else
+                stable_count = 0;
+            R_prev = R;
+            L_prev = L;
+            if (stable_count >= settle_checks) {
+                converged = true;
+                return false;
+            }
+        }
+        return cycle < max_cycles;
+    });
+    if (axis_->error_ != Axis::ERROR_NONE)
+        return false;
+    (void) converged; // on timeout the final estimate is used, as before
+
+    float T_by_L = theta[0] + theta[1];
+    if (!(T_by_L > 0.0f))
+        return set_error(ERROR_PHASE_INDUCTANCE_OUT_OF_RANGE), false;
+    float L = current_meas_period / T_by_L;
+    float R = theta[2] / T_by_L;
+    if (L < 2e-6f || L > 4000e-6f)
+        return set_error(ERROR_PHASE_INDUCTANCE_OUT_OF_RANGE), false;
+    if (R < 0.005f || R > 10.0f)
+        return set_error(ERROR_PHASE_RESISTANCE_OUT_OF_RANGE), false;
+
+    config_.phase_resistance = R;
+    config_.phase_inductance = L;
+    return true;
+}
+
+
 bool Motor::run_calibration() {
     float R_calib_max_voltage = config_.resistance_calib_max_voltage;
     if (config_.motor_type == MOTOR_TYPE_HIGH_CURRENT) {
-        if (!measure_phase_resistance(config_.calibration_current, R_calib_max_voltage))
-            return false;
-        if (!measure_phase_inductance(-R_calib_max_voltage, R_calib_max_voltage))
-            return false;
+        if (config_.fast_calibration) {
+            if (!measure_phase_R_L(config_.calibration_current, R_calib_max_voltage))
+                return false;
+        } else {
+            if (!measure_phase_resistance(config_.calibration_current, R_calib_max_voltage))
+                return false;
+            if (!measure_phase_inductance(-R_calib_max_voltage, R_calib_max_voltage))
+                return false;
+        }
     } else if (config_.motor_type == MOTOR_TYPE_GIMBAL) {
         // no calibration needed
     } else {
@@ -302,18 +583,28 @@ bool Motor::run_calibration() {
 }
 
 bool Motor::enqueue_modulation_timings(float mod_alpha, float mod_beta) {
-    float tA, tB, tC;
-    if (SVM(mod_alpha, mod_beta, &tA, &tB, &tC) != 0)
+    // SVM with the CCR scale folded in (see SVM_timings): the timings come
+    // out directly in timer clocks, so the only float->int step left is
+    // the one unavoidable VCVT per phase. (A Q15 integer pipeline would
+    // have to convert the float modulation inputs first, so on the M4F it
+    // cannot beat this.)
+    if (SVM_timings(mod_alpha, mod_beta, TIM_1_8_PERIOD_CLOCKS,
+                    &next_timings_[0], &next_timings_[1], &next_timings_[2]) != 0)
         return set_error(ERROR_MODULATION_MAGNITUDE), false;
-    next_timings_[0] = (uint16_t)(tA * (float)TIM_1_8_PERIOD_CLOCKS);
-    next_timings_[1] = (uint16_t)(tB * (float)TIM_1_8_PERIOD_CLOCKS);
-    next_timings_[2] = (uint16_t)(tC * (float)TIM_1_8_PERIOD_CLOCKS);
     next_timings_valid_ = true;
+    // Deadline margin: clocks left until pwm_trig_adc_cb's load point
+    // checks next_timings_valid_ (the same headroom proxy FOC_update_isr
+    // snapshots into isr_deadline_margin_, but accumulated into the
+    // profiler histogram so worst cases survive between readouts).
+    static const uint16_t clocks_per_cnt = (uint16_t)((float)TIM_1_8_CLOCK_HZ / (float)TIM_APB1_CLOCK_HZ);
+    uint32_t elapsed = clocks_per_cnt * htim13.Instance->CNT;
+    profiler_.record(PROFILER_STAGE_TIMING_MARGIN,
+            elapsed < TIM_1_8_PERIOD_CLOCKS ? TIM_1_8_PERIOD_CLOCKS - elapsed : 0);
     return true;
 }
 
 bool Motor::enqueue_voltage_timings(float v_alpha, float v_beta) {
-    float vfactor = 1.0f / ((2.0f / 3.0f) * vbus_voltage);
+    float vfactor = vbus_constants.V_to_mod;
     float mod_alpha = vfactor * v_alpha;
     float mod_beta = vfactor * v_beta;
     if (!enqueue_modulation_timings(mod_alpha, mod_beta))
@@ -324,42 +615,59 @@ bool Motor::enqueue_voltage_timings(float v_alpha, float v_beta) {
 
 // We should probably make FOC Current call FOC Voltage to avoid duplication.
 bool Motor::FOC_voltage(float v_d, float v_q, float pwm_phase) {
-    float c = our_arm_cos_f32(pwm_phase);
-    float s = our_arm_sin_f32(pwm_phase);
+    uint32_t profiler_start = Profiler::enter();
+    float s, c;
+    fast_sincos(pwm_phase, &s, &c);
     float v_alpha = c*v_d - s*v_q;
     float v_beta  = c*v_q + s*v_d;
-    return enqueue_voltage_timings(v_alpha, v_beta);
+    bool success = enqueue_voltage_timings(v_alpha, v_beta);
+    profiler_.leave(PROFILER_STAGE_FOC_VOLTAGE, profiler_start);
+    return success;
 }
 
-bool Motor::FOC_current(float Id_des, float Iq_des, float I_phase, float pwm_phase) {
+bool Motor::FOC_current(float Id_des, float Iq_des, float I_phase, float pwm_phase, float phase_vel) {
+    uint32_t profiler_start = Profiler::enter();
     // Syntactic sugar
     CurrentControl_t& ictrl = current_control_;
 
     // For Reporting
+    ictrl.Id_setpoint = Id_des;
     ictrl.Iq_setpoint = Iq_des;
 
     // Check for current sense saturation
     if (fabsf(current_meas_.phB) > ictrl.overcurrent_trip_level
      || fabsf(current_meas_.phC) > ictrl.overcurrent_trip_level) {
-        set_error(ERROR_CURRENT_SENSE_SATURATION);
-        return false;
+        // With autoranging the amplifier may be sitting on a reduced range
+        // when a transient hits: flag a backoff and ride the clipped samples
+        // out briefly instead of tripping, as long as a larger range exists.
+        if (config_.enable_gain_autoranging && gain_idx_ > gain_idx_min_
+         && ++saturation_cycle_cnt_ <= kSaturationRideThrough) {
+            gain_downshift_pending_ = true;
+        } else {
+            set_error(ERROR_CURRENT_SENSE_SATURATION);
+            return false;
+        }
+    } else {
+        saturation_cycle_cnt_ = 0;
     }
 
     // Clarke transform
     float Ialpha = -current_meas_.phB - current_meas_.phC;
     float Ibeta = one_by_sqrt3 * (current_meas_.phB - current_meas_.phC);
 
+    // Fused sin/cos for the Park angle and the inverse-Park angle
+    float s_I, c_I, s_p, c_p;
+    fast_sincos2(I_phase, pwm_phase, &s_I, &c_I, &s_p, &c_p);
+
     // Park transform
-    float c_I = our_arm_cos_f32(I_phase);
-    float s_I = our_arm_sin_f32(I_phase);
     float Id = c_I * Ialpha + s_I * Ibeta;
     float Iq = c_I * Ibeta - s_I * Ialpha;
     ictrl.Iq_measured += ictrl.I_measured_report_filter_k * (Iq - ictrl.Iq_measured);
     ictrl.Id_measured += ictrl.I_measured_report_filter_k * (Id - ictrl.Id_measured);
 
-    // Check for violation of current limit
-    float I_trip = config_.current_lim_tolerance * effective_current_lim();
-    if (SQ(Id) + SQ(Iq) > SQ(I_trip)) {
+    // Check for violation of current limit (threshold cached, squared, by
+    // update_effective_current_lim)
+    if (SQ(Id) + SQ(Iq) > I_trip_squared_) {
         set_error(ERROR_CURRENT_UNSTABLE);
         return false;
     }
@@ -368,19 +676,34 @@ bool Motor::FOC_current(float Id_des, float Iq_des, float I_phase, float pwm_pha
     float Ierr_d = Id_des - Id;
     float Ierr_q = Iq_des - Iq;
 
-    // TODO look into feed forward terms (esp omega, since PI pole maps to RL tau)
     // Apply PI control
     float Vd = ictrl.v_current_control_integral_d + Ierr_d * ictrl.p_gain;
     float Vq = ictrl.v_current_control_integral_q + Ierr_q * ictrl.p_gain;
 
-    float mod_to_V = (2.0f / 3.0f) * vbus_voltage;
-    float V_to_mod = 1.0f / mod_to_V;
+    // Decoupling feed-forward (see config). Computed from the setpoints
+    // rather than the measured currents so measurement noise isn't fed
+    // back into the voltage command; at the operating point they coincide.
+    if (config_.R_wL_FF_enable) {
+        Vd -= phase_vel * config_.phase_inductance * Iq_des;
+        Vq += phase_vel * config_.phase_inductance * Id_des;
+        Vd += config_.phase_resistance * Id_des;
+        Vq += config_.phase_resistance * Iq_des;
+    }
+    if (config_.bemf_FF_enable) {
+        Vq += phase_vel * axis_->sensorless_estimator_.config_.pm_flux_linkage;
+    }
+
+    // Reciprocals are precomputed once per PWM cycle in vbus_sense_adc_cb
+    float mod_to_V = vbus_constants.mod_to_V;
+    float V_to_mod = vbus_constants.V_to_mod;
     float mod_d = V_to_mod * Vd;
     float mod_q = V_to_mod * Vq;
 
     // Vector modulation saturation, lock integrator if saturated
     // TODO make maximum modulation configurable
     float mod_scalefactor = 0.80f * sqrt3_by_2 * 1.0f / sqrtf(mod_d * mod_d + mod_q * mod_q);
+    // Saturation feedback for the field weakening scheduler
+    fw_mod_margin_ = mod_scalefactor;
     if (mod_scalefactor < 1.0f) {
         mod_d *= mod_scalefactor;
         mod_q *= mod_scalefactor;
@@ -395,9 +718,7 @@ bool Motor::FOC_current(float Id_des, float Iq_des, float I_phase, float pwm_pha
     // Compute estimated bus current
     ictrl.Ibus = mod_d * Id + mod_q * Iq;
 
-    // Inverse park transform
-    float c_p = our_arm_cos_f32(pwm_phase);
-    float s_p = our_arm_sin_f32(pwm_phase);
+    // Inverse park transform (sin/cos computed together with the Park angle above)
     float mod_alpha = c_p * mod_d - s_p * mod_q;
     float mod_beta  = c_p * mod_q + s_p * mod_d;
 
@@ -409,31 +730,171 @@ bool Motor::FOC_current(float Id_des, float Iq_des, float I_phase, float pwm_pha
     if (!enqueue_modulation_timings(mod_alpha, mod_beta))
         return false; // error set inside enqueue_modulation_timings
     log_timing(TIMING_LOG_FOC_CURRENT);
+    profiler_.leave(PROFILER_STAGE_FOC_CURRENT, profiler_start);
 
     return true;
 }
 
 
+// @brief Splits the commanded torque current into d/q setpoints.
+//
+// Field weakening is scheduled as a pure integrator on the modulation
+// saturation feedback stored by the previous FOC_current cycle: while the
+// modulation is clipped Id ramps negative (weakening the field and buying
+// back voltage headroom), and while headroom exists it relaxes back toward
+// zero. MTPA allocates part of a salient motor's current to the d axis
+// where the reluctance torque makes it cheaper than q-axis current. The
+// q-axis setpoint is derated so the total vector stays on the current
+// limit circle.
+void Motor::allocate_dq_currents(float& Id_des, float& Iq_des, float phase_vel) {
+    (void) phase_vel;
+    // Aim for 5% modulation headroom so the current controller retains
+    // authority for transients even at the weakened operating point.
+    static constexpr float kModMarginTarget = 1.05f;
+
+    if (config_.field_weakening_enable) {
+        float err = fw_mod_margin_ - kModMarginTarget;
+        if (err > 1.0f)
+            err = 1.0f; // far from saturation: bounded relax rate
+        Id_fw_ += config_.field_weakening_ramp * current_meas_period * err;
+        if (Id_fw_ > 0.0f)
+            Id_fw_ = 0.0f;
+        if (Id_fw_ < -config_.field_weakening_max_Id)
+            Id_fw_ = -config_.field_weakening_max_Id;
+        Id_des = Id_fw_;
+    }
+
+    if (config_.mtpa_enable && config_.mtpa_saliency > 0.0f) {
+        // MTPA for Lq > Ld: Id = psi/(4 dL) - sqrt((psi/(4 dL))^2 + Iq^2/2)
+        float psi_over_4dL = axis_->sensorless_estimator_.config_.pm_flux_linkage
+                           / (4.0f * config_.mtpa_saliency);
+        float Id_mtpa = psi_over_4dL - sqrtf(SQ(psi_over_4dL) + 0.5f * SQ(Iq_des));
+        // The deeper of the two d-axis demands wins; they serve the same
+        // voltage/torque budget and don't add.
+        Id_des = std::min(Id_des, Id_mtpa);
+    }
+
+    // Keep the total current vector inside the limit circle: the d-axis
+    // allocation comes out of the q-axis budget, not on top of it.
+    float ilim = effective_current_lim_;
+    float Iq_max = (fabsf(Id_des) < ilim) ? sqrtf(SQ(ilim) - SQ(Id_des)) : 0.0f;
+    if (Iq_des > Iq_max)
+        Iq_des = Iq_max;
+    if (Iq_des < -Iq_max)
+        Iq_des = -Iq_max;
+}
+
+// @brief Executes the current (or voltage, for gimbal motors) command for one
+// cycle. TYPE is a template parameter so all type comparisons are resolved at
+// compile time; update() and FOC_update_isr() reach the active specialization
+// through a single indirect call instead of a branch chain.
+template<Motor::MotorType_t TYPE>
+bool Motor::apply_current_kernel(float current_setpoint, float phase, float pwm_phase, float phase_vel) {
+    if (TYPE == MOTOR_TYPE_HIGH_CURRENT) {
+        float Id_des = 0.0f;
+        float Iq_des = current_setpoint;
+        if (config_.field_weakening_enable || config_.mtpa_enable)
+            allocate_dq_currents(Id_des, Iq_des, phase_vel);
+        return FOC_current(Id_des, Iq_des, phase, pwm_phase, phase_vel);
+    } else {
+        // In gimbal motor mode, current is reinterptreted as voltage.
+        (void) phase_vel;
+        float v_d = 0.0f;
+        float v_q = current_setpoint;
+        if (config_.gimbal_ir_comp_enable) {
+            // Same Clarke + Park as FOC_current, but feeding forward instead
+            // of closing a loop: add the resistive drop of the measured
+            // currents back onto the command so the back-EMF sees the full
+            // commanded voltage. The report filter doubles as the noise
+            // filter on this positive current feedback.
+            float Ialpha = -current_meas_.phB - current_meas_.phC;
+            float Ibeta = one_by_sqrt3 * (current_meas_.phB - current_meas_.phC);
+            float s, c;
+            fast_sincos(phase, &s, &c);
+            CurrentControl_t& ictrl = current_control_;
+            float Id = c * Ialpha + s * Ibeta;
+            float Iq = c * Ibeta - s * Ialpha;
+            ictrl.Id_measured += ictrl.I_measured_report_filter_k * (Id - ictrl.Id_measured);
+            ictrl.Iq_measured += ictrl.I_measured_report_filter_k * (Iq - ictrl.Iq_measured);
+            float R_comp = config_.gimbal_ir_comp_gain * config_.phase_resistance;
+            v_d += R_comp * ictrl.Id_measured;
+            v_q += R_comp * ictrl.Iq_measured;
+        }
+        return FOC_voltage(v_d, v_q, pwm_phase);
+    }
+}
+
+bool Motor::apply_current_invalid(float current_setpoint, float phase, float pwm_phase, float phase_vel) {
+    (void) current_setpoint; (void) phase; (void) pwm_phase; (void) phase_vel;
+    set_error(ERROR_NOT_IMPLEMENTED_MOTOR_TYPE);
+    return false;
+}
+
+// @brief Re-binds current_kernel_ to the specialization matching the
+// configured motor type. Called from the control path whenever the cached
+// type goes stale, i.e. once after boot and after each type change.
+void Motor::select_current_kernel() {
+    kernel_motor_type_ = config_.motor_type;
+    switch (kernel_motor_type_) {
+        case MOTOR_TYPE_HIGH_CURRENT:
+            current_kernel_ = &Motor::apply_current_kernel<MOTOR_TYPE_HIGH_CURRENT>;
+            break;
+        case MOTOR_TYPE_GIMBAL:
+            current_kernel_ = &Motor::apply_current_kernel<MOTOR_TYPE_GIMBAL>;
+            break;
+        default:
+            current_kernel_ = &Motor::apply_current_invalid;
+            break;
+    }
+}
+
+// @brief Runs the current controller in the ADC interrupt context.
+//
+// Called from pwm_trig_adc_cb when config_.current_control_in_isr is set.
+// The setpoints were published by the axis thread via update() one cycle
+// ago, so the phase is extrapolated by one measurement period.
+bool Motor::FOC_update_isr() {
+    if (!isr_setpoint_.valid)
+        return false;
+
+    float phase = wrap_pm_pi(isr_setpoint_.phase + isr_setpoint_.phase_vel * current_meas_period);
+    float pwm_phase = phase + 1.5f * current_meas_period * isr_setpoint_.phase_vel;
+
+    if (config_.motor_type != kernel_motor_type_ || !current_kernel_)
+        select_current_kernel();
+    bool success = (this->*current_kernel_)(isr_setpoint_.current_setpoint, phase, pwm_phase, isr_setpoint_.phase_vel);
+
+    // Snapshot the remaining headroom until the next timer update event.
+    static const uint16_t clocks_per_cnt = (uint16_t)((float)TIM_1_8_CLOCK_HZ / (float)TIM_APB1_CLOCK_HZ);
+    uint32_t elapsed = clocks_per_cnt * htim13.Instance->CNT;
+    isr_deadline_margin_ = (elapsed < TIM_1_8_PERIOD_CLOCKS)
+                         ? (uint16_t)(TIM_1_8_PERIOD_CLOCKS - elapsed) : 0;
+
+    return success;
+}
+
 bool Motor::update(float current_setpoint, float phase, float phase_vel) {
+    run_gain_autoranging();
     current_setpoint *= config_.direction;
     phase *= config_.direction;
     phase_vel *= config_.direction;
 
+    if (config_.current_control_in_isr) {
+        // Publish the setpoints for the ADC interrupt. The actual control
+        // math runs in FOC_update_isr, right after the current sample.
+        uint32_t mask = cpu_enter_critical();
+        isr_setpoint_.current_setpoint = current_setpoint;
+        isr_setpoint_.phase = phase;
+        isr_setpoint_.phase_vel = phase_vel;
+        isr_setpoint_.valid = true;
+        cpu_exit_critical(mask);
+        return error_ == ERROR_NONE;
+    }
+
     float pwm_phase = phase + 1.5f * current_meas_period * phase_vel;
 
     // Execute current command
-    // TODO: move this into the mot
-    if (config_.motor_type == MOTOR_TYPE_HIGH_CURRENT) {
-        if(!FOC_current(0.0f, current_setpoint, phase, pwm_phase)){
-            return false;
-        }
-    } else if (config_.motor_type == MOTOR_TYPE_GIMBAL) {
-        //In gimbal motor mode, current is reinterptreted as voltage.
-        if(!FOC_voltage(0.0f, current_setpoint, pwm_phase))
-            return false;
-    } else {
-        set_error(ERROR_NOT_IMPLEMENTED_MOTOR_TYPE);
-        return false;
-    }
-    return true;
+    if (config_.motor_type != kernel_motor_type_ || !current_kernel_)
+        select_current_kernel();
+    return (this->*current_kernel_)(current_setpoint, phase, pwm_phase, phase_vel);
 }
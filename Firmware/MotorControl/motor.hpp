@@ -23,7 +23,8 @@ public:
         ERROR_UNEXPECTED_TIMER_CALLBACK = 0x0200,
         ERROR_CURRENT_SENSE_SATURATION = 0x0400,
         ERROR_INVERTER_OVER_TEMP = 0x0800,
-        ERROR_CURRENT_UNSTABLE = 0x1000
+        ERROR_CURRENT_UNSTABLE = 0x1000,
+        ERROR_MOTOR_THERMAL_BUDGET_EXHAUSTED = 0x2000
     };
 
     enum MotorType_t {
@@ -37,6 +38,16 @@ public:
         float phC;
     };
 
+    // Setpoint handoff from the axis thread to the ADC interrupt when
+    // config.current_control_in_isr is active. All values are stored
+    // after the direction multiplier has been applied.
+    struct IsrSetpoint_t {
+        float current_setpoint; // [A]
+        float phase;            // [rad]
+        float phase_vel;        // [rad/s]
+        bool valid;
+    };
+
     struct CurrentControl_t{
         float p_gain; // [V/A]
         float i_gain; // [V/As]
@@ -46,6 +57,7 @@ public:
         // Voltage applied at end of cycle:
         float final_v_alpha; // [V]
         float final_v_beta; // [V]
+        float Id_setpoint; // [A]
         float Iq_setpoint; // [A]
         float Iq_measured; // [A]
         float Id_measured; // [A]
@@ -72,9 +84,75 @@ public:
         float current_lim_tolerance = 1.25f;  // multiple of current_lim
         // Value used to compute shunt amplifier gains
         float requested_current_range = 60.0f; // [A]
+        // Dynamically raise the shunt amplifier gain (lowering the current
+        // noise floor) while the recent current amplitude sits well below
+        // requested_current_range, backing off when it approaches the
+        // reduced range. See Motor::run_gain_autoranging.
+        bool enable_gain_autoranging = false;
         float current_control_bandwidth = 1000.0f;  // [rad/s]
+        // Decoupling feed-forward terms in FOC_current: R_wL_FF cancels the
+        // resistive drop and the omega*L cross-coupling between the d and q
+        // axes using the current setpoints; bemf_FF cancels the back-EMF
+        // using the sensorless estimator's pm_flux_linkage. Both reduce the
+        // disturbance the PI loop has to reject at speed, so
+        // current_control_bandwidth doesn't have to be derated.
+        bool R_wL_FF_enable = false;
+        bool bemf_FF_enable = false;
+        // Gimbal mode only: add the measured I*R drop back onto the
+        // commanded voltage in the FOC_voltage path, so torque tracks the
+        // command across speed and winding temperature without the full
+        // current-loop cost. The gain scales phase_resistance; 1.0 cancels
+        // the drop exactly but is only marginally stable against the
+        // one-cycle measurement delay, so leave some margin.
+        bool gimbal_ir_comp_enable = false;
+        float gimbal_ir_comp_gain = 0.9f;
+        // Field weakening: schedule negative Id from the modulation
+        // saturation feedback in FOC_current so current authority is kept
+        // past the speed where back-EMF meets the bus voltage. MTPA
+        // additionally shifts allocation onto the reluctance torque of
+        // salient (Lq > Ld) motors. See Motor::allocate_dq_currents.
+        bool field_weakening_enable = false;
+        float field_weakening_ramp = 500.0f;  // [A/s] Id slew rate at full saturation error
+        float field_weakening_max_Id = 10.0f; // [A] largest magnitude of negative d-axis current
+        bool mtpa_enable = false;
+        float mtpa_saliency = 0.0f;           // [H] Lq - Ld (0 disables the MTPA term)
         float inverter_temp_limit_lower = 100;
         float inverter_temp_limit_upper = 120;
+        // Response of this axis to the board-level shared heatsink derating
+        // curve (see board config enable_shared_thermal_derating):
+        // 1 = full derating, 0 = opt out, in between softens the response.
+        float shared_thermal_weight = 1.0f;
+        // Winding I^2t observer: with the model enabled, current_lim becomes
+        // the peak rating and motor_current_continuous the steady-state one.
+        // Brief excursions up to current_lim are allowed while the thermal
+        // budget lasts; the limit folds back to the continuous rating as it
+        // depletes. See Motor::update_motor_thermal_model.
+        bool motor_thermal_model_enable = false;
+        float motor_current_continuous = 10.0f; // [A] continuous winding rating
+        float motor_thermal_tau = 60.0f;        // [s] winding thermal time constant
+        // Run FOC_current directly in the ADC interrupt instead of on the
+        // axis thread. This removes the RTOS context switch between current
+        // sample and PWM timing update; the slow path (do_checks, watchdog,
+        // state machine) stays on the thread.
+        bool current_control_in_isr = false;
+        // Process only one in N of the DC offset (SVM vector 7) samples and
+        // skip the rest of that ISR work. The offset only drifts on a thermal
+        // timescale; the filter time constant is kept by scaling the gain.
+        uint8_t dc_calib_decimation = 1;
+        // Run the thermal limit update only one in N do_checks calls; the
+        // FET temperature moves in seconds, not control cycles.
+        uint8_t thermal_check_decimation = 16;
+        // Estimate R and L concurrently with a recursive least squares fit
+        // and confidence based early exit (typically well under a second)
+        // instead of the serialized fixed duration measurements.
+        bool fast_calibration = false;
+        // Number of consecutive late control cycles tolerated before
+        // ERROR_CONTROL_DEADLINE_MISSED disarms the motor. While a miss is
+        // tolerated the previous PWM timings are held for one cycle, which
+        // for non-safety-critical loads (a conveyor eating a USB interrupt
+        // storm) beats a full E-stop. 0 keeps the strict legacy behavior:
+        // the first miss disarms.
+        uint8_t deadline_miss_tolerance = 0;
     };
 
     enum TimingLog_t {
@@ -110,23 +188,40 @@ public:
 
     void update_current_controller_gains();
     void DRV8301_setup();
+    void apply_shunt_amp_gain(uint8_t gain_idx);
+    bool set_shunt_amp_gain(uint8_t gain_idx);
+    void run_gain_autoranging();
     bool check_DRV_fault();
     void set_error(Error_t error);
     bool do_checks();
     float get_inverter_temp();
     bool update_thermal_limits();
+    bool update_motor_thermal_model();
+    void update_effective_current_lim();
     float effective_current_lim();
     void log_timing(TimingLog_t log_idx);
     float phase_current_from_adcval(uint32_t ADCValue);
     bool measure_phase_resistance(float test_current, float max_voltage);
     bool measure_phase_inductance(float voltage_low, float voltage_high);
+    bool measure_phase_R_L(float test_current, float max_voltage);
     bool run_calibration();
     bool enqueue_modulation_timings(float mod_alpha, float mod_beta);
     bool enqueue_voltage_timings(float v_alpha, float v_beta);
+    void allocate_dq_currents(float& Id_des, float& Iq_des, float phase_vel);
     bool FOC_voltage(float v_d, float v_q, float pwm_phase);
-    bool FOC_current(float Id_des, float Iq_des, float I_phase, float pwm_phase);
+    bool FOC_current(float Id_des, float Iq_des, float I_phase, float pwm_phase, float phase_vel);
+    bool FOC_update_isr();
     bool update(float current_setpoint, float phase, float phase_vel);
 
+    // Motor-type specialized current command kernel. The motor type rarely
+    // changes, so instead of branching on it every cycle we swap a function
+    // pointer to a kernel instantiated for the active type; inside the kernel
+    // the type comparison folds away and the hot path is straight-line code.
+    template<MotorType_t TYPE>
+    bool apply_current_kernel(float current_setpoint, float phase, float pwm_phase, float phase_vel);
+    bool apply_current_invalid(float current_setpoint, float phase, float pwm_phase, float phase_vel);
+    void select_current_kernel();
+
     const MotorHardwareConfig_t& hw_config_;
     const GateDriverHardwareConfig_t gate_driver_config_;
     Config_t& config_;
@@ -153,7 +248,21 @@ public:
     bool is_calibrated_ = config_.pre_calibrated;
     Iph_BC_t current_meas_ = {0.0f, 0.0f};
     Iph_BC_t DC_calib_ = {0.0f, 0.0f};
+    uint8_t dc_calib_cycle_ = 0; // wraps at config_.dc_calib_decimation (ISR only)
+    uint8_t thermal_check_cycle_ = 0; // wraps at config_.thermal_check_decimation
     float phase_current_rev_gain_ = 0.0f; // Reverse gain for ADC to Amps (to be set by DRV8301_setup)
+    // Current sense gain autoranging state (see run_gain_autoranging)
+    float max_unity_gain_current_ = 0.0f; // [A] measurable current at 1 V/V (set by DRV8301_setup)
+    uint8_t gain_idx_min_ = 0; // lowest usable gain, snapped from requested_current_range
+    uint8_t gain_idx_ = 0;     // gain table index currently programmed into the DRV8301
+    volatile uint8_t current_meas_blank_cycles_ = 0; // current samples to hold while the amplifier settles
+    volatile bool gain_downshift_pending_ = false;   // set on saturation (possibly ISR), consumed on the worker
+    uint8_t saturation_cycle_cnt_ = 0; // consecutive clipped cycles ridden through
+    float current_envelope_ = 0.0f;    // [A] decaying peak of |phase current|
+    uint32_t gain_dwell_cycles_ = 0;   // control cycles since the last gain change
+    // Claims the shared SPI bus for a runtime gain write; the encoder ISR
+    // skips its DMA transactions while this is set.
+    static volatile bool gate_driver_spi_busy_;
     CurrentControl_t current_control_ = {
         .p_gain = 0.0f,        // [V/A] should be auto set after resistance and inductance measurement
         .i_gain = 0.0f,        // [V/As] should be auto set after resistance and inductance measurement
@@ -162,6 +271,7 @@ public:
         .Ibus = 0.0f,
         .final_v_alpha = 0.0f,
         .final_v_beta = 0.0f,
+        .Id_setpoint = 0.0f,
         .Iq_setpoint = 0.0f,
         .Iq_measured = 0.0f,
         .Id_measured = 0.0f,
@@ -169,9 +279,31 @@ public:
         .max_allowed_current = 0.0f,
         .overcurrent_trip_level = 0.0f,
     };
+    // Field weakening state (see allocate_dq_currents)
+    float Id_fw_ = 0.0f;           // [A] scheduled field weakening current (<= 0)
+    float fw_mod_margin_ = 2.0f;   // last modulation scalefactor from FOC_current
+    IsrSetpoint_t isr_setpoint_ = {0.0f, 0.0f, 0.0f, false};
+    // Active current command kernel, swapped by select_current_kernel()
+    bool (Motor::*current_kernel_)(float, float, float, float) = nullptr;
+    MotorType_t kernel_motor_type_ = MOTOR_TYPE_HIGH_CURRENT; // type current_kernel_ was selected for
+    // [TIM_1_8 clocks] left until the next timer update event after the ISR
+    // current controller finished. This is the headroom we have before
+    // ERROR_CONTROL_DEADLINE_MISSED would fire.
+    uint16_t isr_deadline_margin_ = 0;
+    // Cumulative count of tolerated late cycles (timings held, no disarm)
+    uint32_t deadline_near_miss_count_ = 0;
+    uint8_t consecutive_deadline_misses_ = 0; // ISR only, reset by a timely cycle
     DRV8301_FaultType_e drv_fault_ = DRV8301_FaultType_NoFault;
     DRV_SPI_8301_Vars_t gate_driver_regs_; //Local view of DRV registers (initialized by DRV8301_setup)
     float thermal_current_lim_ = 10.0f;  //[A]
+    // Winding I^2t observer state (see update_motor_thermal_model)
+    float motor_I_sq_filt_ = 0.0f;           // [A^2] I^2 low-passed with motor_thermal_tau
+    float motor_thermal_budget_ = 1.0f;      // remaining transient budget, 1 = cold winding
+    float motor_thermal_current_lim_ = 10.0f; // [A]
+    // Cached results of update_effective_current_lim(), refreshed once per
+    // control cycle from do_checks
+    float effective_current_lim_ = 10.0f; //[A]
+    float I_trip_squared_ = SQ(10.0f);    //[A^2]
 
     // Communication protocol definitions
     auto make_protocol_definitions() {
@@ -184,7 +316,12 @@ public:
             make_protocol_property("DC_calib_phB", &DC_calib_.phB),
             make_protocol_property("DC_calib_phC", &DC_calib_.phC),
             make_protocol_property("phase_current_rev_gain", &phase_current_rev_gain_),
+            make_protocol_ro_property("current_envelope", &current_envelope_),
             make_protocol_ro_property("thermal_current_lim", &thermal_current_lim_),
+            make_protocol_ro_property("motor_thermal_budget", &motor_thermal_budget_),
+            make_protocol_ro_property("motor_thermal_current_lim", &motor_thermal_current_lim_),
+            make_protocol_ro_property("isr_deadline_margin", &isr_deadline_margin_),
+            make_protocol_ro_property("deadline_near_miss_count", &deadline_near_miss_count_),
             make_protocol_function("get_inverter_temp", *this, &Motor::get_inverter_temp),
             make_protocol_object("current_control",
                 make_protocol_property("p_gain", &current_control_.p_gain),
@@ -194,6 +331,7 @@ public:
                 make_protocol_property("Ibus", &current_control_.Ibus),
                 make_protocol_property("final_v_alpha", &current_control_.final_v_alpha),
                 make_protocol_property("final_v_beta", &current_control_.final_v_beta),
+                make_protocol_property("Id_setpoint", &current_control_.Id_setpoint),
                 make_protocol_property("Iq_setpoint", &current_control_.Iq_setpoint),
                 make_protocol_property("Iq_measured", &current_control_.Iq_measured),
                 make_protocol_property("Id_measured", &current_control_.Id_measured),
@@ -232,9 +370,28 @@ public:
                 make_protocol_property("current_lim_tolerance", &config_.current_lim_tolerance),
                 make_protocol_property("inverter_temp_limit_lower", &config_.inverter_temp_limit_lower),
                 make_protocol_property("inverter_temp_limit_upper", &config_.inverter_temp_limit_upper),
+                make_protocol_property("shared_thermal_weight", &config_.shared_thermal_weight),
+                make_protocol_property("motor_thermal_model_enable", &config_.motor_thermal_model_enable),
+                make_protocol_property("motor_current_continuous", &config_.motor_current_continuous),
+                make_protocol_property("motor_thermal_tau", &config_.motor_thermal_tau),
                 make_protocol_property("requested_current_range", &config_.requested_current_range),
+                make_protocol_property("enable_gain_autoranging", &config_.enable_gain_autoranging),
                 make_protocol_property("current_control_bandwidth", &config_.current_control_bandwidth,
-                    [](void* ctx) { static_cast<Motor*>(ctx)->update_current_controller_gains(); }, this)
+                    [](void* ctx) { static_cast<Motor*>(ctx)->update_current_controller_gains(); }, this),
+                make_protocol_property("R_wL_FF_enable", &config_.R_wL_FF_enable),
+                make_protocol_property("bemf_FF_enable", &config_.bemf_FF_enable),
+                make_protocol_property("gimbal_ir_comp_enable", &config_.gimbal_ir_comp_enable),
+                make_protocol_property("gimbal_ir_comp_gain", &config_.gimbal_ir_comp_gain),
+                make_protocol_property("field_weakening_enable", &config_.field_weakening_enable),
+                make_protocol_property("field_weakening_ramp", &config_.field_weakening_ramp),
+                make_protocol_property("field_weakening_max_Id", &config_.field_weakening_max_Id),
+                make_protocol_property("mtpa_enable", &config_.mtpa_enable),
+                make_protocol_property("mtpa_saliency", &config_.mtpa_saliency),
+                make_protocol_property("current_control_in_isr", &config_.current_control_in_isr),
+                make_protocol_property("dc_calib_decimation", &config_.dc_calib_decimation),
+                make_protocol_property("deadline_miss_tolerance", &config_.deadline_miss_tolerance),
+                make_protocol_property("thermal_check_decimation", &config_.thermal_check_decimation),
+                make_protocol_property("fast_calibration", &config_.fast_calibration)
             )
         );
     }
@@ -28,6 +28,13 @@
 * To write a new block of data atomically we first mark all associated fields
 * as "invalid" (in the allocation table) then write the data and then mark the
 * fields as "valid" (in the direction of increasing address).
+*
+* Small updates can also be appended behind the current valid data in the
+* same sector (NVM_start_append/NVM_commit_append): the appended fields
+* extend the valid area that is found on the next startup, so the old data
+* does not have to be rewritten. Note that a torn append leaves the sector
+* ending in "invalid" fields, so the configuration may be lost if power
+* fails during an append.
 */
 
 #include "nvm.h"
@@ -36,6 +43,8 @@
 #include <stm32f4xx_hal.h>
 #include <string.h>
 
+#include "mini_fmt.h"
+
 #if defined(STM32F405xx)
 
 // refer to page 75 of datasheet:
@@ -81,6 +90,7 @@ sector_t sectors[] = { {
 
 uint8_t read_sector_; // 0 or 1 to indicate which sector to read from and which to write to
 size_t n_staging_area_; // number of 64-bit values that were reserved using NVM_start_write
+size_t n_staging_append_; // number of 64-bit values that were reserved using NVM_start_append
 size_t n_valid_; // number of 64-bit fields that can be read
 
 // @brief Erases a flash sector. This sets all bits in the sector to 1.
@@ -218,6 +228,7 @@ int NVM_init(void) {
     n_valid_ = read_sector->index - min_valid_index;
     
     n_staging_area_ = 0;
+    n_staging_append_ = 0;
 
     int status = 0;
     /*// bring non-valid sectors into a known state
@@ -303,21 +314,38 @@ int NVM_start_write(size_t length) {
     return 0;
 }
 
-// @brief Writes to the current data block that was opened with NVM_start_write.
+// @brief Returns a pointer directly into the latest committed block.
 //
-// The operation fails if (offset + length) is larger than the length passed to NVM_start_write.
-// The most recent valid NVM data is not modified or invalidated until NVM_commit is called.
-// Warning: Writing different data to the same area multiple times during a single transaction
-// will cause data corruption.
+// The flash is memory mapped, so the committed data can be read (and CRC
+// checked) in place without copying it out first. The pointer stays valid
+// until the next NVM write or erase operation.
 //
-// @param offset: The offset in bytes, 0 being the beginning of the staging block.
-// @param data: Pointer to the data that should be written
-// @param length: Data length in bytes
-int NVM_write(size_t offset, uint8_t *data, size_t length) {
-    if (offset + length > (n_staging_area_ << 3))
+// @param offset: offset in bytes (0 meaning the beginning of the valid area)
+// @param length: length in bytes of the range that the caller wants to access
+// @returns the pointer on success or NULL if the range is out of bounds
+const uint8_t* NVM_get_read_pointer(size_t offset, size_t length) {
+    if (offset + length > (n_valid_ << 3))
+        return NULL;
+    sector_t *read_sector = &sectors[read_sector_];
+    return ((const uint8_t *)&read_sector->data[read_sector->index - n_valid_]) + offset;
+}
+
+// @brief Compares a range of the latest committed block against a RAM buffer.
+// @param offset: offset in bytes (0 meaning the beginning of the valid area)
+// @param data: buffer to compare against
+// @param length: length in bytes (if (offset + length) is out of range, the function fails)
+// @returns 0 if the data is equal, 1 if it differs or -1 if the range is invalid
+int NVM_compare(size_t offset, uint8_t *data, size_t length) {
+    if (offset + length > (n_valid_ << 3))
         return -1;
-    sector_t *target = &sectors[1 - read_sector_];
+    sector_t *read_sector = &sectors[read_sector_];
+    const uint8_t *src_ptr = ((const uint8_t *)&read_sector->data[read_sector->index - n_valid_]) + offset;
+    return memcmp(src_ptr, data, length) ? 1 : 0;
+}
 
+// @brief Programs a byte range relative to a sector's current write index.
+// @returns 0 on success or a non-zero error code otherwise
+static int program_range(sector_t *target, size_t offset, uint8_t *data, size_t length) {
     HAL_FLASH_Unlock();
     HAL_FLASH_ClearError();
 
@@ -346,6 +374,82 @@ fail:
     return HAL_FLASH_GetError(); // non-zero
 }
 
+// @brief Writes to the current data block that was opened with NVM_start_write.
+//
+// The operation fails if (offset + length) is larger than the length passed to NVM_start_write.
+// The most recent valid NVM data is not modified or invalidated until NVM_commit is called.
+// Warning: Writing different data to the same area multiple times during a single transaction
+// will cause data corruption.
+//
+// @param offset: The offset in bytes, 0 being the beginning of the staging block.
+// @param data: Pointer to the data that should be written
+// @param length: Data length in bytes
+int NVM_write(size_t offset, uint8_t *data, size_t length) {
+    if (offset + length > (n_staging_area_ << 3))
+        return -1;
+    return program_range(&sectors[1 - read_sector_], offset, data, length);
+}
+
+// @brief Starts an append operation behind the most recent valid data.
+//
+// In contrast to NVM_start_write the staging block is located in the same
+// sector as the valid data and extends it, so the valid data does not have
+// to be rewritten. The operation fails if the erased area of the sector is
+// too small; the caller should then fall back to a full rewrite.
+//
+// @param length: Length of the staging block that should be created
+int NVM_start_append(size_t length) {
+    sector_t *target = &sectors[read_sector_];
+
+    length = (length + 7) >> 3; // round to multiple of 64 bit
+    if (target->index + length >= target->n_data)
+        return -1;
+
+    // invalidate the fields we're about to write
+    int status = set_allocation_state(target, target->index, length, INVALID);
+    if (status)
+        return status;
+
+    n_staging_append_ = length;
+    return 0;
+}
+
+// @brief Writes to the staging block that was opened with NVM_start_append.
+// The same constraints as for NVM_write apply.
+int NVM_append_write(size_t offset, uint8_t *data, size_t length) {
+    if (offset + length > (n_staging_append_ << 3))
+        return -1;
+    return program_range(&sectors[read_sector_], offset, data, length);
+}
+
+// @brief Returns the number of bytes that are still available for append
+// operations behind the valid data (see NVM_start_append). Callers can use
+// this to compact (full rewrite into the other sector) before the erased
+// area runs out, instead of having an incremental save fail into the full
+// rewrite at a less convenient time.
+size_t NVM_get_append_free_space(void) {
+    sector_t *target = &sectors[read_sector_];
+    if (target->index + 1 >= target->n_data)
+        return 0;
+    // NVM_start_append requires index + length < n_data
+    return (target->n_data - target->index - 1) << 3;
+}
+
+// @brief Marks the appended data as valid, thereby extending the block that
+// can be read with NVM_read.
+int NVM_commit_append(void) {
+    sector_t *target = &sectors[read_sector_];
+
+    int status = set_allocation_state(target, target->index, n_staging_append_, VALID);
+    if (status)
+        return status;
+
+    target->index += n_staging_append_;
+    n_valid_ += n_staging_append_;
+    n_staging_append_ = 0;
+    return 0;
+}
+
 // @brief Commits the new data to NVM atomically.
 int NVM_commit(void) {
     sector_t *read_sector = &sectors[read_sector_];
@@ -407,7 +511,7 @@ void NVM_demo(void) {
     uint8_t seed = 0;
 
     osDelay(100);
-    printf("=== NVM TEST ===\r\n"); osDelay(5);
+    mini_printf("=== NVM TEST ===\r\n"); osDelay(5);
     //NVM_erase();
     if (progress++, NVM_init() != 0)
         goto fail;
@@ -415,23 +519,23 @@ void NVM_demo(void) {
     // load bytes from NVM and print them
     size_t available = NVM_get_max_read_length();
     if (available) {
-        printf("NVM contains %d valid bytes:\r\n", available); osDelay(5);
+        mini_printf("NVM contains %d valid bytes:\r\n", available); osDelay(5);
         uint8_t buf[available];
         if (progress++, NVM_read(0, buf, available) != 0)
             goto fail;
         for (size_t pos = 0; pos < available; ++pos) {
             seed += buf[pos];
-            printf(" %02x", buf[pos]);
+            mini_printf(" %02x", buf[pos]);
             if ((((pos + 1) % 16) == 0) || ((pos + 1) == available))
-                printf("\r\n");
+                mini_printf("\r\n");
             osDelay(2);
         }
     } else {
-        printf("NVM is empty\r\n"); osDelay(5);
+        mini_printf("NVM is empty\r\n"); osDelay(5);
     }
 
     // store new bytes in NVM (data based on seed)
-    printf("write 0x%02x, ..., 0x%02x to NVM\r\n", seed, seed + len - 1); osDelay(5);
+    mini_printf("write 0x%02x, ..., 0x%02x to NVM\r\n", seed, seed + len - 1); osDelay(5);
     for (size_t i = 0; i < len; i++)
         data[i] = seed++;
     if (progress++, NVM_start_write(len) != 0)
@@ -442,10 +546,10 @@ void NVM_demo(void) {
         goto fail;
     if (progress++, NVM_commit())
         goto fail;
-    printf("new data committed to NVM\r\n"); osDelay(5);
+    mini_printf("new data committed to NVM\r\n"); osDelay(5);
 
     return;
 
 fail:
-    printf("NVM test failed at %d!\r\n", progress);
+    mini_printf("NVM test failed at %d!\r\n", progress);
 }
@@ -21,9 +21,15 @@ int NVM_erase(void);
 size_t NVM_get_max_read_length(void);
 size_t NVM_get_max_write_length(void);
 int NVM_read(size_t offset, uint8_t *data, size_t length);
+const uint8_t* NVM_get_read_pointer(size_t offset, size_t length);
+int NVM_compare(size_t offset, uint8_t *data, size_t length);
 int NVM_start_write(size_t length);
 int NVM_write(size_t offset, uint8_t *data, size_t length);
 int NVM_commit(void);
+int NVM_start_append(size_t length);
+int NVM_append_write(size_t offset, uint8_t *data, size_t length);
+int NVM_commit_append(void);
+size_t NVM_get_append_free_space(void);
 void NVM_demo(void);
 
 #ifdef __cplusplus
@@ -9,6 +9,7 @@
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include <stm32f405xx.h>
 
 #include "nvm.h"
@@ -18,6 +19,8 @@
 /* Private defines -----------------------------------------------------------*/
 #define CONFIG_CRC16_INIT 0xabcd
 #define CONFIG_CRC16_POLYNOMIAL 0x3d65
+#define CONFIG_JOURNAL_MAGIC 0x6a63
+#define CONFIG_STORE_CHUNK_SIZE 64 // [bytes] programmed between two yield() calls
 
 /* Private macros ------------------------------------------------------------*/
 /* Private typedef -----------------------------------------------------------*/
@@ -27,7 +30,7 @@
 
 // IMPORTANT: if you change, reorder or otherwise modify any of the fields in
 // the config structs, make sure to increment this number:
-static constexpr uint16_t config_version = 0x0001;
+static constexpr uint16_t config_version = 0x0017;
 
 /* Private variables ---------------------------------------------------------*/
 /* Private function prototypes -----------------------------------------------*/
@@ -46,41 +49,68 @@ static constexpr uint16_t config_version = 0x0001;
 template<typename ... Ts>
 struct Config;
 
+// @brief Header of one journal record.
+//
+// Journal records are appended after the base config block by
+// safe_update_config and hold a new copy of a single object. They are
+// replayed in order during safe_load_config.
+struct ConfigJournalHeader_t {
+    uint16_t magic;  // CONFIG_JOURNAL_MAGIC ^ config_version
+    uint16_t index;  // position of the object in the Config<Ts...> list
+    uint16_t length; // payload length in bytes
+    uint16_t crc16;  // CRC over the payload
+};
+
 template<>
 struct Config<> {
-    static size_t get_size() {
+    static constexpr size_t get_size() {
         return 0;
     }
-    static int load_config(size_t offset, uint16_t* crc16) {
+    static size_t get_struct_offset(size_t index) {
         return 0;
     }
+    static size_t get_struct_size(size_t index) {
+        return 0;
+    }
+    static void* get_struct_data(size_t index) {
+        return nullptr;
+    }
     static int store_config(size_t offset, uint16_t* crc16) {
         return 0;
     }
+    static constexpr size_t get_max_struct_size() {
+        return 0;
+    }
 };
 
 template<typename T, typename ... Ts>
 struct Config<T, Ts...> {
-    static size_t get_size() {
+    static constexpr size_t n_objects = sizeof...(Ts) + 1;
+
+    static constexpr size_t get_size() {
         return sizeof(T) + Config<Ts...>::get_size();
     }
 
-    // @brief Loads one or more consecutive objects from the NVM.
-    // During loading this function also calculates the CRC over the loaded data.
-    // @param offset: 0 means that the function should start reading at the beginning
-    // of the last comitted NVM block
-    // @param crc16: the result of the CRC calculation is written to this address
-    // @param val0, vals: the values to be loaded
-    static int load_config(size_t offset, uint16_t* crc16, T* val0, Ts* ... vals) {
-        size_t size = sizeof(T);
-        // save current CRC (in case val0 and crc16 point to the same address)
-        size_t previous_crc16 = *crc16;
-        if (NVM_read(offset, (uint8_t *)val0, size))
-            return -1;
-        *crc16 = calc_crc16<CONFIG_CRC16_POLYNOMIAL>(previous_crc16, (uint8_t *)val0, size);
-        if (Config<Ts...>::load_config(offset + size, crc16, vals...))
-            return -1;
-        return 0;
+    // @brief Returns the size of the largest object, i.e. the payload of a
+    // worst-case journal record.
+    static constexpr size_t get_max_struct_size() {
+        return (sizeof(T) > Config<Ts...>::get_max_struct_size()) ?
+                sizeof(T) : Config<Ts...>::get_max_struct_size();
+    }
+
+    // @brief Returns the offset of the index-th object within the base block.
+    static size_t get_struct_offset(size_t index) {
+        return (index == 0) ? 0 : sizeof(T) + Config<Ts...>::get_struct_offset(index - 1);
+    }
+
+    // @brief Returns the size of the index-th object.
+    static size_t get_struct_size(size_t index) {
+        return (index == 0) ? sizeof(T) : Config<Ts...>::get_struct_size(index - 1);
+    }
+
+    // @brief Returns a pointer to the index-th object.
+    static void* get_struct_data(size_t index, T* val0, Ts* ... vals) {
+        return (index == 0) ? (void*)val0 : Config<Ts...>::get_struct_data(index - 1, vals...);
     }
 
     // @brief Stores one or more consecutive objects to the NVM.
@@ -101,17 +131,52 @@ struct Config<T, Ts...> {
         return 0;
     }
 
-    // @brief Loads one or more consecutive objects from the NVM. The loaded data
-    // is validated using a CRC value that is stored at the beginning of the data.
+    // @brief Loads one or more consecutive objects from the NVM. The flash is
+    // memory mapped, so the base block and every journal record (see
+    // safe_update_config) are CRC-validated in place before anything is
+    // copied into the live objects: a corrupt NVM never clobbers them, and
+    // each object is read out in a single bulk copy instead of per-field
+    // NVM reads.
     static int safe_load_config(T* val0, Ts* ... vals) {
         //printf("have %d bytes\r\n", NVM_get_max_read_length()); osDelay(5);
-        if (Config<T, Ts..., uint16_t>::get_size() > NVM_get_max_read_length())
-            return -1;
-        uint16_t crc16 = CONFIG_CRC16_INIT ^ config_version;
-        if (Config<T, Ts..., uint16_t>::load_config(0, &crc16, val0, vals..., &crc16))
+        size_t base_size = Config<T, Ts...>::get_size() + 2;
+        const uint8_t *base = NVM_get_read_pointer(0, base_size);
+        if (!base)
             return -1;
-        if (crc16)
+        if (calc_crc16<CONFIG_CRC16_POLYNOMIAL>(CONFIG_CRC16_INIT ^ config_version,
+                base, base_size))
             return -1;
+        // validate the journal records before applying anything
+        size_t offset = (base_size + 7) & ~(size_t)7;
+        while (offset + sizeof(ConfigJournalHeader_t) <= NVM_get_max_read_length()) {
+            const ConfigJournalHeader_t *header =
+                    (const ConfigJournalHeader_t *)NVM_get_read_pointer(offset, sizeof(ConfigJournalHeader_t));
+            if (!header)
+                return -1;
+            if ((header->magic != (uint16_t)(CONFIG_JOURNAL_MAGIC ^ config_version)) ||
+                (header->index >= n_objects) ||
+                (header->length != get_struct_size(header->index)))
+                return -1;
+            const uint8_t *payload = NVM_get_read_pointer(offset + sizeof(*header), header->length);
+            if (!payload)
+                return -1;
+            if (calc_crc16<CONFIG_CRC16_POLYNOMIAL>(CONFIG_CRC16_INIT ^ config_version,
+                    payload, header->length) != header->crc16)
+                return -1;
+            offset += sizeof(*header) + ((header->length + 7) & ~(size_t)7);
+        }
+        // copy the base block into the live objects in one pass
+        for (size_t i = 0; i < n_objects; ++i)
+            memcpy(get_struct_data(i, val0, vals...), base + get_struct_offset(i), get_struct_size(i));
+        // replay the journal records
+        offset = (base_size + 7) & ~(size_t)7;
+        while (offset + sizeof(ConfigJournalHeader_t) <= NVM_get_max_read_length()) {
+            const ConfigJournalHeader_t *header =
+                    (const ConfigJournalHeader_t *)NVM_get_read_pointer(offset, sizeof(ConfigJournalHeader_t));
+            memcpy(get_struct_data(header->index, val0, vals...),
+                    NVM_get_read_pointer(offset + sizeof(*header), header->length), header->length);
+            offset += sizeof(*header) + ((header->length + 7) & ~(size_t)7);
+        }
         return 0;
     }
 
@@ -138,4 +203,181 @@ struct Config<T, Ts...> {
             return -1;
         return 0;
     }
+
+    // @brief Implementation of the incremental save. data[i] points to the
+    // current value of the i-th object. If a yield function is given it is
+    // called between flash operations so the caller can run this on a low
+    // priority thread without hogging the flash.
+    // @returns 0 on success, 1 if a full rewrite is required or -1 on a
+    // write error
+    static int update_config_impl(uint8_t* const data[n_objects], void (*yield)(void)) {
+        size_t journal_offset = (Config<T, Ts...>::get_size() + 2 + 7) & ~(size_t)7;
+        if (journal_offset > NVM_get_max_read_length())
+            return 1;
+
+        // find the latest stored version of each object
+        size_t latest_offset[n_objects];
+        for (size_t i = 0; i < n_objects; ++i)
+            latest_offset[i] = get_struct_offset(i);
+        size_t offset = journal_offset;
+        while (offset + sizeof(ConfigJournalHeader_t) <= NVM_get_max_read_length()) {
+            ConfigJournalHeader_t header;
+            if (NVM_read(offset, (uint8_t *)&header, sizeof(header)))
+                return 1;
+            if ((header.magic != (uint16_t)(CONFIG_JOURNAL_MAGIC ^ config_version)) ||
+                (header.index >= n_objects) ||
+                (header.length != get_struct_size(header.index)))
+                return 1;
+            latest_offset[header.index] = offset + sizeof(header);
+            offset += sizeof(header) + ((header.length + 7) & ~(size_t)7);
+        }
+
+        // append a journal record for each object that changed
+        for (size_t i = 0; i < n_objects; ++i) {
+            size_t length = get_struct_size(i);
+            if (NVM_compare(latest_offset[i], data[i], length) == 0)
+                continue;
+            ConfigJournalHeader_t header = {
+                .magic = (uint16_t)(CONFIG_JOURNAL_MAGIC ^ config_version),
+                .index = (uint16_t)i,
+                .length = (uint16_t)length,
+                .crc16 = calc_crc16<CONFIG_CRC16_POLYNOMIAL>(CONFIG_CRC16_INIT ^ config_version,
+                        data[i], length)
+            };
+            if (NVM_start_append(sizeof(header) + length))
+                return 1; // journal area used up
+            if (NVM_append_write(0, (uint8_t *)&header, sizeof(header)))
+                return -1;
+            for (size_t pos = 0; pos < length; pos += CONFIG_STORE_CHUNK_SIZE) {
+                size_t chunk = length - pos;
+                if (chunk > CONFIG_STORE_CHUNK_SIZE)
+                    chunk = CONFIG_STORE_CHUNK_SIZE;
+                if (NVM_append_write(sizeof(header) + pos, data[i] + pos, chunk))
+                    return -1;
+                if (yield)
+                    yield();
+            }
+            if (NVM_commit_append())
+                return -1;
+        }
+        return 0;
+    }
+
+    // @brief Stores only the objects that changed since the last save.
+    //
+    // Changed objects are appended behind the valid NVM block as journal
+    // records, so changing a single gain programs a few dozen bytes instead
+    // of rewriting the whole block. The caller must ensure that the NVM
+    // currently holds a valid config (i.e. safe_load_config or a previous
+    // save succeeded). Falls back to a full safe_store_config() when there
+    // is no base block, a journal record is corrupt or the erased area of
+    // the sector is used up.
+    static int safe_update_config(T* val0, Ts* ... vals) {
+        uint8_t* data[n_objects];
+        for (size_t i = 0; i < n_objects; ++i)
+            data[i] = (uint8_t *)get_struct_data(i, val0, vals...);
+        int status = update_config_impl(data, nullptr);
+        return (status > 0) ? safe_store_config(val0, vals...) : status;
+    }
+
+    // @brief Serializes all objects into a RAM buffer of get_size() + 2
+    // bytes, using the same layout (including the trailing CRC) as the base
+    // block in NVM. The buffer can later be written with store_snapshot or
+    // update_snapshot without touching the live objects again.
+    static void snapshot_config(uint8_t *buffer, T* val0, Ts* ... vals) {
+        size_t size = Config<T, Ts...>::get_size();
+        for (size_t i = 0; i < n_objects; ++i)
+            memcpy(buffer + get_struct_offset(i), get_struct_data(i, val0, vals...), get_struct_size(i));
+        uint16_t crc16 = calc_crc16<CONFIG_CRC16_POLYNOMIAL>(CONFIG_CRC16_INIT ^ config_version, buffer, size);
+        buffer[size] = (uint8_t)(crc16 >> 8);
+        buffer[size + 1] = (uint8_t)(crc16 & 0xff);
+    }
+
+    // @brief Inverse of snapshot_config: validates the CRC of a serialized
+    // config image (which covers the version number) and copies the objects
+    // into the live structs. Used by the bulk config import endpoint.
+    // Returns 0 on success, -1 on a CRC or version mismatch, in which case
+    // the live objects are untouched.
+    static int restore_snapshot(const uint8_t *buffer, T* val0, Ts* ... vals) {
+        size_t size = Config<T, Ts...>::get_size() + 2;
+        if (calc_crc16<CONFIG_CRC16_POLYNOMIAL>(CONFIG_CRC16_INIT ^ config_version,
+                buffer, size))
+            return -1;
+        for (size_t i = 0; i < n_objects; ++i)
+            memcpy(get_struct_data(i, val0, vals...), buffer + get_struct_offset(i), get_struct_size(i));
+        return 0;
+    }
+
+    // @brief Stores a snapshot created by snapshot_config to the NVM.
+    // Equivalent to safe_store_config but writes in small chunks and calls
+    // yield() between them so it can run on a low priority thread.
+    static int store_snapshot(const uint8_t *buffer, void (*yield)(void)) {
+        size_t size = Config<T, Ts...>::get_size() + 2;
+        if (size > NVM_get_max_write_length())
+            return -1;
+        if (NVM_start_write(size))
+            return -1;
+        for (size_t offset = 0; offset < size; offset += CONFIG_STORE_CHUNK_SIZE) {
+            size_t chunk = size - offset;
+            if (chunk > CONFIG_STORE_CHUNK_SIZE)
+                chunk = CONFIG_STORE_CHUNK_SIZE;
+            if (NVM_write(offset, (uint8_t *)(buffer + offset), chunk))
+                return -1;
+            if (yield)
+                yield();
+        }
+        if (NVM_commit())
+            return -1;
+        return 0;
+    }
+
+    // @brief Appends a journal record for the index-th object only, without
+    // comparing or rewriting anything else. Used by the odometer checkpoint,
+    // which must stay cheap enough to run from the brown-out interrupt.
+    // Returns 0 on success, 1 if there is no valid base block or the journal
+    // area is used up (compaction is left to the next regular save) or -1 on
+    // a write error.
+    static int journal_append_one(size_t index, T* val0, Ts* ... vals) {
+        size_t base_size = Config<T, Ts...>::get_size() + 2;
+        if (((base_size + 7) & ~(size_t)7) > NVM_get_max_read_length())
+            return 1;
+        uint8_t* data = (uint8_t *)get_struct_data(index, val0, vals...);
+        size_t length = get_struct_size(index);
+        ConfigJournalHeader_t header = {
+            .magic = (uint16_t)(CONFIG_JOURNAL_MAGIC ^ config_version),
+            .index = (uint16_t)index,
+            .length = (uint16_t)length,
+            .crc16 = calc_crc16<CONFIG_CRC16_POLYNOMIAL>(CONFIG_CRC16_INIT ^ config_version,
+                    data, length)
+        };
+        if (NVM_start_append(sizeof(header) + length))
+            return 1;
+        if (NVM_append_write(0, (uint8_t *)&header, sizeof(header)))
+            return -1;
+        if (NVM_append_write(sizeof(header), data, length))
+            return -1;
+        return NVM_commit_append() ? -1 : 0;
+    }
+
+    // @brief True when the erased area of the active sector can no longer
+    // hold a worst-case journal record, i.e. the next incremental save may
+    // fall back to a full rewrite anyway. Callers use this to schedule the
+    // compaction (a full store into the other sector) at a convenient time
+    // instead of paying for it on a latency-sensitive save.
+    static bool needs_compaction() {
+        size_t worst_case_record = sizeof(ConfigJournalHeader_t) +
+                ((get_max_struct_size() + 7) & ~(size_t)7);
+        return NVM_get_append_free_space() < worst_case_record;
+    }
+
+    // @brief Incremental variant of store_snapshot: appends journal records
+    // for the objects whose snapshot differs from the stored config, falling
+    // back to a full store_snapshot when necessary (see safe_update_config).
+    static int update_snapshot(const uint8_t *buffer, void (*yield)(void)) {
+        uint8_t* data[n_objects];
+        for (size_t i = 0; i < n_objects; ++i)
+            data[i] = (uint8_t *)(buffer + get_struct_offset(i));
+        int status = update_config_impl(data, yield);
+        return (status > 0) ? store_snapshot(buffer, yield) : status;
+    }
 };
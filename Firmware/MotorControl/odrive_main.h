@@ -34,8 +34,15 @@ extern "C" {
 #define PH_CURRENT_MEAS_TIMEOUT 2 // [ms]
 
 //TODO clean this up
+// The control rate is selected at build time (CONFIG_CONTROL_FREQ), so the
+// derived constants fold to literals in every specialization.
+#ifdef __cplusplus
+static constexpr float current_meas_period = CURRENT_MEAS_PERIOD;
+static constexpr int current_meas_hz = (int)(CURRENT_MEAS_HZ);
+#else
 static const float current_meas_period = CURRENT_MEAS_PERIOD;
-static const int current_meas_hz = CURRENT_MEAS_HZ;
+static const int current_meas_hz = (int)(CURRENT_MEAS_HZ);
+#endif
 // extern const float elec_rad_per_enc;
 extern uint32_t _reboot_cookie;
 extern bool user_config_loaded_;
@@ -43,17 +50,46 @@ extern bool user_config_loaded_;
 extern uint64_t serial_number;
 extern char serial_number_str[13];
 
+// Per-stage boot time budget, measured with HAL_GetTick
+typedef struct {
+    uint32_t config_load; // [ms] NVM init + config CRC check/load
+    uint32_t peripheral_init; // [ms] CAN/I2C, user GPIO/ADC, object construction
+    uint32_t comm_init; // [ms] endpoint tree build + comm server start
+    uint32_t axis_setup; // [ms] gate driver SPI setup + encoder timer start
+    uint32_t current_calib_wait; // [ms] DC offset calibration settle delay
+    uint32_t total; // [ms] power-on to fully booted
+} BootTimings_t;
+
 typedef struct {
     bool fully_booted;
+    BootTimings_t boot_timings;
     uint32_t uptime; // [ms]
     uint32_t min_heap_space; // FreeRTOS heap [Bytes]
-    uint32_t min_stack_space_axis0; // minimum remaining space since startup [Bytes]
-    uint32_t min_stack_space_axis1;
+    uint32_t min_stack_space_axis_worker; // minimum remaining space since startup [Bytes]
     uint32_t min_stack_space_comms;
     uint32_t min_stack_space_usb;
     uint32_t min_stack_space_uart;
     uint32_t min_stack_space_usb_irq;
     uint32_t min_stack_space_startup;
+    // CPU load over the last ~1s sampling window [0.1 %]. The control ISRs
+    // are invisible to the scheduler (their cycles are charged to whichever
+    // thread they preempted), so cpu_load_control_isr is accounted from the
+    // profiler and overlaps the per-thread numbers.
+    uint16_t cpu_load_axis_worker;
+    uint16_t cpu_load_comms;
+    uint16_t cpu_load_usb;
+    uint16_t cpu_load_uart;
+    uint16_t cpu_load_usb_irq;
+    uint16_t cpu_load_startup;
+    uint16_t cpu_load_idle;
+    uint16_t cpu_load_control_isr;
+    // Tickless idle bookkeeping (see the sleep hooks in main.cpp). There is
+    // no current sense on the MCU rail, so the standby figure is the share
+    // of wall time spent in WFI; correlate it against a bench current probe
+    // once per hardware revision.
+    uint16_t sleep_ratio;      // share of the last ~1s window spent asleep [0.1 %]
+    uint32_t sleep_entry_cnt;  // sleeps entered since boot
+    uint32_t wakeup_to_arm_us; // [us] latest sleep exit to motor PWM arm
 } SystemStats_t;
 extern SystemStats_t system_stats_;
 
@@ -71,6 +107,24 @@ struct BoardConfig_t {
     bool enable_uart = true;
     bool enable_i2c_instead_of_can = false;
     bool enable_ascii_protocol_on_usb = true;
+    bool enable_watchdog_feed_fibre = true; //<! accept the board-level feed_watchdogs
+                                            //<! call (feeds every axis watchdog in one
+                                            //<! transaction) on the fibre protocol
+    bool enable_watchdog_feed_ascii = true; //<! accept the axis-less form of the ASCII
+                                            //<! watchdog command ("u" without an axis)
+    bool enable_watchdog_feed_can = true;   //<! react to the broadcast watchdog feed
+                                            //<! frame (see interface_can.cpp)
+    bool enable_fast_boot = false; //<! overlap the axis hardware setup with the
+                                   //<! communication init and shorten the current
+                                   //<! sense calibration wait to 5 filter time
+                                   //<! constants
+    float startup_current_budget = 0.0f; //<! [A] combined current the calibration
+                                         //<! procedures of all axes may draw at
+                                         //<! once; a procedure that doesn't fit
+                                         //<! waits for the running ones to finish
+                                         //<! (see acquire_startup_budget).
+                                         //<! 0 = no limit.
+
 #if HW_VERSION_MAJOR == 3 && HW_VERSION_MINOR >= 5 && HW_VERSION_VOLTAGE >= 48
     float brake_resistance = 2.0f;     // [ohm]
 #else
@@ -81,22 +135,72 @@ struct BoardConfig_t {
                                                                         //<! This protects against cases in which the power supply fails to dissipate
                                                                         //<! the brake power if the brake resistor is disabled.
                                                                         //<! The default is 26V for the 24V board version and 52V for the 48V board version.
+    float regen_current_allowed = 0.0f;     //<! [A] DC current the supply/battery may
+                                            //<! absorb before the excess regen is chopped
+                                            //<! into the brake resistor. 0 keeps the
+                                            //<! legacy behavior of dumping everything.
+    float regen_hysteresis_engage = 2.0f;   //<! [V] below dc_bus_overvoltage_trip_level
+                                            //<! at which the dispatcher stops trusting
+                                            //<! the supply and chops all regen
+    float regen_hysteresis_release = 4.0f;  //<! [V] below the trip level at which the
+                                            //<! forced chop is released again
+    uint32_t fibre_ops_per_sec = 0;         //<! per-interface limit on dispatched endpoint
+                                            //<! operations; excess is dropped before dispatch.
+                                            //<! 0 = unlimited. Takes effect on reboot.
+    uint32_t fibre_ops_burst = 32;          //<! token bucket burst budget [operations]
+    bool enable_shared_thermal_derating = false; //<! both DRV stages share the heatsink:
+                                                 //<! additionally derate every axis on the
+                                                 //<! hottest stage through the shared curve
+                                                 //<! below, weighted per axis (see
+                                                 //<! motor config shared_thermal_weight)
+    float shared_thermal_limit_lower = 100.0f;   //<! [degC] heatsink temperature where the
+                                                 //<! shared derating starts
+    float shared_thermal_limit_upper = 120.0f;   //<! [degC] heatsink temperature where the
+                                                 //<! shared derating reaches zero current
     PWMMapping_t pwm_mappings[GPIO_COUNT];
     PWMMapping_t analog_mappings[GPIO_COUNT];
+    float analog_filter_bandwidth = 500.0f; //<! [rad/s] exponential averaging of the raw
+                                            //<! analog input samples; 0 = unfiltered.
+                                            //<! Takes effect on reboot.
+    uint32_t analog_mapping_rate = 1000;    //<! [Hz] rate at which the filtered analog
+                                            //<! inputs are applied to their mapped
+                                            //<! endpoints. Takes effect on reboot.
+    float analog_change_threshold = 0.0f;   //<! [ADC counts] minimum change of the
+                                            //<! filtered analog input before its mapped
+                                            //<! endpoint is rewritten; 0 = rewrite every
+                                            //<! application tick. Takes effect on reboot.
 };
 extern BoardConfig_t board_config;
 extern bool user_config_loaded_;
+extern bool config_save_pending_;
+
+// Tie the mapping table extents to the revision matrix (see
+// board_config_v3.h): a GPIO_COUNT that disagrees with the revision
+// walks the PWM/analog mapping loops past the table on the smaller
+// boards.
+static_assert(sizeof(BoardConfig_t::pwm_mappings) / sizeof(PWMMapping_t) == (size_t)board_rev.gpio_count,
+    "pwm_mappings extent disagrees with the board revision matrix");
+static_assert(sizeof(BoardConfig_t::analog_mappings) / sizeof(PWMMapping_t) == (size_t)board_rev.gpio_count,
+    "analog_mappings extent disagrees with the board revision matrix");
 
 class Axis;
 class Motor;
 
-constexpr size_t AXIS_COUNT = 2;
+// Number of motor axes in this build. Single-axis builds (-DAXIS_COUNT=1,
+// set via CONFIG_AXIS_COUNT in tup.config) drop the M1 timer/ADC work from
+// the control ISRs and free the RAM of the unused axis objects. This is a
+// preprocessor define (not a constexpr) so that the ISRs can compile the
+// second axis paths out entirely.
+#ifndef AXIS_COUNT
+#define AXIS_COUNT 2
+#endif
 extern Axis *axes[AXIS_COUNT];
 
-// if you use the oscilloscope feature you can bump up this value
-#define OSCILLOSCOPE_SIZE 128
+// Capture RAM for the oscilloscope engine, shared by all channels.
+// 4096 floats = 16 kB = 1024 samples per channel; shrink this if RAM gets
+// tight on feature-heavy builds.
+#define OSCILLOSCOPE_SIZE 4096
 extern float oscilloscope[OSCILLOSCOPE_SIZE];
-extern size_t oscilloscope_pos;
 
 // TODO: move
 // this is technically not thread-safe but practically it might be
@@ -112,13 +216,19 @@ inline ENUMTYPE operator ~ (ENUMTYPE a) { return static_cast<ENUMTYPE>(~static_c
 
 // ODrive specific includes
 #include <utils.h>
+#include <trace.h>
 #include <low_level.h>
+#include <profiler.hpp>
 #include <encoder.hpp>
 #include <sensorless_estimator.hpp>
 #include <controller.hpp>
 #include <motor.hpp>
 #include <trapTraj.hpp>
 #include <axis.hpp>
+#include <oscilloscope.hpp>
+#include <blackbox.hpp>
+#include <watch.hpp>
+#include <communication/telemetry.hpp>
 #include <communication/communication.h>
 
 #endif // __cplusplus
@@ -126,7 +236,36 @@ inline ENUMTYPE operator ~ (ENUMTYPE a) { return static_cast<ENUMTYPE>(~static_c
 
 // general system functions defined in main.cpp
 void save_configuration(void);
+#ifdef __cplusplus
+void save_configuration_async(void);
+#endif
+#ifdef RUN_BENCHMARKS
+void run_benchmarks(void); // defined in benchmarks.cpp
+#endif
 void erase_configuration(void);
 void enter_dfu_mode(void);
+void odometer_checkpoint(void);
+void tickless_note_motor_arm(void);
+void feed_all_watchdogs(void); // defined in axis.cpp
+
+#ifdef __cplusplus
+// bulk config export/import (see main.cpp)
+uint32_t get_config_image_size(void);
+int32_t config_export_begin(void);
+uint32_t config_read_word(uint32_t offset);
+void config_write_word(uint32_t offset, uint32_t word);
+int32_t config_import_commit(void);
+
+// runtime interface reconfiguration (see main.cpp / communication.cpp)
+void init_i2c_auto_addr(void);
+
+// config trial mode (see main.cpp)
+int32_t config_trial_begin(uint32_t timeout_ms);
+void config_trial_feed(void);
+int32_t config_trial_commit(void);
+int32_t config_trial_revert(void);
+extern bool config_trial_active_;
+extern uint32_t config_trial_revert_cnt_;
+#endif
 
 #endif /* __ODRIVE_MAIN_H */
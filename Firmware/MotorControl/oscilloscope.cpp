@@ -0,0 +1,221 @@
+
+#include "odrive_main.h"
+
+#include <freertos_vars.h>
+
+Oscilloscope osc_;
+
+// @brief Resolves the channel bindings and starts recording pre-trigger
+// history. Resolving happens here (in the communication thread) so the
+// sampling interrupt only ever dereferences plain endpoint pointers.
+void Oscilloscope::arm() {
+    state_ = STATE_IDLE; // stop the sampler while we reconfigure
+    for (size_t c = 0; c < NUM_CHANNELS; ++c) {
+        resolved_[c] = is_endpoint_ref_valid(config_.channels[c].endpoint)
+                     ? get_endpoint(config_.channels[c].endpoint) : nullptr;
+        write_index_[c] = 0;
+        trigger_index_[c] = 0;
+        decimation_counter_[c] = 0;
+        post_trigger_remaining_[c] = 0;
+    }
+    last_trigger_value_ = 0.0f / 0.0f; // NaN: no spurious edge on the first sample
+    raw_remaining_ = 0; // the float capture takes over the shared buffer
+    state_ = STATE_ARMED;
+}
+
+// @brief Starts a raw ADC burst capture. The float capture engine is
+// stopped since both modes share the capture RAM.
+void Oscilloscope::arm_raw(uint32_t axis, uint32_t n_cycles) {
+    raw_remaining_ = 0; // stop the sampler while we reconfigure
+    state_ = STATE_IDLE;
+    if (axis >= AXIS_COUNT)
+        return;
+    if (n_cycles > RAW_DEPTH)
+        n_cycles = RAW_DEPTH;
+    raw_axis_ = axis;
+    raw_write_ = 0;
+    raw_remaining_ = n_cycles;
+}
+
+void Oscilloscope::sample_raw_adc(int axis_num, bool is_phB, uint32_t adc_value) {
+    if (!raw_remaining_ || (uint32_t)axis_num != raw_axis_)
+        return;
+    uint16_t* raw = reinterpret_cast<uint16_t*>(oscilloscope);
+    raw[2 * raw_write_ + (is_phB ? 0 : 1)] = (uint16_t)adc_value;
+    if (!is_phB) { // ADC3 (phC) is dispatched last: the pair is complete
+        ++raw_write_;
+        if (--raw_remaining_ == 0 && config_.auto_dump)
+            start_dump();
+    }
+}
+
+void Oscilloscope::disarm() {
+    state_ = STATE_IDLE;
+}
+
+void Oscilloscope::force_trigger() {
+    if (state_ == STATE_ARMED)
+        trigger();
+}
+
+void Oscilloscope::start_dump() {
+    dump_pending_ = true;
+    osSemaphoreRelease(sem_usb_rx); // wake the USB server thread
+}
+
+void Oscilloscope::service_dump(PacketSink& output) {
+    if (!dump_pending_)
+        return;
+    dump_pending_ = false;
+
+    static_assert(sizeof(DumpHeader_t) == 12, "dump header layout is part of the wire format");
+
+    // The F405's USB FS core has no DMA mode, and the USB driver copies
+    // into its own transfer buffer anyway, so the samples pass through
+    // one staging buffer here. Static because the USB server thread (the
+    // only caller) runs on a small stack.
+    static uint8_t chunk[512];
+    size_t mtu = output.get_mtu();
+    if (mtu > sizeof(chunk))
+        mtu = sizeof(chunk);
+    size_t samples_per_chunk = (mtu - sizeof(DumpHeader_t)) / sizeof(float);
+
+    // chunk 0: channel config and trigger metadata
+    DumpHeader_t header = { DUMP_MAGIC, 0, 0, (uint16_t)sizeof(DumpMetadata_t), 0 };
+    DumpMetadata_t meta;
+    meta.channel_depth = CHANNEL_DEPTH;
+    meta.trigger_channel = config_.trigger_channel;
+    meta.trigger_mode = config_.trigger_mode;
+    meta.trigger_level = config_.trigger_level;
+    meta.pretrigger_samples = config_.pretrigger_samples;
+    for (size_t c = 0; c < NUM_CHANNELS; ++c) {
+        meta.write_index[c] = write_index_[c];
+        meta.trigger_index[c] = trigger_index_[c];
+        meta.decimation[c] = config_.channels[c].decimation;
+        meta.decimation_mode[c] = config_.channels[c].decimation_mode;
+    }
+    memcpy(chunk, &header, sizeof(header));
+    memcpy(chunk + sizeof(header), &meta, sizeof(meta));
+    if (output.process_packet(chunk, sizeof(header) + sizeof(meta)) != 0)
+        return; // host gone: drop the dump instead of retrying
+
+    // data chunks: the raw capture RAM in buffer order
+    uint16_t chunk_number = 1;
+    for (size_t offset = 0; offset < OSCILLOSCOPE_SIZE; ) {
+        size_t n = samples_per_chunk;
+        if (offset + n > OSCILLOSCOPE_SIZE)
+            n = OSCILLOSCOPE_SIZE - offset;
+        header = { DUMP_MAGIC, chunk_number++, (uint32_t)offset, (uint16_t)(n * sizeof(float)), 0 };
+        memcpy(chunk, &header, sizeof(header));
+        memcpy(chunk + sizeof(header), &oscilloscope[offset], n * sizeof(float));
+        if (output.process_packet(chunk, sizeof(header) + n * sizeof(float)) != 0)
+            return;
+        offset += n;
+    }
+}
+
+// @brief Stores one sample into the channel's slice of the capture RAM
+// and accounts for it against the post-trigger budget. Envelope bins call
+// this twice, so their effective span per buffer is half that of the
+// single-sample modes.
+void Oscilloscope::store_sample(size_t channel, float value) {
+    oscilloscope[channel * CHANNEL_DEPTH + write_index_[channel]] = value;
+    write_index_[channel] = (write_index_[channel] + 1) % CHANNEL_DEPTH;
+    if (state_ == STATE_TRIGGERED && post_trigger_remaining_[channel])
+        --post_trigger_remaining_[channel];
+}
+
+void Oscilloscope::trigger() {
+    uint32_t pretrigger = config_.pretrigger_samples;
+    if (pretrigger >= CHANNEL_DEPTH)
+        pretrigger = CHANNEL_DEPTH - 1;
+    uint32_t posttrigger = CHANNEL_DEPTH - pretrigger;
+    if (config_.posttrigger_samples && config_.posttrigger_samples < posttrigger)
+        posttrigger = config_.posttrigger_samples;
+    for (size_t c = 0; c < NUM_CHANNELS; ++c) {
+        trigger_index_[c] = write_index_[c];
+        post_trigger_remaining_[c] = posttrigger;
+    }
+    state_ = STATE_TRIGGERED;
+}
+
+void Oscilloscope::sample() {
+    if (state_ != STATE_ARMED && state_ != STATE_TRIGGERED)
+        return;
+
+    // Evaluate the trigger condition on the undecimated source value
+    if (state_ == STATE_ARMED) {
+        bool triggered = false;
+        if (config_.trigger_mode == TRIGGER_RISING_EDGE
+            || config_.trigger_mode == TRIGGER_FALLING_EDGE) {
+            Endpoint* source = (config_.trigger_channel < NUM_CHANNELS)
+                             ? resolved_[config_.trigger_channel] : nullptr;
+            float value;
+            if (source && source->get_as_float(&value)) {
+                if (config_.trigger_mode == TRIGGER_RISING_EDGE)
+                    triggered = (last_trigger_value_ < config_.trigger_level)
+                             && (value >= config_.trigger_level);
+                else
+                    triggered = (last_trigger_value_ > config_.trigger_level)
+                             && (value <= config_.trigger_level);
+                last_trigger_value_ = value;
+            }
+        } else if (config_.trigger_mode == TRIGGER_ERROR_FLAG) {
+            for (size_t i = 0; i < AXIS_COUNT; ++i)
+                triggered = triggered || (axes[i]->error_ != Axis::ERROR_NONE);
+        }
+        if (triggered)
+            trigger();
+    }
+
+    bool any_channel_active = false;
+    for (size_t c = 0; c < NUM_CHANNELS; ++c) {
+        if (!resolved_[c])
+            continue;
+        if (state_ == STATE_TRIGGERED && post_trigger_remaining_[c] == 0)
+            continue; // this channel completed its post-trigger capture
+        any_channel_active = true;
+        const ChannelConfig_t& chan = config_.channels[c];
+        bool bin_complete = ++decimation_counter_[c] >= chan.decimation;
+
+        if (chan.decimation_mode == DECIM_SUBSAMPLE) {
+            // Naive subsampling: only the bin-completing cycle touches the
+            // endpoint at all, keeping heavily decimated channels cheap.
+            if (!bin_complete)
+                continue;
+            decimation_counter_[c] = 0;
+            float value;
+            if (!resolved_[c]->get_as_float(&value))
+                value = 0.0f / 0.0f; // endpoint is not numeric
+            store_sample(c, value);
+            continue;
+        }
+
+        // Min/max binning: evaluate every cycle so a single-cycle spike
+        // inside the bin still lands in the stored extrema.
+        float value;
+        if (!resolved_[c]->get_as_float(&value))
+            value = 0.0f / 0.0f;
+        if (decimation_counter_[c] == 1) { // first cycle of this bin
+            bin_min_[c] = value;
+            bin_max_[c] = value;
+        } else {
+            if (value < bin_min_[c]) bin_min_[c] = value;
+            if (value > bin_max_[c]) bin_max_[c] = value;
+        }
+        if (!bin_complete)
+            continue;
+        decimation_counter_[c] = 0;
+        if (chan.decimation_mode != DECIM_MAX)
+            store_sample(c, bin_min_[c]);
+        if (chan.decimation_mode != DECIM_MIN
+            && !(state_ == STATE_TRIGGERED && post_trigger_remaining_[c] == 0))
+            store_sample(c, bin_max_[c]);
+    }
+
+    if (state_ == STATE_TRIGGERED && !any_channel_active) {
+        state_ = STATE_DONE;
+        if (config_.auto_dump)
+            start_dump();
+    }
+}
@@ -0,0 +1,222 @@
+#ifndef __OSCILLOSCOPE_HPP
+#define __OSCILLOSCOPE_HPP
+
+#ifndef __ODRIVE_MAIN_H
+#error "This file should not be included directly. Include odrive_main.h instead."
+#endif
+
+// @brief Multi-channel triggered capture engine.
+//
+// Each channel is bound to a numeric protocol endpoint (Iq_measured,
+// pos_estimate, ...) and sampled in the current measurement interrupt, so
+// the recording is cycle-accurate with respect to the control loop. While
+// armed, all channels record continuously into their slice of the shared
+// oscilloscope[] buffer, which provides the pre-trigger history. Once the
+// trigger fires, recording continues until channel_depth minus
+// pretrigger_samples further samples were stored.
+//
+// The capture RAM is read back through the "data" array endpoint; channel c
+// occupies [c * channel_depth, (c + 1) * channel_depth) and wraps at
+// trigger_index / write_index as reported per channel.
+class Oscilloscope {
+public:
+    enum TriggerMode_t {
+        TRIGGER_MANUAL = 0,       // only force_trigger()
+        TRIGGER_RISING_EDGE = 1,  // trigger channel value crosses level upwards
+        TRIGGER_FALLING_EDGE = 2, // trigger channel value crosses level downwards
+        TRIGGER_ERROR_FLAG = 3,   // any axis reports an error
+    };
+
+    enum State_t {
+        STATE_IDLE = 0,
+        STATE_ARMED = 1,
+        STATE_TRIGGERED = 2,
+        STATE_DONE = 3,
+    };
+
+    static constexpr size_t NUM_CHANNELS = 4;
+    static constexpr size_t CHANNEL_DEPTH = OSCILLOSCOPE_SIZE / NUM_CHANNELS;
+
+    // How a channel reduces `decimation` control cycles to its stored
+    // samples. Subsampling keeps one arbitrary cycle per bin and misses
+    // anything shorter than the bin; the min/max modes evaluate the
+    // endpoint on every cycle and store the bin extremum, so a 1ms spike
+    // survives even a capture decimated down to minutes of span. Envelope
+    // stores both extrema (min, then max) and thus consumes two buffer
+    // slots per bin.
+    enum DecimationMode_t {
+        DECIM_SUBSAMPLE = 0, // every decimation-th sample
+        DECIM_MIN = 1,       // minimum of each bin
+        DECIM_MAX = 2,       // maximum of each bin
+        DECIM_ENVELOPE = 3,  // min and max of each bin
+    };
+
+    struct ChannelConfig_t {
+        endpoint_ref_t endpoint = { 0, 0, 0 }; // invalid ref = channel disabled
+        uint32_t decimation = 1;               // control cycles per stored bin
+        DecimationMode_t decimation_mode = DECIM_SUBSAMPLE;
+    };
+
+    struct Config_t {
+        ChannelConfig_t channels[NUM_CHANNELS];
+        uint32_t trigger_channel = 0;
+        TriggerMode_t trigger_mode = TRIGGER_MANUAL;
+        float trigger_level = 0.0f;
+        uint32_t pretrigger_samples = CHANNEL_DEPTH / 4;
+        // Post-trigger run-length cap, in stored samples per channel.
+        // 0 fills the rest of the buffer (channel_depth - pretrigger).
+        // A smaller value freezes the capture that many samples after the
+        // trigger, which matters for heavily decimated channels: with a
+        // 1s/bin decimation, filling the remaining buffer would keep
+        // recording for minutes after the fault the capture was armed for.
+        uint32_t posttrigger_samples = 0;
+        bool auto_dump = false; // push the buffer as soon as a capture completes
+    };
+
+    // Autonomous capture dump ------------------------------------------
+    //
+    // Instead of reading the capture RAM sample by sample through the
+    // "data" endpoint, a completed capture can be pushed to the host over
+    // the native USB bulk pipe without request/response round trips.
+    // Chunk 0 carries the channel and trigger metadata, subsequent chunks
+    // carry the raw float samples. Every chunk starts with DumpHeader_t;
+    // the magic has bit 15 clear, so a chunk can never be mistaken for a
+    // protocol response (those start with seq_no | 0x8000).
+    struct DumpHeader_t {
+        uint16_t magic;       // = DUMP_MAGIC
+        uint16_t chunk;       // 0 = metadata, data chunks count from 1
+        uint32_t offset;      // index into oscilloscope[] of the first sample
+        uint16_t payload_len; // bytes following this header
+        uint16_t reserved;    // = 0
+    };
+    struct DumpMetadata_t {   // payload of chunk 0
+        uint32_t channel_depth;
+        uint32_t trigger_channel;
+        uint32_t trigger_mode;
+        float trigger_level;
+        uint32_t pretrigger_samples;
+        uint32_t write_index[NUM_CHANNELS];
+        uint32_t trigger_index[NUM_CHANNELS];
+        uint32_t decimation[NUM_CHANNELS];
+        uint32_t decimation_mode[NUM_CHANNELS];
+    };
+    static constexpr uint16_t DUMP_MAGIC = 0x5C0B;
+
+    // Raw ADC burst capture --------------------------------------------
+    //
+    // Commissioning mode for the current sensors: records the unprocessed
+    // injected-ADC counts of one axis - the phase_current_from_adcval
+    // input, before any scaling or DC_calib_ subtraction - at full PWM
+    // rate. The capture RAM is reinterpreted as uint16_t pairs, one
+    // (phB, phC) pair per current measurement cycle, so RAW_DEPTH cycles
+    // fit. Arming a raw capture stops and invalidates any float capture
+    // (and vice versa) since both share the buffer. Readback goes through
+    // the "data" endpoint (two packed counts per float) or start_dump().
+    static constexpr size_t RAW_DEPTH = OSCILLOSCOPE_SIZE * sizeof(float) / (2 * sizeof(uint16_t));
+
+    // @brief Starts recording n_cycles (phB, phC) pairs of the given axis,
+    // beginning with the next current measurement.
+    void arm_raw(uint32_t axis, uint32_t n_cycles);
+
+    // Called from the ADC ISR for every vector 0 conversion; returns
+    // immediately unless a raw capture is running.
+    void sample_raw_adc(int axis_num, bool is_phB, uint32_t adc_value);
+
+    void arm();
+    void disarm();
+    void force_trigger();
+
+    // @brief Schedules a dump of the capture RAM and wakes the USB server
+    // thread to stream it. Callable from thread and interrupt context.
+    void start_dump();
+
+    // @brief Streams the pending dump, if any. Called by the USB server
+    // thread so dump traffic is serialized with the response traffic on
+    // the same endpoint.
+    void service_dump(PacketSink& output);
+
+    // Called once per current measurement cycle in interrupt context.
+    void sample();
+
+    Config_t config_;
+
+    State_t state_ = STATE_IDLE;
+    uint32_t write_index_[NUM_CHANNELS] = { 0 };
+    uint32_t trigger_index_[NUM_CHANNELS] = { 0 };
+
+    // Communication protocol definitions
+    auto make_protocol_definitions() {
+        return make_protocol_member_list(
+            make_protocol_ro_property("state", &state_),
+            make_protocol_ro_property("channel_depth", &channel_depth_),
+            make_protocol_object("ch0",
+                make_protocol_property("endpoint", &config_.channels[0].endpoint),
+                make_protocol_property("decimation", &config_.channels[0].decimation),
+                make_protocol_property("decimation_mode", &config_.channels[0].decimation_mode),
+                make_protocol_ro_property("write_index", &write_index_[0]),
+                make_protocol_ro_property("trigger_index", &trigger_index_[0])
+            ),
+            make_protocol_object("ch1",
+                make_protocol_property("endpoint", &config_.channels[1].endpoint),
+                make_protocol_property("decimation", &config_.channels[1].decimation),
+                make_protocol_property("decimation_mode", &config_.channels[1].decimation_mode),
+                make_protocol_ro_property("write_index", &write_index_[1]),
+                make_protocol_ro_property("trigger_index", &trigger_index_[1])
+            ),
+            make_protocol_object("ch2",
+                make_protocol_property("endpoint", &config_.channels[2].endpoint),
+                make_protocol_property("decimation", &config_.channels[2].decimation),
+                make_protocol_property("decimation_mode", &config_.channels[2].decimation_mode),
+                make_protocol_ro_property("write_index", &write_index_[2]),
+                make_protocol_ro_property("trigger_index", &trigger_index_[2])
+            ),
+            make_protocol_object("ch3",
+                make_protocol_property("endpoint", &config_.channels[3].endpoint),
+                make_protocol_property("decimation", &config_.channels[3].decimation),
+                make_protocol_property("decimation_mode", &config_.channels[3].decimation_mode),
+                make_protocol_ro_property("write_index", &write_index_[3]),
+                make_protocol_ro_property("trigger_index", &trigger_index_[3])
+            ),
+            make_protocol_object("config",
+                make_protocol_property("trigger_channel", &config_.trigger_channel),
+                make_protocol_property("trigger_mode", &config_.trigger_mode),
+                make_protocol_property("trigger_level", &config_.trigger_level),
+                make_protocol_property("pretrigger_samples", &config_.pretrigger_samples),
+                make_protocol_property("posttrigger_samples", &config_.posttrigger_samples),
+                make_protocol_property("auto_dump", &config_.auto_dump)
+            ),
+            make_protocol_object("raw",
+                make_protocol_ro_property("depth", &raw_depth_),
+                make_protocol_ro_property("remaining", &raw_remaining_),
+                make_protocol_ro_property("n_captured", &raw_write_),
+                make_protocol_function("arm", *this, &Oscilloscope::arm_raw, "axis", "n_cycles")
+            ),
+            make_protocol_ro_array_property("data", oscilloscope, OSCILLOSCOPE_SIZE),
+            make_protocol_function("arm", *this, &Oscilloscope::arm),
+            make_protocol_function("disarm", *this, &Oscilloscope::disarm),
+            make_protocol_function("force_trigger", *this, &Oscilloscope::force_trigger),
+            make_protocol_function("start_dump", *this, &Oscilloscope::start_dump)
+        );
+    }
+
+private:
+    void trigger();
+    void store_sample(size_t channel, float value);
+
+    Endpoint* resolved_[NUM_CHANNELS] = { nullptr };
+    float bin_min_[NUM_CHANNELS] = { 0.0f }; // running extrema of the current bin
+    float bin_max_[NUM_CHANNELS] = { 0.0f }; // (min/max/envelope decimation modes)
+    volatile bool dump_pending_ = false;
+    uint32_t raw_axis_ = 0;
+    uint32_t raw_write_ = 0;     // completed (phB, phC) pairs
+    uint32_t raw_remaining_ = 0; // pairs still to record; 0 = raw capture inactive
+    uint32_t decimation_counter_[NUM_CHANNELS] = { 0 };
+    uint32_t post_trigger_remaining_[NUM_CHANNELS] = { 0 };
+    float last_trigger_value_ = 0.0f;
+    const uint32_t channel_depth_ = CHANNEL_DEPTH;
+    const uint32_t raw_depth_ = RAW_DEPTH;
+};
+
+extern Oscilloscope osc_;
+
+#endif // __OSCILLOSCOPE_HPP
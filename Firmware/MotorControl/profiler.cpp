@@ -0,0 +1,43 @@
+
+#include "odrive_main.h"
+
+Profiler profiler_;
+
+// @brief Enables the DWT cycle counter and clears all statistics.
+void Profiler::init() {
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+    reset();
+}
+
+// @brief Clears all accumulated statistics.
+void Profiler::reset() {
+    for (size_t i = 0; i < PROFILER_STAGE_NUM_STAGES; ++i) {
+        stages_[i].min = UINT32_MAX;
+        stages_[i].max = 0;
+        stages_[i].sum = 0;
+        stages_[i].count = 0;
+        for (size_t bin = 0; bin < PROFILER_HISTOGRAM_BINS; ++bin)
+            stages_[i].histogram[bin] = 0;
+    }
+}
+
+// @brief Returns the mean duration of the stage in cycles,
+// or 0 if no samples were recorded yet.
+float Profiler::get_mean(uint32_t stage) {
+    if (stage >= PROFILER_STAGE_NUM_STAGES)
+        return 0.0f;
+    StageStats_t& stats = stages_[stage];
+    if (stats.count == 0)
+        return 0.0f;
+    return (float)stats.sum / (float)stats.count;
+}
+
+// @brief Returns one bin of the log2 duration histogram of the stage.
+// Bin i counts samples that took [2^i, 2^(i+1)) cycles.
+uint32_t Profiler::get_histogram_bin(uint32_t stage, uint32_t bin) {
+    if (stage >= PROFILER_STAGE_NUM_STAGES || bin >= PROFILER_HISTOGRAM_BINS)
+        return 0;
+    return stages_[stage].histogram[bin];
+}
@@ -0,0 +1,135 @@
+#ifndef __PROFILER_HPP
+#define __PROFILER_HPP
+
+#ifndef __ODRIVE_MAIN_H
+#error "This file should not be included directly. Include odrive_main.h instead."
+#endif
+
+// Cycle-accurate hot-path profiler based on the Cortex-M4 DWT cycle counter.
+//
+// Unlike Motor::log_timing, which only stores the last timer snapshot per
+// slot, this accumulates min/max/mean and a log2 histogram of the measured
+// durations so we can quantify how much headroom is left before
+// ERROR_CONTROL_DEADLINE_MISSED fires. Usage:
+//
+//     uint32_t start = Profiler::enter();
+//     ... code under measurement ...
+//     profiler_.leave(PROFILER_STAGE_FOC_CURRENT, start);
+//
+// enter/leave are safe to call from interrupt context.
+
+enum ProfilerStage_t {
+    PROFILER_STAGE_ADC_CB = 0,
+    PROFILER_STAGE_FOC_CURRENT,
+    PROFILER_STAGE_FOC_VOLTAGE,
+    PROFILER_STAGE_CONTROL_LOOP,
+    PROFILER_STAGE_ESTIMATOR_UPDATES,
+    PROFILER_STAGE_ADC_IRQ_LATENCY,
+    PROFILER_STAGE_TIMING_MARGIN,
+    PROFILER_STAGE_NUM_STAGES
+};
+
+// bin i counts durations in [2^i, 2^(i+1)) cycles; the last bin absorbs
+// everything longer
+#define PROFILER_HISTOGRAM_BINS 16
+
+class Profiler {
+public:
+    struct StageStats_t {
+        uint32_t min;   // [cycles]
+        uint32_t max;   // [cycles]
+        uint64_t sum;   // [cycles]
+        uint32_t count;
+        uint32_t histogram[PROFILER_HISTOGRAM_BINS];
+    };
+
+    // @brief Enables the DWT cycle counter. Must be called once before
+    // any enter/leave pair.
+    void init();
+
+    // @brief Clears all accumulated statistics.
+    void reset();
+
+    // @brief Snapshots the cycle counter at the start of a stage.
+    static inline uint32_t enter() {
+        return DWT->CYCCNT;
+    }
+
+    // @brief Accumulates the duration since the matching enter() call.
+    inline void leave(ProfilerStage_t stage, uint32_t start_cycles) {
+        record(stage, DWT->CYCCNT - start_cycles);
+    }
+
+    // @brief Accumulates an externally measured duration, for stages whose
+    // start point is not observable in software (e.g. a hardware trigger
+    // read back from a timer counter).
+    inline void record(ProfilerStage_t stage, uint32_t delta) {
+        StageStats_t& stats = stages_[stage];
+        if (delta < stats.min)
+            stats.min = delta;
+        if (delta > stats.max)
+            stats.max = delta;
+        stats.sum += delta;
+        stats.count++;
+        uint32_t bin = 31 - __CLZ(delta | 1);
+        if (bin >= PROFILER_HISTOGRAM_BINS)
+            bin = PROFILER_HISTOGRAM_BINS - 1;
+        stats.histogram[bin]++;
+    }
+
+    float get_mean(uint32_t stage);
+    uint32_t get_histogram_bin(uint32_t stage, uint32_t bin);
+
+    StageStats_t stages_[PROFILER_STAGE_NUM_STAGES];
+
+    // Communication protocol definitions
+    auto make_protocol_definitions() {
+        return make_protocol_member_list(
+            make_protocol_object("adc_cb",
+                make_protocol_ro_property("min", &stages_[PROFILER_STAGE_ADC_CB].min),
+                make_protocol_ro_property("max", &stages_[PROFILER_STAGE_ADC_CB].max),
+                make_protocol_ro_property("count", &stages_[PROFILER_STAGE_ADC_CB].count)
+            ),
+            make_protocol_object("foc_current",
+                make_protocol_ro_property("min", &stages_[PROFILER_STAGE_FOC_CURRENT].min),
+                make_protocol_ro_property("max", &stages_[PROFILER_STAGE_FOC_CURRENT].max),
+                make_protocol_ro_property("count", &stages_[PROFILER_STAGE_FOC_CURRENT].count)
+            ),
+            make_protocol_object("foc_voltage",
+                make_protocol_ro_property("min", &stages_[PROFILER_STAGE_FOC_VOLTAGE].min),
+                make_protocol_ro_property("max", &stages_[PROFILER_STAGE_FOC_VOLTAGE].max),
+                make_protocol_ro_property("count", &stages_[PROFILER_STAGE_FOC_VOLTAGE].count)
+            ),
+            make_protocol_object("control_loop",
+                make_protocol_ro_property("min", &stages_[PROFILER_STAGE_CONTROL_LOOP].min),
+                make_protocol_ro_property("max", &stages_[PROFILER_STAGE_CONTROL_LOOP].max),
+                make_protocol_ro_property("count", &stages_[PROFILER_STAGE_CONTROL_LOOP].count)
+            ),
+            make_protocol_object("estimator_updates",
+                make_protocol_ro_property("min", &stages_[PROFILER_STAGE_ESTIMATOR_UPDATES].min),
+                make_protocol_ro_property("max", &stages_[PROFILER_STAGE_ESTIMATOR_UPDATES].max),
+                make_protocol_ro_property("count", &stages_[PROFILER_STAGE_ESTIMATOR_UPDATES].count)
+            ),
+            make_protocol_object("adc_irq_latency",
+                make_protocol_ro_property("min", &stages_[PROFILER_STAGE_ADC_IRQ_LATENCY].min),
+                make_protocol_ro_property("max", &stages_[PROFILER_STAGE_ADC_IRQ_LATENCY].max),
+                make_protocol_ro_property("count", &stages_[PROFILER_STAGE_ADC_IRQ_LATENCY].count)
+            ),
+            // Headroom between enqueue_modulation_timings completing and the
+            // timing load point; min approaching 0 means we are about to
+            // start throwing ERROR_CONTROL_DEADLINE_MISSED.
+            make_protocol_object("timings_margin",
+                make_protocol_ro_property("min", &stages_[PROFILER_STAGE_TIMING_MARGIN].min),
+                make_protocol_ro_property("max", &stages_[PROFILER_STAGE_TIMING_MARGIN].max),
+                make_protocol_ro_property("count", &stages_[PROFILER_STAGE_TIMING_MARGIN].count)
+            ),
+            make_protocol_function("get_mean", *this, &Profiler::get_mean, "stage"),
+            make_protocol_function("get_histogram_bin", *this, &Profiler::get_histogram_bin, "stage", "bin"),
+            make_protocol_function("reset", *this, &Profiler::reset)
+        );
+    }
+};
+
+extern Profiler profiler_;
+
+#endif // __PROFILER_HPP
@@ -1,5 +1,6 @@
 
 #include "odrive_main.h"
+#include "atan2_lut.hpp"
 
 SensorlessEstimator::SensorlessEstimator(Config_t& config) :
         config_(config)
@@ -58,24 +59,84 @@ bool SensorlessEstimator::update() {
 
     // PLL
     // TODO: the PLL part has some code duplication with the encoder PLL
+    // The flux integration above has to run at full control rate (it
+    // consumes every current sample), but the atan2 + PLL correction only
+    // needs control rate / config_.pll_decimation. Between corrections both
+    // phase outputs are predicted from the velocity estimate, which is what
+    // the PLL does with its phase state anyway.
+
+    // predict PLL phase with velocity
+    pll_pos_ = wrap_pm_pi(pll_pos_ + current_meas_period * vel_estimate_);
+    if (config_.pll_decimation > 1) {
+        // keep the phase output fresh for the current controller
+        phase_ = wrap_pm_pi(phase_ + current_meas_period * vel_estimate_);
+        if (++pll_cycle_ < config_.pll_decimation)
+            return true;
+    }
+    pll_cycle_ = 0;
+    float pll_period = current_meas_period * (float)MACRO_MAX(config_.pll_decimation, 1);
     // Pll gains as a function of bandwidth
     float pll_kp = 2.0f * config_.pll_bandwidth;
     // Critically damped
     float pll_ki = 0.25f * (pll_kp * pll_kp);
     // Check that we don't get problems with discrete time approximation
-    if (!(current_meas_period * pll_kp < 1.0f)) {
+    if (!(pll_period * pll_kp < 1.0f)) {
+        axis_->log_error(Axis::ERROR_SOURCE_SENSORLESS, (uint32_t)(ERROR_UNSTABLE_GAIN & ~error_));
         error_ |= ERROR_UNSTABLE_GAIN;
         return false;
     }
 
-    // predict PLL phase with velocity
-    pll_pos_ = wrap_pm_pi(pll_pos_ + current_meas_period * vel_estimate_);
     // update PLL phase with observer permanent magnet phase
-    phase_ = fast_atan2(eta[1], eta[0]);
+    phase_ = fast_atan2_lut(eta[1], eta[0]);
     float delta_phase = wrap_pm_pi(phase_ - pll_pos_);
-    pll_pos_ = wrap_pm_pi(pll_pos_ + current_meas_period * pll_kp * delta_phase);
+    pll_pos_ = wrap_pm_pi(pll_pos_ + pll_period * pll_kp * delta_phase);
     // update PLL velocity
-    vel_estimate_ += current_meas_period * pll_ki * delta_phase;
+    vel_estimate_ += pll_period * pll_ki * delta_phase;
 
     return true;
 };
+
+// @brief Saves the observer and PLL state so a prompt re-entry into
+// sensorless control can skip the lockin ramp. Called on a clean exit
+// from the sensorless control loop.
+void SensorlessEstimator::checkpoint() {
+    checkpoint_flux_state_[0] = flux_state_[0];
+    checkpoint_flux_state_[1] = flux_state_[1];
+    checkpoint_pll_pos_ = pll_pos_;
+    checkpoint_vel_estimate_ = vel_estimate_;
+    checkpoint_tick_ms_ = HAL_GetTick();
+    checkpoint_valid_ = true;
+}
+
+// @brief Restores the last checkpoint if it is recent enough that the
+// coasting rotor is still near the checkpointed state; the zero-current
+// settle window afterwards pulls the estimate back in exactly.
+bool SensorlessEstimator::try_restore_checkpoint() {
+    if (!checkpoint_valid_)
+        return false;
+    uint32_t age_ms = HAL_GetTick() - checkpoint_tick_ms_;
+    if ((float)age_ms > config_.warm_start_max_age * 1000.0f)
+        return false;
+    flux_state_[0] = checkpoint_flux_state_[0];
+    flux_state_[1] = checkpoint_flux_state_[1];
+    pll_pos_ = checkpoint_pll_pos_;
+    phase_ = checkpoint_pll_pos_;
+    vel_estimate_ = checkpoint_vel_estimate_;
+    // The phases were floating while stopped, so no voltage was applied
+    V_alpha_beta_memory_[0] = 0.0f;
+    V_alpha_beta_memory_[1] = 0.0f;
+    return true;
+}
+
+// @brief Seeds the observer for a flying start on a rotor of unknown speed
+// and position: nominal flux magnitude at an arbitrary angle. The back-EMF
+// driven currents during the zero-current settle window do the rest.
+void SensorlessEstimator::seed_flying_start() {
+    flux_state_[0] = config_.pm_flux_linkage;
+    flux_state_[1] = 0.0f;
+    V_alpha_beta_memory_[0] = 0.0f;
+    V_alpha_beta_memory_[1] = 0.0f;
+    pll_pos_ = 0.0f;
+    phase_ = 0.0f;
+    vel_estimate_ = 0.0f;
+}
@@ -12,11 +12,27 @@ public:
         float observer_gain = 1000.0f; // [rad/s]
         float pll_bandwidth = 1000.0f;  // [rad/s]
         float pm_flux_linkage = 1.58e-3f; // [V / (rad/s)]  { 5.51328895422 / (<pole pairs> * <rpm/v>) }
+        // Warm start: skip the lockin ramp when entering sensorless control
+        // by restoring a recent estimator checkpoint, or by letting the
+        // observer converge on the back-EMF of an already spinning rotor
+        // during a zero-current settle window (flying start).
+        bool enable_warm_start = false;
+        float warm_start_max_age = 1.0f;       // [s] max checkpoint age for a restore
+        float flying_start_settle_time = 0.2f; // [s] zero-current convergence window
+        float flying_start_min_vel = 50.0f;    // [rad/s electrical] minimum speed to accept
+        // Run the atan2 + PLL correction only one in N updates; the flux
+        // integration stays at full control rate and the phase outputs are
+        // predicted from the velocity in between. The effective PLL
+        // bandwidth limit scales down accordingly.
+        uint8_t pll_decimation = 1;
     };
 
     explicit SensorlessEstimator(Config_t& config);
 
     bool update();
+    void checkpoint();
+    bool try_restore_checkpoint();
+    void seed_flying_start();
 
     Axis* axis_ = nullptr; // set by Axis constructor
     Config_t& config_;
@@ -31,6 +47,14 @@ public:
     float flux_state_[2] = {0.0f, 0.0f};        // [Vs]
     float V_alpha_beta_memory_[2] = {0.0f, 0.0f}; // [V]
     bool estimator_good_ = false;
+    uint8_t pll_cycle_ = 0; // wraps at config_.pll_decimation
+
+    // Estimator checkpoint, taken on a clean exit from sensorless control
+    float checkpoint_flux_state_[2] = {0.0f, 0.0f}; // [Vs]
+    float checkpoint_pll_pos_ = 0.0f;               // [rad]
+    float checkpoint_vel_estimate_ = 0.0f;          // [rad/s]
+    uint32_t checkpoint_tick_ms_ = 0;
+    bool checkpoint_valid_ = false;
 
     // Communication protocol definitions
     auto make_protocol_definitions() {
@@ -44,7 +68,12 @@ public:
             make_protocol_object("config",
                 make_protocol_property("observer_gain", &config_.observer_gain),
                 make_protocol_property("pll_bandwidth", &config_.pll_bandwidth),
-                make_protocol_property("pm_flux_linkage", &config_.pm_flux_linkage)
+                make_protocol_property("pm_flux_linkage", &config_.pm_flux_linkage),
+                make_protocol_property("enable_warm_start", &config_.enable_warm_start),
+                make_protocol_property("warm_start_max_age", &config_.warm_start_max_age),
+                make_protocol_property("flying_start_settle_time", &config_.flying_start_settle_time),
+                make_protocol_property("flying_start_min_vel", &config_.flying_start_min_vel),
+                make_protocol_property("pll_decimation", &config_.pll_decimation)
             )
         );
     }
@@ -0,0 +1,58 @@
+#ifndef __THERMISTOR_LUT_HPP
+#define __THERMISTOR_LUT_HPP
+
+#include <stddef.h>
+
+// Inverter thermistor voltage-to-temperature conversion.
+//
+// The third order polynomial fit of the voltage divider response (see
+// analysis/thermistors.py for the derivation) is evaluated at compile time
+// into a lookup table over the full normalized voltage range [0, 1], and
+// get_inverter_temp() interpolates linearly between the entries. This
+// replaces the per-cycle Horner evaluation with one multiply-add and keeps
+// the Python script as documentation only; changing the thermistor fit means
+// changing the coefficients below, not regenerating code.
+
+// Coefficients of the temperature [°C] polynomial in normalized thermistor
+// voltage, highest order first (same convention as numpy polyfit).
+constexpr float thermistor_poly_coeffs[] =
+    {363.93910201f, -462.15369634f, 307.55129571f, -27.72569531f};
+constexpr size_t thermistor_num_coeffs =
+    sizeof(thermistor_poly_coeffs) / sizeof(thermistor_poly_coeffs[0]);
+
+struct ThermistorLut_t {
+    // 33 entries give a step of 1/32 in normalized voltage; the fit is
+    // gentle enough that linear interpolation error stays well under 1°C.
+    static constexpr size_t size = 33;
+    float temp[size];
+
+    constexpr ThermistorLut_t() : temp() {
+        for (size_t i = 0; i < size; ++i) {
+            float x = (float)i / (float)(size - 1);
+            float t = 0.0f;
+            for (size_t j = 0; j < thermistor_num_coeffs; ++j)
+                t = t * x + thermistor_poly_coeffs[j];
+            temp[i] = t;
+        }
+    }
+};
+
+constexpr ThermistorLut_t thermistor_lut{};
+
+// @brief Converts a normalized thermistor voltage (adc / adc_full_scale) to
+// a temperature [°C] by linear interpolation in the compile time table.
+// Inputs outside [0, 1] clamp to the table ends.
+inline float thermistor_lut_temp(float normalized_voltage) {
+    constexpr float scale = (float)(ThermistorLut_t::size - 1);
+    float pos = normalized_voltage * scale;
+    if (!(pos > 0.0f)) // also catches NaN
+        return thermistor_lut.temp[0];
+    if (pos >= scale)
+        return thermistor_lut.temp[ThermistorLut_t::size - 1];
+    size_t idx = (size_t)pos;
+    float frac = pos - (float)idx;
+    return thermistor_lut.temp[idx]
+         + (thermistor_lut.temp[idx + 1] - thermistor_lut.temp[idx]) * frac;
+}
+
+#endif // __THERMISTOR_LUT_HPP
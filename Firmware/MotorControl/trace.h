@@ -0,0 +1,69 @@
+#ifndef __TRACE_H
+#define __TRACE_H
+
+// Structured trace events over the Cortex-M4 ITM stimulus ports.
+//
+// The DWT profiler (profiler.hpp) accumulates aggregates; ITM gives the
+// timeline. Each event is a single blocking-free write into an ITM
+// stimulus port FIFO, which the core drains over SWO in the background -
+// a few cycles per event, no interrupt, no GPIO, and the ITM inserts its
+// own timestamp packets so the host can reconstruct timing. Decode the
+// SWO byte stream with tools/itm_decode.py.
+//
+// Everything here compiles to nothing unless the build enables it
+// (CONFIG_ITM_TRACE=true, which defines ENABLE_ITM_TRACE), so release
+// timing is untouched.
+//
+// Port allocation (one stimulus port per event class, so the host can
+// filter without decoding payloads):
+//   port 0: control loop; 8-bit write, bit 7 = 0 start / 1 end,
+//           bits 0-6 = axis number
+//   port 1: error transitions; 32-bit write, bits 24-30 = axis,
+//           bits 0-23 = new error bits (truncated)
+//   port 2: comm packet boundaries; 16-bit write, bit 15 = 0 start /
+//           1 end, bits 0-14 = length
+//
+// The SWO pin (PB3) is shared with nothing on this board; the debug
+// probe configures the SWO baud rate and enables the ports via the
+// DBGMCU/TPIU registers, the firmware only writes the stimulus ports.
+
+#ifdef ENABLE_ITM_TRACE
+
+#include <stm32f4xx.h>
+
+// A write is dropped (not stalled) when the port FIFO is full or tracing
+// is disabled by the probe, so these are safe at any rate and in any
+// context.
+static inline void trace_write8(uint8_t port, uint8_t value) {
+    if ((ITM->TCR & ITM_TCR_ITMENA_Msk) && (ITM->TER & (1UL << port)))
+        if (ITM->PORT[port].u32) // FIFO ready
+            ITM->PORT[port].u8 = value;
+}
+static inline void trace_write16(uint8_t port, uint16_t value) {
+    if ((ITM->TCR & ITM_TCR_ITMENA_Msk) && (ITM->TER & (1UL << port)))
+        if (ITM->PORT[port].u32)
+            ITM->PORT[port].u16 = value;
+}
+static inline void trace_write32(uint8_t port, uint32_t value) {
+    if ((ITM->TCR & ITM_TCR_ITMENA_Msk) && (ITM->TER & (1UL << port)))
+        if (ITM->PORT[port].u32)
+            ITM->PORT[port].u32 = value;
+}
+
+#define TRACE_LOOP_START(axis)      trace_write8(0, (uint8_t)(axis))
+#define TRACE_LOOP_END(axis)        trace_write8(0, (uint8_t)(0x80 | (axis)))
+#define TRACE_ERROR(axis, error)    trace_write32(1, ((uint32_t)(axis) << 24) | ((error) & 0xffffff))
+#define TRACE_COMM_PKT_START(len)   trace_write16(2, (uint16_t)((len) & 0x7fff))
+#define TRACE_COMM_PKT_END(len)     trace_write16(2, (uint16_t)(0x8000 | ((len) & 0x7fff)))
+
+#else // !ENABLE_ITM_TRACE
+
+#define TRACE_LOOP_START(axis)      ((void)0)
+#define TRACE_LOOP_END(axis)        ((void)0)
+#define TRACE_ERROR(axis, error)    ((void)0)
+#define TRACE_COMM_PKT_START(len)   ((void)0)
+#define TRACE_COMM_PKT_END(len)     ((void)0)
+
+#endif // ENABLE_ITM_TRACE
+
+#endif // __TRACE_H
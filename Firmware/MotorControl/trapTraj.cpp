@@ -17,8 +17,148 @@ float sign_hard(float val) {
 
 TrapezoidalTrajectory::TrapezoidalTrajectory(Config_t& config) : config_(config) {}
 
-bool TrapezoidalTrajectory::planTrapezoidal(float Xf, float Xi, float Vi,
+// @brief Duration, reached acceleration and displacement of a jerk-limited
+// velocity ramp from v0 to v1 (v1 >= v0 >= 0) under acceleration limit
+// a_lim and jerk jmax. The ramp is symmetric in acceleration, so its
+// average velocity is (v0 + v1)/2.
+static void scurve_ramp(float v0, float v1, float a_lim, float jmax,
+                        float* T, float* a_reached, float* dX) {
+    float dv = v1 - v0;
+    float a = sqrtf(dv * jmax); // peak accel of a pure jerk up/down ramp
+    if (a > a_lim)
+        a = a_lim;
+    *T = (a > 0.0f) ? (dv / a + a / jmax) : 0.0f;
+    *a_reached = a;
+    *dX = 0.5f * (v0 + v1) * *T;
+}
+
+// @brief Displacement consumed by jerk-limited acceleration vi -> v plus
+// jerk-limited braking v -> 0. Monotonic in v, which is what the short-move
+// bisection in planSCurve relies on.
+static float scurve_phase_dist(float vi, float v, float Amax, float Dmax,
+                               float jmax, float* Ta, float* Td) {
+    float a, d, dXa, dXd;
+    scurve_ramp(vi, v, Amax, jmax, Ta, &a, &dXa);
+    scurve_ramp(0.0f, v, Dmax, jmax, Td, &d, &dXd);
+    return dXa + dXd;
+}
+
+// @brief Records one constant-jerk segment starting at the current state
+// and integrates the state to the end of the segment. Zero-duration
+// segments are dropped.
+static void seg_append(TrapezoidalTrajectory::Seg_t* segs, int* n,
+                       float* t, float* y, float* yd, float* ydd,
+                       float j, float dur) {
+    if (!(dur > 0.0f))
+        return;
+    segs[*n] = {*t, *y, *yd, *ydd, j};
+    (*n)++;
+    *y += (*yd + (0.5f * *ydd + (1.0f / 6.0f) * j * dur) * dur) * dur;
+    *yd += (*ydd + 0.5f * j * dur) * dur;
+    *ydd += j * dur;
+    *t += dur;
+}
+
+// Seven-segment bounded-jerk profile: jerk up / constant accel / jerk down,
+// cruise, jerk down / constant decel / jerk up. Acceleration is continuous
+// and piecewise linear, so the profile doesn't excite the resonances that
+// the acceleration steps of the pure trapezoid do. Only the common
+// "accelerate forward, cruise, brake to rest" shape is planned here;
+// reversals, overspeed starts and moves too short to brake on return false
+// and are handled by the trapezoidal planner's double-deceleration logic.
+// The short-move bisection runs once per move (not in the control loop);
+// eval() costs a few compares and one cubic.
+bool TrapezoidalTrajectory::planSCurve(float Xf, float Xi, float Vi, float Ai,
+                                       float Vmax, float Amax, float Dmax, float Jmax) {
+    // A nonzero initial acceleration (mid-move replan) gets a lead-in
+    // segment ramping it to zero at the jerk limit; the seven-segment
+    // profile is then planned from the state at the end of the lead-in,
+    // which keeps acceleration continuous across the retarget.
+    float T0 = 0.0f, j0 = 0.0f;
+    float X0 = Xi, V0 = Vi;
+    if (Ai != 0.0f) {
+        T0 = fabsf(Ai) / Jmax;
+        j0 = (Ai > 0.0f) ? -Jmax : Jmax;
+        X0 = Xi + (Vi + (0.5f * Ai + (1.0f / 6.0f) * j0 * T0) * T0) * T0;
+        V0 = Vi + 0.5f * Ai * T0;
+    }
+
+    float dX = Xf - X0;
+    float s = sign_hard(dX);
+    float vi = s * V0;  // initial velocity along the move direction
+    float D = s * dX;   // distance to travel (positive)
+    if (vi < 0.0f || vi > Vmax)
+        return false;
+
+    // Can we even brake to rest within the displacement?
+    float Ta, Td;
+    if (scurve_phase_dist(vi, vi, Amax, Dmax, Jmax, &Ta, &Td) > D)
+        return false;
+
+    float vr = Vmax;
+    if (scurve_phase_dist(vi, Vmax, Amax, Dmax, Jmax, &Ta, &Td) > D) {
+        // Short move: bisect for the peak velocity that exactly consumes
+        // the displacement (no closed form with four limits in play).
+        float lo = vi, hi = Vmax;
+        for (int i = 0; i < 24; ++i) {
+            float mid = 0.5f * (lo + hi);
+            if (scurve_phase_dist(vi, mid, Amax, Dmax, Jmax, &Ta, &Td) > D)
+                hi = mid;
+            else
+                lo = mid;
+        }
+        vr = lo;
+    }
+
+    float ar, dr, dXa, dXd;
+    scurve_ramp(vi, vr, Amax, Jmax, &Ta, &ar, &dXa);
+    scurve_ramp(0.0f, vr, Dmax, Jmax, &Td, &dr, &dXd);
+    float Tv = (vr > 0.0f) ? std::max((D - dXa - dXd) / vr, 0.0f) : 0.0f;
+
+    float Tja = ar / Jmax; // jerk ramp time of the accel phase
+    float Tjd = dr / Jmax; // jerk ramp time of the decel phase
+    float Tca = std::max(Ta - 2.0f * Tja, 0.0f); // constant accel time
+    float Tcd = std::max(Td - 2.0f * Tjd, 0.0f); // constant decel time
+
+    num_segs_ = 0;
+    float t = 0.0f, y = Xi, yd = Vi, ydd = Ai;
+    seg_append(segs_, &num_segs_, &t, &y, &yd, &ydd,         j0, T0);
+    yd = V0; ydd = 0.0f; // snap away the lead-in integration drift
+    seg_append(segs_, &num_segs_, &t, &y, &yd, &ydd,  s * Jmax, Tja);
+    seg_append(segs_, &num_segs_, &t, &y, &yd, &ydd,       0.0f, Tca);
+    seg_append(segs_, &num_segs_, &t, &y, &yd, &ydd, -s * Jmax, Tja);
+    // Snap away the integration drift at the phase boundaries so it can't
+    // accumulate over a long cruise
+    yd = s * vr; ydd = 0.0f;
+    yAccel_ = y;
+    seg_append(segs_, &num_segs_, &t, &y, &yd, &ydd,       0.0f, Tv);
+    seg_append(segs_, &num_segs_, &t, &y, &yd, &ydd, -s * Jmax, Tjd);
+    seg_append(segs_, &num_segs_, &t, &y, &yd, &ydd,       0.0f, Tcd);
+    seg_append(segs_, &num_segs_, &t, &y, &yd, &ydd,  s * Jmax, Tjd);
+
+    Ar_ = s * ar;
+    Dr_ = -s * dr;
+    Vr_ = s * vr;
+    Ta_ = Ta;
+    Tv_ = Tv;
+    Td_ = Td;
+    Tf_ = t;
+    Xi_ = Xi;
+    Xf_ = Xf;
+    Vi_ = Vi;
+    Ai_ = Ai;
+    eval_seg_ = 0;
+    return true;
+}
+
+bool TrapezoidalTrajectory::planTrapezoidal(float Xf, float Xi, float Vi, float Ai,
                                             float Vmax, float Amax, float Dmax) {
+    if (config_.jerk_limit > 0.0f &&
+        planSCurve(Xf, Xi, Vi, Ai, Vmax, Amax, Dmax, config_.jerk_limit))
+        return true;
+    // The trapezoidal profile has no acceleration state to hand over to;
+    // Ai is only honored by the S-curve plan.
+
     float dX = Xf - Xi;  // Distance to travel
     float stop_dist = (Vi * Vi) / (2.0f * Dmax); // Minimum stopping distance
     float dXstop = std::copysign(stop_dist, Vi); // Minimum stopping displacement
@@ -58,37 +198,75 @@ bool TrapezoidalTrajectory::planTrapezoidal(float Xf, float Xi, float Vi,
     Xi_ = Xi;
     Xf_ = Xf;
     Vi_ = Vi;
+    Ai_ = 0.0f; // the trapezoid can't honor a nonzero initial acceleration
     yAccel_ = Xi + Vi*Ta_ + 0.5f*Ar_*SQ(Ta_); // pos at end of accel phase
 
+    // Emit the phases as zero-jerk segments so eval() shares one code path
+    // with the S-curve plan. The phase-boundary states are snapped to their
+    // analytic values rather than integrated, so the coast and decel phases
+    // match the closed-form profile exactly.
+    num_segs_ = 0;
+    eval_seg_ = 0;
+    float t = 0.0f, y = Xi, yd = Vi, ydd = Ar_;
+    seg_append(segs_, &num_segs_, &t, &y, &yd, &ydd, 0.0f, Ta_);
+    y = yAccel_; yd = Vr_; ydd = 0.0f;
+    seg_append(segs_, &num_segs_, &t, &y, &yd, &ydd, 0.0f, Tv_);
+    ydd = Dr_;
+    seg_append(segs_, &num_segs_, &t, &y, &yd, &ydd, 0.0f, Td_);
+
     return true;
 }
 
+// @brief Copies the plan state (not the config or axis binding) from a
+// scratch trajectory. Used by Controller::move_to_pos to plan off to the
+// side and swap the result in under a critical section, so the control
+// loop never evaluates a half-written plan.
+void TrapezoidalTrajectory::adopt_plan(const TrapezoidalTrajectory& other) {
+    Xi_ = other.Xi_;
+    Xf_ = other.Xf_;
+    Vi_ = other.Vi_;
+    Ar_ = other.Ar_;
+    Vr_ = other.Vr_;
+    Dr_ = other.Dr_;
+    Ta_ = other.Ta_;
+    Tv_ = other.Tv_;
+    Td_ = other.Td_;
+    Tf_ = other.Tf_;
+    yAccel_ = other.yAccel_;
+    Ai_ = other.Ai_;
+    num_segs_ = other.num_segs_;
+    for (int i = 0; i < other.num_segs_; ++i)
+        segs_[i] = other.segs_[i];
+    eval_seg_ = 0;
+}
+
 TrapezoidalTrajectory::Step_t TrapezoidalTrajectory::eval(float t) {
     Step_t trajStep;
     if (t < 0.0f) {  // Initial Condition
         trajStep.Y   = Xi_;
         trajStep.Yd  = Vi_;
-        trajStep.Ydd = 0.0f;
-    } else if (t < Ta_) {  // Accelerating
-        trajStep.Y   = Xi_ + Vi_*t + 0.5f*Ar_*SQ(t);
-        trajStep.Yd  = Vi_ + Ar_*t;
-        trajStep.Ydd = Ar_;
-    } else if (t < Ta_ + Tv_) {  // Coasting
-        trajStep.Y   = yAccel_ + Vr_*(t - Ta_);
-        trajStep.Yd  = Vr_;
-        trajStep.Ydd = 0.0f;
-    } else if (t < Tf_) {  // Deceleration
-        float td     = t - Tf_;
-        trajStep.Y   = Xf_ + 0.5f*Dr_*SQ(td);
-        trajStep.Yd  = Dr_*td;
-        trajStep.Ydd = Dr_;
-    } else if (t >= Tf_) {  // Final Condition
+        trajStep.Ydd = Ai_;
+    } else if (t >= Tf_ || num_segs_ == 0) {  // Final Condition
         trajStep.Y   = Xf_;
         trajStep.Yd  = 0.0f;
         trajStep.Ydd = 0.0f;
     } else {
-        // TODO: report error here
+        // Resume from the cached segment: since t is monotonic at the
+        // control rate, the common case is no compare beyond the phase
+        // boundary check. A backwards time jump (replan) restarts the
+        // search from the first segment.
+        int i = eval_seg_;
+        if (i >= num_segs_ || segs_[i].t > t)
+            i = 0;
+        while (i + 1 < num_segs_ && segs_[i + 1].t <= t)
+            ++i;
+        eval_seg_ = i;
+        // Constant-jerk cubic from the segment start state
+        const Seg_t& seg = segs_[i];
+        float td = t - seg.t;
+        trajStep.Y   = seg.Y + (seg.Yd + (0.5f * seg.Ydd + (1.0f / 6.0f) * seg.j * td) * td) * td;
+        trajStep.Yd  = seg.Yd + (seg.Ydd + 0.5f * seg.j * td) * td;
+        trajStep.Ydd = seg.Ydd + seg.j * td;
     }
-
     return trajStep;
 }
\ No newline at end of file
@@ -8,8 +8,9 @@ public:
         float accel_limit = 5000.0f; // [count/s^2]
         float decel_limit = 5000.0f; // [count/s^2]
         float A_per_css = 0.0f;      // [A/(count/s^2)]
+        float jerk_limit = 0.0f;     // [count/s^3], 0 = unlimited (pure trapezoid)
     };
-    
+
     struct Step_t {
         float Y;
         float Yd;
@@ -17,9 +18,10 @@ public:
     };
 
     explicit TrapezoidalTrajectory(Config_t& config);
-    bool planTrapezoidal(float Xf, float Xi, float Vi,
+    bool planTrapezoidal(float Xf, float Xi, float Vi, float Ai,
                          float Vmax, float Amax, float Dmax);
     Step_t eval(float t);
+    void adopt_plan(const TrapezoidalTrajectory& other);
 
     auto make_protocol_definitions() {
         return make_protocol_member_list(
@@ -27,7 +29,8 @@ public:
                 make_protocol_property("vel_limit", &config_.vel_limit),
                 make_protocol_property("accel_limit", &config_.accel_limit),
                 make_protocol_property("decel_limit", &config_.decel_limit),
-                make_protocol_property("A_per_css", &config_.A_per_css)
+                make_protocol_property("A_per_css", &config_.A_per_css),
+                make_protocol_property("jerk_limit", &config_.jerk_limit)
             )
         );
     }
@@ -49,6 +52,30 @@ public:
     float Tf_;
 
     float yAccel_;
+
+    // Piecewise plan shared by both profiles. Each entry holds the state at
+    // the start of one constant-jerk segment; eval() integrates the cubic
+    // from there. The trapezoidal planner emits up to three zero-jerk
+    // segments (accel/coast/decel); the jerk-limited S-curve (used when
+    // config_.jerk_limit > 0 and the initial conditions allow it, see
+    // planSCurve) emits up to eight: seven profile segments plus an
+    // optional lead-in that ramps a nonzero initial acceleration away.
+    struct Seg_t {
+        float t;   // segment start time
+        float Y;
+        float Yd;
+        float Ydd;
+        float j;   // jerk over this segment
+    };
+    Seg_t segs_[8];
+    int num_segs_ = 0;
+    float Ai_ = 0.0f;  // initial acceleration, reported for t < 0
+    int eval_seg_ = 0; // cached segment index; eval() only searches on a
+                       // phase transition or when t jumps backwards (replan)
+
+private:
+    bool planSCurve(float Xf, float Xi, float Vi, float Ai,
+                    float Vmax, float Amax, float Dmax, float Jmax);
 };
 
 #endif
\ No newline at end of file
@@ -3,10 +3,82 @@
 #include <math.h>
 #include <float.h>
 #include <cmsis_os.h>
-#include <stm32f4xx_hal.h>
+#include <stm32f4xx_hal.h>  // Sets up the correct chip specifc defines required by arm_math
+#define ARM_MATH_CM4 // TODO: might change in future board versions
+#include "arm_math.h"
+#include "arm_common_tables.h"
 
 
-int SVM(float alpha, float beta, float* tA, float* tB, float* tC) {
+// @brief Space vector modulation, min/max (midpoint clamp) formulation.
+//
+// The three inverse-Clarke phase voltages are shifted by the common-mode
+// injection -(vmax + vmin)/2 and scaled into rising-edge timings. In every
+// sextant this is algebraically identical to the classic sector
+// decomposition (kept below as SVM_sector), but the branch cascade and
+// sector switch collapse into two min/max selects, which the M4 compiles
+// to short IT blocks instead of data-dependent branches. Equivalence
+// (float rounding only, ~2e-7) and the cycle counts are reported by the
+// benchmark build.
+RAMFUNC int SVM(float alpha, float beta, float* tA, float* tB, float* tC) {
+    float va = alpha;
+    float vb = -0.5f * alpha + sqrt3_by_2 * beta;
+    float vc = -0.5f * alpha - sqrt3_by_2 * beta;
+
+    float vmax = MACRO_MAX(MACRO_MAX(va, vb), vc);
+    float vmin = MACRO_MIN(MACRO_MIN(va, vb), vc);
+    float common = (1.0f / 3.0f) * (vmax + vmin);
+
+    *tA = 0.5f - (2.0f / 3.0f) * va + common;
+    *tB = 0.5f - (2.0f / 3.0f) * vb + common;
+    *tC = 0.5f - (2.0f / 3.0f) * vc + common;
+
+    // if any of the results becomes NaN, result_valid will evaluate to false
+    int result_valid =
+            *tA >= 0.0f && *tA <= 1.0f
+         && *tB >= 0.0f && *tB <= 1.0f
+         && *tC >= 0.0f && *tC <= 1.0f;
+    return result_valid ? 0 : -1;
+}
+
+// @brief SVM with the timer period folded into the constants: the three
+// compare values come out directly in timer clocks, so the conversion
+// stage is just one float->int per phase instead of a normalize,
+// rescale and convert. The range check stays in the float domain
+// because a float->int conversion of NaN silently yields 0.
+// Returns 0 on success, -1 if the vector was out of range.
+RAMFUNC int SVM_timings(float alpha, float beta, uint16_t period_clocks,
+                uint16_t* tA, uint16_t* tB, uint16_t* tC) {
+    float period = (float)period_clocks;
+    float va = alpha;
+    float vb = -0.5f * alpha + sqrt3_by_2 * beta;
+    float vc = -0.5f * alpha - sqrt3_by_2 * beta;
+
+    float vmax = MACRO_MAX(MACRO_MAX(va, vb), vc);
+    float vmin = MACRO_MIN(MACRO_MIN(va, vb), vc);
+    float common = 0.5f * period + (period * (1.0f / 3.0f)) * (vmax + vmin);
+    float scale = period * (2.0f / 3.0f);
+
+    float fA = common - scale * va;
+    float fB = common - scale * vb;
+    float fC = common - scale * vc;
+
+    // if any of the results becomes NaN, result_valid will evaluate to false
+    int result_valid =
+            fA >= 0.0f && fA <= period
+         && fB >= 0.0f && fB <= period
+         && fC >= 0.0f && fC <= period;
+    if (!result_valid)
+        return -1;
+
+    *tA = (uint16_t)fA;
+    *tB = (uint16_t)fB;
+    *tC = (uint16_t)fC;
+    return 0;
+}
+
+// @brief Sector-decomposition SVM, kept as the reference implementation
+// for the equivalence check and cycle comparison in the benchmark build.
+int SVM_sector(float alpha, float beta, float* tA, float* tB, float* tC) {
     int Sextant;
 
     if (beta >= 0.0f) {
@@ -122,6 +194,103 @@ int SVM(float alpha, float beta, float* tA, float* tB, float* tC) {
     return result_valid ? 0 : -1;
 }
 
+// @brief Computes sine and cosine of one angle with a single argument
+// reduction and table walk.
+//
+// This is the fused equivalent of calling our_arm_sin_f32 and
+// our_arm_cos_f32 back to back: the cosine is read from the same sine
+// table a quarter period ahead, reusing the index and interpolation
+// fraction that were already computed for the sine. This matters in
+// the FOC hot path where we need both outputs per transform.
+// @param x input value in radians.
+// @param s sin(x) output.
+// @param c cos(x) output.
+RAMFUNC void fast_sincos(float x, float* s, float* c) {
+    /* Scale the input to [0 1) range from [0 2*PI), divide input by 2*pi */
+    float in = x * 0.159154943092f;
+
+    /* Calculation of floor value of input */
+    int32_t n = (int32_t)in;
+
+    /* Make negative values towards -infinity */
+    if (in < 0.0f)
+        n--;
+
+    /* Map input value to [0 1) */
+    in = in - (float)n;
+
+    /* Calculation of index of the table */
+    float findex = (float)FAST_MATH_TABLE_SIZE * in;
+    uint16_t index = (uint16_t)findex;
+
+    /* when "in" is exactly 1, we need to rotate the index down to 0 */
+    if (index >= FAST_MATH_TABLE_SIZE) {
+        index = 0;
+        findex -= (float)FAST_MATH_TABLE_SIZE;
+    }
+
+    /* fractional value calculation (shared by both interpolations) */
+    float fract = findex - (float)index;
+
+    /* Linear interpolation of the sine */
+    float a = sinTable_f32[index];
+    float b = sinTable_f32[index + 1];
+    *s = (1.0f - fract) * a + fract * b;
+
+    /* The cosine is the sine read a quarter period ahead. The table is
+     * a power-of-two size so the wrap-around is a simple mask. */
+    uint16_t cindex = (index + (FAST_MATH_TABLE_SIZE / 4)) & (FAST_MATH_TABLE_SIZE - 1);
+    a = sinTable_f32[cindex];
+    b = sinTable_f32[cindex + 1];
+    *c = (1.0f - fract) * a + fract * b;
+}
+
+// @brief Computes sine and cosine of two angles at once.
+//
+// Interleaving the two independent reductions and table reads gives the
+// compiler room to pipeline the loads; in Motor::FOC_current we need
+// both the Park angle (I_phase) and the inverse-Park angle (pwm_phase)
+// in the same 8kHz cycle.
+RAMFUNC void fast_sincos2(float x0, float x1, float* s0, float* c0, float* s1, float* c1) {
+    float in0 = x0 * 0.159154943092f;
+    float in1 = x1 * 0.159154943092f;
+
+    int32_t n0 = (int32_t)in0;
+    int32_t n1 = (int32_t)in1;
+    if (in0 < 0.0f)
+        n0--;
+    if (in1 < 0.0f)
+        n1--;
+
+    in0 = in0 - (float)n0;
+    in1 = in1 - (float)n1;
+
+    float findex0 = (float)FAST_MATH_TABLE_SIZE * in0;
+    float findex1 = (float)FAST_MATH_TABLE_SIZE * in1;
+    uint16_t index0 = (uint16_t)findex0;
+    uint16_t index1 = (uint16_t)findex1;
+
+    if (index0 >= FAST_MATH_TABLE_SIZE) {
+        index0 = 0;
+        findex0 -= (float)FAST_MATH_TABLE_SIZE;
+    }
+    if (index1 >= FAST_MATH_TABLE_SIZE) {
+        index1 = 0;
+        findex1 -= (float)FAST_MATH_TABLE_SIZE;
+    }
+
+    float fract0 = findex0 - (float)index0;
+    float fract1 = findex1 - (float)index1;
+
+    uint16_t cindex0 = (index0 + (FAST_MATH_TABLE_SIZE / 4)) & (FAST_MATH_TABLE_SIZE - 1);
+    uint16_t cindex1 = (index1 + (FAST_MATH_TABLE_SIZE / 4)) & (FAST_MATH_TABLE_SIZE - 1);
+
+    *s0 = (1.0f - fract0) * sinTable_f32[index0] + fract0 * sinTable_f32[index0 + 1];
+    *c0 = (1.0f - fract0) * sinTable_f32[cindex0] + fract0 * sinTable_f32[cindex0 + 1];
+    *s1 = (1.0f - fract1) * sinTable_f32[index1] + fract1 * sinTable_f32[index1 + 1];
+    *c1 = (1.0f - fract1) * sinTable_f32[cindex1] + fract1 * sinTable_f32[cindex1 + 1];
+}
+
 // based on https://math.stackexchange.com/a/1105038/81278
 float fast_atan2(float y, float x) {
     // a := min (|x|, |y|) / max (|x|, |y|)
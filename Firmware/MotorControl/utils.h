@@ -65,6 +65,14 @@ extern "C" {
 
 #define SQ(x) ((x) * (x))
 
+// Places a function in the .ram_func input section. The linker script
+// folds that section into .data, so the startup data-copy loop moves the
+// code to SRAM and it executes without flash wait states (5 on this part)
+// or ART prefetch misses. Use it on ISR-path code where a flash stall
+// would add jitter to the control deadline; don't use it on cold code,
+// it costs RAM byte for byte.
+#define RAMFUNC __attribute__((section(".ram_func")))
+
 static const float one_by_sqrt3 = 0.57735026919f;
 static const float two_by_sqrt3 = 1.15470053838f;
 static const float sqrt3_by_2 = 0.86602540378f;
@@ -94,7 +102,16 @@ static inline float fmodf_pos(float x, float y) {
 // The magnitude of the alpha-beta vector may not be larger than sqrt(3)/2
 // Returns 0 on success, and -1 if the input was out of range
 int SVM(float alpha, float beta, float* tA, float* tB, float* tC);
-
+// SVM with the timer period folded in: writes the three compare values
+// directly in timer clocks, [0, period_clocks]
+int SVM_timings(float alpha, float beta, uint16_t period_clocks,
+                uint16_t* tA, uint16_t* tB, uint16_t* tC);
+// Sector-decomposition reference implementation (same contract as SVM);
+// only used by the benchmark build for equivalence and cycle comparison
+int SVM_sector(float alpha, float beta, float* tA, float* tB, float* tC);
+
+void fast_sincos(float x, float* s, float* c);
+void fast_sincos2(float x0, float x1, float* s0, float* c0, float* s1, float* c1);
 float fast_atan2(float y, float x);
 float horner_fma(float x, const float *coeffs, size_t count);
 int mod(int dividend, int divisor);
@@ -0,0 +1,51 @@
+
+#include "odrive_main.h"
+
+WatchRegion watch_;
+
+// STM32F405 RAM address map: main SRAM (SRAM1 + SRAM2) and the core
+// coupled memory the control objects live in. Only regions entirely
+// inside one of these are accepted; peripheral and flash space stays
+// unreachable through this endpoint.
+#define SRAM_BASE_ADDR 0x20000000u
+#define SRAM_SIZE      (128u * 1024u)
+#define CCMRAM_BASE    0x10000000u
+#define CCMRAM_SIZE    (64u * 1024u)
+
+static bool region_in(uint32_t address, uint32_t size, uint32_t base, uint32_t length) {
+    return address >= base && size <= length && address - base <= length - size;
+}
+
+bool WatchRegion::set_region(uint32_t address, uint32_t size) {
+    address_ = 0; // stop the sampler while we reconfigure
+    size_ = 0;
+    if ((address % sizeof(uint32_t)) || (size % sizeof(uint32_t)) || size == 0)
+        return false;
+    if (size > MAX_SIZE_WORDS * sizeof(uint32_t))
+        return false;
+    if (!region_in(address, size, SRAM_BASE_ADDR, SRAM_SIZE)
+        && !region_in(address, size, CCMRAM_BASE, CCMRAM_SIZE))
+        return false;
+    size_ = size;
+    address_ = address;
+    return true;
+}
+
+void WatchRegion::capture() {
+    if (address_)
+        capture_pending_ = true;
+}
+
+void WatchRegion::sample() {
+    if (!capture_pending_)
+        return;
+    capture_pending_ = false;
+    // Word copy in the sampling interrupt: the worker thread's control
+    // math for this cycle has not run yet and the previous cycle's has
+    // finished, so every watched field belongs to the same cycle.
+    const uint32_t* src = reinterpret_cast<const uint32_t*>(address_);
+    uint32_t n_words = size_ / sizeof(uint32_t);
+    for (uint32_t i = 0; i < n_words; ++i)
+        snapshot_[i] = src[i];
+    ++snapshot_seq_;
+}
@@ -0,0 +1,65 @@
+#ifndef __WATCH_HPP
+#define __WATCH_HPP
+
+#ifndef __ODRIVE_MAIN_H
+#error "This file should not be included directly. Include odrive_main.h instead."
+#endif
+
+// @brief Coherent snapshot readout of an arbitrary RAM region.
+//
+// Debugging estimator state means reading a dozen related fields
+// (flux_state_, pll_pos_, V_alpha_beta_memory_, ...) that are all updated
+// by the same control cycle; fetching them through individual endpoint
+// reads yields values from different cycles. This registers one memory
+// region (validated against the RAM address map, nothing else is
+// reachable) and copies it into a private buffer in the current
+// measurement interrupt, i.e. between control cycles, so the host reads
+// one atomic snapshot instead of N torn reads - a software logic analyzer
+// over struct state.
+//
+// Usage: set_region(address, size), capture(), poll snapshot_seq until it
+// increments, then read the "data" array. The host typically obtains the
+// address from the ELF file of the running build.
+class WatchRegion {
+public:
+    static constexpr size_t MAX_SIZE_WORDS = 64; // 256 bytes per snapshot
+
+    // @brief Registers the region to snapshot. Address and size must be
+    // word-aligned and the region must lie entirely within SRAM or CCM
+    // RAM; anything else (peripherals, flash, out of range) is rejected
+    // and disables the watch. Returns true if the region was accepted.
+    bool set_region(uint32_t address, uint32_t size);
+
+    // @brief Requests one snapshot; the copy happens in the next current
+    // measurement interrupt and increments snapshot_seq when done.
+    void capture();
+
+    // Called once per current measurement cycle in interrupt context.
+    void sample();
+
+    uint32_t snapshot_seq_ = 0; // increments when a capture completes
+
+    // Communication protocol definitions
+    auto make_protocol_definitions() {
+        return make_protocol_member_list(
+            make_protocol_ro_property("address", &address_),
+            make_protocol_ro_property("size", &size_),
+            make_protocol_ro_property("max_size", &max_size_),
+            make_protocol_ro_property("snapshot_seq", &snapshot_seq_),
+            make_protocol_function("set_region", *this, &WatchRegion::set_region, "address", "size"),
+            make_protocol_function("capture", *this, &WatchRegion::capture),
+            make_protocol_ro_array_property("data", snapshot_, MAX_SIZE_WORDS)
+        );
+    }
+
+private:
+    uint32_t address_ = 0; // 0 = no region registered
+    uint32_t size_ = 0;    // [bytes]
+    const uint32_t max_size_ = MAX_SIZE_WORDS * sizeof(uint32_t); // [bytes]
+    volatile bool capture_pending_ = false;
+    uint32_t snapshot_[MAX_SIZE_WORDS];
+};
+
+extern WatchRegion watch_;
+
+#endif // __WATCH_HPP
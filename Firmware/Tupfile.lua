@@ -72,6 +72,33 @@ else
     error("unknown UART protocol "..tup.getconfig("UART_PROTOCOL"))
 end
 
+-- PWM / current-loop frequency settings
+-- The PWM carrier stays at 24kHz in all variants; the repetition counter
+-- selects how many PWM periods make up one control cycle:
+--   control rate = TIM_1_8_CLOCK_HZ / (2 * TIM_1_8_PERIOD_CLOCKS * (TIM_1_8_RCR + 1))
+-- All derived constants (CURRENT_MEAS_PERIOD, calibration cycle counts,
+-- PLL gain limits) follow from these defines at compile time.
+if tup.getconfig("CONTROL_FREQ") == "24k" then
+    FLAGS += "-DTIM_1_8_RCR_OVERRIDE=0"
+elseif tup.getconfig("CONTROL_FREQ") == "4k" then
+    FLAGS += "-DTIM_1_8_RCR_OVERRIDE=5"
+elseif tup.getconfig("CONTROL_FREQ") == "8k" or tup.getconfig("CONTROL_FREQ") == "" then
+    -- default: TIM_1_8_RCR=2 as defined in main.h
+else
+    error("unknown control frequency "..tup.getconfig("CONTROL_FREQ"))
+end
+
+-- Axis count settings
+-- Single-axis builds drop the M1 timer/ADC scheduling from the control
+-- ISRs and free the RAM of the unused axis objects.
+if tup.getconfig("AXIS_COUNT") == "1" then
+    FLAGS += "-DAXIS_COUNT=1"
+elseif tup.getconfig("AXIS_COUNT") == "2" or tup.getconfig("AXIS_COUNT") == "" then
+    -- default: both axes as defined in odrive_main.h
+else
+    error("unknown axis count "..tup.getconfig("AXIS_COUNT"))
+end
+
 -- GPIO settings
 if tup.getconfig("STEP_DIR") == "y" then
     if tup.getconfig("UART_PROTOCOL") == "none" then
@@ -86,6 +113,27 @@ if tup.getconfig("STRICT") == "true" then
     FLAGS += '-Werror'
 end
 
+-- On-target microbenchmark suite (runs at boot, reports on UART)
+if tup.getconfig("BENCHMARK") == "true" then
+    FLAGS += '-DRUN_BENCHMARKS'
+end
+
+-- Structured trace events over ITM/SWO (see MotorControl/trace.h);
+-- decode with tools/itm_decode.py. Off by default: the macros compile to
+-- nothing without this flag.
+if tup.getconfig("ITM_TRACE") == "true" then
+    FLAGS += '-DENABLE_ITM_TRACE'
+end
+
+-- Static allocation build mode: long-lived threads, semaphores and large
+-- runtime buffers come from link-time storage instead of the FreeRTOS
+-- heap, newlib's sbrk traps, and the heap shrinks to the worst case of
+-- the remaining transient threads. Every byte of RAM then shows up as a
+-- named symbol in the .map file. See freertos_vars.h for the rules.
+if tup.getconfig("STATIC_ALLOCATION") == "true" then
+    FLAGS += '-DSTATIC_ALLOCATION_ONLY'
+end
+
 
 -- C-specific flags
 FLAGS += '-D__weak="__attribute__((weak))"'
@@ -114,7 +162,21 @@ else
     OPT += '-O2'
 end
 
+-- Tuned release build: -O3 plus whole-program (link time) optimization.
+-- The control hot path spans translation units (ADC dispatch in
+-- stm32f4xx_it.c -> low_level.cpp -> Motor::FOC_current -> SVM in
+-- utils.c), so LTO is what finally lets those calls inline; explicit
+-- inline attributes are deliberately not sprayed over the hot functions.
+-- Verify a change of this option with the benchmark build
+-- (CONFIG_BENCHMARK) and the foc_current profiler stage.
+if tup.getconfig("TUNED") == "true" and tup.getconfig("DEBUG") ~= "true" then
+    OPT += '-O3 -flto'
+end
+
 -- common flags for ASM, C and C++
+-- -ffast-math is safe for the control kernels except for its
+-- finite-math assumption: the SVM range check and the config validators
+-- rely on NaN comparisons, hence -fno-finite-math-only.
 OPT += '-ffast-math -fno-finite-math-only'
 tup.append_table(FLAGS, OPT)
 tup.append_table(LDFLAGS, OPT)
@@ -158,9 +220,14 @@ build{
     sources={
         'Drivers/DRV8301/drv8301.c',
         'MotorControl/utils.c',
+        'MotorControl/mini_fmt.c',
         'MotorControl/arm_sin_f32.c',
         'MotorControl/arm_cos_f32.c',
         'MotorControl/low_level.cpp',
+        'MotorControl/profiler.cpp',
+        'MotorControl/oscilloscope.cpp',
+        'MotorControl/blackbox.cpp',
+        'MotorControl/watch.cpp',
         'MotorControl/nvm.c',
         'MotorControl/axis.cpp',
         'MotorControl/motor.cpp',
@@ -168,6 +235,9 @@ build{
         'MotorControl/controller.cpp',
         'MotorControl/sensorless_estimator.cpp',
         'MotorControl/trapTraj.cpp',
+        'MotorControl/benchmarks.cpp',
+        'MotorControl/clock_sync.cpp',
+        'MotorControl/fw_update.cpp',
         'MotorControl/main.cpp',
         'communication/communication.cpp',
         'communication/ascii_protocol.cpp',
@@ -175,6 +245,7 @@ build{
         'communication/interface_usb.cpp',
         'communication/interface_can.cpp',
         'communication/interface_i2c.cpp',
+        'communication/telemetry.cpp',
         'fibre/cpp/protocol.cpp',
         'FreeRTOS-openocd.c'
     },
@@ -99,6 +99,14 @@ function GCCToolchain(prefix, builddir, compiler_flags, linker_flags)
             }
             -- display the size
             tup.frule{inputs={output_name..'.elf'}, command=prefix..'size %f'}
+            -- per-subsystem flash/RAM breakdown from the map file, kept as
+            -- a build artifact next to the .elf; exceeding a budget in
+            -- size_budget.conf fails the build (see ../tools/size_report.py)
+            tup.frule{
+                inputs={output_name..'.map'},
+                command='python ../tools/size_report.py %f --budget size_budget.conf --output %o',
+                outputs={output_name..'.size'}
+            }
             -- generate disassembly
             tup.frule{inputs={output_name..'.elf'}, command=prefix..'objdump %f -dSC > %o', outputs={output_name..'.asm'}}
             -- create *.hex and *.bin output formats
@@ -14,6 +14,8 @@
 #include <utils.h>
 #include <fibre/cpp_utils.hpp>
 
+#include <algorithm>
+
 /* Private macros ------------------------------------------------------------*/
 /* Private typedef -----------------------------------------------------------*/
 /* Global constant data ------------------------------------------------------*/
@@ -21,35 +23,728 @@
 /* Private constant data -----------------------------------------------------*/
 
 #define MAX_LINE_LENGTH 256
-#define TO_STR_INNER(s) #s
-#define TO_STR(s) TO_STR_INNER(s)
 
 /* Private variables ---------------------------------------------------------*/
 /* Private function prototypes -----------------------------------------------*/
 /* Function implementations --------------------------------------------------*/
 
+// @brief Fixed-precision float-to-decimal writer, replacing newlib's %f
+// on the feedback hot path (%f costs tens of microseconds per value).
+// Output matches "%f": sign, integer digits, 6 rounded fractional
+// digits, nan/inf spelled out. Magnitudes beyond uint32 range take the
+// snprintf slow path; feedback values never do. Needs at least 20 bytes
+// of buffer space on the fast path. Returns the number of bytes written.
+static size_t format_float(char* buffer, size_t size, float value) {
+    if (!(fabsf(value) < 4294967040.0f) || size < 20) { // catches nan/inf too
+        size_t len = snprintf(buffer, size, "%f", (double)value);
+        return len < size ? len : size - 1;
+    }
+    size_t pos = 0;
+    if (signbit(value)) {
+        buffer[pos++] = '-';
+        value = -value;
+    }
+    uint32_t int_part = (uint32_t)value;
+    // The double round-trip is exact for any float, and nearbyint's
+    // round-half-even matches what newlib's %f would print.
+    uint32_t frac = (uint32_t)nearbyint(((double)value - int_part) * 1000000.0);
+    if (frac >= 1000000) { // fraction rounded up to 1.0
+        frac -= 1000000;
+        ++int_part;
+    }
+    char digits[10];
+    size_t n = 0;
+    do {
+        digits[n++] = '0' + int_part % 10;
+        int_part /= 10;
+    } while (int_part);
+    while (n)
+        buffer[pos++] = digits[--n];
+    buffer[pos++] = '.';
+    for (uint32_t divider = 100000; divider; divider /= 10)
+        buffer[pos++] = '0' + (frac / divider) % 10;
+    buffer[pos] = 0;
+    return pos;
+}
+
+// @brief Appends the optional "*checksum" and the CRLF in place and
+// returns the final line length, so the caller can hand the complete
+// line to the sink with a single process_bytes call.
+static size_t finish_line(char* buffer, size_t len, size_t size, bool include_checksum) {
+    if (include_checksum) {
+        uint8_t checksum = 0;
+        for (size_t i = 0; i < len; ++i)
+            checksum ^= buffer[i];
+        if (len + 4 <= size) { // '*' + up to 3 digits
+            buffer[len++] = '*';
+            char digits[3];
+            size_t n = 0;
+            do {
+                digits[n++] = '0' + checksum % 10;
+                checksum /= 10;
+            } while (checksum);
+            while (n)
+                buffer[len++] = digits[--n];
+        }
+    }
+    if (len + 2 <= size) {
+        buffer[len++] = '\r';
+        buffer[len++] = '\n';
+    }
+    return len;
+}
+
 // @brief Sends a line on the specified output.
 template<typename ... TArgs>
 void respond(StreamSink& output, bool include_checksum, const char * fmt, TArgs&& ... args) {
-    char response[64];
-    size_t len = snprintf(response, sizeof(response), fmt, std::forward<TArgs>(args)...);
+    char response[72]; // payload (64) + checksum + CRLF
+    size_t len = snprintf(response, 64, fmt, std::forward<TArgs>(args)...);
+    if (len > 63)
+        len = 63; // snprintf returns the untruncated length
+    len = finish_line(response, len, sizeof(response), include_checksum);
     output.process_bytes((uint8_t*)response, len, nullptr); // TODO: use process_all instead
-    if (include_checksum) {
-        uint8_t checksum = 0;
-        for (size_t i = 0; i < len; ++i)
-            checksum ^= response[i];
-        len = snprintf(response, sizeof(response), "*%u", checksum);
-        output.process_bytes((uint8_t*)response, len, nullptr);
+}
+
+// @brief Gathers a multi-line response and flushes it to the sink in large
+// chunks. respond() costs one sink call (and potentially one UART semaphore
+// acquisition) per line, which is fine for single-line replies but makes
+// the multi-line responders (help, device info) take dozens. Lines are
+// finished (checksum + CRLF) back to back into the gather buffer; flush()
+// then pushes chunks bounded by the sink's reported free space, so we
+// neither call the sink per line nor block it mid-line with more bytes
+// than it can take. StreamSink has no vectored write, so the segments are
+// gathered contiguously at append time - the flush granularity is what
+// buys the throughput.
+class ResponseBatcher {
+public:
+    ResponseBatcher(StreamSink& output, bool include_checksum)
+        : output_(output), include_checksum_(include_checksum) {}
+    ~ResponseBatcher() { flush(); }
+
+    // Appends one line, flushing first if a worst-case line might not fit
+    template<typename ... TArgs>
+    void line(const char* fmt, TArgs&& ... args) {
+        if (pos_ + MAX_RESPONSE_LINE > sizeof(buffer_))
+            flush();
+        size_t len = snprintf(buffer_ + pos_, 64, fmt, std::forward<TArgs>(args)...);
+        if (len > 63)
+            len = 63; // snprintf returns the untruncated length
+        pos_ += finish_line(buffer_ + pos_, len, sizeof(buffer_) - pos_, include_checksum_);
+    }
+
+    void flush() {
+        size_t sent = 0;
+        uint32_t stall_ticks = 0;
+        while (sent < pos_) {
+            size_t free_space = output_.get_free_space();
+            if (free_space == 0) {
+                // sink full - let the TX path drain, but don't hang the
+                // comm thread forever on a dead host
+                if (++stall_ticks > 100)
+                    break;
+                osDelay(1);
+                continue;
+            }
+            stall_ticks = 0;
+            size_t chunk = std::min(pos_ - sent, free_space);
+            if (output_.process_bytes((uint8_t*)buffer_ + sent, chunk, nullptr) != 0)
+                break; // sink failed - drop the rest
+            sent += chunk;
+        }
+        pos_ = 0;
+    }
+
+private:
+    static constexpr size_t MAX_RESPONSE_LINE = 72; // payload (64) + checksum + CRLF
+    StreamSink& output_;
+    bool include_checksum_;
+    size_t pos_ = 0;
+    char buffer_[288]; // several lines gathered per sink call
+};
+
+/* Hand-rolled tokenizer ------------------------------------------------------
+* These replace sscanf on the command hot path: newlib's sscanf with %f costs
+* tens of microseconds and considerable stack per call, which matters at kHz
+* command rates. Each parser skips leading spaces, consumes its token and
+* advances the cursor, returning false (cursor untouched) on malformed input.
+*/
+
+static inline bool is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+static void skip_spaces(const char** cursor) {
+    while (**cursor == ' ')
+        ++(*cursor);
+}
+
+// @brief Parses an unsigned decimal integer.
+static bool parse_uint(const char** cursor, unsigned* value) {
+    const char* p = *cursor;
+    while (*p == ' ')
+        ++p;
+    if (!is_digit(*p))
+        return false;
+    unsigned result = 0;
+    while (is_digit(*p))
+        result = result * 10 + (unsigned)(*(p++) - '0');
+    *value = result;
+    *cursor = p;
+    return true;
+}
+
+// @brief Parses a decimal float of the form [+-]ddd[.ddd][eE[+-]dd].
+// Accumulating decimal digits in binary floats loses at most ~1 ulp per
+// digit, which is well below the noise floor of any setpoint we handle.
+static bool parse_float(const char** cursor, float* value) {
+    const char* p = *cursor;
+    while (*p == ' ')
+        ++p;
+    bool negative = (*p == '-');
+    if (*p == '-' || *p == '+')
+        ++p;
+    bool any_digits = false;
+    float result = 0.0f;
+    while (is_digit(*p)) {
+        result = result * 10.0f + (float)(*(p++) - '0');
+        any_digits = true;
+    }
+    if (*p == '.') {
+        ++p;
+        float scale = 0.1f;
+        while (is_digit(*p)) {
+            result += (float)(*(p++) - '0') * scale;
+            scale *= 0.1f;
+            any_digits = true;
+        }
+    }
+    if (!any_digits)
+        return false;
+    if (*p == 'e' || *p == 'E') {
+        const char* q = p + 1;
+        bool exp_negative = (*q == '-');
+        if (*q == '-' || *q == '+')
+            ++q;
+        if (is_digit(*q)) {
+            unsigned exponent = 0;
+            while (is_digit(*q))
+                exponent = exponent * 10 + (unsigned)(*(q++) - '0');
+            float exp_scale = exp_negative ? 0.1f : 10.0f;
+            while (exponent--)
+                result *= exp_scale;
+            p = q;
+        }
+    }
+    *value = negative ? -result : result;
+    *cursor = p;
+    return true;
+}
+
+// @brief Copies the next space-delimited token into buffer (always
+// null-terminated). Returns false if there is no token.
+static bool parse_token(const char** cursor, char* buffer, size_t buffer_length) {
+    const char* p = *cursor;
+    while (*p == ' ')
+        ++p;
+    size_t len = 0;
+    while (*p && *p != ' ' && len < buffer_length - 1)
+        buffer[len++] = *(p++);
+    buffer[len] = 0;
+    *cursor = p;
+    return len > 0;
+}
+
+// @brief Parses and validates the axis number argument shared by all
+// setpoint commands. Returns nullptr (with the error already reported)
+// on failure.
+static Axis* parse_axis(const char** cursor, StreamSink& response_channel, bool use_checksum) {
+    unsigned motor_number;
+    if (!parse_uint(cursor, &motor_number)) {
+        respond(response_channel, use_checksum, "invalid command format");
+        return nullptr;
+    }
+    if (motor_number >= AXIS_COUNT) {
+        respond(response_channel, use_checksum, "invalid motor %u", motor_number);
+        return nullptr;
+    }
+    return axes[motor_number];
+}
+
+/* Streaming moves -------------------------------------------------------------
+* G-code style segment streaming for hosts that chop a path into short line
+* moves (engraving, contouring). Segments are queued per axis with a
+* feedrate; the junction velocity between consecutive segments is the
+* smaller of the two feedrates, or zero on direction reversal. A segment is
+* only emitted once its successor is queued (so its junction velocity is
+* final) or on flush, as a trapezoid of at most three knots into the
+* controller's streamed-trajectory buffer. Every queue command is answered
+* with "ok N" (N free queue slots) or "busy", which is the host's flow
+* control; the stream must be terminated with a flush or the last segment
+* stays queued.
+*/
+
+class MovePlanner {
+public:
+    static constexpr size_t QUEUE_DEPTH = 8;
+    static constexpr float MIN_FEEDRATE = 1.0f; // [counts/s]
+
+    // @brief Queues one segment. Returns false if the queue stays full
+    // even after trying to emit pending segments.
+    bool push(Axis* axis, float pos, float feedrate) {
+        if (count_ >= QUEUE_DEPTH) {
+            pump(axis); // knot space may have opened up since the last command
+            if (count_ >= QUEUE_DEPTH)
+                return false;
+        }
+        if (axis->controller_.config_.control_mode != Controller::CTRL_MODE_TRAJECTORY_STREAM) {
+            // (Re)arm the stream; the first segment departs from the
+            // current setpoints.
+            axis->controller_.start_trajectory_stream();
+            entry_pos_ = axis->controller_.pos_setpoint_;
+            entry_vel_ = axis->controller_.vel_setpoint_;
+        }
+        if (!(feedrate >= MIN_FEEDRATE))
+            feedrate = MIN_FEEDRATE;
+        queue_[(head_ + count_) % QUEUE_DEPTH] = {pos, feedrate};
+        ++count_;
+        flush_requested_ = false;
+        pump(axis);
+        return true;
+    }
+
+    // @brief Emits all remaining segments, ending at zero velocity.
+    void flush(Axis* axis) {
+        flush_requested_ = true;
+        pump(axis);
+    }
+
+    // @brief Aborts the stream and discards the queue.
+    void stop(Axis* axis) {
+        axis->controller_.stop_trajectory_stream();
+        head_ = count_ = 0;
+        flush_requested_ = false;
+    }
+
+    size_t free_space() const { return QUEUE_DEPTH - count_; }
+
+    // @brief Emits every segment whose junction velocity is final.
+    void pump(Axis* axis) {
+        while (count_ > (flush_requested_ ? 0u : 1u)) {
+            Move_t& move = queue_[head_];
+            float v_exit = 0.0f;
+            if (count_ > 1) {
+                Move_t& next = queue_[(head_ + 1) % QUEUE_DEPTH];
+                float d_this = move.pos - entry_pos_;
+                float d_next = next.pos - move.pos;
+                if (d_this * d_next > 0.0f) { // zero on reversal (or zero-length)
+                    v_exit = std::min(move.feedrate, next.feedrate);
+                    // Also limited by what the next segment can brake to
+                    // rest from: this keeps every queued velocity
+                    // stoppable with one-segment look-ahead, so a flush
+                    // (or a short closing segment) is always feasible.
+                    float accel = axis->trap_.config_.accel_limit;
+                    v_exit = std::min(v_exit, sqrtf(2.0f * accel * fabsf(d_next)));
+                }
+            }
+            if (!emit(axis, move, v_exit))
+                return; // knot buffer full; retried on the next command
+            head_ = (head_ + 1) % QUEUE_DEPTH;
+            --count_;
+        }
     }
-    output.process_bytes((const uint8_t*)"\r\n", 2, nullptr);
+
+private:
+    struct Move_t {
+        float pos;      // [counts]
+        float feedrate; // [counts/s]
+    };
+
+    // @brief Emits one segment as an accel/cruise/decel knot triple
+    // (degenerate phases are dropped). The cubic segment interpolation
+    // reproduces the constant-acceleration phases exactly.
+    bool emit(Axis* axis, const Move_t& move, float v_exit) {
+        Controller& controller = axis->controller_;
+        if (controller.get_traj_knot_free_space() < 3)
+            return false;
+
+        float dX = move.pos - entry_pos_;
+        if (dX == 0.0f) {
+            entry_vel_ = 0.0f; // zero-length segment: come to rest
+            return controller.push_traj_knot(move.pos, 0.0f, 0.0f);
+        }
+        float accel = axis->trap_.config_.accel_limit;
+        float dir = dX > 0.0f ? 1.0f : -1.0f;
+        float dist = fabsf(dX);
+        float v_in = std::max(entry_vel_ * dir, 0.0f); // reversals replan from rest
+        // Clamp the exit velocity to what the accel limit can reach, then
+        // find the peak of the velocity trapezoid over this distance.
+        v_exit = std::min(v_exit, sqrtf(v_in * v_in + 2.0f * accel * dist));
+        float v_peak = sqrtf(0.5f * (v_in * v_in + v_exit * v_exit) + accel * dist);
+        v_peak = std::min(v_peak, move.feedrate);
+        v_peak = std::max(v_peak, std::max(v_in, v_exit)); // infeasible input: overshoot the feedrate rather than the target
+
+        float t_accel = (v_peak - v_in) / accel;
+        float t_decel = (v_peak - v_exit) / accel;
+        float d_accel = 0.5f * (v_in + v_peak) * t_accel;
+        float d_decel = 0.5f * (v_exit + v_peak) * t_decel;
+        float d_cruise = std::max(dist - d_accel - d_decel, 0.0f);
+        float t_cruise = d_cruise / v_peak;
+
+        float pos = entry_pos_;
+        if (t_accel > 0.0f) {
+            pos += dir * d_accel;
+            controller.push_traj_knot(pos, dir * v_peak, t_accel);
+        }
+        if (t_cruise > 0.0f) {
+            pos += dir * d_cruise;
+            controller.push_traj_knot(pos, dir * v_peak, t_cruise);
+        }
+        // The final knot always lands exactly on the target
+        controller.push_traj_knot(move.pos, dir * v_exit, t_decel);
+
+        entry_pos_ = move.pos;
+        entry_vel_ = dir * v_exit;
+        return true;
+    }
+
+    Move_t queue_[QUEUE_DEPTH];
+    size_t head_ = 0;
+    size_t count_ = 0;
+    bool flush_requested_ = false;
+    float entry_pos_ = 0.0f; // position where the first unemitted segment departs
+    float entry_vel_ = 0.0f; // signed velocity at that point
+};
+
+static MovePlanner move_planners[AXIS_COUNT];
+
+/* Command handlers -----------------------------------------------------------
+* Each handler receives the argument cursor (just past the command byte).
+* The setpoint handlers (p, q, v, c, t, u) are allocation-free and only
+* touch the tokenizer above.
+*/
+
+static void cmd_set_position(const char* cursor, StreamSink& response_channel, bool use_checksum) {
+    Axis* axis = parse_axis(&cursor, response_channel, use_checksum);
+    if (!axis)
+        return;
+    float pos_setpoint;
+    if (!parse_float(&cursor, &pos_setpoint)) {
+        respond(response_channel, use_checksum, "invalid command format");
+        return;
+    }
+    float vel_feed_forward = 0.0f;
+    float current_feed_forward = 0.0f;
+    if (parse_float(&cursor, &vel_feed_forward))
+        parse_float(&cursor, &current_feed_forward);
+    axis->controller_.set_pos_setpoint(pos_setpoint, vel_feed_forward, current_feed_forward);
+    axis->watchdog_feed();
+}
+
+static void cmd_set_position_wl(const char* cursor, StreamSink& response_channel, bool use_checksum) {
+    Axis* axis = parse_axis(&cursor, response_channel, use_checksum);
+    if (!axis)
+        return;
+    float pos_setpoint;
+    if (!parse_float(&cursor, &pos_setpoint)) {
+        respond(response_channel, use_checksum, "invalid command format");
+        return;
+    }
+    axis->controller_.pos_setpoint_ = pos_setpoint;
+    float vel_limit, current_lim;
+    if (parse_float(&cursor, &vel_limit)) {
+        axis->controller_.config_.vel_limit = vel_limit;
+        if (parse_float(&cursor, &current_lim))
+            axis->motor_.config_.current_lim = current_lim;
+    }
+    axis->watchdog_feed();
 }
 
+// @brief Batched position command: one 'Q' line carries a full
+// pos/vel-limit/current-limit group per axis, in axis order, so a
+// multi-axis host updates all setpoints with a single transaction.
+// All arguments are mandatory (optional ones would make the groups
+// ambiguous) and nothing is applied unless the whole line parses.
+static void cmd_set_position_wl_all(const char* cursor, StreamSink& response_channel, bool use_checksum) {
+    float pos_setpoint[AXIS_COUNT];
+    float vel_limit[AXIS_COUNT];
+    float current_lim[AXIS_COUNT];
+    for (size_t i = 0; i < AXIS_COUNT; ++i) {
+        if (!parse_float(&cursor, &pos_setpoint[i]) ||
+            !parse_float(&cursor, &vel_limit[i]) ||
+            !parse_float(&cursor, &current_lim[i])) {
+            respond(response_channel, use_checksum, "invalid command format");
+            return;
+        }
+    }
+    for (size_t i = 0; i < AXIS_COUNT; ++i) {
+        axes[i]->controller_.pos_setpoint_ = pos_setpoint[i];
+        axes[i]->controller_.config_.vel_limit = vel_limit[i];
+        axes[i]->motor_.config_.current_lim = current_lim[i];
+        axes[i]->watchdog_feed();
+    }
+}
+
+static void cmd_set_velocity(const char* cursor, StreamSink& response_channel, bool use_checksum) {
+    Axis* axis = parse_axis(&cursor, response_channel, use_checksum);
+    if (!axis)
+        return;
+    float vel_setpoint;
+    if (!parse_float(&cursor, &vel_setpoint)) {
+        respond(response_channel, use_checksum, "invalid command format");
+        return;
+    }
+    float current_feed_forward = 0.0f;
+    parse_float(&cursor, &current_feed_forward);
+    axis->controller_.set_vel_setpoint(vel_setpoint, current_feed_forward);
+    axis->watchdog_feed();
+}
+
+static void cmd_set_current(const char* cursor, StreamSink& response_channel, bool use_checksum) {
+    Axis* axis = parse_axis(&cursor, response_channel, use_checksum);
+    if (!axis)
+        return;
+    float current_setpoint;
+    if (!parse_float(&cursor, &current_setpoint)) {
+        respond(response_channel, use_checksum, "invalid command format");
+        return;
+    }
+    axis->controller_.set_current_setpoint(current_setpoint);
+    axis->watchdog_feed();
+}
+
+static void cmd_move_to_pos(const char* cursor, StreamSink& response_channel, bool use_checksum) {
+    Axis* axis = parse_axis(&cursor, response_channel, use_checksum);
+    if (!axis)
+        return;
+    float goal_point;
+    if (!parse_float(&cursor, &goal_point)) {
+        respond(response_channel, use_checksum, "invalid command format");
+        return;
+    }
+    axis->controller_.move_to_pos(goal_point);
+    axis->watchdog_feed();
+}
+
+// @brief Streaming move commands: "m axis pos feedrate" queues a segment
+// and answers "ok N" (free queue slots) or "busy" (queue full, resend
+// later); "m axis f" flushes the stream to a stop; "m axis s" aborts it.
+static void cmd_stream_move(const char* cursor, StreamSink& response_channel, bool use_checksum) {
+    unsigned motor_number;
+    if (!parse_uint(&cursor, &motor_number)) {
+        respond(response_channel, use_checksum, "invalid command format");
+        return;
+    }
+    if (motor_number >= AXIS_COUNT) {
+        respond(response_channel, use_checksum, "invalid motor %u", motor_number);
+        return;
+    }
+    Axis* axis = axes[motor_number];
+    MovePlanner& planner = move_planners[motor_number];
+
+    skip_spaces(&cursor);
+    if (*cursor == 'f') {
+        planner.flush(axis);
+        respond(response_channel, use_checksum, "ok");
+    } else if (*cursor == 's') {
+        planner.stop(axis);
+        respond(response_channel, use_checksum, "ok");
+    } else {
+        float pos, feedrate;
+        if (!parse_float(&cursor, &pos) || !parse_float(&cursor, &feedrate)) {
+            respond(response_channel, use_checksum, "invalid command format");
+            return;
+        }
+        if (planner.push(axis, pos, feedrate)) {
+            axis->watchdog_feed();
+            respond(response_channel, use_checksum, "ok %u", (unsigned)planner.free_space());
+        } else {
+            respond(response_channel, use_checksum, "busy");
+        }
+    }
+}
+
+static void cmd_feedback(const char* cursor, StreamSink& response_channel, bool use_checksum) {
+    // Batched form: without an axis argument all axes are reported in
+    // one line ("pos0 vel0 pos1 vel1"), halving the per-cycle UART
+    // transactions for dual-axis hosts; a trailing 'i' ("fi") appends
+    // Iq_measured to each axis group.
+    if (!is_digit(*cursor)) {
+        bool include_current = (*cursor == 'i');
+        char response[160]; // worst case: 6 values + separators + checksum
+        size_t len = 0;
+        for (size_t i = 0; i < AXIS_COUNT; ++i) {
+            // the mirror gives a pos/vel/Iq group captured in the same
+            // control cycle; live fields could pair values from different
+            // cycles (see Axis::update_telemetry_mirror)
+            Axis::Telemetry_t telemetry = axes[i]->read_telemetry();
+            if (i)
+                response[len++] = ' ';
+            len += format_float(response + len, sizeof(response) - len, telemetry.pos_estimate);
+            response[len++] = ' ';
+            len += format_float(response + len, sizeof(response) - len, telemetry.vel_estimate);
+            if (include_current) {
+                response[len++] = ' ';
+                len += format_float(response + len, sizeof(response) - len, telemetry.Iq_measured);
+            }
+        }
+        len = finish_line(response, len, sizeof(response), use_checksum);
+        response_channel.process_bytes((uint8_t*)response, len, nullptr);
+        return;
+    }
+
+    Axis* axis = parse_axis(&cursor, response_channel, use_checksum);
+    if (!axis)
+        return;
+    char response[56];
+    Axis::Telemetry_t telemetry = axis->read_telemetry();
+    size_t len = format_float(response, sizeof(response), telemetry.pos_estimate);
+    response[len++] = ' ';
+    len += format_float(response + len, sizeof(response) - len, telemetry.vel_estimate);
+    len = finish_line(response, len, sizeof(response), use_checksum);
+    response_channel.process_bytes((uint8_t*)response, len, nullptr);
+}
+
+// micros() at entry of the line currently being processed, for cmd_ping
+static uint32_t line_parse_start_us_ = 0;
+
+// @brief Latency probe: replies with the device timestamp at line-parse
+// time and the parse-to-response duration, both in microseconds. The host
+// subtracts the duration from its measured round trip to split transport
+// latency from firmware processing time.
+static void cmd_ping(const char* cursor, StreamSink& response_channel, bool use_checksum) {
+    (void) cursor; // unused parameter
+    uint32_t parse_us = line_parse_start_us_;
+    respond(response_channel, use_checksum, "pong %lu %lu",
+            (unsigned long)parse_us, (unsigned long)(micros() - parse_us));
+}
+
+// @brief Feeds one axis watchdog ("u 0") or, without an axis argument,
+// every axis watchdog in one transaction ("u"): a board-level host
+// heartbeat, so a supervisory host pays one line per period for the
+// whole board. The axis-less form can be disarmed via
+// config.enable_watchdog_feed_ascii.
+static void cmd_feed_watchdog(const char* cursor, StreamSink& response_channel, bool use_checksum) {
+    if (!is_digit(*cursor)) {
+        if (board_config.enable_watchdog_feed_ascii)
+            feed_all_watchdogs();
+        return;
+    }
+    Axis* axis = parse_axis(&cursor, response_channel, use_checksum);
+    if (axis)
+        axis->watchdog_feed();
+}
+
+static void cmd_help(const char* cursor, StreamSink& response_channel, bool use_checksum) {
+    (void) cursor; // unused parameter
+    ResponseBatcher batch(response_channel, use_checksum);
+    batch.line("Please see documentation for more details");
+    batch.line("");
+    batch.line("Available commands syntax reference:");
+    batch.line("Position: q axis pos vel-lim I-lim");
+    batch.line("Position (all axes): Q pos vel-lim I-lim per axis");
+    batch.line("Position: p axis pos vel-ff I-ff");
+    batch.line("Velocity: v axis vel I-ff");
+    batch.line("Current: c axis I");
+    batch.line("Stream move: m axis pos feedrate (m axis f = flush, m axis s = stop)");
+    batch.line("Feed watchdog: u axis (u = feed all axes)");
+    batch.line("");
+    batch.line("Properties start at odrive root, such as axis0.requested_state");
+    batch.line("Read: r property");
+    batch.line("Write: w property value");
+    batch.line("");
+    batch.line("Save config: ss");
+    batch.line("Erase config: se");
+    batch.line("Reboot: sr");
+}
+
+static void cmd_info(const char* cursor, StreamSink& response_channel, bool use_checksum) {
+    (void) cursor; // unused parameter
+    ResponseBatcher batch(response_channel, use_checksum);
+    // batch.line("Signature: %#x", STM_ID_GetSignature());
+    // batch.line("Revision: %#x", STM_ID_GetRevision());
+    // batch.line("Flash Size: %#x KiB", STM_ID_GetFlashSize());
+    batch.line("Hardware version: %d.%d-%dV", HW_VERSION_MAJOR, HW_VERSION_MINOR, HW_VERSION_VOLTAGE);
+    batch.line("Firmware version: %d.%d.%d", FW_VERSION_MAJOR, FW_VERSION_MINOR, FW_VERSION_REVISION);
+    batch.line("Serial number: %s", serial_number_str);
+}
+
+static void cmd_system(const char* cursor, StreamSink& response_channel, bool use_checksum) {
+    (void) response_channel; // unused parameter
+    (void) use_checksum;     // unused parameter
+    if (*cursor == 's') { // Save config
+        save_configuration();
+    } else if (*cursor == 'e') { // Erase config
+        erase_configuration();
+    } else if (*cursor == 'r') { // Reboot
+        NVIC_SystemReset();
+    }
+}
+
+static void cmd_read_property(const char* cursor, StreamSink& response_channel, bool use_checksum) {
+    char name[MAX_LINE_LENGTH];
+    if (!parse_token(&cursor, name, sizeof(name))) {
+        respond(response_channel, use_checksum, "invalid command format");
+        return;
+    }
+    Endpoint* endpoint = application_endpoints_->get_by_name(name, sizeof(name));
+    if (!endpoint) {
+        respond(response_channel, use_checksum, "invalid property");
+    } else {
+        char response[10];
+        bool success = endpoint->get_string(response, sizeof(response));
+        if (!success)
+            respond(response_channel, use_checksum, "not implemented");
+        else
+            respond(response_channel, use_checksum, response);
+    }
+}
+
+static void cmd_write_property(const char* cursor, StreamSink& response_channel, bool use_checksum) {
+    char name[MAX_LINE_LENGTH];
+    char value[MAX_LINE_LENGTH];
+    if (!parse_token(&cursor, name, sizeof(name))) {
+        respond(response_channel, use_checksum, "invalid command format");
+        return;
+    }
+    parse_token(&cursor, value, sizeof(value));
+    Endpoint* endpoint = application_endpoints_->get_by_name(name, sizeof(name));
+    if (!endpoint) {
+        respond(response_channel, use_checksum, "invalid property");
+    } else {
+        bool success = endpoint->set_string(value, sizeof(value));
+        if (!success)
+            respond(response_channel, use_checksum, "not implemented");
+    }
+}
+
+// Dispatch table keyed on the first command byte
+static const struct {
+    char command;
+    void (*handler)(const char* cursor, StreamSink& response_channel, bool use_checksum);
+} command_table[] = {
+    { 'p', cmd_set_position },    // position control
+    { 'q', cmd_set_position_wl }, // position control with limits
+    { 'Q', cmd_set_position_wl_all }, // position control with limits, all axes at once
+    { 'v', cmd_set_velocity },    // velocity control
+    { 'c', cmd_set_current },     // current control
+    { 't', cmd_move_to_pos },     // trapezoidal trajectory
+    { 'm', cmd_stream_move },     // streaming moves with look-ahead
+    { 'f', cmd_feedback },        // feedback
+    { 'u', cmd_feed_watchdog },   // update axis watchdog
+    { 'e', cmd_ping },            // echo/ping for latency measurement
+    { 'h', cmd_help },            // help
+    { 'i', cmd_info },            // dump device info
+    { 's', cmd_system },          // system commands
+    { 'r', cmd_read_property },   // read property
+    { 'w', cmd_write_property },  // write property
+};
 
 // @brief Executes an ASCII protocol command
 // @param buffer buffer of ASCII encoded characters
 // @param len size of the buffer
 void ASCII_protocol_process_line(const uint8_t* buffer, size_t len, StreamSink& response_channel) {
     static_assert(sizeof(char) == sizeof(uint8_t));
+    line_parse_start_us_ = micros();
 
     // scan line to find beginning of checksum and prune comment
     uint8_t checksum = 0;
@@ -72,198 +767,32 @@ void ASCII_protocol_process_line(const uint8_t* buffer, size_t len, StreamSink&
     char cmd[MAX_LINE_LENGTH + 1];
     if (len > MAX_LINE_LENGTH) len = MAX_LINE_LENGTH;
     memcpy(cmd, buffer, len);
+    cmd[len] = 0; // null-terminate
 
     // optional checksum validation
     bool use_checksum = (checksum_start < len);
     if (use_checksum) {
-        unsigned int received_checksum;
-        sscanf((const char *)cmd + checksum_start, "%u", &received_checksum);
-        if (received_checksum != checksum)
+        const char* cursor = cmd + checksum_start;
+        unsigned received_checksum;
+        if (!parse_uint(&cursor, &received_checksum) || received_checksum != checksum)
             return;
         len = checksum_start - 1; // prune checksum and asterisk
+        cmd[len] = 0;
     }
 
-    cmd[len] = 0; // null-terminate
+    if (cmd[0] == 0)
+        return;
 
-    // check incoming packet type
-    if (cmd[0] == 'p') { // position control
-        unsigned motor_number;
-        float pos_setpoint, vel_feed_forward, current_feed_forward;
-        int numscan = sscanf(cmd, "p %u %f %f %f", &motor_number, &pos_setpoint, &vel_feed_forward, &current_feed_forward);
-        if (numscan < 2) {
-            respond(response_channel, use_checksum, "invalid command format");
-        } else if (motor_number >= AXIS_COUNT) {
-            respond(response_channel, use_checksum, "invalid motor %u", motor_number);
-        } else {
-            if (numscan < 3)
-                vel_feed_forward = 0.0f;
-            if (numscan < 4)
-                current_feed_forward = 0.0f;
-            Axis* axis = axes[motor_number];
-            axis->controller_.set_pos_setpoint(pos_setpoint, vel_feed_forward, current_feed_forward);
-            axis->watchdog_feed();
-        }
-
-    } else if (cmd[0] == 'q') { // position control with limits
-        unsigned motor_number;
-        float pos_setpoint, vel_limit, current_lim;
-        int numscan = sscanf(cmd, "q %u %f %f %f", &motor_number, &pos_setpoint, &vel_limit, &current_lim);
-        if (numscan < 2) {
-            respond(response_channel, use_checksum, "invalid command format");
-        } else if (motor_number >= AXIS_COUNT) {
-            respond(response_channel, use_checksum, "invalid motor %u", motor_number);
-        } else {
-            Axis* axis = axes[motor_number];
-            axis->controller_.pos_setpoint_ = pos_setpoint;
-            if (numscan >= 3)
-                axis->controller_.config_.vel_limit = vel_limit;
-            if (numscan >= 4)
-                axis->motor_.config_.current_lim = current_lim;
-
-            axis->watchdog_feed();
-        }
-
-    } else if (cmd[0] == 'v') { // velocity control
-        unsigned motor_number;
-        float vel_setpoint, current_feed_forward;
-        int numscan = sscanf(cmd, "v %u %f %f", &motor_number, &vel_setpoint, &current_feed_forward);
-        if (numscan < 2) {
-            respond(response_channel, use_checksum, "invalid command format");
-        } else if (motor_number >= AXIS_COUNT) {
-            respond(response_channel, use_checksum, "invalid motor %u", motor_number);
-        } else {
-            if (numscan < 3)
-                current_feed_forward = 0.0f;
-            Axis* axis = axes[motor_number];
-            axis->controller_.set_vel_setpoint(vel_setpoint, current_feed_forward);
-            axis->watchdog_feed();
-        }
-
-    } else if (cmd[0] == 'c') { // current control
-        unsigned motor_number;
-        float current_setpoint;
-        int numscan = sscanf(cmd, "c %u %f", &motor_number, &current_setpoint);
-        if (numscan < 2) {
-            respond(response_channel, use_checksum, "invalid command format");
-        } else if (motor_number >= AXIS_COUNT) {
-            respond(response_channel, use_checksum, "invalid motor %u", motor_number);
-        } else {
-            Axis* axis = axes[motor_number];
-            axis->controller_.set_current_setpoint(current_setpoint);
-            axis->watchdog_feed();
-        }
-
-    } else if (cmd[0] == 't') { // trapezoidal trajectory
-        unsigned motor_number;
-        float goal_point;
-        int numscan = sscanf(cmd, "t %u %f", &motor_number, &goal_point);
-        if (numscan < 2) {
-            respond(response_channel, use_checksum, "invalid command format");
-        } else if (motor_number >= AXIS_COUNT) {
-            respond(response_channel, use_checksum, "invalid motor %u", motor_number);
-        } else {
-            Axis* axis = axes[motor_number];
-            axis->controller_.move_to_pos(goal_point);
-            axis->watchdog_feed();
-        }
-
-    } else if (cmd[0] == 'f') { // feedback
-        unsigned motor_number;
-        int numscan = sscanf(cmd, "f %u", &motor_number);
-        if (numscan < 1) {
-            respond(response_channel, use_checksum, "invalid command format");
-        } else if (motor_number >= AXIS_COUNT) {
-            respond(response_channel, use_checksum, "invalid motor %u", motor_number);
-        } else {
-            respond(response_channel, use_checksum, "%f %f",
-                    (double)axes[motor_number]->encoder_.pos_estimate_,
-                    (double)axes[motor_number]->encoder_.vel_estimate_);
-        }
-
-    } else if (cmd[0] == 'h') {  // Help
-        respond(response_channel, use_checksum, "Please see documentation for more details");
-        respond(response_channel, use_checksum, "");
-        respond(response_channel, use_checksum, "Available commands syntax reference:");
-        respond(response_channel, use_checksum, "Position: q axis pos vel-lim I-lim");
-        respond(response_channel, use_checksum, "Position: p axis pos vel-ff I-ff");
-        respond(response_channel, use_checksum, "Velocity: v axis vel I-ff");
-        respond(response_channel, use_checksum, "Current: c axis I");
-        respond(response_channel, use_checksum, "");
-        respond(response_channel, use_checksum, "Properties start at odrive root, such as axis0.requested_state");
-        respond(response_channel, use_checksum, "Read: r property");
-        respond(response_channel, use_checksum, "Write: w property value");
-        respond(response_channel, use_checksum, "");
-        respond(response_channel, use_checksum, "Save config: ss");
-        respond(response_channel, use_checksum, "Erase config: se");
-        respond(response_channel, use_checksum, "Reboot: sr");
-
-    } else if (cmd[0] == 'i'){ // Dump device info
-        // respond(response_channel, use_checksum, "Signature: %#x", STM_ID_GetSignature());
-        // respond(response_channel, use_checksum, "Revision: %#x", STM_ID_GetRevision());
-        // respond(response_channel, use_checksum, "Flash Size: %#x KiB", STM_ID_GetFlashSize());
-        respond(response_channel, use_checksum, "Hardware version: %d.%d-%dV", HW_VERSION_MAJOR, HW_VERSION_MINOR, HW_VERSION_VOLTAGE);
-        respond(response_channel, use_checksum, "Firmware version: %d.%d.%d", FW_VERSION_MAJOR, FW_VERSION_MINOR, FW_VERSION_REVISION);
-        respond(response_channel, use_checksum, "Serial number: %s", serial_number_str);
-
-    } else if (cmd[0] == 's'){ // System
-        if(cmd[1] == 's') { // Save config
-            save_configuration();
-        } else if (cmd[1] == 'e'){ // Erase config
-            erase_configuration();
-        } else if (cmd[1] == 'r'){ // Reboot
-            NVIC_SystemReset();
-        }
-
-    } else if (cmd[0] == 'r') { // read property
-        char name[MAX_LINE_LENGTH];
-        int numscan = sscanf(cmd, "r %" TO_STR(MAX_LINE_LENGTH) "s", name);
-        if (numscan < 1) {
-            respond(response_channel, use_checksum, "invalid command format");
-        } else {
-            Endpoint* endpoint = application_endpoints_->get_by_name(name, sizeof(name));
-            if (!endpoint) {
-                respond(response_channel, use_checksum, "invalid property");
-            } else {
-                char response[10];
-                bool success = endpoint->get_string(response, sizeof(response));
-                if (!success)
-                    respond(response_channel, use_checksum, "not implemented");
-                else
-                    respond(response_channel, use_checksum, response);
-            }
-        }
-
-    } else if (cmd[0] == 'w') { // write property
-        char name[MAX_LINE_LENGTH];
-        char value[MAX_LINE_LENGTH];
-        int numscan = sscanf(cmd, "w %" TO_STR(MAX_LINE_LENGTH) "s %" TO_STR(MAX_LINE_LENGTH) "s", name, value);
-        if (numscan < 1) {
-            respond(response_channel, use_checksum, "invalid command format");
-        } else {
-            Endpoint* endpoint = application_endpoints_->get_by_name(name, sizeof(name));
-            if (!endpoint) {
-                respond(response_channel, use_checksum, "invalid property");
-            } else {
-                bool success = endpoint->set_string(value, sizeof(value));
-                if (!success)
-                    respond(response_channel, use_checksum, "not implemented");
-            }
-        }
-
-    }else if (cmd[0] == 'u') { // Update axis watchdog. 
-        unsigned motor_number;
-        int numscan = sscanf(cmd, "u %u", &motor_number);
-        if(numscan < 1){
-            respond(response_channel, use_checksum, "invalid command format");
-        } else if (motor_number >= AXIS_COUNT) {
-            respond(response_channel, use_checksum, "invalid motor %u", motor_number);
-        }else {
-            axes[motor_number]->watchdog_feed();
+    for (size_t i = 0; i < sizeof(command_table) / sizeof(command_table[0]); ++i) {
+        if (command_table[i].command == cmd[0]) {
+            const char* cursor = cmd + 1;
+            skip_spaces(&cursor);
+            command_table[i].handler(cursor, response_channel, use_checksum);
+            return;
         }
-
-    } else if (cmd[0] != 0) {
-        respond(response_channel, use_checksum, "unknown command");
     }
+
+    respond(response_channel, use_checksum, "unknown command");
 }
 
 void ASCII_protocol_parse_stream(const uint8_t* buffer, size_t len, StreamSink& response_channel) {
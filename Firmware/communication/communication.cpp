@@ -11,10 +11,14 @@
 #include "odrive_main.h"
 #include "freertos_vars.h"
 #include "utils.h"
+#include "mini_fmt.h"
+#include "nvm.h"
 
 #include "../build/version.h" // autogenerated based on Git state
+#include "stable_endpoint_ids.hpp"
 
 #include <cmsis_os.h>
+#include <can.h>
 #include <memory>
 //#include <usbd_cdc_if.h>
 //#include <usb_device.h>
@@ -62,14 +66,32 @@ const uint8_t fw_version_major = FW_VERSION_MAJOR;
 const uint8_t fw_version_minor = FW_VERSION_MINOR;
 const uint8_t fw_version_revision = FW_VERSION_REVISION;
 const uint8_t fw_version_unreleased = FW_VERSION_UNRELEASED; // 0 for official releases, 1 otherwise
+const uint8_t stable_id_map_version = STABLE_ID_MAP_VERSION; // see stable_endpoint_ids.hpp
 
 osThreadId comm_thread;
 volatile bool endpoint_list_valid = false;
 
 static uint32_t test_property = 0;
 
+// Endpoint handlers are shared between the USB, UART and I2C serving
+// threads; this mutex (registered with the protocol code below) serializes
+// their execution per dispatched operation. A FreeRTOS mutex, so the
+// UART thread inherits its priority into a USB-held section instead of
+// waiting out a burst.
+osMutexDefStatic(fibre_endpoint_mutex_def);
+static osMutexId fibre_endpoint_mutex;
+static void fibre_endpoint_lock(void) {
+    osMutexWait(fibre_endpoint_mutex, osWaitForever);
+}
+static void fibre_endpoint_unlock(void) {
+    osMutexRelease(fibre_endpoint_mutex);
+}
+
 /* Private function prototypes -----------------------------------------------*/
 
+static void publish_obj_tree_thread(void * ctx);
+static void request_interface_reconfig(void);
+
 auto make_protocol_definitions(PWMMapping_t& mapping) {
     return make_protocol_member_list(
         make_protocol_property("endpoint", &mapping.endpoint),
@@ -81,19 +103,36 @@ auto make_protocol_definitions(PWMMapping_t& mapping) {
 /* Function implementations --------------------------------------------------*/
 
 void init_communication(void) {
-    printf("hi!\r\n");
-
-    // Start command handling thread
-    osThreadDef(task_cmd_parse, communication_task, osPriorityNormal, 0, 8000 /* in 32-bit words */); // TODO: fix stack issues
-    comm_thread = osThreadCreate(osThread(task_cmd_parse), NULL);
+    mini_printf("hi!\r\n");
+
+    // Build the endpoint tree on a disposable thread. Constructing the
+    // deeply nested make_obj_tree() aggregate needs a lot of stack, but
+    // only once; a one-shot thread pays for it and hands its stack back
+    // to the FreeRTOS heap on termination, instead of parking it in the
+    // comm thread forever.
+#ifdef STATIC_ALLOCATION_ONLY
+    // In the static build the stack is parked permanently; it goes to
+    // main SRAM (not the macro's CCM section) because the CCM budget is
+    // reserved for the stacks that are actually live at runtime.
+    static StackType_t tree_build_stack[8000];
+    static StaticTask_t tree_build_control;
+    osThreadStaticDef(task_tree_build, publish_obj_tree_thread, osPriorityNormal, 0, 8000,
+                      tree_build_stack, &tree_build_control);
+#else
+    osThreadDef(task_tree_build, publish_obj_tree_thread, osPriorityNormal, 0, 8000 /* in 32-bit words */);
+#endif
+    osThreadCreate(osThread(task_tree_build), NULL);
 
     while (!endpoint_list_valid)
         osDelay(1);
+
+    // Start command handling thread
+    osThreadDefStatic(task_cmd_parse, communication_task, osPriorityNormal, 0, 2048 /* in 32-bit words */);
+    comm_thread = osThreadCreate(osThread(task_cmd_parse), NULL);
 }
 
 
 float oscilloscope[OSCILLOSCOPE_SIZE] = {0};
-size_t oscilloscope_pos = 0;
 
 
 static CAN_context can1_ctx;
@@ -104,12 +143,37 @@ static CAN_context can1_ctx;
 class StaticFunctions {
 public:
     void save_configuration_helper() { save_configuration(); }
+    void save_configuration_async_helper() { save_configuration_async(); }
     void erase_configuration_helper() { erase_configuration(); }
     void NVIC_SystemReset_helper() { NVIC_SystemReset(); }
     void enter_dfu_mode_helper() { enter_dfu_mode(); }
     float get_oscilloscope_val(uint32_t index) { return oscilloscope[index]; }
     float get_adc_voltage_(uint32_t gpio) { return get_adc_voltage(get_gpio_port_by_pin(gpio), get_gpio_pin_by_pin(gpio)); }
     int32_t test_function(int32_t delta) { static int cnt = 0; return cnt += delta; }
+    // Latency probe: high word = micros() at packet-parse time, low word =
+    // parse-to-response duration in us. The host subtracts the duration
+    // from its own round trip to split transport from firmware latency.
+    uint64_t ping_us_() {
+        uint32_t parse_us = fibre_get_last_parse_us();
+        uint32_t elapsed_us = micros() - parse_us;
+        return ((uint64_t)parse_us << 32) | elapsed_us;
+    }
+    uint32_t get_endpoint_access_cnt_(uint32_t endpoint_id) { return fibre_get_endpoint_access_cnt(endpoint_id); }
+    void reset_endpoint_stats_() { fibre_reset_endpoint_stats(); }
+    uint32_t get_config_image_size_() { return get_config_image_size(); }
+    int32_t config_export_begin_() { return config_export_begin(); }
+    uint32_t config_read_word_(uint32_t offset) { return config_read_word(offset); }
+    void config_write_word_(uint32_t offset, uint32_t word) { config_write_word(offset, word); }
+    int32_t config_import_commit_() { return config_import_commit(); }
+    int32_t config_trial_begin_(uint32_t timeout_ms) { return config_trial_begin(timeout_ms); }
+    void config_trial_feed_() { config_trial_feed(); }
+    int32_t config_trial_commit_() { return config_trial_commit(); }
+    int32_t config_trial_revert_() { return config_trial_revert(); }
+    uint32_t get_nvm_journal_free_space_() { return NVM_get_append_free_space(); }
+    void apply_interface_config_() { request_interface_reconfig(); }
+    // Board-level host heartbeat: one call feeds every axis watchdog
+    // (see feed_all_watchdogs in axis.cpp)
+    void feed_watchdogs_() { if (board_config.enable_watchdog_feed_fibre) feed_all_watchdogs(); }
 } static_functions;
 
 // When adding new functions/variables to the protocol, be careful not to
@@ -118,6 +182,9 @@ public:
 static inline auto make_obj_tree() {
     return make_protocol_member_list(
         make_protocol_ro_property("vbus_voltage", &vbus_voltage),
+        make_protocol_ro_property("vbus_voltage_pred", &vbus_voltage_pred),
+        make_protocol_ro_property("regen_energy_absorbed", &regen_energy_absorbed),
+        make_protocol_ro_property("brake_energy_dissipated", &brake_energy_dissipated),
         make_protocol_ro_property("serial_number", &serial_number),
         make_protocol_ro_property("hw_version_major", &hw_version_major),
         make_protocol_ro_property("hw_version_minor", &hw_version_minor),
@@ -126,38 +193,98 @@ static inline auto make_obj_tree() {
         make_protocol_ro_property("fw_version_minor", &fw_version_minor),
         make_protocol_ro_property("fw_version_revision", &fw_version_revision),
         make_protocol_ro_property("fw_version_unreleased", &fw_version_unreleased),
+        make_protocol_ro_property("stable_id_map_version", &stable_id_map_version),
         make_protocol_ro_property("user_config_loaded", const_cast<const bool *>(&user_config_loaded_)),
+        make_protocol_ro_property("config_save_pending", const_cast<const bool *>(&config_save_pending_)),
         make_protocol_ro_property("brake_resistor_armed", &brake_resistor_armed),
         make_protocol_object("system_stats",
+            make_protocol_object("boot_timings",
+                make_protocol_ro_property("config_load", &system_stats_.boot_timings.config_load),
+                make_protocol_ro_property("peripheral_init", &system_stats_.boot_timings.peripheral_init),
+                make_protocol_ro_property("comm_init", &system_stats_.boot_timings.comm_init),
+                make_protocol_ro_property("axis_setup", &system_stats_.boot_timings.axis_setup),
+                make_protocol_ro_property("current_calib_wait", &system_stats_.boot_timings.current_calib_wait),
+                make_protocol_ro_property("total", &system_stats_.boot_timings.total)
+            ),
             make_protocol_ro_property("uptime", &system_stats_.uptime),
             make_protocol_ro_property("min_heap_space", &system_stats_.min_heap_space),
-            make_protocol_ro_property("min_stack_space_axis0", &system_stats_.min_stack_space_axis0),
-            make_protocol_ro_property("min_stack_space_axis1", &system_stats_.min_stack_space_axis1),
+            make_protocol_ro_property("min_stack_space_axis_worker", &system_stats_.min_stack_space_axis_worker),
             make_protocol_ro_property("min_stack_space_comms", &system_stats_.min_stack_space_comms),
             make_protocol_ro_property("min_stack_space_usb", &system_stats_.min_stack_space_usb),
             make_protocol_ro_property("min_stack_space_uart", &system_stats_.min_stack_space_uart),
             make_protocol_ro_property("min_stack_space_usb_irq", &system_stats_.min_stack_space_usb_irq),
             make_protocol_ro_property("min_stack_space_startup", &system_stats_.min_stack_space_startup),
+            make_protocol_ro_property("cpu_load_axis_worker", &system_stats_.cpu_load_axis_worker),
+            make_protocol_ro_property("cpu_load_comms", &system_stats_.cpu_load_comms),
+            make_protocol_ro_property("cpu_load_usb", &system_stats_.cpu_load_usb),
+            make_protocol_ro_property("cpu_load_uart", &system_stats_.cpu_load_uart),
+            make_protocol_ro_property("cpu_load_usb_irq", &system_stats_.cpu_load_usb_irq),
+            make_protocol_ro_property("cpu_load_startup", &system_stats_.cpu_load_startup),
+            make_protocol_ro_property("cpu_load_idle", &system_stats_.cpu_load_idle),
+            make_protocol_ro_property("cpu_load_control_isr", &system_stats_.cpu_load_control_isr),
+            // ADC IRQ entries delayed past the latency budget; nonzero means
+            // the NVIC priority partition is being violated somewhere
+            // (see Board/v3/Inc/nvic_priorities.h)
+            make_protocol_ro_property("nvic_audit_inversion_cnt", &nvic_audit_inversion_cnt),
+            make_protocol_ro_property("sleep_ratio", &system_stats_.sleep_ratio),
+            make_protocol_ro_property("sleep_entry_cnt", &system_stats_.sleep_entry_cnt),
+            make_protocol_ro_property("wakeup_to_arm_us", &system_stats_.wakeup_to_arm_us),
             make_protocol_object("usb",
                 make_protocol_ro_property("rx_cnt", &usb_stats_.rx_cnt),
                 make_protocol_ro_property("tx_cnt", &usb_stats_.tx_cnt),
-                make_protocol_ro_property("tx_overrun_cnt", &usb_stats_.tx_overrun_cnt)
+                make_protocol_ro_property("tx_overrun_cnt", &usb_stats_.tx_overrun_cnt),
+                make_protocol_ro_property("rx_queue_overrun_cnt", &usb_stats_.rx_queue_overrun_cnt),
+                make_protocol_ro_property("max_irq_duration_us", &usb_stats_.max_irq_duration_us),
+                make_protocol_ro_property("rx_rate_limited_cnt", &usb_stats_.rx_rate_limited_cnt)
             ),
             make_protocol_object("i2c",
                 make_protocol_ro_property("addr", &i2c_stats_.addr),
                 make_protocol_ro_property("addr_match_cnt", &i2c_stats_.addr_match_cnt),
                 make_protocol_ro_property("rx_cnt", &i2c_stats_.rx_cnt),
-                make_protocol_ro_property("error_cnt", &i2c_stats_.error_cnt)
+                make_protocol_ro_property("error_cnt", &i2c_stats_.error_cnt),
+                make_protocol_object("registers", i2c_registers_.make_protocol_definitions())
+            ),
+            make_protocol_object("uart",
+                make_protocol_ro_property("rx_cnt", &uart_stats_.rx_cnt),
+                make_protocol_ro_property("rx_event_cnt", &uart_stats_.rx_event_cnt),
+                make_protocol_ro_property("rx_to_parse_latency_us", &uart_stats_.rx_to_parse_latency_us),
+                make_protocol_ro_property("rx_rate_limited_cnt", &uart_stats_.rx_rate_limited_cnt)
+            ),
+            // Erased bytes left for config journal appends; a save compacts
+            // automatically when this gets too small for one more record.
+            make_protocol_function("nvm_journal_free_space", static_functions, &StaticFunctions::get_nvm_journal_free_space_),
+            // Reading these endpoints counts as accesses itself, so poll
+            // them sparingly while hunting for a slow handler.
+            make_protocol_object("endpoints",
+                make_protocol_ro_property("access_cnt", &fibre_endpoint_stats_.access_cnt),
+                make_protocol_ro_property("max_handler_us", &fibre_endpoint_stats_.max_handler_us),
+                make_protocol_ro_property("max_handler_endpoint_id", &fibre_endpoint_stats_.max_handler_endpoint_id),
+                make_protocol_function("get_access_cnt", static_functions, &StaticFunctions::get_endpoint_access_cnt_, "endpoint_id"),
+                make_protocol_function("reset", static_functions, &StaticFunctions::reset_endpoint_stats_)
             )
         ),
+        make_protocol_object("profiler", profiler_.make_protocol_definitions()),
         make_protocol_object("config",
             make_protocol_property("brake_resistance", &board_config.brake_resistance),
-            // TODO: changing this currently requires a reboot - fix this
+            // applied at boot or by apply_interface_config()
             make_protocol_property("enable_uart", &board_config.enable_uart),
-            make_protocol_property("enable_i2c_instead_of_can" , &board_config.enable_i2c_instead_of_can), // requires a reboot
+            make_protocol_property("enable_i2c_instead_of_can" , &board_config.enable_i2c_instead_of_can),
             make_protocol_property("enable_ascii_protocol_on_usb", &board_config.enable_ascii_protocol_on_usb),
+            make_protocol_property("enable_watchdog_feed_fibre", &board_config.enable_watchdog_feed_fibre),
+            make_protocol_property("enable_watchdog_feed_ascii", &board_config.enable_watchdog_feed_ascii),
+            make_protocol_property("enable_watchdog_feed_can", &board_config.enable_watchdog_feed_can),
+            make_protocol_property("enable_fast_boot", &board_config.enable_fast_boot), // requires a reboot
+            make_protocol_property("startup_current_budget", &board_config.startup_current_budget),
             make_protocol_property("dc_bus_undervoltage_trip_level", &board_config.dc_bus_undervoltage_trip_level),
             make_protocol_property("dc_bus_overvoltage_trip_level", &board_config.dc_bus_overvoltage_trip_level),
+            make_protocol_property("regen_current_allowed", &board_config.regen_current_allowed),
+            make_protocol_property("regen_hysteresis_engage", &board_config.regen_hysteresis_engage),
+            make_protocol_property("regen_hysteresis_release", &board_config.regen_hysteresis_release),
+            make_protocol_property("fibre_ops_per_sec", &board_config.fibre_ops_per_sec), // requires a reboot
+            make_protocol_property("fibre_ops_burst", &board_config.fibre_ops_burst), // requires a reboot
+            make_protocol_property("enable_shared_thermal_derating", &board_config.enable_shared_thermal_derating),
+            make_protocol_property("shared_thermal_limit_lower", &board_config.shared_thermal_limit_lower),
+            make_protocol_property("shared_thermal_limit_upper", &board_config.shared_thermal_limit_upper),
 #if HW_VERSION_MAJOR == 3 && HW_VERSION_MINOR >= 3
             make_protocol_object("gpio1_pwm_mapping", make_protocol_definitions(board_config.pwm_mappings[0])),
             make_protocol_object("gpio2_pwm_mapping", make_protocol_definitions(board_config.pwm_mappings[1])),
@@ -166,16 +293,51 @@ static inline auto make_obj_tree() {
             make_protocol_object("gpio4_pwm_mapping", make_protocol_definitions(board_config.pwm_mappings[3])),
 
             make_protocol_object("gpio3_analog_mapping", make_protocol_definitions(board_config.analog_mappings[2])),
-            make_protocol_object("gpio4_analog_mapping", make_protocol_definitions(board_config.analog_mappings[3]))
+            make_protocol_object("gpio4_analog_mapping", make_protocol_definitions(board_config.analog_mappings[3])),
+            make_protocol_property("analog_filter_bandwidth", &board_config.analog_filter_bandwidth), // requires a reboot
+            make_protocol_property("analog_mapping_rate", &board_config.analog_mapping_rate), // requires a reboot
+            make_protocol_property("analog_change_threshold", &board_config.analog_change_threshold) // requires a reboot
             ),
         make_protocol_object("axis0", axes[0]->make_protocol_definitions()),
+#if AXIS_COUNT >= 2
         make_protocol_object("axis1", axes[1]->make_protocol_definitions()),
+#endif
         make_protocol_object("can", can1_ctx.make_protocol_definitions()),
         make_protocol_property("test_property", &test_property),
         make_protocol_function("test_function", static_functions, &StaticFunctions::test_function, "delta"),
+        make_protocol_function("ping_us", static_functions, &StaticFunctions::ping_us_),
         make_protocol_function("get_oscilloscope_val", static_functions, &StaticFunctions::get_oscilloscope_val, "index"),
+        make_protocol_object("oscilloscope", osc_.make_protocol_definitions()),
+        make_protocol_object("blackbox", blackbox_.make_protocol_definitions()),
+        make_protocol_object("watch", watch_.make_protocol_definitions()),
+        make_protocol_object("telemetry", telemetry_.make_protocol_definitions()),
         make_protocol_function("get_adc_voltage", static_functions, &StaticFunctions::get_adc_voltage_, "gpio"),
+        // Bulk config cloning: export_begin + read_word to pull the whole
+        // serialized config image, write_word + import_commit (+ save) to
+        // push it back. See main.cpp for the image layout and semantics.
+        make_protocol_object("config_image",
+            make_protocol_function("get_size", static_functions, &StaticFunctions::get_config_image_size_),
+            make_protocol_function("export_begin", static_functions, &StaticFunctions::config_export_begin_),
+            make_protocol_function("read_word", static_functions, &StaticFunctions::config_read_word_, "offset"),
+            make_protocol_function("write_word", static_functions, &StaticFunctions::config_write_word_, "offset", "word"),
+            make_protocol_function("import_commit", static_functions, &StaticFunctions::config_import_commit_)
+        ),
+        // Try a staged config image live without saving or rebooting; it
+        // auto-reverts when feed() stops coming (see main.cpp).
+        make_protocol_object("config_trial",
+            make_protocol_ro_property("active", &config_trial_active_),
+            make_protocol_ro_property("revert_cnt", &config_trial_revert_cnt_),
+            make_protocol_function("begin", static_functions, &StaticFunctions::config_trial_begin_, "timeout_ms"),
+            make_protocol_function("feed", static_functions, &StaticFunctions::config_trial_feed_),
+            make_protocol_function("commit", static_functions, &StaticFunctions::config_trial_commit_),
+            make_protocol_function("revert", static_functions, &StaticFunctions::config_trial_revert_)
+        ),
+        // Applies enable_uart / enable_i2c_instead_of_can at runtime; the
+        // switch happens on the comm thread within a couple of ticks.
+        make_protocol_function("apply_interface_config", static_functions, &StaticFunctions::apply_interface_config_),
+        make_protocol_function("feed_watchdogs", static_functions, &StaticFunctions::feed_watchdogs_),
         make_protocol_function("save_configuration", static_functions, &StaticFunctions::save_configuration_helper),
+        make_protocol_function("save_configuration_async", static_functions, &StaticFunctions::save_configuration_async_helper),
         make_protocol_function("erase_configuration", static_functions, &StaticFunctions::erase_configuration_helper),
         make_protocol_function("reboot", static_functions, &StaticFunctions::NVIC_SystemReset_helper),
         make_protocol_function("enter_dfu_mode", static_functions, &StaticFunctions::enter_dfu_mode_helper)
@@ -186,31 +348,99 @@ using tree_type = decltype(make_obj_tree());
 uint8_t tree_buffer[sizeof(tree_type)];
 
 
-// Thread to handle deffered processing of USB interrupt, and
-// read commands out of the UART DMA circular buffer
-void communication_task(void * ctx) {
+// One-shot thread that constructs the endpoint tree and publishes it.
+// The nested make_* calls build the whole aggregate out of function
+// argument temporaries, so the peak stack usage is a multiple of
+// sizeof(tree_type) no matter how the final copy is elided. This thread
+// terminates right after publishing, which returns its stack to the heap.
+static void publish_obj_tree_thread(void * ctx) {
     (void) ctx; // unused parameter
 
-    // TODO: this is supposed to use the move constructor, but currently
-    // the compiler uses the copy-constructor instead. Thus the make_obj_tree
-    // ends up with a stupid stack size of around 8000 bytes. Fix this.
     auto tree_ptr = new (tree_buffer) tree_type(make_obj_tree());
+    fibre_set_us_clock(micros); // for the endpoint handler duration tracker
+    fibre_endpoint_mutex = osMutexCreate(osMutex(fibre_endpoint_mutex_def));
+    fibre_set_endpoint_lock(fibre_endpoint_lock, fibre_endpoint_unlock);
     fibre_publish(*tree_ptr);
+    fibre_set_stable_id_map(stable_endpoint_ids, n_stable_endpoint_ids);
 
     // Allow main init to continue
     endpoint_list_valid = true;
-    
+
+    osThreadTerminate(osThreadGetId());
+}
+
+/* Runtime interface reconfiguration ------------------------------------------
+*
+* enable_uart and enable_i2c_instead_of_can used to require a reboot
+* because the peripheral bring-up only ran once at boot. An endpoint write
+* now merely requests the switch; the comm thread applies it between two
+* service iterations, i.e. when no CAN or I2C servicing is in flight, using
+* the start/stop pairs of the interface modules. The USB and UART servers
+* themselves keep running throughout -- enable_uart is only a pin mux.
+*/
+
+static bool i2c_active_ = false;
+static bool uart_gpio_active_ = false;
+static volatile bool interface_reconfig_pending_ = false;
+
+static void request_interface_reconfig(void) {
+    interface_reconfig_pending_ = true;
+    osSemaphoreRelease(sem_telemetry); // wake the comm thread promptly
+}
+
+static void apply_interface_config(void) {
+#if HW_VERSION_MAJOR == 3 && HW_VERSION_MINOR >= 3
+    if (board_config.enable_i2c_instead_of_can != i2c_active_) {
+        if (i2c_active_) {
+            stop_i2c_server();
+            MX_CAN1_Init();
+            start_can_server(can1_ctx, CAN1, serial_number);
+        } else {
+            stop_can_server(can1_ctx);
+            init_i2c_auto_addr();
+            start_i2c_server();
+        }
+        i2c_active_ = board_config.enable_i2c_instead_of_can;
+    }
+    if (board_config.enable_uart != uart_gpio_active_) {
+        if (board_config.enable_uart)
+            SetGPIO12toUART();
+        else
+            SetGPIO12toGPIO();
+        uart_gpio_active_ = board_config.enable_uart;
+    }
+#endif
+}
+
+// Thread to handle deffered processing of USB interrupt, and
+// read commands out of the UART DMA circular buffer
+void communication_task(void * ctx) {
+    (void) ctx; // unused parameter
+
     start_uart_server();
     start_usb_server();
-    if (board_config.enable_i2c_instead_of_can) {
+    i2c_active_ = board_config.enable_i2c_instead_of_can;
+    uart_gpio_active_ = board_config.enable_uart;
+    if (i2c_active_) {
         start_i2c_server();
     } else {
-        // TODO: finish implementing CAN
-        // start_can_server(can1_ctx, CAN1, serial_number);
+        start_can_server(can1_ctx, CAN1, serial_number);
     }
 
     for (;;) {
-        osDelay(1000); // nothing to do
+        // Sleep until the sampling interrupt queues telemetry frames.
+        // With I2C active, wake every tick to keep the register file
+        // shadow fresh at its configured rate.
+        osSemaphoreWait(sem_telemetry, i2c_active_ ? 1 : 1000);
+        if (interface_reconfig_pending_) {
+            interface_reconfig_pending_ = false;
+            apply_interface_config();
+        }
+        telemetry_.poll();
+        if (i2c_active_) {
+            i2c_registers_.refresh();
+            i2c_registers_.poll_writes();
+        }
     }
 }
 
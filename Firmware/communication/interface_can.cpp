@@ -25,23 +25,117 @@
 * d) At a given point in time, a node MUST NOT send any regular message with
 *   a node ID that is not self-assigned.
 *
+* Regular messages
+* ----------------
+*
+* Regular messages use StdId = (node_id << 4) | cmd where cmd is
+* (axis << 3) | opcode. Since heartbeats occupy 0x700..0x77f, node IDs
+* that would map regular messages into that range (>= 0x70) are never
+* self-assigned.
+*
+* Command frames (host -> drive), decoded directly in the RX interrupt:
+*   opcode 0: set position setpoint; f32 pos [counts],
+*             i16 vel_ff [0.1 counts/s], i16 current_ff [0.01 A]
+*   opcode 1: set velocity setpoint; f32 vel [counts/s], f32 current_ff [A]
+*   opcode 2: set current setpoint; f32 current [A]
+*   opcode 3: buffered position setpoint; payload as opcode 0, but held
+*             back until the next SYNC frame
+*   opcode 6: buffered velocity setpoint; payload as opcode 1, held back
+*             until the next SYNC frame
+*
+* Cyclic feedback frames (drive -> host), rates set in config:
+*   opcode 4: encoder feedback; f32 pos_estimate, f32 vel_estimate
+*   opcode 5: current feedback; f32 Iq_setpoint, f32 Iq_measured
+*
+* Opcode 7 is the in-application firmware update protocol; the frame
+* format lives in fw_update.cpp. The RX interrupt only buffers the
+* payload, the flash work runs on the server thread, and status frames
+* go back out on the same opcode.
+*
+* StdId 0x000 is the broadcast SYNC frame (highest bus priority, no
+* payload). CANopen-style: every node latches its buffered setpoints into
+* the controllers upon receipt, so all axes on the bus step in the same
+* control period regardless of when their command frames arrived.
+*
+* StdId 0x001 is the broadcast TIME frame (u32 master time [us]) of the
+* distributed clock; every node disciplines its local clock and PWM phase
+* to it (see clock_sync.cpp).
+*
+* StdId 0x002 is the broadcast WATCHDOG FEED frame (no payload): a
+* board-level host heartbeat that feeds every axis watchdog on every
+* armed node (config.enable_watchdog_feed_can), so a supervisory host
+* pays one frame per period for the whole bus instead of one command per
+* axis.
+*
 * Hardware allocation
 * -------------------
-*   RX FIFO0:
-*       - filter bank 0: heartbeat messages
+* Each message class has its own 16-bit hardware filter, so frames that
+* are not for us never raise an interrupt and the RX handlers dispatch on
+* the filter match index without parsing IDs in software:
+*
+*   RX FIFO0 (filter bank 0):
+*       - match index 0: any other heartbeat
+*       - match index 1: heartbeat with our own node ID (a collision)
+*   RX FIFO1 (filter bank 1):
+*       - match index 0: the broadcast SYNC frame
+*       - match index 1: command frames addressed to this node
+*   RX FIFO1 (filter bank 2):
+*       - match index 2: the broadcast WATCHDOG FEED frame
+*       - match index 3: the broadcast TIME frame
+*
+* Within each bank the Low half of the Id/Mask registers is the
+* lower-numbered filter (it maps to FR1). The mapping from layout to
+* match index can be asserted on real hardware with can.test_loopback.
+*
+* The filters also pin RTR = 0 and IDE = 0, so remote and extended frames
+* are rejected in hardware as well.
 */
 
 #include "interface_can.hpp"
 #include "fibre/crc.hpp"
 #include "utils.h"
+#include "odrive_main.h"
+#include "fw_update.hpp"
+#include "clock_sync.hpp"
 
 #include <can.h>
 #include <stm32f4xx_hal.h>
 #include <cmsis_os.h>
+#include <freertos_vars.h>
 
 #define CAN_HEARTBEAT_INTERVAL  1000 // [ms]
 #define CAN_HEARTBEAT_MARGIN    10 // maximum time that a heartbeat message can be delayed until we stop sending other messages [ms]
 
+// broadcast frame that latches buffered setpoints on all nodes
+#define CAN_SYNC_ID                     0x000
+// broadcast frame carrying the distributed clock (see clock_sync.cpp)
+#define CAN_TIME_ID                     0x001
+// broadcast frame that feeds all axis watchdogs (board-level host heartbeat)
+#define CAN_FEED_WATCHDOGS_ID           0x002
+
+// Filter match indices, determined by the filter layout (see the hardware
+// allocation comment above). The match index counts the filters routed to
+// a FIFO in bank order; within a dual 16-bit bank the Low half (FR1) is
+// the lower-numbered filter, the High half (FR2) the higher one (RM0090
+// identifier filtering; the HAL writes FilterIdLow/FilterMaskIdLow into
+// FR1). test_loopback verifies this mapping against the real hardware.
+#define CAN_MATCH_ANY_HEARTBEAT         0 // FIFO0 (bank 0, Low)
+#define CAN_MATCH_OWN_HEARTBEAT         1 // FIFO0 (bank 0, High)
+#define CAN_MATCH_SYNC                  0 // FIFO1 (bank 1, Low)
+#define CAN_MATCH_COMMAND               1 // FIFO1 (bank 1, High)
+#define CAN_MATCH_FEED_WATCHDOGS        2 // FIFO1 (bank 2, Low)
+#define CAN_MATCH_TIME                  3 // FIFO1 (bank 2, High)
+
+// opcodes of regular messages (lower 3 bits of cmd; bit 3 selects the axis)
+#define CAN_CMD_SET_POS_SETPOINT        0x0
+#define CAN_CMD_SET_VEL_SETPOINT        0x1
+#define CAN_CMD_SET_CURRENT_SETPOINT    0x2
+#define CAN_CMD_SET_POS_SETPOINT_BUF    0x3 // applied on SYNC
+#define CAN_MSG_ENCODER_FEEDBACK        0x4
+#define CAN_MSG_CURRENT_FEEDBACK        0x5
+#define CAN_CMD_SET_VEL_SETPOINT_BUF    0x6 // applied on SYNC
+#define CAN_CMD_FW_UPDATE               0x7 // see fw_update.cpp
+
 // defined in can.c
 extern CAN_HandleTypeDef hcan1;
 extern CAN_HandleTypeDef hcan2;
@@ -70,10 +164,62 @@ void consider_node_id_in_use(CAN_context* ctx, uint8_t node_id) {
 bool is_node_id_in_use(CAN_context* ctx, uint32_t node_id) {
     if (node_id == 0) // node ID 0 is reserved (is it though?)
         return true;
+    if (node_id >= 0x70) // regular messages of these nodes would collide with the heartbeat ID range
+        return true;
     return (ctx->node_ids_in_use_0[node_id >> 5] & (1 << (node_id & 0x1f)))
         || (ctx->node_ids_in_use_1[node_id >> 5] & (1 << (node_id & 0x1f)));
 }
 
+// Configures the node-ID dependent RX filters: bank 0 routes heartbeats
+// into FIFO0 (own node ID in the High half so a collision gets its own
+// match index), bank 1 routes command frames addressed to this node and
+// the broadcast SYNC frame into FIFO1. Must be called again whenever the
+// node ID changes. This only touches the filter registers, so it's safe
+// in interrupt context.
+static bool config_node_id_filters(CAN_context* ctx) {
+    CAN_FilterTypeDef heartbeat_filter = {
+        .FilterIdHigh = (uint16_t)(((0x700u + ctx->node_id) << 5) | (0x0 << 2)), // own heartbeat (standard ID, no RTR)
+        .FilterIdLow = (0x700u << 5) | (0x0 << 2), // any heartbeat (standard ID, no RTR)
+        .FilterMaskIdHigh = (0x7ffu << 5) | (0x3 << 2),
+        .FilterMaskIdLow = (0x780u << 5) | (0x3 << 2),
+        .FilterFIFOAssignment = CAN_RX_FIFO0,
+        .FilterBank = 0,
+        .FilterMode = CAN_FILTERMODE_IDMASK,
+        .FilterScale = CAN_FILTERSCALE_16BIT, // two 16-bit filters
+        .FilterActivation = ENABLE,
+        .SlaveStartFilterBank = 0
+    };
+    if (HAL_CAN_ConfigFilter(ctx->handle, &heartbeat_filter) != HAL_OK)
+        return false;
+    CAN_FilterTypeDef command_filter = {
+        .FilterIdHigh = (uint16_t)(((ctx->node_id << 4) << 5) | (0x0 << 2)), // own command frames (standard ID, no RTR)
+        .FilterIdLow = (CAN_SYNC_ID << 5) | (0x0 << 2), // SYNC frame (standard ID, no RTR)
+        .FilterMaskIdHigh = (0x7f0u << 5) | (0x3 << 2),
+        .FilterMaskIdLow = (0x7ffu << 5) | (0x3 << 2),
+        .FilterFIFOAssignment = CAN_RX_FIFO1,
+        .FilterBank = 1,
+        .FilterMode = CAN_FILTERMODE_IDMASK,
+        .FilterScale = CAN_FILTERSCALE_16BIT, // two 16-bit filters
+        .FilterActivation = ENABLE,
+        .SlaveStartFilterBank = 0
+    };
+    if (HAL_CAN_ConfigFilter(ctx->handle, &command_filter) != HAL_OK)
+        return false;
+    CAN_FilterTypeDef time_filter = {
+        .FilterIdHigh = (CAN_TIME_ID << 5) | (0x0 << 2), // TIME frame (standard ID, no RTR)
+        .FilterIdLow = (CAN_FEED_WATCHDOGS_ID << 5) | (0x0 << 2), // WATCHDOG FEED frame (standard ID, no RTR)
+        .FilterMaskIdHigh = (0x7ffu << 5) | (0x3 << 2),
+        .FilterMaskIdLow = (0x7ffu << 5) | (0x3 << 2),
+        .FilterFIFOAssignment = CAN_RX_FIFO1,
+        .FilterBank = 2,
+        .FilterMode = CAN_FILTERMODE_IDMASK,
+        .FilterScale = CAN_FILTERSCALE_16BIT, // two 16-bit filters
+        .FilterActivation = ENABLE,
+        .SlaveStartFilterBank = 0
+    };
+    return HAL_CAN_ConfigFilter(ctx->handle, &time_filter) == HAL_OK;
+}
+
 bool select_another_node_id(CAN_context* ctx) {
     ctx->node_id_expiry = osKernelSysTick() - 1;
 
@@ -85,52 +231,196 @@ bool select_another_node_id(CAN_context* ctx) {
         if (++(ctx->node_id_rng_state) >= sizeof(ctx->serial_number))
             ctx->node_id_rng_state = 0;
         ctx->node_id = calc_crc<uint8_t, 1>(ctx->node_id, poor_mans_random_byte);
-        if (!is_node_id_in_use(ctx, ctx->node_id))
+        if (!is_node_id_in_use(ctx, ctx->node_id)) {
+            config_node_id_filters(ctx); // track the new node ID
             return true;
+        }
     }
     return false;
 }
 
+// Applies the configured bit timing. Presets assume the 42MHz APB1 clock
+// and use 12 time quanta per bit (1 + 6 + 5, like the CubeMX 500k
+// default); 1M needs 14 quanta (1 + 11 + 2) to divide evenly. An unknown
+// baud_rate falls back to 500k so a corrupt config can't take the bus
+// down. If custom_btr is set it is written into CAN_BTR verbatim after
+// the re-init, for timings outside the preset table.
+static bool config_bit_timing(CAN_HandleTypeDef* handle) {
+    uint32_t prescaler;
+    uint32_t bs1 = CAN_BS1_6TQ;
+    uint32_t bs2 = CAN_BS2_5TQ;
+    switch (can_config.baud_rate) {
+        case 125000: prescaler = 28; break;
+        case 250000: prescaler = 14; break;
+        case 1000000: prescaler = 3; bs1 = CAN_BS1_11TQ; bs2 = CAN_BS2_2TQ; break;
+        case 500000:
+        default: prescaler = 7; break;
+    }
+    handle->Init.Prescaler = prescaler;
+    handle->Init.TimeSeg1 = bs1;
+    handle->Init.TimeSeg2 = bs2;
+    if (HAL_CAN_Init(handle) != HAL_OK)
+        return false;
+    if (can_config.custom_btr) {
+        // HAL_CAN_Init left initialization mode, so re-enter it to write
+        // the timing register directly
+        uint32_t tickstart = HAL_GetTick();
+        SET_BIT(handle->Instance->MCR, CAN_MCR_INRQ);
+        while ((handle->Instance->MSR & CAN_MSR_INAK) == 0U)
+            if (HAL_GetTick() - tickstart > 10)
+                return false;
+        handle->Instance->BTR = can_config.custom_btr;
+        CLEAR_BIT(handle->Instance->MCR, CAN_MCR_INRQ);
+        while ((handle->Instance->MSR & CAN_MSR_INAK) != 0U)
+            if (HAL_GetTick() - tickstart > 10)
+                return false;
+    }
+    return true;
+}
+
+// Writes a regular message directly into a free hardware TX mailbox.
+// Returns false (and counts the drop) if all three mailboxes are busy.
+static bool send_regular_message(CAN_context* ctx, uint8_t cmd, const uint8_t data[8]) {
+    CAN_TxHeaderTypeDef header = {
+        .StdId = (uint32_t)((ctx->node_id << 4) | cmd),
+        .ExtId = 0,
+        .IDE = CAN_ID_STD,
+        .RTR = CAN_RTR_DATA,
+        .DLC = 8,
+        .TransmitGlobalTime = DISABLE
+    };
+    uint32_t mailbox;
+    if (HAL_CAN_AddTxMessage(ctx->handle, &header, const_cast<uint8_t*>(data), &mailbox) != HAL_OK) {
+        ctx->mailbox_full_drop_cnt++;
+        return false;
+    }
+    ctx->feedback_msg_cnt++;
+    return true;
+}
+
 
 void server_thread(CAN_context* ctx) {
-    uint32_t next_1s_tick = osKernelSysTick() + 1000;
+    uint32_t next_heartbeat_tick = osKernelSysTick();
+    uint32_t next_encoder_tick[AXIS_COUNT];
+    uint32_t next_current_tick[AXIS_COUNT];
+    for (size_t i = 0; i < AXIS_COUNT; ++i)
+        next_encoder_tick[i] = next_current_tick[i] = osKernelSysTick();
+
     for (;;) {
-        if (deadline_to_timeout(next_1s_tick) == 0)
-            
-        // wait until either the next heartbeat is due or a hearbeat was requested
-        // by releasing the semaphore
-        osSemaphoreWait(ctx->sem_send_heartbeat, deadline_to_timeout(next_1s_tick));
-        if (!is_in_the_future(next_1s_tick))
-            memcpy(ctx->node_ids_in_use_1, ctx->node_ids_in_use_0, sizeof(ctx->node_ids_in_use_1));
-        next_1s_tick += 1000;
-        if (!is_in_the_future(next_1s_tick))
-            next_1s_tick = osKernelSysTick(); // fast-forward if we missed several 1 second ticks
-
-        if (is_node_id_in_use(ctx, ctx->node_id)) {
-            if (!select_another_node_id(ctx))
-                continue;
-            else
-                next_1s_tick += ctx->node_id; // shift the 1s tick by a bit
+        // Shutdown handshake (see stop_can_server): quiesce the peripheral
+        // from the thread that owns it, then let the stopper observe the
+        // cleared thread_id before it deinits the peripheral.
+        if (ctx->quit_requested) {
+            HAL_CAN_DeactivateNotification(ctx->handle,
+                CAN_IT_TX_MAILBOX_EMPTY |
+                CAN_IT_RX_FIFO0_MSG_PENDING | CAN_IT_RX_FIFO1_MSG_PENDING |
+                CAN_IT_RX_FIFO0_FULL | CAN_IT_RX_FIFO1_FULL |
+                CAN_IT_RX_FIFO0_OVERRUN | CAN_IT_RX_FIFO1_OVERRUN |
+                CAN_IT_WAKEUP | CAN_IT_SLEEP_ACK |
+                CAN_IT_ERROR_WARNING | CAN_IT_ERROR_PASSIVE |
+                CAN_IT_BUSOFF | CAN_IT_LAST_ERROR_CODE |
+                CAN_IT_ERROR);
+            HAL_CAN_Stop(ctx->handle);
+            ctx->thread_id = nullptr;
+            osThreadTerminate(osThreadGetId());
         }
 
-        uint8_t data[8];
-        //uint8_t data[] = { ctx->node_id }; // this would be the correct data for CANopen - TODO: make it compatible
-        *(uint64_t*)data = ctx->serial_number;
-
-        CAN_TxHeaderTypeDef header = {
-            .StdId = 0x700u + ctx->node_id,
-            .ExtId = 0,
-            .IDE = CAN_ID_STD,
-            .RTR = CAN_RTR_DATA,
-            .DLC = sizeof(data),
-            .TransmitGlobalTime = DISABLE
-        };
-        HAL_CAN_AddTxMessage(ctx->handle, &header, data, &ctx->last_heartbeat_mailbox);
+        // wait until either the next scheduled frame is due or a heartbeat
+        // was requested by releasing the semaphore
+        uint32_t timeout = deadline_to_timeout(next_heartbeat_tick);
+        for (size_t i = 0; i < AXIS_COUNT; ++i) {
+            if (can_config.encoder_feedback_rate_ms[i] && deadline_to_timeout(next_encoder_tick[i]) < timeout)
+                timeout = deadline_to_timeout(next_encoder_tick[i]);
+            if (can_config.current_feedback_rate_ms[i] && deadline_to_timeout(next_current_tick[i]) < timeout)
+                timeout = deadline_to_timeout(next_current_tick[i]);
+        }
+        if (fw_update_active() && timeout > 1)
+            timeout = 1; // poll quickly so flash rows are programmed without stalling the transfer
+        bool heartbeat_requested = osSemaphoreWait(ctx->sem_send_heartbeat, timeout) == osOK;
+
+        // refresh the REC/TEC telemetry from the error status register
+        uint32_t esr = ctx->handle->Instance->ESR;
+        ctx->tx_error_counter = (esr & CAN_ESR_TEC) >> CAN_ESR_TEC_Pos;
+        ctx->rx_error_counter = (esr & CAN_ESR_REC) >> CAN_ESR_REC_Pos;
+
+        if (heartbeat_requested || !is_in_the_future(next_heartbeat_tick)) {
+            if (!is_in_the_future(next_heartbeat_tick)) {
+                memcpy(ctx->node_ids_in_use_1, ctx->node_ids_in_use_0, sizeof(ctx->node_ids_in_use_1));
+                next_heartbeat_tick += CAN_HEARTBEAT_INTERVAL;
+                if (!is_in_the_future(next_heartbeat_tick))
+                    next_heartbeat_tick = osKernelSysTick(); // fast-forward if we missed several heartbeat ticks
+            }
+
+            bool node_id_valid = true;
+            if (is_node_id_in_use(ctx, ctx->node_id)) {
+                node_id_valid = select_another_node_id(ctx);
+                if (node_id_valid)
+                    next_heartbeat_tick += ctx->node_id; // shift the heartbeat tick by a bit
+            }
+
+            if (node_id_valid) {
+                uint8_t data[8];
+                //uint8_t data[] = { ctx->node_id }; // this would be the correct data for CANopen - TODO: make it compatible
+                *(uint64_t*)data = ctx->serial_number;
+
+                CAN_TxHeaderTypeDef header = {
+                    .StdId = 0x700u + ctx->node_id,
+                    .ExtId = 0,
+                    .IDE = CAN_ID_STD,
+                    .RTR = CAN_RTR_DATA,
+                    .DLC = sizeof(data),
+                    .TransmitGlobalTime = DISABLE
+                };
+                HAL_CAN_AddTxMessage(ctx->handle, &header, data, &ctx->last_heartbeat_mailbox);
+            }
+        }
+
+        // Cyclic feedback frames. Rule (d): regular messages may only be
+        // sent while the node ID is backed by a recently ACK'd heartbeat.
+        if (!is_in_the_future(ctx->node_id_expiry))
+            continue;
+
+        // Firmware update flash work (erase/program/verify) and status reply
+        uint8_t dfu_status[8];
+        if (fw_update_poll(dfu_status))
+            send_regular_message(ctx, CAN_CMD_FW_UPDATE, dfu_status);
+        for (size_t i = 0; i < AXIS_COUNT; ++i) {
+            uint32_t rate = can_config.encoder_feedback_rate_ms[i];
+            if (rate && !is_in_the_future(next_encoder_tick[i])) {
+                uint8_t data[8];
+                // serve from the telemetry mirror so pos and vel come from
+                // the same control cycle (see Axis::update_telemetry_mirror)
+                Axis::Telemetry_t telemetry = axes[i]->read_telemetry();
+                write_le<float>(telemetry.pos_estimate, &data[0]);
+                write_le<float>(telemetry.vel_estimate, &data[4]);
+                send_regular_message(ctx, (i << 3) | CAN_MSG_ENCODER_FEEDBACK, data);
+                next_encoder_tick[i] += rate;
+                if (!is_in_the_future(next_encoder_tick[i]))
+                    next_encoder_tick[i] = osKernelSysTick() + rate;
+            }
+            rate = can_config.current_feedback_rate_ms[i];
+            if (rate && !is_in_the_future(next_current_tick[i])) {
+                uint8_t data[8];
+                Axis::Telemetry_t telemetry = axes[i]->read_telemetry();
+                write_le<float>(telemetry.Iq_setpoint, &data[0]);
+                write_le<float>(telemetry.Iq_measured, &data[4]);
+                send_regular_message(ctx, (i << 3) | CAN_MSG_CURRENT_FEEDBACK, data);
+                next_current_tick[i] += rate;
+                if (!is_in_the_future(next_current_tick[i]))
+                    next_current_tick[i] = osKernelSysTick() + rate;
+            }
+        }
     }
 }
 
+static void server_thread_wrapper(void * ctx) {
+    server_thread((CAN_context*)ctx);
+}
+
 bool start_can_server(CAN_context& ctx, CAN_TypeDef *port, uint64_t serial_number) {
     //MX_CAN1_Init(); // TODO: flatten
+    if (ctx.thread_id)
+        return true; // already running
 #if defined(CAN1)
     if (port == CAN1) ctx.handle = &hcan1, ctxs[0] = &ctx; else
 #endif
@@ -147,25 +437,20 @@ bool start_can_server(CAN_context& ctx, CAN_TypeDef *port, uint64_t serial_numbe
 
     ctx.node_id = calc_crc<uint8_t, 1>(0, (const uint8_t*)UID_BASE, 12);
     ctx.serial_number = serial_number;
-    osSemaphoreDef(sem_send_heartbeat);
-    ctx.sem_send_heartbeat = osSemaphoreCreate(osSemaphore(sem_send_heartbeat), 1);
+    ctx.quit_requested = false;
+    if (!ctx.sem_send_heartbeat) { // keep the semaphore across restarts
+        osSemaphoreDefStatic(sem_send_heartbeat);
+        ctx.sem_send_heartbeat = osSemaphoreCreate(osSemaphore(sem_send_heartbeat), 1);
+    }
     osSemaphoreWait(ctx.sem_send_heartbeat, 0);
 
-    //// Set up heartbeat filter
-    CAN_FilterTypeDef sFilterConfig = {
-        .FilterIdHigh = ((0x700u + ctx.node_id) << 5) | (0x0 << 2), // own heartbeat (standard ID, no RTR)
-        .FilterIdLow = (0x700u << 5) | (0x0 << 2), // any heartbeat (standard ID, no RTR)
-        .FilterMaskIdHigh = (0x7ffu << 5) | (0x3 << 2),
-        .FilterMaskIdLow = (0x780u << 5) | (0x3 << 2),
-        .FilterFIFOAssignment = CAN_RX_FIFO0,
-        .FilterBank = 0,
-        .FilterMode = CAN_FILTERMODE_IDMASK,
-        .FilterScale = CAN_FILTERSCALE_16BIT, // two 16-bit filters
-        .FilterActivation = ENABLE,
-        .SlaveStartFilterBank = 0
-    };
-    status = HAL_CAN_ConfigFilter(ctx.handle, &sFilterConfig);
-    if (status != HAL_OK)
+    // Re-init with the configured bit timing (the CubeMX init ran with the
+    // 500k default)
+    if (!config_bit_timing(ctx.handle))
+        return false;
+
+    // Set up the RX filters (heartbeats into FIFO0, commands + SYNC into FIFO1)
+    if (!config_node_id_filters(&ctx))
         return false;
 
     status = HAL_CAN_Start(ctx.handle);
@@ -183,9 +468,27 @@ bool start_can_server(CAN_context& ctx, CAN_TypeDef *port, uint64_t serial_numbe
         CAN_IT_ERROR);
     if (status != HAL_OK)
         return false;
-    
-    server_thread(&ctx);
-    return true;
+
+    // Start CAN server thread (heartbeats and cyclic feedback frames).
+    // Heap-allocated even in the static allocation build: the thread is
+    // recreated on every CAN restart (see freertos_vars.h for the rule).
+    osThreadDef(can_server_thread_def, server_thread_wrapper, osPriorityNormal, 0, 512);
+    ctx.thread_id = osThreadCreate(osThread(can_server_thread_def), &ctx);
+    return ctx.thread_id != nullptr;
+}
+
+// @brief Counterpart of start_can_server for runtime interface
+// reconfiguration. Asks the server thread to quiesce the peripheral and
+// exit (it owns the CAN handle), waits for it, then releases the pins and
+// interrupts so another interface can claim them. Idempotent.
+void stop_can_server(CAN_context& ctx) {
+    if (!ctx.thread_id)
+        return;
+    ctx.quit_requested = true;
+    osSemaphoreRelease(ctx.sem_send_heartbeat); // wake the server thread
+    while (ctx.thread_id)
+        osDelay(1);
+    HAL_CAN_DeInit(ctx.handle);
 }
 
 void tx_complete_callback(CAN_HandleTypeDef *hcan, uint8_t mailbox_idx) {
@@ -237,22 +540,273 @@ void HAL_CAN_RxFifo0MsgPendingCallback(CAN_HandleTypeDef *hcan) {
         return;
     }
 
-    uint8_t node_id = header.StdId & 0x07fu;
-    if ((header.StdId & 0x780u) == 0x700u) {
-        ctx->received_ack++;
-        consider_node_id_in_use(ctx, node_id);
-    } else {
-        ctx->unhandled_messages++;
+    // Only the two heartbeat filters feed FIFO0, so the ID range check
+    // already happened in hardware. Match index 1 (a heartbeat carrying
+    // our own node ID) needs no special treatment: marking the ID as taken
+    // makes the next heartbeat tick move us off it.
+    switch (header.FilterMatchIndex) {
+        case CAN_MATCH_OWN_HEARTBEAT:
+        case CAN_MATCH_ANY_HEARTBEAT:
+            ctx->received_ack++;
+            consider_node_id_in_use(ctx, header.StdId & 0x07fu);
+            break;
+        default:
+            ctx->unhandled_messages++;
+            break;
     }
 }
 
 void HAL_CAN_RxFifo0FullCallback(CAN_HandleTypeDef *hcan) { if (get_can_ctx(hcan)) get_can_ctx(hcan)->RxFifo0FullCallbackCnt++; }
 
-void HAL_CAN_RxFifo1MsgPendingCallback(CAN_HandleTypeDef *hcan) { if (get_can_ctx(hcan)) get_can_ctx(hcan)->RxFifo1MsgPendingCallbackCnt++; }
+// Latches buffered setpoints into the controllers. Runs in the RX FIFO1
+// interrupt on receipt of a SYNC frame, so every node on the bus applies
+// its setpoints within the same control period.
+static void handle_sync_frame(CAN_context *ctx) {
+    ctx->sync_msg_cnt++;
+    for (size_t i = 0; i < AXIS_COUNT; ++i) {
+        CAN_context::PendingSetpoint_t* pending = &ctx->pending_setpoints[i];
+        switch (pending->mode) {
+            case CAN_context::SETPOINT_POSITION:
+                axes[i]->controller_.set_pos_setpoint(pending->value, pending->vel_ff, pending->current_ff);
+                axes[i]->watchdog_feed();
+                break;
+            case CAN_context::SETPOINT_VELOCITY:
+                axes[i]->controller_.set_vel_setpoint(pending->value, pending->current_ff);
+                axes[i]->watchdog_feed();
+                break;
+            default:
+                break;
+        }
+        pending->mode = CAN_context::SETPOINT_NONE;
+    }
+}
+
+// Decodes a setpoint command frame. This runs directly in the RX interrupt
+// so a command reaches the controller within the frame's own interrupt
+// instead of waiting for a thread to be scheduled. The controller setters
+// only store floats and a mode, so they are safe to call from here.
+static void handle_command_frame(CAN_context *ctx, CAN_RxHeaderTypeDef *header, const uint8_t *data) {
+    // A frame only reaches FIFO1 through the SYNC filter or the
+    // own-command filter (both pin RTR = 0), so dispatching on the filter
+    // match index replaces the node ID and RTR checks in software.
+    if (header->FilterMatchIndex == CAN_MATCH_SYNC) {
+        handle_sync_frame(ctx);
+        return;
+    }
+    if (header->FilterMatchIndex == CAN_MATCH_TIME) {
+        if (header->DLC >= 4) {
+            uint32_t master_time_us;
+            read_le(&master_time_us, &data[0]);
+            clock_sync_handle_time_frame(master_time_us);
+        }
+        return;
+    }
+    if (header->FilterMatchIndex == CAN_MATCH_FEED_WATCHDOGS) {
+        // Board-level host heartbeat: one broadcast frame feeds every
+        // axis watchdog. watchdog_feed only stores a word, so this is
+        // safe from the RX interrupt.
+        if (board_config.enable_watchdog_feed_can) {
+            feed_all_watchdogs();
+            ctx->command_msg_cnt++;
+        }
+        return;
+    }
+    if (header->FilterMatchIndex != CAN_MATCH_COMMAND) {
+        ctx->unhandled_messages++;
+        return;
+    }
+    uint8_t cmd = header->StdId & 0xf;
+    size_t axis_num = (cmd >> 3) & 0x1;
+    if (axis_num >= AXIS_COUNT) {
+        ctx->unhandled_messages++;
+        return;
+    }
+    Axis* axis = axes[axis_num];
+
+    switch (cmd & 0x7) {
+        case CAN_CMD_SET_POS_SETPOINT: {
+            if (header->DLC != 8)
+                break;
+            float pos_setpoint;
+            int16_t vel_ff, current_ff;
+            read_le(&pos_setpoint, &data[0]);
+            read_le(&vel_ff, &data[4]);
+            read_le(&current_ff, &data[6]);
+            axis->controller_.set_pos_setpoint(pos_setpoint, vel_ff * 0.1f, current_ff * 0.01f);
+            axis->watchdog_feed();
+            ctx->command_msg_cnt++;
+        } return;
+        case CAN_CMD_SET_VEL_SETPOINT: {
+            if (header->DLC != 8)
+                break;
+            float vel_setpoint, current_ff;
+            read_le(&vel_setpoint, &data[0]);
+            read_le(&current_ff, &data[4]);
+            axis->controller_.set_vel_setpoint(vel_setpoint, current_ff);
+            axis->watchdog_feed();
+            ctx->command_msg_cnt++;
+        } return;
+        case CAN_CMD_SET_CURRENT_SETPOINT: {
+            if (header->DLC < 4)
+                break;
+            float current_setpoint;
+            read_le(&current_setpoint, &data[0]);
+            axis->controller_.set_current_setpoint(current_setpoint);
+            axis->watchdog_feed();
+            ctx->command_msg_cnt++;
+        } return;
+        case CAN_CMD_SET_POS_SETPOINT_BUF: {
+            if (header->DLC != 8)
+                break;
+            int16_t vel_ff, current_ff;
+            CAN_context::PendingSetpoint_t* pending = &ctx->pending_setpoints[axis_num];
+            read_le(&pending->value, &data[0]);
+            read_le(&vel_ff, &data[4]);
+            read_le(&current_ff, &data[6]);
+            pending->vel_ff = vel_ff * 0.1f;
+            pending->current_ff = current_ff * 0.01f;
+            pending->mode = CAN_context::SETPOINT_POSITION;
+            ctx->command_msg_cnt++;
+        } return;
+        case CAN_CMD_SET_VEL_SETPOINT_BUF: {
+            if (header->DLC != 8)
+                break;
+            CAN_context::PendingSetpoint_t* pending = &ctx->pending_setpoints[axis_num];
+            read_le(&pending->value, &data[0]);
+            read_le(&pending->current_ff, &data[4]);
+            pending->mode = CAN_context::SETPOINT_VELOCITY;
+            ctx->command_msg_cnt++;
+        } return;
+        case CAN_CMD_FW_UPDATE: {
+            // RAM work only; the flash operations run on the server thread,
+            // so wake it when an operation was staged (the spurious
+            // heartbeat this causes is harmless)
+            if (fw_update_handle_frame(data, header->DLC))
+                osSemaphoreRelease(ctx->sem_send_heartbeat);
+            ctx->command_msg_cnt++;
+        } return;
+        default:
+            break;
+    }
+    ctx->unhandled_messages++;
+}
+
+void HAL_CAN_RxFifo1MsgPendingCallback(CAN_HandleTypeDef *hcan) {
+    CAN_context *ctx = get_can_ctx(hcan);
+    if (!ctx) return;
+    ctx->RxFifo1MsgPendingCallbackCnt++;
+
+    CAN_RxHeaderTypeDef header;
+    uint8_t data[8];
+    if (HAL_CAN_GetRxMessage(hcan, CAN_RX_FIFO1, &header, data) != HAL_OK) {
+        ctx->unexpected_errors++;
+        return;
+    }
+    handle_command_frame(ctx, &header, data);
+}
 void HAL_CAN_RxFifo1FullCallback(CAN_HandleTypeDef *hcan) { if (get_can_ctx(hcan)) get_can_ctx(hcan)->RxFifo1FullCallbackCnt++; }
 void HAL_CAN_SleepCallback(CAN_HandleTypeDef *hcan) { if (get_can_ctx(hcan)) get_can_ctx(hcan)->SleepCallbackCnt++; }
 void HAL_CAN_WakeUpFromRxMsgCallback(CAN_HandleTypeDef *hcan) { if (get_can_ctx(hcan)) get_can_ctx(hcan)->WakeUpFromRxMsgCallbackCnt++; }
 
+// @brief Re-inits the peripheral with the given CAN_MODE_*, keeping the
+// filter and notification setup of the normal server configuration.
+static bool reinit_with_mode(CAN_context* ctx, uint32_t mode) {
+    HAL_CAN_Stop(ctx->handle);
+    ctx->handle->Init.Mode = mode;
+    if (HAL_CAN_Init(ctx->handle) != HAL_OK)
+        return false;
+    if (!config_node_id_filters(ctx))
+        return false;
+    if (HAL_CAN_Start(ctx->handle) != HAL_OK)
+        return false;
+    return HAL_CAN_ActivateNotification(ctx->handle,
+        CAN_IT_TX_MAILBOX_EMPTY |
+        CAN_IT_RX_FIFO0_MSG_PENDING | CAN_IT_RX_FIFO1_MSG_PENDING |
+        CAN_IT_RX_FIFO0_FULL | CAN_IT_RX_FIFO1_FULL |
+        CAN_IT_RX_FIFO0_OVERRUN | CAN_IT_RX_FIFO1_OVERRUN |
+        CAN_IT_WAKEUP | CAN_IT_SLEEP_ACK |
+        CAN_IT_ERROR_WARNING | CAN_IT_ERROR_PASSIVE |
+        CAN_IT_BUSOFF | CAN_IT_LAST_ERROR_CODE |
+        CAN_IT_ERROR) == HAL_OK;
+}
+
+// @brief Transmits one frame to ourselves in loopback mode and gives the
+// RX interrupt time to dispatch it (loopback delivery happens as soon as
+// the mailbox drains; an 8-byte frame takes ~250us at 500k).
+static bool send_test_frame(CAN_context* ctx, uint32_t std_id, uint32_t dlc, uint8_t* data) {
+    CAN_TxHeaderTypeDef header = {
+        .StdId = std_id,
+        .ExtId = 0,
+        .IDE = CAN_ID_STD,
+        .RTR = CAN_RTR_DATA,
+        .DLC = dlc,
+        .TransmitGlobalTime = DISABLE
+    };
+    uint32_t mailbox;
+    if (HAL_CAN_AddTxMessage(ctx->handle, &header, data, &mailbox) != HAL_OK)
+        return false;
+    osDelay(2);
+    return true;
+}
+
+// @brief Silent-loopback self-test of the RX dispatch path. Re-inits the
+// peripheral in silent loopback mode (frames loop back internally, the bus
+// sees nothing), sends one frame of each FIFO1 message class to ourselves
+// and checks that each one lands in the handler its CAN_MATCH_* constant
+// claims - the filter-layout-to-match-index mapping is the one link the
+// compiler cannot check. The command check uses a buffered setpoint so the
+// setpoint parser is exercised without writing to a live controller; the
+// pending entry is dropped again before the SYNC check. A heartbeat that
+// happens to loop back during the test marks our own node ID as taken,
+// which at worst causes one ID reselection - harmless while off the bus.
+// Runs on the comm thread; call with the axes idle.
+bool CAN_context::test_loopback() {
+    loopback_test_passed = false;
+    if (!handle || !thread_id)
+        return false;
+
+    if (!reinit_with_mode(this, CAN_MODE_SILENT_LOOPBACK))
+        return false;
+
+    bool pass = true;
+    uint8_t payload[8] = { 0 };
+
+    // Command frame addressed to this node: must dispatch as
+    // CAN_MATCH_COMMAND and reach the setpoint parser
+    pending_setpoints[0].mode = SETPOINT_NONE;
+    uint32_t commands = command_msg_cnt;
+    pass = send_test_frame(this, (uint32_t)(node_id << 4) | CAN_CMD_SET_VEL_SETPOINT_BUF, 8, payload) && pass;
+    pass = pass && (pending_setpoints[0].mode == SETPOINT_VELOCITY)
+                && (command_msg_cnt == commands + 1);
+    pending_setpoints[0].mode = SETPOINT_NONE; // drop the test setpoint
+
+    // SYNC: must dispatch as CAN_MATCH_SYNC (the latch is a no-op with
+    // the pending setpoint dropped)
+    uint32_t syncs = sync_msg_cnt;
+    pass = send_test_frame(this, CAN_SYNC_ID, 0, payload) && pass;
+    pass = pass && (sync_msg_cnt == syncs + 1);
+
+    // TIME: must dispatch as CAN_MATCH_TIME and reach the clock servo.
+    // Carrying our own disciplined time keeps the servo error near zero.
+    uint32_t time_frames = clock_sync_state.time_frame_cnt;
+    write_le<uint32_t>(clock_sync_time_us(), &payload[0]);
+    pass = send_test_frame(this, CAN_TIME_ID, 4, payload) && pass;
+    pass = pass && (clock_sync_state.time_frame_cnt == time_frames + 1);
+
+    // WATCHDOG FEED: only observable while the per-transport enable is on
+    if (board_config.enable_watchdog_feed_can) {
+        commands = command_msg_cnt;
+        pass = send_test_frame(this, CAN_FEED_WATCHDOGS_ID, 0, payload) && pass;
+        pass = pass && (command_msg_cnt == commands + 1);
+    }
+
+    if (!reinit_with_mode(this, CAN_MODE_NORMAL))
+        return false;
+
+    loopback_test_passed = pass;
+    return pass;
+}
+
 void HAL_CAN_ErrorCallback(CAN_HandleTypeDef *hcan) {
     //__asm volatile ("bkpt");
     CAN_context *ctx = get_can_ctx(hcan);
@@ -291,6 +845,11 @@ void HAL_CAN_ErrorCallback(CAN_HandleTypeDef *hcan) {
         hcan->ErrorCode &= ~HAL_CAN_ERROR_TX_TERR2;
     }
 
+    if (hcan->ErrorCode & HAL_CAN_ERROR_BOF) {
+        ctx->bus_off_cnt++;
+        hcan->ErrorCode &= ~HAL_CAN_ERROR_BOF;
+    }
+
     if (hcan->ErrorCode)
         ctx->unexpected_errors++;
 }
@@ -2,13 +2,50 @@
 #define __INTERFACE_CAN_HPP
 
 #include "fibre/protocol.hpp"
+#include "clock_sync.hpp"
 #include <stm32f4xx_hal.h>
 #include <cmsis_os.h>
 
+// Persisted CAN settings (part of the NVM config, see main.cpp). At
+// namespace scope (rather than nested in CAN_context) so the extern below
+// is visible inside make_protocol_definitions.
+struct CANConfig_t {
+    // Cyclic feedback frame periods, 0 = disabled. Indexed by axis.
+    uint32_t encoder_feedback_rate_ms[2] = { 0, 0 };
+    uint32_t current_feedback_rate_ms[2] = { 0, 0 };
+    // Bus bit rate [bps], applied at boot (save and reboot to change).
+    // One of 125000, 250000, 500000, 1000000; anything else falls back
+    // to the 500k default so a corrupt config can't take the bus down.
+    uint32_t baud_rate = 500000;
+    // Raw CAN_BTR register value for bit timings outside the preset
+    // table (sample point tuning); 0 = use baud_rate. Applied verbatim,
+    // so wrong values are your own problem.
+    uint32_t custom_btr = 0;
+};
+extern CANConfig_t can_config;
+
 struct CAN_context {
     CAN_HandleTypeDef *handle = nullptr;
     uint8_t node_id = 0;
     uint64_t serial_number = 0;
+    osThreadId thread_id = nullptr;
+    volatile bool quit_requested = false; //!< see stop_can_server
+
+    enum SetpointMode_t : uint8_t {
+        SETPOINT_NONE = 0,
+        SETPOINT_POSITION,
+        SETPOINT_VELOCITY
+    };
+
+    // Setpoints received as buffered commands, held back until a SYNC
+    // frame latches them into the controller. Indexed by axis. Only
+    // touched from the RX FIFO1 interrupt.
+    struct PendingSetpoint_t {
+        SetpointMode_t mode = SETPOINT_NONE;
+        float value = 0.0f;
+        float vel_ff = 0.0f;
+        float current_ff = 0.0f;
+    } pending_setpoints[2];
 
     uint32_t node_ids_in_use_0[4]; // 128 bits (indicate if a node ID was in use up to 1 second ago)
     uint32_t node_ids_in_use_1[4]; // 128 bits (indicats if a node ID was in use 1-2 seconds ago)
@@ -36,6 +73,21 @@ struct CAN_context {
     uint32_t received_ack = 0;
     uint32_t unexpected_errors = 0;
     uint32_t unhandled_messages = 0;
+    uint32_t command_msg_cnt = 0;
+    uint32_t feedback_msg_cnt = 0;
+    uint32_t mailbox_full_drop_cnt = 0;
+    uint32_t sync_msg_cnt = 0;
+
+    // bus health telemetry: REC/TEC sampled from the error status register
+    // by the server thread, bus-off events counted in the error interrupt
+    uint8_t tx_error_counter = 0;
+    uint8_t rx_error_counter = 0;
+    uint32_t bus_off_cnt = 0;
+
+    // Silent-loopback self-test of the RX filter/dispatch layout (see
+    // interface_can.cpp). Run with the axes idle.
+    bool test_loopback();
+    bool loopback_test_passed = false; // result of the last test_loopback run
 
     auto make_protocol_definitions() {
         return make_protocol_member_list(
@@ -45,11 +97,36 @@ struct CAN_context {
             make_protocol_ro_property("received_msg_cnt", &received_msg_cnt),
             make_protocol_ro_property("received_ack", &received_ack),
             make_protocol_ro_property("unexpected_errors", &unexpected_errors),
-            make_protocol_ro_property("unhandled_messages", &unhandled_messages)
+            make_protocol_ro_property("unhandled_messages", &unhandled_messages),
+            make_protocol_ro_property("command_msg_cnt", &command_msg_cnt),
+            make_protocol_ro_property("feedback_msg_cnt", &feedback_msg_cnt),
+            make_protocol_ro_property("mailbox_full_drop_cnt", &mailbox_full_drop_cnt),
+            make_protocol_ro_property("sync_msg_cnt", &sync_msg_cnt),
+            make_protocol_ro_property("tx_error_counter", &tx_error_counter),
+            make_protocol_ro_property("rx_error_counter", &rx_error_counter),
+            make_protocol_ro_property("bus_off_cnt", &bus_off_cnt),
+            make_protocol_ro_property("loopback_test_passed", &loopback_test_passed),
+            make_protocol_function("test_loopback", *this, &CAN_context::test_loopback),
+            make_protocol_object("config",
+                make_protocol_property("axis0_encoder_rate_ms", &can_config.encoder_feedback_rate_ms[0]),
+                make_protocol_property("axis1_encoder_rate_ms", &can_config.encoder_feedback_rate_ms[1]),
+                make_protocol_property("axis0_current_rate_ms", &can_config.current_feedback_rate_ms[0]),
+                make_protocol_property("axis1_current_rate_ms", &can_config.current_feedback_rate_ms[1]),
+                make_protocol_property("baud_rate", &can_config.baud_rate),
+                make_protocol_property("custom_btr", &can_config.custom_btr)
+            ),
+            make_protocol_object("time_sync",
+                make_protocol_ro_property("locked", &clock_sync_state.locked),
+                make_protocol_ro_property("offset_us", &clock_sync_state.offset_us),
+                make_protocol_ro_property("phase_error_us", &clock_sync_state.phase_error_us),
+                make_protocol_ro_property("period_trim", &clock_sync_state.period_trim),
+                make_protocol_ro_property("time_frame_cnt", &clock_sync_state.time_frame_cnt)
+            )
         );
     }
 };
 
 bool start_can_server(CAN_context& ctx, CAN_TypeDef *hcan, uint64_t serial_number);
+void stop_can_server(CAN_context& ctx);
 
 #endif // __INTERFACE_CAN_HPP
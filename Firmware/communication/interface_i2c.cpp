@@ -3,12 +3,14 @@
 #include "fibre/protocol.hpp"
 
 #include <i2c.h>
+#include <cmsis_os.h>
 
 #define I2C_RX_BUFFER_SIZE 128
 #define I2C_RX_BUFFER_PREAMBLE_SIZE   4
 #define I2C_TX_BUFFER_SIZE 128
 
 I2CStats_t i2c_stats_ = {0};
+I2CRegisterFile i2c_registers_;
 
 static uint8_t i2c_rx_buffer[I2C_RX_BUFFER_PREAMBLE_SIZE + I2C_RX_BUFFER_SIZE];
 static uint8_t i2c_tx_buffer[I2C_TX_BUFFER_SIZE];
@@ -16,32 +18,158 @@ static uint8_t i2c_tx_buffer[I2C_TX_BUFFER_SIZE];
 class I2CSender : public PacketSink {
 public:
     int process_packet(const uint8_t* buffer, size_t length) {
-        if (length >= 2 && (length - 2) <= sizeof(i2c_tx_buffer))
-            memcpy(i2c_tx_buffer, buffer + 2, length - 2);
+        if (length >= 2 && (length - 2) <= target_size_) {
+            memcpy(target_, buffer + 2, length - 2);
+            target_written_ = length - 2;
+        }
         return 0;
     }
+    // @brief Redirects the response of subsequent requests into an
+    // arbitrary buffer (used to render the register file shadow).
+    void redirect(uint8_t* target, size_t size) {
+        target_ = target;
+        target_size_ = size;
+        target_written_ = 0;
+    }
+    void restore() {
+        target_ = i2c_tx_buffer;
+        target_size_ = sizeof(i2c_tx_buffer);
+    }
+    size_t get_last_length() { return target_written_; }
     size_t get_free_space() { return SIZE_MAX; }
+    // process_packet strips the 2-byte sequence number before the copy
+    size_t get_mtu() { return target_size_ + 2; }
+private:
+    uint8_t* target_ = i2c_tx_buffer;
+    size_t target_size_ = sizeof(i2c_tx_buffer);
+    size_t target_written_ = 0;
 } i2c1_packet_output;
 BidirectionalPacketBasedChannel i2c1_channel(i2c1_packet_output);
 
+// @brief Builds the preamble that i2c_handle_packet prepends to incoming
+// transactions, so requests synthesized by the register file take the
+// exact same path through the protocol channel as live ones.
+static size_t make_i2c_request(uint8_t* buffer, uint8_t addr_lo, uint8_t addr_hi,
+                               size_t expected_bytes) {
+    write_le<uint16_t>(0, buffer); // hallucinate seq-no (not needed for I2C)
+    buffer[2] = addr_lo; // endpoint-id = I2C register address
+    buffer[3] = addr_hi | 0x80; // MSB must be 1
+    write_le<uint16_t>(expected_bytes, buffer + 4);
+    return 6;
+}
+
+void I2CRegisterFile::refresh() {
+    uint32_t now = osKernelSysTick();
+    if ((uint32_t)(now - last_refresh_ms_) < config_.refresh_interval_ms)
+        return;
+    last_refresh_ms_ = now;
+
+    // Keep the event interrupt out while we borrow the protocol channel
+    // and rewrite the shadow; the slave stretches SCL in the meantime.
+    HAL_NVIC_DisableIRQ(I2C1_EV_IRQn);
+    for (size_t i = 0; i < NUM_REGS; ++i) {
+        Register_t& reg = shadow_[i];
+        if (!is_endpoint_ref_valid(config_.slots[i]) || !get_endpoint(config_.slots[i])) {
+            reg.valid = false;
+            continue;
+        }
+        uint16_t endpoint_id = config_.slots[i].endpoint_id;
+
+        uint8_t request[6];
+        size_t length = make_i2c_request(request,
+                (uint8_t)endpoint_id, (uint8_t)(endpoint_id >> 8), REG_SIZE);
+
+        i2c1_packet_output.redirect(reg.data, REG_SIZE);
+        i2c1_channel.process_packet(request, length);
+        reg.length = i2c1_packet_output.get_last_length();
+        i2c1_packet_output.restore();
+
+        reg.endpoint_id = endpoint_id & 0x7fff;
+        reg.valid = reg.length > 0;
+    }
+    HAL_NVIC_EnableIRQ(I2C1_EV_IRQn);
+}
+
+void I2CRegisterFile::poll_writes() {
+    Write_t wr;
+    while (write_queue_.pop(&wr)) {
+        uint8_t buffer[6 + MAX_WRITE_SIZE];
+        size_t expected_bytes = (TX_BUF_SIZE - 2) < I2C_TX_BUFFER_SIZE ? (TX_BUF_SIZE - 2) : I2C_TX_BUFFER_SIZE;
+        size_t pos = make_i2c_request(buffer, wr.data[0], wr.data[1], expected_bytes);
+        memcpy(buffer + pos, wr.data + 2, wr.length - 2);
+
+        // The write runs through the normal endpoint deserialization; any
+        // readback response lands in the TX buffer just like it used to.
+        HAL_NVIC_DisableIRQ(I2C1_EV_IRQn);
+        i2c1_channel.process_packet(buffer, pos + (wr.length - 2));
+        HAL_NVIC_EnableIRQ(I2C1_EV_IRQn);
+    }
+}
+
+bool I2CRegisterFile::serve_read(uint16_t reg_addr) {
+    reg_addr &= 0x7fff;
+    for (size_t i = 0; i < NUM_REGS; ++i) {
+        if (shadow_[i].valid && shadow_[i].endpoint_id == reg_addr) {
+            memcpy(i2c_tx_buffer, shadow_[i].data, shadow_[i].length);
+            ++shadow_hit_cnt_;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool I2CRegisterFile::queue_write(const uint8_t* data, size_t length) {
+    if (length > MAX_WRITE_SIZE)
+        return false; // oversized command: the in-interrupt path handles it
+    Write_t wr;
+    wr.length = length;
+    memcpy(wr.data, data, length);
+    if (!write_queue_.push(wr))
+        return false; // queue full: fall back to in-interrupt processing
+    ++deferred_write_cnt_;
+    return true;
+}
+
 void start_i2c_server() {
     // CAN H = SDA
     // CAN L = SCL
     HAL_I2C_EnableListen_IT(&hi2c1);
 }
 
+// @brief Counterpart of start_i2c_server for runtime interface
+// reconfiguration: stops listening and releases the pins and interrupts so
+// the CAN peripheral can claim them. Any transaction in flight is aborted
+// by the deinit; the master sees a NACK. Idempotent.
+void stop_i2c_server() {
+    HAL_I2C_DisableListen_IT(&hi2c1);
+    HAL_I2C_DeInit(&hi2c1);
+}
+
 void i2c_handle_packet(I2C_HandleTypeDef *hi2c) {
     size_t received = sizeof(i2c_rx_buffer) - hi2c->XferCount;
     if (received > I2C_RX_BUFFER_PREAMBLE_SIZE) {
         i2c_stats_.rx_cnt++;
-        
-        write_le<uint16_t>(0, i2c_rx_buffer); // hallucinate seq-no (not needed for I2C)
-        i2c_rx_buffer[2] = i2c_rx_buffer[4]; // endpoint-id = I2C register address
-        i2c_rx_buffer[3] = i2c_rx_buffer[5] | 0x80; // MSB must be 1
-        size_t expected_bytes = (TX_BUF_SIZE - 2) < I2C_TX_BUFFER_SIZE ? (TX_BUF_SIZE - 2) : I2C_TX_BUFFER_SIZE;
-        write_le<uint16_t>(expected_bytes, i2c_rx_buffer + 4); // hallucinate maximum number of expected response bytes
 
-        i2c1_channel.process_packet(i2c_rx_buffer, received);
+        // Fast paths: a poll of a shadowed register is answered from the
+        // pre-rendered response and a register write is deferred to the
+        // communication thread, so neither runs endpoint handlers in
+        // interrupt context. Transactions not covered by the register
+        // file (unshadowed registers, oversized commands, full write
+        // queue) take the original in-interrupt path below.
+        size_t payload_length = received - I2C_RX_BUFFER_PREAMBLE_SIZE;
+        uint16_t reg_addr = (uint16_t)i2c_rx_buffer[4]
+                          | ((uint16_t)i2c_rx_buffer[5] << 8);
+        bool handled = (payload_length <= 2)
+                     ? i2c_registers_.serve_read(reg_addr)
+                     : i2c_registers_.queue_write(
+                            i2c_rx_buffer + I2C_RX_BUFFER_PREAMBLE_SIZE, payload_length);
+
+        if (!handled) {
+            size_t expected_bytes = (TX_BUF_SIZE - 2) < I2C_TX_BUFFER_SIZE ? (TX_BUF_SIZE - 2) : I2C_TX_BUFFER_SIZE;
+            make_i2c_request(i2c_rx_buffer, i2c_rx_buffer[4], i2c_rx_buffer[5], expected_bytes);
+
+            i2c1_channel.process_packet(i2c_rx_buffer, received);
+        }
 
         // reset receive buffer
         hi2c->pBuffPtr = I2C_RX_BUFFER_PREAMBLE_SIZE + i2c_rx_buffer;
@@ -62,7 +190,7 @@ void HAL_I2C_ListenCpltCallback(I2C_HandleTypeDef *hi2c) {
 
 void HAL_I2C_AddrCallback(I2C_HandleTypeDef *hi2c, uint8_t TransferDirection, uint16_t AddrMatchCode) {
     i2c_stats_.addr_match_cnt += 1;
-    
+
     i2c_handle_packet(hi2c);
 
     if (TransferDirection == I2C_DIRECTION_TRANSMIT) {
@@ -2,6 +2,89 @@
 #define __INTERFACE_I2C_HPP
 
 #ifdef __cplusplus
+#include "fibre/protocol.hpp"
+#include <fibre/cpp_utils.hpp>
+
+// @brief Shadow register file for cyclically polled endpoints.
+//
+// PLC masters poll the same few endpoint values at a fixed rate (up to
+// 1kHz per deployment). Running the endpoint handler inside the I2C
+// event interrupt for every poll costs control-loop margin, so the
+// responses for up to NUM_REGS configured endpoints are pre-rendered
+// into this register file by the communication thread at a fixed
+// refresh rate. A poll of a shadowed register is then served with a
+// plain memcpy in the interrupt, and register writes are queued here
+// and executed by the communication thread through the normal endpoint
+// deserialization. Transactions not covered by the shadow fall back to
+// the original in-interrupt path.
+class I2CRegisterFile {
+public:
+    static constexpr size_t NUM_REGS = 8;
+    static constexpr size_t REG_SIZE = 8;  // largest serialized endpoint value
+    static constexpr size_t WRITE_QUEUE_DEPTH = 4;
+    static constexpr size_t MAX_WRITE_SIZE = 2 + REG_SIZE; // register address + value
+
+    struct Config_t {
+        endpoint_ref_t slots[NUM_REGS] = {}; // invalid ref = slot disabled
+        uint32_t refresh_interval_ms = 1;    // matches the fastest PLC poll rate
+    };
+
+    // Re-renders the shadowed responses. Called from the communication
+    // thread; rate limits itself to config_.refresh_interval_ms.
+    void refresh();
+    // Executes deferred register writes in the communication thread.
+    void poll_writes();
+
+    // Called from the I2C event interrupt. serve_read() serves a poll of
+    // a shadowed register from the pre-rendered response, queue_write()
+    // defers a register write to the communication thread. Both return
+    // false if the transaction is not covered and must take the legacy
+    // in-interrupt path.
+    bool serve_read(uint16_t reg_addr);
+    bool queue_write(const uint8_t* data, size_t length);
+
+    Config_t config_;
+    uint32_t shadow_hit_cnt_ = 0;
+    uint32_t deferred_write_cnt_ = 0;
+
+    // Communication protocol definitions
+    auto make_protocol_definitions() {
+        return make_protocol_member_list(
+            make_protocol_ro_property("shadow_hit_cnt", &shadow_hit_cnt_),
+            make_protocol_ro_property("deferred_write_cnt", &deferred_write_cnt_),
+            make_protocol_object("config",
+                make_protocol_property("slot0", &config_.slots[0]),
+                make_protocol_property("slot1", &config_.slots[1]),
+                make_protocol_property("slot2", &config_.slots[2]),
+                make_protocol_property("slot3", &config_.slots[3]),
+                make_protocol_property("slot4", &config_.slots[4]),
+                make_protocol_property("slot5", &config_.slots[5]),
+                make_protocol_property("slot6", &config_.slots[6]),
+                make_protocol_property("slot7", &config_.slots[7]),
+                make_protocol_property("refresh_interval_ms", &config_.refresh_interval_ms)
+            )
+        );
+    }
+
+private:
+    struct Register_t {
+        uint16_t endpoint_id = 0;
+        uint8_t length = 0; // rendered response length in bytes
+        bool valid = false;
+        uint8_t data[REG_SIZE];
+    };
+    struct Write_t {
+        uint8_t length;
+        uint8_t data[MAX_WRITE_SIZE];
+    };
+
+    Register_t shadow_[NUM_REGS];
+    SpscRingBuffer<Write_t, WRITE_QUEUE_DEPTH> write_queue_;
+    uint32_t last_refresh_ms_ = 0;
+};
+
+extern I2CRegisterFile i2c_registers_;
+
 extern "C" {
 #endif
 
@@ -17,6 +100,7 @@ struct I2CStats_t {
 extern I2CStats_t i2c_stats_;
 
 void start_i2c_server(void);
+void stop_i2c_server(void);
 
 #ifdef __cplusplus
 }
@@ -3,42 +3,55 @@
 
 #include "ascii_protocol.hpp"
 
+#include "odrive_main.h"
 #include <MotorControl/utils.h>
 
 #include <fibre/protocol.hpp>
 #include <usart.h>
 #include <cmsis_os.h>
 #include <freertos_vars.h>
+#include <string.h>
 
-#define UART_TX_BUFFER_SIZE 64
+#define UART_TX_RING_SIZE 512 // must be a power of two
 #define UART_RX_BUFFER_SIZE 64
 
-// DMA open loop continous circular buffer
-// 1ms delay periodic, chase DMA ptr around
+// Signal sent to the UART thread when RX data is pending
+#define UART_SIGNAL_RX 0x0001
+// Fallback wakeup period; only relevant for error recovery, the data
+// path is driven by the IDLE line and DMA half/full-transfer interrupts
+#define UART_RX_POLL_INTERVAL_MS 10
+
+// DMA continous circular buffer, drained on RX interrupt signals
 static uint8_t dma_rx_buffer[UART_RX_BUFFER_SIZE];
 static uint32_t dma_last_rcv_idx;
 
+UARTStats_t uart_stats_ = {0};
+static volatile bool rx_event_pending_ = false;
+static uint32_t rx_event_timestamp_ = 0; // DWT cycle count of the oldest unparsed RX event
+
 // FIXME: the stdlib doesn't know about CMSIS threads, so this is just a global variable
 // static thread_local uint32_t deadline_ms = 0;
 
 osThreadId uart_thread;
 
 
+// TX ring buffer with DMA chained from the transfer-complete interrupt.
+// Writers append into the ring and return immediately; the DMA streams
+// contiguous spans of the ring back-to-back so the line never idles
+// between chunks. Writers only block (on sem_uart_dma) when the ring is
+// full, i.e. when more than UART_TX_RING_SIZE bytes are in flight.
 class UART4Sender : public StreamSink {
 public:
     int process_bytes(const uint8_t* buffer, size_t length, size_t* processed_bytes) {
         // Loop to ensure all bytes get sent
         while (length) {
-            size_t chunk = length < UART_TX_BUFFER_SIZE ? length : UART_TX_BUFFER_SIZE;
-            // wait for USB interface to become ready
-            // TODO: implement ring buffer to get a more continuous stream of data
-            // if (osSemaphoreWait(sem_uart_dma, deadline_to_timeout(deadline_ms)) != osOK)
-            if (osSemaphoreWait(sem_uart_dma, PROTOCOL_SERVER_TIMEOUT_MS) != osOK)
-                return -1;
-            // transmit chunk
-            memcpy(tx_buf_, buffer, chunk);
-            if (HAL_UART_Transmit_DMA(&huart4, tx_buf_, chunk) != HAL_OK)
-                return -1;
+            size_t chunk = append(buffer, length);
+            if (chunk == 0) {
+                // Ring full: wait for the DMA to drain some of it
+                if (osSemaphoreWait(sem_uart_dma, PROTOCOL_SERVER_TIMEOUT_MS) != osOK)
+                    return -1;
+                continue;
+            }
             buffer += chunk;
             length -= chunk;
             if (processed_bytes)
@@ -47,9 +60,56 @@ public:
         return 0;
     }
 
-    size_t get_free_space() { return SIZE_MAX; }
+    size_t get_free_space() {
+        return (UART_TX_RING_SIZE - 1) - ((write_index_ - read_index_) & (UART_TX_RING_SIZE - 1));
+    }
+
+    // Called from the DMA transfer-complete interrupt: retire the span
+    // that just went out and immediately chain the next one.
+    void on_tx_complete() {
+        read_index_ = (read_index_ + dma_active_length_) & (UART_TX_RING_SIZE - 1);
+        dma_active_length_ = 0;
+        start_dma();
+        osSemaphoreRelease(sem_uart_dma); // wake a writer blocked on a full ring
+    }
+
 private:
-    uint8_t tx_buf_[UART_TX_BUFFER_SIZE];
+    // Copies as much of the data as currently fits into the ring and kicks
+    // the DMA if it's idle. Returns the number of bytes accepted.
+    size_t append(const uint8_t* buffer, size_t length) {
+        uint32_t mask = cpu_enter_critical();
+        size_t free_space = get_free_space();
+        size_t chunk = length < free_space ? length : free_space;
+        for (size_t i = 0; i < chunk; ++i) {
+            tx_ring_[write_index_] = buffer[i];
+            write_index_ = (write_index_ + 1) & (UART_TX_RING_SIZE - 1);
+        }
+        if (chunk)
+            start_dma();
+        cpu_exit_critical(mask);
+        return chunk;
+    }
+
+    // Starts the DMA on the longest contiguous span of pending data.
+    // Must be called with interrupts masked or from the TX interrupt.
+    void start_dma() {
+        if (dma_active_length_ != 0)
+            return; // a transfer is already in flight
+        size_t pending = (write_index_ - read_index_) & (UART_TX_RING_SIZE - 1);
+        if (pending == 0)
+            return;
+        size_t span = UART_TX_RING_SIZE - read_index_; // stop at the wrap point
+        if (span > pending)
+            span = pending;
+        dma_active_length_ = span;
+        if (HAL_UART_Transmit_DMA(&huart4, &tx_ring_[read_index_], span) != HAL_OK)
+            dma_active_length_ = 0; // transmitter in a bad state; retry on next append
+    }
+
+    uint8_t tx_ring_[UART_TX_RING_SIZE];
+    volatile size_t read_index_ = 0;
+    volatile size_t write_index_ = 0;
+    volatile size_t dma_active_length_ = 0;
 } uart4_stream_output;
 StreamSink* uart4_stream_output_ptr = &uart4_stream_output;
 
@@ -57,10 +117,77 @@ StreamBasedPacketSink uart4_packet_output(uart4_stream_output);
 BidirectionalPacketBasedChannel uart4_channel(uart4_packet_output);
 StreamToPacketSegmenter uart4_stream_input(uart4_channel);
 
+// Set while the byte stream is inside a fibre frame; spans across the
+// DMA chunk boundaries of the receive buffer.
+static bool rx_in_fibre_frame_ = false;
+
+// Routes each received byte range to exactly one parser. Fibre frames
+// announce themselves with the sync byte (CANONICAL_PREFIX, not a
+// printable character, so it never occurs in ASCII commands): everything
+// from a sync byte up to the end of the frame goes to the packet
+// segmenter, everything else to the ASCII parser. This replaces feeding
+// all traffic through both parsers, which cost two full passes and let
+// binary payload bytes churn the ASCII line buffer.
+static void uart_demux_parse_stream(const uint8_t* buffer, size_t length) {
+    while (length) {
+        if (rx_in_fibre_frame_) {
+            size_t chunk = uart4_stream_input.requested_bytes();
+            if (chunk == 0) {
+                // Frame complete (or header rejected): back to ASCII.
+                // Bytes consumed by a rejected header are not replayed.
+                rx_in_fibre_frame_ = false;
+                continue;
+            }
+            if (chunk > length)
+                chunk = length;
+            uart4_stream_input.process_bytes(buffer, chunk, nullptr);
+            buffer += chunk;
+            length -= chunk;
+        } else {
+            const uint8_t* sync = (const uint8_t*)memchr(buffer, CANONICAL_PREFIX, length);
+            size_t ascii_span = sync ? (size_t)(sync - buffer) : length;
+            if (ascii_span)
+                ASCII_protocol_parse_stream(buffer, ascii_span, uart4_stream_output);
+            buffer += ascii_span;
+            length -= ascii_span;
+            if (sync) {
+                uart4_stream_input.process_bytes(buffer, 1, nullptr); // the sync byte
+                ++buffer;
+                --length;
+                rx_in_fibre_frame_ = true;
+            }
+        }
+    }
+    if (rx_in_fibre_frame_ && uart4_stream_input.requested_bytes() == 0)
+        rx_in_fibre_frame_ = false;
+}
+
+// Marks the receive timestamp of the oldest unparsed data and wakes the
+// UART thread. Called from interrupt context.
+static void signal_rx_event(void) {
+    if (!rx_event_pending_) {
+        rx_event_pending_ = true;
+        rx_event_timestamp_ = DWT->CYCCNT;
+    }
+    uart_stats_.rx_event_cnt++;
+    if (uart_thread)
+        osSignalSet(uart_thread, UART_SIGNAL_RX);
+}
+
 static void uart_server_thread(void * ctx) {
     (void) ctx;
 
     for (;;) {
+        // Sleep until the RX interrupts report pending data. The timeout
+        // covers error recovery and any event lost during a parse pass.
+        osSignalWait(UART_SIGNAL_RX, UART_RX_POLL_INTERVAL_MS);
+
+        if (rx_event_pending_) {
+            uart_stats_.rx_to_parse_latency_us =
+                    (DWT->CYCCNT - rx_event_timestamp_) / (SystemCoreClock / 1000000);
+            rx_event_pending_ = false;
+        }
+
         // Check for UART errors and restart recieve DMA transfer if required
         if (huart4.ErrorCode != HAL_UART_ERROR_NONE) {
             HAL_UART_AbortReceive(&huart4);
@@ -72,36 +199,55 @@ static void uart_server_thread(void * ctx) {
         // deadline_ms = timeout_to_deadline(PROTOCOL_SERVER_TIMEOUT_MS);
         // Process bytes in one or two chunks (two in case there was a wrap)
         if (new_rcv_idx < dma_last_rcv_idx) {
-            uart4_stream_input.process_bytes(dma_rx_buffer + dma_last_rcv_idx,
-                    UART_RX_BUFFER_SIZE - dma_last_rcv_idx, nullptr); // TODO: use process_all
-            ASCII_protocol_parse_stream(dma_rx_buffer + dma_last_rcv_idx,
-                    UART_RX_BUFFER_SIZE - dma_last_rcv_idx, uart4_stream_output);
+            uart_demux_parse_stream(dma_rx_buffer + dma_last_rcv_idx,
+                    UART_RX_BUFFER_SIZE - dma_last_rcv_idx);
+            uart_stats_.rx_cnt += UART_RX_BUFFER_SIZE - dma_last_rcv_idx;
             dma_last_rcv_idx = 0;
         }
         if (new_rcv_idx > dma_last_rcv_idx) {
-            uart4_stream_input.process_bytes(dma_rx_buffer + dma_last_rcv_idx,
-                    new_rcv_idx - dma_last_rcv_idx, nullptr); // TODO: use process_all
-            ASCII_protocol_parse_stream(dma_rx_buffer + dma_last_rcv_idx,
-                    new_rcv_idx - dma_last_rcv_idx, uart4_stream_output);
+            uart_demux_parse_stream(dma_rx_buffer + dma_last_rcv_idx,
+                    new_rcv_idx - dma_last_rcv_idx);
+            uart_stats_.rx_cnt += new_rcv_idx - dma_last_rcv_idx;
             dma_last_rcv_idx = new_rcv_idx;
         }
-
-        osDelay(1);
     };
 }
 
 void start_uart_server() {
-    // DMA is set up to recieve in a circular buffer forever.
-    // We dont use interrupts to fetch the data, instead we periodically read
-    // data out of the circular buffer into a parse buffer, controlled by a state machine
+    uart4_channel.rate_limit_.ops_per_sec = board_config.fibre_ops_per_sec;
+    uart4_channel.rate_limit_.burst = board_config.fibre_ops_burst;
+    uart4_channel.rate_limit_.drop_cnt = &uart_stats_.rx_rate_limited_cnt;
+
+    // DMA is set up to recieve in a circular buffer forever. The DMA
+    // half/full-transfer interrupts and the UART IDLE line interrupt
+    // signal the thread to drain the buffer as bytes arrive.
     HAL_UART_Receive_DMA(&huart4, dma_rx_buffer, sizeof(dma_rx_buffer));
     dma_last_rcv_idx = UART_RX_BUFFER_SIZE - huart4.hdmarx->Instance->NDTR;
+    __HAL_UART_ENABLE_IT(&huart4, UART_IT_IDLE);
 
     // Start UART communication thread
-    osThreadDef(uart_server_thread_def, uart_server_thread, osPriorityNormal, 0, 1024 /* the ascii protocol needs considerable stack space */);
+    osThreadDefStatic(uart_server_thread_def, uart_server_thread, osPriorityNormal, 0, 1024 /* the ascii protocol needs considerable stack space */);
     uart_thread = osThreadCreate(osThread(uart_server_thread_def), NULL);
 }
 
 void HAL_UART_TxCpltCallback(UART_HandleTypeDef* huart) {
-    osSemaphoreRelease(sem_uart_dma);
+    uart4_stream_output.on_tx_complete();
+}
+
+void HAL_UART_RxHalfCpltCallback(UART_HandleTypeDef* huart) {
+    signal_rx_event();
+}
+
+void HAL_UART_RxCpltCallback(UART_HandleTypeDef* huart) {
+    signal_rx_event();
+}
+
+// The HAL doesn't dispatch the IDLE line interrupt, so this runs from
+// UART4_IRQHandler before the HAL handler gets a chance to.
+void uart4_idle_cb(void) {
+    if (__HAL_UART_GET_FLAG(&huart4, UART_FLAG_IDLE)
+        && __HAL_UART_GET_IT_SOURCE(&huart4, UART_IT_IDLE)) {
+        __HAL_UART_CLEAR_IDLEFLAG(&huart4);
+        signal_rx_event();
+    }
 }
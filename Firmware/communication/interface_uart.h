@@ -9,10 +9,21 @@ extern "C" {
 #endif
 
 #include <cmsis_os.h>
+#include <stdint.h>
 
 extern osThreadId uart_thread;
 
+typedef struct {
+    uint32_t rx_cnt;                 // bytes handed to the parsers
+    uint32_t rx_event_cnt;           // RX interrupts (IDLE line + DMA half/full)
+    uint32_t rx_to_parse_latency_us; // last observed RX-interrupt-to-parse delay
+    uint32_t rx_rate_limited_cnt;    // endpoint operations shed by the token bucket
+} UARTStats_t;
+
+extern UARTStats_t uart_stats_;
+
 void start_uart_server(void);
+void uart4_idle_cb(void); // called from UART4_IRQHandler on every interrupt
 
 #ifdef __cplusplus
 }
@@ -5,6 +5,7 @@
 #include <MotorControl/utils.h>
 
 #include <fibre/protocol.hpp>
+#include <fibre/cpp_utils.hpp>
 #include <usbd_cdc.h>
 #include <usbd_cdc_if.h>
 #include <usb_device.h>
@@ -18,13 +19,35 @@ USBStats_t usb_stats_ = {0};
 
 class USBSender : public PacketSink {
 public:
-    USBSender(uint8_t endpoint_pair, const osSemaphoreId& sem_usb_tx)
-            : endpoint_pair_(endpoint_pair), sem_usb_tx_(sem_usb_tx) {}
+    USBSender(uint8_t endpoint_pair, const osSemaphoreId& sem_usb_tx, size_t tx_capacity)
+            : endpoint_pair_(endpoint_pair), sem_usb_tx_(sem_usb_tx),
+              tx_capacity_(tx_capacity) {}
 
     int process_packet(const uint8_t* buffer, size_t length) {
         // cannot send partial packets
-        if (length > USB_TX_DATA_SIZE)
+        if (length > tx_capacity_)
             return -1;
+        if (transmit(buffer, length) != 0)
+            return -1;
+        // A transfer that is an exact multiple of the endpoint's max packet
+        // size must be terminated by a zero-length packet, otherwise the
+        // host keeps waiting for the rest of the transfer. This is what
+        // used to hang the channel with TX_BUF_SIZE = 64.
+        if (length && (length % CDC_DATA_FS_MAX_PACKET_SIZE) == 0)
+            return transmit(buffer, 0);
+        return 0;
+    }
+
+    // @brief Congestion probe for flow-controlled producers: full TX
+    // capacity when the endpoint can take another transfer right now,
+    // 0 while the previous one is still in flight.
+    size_t get_free_space() {
+        return CDC_Transmit_Busy(endpoint_pair_) ? 0 : tx_capacity_;
+    }
+
+    size_t get_mtu() { return tx_capacity_; }
+private:
+    int transmit(const uint8_t* buffer, size_t length) {
         // wait for USB interface to become ready
         if (osSemaphoreWait(sem_usb_tx_, PROTOCOL_SERVER_TIMEOUT_MS) != osOK) {
             // If the host resets the device it might be that the TX-complete handler is never called
@@ -44,23 +67,26 @@ public:
         usb_stats_.tx_cnt++;
         return 0;
     }
-private:
+
     uint8_t endpoint_pair_;
     const osSemaphoreId& sem_usb_tx_;
+    size_t tx_capacity_;
 };
 
-// Note we could have independent semaphores here to allow concurrent transmission
-USBSender usb_packet_output_cdc(CDC_OUT_EP, sem_usb_tx);
-USBSender usb_packet_output_native(ODRIVE_OUT_EP, sem_usb_tx);
+// Independent semaphores so a multi-packet bulk transfer on the native
+// pipe (oscilloscope/blackbox dumps, large endpoint reads) never stalls
+// the CDC pipe and vice versa.
+USBSender usb_packet_output_cdc(CDC_OUT_EP, sem_usb_tx, USB_TX_DATA_SIZE);
+USBSender usb_packet_output_native(ODRIVE_OUT_EP, sem_usb_tx_native, ODRIVE_USB_TX_DATA_SIZE);
 
 class TreatPacketSinkAsStreamSink : public StreamSink {
 public:
-    TreatPacketSinkAsStreamSink(PacketSink& output) : output_(output) {}
+    TreatPacketSinkAsStreamSink(USBSender& output) : output_(output) {}
     int process_bytes(const uint8_t* buffer, size_t length, size_t* processed_bytes) {
         // Loop to ensure all bytes get sent
         while (length) {
             size_t chunk = length < USB_TX_DATA_SIZE ? length : USB_TX_DATA_SIZE;
-            if (output_.process_packet(buffer, length) != 0)
+            if (output_.process_packet(buffer, chunk) != 0)
                 return -1;
             buffer += chunk;
             length -= chunk;
@@ -69,9 +95,12 @@ public:
         }
         return 0;
     }
-    size_t get_free_space() { return SIZE_MAX; }
+    // Reports the sender's momentary TX capacity so best-effort producers
+    // (telemetry) can back off instead of blocking. process_bytes() itself
+    // still accepts any length and waits for the endpoint as before.
+    size_t get_free_space() { return output_.get_free_space(); }
 private:
-    PacketSink& output_;
+    USBSender& output_;
 } usb_stream_output(usb_packet_output_cdc);
 
 // This is used by the printf feature. Hence the above statics, and below seemingly random ptr (it's externed)
@@ -86,97 +115,82 @@ BidirectionalPacketBasedChannel usb_channel(usb_packetized_output);
 StreamToPacketSegmenter usb_native_stream_input(usb_channel);
 #endif
 
-struct USBInterface {
-    uint8_t* rx_buf = nullptr;
-    uint32_t rx_len = 0;
-    bool data_pending = false;
-    uint8_t out_ep;
-    uint8_t in_ep;
-    USBSender& usb_sender;
-};
-
-// Note: statics make this less modular.
-// Note: we use a single rx semaphore and loop over data_pending to allow a single pump loop thread
-static USBInterface CDC_interface = {
-    .rx_buf = nullptr,
-    .rx_len = 0,
-    .data_pending = false,
-    .out_ep = CDC_OUT_EP,
-    .in_ep = CDC_IN_EP,
-    .usb_sender = usb_packet_output_cdc,
-};
-static USBInterface ODrive_interface = {
-    .rx_buf = nullptr,
-    .rx_len = 0,
-    .data_pending = false,
-    .out_ep = ODRIVE_OUT_EP,
-    .in_ep = ODRIVE_IN_EP,
-    .usb_sender = usb_packet_output_native,
+// RX handoff from the USB interrupt path to the server thread. The CDC
+// receive callback runs in the deferred interrupt context and must not do
+// any protocol work (parsing in that context stalls whatever the interrupt
+// preempted and blows up its stack budget); it only queues a descriptor of
+// the HAL-owned buffer here. One slot per OUT endpoint would suffice -- an
+// endpoint is not re-armed until its buffer has been processed -- but the
+// ring must be a power of two anyway.
+struct UsbRxTransfer_t {
+    uint8_t* buf;
+    uint32_t len;
+    uint8_t endpoint_pair;
 };
+static SpscRingBuffer<UsbRxTransfer_t, 4> usb_rx_queue_;
 
 static void usb_server_thread(void * ctx) {
     (void) ctx;
-    
+
     for (;;) {
         // const uint32_t usb_check_timeout = 1; // ms
         osStatus sem_stat = osSemaphoreWait(sem_usb_rx, osWaitForever);
         if (sem_stat == osOK) {
-            usb_stats_.rx_cnt++;
-
-            // CDC Interface
-            if (CDC_interface.data_pending) {
-                CDC_interface.data_pending = false;
-                if (board_config.enable_ascii_protocol_on_usb) {
-                    ASCII_protocol_parse_stream(CDC_interface.rx_buf,
-                            CDC_interface.rx_len, usb_stream_output);
+            UsbRxTransfer_t transfer;
+            while (usb_rx_queue_.pop(&transfer)) {
+                usb_stats_.rx_cnt++;
+                TRACE_COMM_PKT_START(transfer.len);
+                if (transfer.endpoint_pair == CDC_OUT_EP &&
+                        board_config.enable_ascii_protocol_on_usb) {
+                    ASCII_protocol_parse_stream(transfer.buf,
+                            transfer.len, usb_stream_output);
                 } else {
 #if defined(USB_PROTOCOL_NATIVE)
-                    usb_channel.process_packet(CDC_interface.rx_buf, CDC_interface.rx_len);
+                    usb_channel.process_packet(transfer.buf, transfer.len);
 #elif defined(USB_PROTOCOL_NATIVE_STREAM_BASED)
                     usb_native_stream_input.process_bytes(
-                            CDC_interface.rx_buf, CDC_interface.rx_len, nullptr);
+                            transfer.buf, transfer.len, nullptr);
 #endif
                 }
-                USBD_CDC_ReceivePacket(&hUsbDeviceFS, CDC_interface.out_ep);  // Allow next packet
+                TRACE_COMM_PKT_END(transfer.len);
+                USBD_CDC_ReceivePacket(&hUsbDeviceFS, transfer.endpoint_pair);  // Allow next packet
             }
 
-            // Native Interface
-            if (ODrive_interface.data_pending) {
-                ODrive_interface.data_pending = false;
-#if defined(USB_PROTOCOL_NATIVE)
-                usb_channel.process_packet(ODrive_interface.rx_buf, ODrive_interface.rx_len);
-#elif defined(USB_PROTOCOL_NATIVE_STREAM_BASED)
-                usb_native_stream_input.process_bytes(
-                        ODrive_interface.rx_buf, ODrive_interface.rx_len, nullptr);
-#endif
-                USBD_CDC_ReceivePacket(&hUsbDeviceFS, ODrive_interface.out_ep);  // Allow next packet
-            }
+            // Autonomous oscilloscope dumps ride on the native bulk pipe.
+            // Serviced here so they are serialized with the response
+            // traffic on the same endpoint; start_dump() releases
+            // sem_usb_rx to get this loop running without RX traffic.
+            osc_.service_dump(usb_packet_output_native);
         }
     }
 }
 
-// Called from CDC_Receive_FS callback function, this allows the communication
-// thread to handle the incoming data
+// Called from the CDC_Receive_FS callback, i.e. from the (deferred) USB
+// interrupt path. Only hands the HAL-owned buffer off to the server thread;
+// all protocol parsing happens there.
 void usb_rx_process_packet(uint8_t *buf, uint32_t len, uint8_t endpoint_pair) {
-    USBInterface* usb_iface;
-    if (endpoint_pair == CDC_interface.out_ep) {
-        usb_iface = &CDC_interface;
-    } else if (endpoint_pair == ODrive_interface.out_ep) {
-        usb_iface = &ODrive_interface;
-    } else {
+    if (endpoint_pair != CDC_OUT_EP && endpoint_pair != ODRIVE_OUT_EP)
         return;
-    }
 
-    // We don't allow the next USB packet until the previous one has been processed completely.
-    // Therefore it's safe to write to these vars directly since we know previous processing is complete.
-    usb_iface->rx_buf = buf;
-    usb_iface->rx_len = len;
-    usb_iface->data_pending = true;
+    UsbRxTransfer_t transfer = { buf, len, endpoint_pair };
+    if (!usb_rx_queue_.push(transfer)) {
+        // Can't happen with the current flow control (the endpoint is only
+        // re-armed after its previous buffer was consumed), but don't wedge
+        // silently if that invariant is ever broken.
+        usb_stats_.rx_queue_overrun_cnt++;
+        return;
+    }
     osSemaphoreRelease(sem_usb_rx);
 }
 
 void start_usb_server() {
+#if defined(USB_PROTOCOL_NATIVE) || defined(USB_PROTOCOL_NATIVE_STREAM_BASED)
+    usb_channel.rate_limit_.ops_per_sec = board_config.fibre_ops_per_sec;
+    usb_channel.rate_limit_.burst = board_config.fibre_ops_burst;
+    usb_channel.rate_limit_.drop_cnt = &usb_stats_.rx_rate_limited_cnt;
+#endif
+
     // Start USB communication thread
-    osThreadDef(usb_server_thread_def, usb_server_thread, osPriorityNormal, 0, 1024);
+    osThreadDefStatic(usb_server_thread_def, usb_server_thread, osPriorityNormal, 0, 1024);
     usb_thread = osThreadCreate(osThread(usb_server_thread_def), NULL);
 }
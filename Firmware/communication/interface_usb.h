@@ -17,6 +17,9 @@ typedef struct {
     uint32_t rx_cnt;
     uint32_t tx_cnt;
     uint32_t tx_overrun_cnt;
+    uint32_t rx_queue_overrun_cnt;
+    uint32_t rx_rate_limited_cnt; //!< endpoint operations shed by the token bucket
+    uint32_t max_irq_duration_us; //!< worst-case duration of one deferred USB interrupt service pass
 } USBStats_t;
 
 extern USBStats_t usb_stats_;
@@ -0,0 +1,59 @@
+#ifndef __STABLE_ENDPOINT_IDS_HPP
+#define __STABLE_ENDPOINT_IDS_HPP
+
+#include <fibre/protocol.hpp>
+
+/*
+* Stable endpoint ID manifest.
+*
+* Slot i of this table is addressable on the wire as endpoint ID
+* STABLE_ENDPOINT_ID_BASE + i with a PROTOCOL_VERSION trailer, regardless
+* of where the named endpoint ends up in the JSON tree of a particular
+* firmware build. Fleet hosts that only touch endpoints listed here never
+* need to refetch the descriptor after a firmware update.
+*
+* RULES: this table is APPEND-ONLY. Never remove, reorder or repurpose a
+* slot - that would silently redirect deployed hosts to a different
+* endpoint. When a listed endpoint is removed from the tree its slot stays
+* here and simply stops resolving (requests to it are rejected). Bump
+* STABLE_ID_MAP_VERSION whenever slots are appended.
+*
+* Paths that don't exist in a given build configuration (e.g. the axis1
+* block with CONFIG_AXIS_COUNT=1) are unroutable in that build, which is
+* fine: the slot assignment is global, not per-build.
+*/
+
+#define STABLE_ID_MAP_VERSION 1
+
+static constexpr uint32_t stable_endpoint_ids[] = {
+    fibre_name_hash("vbus_voltage"),                            // 0x4000
+    fibre_name_hash("serial_number"),                           // 0x4001
+    fibre_name_hash("fw_version_major"),                        // 0x4002
+    fibre_name_hash("fw_version_minor"),                        // 0x4003
+    fibre_name_hash("fw_version_revision"),                     // 0x4004
+    fibre_name_hash("axis0.error"),                             // 0x4005
+    fibre_name_hash("axis0.current_state"),                     // 0x4006
+    fibre_name_hash("axis0.requested_state"),                   // 0x4007
+    fibre_name_hash("axis0.encoder.pos_estimate"),              // 0x4008
+    fibre_name_hash("axis0.encoder.vel_estimate"),              // 0x4009
+    fibre_name_hash("axis0.controller.pos_setpoint"),           // 0x400a
+    fibre_name_hash("axis0.controller.vel_setpoint"),           // 0x400b
+    fibre_name_hash("axis0.controller.current_setpoint"),       // 0x400c
+    fibre_name_hash("axis0.motor.current_control.Iq_measured"), // 0x400d
+    fibre_name_hash("axis1.error"),                             // 0x400e
+    fibre_name_hash("axis1.current_state"),                     // 0x400f
+    fibre_name_hash("axis1.requested_state"),                   // 0x4010
+    fibre_name_hash("axis1.encoder.pos_estimate"),              // 0x4011
+    fibre_name_hash("axis1.encoder.vel_estimate"),              // 0x4012
+    fibre_name_hash("axis1.controller.pos_setpoint"),           // 0x4013
+    fibre_name_hash("axis1.controller.vel_setpoint"),           // 0x4014
+    fibre_name_hash("axis1.controller.current_setpoint"),       // 0x4015
+    fibre_name_hash("axis1.motor.current_control.Iq_measured"), // 0x4016
+    fibre_name_hash("save_configuration"),                      // 0x4017
+    fibre_name_hash("reboot"),                                  // 0x4018
+};
+
+static constexpr size_t n_stable_endpoint_ids =
+        sizeof(stable_endpoint_ids) / sizeof(stable_endpoint_ids[0]);
+
+#endif // __STABLE_ENDPOINT_IDS_HPP
@@ -0,0 +1,100 @@
+
+#include "odrive_main.h"
+
+#include "interface_usb.h"
+#include "interface_uart.h"
+#include <freertos_vars.h>
+
+Telemetry telemetry_;
+
+// @brief Resolves the slot bindings and starts publishing. Resolving
+// happens here (in the communication thread) so the sampling interrupt
+// only ever dereferences plain endpoint pointers. Bound slots are packed
+// in ascending slot order; the host infers the value layout from its own
+// slot configuration.
+void Telemetry::start() {
+    active_ = false; // stop the sampler while we reconfigure
+    num_active_ = 0;
+    for (size_t i = 0; i < NUM_SLOTS; ++i) {
+        if (is_endpoint_ref_valid(config_.slots[i])) {
+            Endpoint* endpoint = get_endpoint(config_.slots[i]);
+            if (endpoint)
+                resolved_[num_active_++] = endpoint;
+        }
+    }
+    divider_counter_ = 0;
+    seq_ = 0;
+    decimation_mask_ = 0;
+    frame_queue_.clear();
+    if (num_active_ > 0)
+        active_ = true;
+}
+
+void Telemetry::stop() {
+    active_ = false;
+}
+
+void Telemetry::sample() {
+    if (!active_)
+        return;
+    if (++divider_counter_ < config_.rate_divider)
+        return;
+    divider_counter_ = 0;
+
+    Frame_t frame;
+    frame.seq = seq_++;
+    frame.num_values = num_active_;
+    for (size_t i = 0; i < num_active_; ++i) {
+        if (!resolved_[i]->get_as_float(&frame.values[i]))
+            frame.values[i] = 0.0f / 0.0f; // endpoint is not numeric
+    }
+
+    if (frame_queue_.push(frame))
+        osSemaphoreRelease(sem_telemetry);
+    else
+        ++frames_dropped_; // the communication thread is falling behind
+}
+
+void Telemetry::poll() {
+    Frame_t frame;
+    while (frame_queue_.pop(&frame)) {
+        StreamSink* output = (config_.output == OUTPUT_UART)
+                           ? uart4_stream_output_ptr : usb_stream_output_ptr;
+
+        // Flow control: telemetry is best-effort and must never block the
+        // communication thread (protocol responses share it) or clobber a
+        // transfer in flight. When the link is backed up we degrade by
+        // decimation - double the effective divider, up to 8x - rather
+        // than dropping whichever frame happens to hit the stall. The
+        // host sees the reduced rate as regular gaps in the seq field.
+        size_t frame_size = 2 + 2 + 1 + frame.num_values * sizeof(float) + 2;
+        bool congested = output->get_free_space() < frame_size;
+        if (congested && decimation_mask_ < 0x7)
+            decimation_mask_ = (decimation_mask_ << 1) | 1;
+        else if (!congested)
+            decimation_mask_ >>= 1;
+        if (frame.seq & decimation_mask_) {
+            ++frames_decimated_;
+            continue;
+        }
+        if (congested) { // still saturated at max decimation
+            ++frames_decimated_;
+            continue;
+        }
+
+        uint8_t buffer[2 + 2 + 1 + NUM_SLOTS * sizeof(float) + 2];
+        size_t pos = 0;
+        buffer[pos++] = CANONICAL_PREFIX;
+        buffer[pos++] = 0x55;
+        pos += write_le<uint16_t>(frame.seq, &buffer[pos]);
+        buffer[pos++] = frame.num_values;
+        for (size_t i = 0; i < frame.num_values; ++i)
+            pos += write_le<float>(frame.values[i], &buffer[pos]);
+        uint16_t crc = calc_crc16<CANONICAL_CRC16_POLYNOMIAL>(
+                CANONICAL_CRC16_INIT, &buffer[2], pos - 2);
+        pos += write_le<uint16_t>(crc, &buffer[pos]);
+
+        output->process_bytes(buffer, pos, nullptr);
+        ++frames_sent_;
+    }
+}
@@ -0,0 +1,92 @@
+#ifndef __TELEMETRY_HPP
+#define __TELEMETRY_HPP
+
+#ifndef __ODRIVE_MAIN_H
+#error "This file should not be included directly. Include odrive_main.h instead."
+#endif
+
+// @brief Push-based binary telemetry channel.
+//
+// Up to NUM_SLOTS numeric protocol endpoints are sampled in the current
+// measurement interrupt at a fixed divider of the control loop and pushed
+// out as compact binary frames on USB (CDC) or UART, with no host request
+// per sample. Frames are queued from the interrupt through a lock-free
+// ring and serialized by the communication thread.
+//
+// Wire format (little endian):
+//   0xAA 0x55 | seq (u16) | count (u8) | count * float32 | crc16
+// where the CRC16 (CANONICAL_CRC16_POLYNOMIAL, init CANONICAL_CRC16_INIT)
+// covers everything after the two sync bytes.
+class Telemetry {
+public:
+    enum Output_t {
+        OUTPUT_USB_CDC = 0,
+        OUTPUT_UART = 1,
+    };
+
+    static constexpr size_t NUM_SLOTS = 8;
+    static constexpr size_t FRAME_QUEUE_DEPTH = 4;
+
+    struct Config_t {
+        endpoint_ref_t slots[NUM_SLOTS] = {}; // invalid ref = slot disabled
+        uint32_t rate_divider = 80;           // control cycles per frame (8kHz / 80 = 100Hz)
+        Output_t output = OUTPUT_USB_CDC;
+    };
+
+    struct Frame_t {
+        uint16_t seq;
+        uint8_t num_values;
+        float values[NUM_SLOTS];
+    };
+
+    void start();
+    void stop();
+
+    // Called once per current measurement cycle in interrupt context.
+    void sample();
+    // Called from the communication thread to drain the frame queue.
+    void poll();
+
+    Config_t config_;
+
+    bool active_ = false;
+    uint32_t frames_sent_ = 0;
+    uint32_t frames_dropped_ = 0;
+    uint32_t frames_decimated_ = 0;
+
+    // Communication protocol definitions
+    auto make_protocol_definitions() {
+        return make_protocol_member_list(
+            make_protocol_ro_property("active", const_cast<const bool*>(&active_)),
+            make_protocol_ro_property("frames_sent", &frames_sent_),
+            make_protocol_ro_property("frames_dropped", &frames_dropped_),
+            make_protocol_ro_property("frames_decimated", &frames_decimated_),
+            make_protocol_object("config",
+                make_protocol_property("slot0", &config_.slots[0]),
+                make_protocol_property("slot1", &config_.slots[1]),
+                make_protocol_property("slot2", &config_.slots[2]),
+                make_protocol_property("slot3", &config_.slots[3]),
+                make_protocol_property("slot4", &config_.slots[4]),
+                make_protocol_property("slot5", &config_.slots[5]),
+                make_protocol_property("slot6", &config_.slots[6]),
+                make_protocol_property("slot7", &config_.slots[7]),
+                make_protocol_property("rate_divider", &config_.rate_divider),
+                make_protocol_property("output", &config_.output)
+            ),
+            make_protocol_function("start", *this, &Telemetry::start),
+            make_protocol_function("stop", *this, &Telemetry::stop)
+        );
+    }
+
+private:
+    Endpoint* resolved_[NUM_SLOTS] = { nullptr };
+    size_t num_active_ = 0;
+    uint32_t divider_counter_ = 0;
+    uint16_t seq_ = 0;
+    uint8_t decimation_mask_ = 0; // 0, 1, 3 or 7: skip frames where (seq & mask) != 0
+    SpscRingBuffer<Frame_t, FRAME_QUEUE_DEPTH> frame_queue_;
+};
+
+extern Telemetry telemetry_;
+
+#endif // __TELEMETRY_HPP
@@ -0,0 +1,393 @@
+/*
+* Host-side fibre client, see include/fibre/client.hpp.
+*/
+
+#include <fibre/client.hpp>
+#include <fibre/crc.hpp>
+#include <fibre/encoders.hpp>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+
+#define CLIENT_SEND_ATTEMPTS	5
+#define CLIENT_RESEND_TIMEOUT_MS	100
+
+/* TCP transport -------------------------------------------------------------*/
+
+TCPClientTransport::~TCPClientTransport() {
+    if (socket_fd_ != -1)
+        close(socket_fd_);
+}
+
+int TCPClientTransport::connect_to(const char* host, unsigned int port) {
+    char port_str[8];
+    snprintf(port_str, sizeof(port_str), "%u", port);
+
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    struct addrinfo* result;
+    if (getaddrinfo(host, port_str, &hints, &result) != 0)
+        return -1;
+
+    for (struct addrinfo* ai = result; ai; ai = ai->ai_next) {
+        socket_fd_ = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (socket_fd_ == -1)
+            continue;
+        if (connect(socket_fd_, ai->ai_addr, ai->ai_addrlen) == 0)
+            break;
+        close(socket_fd_);
+        socket_fd_ = -1;
+    }
+    freeaddrinfo(result);
+    if (socket_fd_ == -1)
+        return -1;
+
+    // setpoint packets are small and latency-sensitive
+    int nodelay = 1;
+    setsockopt(socket_fd_, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+    return 0;
+}
+
+int TCPClientTransport::send_packet(const uint8_t* buffer, size_t length) {
+    if (socket_fd_ == -1)
+        return -1;
+
+    // frame in place and send with a single syscall
+    uint8_t frame[FrameEncoder::HEADER_SIZE + STREAM_MAX_PAYLOAD + FrameEncoder::TRAILER_SIZE];
+    FrameEncoder encoder(frame, sizeof(frame));
+    encoder.write_bytes(buffer, length);
+    int frame_length = encoder.finalize();
+    if (frame_length < 0)
+        return -1;
+
+    const uint8_t* pos = frame;
+    size_t remaining = frame_length;
+    while (remaining) {
+        ssize_t n = send(socket_fd_, pos, remaining, MSG_NOSIGNAL);
+        if (n <= 0)
+            return -1;
+        pos += n;
+        remaining -= n;
+    }
+    return 0;
+}
+
+int TCPClientTransport::receive_packet(uint8_t* buffer, size_t max_length, uint32_t timeout_ms) {
+    if (socket_fd_ == -1)
+        return -1;
+
+    // Collects the segmenter's output. If several packets arrive in one
+    // burst (a stale response followed by the current one) only the most
+    // recent is kept, which is the one the caller is waiting for.
+    class CapturePacketSink : public PacketSink {
+    public:
+        CapturePacketSink(uint8_t* buffer, size_t max_length) :
+            buffer_(buffer), max_length_(max_length) {}
+        int process_packet(const uint8_t* buffer, size_t length) {
+            if (length > max_length_)
+                return -1;
+            memcpy(buffer_, buffer, length);
+            captured_length_ = length;
+            return 0;
+        }
+        int captured_length_ = 0;
+    private:
+        uint8_t* buffer_;
+        size_t max_length_;
+    } capture(buffer, max_length);
+
+    // The segmenter state is per call: a frame split across a timeout
+    // boundary is dropped and recovered by the client's resend logic.
+    StreamToPacketSegmenter segmenter(capture);
+
+    struct timeval tv = { (time_t)(timeout_ms / 1000), (suseconds_t)((timeout_ms % 1000) * 1000) };
+    setsockopt(socket_fd_, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    uint8_t rx_buf[RX_BUF_SIZE];
+    while (!capture.captured_length_) {
+        ssize_t n = recv(socket_fd_, rx_buf, sizeof(rx_buf), 0);
+        if (n == 0)
+            return -1; // peer closed the connection
+        if (n < 0)
+            return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+        segmenter.process_bytes(rx_buf, n, nullptr);
+    }
+    return capture.captured_length_;
+}
+
+/* USB transport -------------------------------------------------------------*/
+
+#ifdef FIBRE_CLIENT_LIBUSB
+
+#include <libusb-1.0/libusb.h>
+
+// native (raw packet) bulk endpoint pair, see usbd_cdc.h
+#define FIBRE_USB_EP_OUT 0x03
+#define FIBRE_USB_EP_IN  0x83
+
+USBClientTransport::~USBClientTransport() {
+    if (handle_) {
+        libusb_release_interface(handle_, 2);
+        libusb_close(handle_);
+    }
+    if (ctx_)
+        libusb_exit(ctx_);
+}
+
+int USBClientTransport::connect_to(uint16_t vid, uint16_t pid) {
+    if (libusb_init(&ctx_) != 0)
+        return -1;
+    handle_ = libusb_open_device_with_vid_pid(ctx_, vid, pid);
+    if (!handle_)
+        return -1;
+    libusb_set_auto_detach_kernel_driver(handle_, 1);
+    if (libusb_claim_interface(handle_, 2) != 0) { // native interface
+        libusb_close(handle_);
+        handle_ = nullptr;
+        return -1;
+    }
+    return 0;
+}
+
+int USBClientTransport::send_packet(const uint8_t* buffer, size_t length) {
+    if (!handle_)
+        return -1;
+    int transferred = 0;
+    int result = libusb_bulk_transfer(handle_, FIBRE_USB_EP_OUT,
+            const_cast<uint8_t*>(buffer), length, &transferred, CLIENT_RESEND_TIMEOUT_MS);
+    return (result == 0 && transferred == (int)length) ? 0 : -1;
+}
+
+int USBClientTransport::receive_packet(uint8_t* buffer, size_t max_length, uint32_t timeout_ms) {
+    if (!handle_)
+        return -1;
+    int transferred = 0;
+    int result = libusb_bulk_transfer(handle_, FIBRE_USB_EP_IN,
+            buffer, max_length, &transferred, timeout_ms);
+    if (result == LIBUSB_ERROR_TIMEOUT)
+        return 0;
+    return (result == 0) ? transferred : -1;
+}
+
+#endif // FIBRE_CLIENT_LIBUSB
+
+/* Remote node ---------------------------------------------------------------*/
+
+int RemoteNode::endpoint_operation(uint16_t endpoint_id,
+        const uint8_t* input, size_t input_length,
+        uint8_t* output, size_t output_length) {
+    if (!transport_)
+        return -1;
+
+    std::lock_guard<std::mutex> lock(channel_mutex_);
+
+    outbound_seq_no_ = (outbound_seq_no_ + 1) & 0x7fff;
+    // one seq-no bit is hardwired to 1 to avoid conflicts with the ASCII
+    // protocol (same as the Python implementation)
+    uint16_t seq_no = outbound_seq_no_ | 0x0080;
+
+    uint8_t packet[TX_BUF_SIZE];
+    size_t pos = 0;
+    pos += write_le<uint16_t>(seq_no, packet + pos);
+    pos += write_le<uint16_t>(endpoint_id | 0x8000, packet + pos); // MSB: expect response
+    pos += write_le<uint16_t>((uint16_t)output_length, packet + pos);
+    if (input_length > sizeof(packet) - pos - 2)
+        return -1;
+    memcpy(packet + pos, input, input_length);
+    pos += input_length;
+    pos += write_le<uint16_t>(endpoint_id ? json_crc_ : PROTOCOL_VERSION, packet + pos);
+
+    uint8_t response[TX_BUF_SIZE];
+    for (int attempt = 0; attempt < CLIENT_SEND_ATTEMPTS; ++attempt) {
+        if (transport_->send_packet(packet, pos) != 0)
+            continue;
+        int response_length = transport_->receive_packet(response, sizeof(response),
+                CLIENT_RESEND_TIMEOUT_MS);
+        if (response_length < 2)
+            continue; // timeout or error: resend
+        uint16_t response_seq_no;
+        read_le<uint16_t>(&response_seq_no, response);
+        if (response_seq_no != (seq_no | 0x8000))
+            continue; // stale response of an abandoned attempt
+        size_t payload_length = response_length - 2;
+        if (payload_length > output_length)
+            payload_length = output_length;
+        if (output)
+            memcpy(output, response + 2, payload_length);
+        return (int)payload_length;
+    }
+    return -1;
+}
+
+int RemoteNode::fetch_json_descriptor(std::string& json) {
+    json.clear();
+    for (;;) {
+        uint8_t offset_buf[4];
+        write_le<uint32_t>((uint32_t)json.size(), offset_buf);
+        uint8_t chunk[TX_BUF_SIZE];
+        // json_crc_ is still 0 here; endpoint 0 uses PROTOCOL_VERSION as
+        // trailer so the descriptor can be read before the CRC is known
+        int chunk_length = endpoint_operation(0, offset_buf, sizeof(offset_buf),
+                chunk, sizeof(chunk) - 2);
+        if (chunk_length < 0)
+            return -1;
+        if (chunk_length == 0)
+            return 0; // end of descriptor
+        json.append(reinterpret_cast<char*>(chunk), chunk_length);
+    }
+}
+
+/* Minimal JSON walker for the interface descriptor. The descriptor is
+* machine-generated (see write_json in protocol.hpp) so this only handles
+* the shapes that generator emits: objects with string/number values and
+* "members"/"inputs"/"outputs" arrays of objects. */
+
+static size_t skip_whitespace(const std::string& json, size_t pos) {
+    while (pos < json.size() && (json[pos] == ' ' || json[pos] == '\t' ||
+            json[pos] == '\n' || json[pos] == '\r'))
+        pos++;
+    return pos;
+}
+
+// pos points at the opening quote; returns position past the closing quote
+static size_t parse_string(const std::string& json, size_t pos, std::string* value) {
+    if (value)
+        value->clear();
+    pos++; // opening quote
+    while (pos < json.size() && json[pos] != '"') {
+        if (json[pos] == '\\')
+            pos++;
+        if (value)
+            value->push_back(json[pos]);
+        pos++;
+    }
+    return pos + 1; // closing quote
+}
+
+static size_t parse_endpoint_object(const std::string& json, size_t pos,
+        const std::string& prefix, std::vector<RemoteEndpointInfo>& endpoints);
+
+// pos points at '['; returns position past ']'
+static size_t parse_endpoint_array(const std::string& json, size_t pos,
+        const std::string& prefix, std::vector<RemoteEndpointInfo>& endpoints) {
+    pos = skip_whitespace(json, pos + 1);
+    while (pos < json.size() && json[pos] != ']') {
+        if (json[pos] == '{')
+            pos = parse_endpoint_object(json, pos, prefix, endpoints);
+        else
+            pos++; // tolerate unexpected tokens
+        pos = skip_whitespace(json, pos);
+        if (pos < json.size() && json[pos] == ',')
+            pos = skip_whitespace(json, pos + 1);
+    }
+    return pos + 1;
+}
+
+// pos points at '{'; returns position past '}'
+static size_t parse_endpoint_object(const std::string& json, size_t pos,
+        const std::string& prefix, std::vector<RemoteEndpointInfo>& endpoints) {
+    RemoteEndpointInfo info;
+    info.id = 0;
+    bool have_id = false;
+    // sub-arrays are parsed after name/id/type are known; the generator
+    // emits "name" first but we don't rely on the member order
+    struct { std::string key; size_t pos; } sub_arrays[3];
+    size_t n_sub_arrays = 0;
+
+    pos = skip_whitespace(json, pos + 1);
+    while (pos < json.size() && json[pos] != '}') {
+        std::string key;
+        pos = parse_string(json, pos, &key);
+        pos = skip_whitespace(json, pos);
+        if (pos < json.size() && json[pos] == ':')
+            pos = skip_whitespace(json, pos + 1);
+
+        if (json[pos] == '"') {
+            std::string value;
+            pos = parse_string(json, pos, &value);
+            if (key == "name")
+                info.path = prefix.empty() ? value : prefix + "." + value;
+            else if (key == "type")
+                info.type = value;
+        } else if (json[pos] == '[') {
+            if (n_sub_arrays < 3) {
+                sub_arrays[n_sub_arrays].key = key;
+                sub_arrays[n_sub_arrays].pos = pos;
+                n_sub_arrays++;
+            }
+            // skip the array (including nested ones) for now
+            size_t depth = 0;
+            do {
+                if (json[pos] == '[')
+                    depth++;
+                else if (json[pos] == ']')
+                    depth--;
+                else if (json[pos] == '"')
+                    pos = parse_string(json, pos, nullptr) - 1;
+                pos++;
+            } while (pos < json.size() && depth);
+        } else {
+            // number (only "id" is numeric in this descriptor)
+            size_t start = pos;
+            while (pos < json.size() && json[pos] != ',' && json[pos] != '}')
+                pos++;
+            if (key == "id") {
+                info.id = (uint16_t)strtoul(json.c_str() + start, nullptr, 10);
+                have_id = true;
+            }
+        }
+
+        pos = skip_whitespace(json, pos);
+        if (pos < json.size() && json[pos] == ',')
+            pos = skip_whitespace(json, pos + 1);
+    }
+    pos++; // '}'
+
+    if (have_id && !info.path.empty())
+        endpoints.push_back(info);
+
+    for (size_t i = 0; i < n_sub_arrays; ++i) {
+        if (sub_arrays[i].key == "members" || sub_arrays[i].key == "inputs" ||
+                sub_arrays[i].key == "outputs")
+            parse_endpoint_array(json, sub_arrays[i].pos, info.path, endpoints);
+    }
+    return pos;
+}
+
+int RemoteNode::parse_json_descriptor(const std::string& json) {
+    endpoints_.clear();
+    size_t pos = skip_whitespace(json, 0);
+    if (pos >= json.size() || json[pos] != '[')
+        return -1;
+    parse_endpoint_array(json, pos, "", endpoints_);
+    return endpoints_.empty() ? -1 : 0;
+}
+
+int RemoteNode::connect(ClientTransport& transport) {
+    transport_ = &transport;
+    json_crc_ = 0;
+
+    std::string json;
+    if (fetch_json_descriptor(json) != 0)
+        return -1;
+    json_crc_ = calc_crc16<CANONICAL_CRC16_POLYNOMIAL>(PROTOCOL_VERSION,
+            reinterpret_cast<const uint8_t*>(json.data()), json.size());
+    return parse_json_descriptor(json);
+}
+
+const RemoteEndpointInfo* RemoteNode::find_endpoint(const std::string& path) const {
+    for (const RemoteEndpointInfo& ep : endpoints_) {
+        if (ep.path == path)
+            return &ep;
+    }
+    return nullptr;
+}
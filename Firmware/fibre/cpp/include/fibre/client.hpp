@@ -0,0 +1,156 @@
+/*
+* Host-side fibre client.
+*
+* Connects to a fibre node (ODrive) over a packet transport, fetches the
+* JSON interface descriptor from endpoint 0 and exposes the endpoints by
+* their dotted path ("axis0.controller.pos_setpoint"). Property reads and
+* writes are synchronous wire transactions; *_async variants return a
+* std::future for callers that overlap I/O with computation. The client
+* is designed for tight host control loops (kHz setpoint streaming) that
+* the Python implementation cannot sustain.
+*
+* Transports: TCPClientTransport (stream framing over a socket, matches
+* posix_tcp.cpp) is always available. USBClientTransport (raw packets on
+* the native bulk endpoints) is compiled when FIBRE_CLIENT_LIBUSB is
+* defined and requires libusb-1.0.
+*/
+
+#ifndef __FIBRE_CLIENT_HPP
+#define __FIBRE_CLIENT_HPP
+
+#include <fibre/protocol.hpp>
+
+#include <future>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// @brief Packet transport a client channel runs on.
+// send_packet/receive_packet move whole fibre packets; framing (if the
+// underlying medium is a byte stream) is the transport's business.
+class ClientTransport {
+public:
+    virtual ~ClientTransport() {}
+    // @return 0 on success, -1 on transport error
+    virtual int send_packet(const uint8_t* buffer, size_t length) = 0;
+    // @return received packet length, 0 on timeout or -1 on transport error
+    virtual int receive_packet(uint8_t* buffer, size_t max_length, uint32_t timeout_ms) = 0;
+};
+
+class TCPClientTransport : public ClientTransport {
+public:
+    ~TCPClientTransport();
+    // @return 0 on success, -1 if the connection could not be established
+    int connect_to(const char* host, unsigned int port);
+    int send_packet(const uint8_t* buffer, size_t length) final;
+    int receive_packet(uint8_t* buffer, size_t max_length, uint32_t timeout_ms) final;
+private:
+    int socket_fd_ = -1;
+};
+
+#ifdef FIBRE_CLIENT_LIBUSB
+struct libusb_context;
+struct libusb_device_handle;
+
+class USBClientTransport : public ClientTransport {
+public:
+    ~USBClientTransport();
+    // @return 0 on success, -1 if no matching device was found
+    int connect_to(uint16_t vid = 0x1209, uint16_t pid = 0x0d32);
+    int send_packet(const uint8_t* buffer, size_t length) final;
+    int receive_packet(uint8_t* buffer, size_t max_length, uint32_t timeout_ms) final;
+private:
+    libusb_context* ctx_ = nullptr;
+    libusb_device_handle* handle_ = nullptr;
+};
+#endif
+
+// One entry of the flattened interface descriptor.
+struct RemoteEndpointInfo {
+    std::string path; // dotted path, e.g. "axis0.motor.config.current_lim"
+    std::string type; // JSON type name, e.g. "float", "uint32", "function"
+    uint16_t id;
+};
+
+class RemoteNode {
+public:
+    // @brief Fetches and parses the JSON descriptor of the node behind
+    // the transport. Must succeed before any endpoint access.
+    // @return 0 on success, -1 otherwise
+    int connect(ClientTransport& transport);
+
+    // @brief Raw endpoint transaction, matching the firmware's packet
+    // format. Resends until acknowledged or out of attempts.
+    // @return response payload length on success, -1 otherwise
+    int endpoint_operation(uint16_t endpoint_id,
+            const uint8_t* input, size_t input_length,
+            uint8_t* output, size_t output_length);
+
+    // @return endpoint descriptor for the path, or nullptr if unknown
+    const RemoteEndpointInfo* find_endpoint(const std::string& path) const;
+
+    // Typed property access by path. @return 0 on success, -1 otherwise.
+    template<typename T>
+    int read(const std::string& path, T* value) {
+        const RemoteEndpointInfo* ep = find_endpoint(path);
+        if (!ep)
+            return -1;
+        uint8_t buffer[sizeof(T)];
+        if (endpoint_operation(ep->id, nullptr, 0, buffer, sizeof(T)) != (int)sizeof(T))
+            return -1;
+        read_le<T>(value, buffer);
+        return 0;
+    }
+
+    template<typename T>
+    int write(const std::string& path, T value) {
+        const RemoteEndpointInfo* ep = find_endpoint(path);
+        if (!ep)
+            return -1;
+        uint8_t buffer[sizeof(T)];
+        write_le<T>(value, buffer);
+        return endpoint_operation(ep->id, buffer, sizeof(T), nullptr, 0) < 0 ? -1 : 0;
+    }
+
+    // @brief Invokes a remote function. Arguments must have been written
+    // to its input endpoints (path + ".argname") beforehand.
+    int call(const std::string& path) {
+        const RemoteEndpointInfo* ep = find_endpoint(path);
+        if (!ep || ep->type != "function")
+            return -1;
+        return endpoint_operation(ep->id, nullptr, 0, nullptr, 0) < 0 ? -1 : 0;
+    }
+
+    // Future-based variants for overlapping communication with other work.
+    // Operations are serialized on the channel by endpoint_operation().
+    template<typename T>
+    std::future<T> read_async(const std::string& path) {
+        return std::async(std::launch::async, [this, path]() {
+            T value{};
+            read<T>(path, &value);
+            return value;
+        });
+    }
+
+    template<typename T>
+    std::future<int> write_async(const std::string& path, T value) {
+        return std::async(std::launch::async, [this, path, value]() {
+            return write<T>(path, value);
+        });
+    }
+
+    const std::vector<RemoteEndpointInfo>& endpoints() const { return endpoints_; }
+    uint16_t json_crc() const { return json_crc_; }
+
+private:
+    int fetch_json_descriptor(std::string& json);
+    int parse_json_descriptor(const std::string& json);
+
+    ClientTransport* transport_ = nullptr;
+    std::vector<RemoteEndpointInfo> endpoints_;
+    uint16_t json_crc_ = 0;
+    uint16_t outbound_seq_no_ = 0;
+    std::mutex channel_mutex_;
+};
+
+#endif // __FIBRE_CLIENT_HPP
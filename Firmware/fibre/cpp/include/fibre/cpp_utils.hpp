@@ -180,4 +180,127 @@ TRet invoke_function_with_tuple(TObj& obj, TRet(TObj::*func_ptr)(TArgs...), std:
     return function_traits<TObj, TRet, TArgs...>::template invoke<0>(obj, func_ptr, packed_args);
 }
 
+#include <atomic>
+#include <stdlib.h>
+
+/* @brief Lock-free single-producer/single-consumer ring buffer.
+
+Exactly one context may call write-side functions and exactly one context
+may call read-side functions. Under that contract no critical section is
+needed: the producer only advances write_index_, the consumer only
+advances read_index_, and both indices are only ever read by the other
+side through a std::atomic with acquire/release ordering. This makes the
+primitive suitable for ISR-to-thread data flow without masking interrupts.
+
+SIZE must be a power of two; one slot is kept free to distinguish full
+from empty, so the usable capacity is SIZE - 1.
+*/
+template<typename T, size_t SIZE>
+class SpscRingBuffer {
+public:
+    static_assert((SIZE & (SIZE - 1)) == 0, "SIZE must be a power of two");
+
+    // @brief Appends one element. Returns false if the buffer is full.
+    // May only be called from the producer context.
+    bool push(const T& value) {
+        size_t wr = write_index_.load(std::memory_order_relaxed);
+        size_t next = (wr + 1) & (SIZE - 1);
+        if (next == read_index_.load(std::memory_order_acquire))
+            return false; // full
+        buffer_[wr] = value;
+        write_index_.store(next, std::memory_order_release);
+        return true;
+    }
+
+    // @brief Removes the oldest element. Returns false if the buffer is empty.
+    // May only be called from the consumer context.
+    bool pop(T* value) {
+        size_t rd = read_index_.load(std::memory_order_relaxed);
+        if (rd == write_index_.load(std::memory_order_acquire))
+            return false; // empty
+        *value = buffer_[rd];
+        read_index_.store((rd + 1) & (SIZE - 1), std::memory_order_release);
+        return true;
+    }
+
+    // @brief Number of elements currently stored. Only an estimate if
+    // called concurrently with push/pop.
+    size_t count() const {
+        size_t wr = write_index_.load(std::memory_order_acquire);
+        size_t rd = read_index_.load(std::memory_order_acquire);
+        return (wr - rd) & (SIZE - 1);
+    }
+
+    size_t free_space() const {
+        return (SIZE - 1) - count();
+    }
+
+    bool empty() const { return count() == 0; }
+    bool full() const { return free_space() == 0; }
+
+    // @brief Discards all content. May only be called while neither
+    // producer nor consumer are active.
+    void clear() {
+        read_index_.store(0, std::memory_order_relaxed);
+        write_index_.store(0, std::memory_order_relaxed);
+    }
+
+private:
+    T buffer_[SIZE];
+    std::atomic<size_t> read_index_{0};
+    std::atomic<size_t> write_index_{0};
+};
+
+#include <new>
+#include <utility>
+#include <stddef.h>
+
+/* @brief Fixed-capacity bump allocator.
+
+Hands out memory from a caller-provided block with nothing but a pointer
+increment; individual objects are never freed, the whole arena is recycled
+with reset() in O(1). Intended for per-connection protocol state: carve
+everything a connection needs out of its arena at setup, then steady-state
+packet handling performs zero allocations and teardown is a single reset.
+*/
+class Arena {
+public:
+    Arena(uint8_t* buffer, size_t size) :
+        buffer_(buffer), size_(size) {}
+
+    // @brief Allocates uninitialized storage. Returns nullptr when the
+    // arena is exhausted.
+    void* alloc(size_t size, size_t alignment = alignof(max_align_t)) {
+        size_t pos = (pos_ + alignment - 1) & ~(alignment - 1);
+        if (pos + size > size_)
+            return nullptr;
+        pos_ = pos + size;
+        n_allocs_++;
+        return buffer_ + pos;
+    }
+
+    // @brief Constructs an object inside the arena. The caller must run
+    // the destructor explicitly (if needed) before reset().
+    template<typename T, typename ... Args>
+    T* make(Args&& ... args) {
+        void* storage = alloc(sizeof(T), alignof(T));
+        return storage ? new (storage) T(std::forward<Args>(args)...) : nullptr;
+    }
+
+    // @brief Recycles the whole arena. O(1); no destructors are run.
+    void reset() {
+        pos_ = 0;
+        n_allocs_ = 0;
+    }
+
+    size_t used() const { return pos_; }
+    size_t n_allocs() const { return n_allocs_; }
+
+private:
+    uint8_t* buffer_;
+    size_t size_;
+    size_t pos_ = 0;
+    size_t n_allocs_ = 0;
+};
+
 #endif // __CPP_UTILS_HPP
@@ -2,15 +2,26 @@
 #define __CRC_HPP
 
 #include <stdint.h>
+#include <stdlib.h>
 #include <limits.h>
 
-// Calculates an arbitrary CRC for one byte.
+// The bit-serial fallback can be selected for flash-constrained builds by
+// defining FIBRE_CRC_BITWISE. By default a 256-entry lookup table is
+// generated at compile time per (type, polynomial) combination, which
+// processes one byte per table lookup instead of eight shift/xor rounds.
+//
+// Note: the STM32F4 CRC peripheral only implements the fixed CRC-32
+// polynomial 0x04C11DB7 on 32-bit words, so it cannot back the CRC8/CRC16
+// polynomials used by the packet framing; the table-driven path is the
+// fastest implementation available for them.
+
+// Calculates an arbitrary CRC for one byte, one bit at a time.
 // Adapted from https://barrgroup.com/Embedded-Systems/How-To/CRC-Calculation-C-Code
 template<typename T, unsigned POLYNOMIAL>
-static T calc_crc(T remainder, uint8_t value) {
+static constexpr T calc_crc_bitwise(T remainder, uint8_t value) {
     constexpr T BIT_WIDTH = (CHAR_BIT * sizeof(T));
     constexpr T TOPBIT = ((T)1 << (BIT_WIDTH - 1));
-    
+
     // Bring the next byte into the remainder.
     remainder ^= (value << (BIT_WIDTH - 8));
 
@@ -26,13 +37,55 @@ static T calc_crc(T remainder, uint8_t value) {
     return remainder;
 }
 
+#ifndef FIBRE_CRC_BITWISE
+
+// 256-entry remainder table, generated at compile time and emitted into
+// flash once per (type, polynomial) combination.
+template<typename T, unsigned POLYNOMIAL>
+class CrcTable {
+public:
+    constexpr CrcTable() : table_() {
+        for (unsigned i = 0; i < 256; ++i)
+            table_[i] = calc_crc_bitwise<T, POLYNOMIAL>((T)0, (uint8_t)i);
+    }
+    T table_[256];
+};
+
+template<typename T, unsigned POLYNOMIAL>
+static T calc_crc(T remainder, uint8_t value) {
+    constexpr T BIT_WIDTH = (CHAR_BIT * sizeof(T));
+    static constexpr CrcTable<T, POLYNOMIAL> table{};
+    uint8_t index = (uint8_t)(value ^ (remainder >> (BIT_WIDTH - 8)));
+    return (T)((remainder << 8) ^ table.table_[index]);
+}
+
+template<typename T, unsigned POLYNOMIAL>
+static T calc_crc(T remainder, const uint8_t* buffer, size_t length) {
+    constexpr T BIT_WIDTH = (CHAR_BIT * sizeof(T));
+    static constexpr CrcTable<T, POLYNOMIAL> table{};
+    while (length--) {
+        uint8_t index = (uint8_t)(*(buffer++) ^ (remainder >> (BIT_WIDTH - 8)));
+        remainder = (T)((remainder << 8) ^ table.table_[index]);
+    }
+    return remainder;
+}
+
+#else
+
+template<typename T, unsigned POLYNOMIAL>
+static T calc_crc(T remainder, uint8_t value) {
+    return calc_crc_bitwise<T, POLYNOMIAL>(remainder, value);
+}
+
 template<typename T, unsigned POLYNOMIAL>
 static T calc_crc(T remainder, const uint8_t* buffer, size_t length) {
     while (length--)
-        remainder = calc_crc<T, POLYNOMIAL>(remainder, *(buffer++));
+        remainder = calc_crc_bitwise<T, POLYNOMIAL>(remainder, *(buffer++));
     return remainder;
 }
 
+#endif // FIBRE_CRC_BITWISE
+
 template<unsigned POLYNOMIAL>
 static uint8_t calc_crc8(uint8_t remainder, uint8_t value) {
     return calc_crc<uint8_t, POLYNOMIAL>(remainder, value);
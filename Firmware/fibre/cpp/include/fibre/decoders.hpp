@@ -162,12 +162,19 @@ private:
 
 /* Decoder implementations ---------------------------------------------------*/
 
+// @brief Flat varint decoder.
+// The varint fields are the most common decode operation, so instead of
+// composing a ByteDecoder with the generic wrapper (which funnels every
+// byte through two virtual calls) this decoder consumes the input buffer
+// directly in one non-virtual loop. Decode cost should be dominated by
+// the CRC and the copy, not by dispatch; the wrapper stack remains
+// available for composite decoders.
 template<typename T>
-class VarintByteDecoder : public ByteDecoder {
+class VarintStreamDecoder : public StreamDecoder {
 public:
-    static constexpr T BIT_WIDTH = (CHAR_BIT * sizeof(T));
+    static constexpr size_t BIT_WIDTH = (CHAR_BIT * sizeof(T));
 
-    VarintByteDecoder(T& state_variable) :
+    VarintStreamDecoder(T& state_variable) :
         state_variable_(state_variable)
     {
     }
@@ -180,43 +187,42 @@ public:
         return status_;
     }
 
-    int process_byte(uint8_t input_byte) final {
-        if (bit_pos_ == 0) {
-            LOG_FIBRE("start decoding varint, with 0x%02x => %zx\n", input_byte, (uintptr_t)&state_variable_);
-            state_variable_ = 0;
-        }
-        LOG_FIBRE("varint: decode %02x << %zu at %zx\n", input_byte, bit_pos_, &bit_pos_);
-        // we assume bit_pos_ < BIT_WIDTH
-        state_variable_ |= (static_cast<T>(input_byte & 0x7f) << bit_pos_);
-        if (((state_variable_ >> bit_pos_) & 0x7f) != static_cast<T>(input_byte & 0x7f)) {
-            LOG_FIBRE("varint overflow: tried to add %02x << %zu\n", input_byte, bit_pos_);
-            return (status_ = -1); // overflow
+    int process_bytes(const uint8_t* buffer, size_t length, size_t* processed_bytes) final {
+        while (!status_ && !done_ && length) {
+            uint8_t input_byte = *(buffer++);
+            length--;
+            if (processed_bytes) (*processed_bytes)++;
+            if (bit_pos_ == 0) {
+                LOG_FIBRE("start decoding varint, with 0x%02x => %zx\n", input_byte, (uintptr_t)&state_variable_);
+                state_variable_ = 0;
+            }
+            LOG_FIBRE("varint: decode %02x << %zu at %zx\n", input_byte, bit_pos_, &bit_pos_);
+            // we assume bit_pos_ < BIT_WIDTH
+            state_variable_ |= (static_cast<T>(input_byte & 0x7f) << bit_pos_);
+            if (((state_variable_ >> bit_pos_) & 0x7f) != static_cast<T>(input_byte & 0x7f)) {
+                LOG_FIBRE("varint overflow: tried to add %02x << %zu\n", input_byte, bit_pos_);
+                status_ = -1; // overflow
+                break;
+            }
+            bit_pos_ += 7;
+            done_ = !(input_byte & 0x80);
+            if (!done_ && bit_pos_ >= BIT_WIDTH)
+                status_ = -1;
         }
-        bit_pos_ += 7;
-        done_ = !(input_byte & 0x80);
-        return (status_ = (done_ || bit_pos_ < BIT_WIDTH) ? 0 : -1);
+        return status_;
     }
 
+    size_t get_free_space() { return SIZE_MAX; } // TODO: deprecate
+
 private:
     T& state_variable_;
-    // At all times where status_ != 0 the following statement holds:
+    // At all times where status_ == 0 the following statement holds:
     // (done_ || bit_pos_ < BIT_WIDTH)
-    //size_t bit_pos_ = 0; // bit position
     size_t bit_pos_ = 0; // bit position
     int status_ = 0;
     bool done_ = false;
-    int data[1024] = {0};
 };
 
-template<typename T>
-using VarintStreamDecoder = StreamDecoder_from_ByteDecoder<VarintByteDecoder<T>>;
-
-// This double nested type should work identically but makes it way harder for the compiler to optimize
-//template<typename T>
-//using VarintBlockDecoder = BlockDecoder_from_ByteDecoder<VarintByteDecoder<T>>;
-//template<typename T>
-//using VarintStreamDecoder = StreamDecoder_from_BlockDecoder<VarintBlockDecoder<T>>;
-
 template<typename T>
 inline VarintStreamDecoder<T> make_varint_decoder(T& variable) {
     return VarintStreamDecoder<T>(variable);
@@ -320,4 +320,68 @@ EncoderChain<TEncoders...> make_encoder_chain(TEncoders&& ... encoders) {
     return EncoderChain<TEncoders...>(std::forward<TEncoders>(encoders)...);
 }
 
+/* Zero-copy frame encoder ----------------------------------------------------*/
+
+// @brief Serializes values directly into the final transport buffer.
+//
+// The encoder chain above pulls bytes through intermediate per-encoder
+// buffers and StreamBasedPacketSink::process_packet then copies the
+// assembled packet again while framing it. FrameEncoder avoids both:
+// values are written in wire format straight at their final position in
+// the caller's buffer (typically the transport's TX buffer) and
+// finalize() completes the frame with one table-driven CRC16 pass over
+// the finished payload. The emitted bytes are identical to the canonical
+// stream framing (sync byte, length, CRC8 header, payload, CRC16), so
+// the receiving side needs no changes.
+class FrameEncoder {
+public:
+    static constexpr size_t HEADER_SIZE = 3;
+    static constexpr size_t TRAILER_SIZE = 2;
+
+    FrameEncoder(uint8_t* buffer, size_t capacity) :
+        buffer_(buffer),
+        capacity_(capacity),
+        pos_(HEADER_SIZE) // the header is filled in by finalize()
+    {}
+
+    template<typename T>
+    int write(T value) {
+        if (status_ || pos_ + sizeof(T) + TRAILER_SIZE > capacity_)
+            return status_ = -1;
+        pos_ += write_le<T>(value, buffer_ + pos_);
+        return 0;
+    }
+
+    int write_bytes(const uint8_t* data, size_t length) {
+        if (status_ || pos_ + length + TRAILER_SIZE > capacity_)
+            return status_ = -1;
+        memcpy(buffer_ + pos_, data, length);
+        pos_ += length;
+        return 0;
+    }
+
+    // @brief Writes the frame header and the trailing CRC16.
+    // @return total frame length in the buffer, or -1 if the encoder
+    // overflowed or the payload exceeds the framing's length field
+    int finalize() {
+        size_t payload_length = pos_ - HEADER_SIZE;
+        if (status_ || payload_length > STREAM_MAX_PAYLOAD)
+            return -1;
+        buffer_[0] = CANONICAL_PREFIX;
+        buffer_[1] = (uint8_t)payload_length;
+        buffer_[2] = calc_crc8<CANONICAL_CRC8_POLYNOMIAL>(CANONICAL_CRC8_INIT, buffer_, 2);
+        uint16_t crc16 = calc_crc16<CANONICAL_CRC16_POLYNOMIAL>(CANONICAL_CRC16_INIT,
+                buffer_ + HEADER_SIZE, payload_length);
+        buffer_[pos_++] = (uint8_t)((crc16 >> 8) & 0xff);
+        buffer_[pos_++] = (uint8_t)(crc16 & 0xff);
+        return (int)pos_;
+    }
+
+private:
+    uint8_t* buffer_;
+    size_t capacity_;
+    size_t pos_;
+    int status_ = 0;
+};
+
 #endif // __ENCODERS_HPP
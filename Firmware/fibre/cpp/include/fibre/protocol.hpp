@@ -68,9 +68,25 @@ struct ReceiverState {
 
 constexpr uint16_t PROTOCOL_VERSION = 1;
 
-// This value must not be larger than USB_TX_DATA_SIZE defined in usbd_cdc_if.h
-constexpr uint16_t TX_BUF_SIZE = 32; // does not work with 64 for some reason
-constexpr uint16_t RX_BUF_SIZE = 128; // larger values than 128 have currently no effect because of protocol limitations
+// The stream framing (StreamToPacketSegmenter / StreamBasedPacketSink)
+// carries the payload length in a single byte whose MSB is reserved, so a
+// stream-framed packet holds at most 127 payload bytes.
+constexpr uint16_t STREAM_MAX_PAYLOAD = 127;
+
+// Response buffer of a BidirectionalPacketBasedChannel. Responses are
+// additionally clamped to the output sink's MTU (see PacketSink::get_mtu),
+// so this may exceed what narrow transports can carry: USB native packets
+// use the full size while stream-framed transports are clamped to
+// STREAM_MAX_PAYLOAD. It used to be 64, which also hung the USB channel
+// because transfers that are an exact multiple of the endpoint's max packet
+// size were not terminated with a zero-length packet; the USB sender
+// handles that now.
+constexpr uint16_t TX_BUF_SIZE = 256;
+
+// A maximum-size incoming stream frame is STREAM_MAX_PAYLOAD payload bytes
+// plus the 16 bit packet CRC. The previous magic 128 was one byte short of
+// that, so full-length frames were silently dropped by the segmenter.
+constexpr uint16_t RX_BUF_SIZE = STREAM_MAX_PAYLOAD + 2;
 
 // Maximum time we allocate for processing and responding to a request
 constexpr uint32_t PROTOCOL_SERVER_TIMEOUT_MS = 10;
@@ -135,9 +151,11 @@ static inline T read_le(const uint8_t** buffer, size_t* length) {
 class PacketSink {
 public:
     // @brief Get the maximum packet length (aka maximum transmission unit)
-    // A packet size shall take no action and return an error code if the
-    // caller attempts to send an oversized packet.
-    //virtual size_t get_mtu() = 0;
+    // A packet sink shall take no action and return an error code if the
+    // caller attempts to send an oversized packet. The protocol channel
+    // clamps its responses to this, so narrow transports receive packets
+    // they can actually carry.
+    virtual size_t get_mtu() { return SIZE_MAX; }
 
     // @brief Processes a packet.
     // The blocking behavior shall depend on the thread-local deadline_ms variable.
@@ -189,9 +207,21 @@ public:
     };
 
     int process_bytes(const uint8_t *buffer, size_t length, size_t* processed_bytes);
-    
+
     size_t get_free_space() { return SIZE_MAX; }
 
+    // @brief Number of bytes the segmenter can consume before it either
+    // completes the pending packet or resumes hunting for a sync byte.
+    // Returns 0 while it is idle (not inside a frame), which lets a
+    // demultiplexer route non-fibre bytes elsewhere.
+    size_t requested_bytes() const {
+        if (header_index_ == 0)
+            return 0;
+        if (header_index_ < sizeof(header_buffer_))
+            return sizeof(header_buffer_) - header_index_;
+        return packet_length_ - packet_index_;
+    }
+
 private:
     uint8_t header_buffer_[3];
     size_t header_index_ = 0;
@@ -209,7 +239,7 @@ public:
     {
     };
     
-    //size_t get_mtu() { return SIZE_MAX; }
+    size_t get_mtu() { return STREAM_MAX_PAYLOAD; }
     int process_packet(const uint8_t *buffer, size_t length);
 
 private:
@@ -441,6 +471,14 @@ inline constexpr const char* get_default_json_modifier<uint32_t>() {
     return "\"type\":\"uint32\",\"access\":\"rw\"";
 }
 template<>
+inline constexpr const char* get_default_json_modifier<const int16_t>() {
+    return "\"type\":\"int16\",\"access\":\"r\"";
+}
+template<>
+inline constexpr const char* get_default_json_modifier<int16_t>() {
+    return "\"type\":\"int16\",\"access\":\"rw\"";
+}
+template<>
 inline constexpr const char* get_default_json_modifier<const uint16_t>() {
     return "\"type\":\"uint16\",\"access\":\"r\"";
 }
@@ -469,6 +507,50 @@ inline constexpr const char* get_default_json_modifier<endpoint_ref_t>() {
     return "\"type\":\"endpoint_ref\",\"access\":\"rw\"";
 }
 
+// Compact type codes for the bounded-time endpoint lookup (see the name
+// hash request flags in JSONDescriptorEndpoint::handle): a minimal host
+// can learn an endpoint's wire type without ever parsing the JSON
+// descriptor. Bit 7 set marks a read-only endpoint.
+enum fibre_endpoint_type_t : uint8_t {
+    FIBRE_TYPE_NONE = 0, // endpoint does not exist
+    FIBRE_TYPE_JSON = 1,
+    FIBRE_TYPE_BOOL = 2,
+    FIBRE_TYPE_UINT8 = 3,
+    FIBRE_TYPE_INT16 = 4,
+    FIBRE_TYPE_UINT16 = 5,
+    FIBRE_TYPE_INT32 = 6,
+    FIBRE_TYPE_UINT32 = 7,
+    FIBRE_TYPE_INT64 = 8,
+    FIBRE_TYPE_UINT64 = 9,
+    FIBRE_TYPE_FLOAT = 10,
+    FIBRE_TYPE_ENDPOINT_REF = 11,
+    FIBRE_TYPE_FUNCTION = 12,
+    FIBRE_TYPE_RO_FLAG = 0x80,
+};
+
+template<typename T>
+static inline constexpr uint8_t get_default_type_code();
+template<> inline constexpr uint8_t get_default_type_code<float>() { return FIBRE_TYPE_FLOAT; }
+template<> inline constexpr uint8_t get_default_type_code<const float>() { return FIBRE_TYPE_FLOAT | FIBRE_TYPE_RO_FLAG; }
+template<> inline constexpr uint8_t get_default_type_code<bool>() { return FIBRE_TYPE_BOOL; }
+template<> inline constexpr uint8_t get_default_type_code<const bool>() { return FIBRE_TYPE_BOOL | FIBRE_TYPE_RO_FLAG; }
+template<> inline constexpr uint8_t get_default_type_code<uint8_t>() { return FIBRE_TYPE_UINT8; }
+template<> inline constexpr uint8_t get_default_type_code<const uint8_t>() { return FIBRE_TYPE_UINT8 | FIBRE_TYPE_RO_FLAG; }
+template<> inline constexpr uint8_t get_default_type_code<int16_t>() { return FIBRE_TYPE_INT16; }
+template<> inline constexpr uint8_t get_default_type_code<const int16_t>() { return FIBRE_TYPE_INT16 | FIBRE_TYPE_RO_FLAG; }
+template<> inline constexpr uint8_t get_default_type_code<uint16_t>() { return FIBRE_TYPE_UINT16; }
+template<> inline constexpr uint8_t get_default_type_code<const uint16_t>() { return FIBRE_TYPE_UINT16 | FIBRE_TYPE_RO_FLAG; }
+template<> inline constexpr uint8_t get_default_type_code<int32_t>() { return FIBRE_TYPE_INT32; }
+template<> inline constexpr uint8_t get_default_type_code<const int32_t>() { return FIBRE_TYPE_INT32 | FIBRE_TYPE_RO_FLAG; }
+template<> inline constexpr uint8_t get_default_type_code<uint32_t>() { return FIBRE_TYPE_UINT32; }
+template<> inline constexpr uint8_t get_default_type_code<const uint32_t>() { return FIBRE_TYPE_UINT32 | FIBRE_TYPE_RO_FLAG; }
+template<> inline constexpr uint8_t get_default_type_code<int64_t>() { return FIBRE_TYPE_INT64; }
+template<> inline constexpr uint8_t get_default_type_code<const int64_t>() { return FIBRE_TYPE_INT64 | FIBRE_TYPE_RO_FLAG; }
+template<> inline constexpr uint8_t get_default_type_code<uint64_t>() { return FIBRE_TYPE_UINT64; }
+template<> inline constexpr uint8_t get_default_type_code<const uint64_t>() { return FIBRE_TYPE_UINT64 | FIBRE_TYPE_RO_FLAG; }
+template<> inline constexpr uint8_t get_default_type_code<endpoint_ref_t>() { return FIBRE_TYPE_ENDPOINT_REF; }
+template<> inline constexpr uint8_t get_default_type_code<const endpoint_ref_t>() { return FIBRE_TYPE_ENDPOINT_REF | FIBRE_TYPE_RO_FLAG; }
+
 class Endpoint {
 public:
     //const char* const name_;
@@ -476,12 +558,57 @@ public:
     virtual bool get_string(char * output, size_t length) { return false; }
     virtual bool set_string(char * buffer, size_t length) { return false; }
     virtual bool set_from_float(float value) { return false; }
+    virtual bool get_as_float(float* value) { return false; }
+    virtual uint8_t type_id() { return FIBRE_TYPE_NONE; }
+};
+
+// Flat dispatch table, one entry per endpoint ID, filled by
+// register_endpoints() during fibre_publish(). `handler` is a non-virtual
+// trampoline of the concrete endpoint class and `ctx` is the endpoint
+// object (stored as its Endpoint base pointer), so per-packet dispatch is
+// a single indirect call with no vtable lookup, and the compiler is free
+// to inline the final handler into its trampoline. The Endpoint objects
+// themselves stay around for the cold paths (named ASCII access,
+// set_from_float/get_as_float users).
+typedef void (*endpoint_handler_t)(void* ctx, const uint8_t* input, size_t input_length, StreamSink* output);
+struct endpoint_dispatch_entry_t {
+    endpoint_handler_t handler;
+    void* ctx;
 };
 
 static inline int write_string(const char* str, StreamSink* output) {
     return output->process_bytes(reinterpret_cast<const uint8_t*>(str), strlen(str), nullptr);
 }
 
+// @brief 32-bit FNV-1a over a NUL-terminated string.
+// constexpr (and recursive, so C++11 accepts it), which means it folds to a
+// literal when applied to a string literal: resource constrained hosts can
+// bake the hashes of the endpoint paths they care about into their firmware
+// and resolve them to endpoint IDs via endpoint 0 (see
+// JSONDescriptorEndpoint::handle) without ever fetching the JSON descriptor.
+// Hashing "a.b" is equivalent to chaining the segments:
+// fibre_name_hash("b", fibre_name_hash(".", fibre_name_hash("a"))).
+static constexpr uint32_t fibre_name_hash(const char* str, uint32_t hash = 2166136261u) {
+    return *str ? fibre_name_hash(str + 1, (hash ^ (uint8_t)*str) * 16777619u) : hash;
+}
+
+// One row of the name hash table: maps the FNV-1a hash of a full
+// dot-separated endpoint path (e.g. "axis0.motor.config.pole_pairs") to the
+// corresponding endpoint ID. The table is built by fibre_publish() and
+// sorted by hash so lookups can bisect.
+struct endpoint_name_hash_entry_t {
+    uint32_t hash;
+    uint16_t endpoint_id;
+};
+
+// Stable endpoint ID space: wire endpoint IDs at or above this base are
+// indices into an append-only, checked-in manifest of endpoint path hashes
+// (see fibre_set_stable_id_map) instead of positions in the JSON tree, so
+// they survive tree re-numbering across firmware updates. Stable-ID
+// requests use PROTOCOL_VERSION as the packet trailer - the json_crc_
+// guard is exactly the dependency they exist to avoid.
+#define STABLE_ENDPOINT_ID_BASE 0x4000
+
 
 /* @brief Handles the communication protocol on one channel.
 *
@@ -492,6 +619,19 @@ static inline int write_string(const char* str, StreamSink* output) {
 */
 class BidirectionalPacketBasedChannel : public PacketSink {
 public:
+    // Per-channel token bucket limiting how many endpoint operations this
+    // channel may dispatch. The bucket is accounted in microseconds of
+    // credit: a full bucket holds `burst` operations and refills at
+    // `ops_per_sec`. Operations arriving on an empty bucket are dropped
+    // before dispatch (no response; the host's request times out like any
+    // lost packet) and counted through `drop_cnt`. Disabled by default and
+    // whenever no us-clock is registered.
+    struct RateLimit_t {
+        uint32_t ops_per_sec = 0;   //!< refill rate, 0 = unlimited
+        uint32_t burst = 8;         //!< bucket capacity in operations
+        uint32_t* drop_cnt = nullptr; //!< incremented per dropped operation
+    };
+
     BidirectionalPacketBasedChannel(PacketSink& output) :
         output_(output)
     { }
@@ -500,9 +640,16 @@ public:
     //    return SIZE_MAX;
     //}
     int process_packet(const uint8_t* buffer, size_t length);
+
+    RateLimit_t rate_limit_;
 private:
+    bool consume_rate_limit_token();
+
     PacketSink& output_;
     uint8_t tx_buf_[TX_BUF_SIZE];
+    uint32_t bucket_us_ = 0;
+    uint32_t last_refill_us_ = 0;
+    bool rate_limit_armed_ = false;
 };
 
 
@@ -612,7 +759,10 @@ public:
     void write_json(size_t id, StreamSink* output) {
         // no action
     }
-    void register_endpoints(Endpoint** list, size_t id, size_t length) {
+    void register_endpoints(endpoint_dispatch_entry_t* table, size_t id, size_t length) {
+        // no action
+    }
+    void register_name_hashes(endpoint_name_hash_entry_t* table, size_t* table_pos, size_t table_length, uint32_t prefix, size_t id) {
         // no action
     }
     Endpoint* get_by_name(const char * name, size_t length) {
@@ -653,9 +803,14 @@ public:
         else return subsequent_members_.get_by_name(name, length);
     }
 
-    void register_endpoints(Endpoint** list, size_t id, size_t length) /*final*/ {
-        this_member_.register_endpoints(list, id, length);
-        subsequent_members_.register_endpoints(list, id + TMember::endpoint_count, length);
+    void register_endpoints(endpoint_dispatch_entry_t* table, size_t id, size_t length) /*final*/ {
+        this_member_.register_endpoints(table, id, length);
+        subsequent_members_.register_endpoints(table, id + TMember::endpoint_count, length);
+    }
+
+    void register_name_hashes(endpoint_name_hash_entry_t* table, size_t* table_pos, size_t table_length, uint32_t prefix, size_t id) {
+        this_member_.register_name_hashes(table, table_pos, table_length, prefix, id);
+        subsequent_members_.register_name_hashes(table, table_pos, table_length, prefix, id + TMember::endpoint_count);
     }
 
     TMember this_member_;
@@ -692,10 +847,17 @@ public:
             return nullptr;
     }
 
-    void register_endpoints(Endpoint** list, size_t id, size_t length) {
-        member_list_.register_endpoints(list, id, length);
+    void register_endpoints(endpoint_dispatch_entry_t* table, size_t id, size_t length) {
+        member_list_.register_endpoints(table, id, length);
     }
-    
+
+    void register_name_hashes(endpoint_name_hash_entry_t* table, size_t* table_pos, size_t table_length, uint32_t prefix, size_t id) {
+        // objects have no endpoint of their own - extend the prefix with
+        // "<name>." and descend
+        member_list_.register_name_hashes(table, table_pos, table_length,
+                fibre_name_hash(".", fibre_name_hash(name_, prefix)), id);
+    }
+
     const char * name_;
     MemberList<TMembers...> member_list_;
 };
@@ -732,6 +894,26 @@ template<typename T>
 bool set_from_float(float value, T* property) {
     return set_from_float_ex<T>(value, property, 0);
 }
+template<typename T>
+bool get_float_ex(const float* property, float* value, int) {
+    return *value = *property, true;
+}
+template<typename T>
+bool get_float_ex(const bool* property, float* value, int) {
+    return *value = (*property ? 1.0f : 0.0f), true;
+}
+template<typename T, typename = std::enable_if_t<std::is_integral<T>::value>>
+bool get_float_ex(const T* property, float* value, int) {
+    return *value = static_cast<float>(*property), true;
+}
+template<typename T>
+bool get_float_ex(const T* property, float* value, ...) {
+    return false;
+}
+template<typename T>
+bool get_float(const T* property, float* value) {
+    return get_float_ex<T>(property, value, 0);
+}
 }
 
 //template<typename T>
@@ -819,9 +1001,21 @@ public:
         return conversion::set_from_float(value, property_);
     }
 
-    void register_endpoints(Endpoint** list, size_t id, size_t length) {
+    bool get_as_float(float* value) final {
+        return conversion::get_float(property_, value);
+    }
+
+    uint8_t type_id() final {
+        return get_default_type_code<TProperty>();
+    }
+
+    void register_endpoints(endpoint_dispatch_entry_t* table, size_t id, size_t length) {
         if (id < length)
-            list[id] = this;
+            table[id] = { &handle_trampoline, static_cast<Endpoint*>(this) };
+    }
+    void register_name_hashes(endpoint_name_hash_entry_t* table, size_t* table_pos, size_t table_length, uint32_t prefix, size_t id) {
+        if (*table_pos < table_length)
+            table[(*table_pos)++] = { fibre_name_hash(name_, prefix), (uint16_t)id };
     }
     void handle(const uint8_t* input, size_t input_length, StreamSink* output) final {
         bool wrote = default_readwrite_endpoint_handler<TProperty>(property_, input, input_length, output);
@@ -829,6 +1023,11 @@ public:
             written_hook_(ctx_);
         }
     }
+    // non-virtual dispatch entry point - the qualified call devirtualizes
+    // handle() so it can be inlined here
+    static void handle_trampoline(void* ctx, const uint8_t* input, size_t input_length, StreamSink* output) {
+        static_cast<ProtocolProperty*>(static_cast<Endpoint*>(ctx))->ProtocolProperty::handle(input, input_length, output);
+    }
     /*void handle(const uint8_t* input, size_t input_length, StreamSink* output) {
         handle(input, input_length, output);
     }*/
@@ -870,6 +1069,147 @@ ProtocolProperty<const std::underlying_type_t<TProperty>> make_protocol_ro_prope
 };
 
 
+template<typename T>
+static inline constexpr const char* get_default_json_type_name();
+
+template<> inline constexpr const char* get_default_json_type_name<float>() { return "float"; }
+template<> inline constexpr const char* get_default_json_type_name<int32_t>() { return "int32"; }
+template<> inline constexpr const char* get_default_json_type_name<uint32_t>() { return "uint32"; }
+template<> inline constexpr const char* get_default_json_type_name<int16_t>() { return "int16"; }
+template<> inline constexpr const char* get_default_json_type_name<uint16_t>() { return "uint16"; }
+template<> inline constexpr const char* get_default_json_type_name<uint8_t>() { return "uint8"; }
+
+// @brief Endpoint exposing a contiguous numeric buffer with ranged access.
+//
+// The request payload starts with two uint32 values (element offset and
+// element count), optionally followed by count elements to be stored.
+// If the elements are absent the request is a read and up to count
+// elements starting at offset are returned, truncated to what fits into
+// the response buffer. Offset and count are clamped to the buffer bounds.
+// This allows large buffers (anticogging map, oscilloscope) to be
+// transferred in a few packets instead of one transaction per element.
+template<typename T>
+class ProtocolArrayProperty : public Endpoint {
+public:
+    static constexpr size_t endpoint_count = 1;
+
+    ProtocolArrayProperty(const char * name, T* array, size_t length)
+        : name_(name), array_(array), indirect_(nullptr), length_(length), length_ptr_(nullptr) {}
+
+    // For buffers that are only allocated after the object tree is built:
+    // pointer and length are dereferenced on every access instead of being
+    // captured here. Requests are rejected while the pointer is still null.
+    ProtocolArrayProperty(const char * name, T* const * array_ptr, const size_t* length_ptr)
+        : name_(name), array_(nullptr), indirect_(array_ptr), length_(0), length_ptr_(length_ptr) {}
+
+    void write_json(size_t id, StreamSink* output) {
+        // write name
+        write_string("{\"name\":\"", output);
+        write_string(name_, output);
+
+        // write endpoint ID
+        write_string("\",\"id\":", output);
+        char buf[10];
+        snprintf(buf, sizeof(buf), "%u", (unsigned)id); // TODO: get rid of printf
+        write_string(buf, output);
+
+        // write element type and length
+        write_string(",\"type\":\"array\",\"elem_type\":\"", output);
+        write_string(get_default_json_type_name<std::remove_const_t<T>>(), output);
+        write_string("\",\"access\":\"", output);
+        write_string(std::is_const<T>::value ? "r" : "rw", output);
+        write_string("\",\"length\":", output);
+        snprintf(buf, sizeof(buf), "%u", (unsigned)get_length());
+        write_string(buf, output);
+        write_string("}", output);
+    }
+
+    // special-purpose function - to be moved
+    Endpoint* get_by_name(const char * name, size_t length) {
+        return nullptr; // can't address arrays by name
+    }
+
+    uint8_t type_id() final {
+        return get_default_type_code<T>();
+    }
+
+    void register_endpoints(endpoint_dispatch_entry_t* table, size_t id, size_t length) {
+        if (id < length)
+            table[id] = { &handle_trampoline, static_cast<Endpoint*>(this) };
+    }
+
+    void register_name_hashes(endpoint_name_hash_entry_t* table, size_t* table_pos, size_t table_length, uint32_t prefix, size_t id) {
+        if (*table_pos < table_length)
+            table[(*table_pos)++] = { fibre_name_hash(name_, prefix), (uint16_t)id };
+    }
+
+    static void handle_trampoline(void* ctx, const uint8_t* input, size_t input_length, StreamSink* output) {
+        static_cast<ProtocolArrayProperty*>(static_cast<Endpoint*>(ctx))->ProtocolArrayProperty::handle(input, input_length, output);
+    }
+
+    template<typename U = T> std::enable_if_t<!std::is_const<U>::value>
+    store_elements(U* array, const uint8_t* input, size_t count) {
+        for (size_t i = 0; i < count; ++i)
+            input += read_le(&array[i], input);
+    }
+    template<typename U = T> std::enable_if_t<std::is_const<U>::value>
+    store_elements(U* array, const uint8_t* input, size_t count) {
+        // read-only array, ignore the write request
+    }
+
+    size_t get_length() const {
+        return length_ptr_ ? *length_ptr_ : length_;
+    }
+
+    void handle(const uint8_t* input, size_t input_length, StreamSink* output) final {
+        T* array = indirect_ ? *indirect_ : array_;
+        size_t length = get_length();
+        if (array == nullptr || input_length < 8)
+            return;
+        uint32_t offset = read_le<uint32_t>(&input, &input_length);
+        uint32_t count = read_le<uint32_t>(&input, &input_length);
+        if (offset >= length)
+            return;
+        if (count > length - offset)
+            count = length - offset;
+        if (!std::is_const<T>::value && input_length >= count * sizeof(T)) {
+            store_elements(array + offset, input, count);
+        } else if (output) {
+            uint8_t buffer[sizeof(T)];
+            for (size_t i = 0; i < count; ++i) {
+                size_t cnt = write_le<std::remove_const_t<T>>(array[offset + i], buffer);
+                if (cnt > output->get_free_space())
+                    break; // response full; the host continues at a new offset
+                output->process_bytes(buffer, cnt, nullptr);
+            }
+        }
+    }
+
+    const char * name_;
+    T* array_;
+    T* const * indirect_;
+    size_t length_;
+    const size_t* length_ptr_;
+};
+
+template<typename T>
+ProtocolArrayProperty<T> make_protocol_array_property(const char * name, T* array, size_t length) {
+    return ProtocolArrayProperty<T>(name, array, length);
+};
+
+template<typename T>
+ProtocolArrayProperty<const T> make_protocol_ro_array_property(const char * name, T* array, size_t length) {
+    return ProtocolArrayProperty<const T>(name, array, length);
+};
+
+// For buffers allocated after the object tree is built (see the
+// corresponding constructor).
+template<typename T>
+ProtocolArrayProperty<T> make_protocol_indirect_array_property(const char * name, T* const * array_ptr, const size_t* length_ptr) {
+    return ProtocolArrayProperty<T>(name, array_ptr, length_ptr);
+};
+
+
 template<typename ... TArgs>
 struct PropertyListFactory;
 
@@ -969,11 +1309,30 @@ public:
         return nullptr; // can't address functions by name
     }
 
-    void register_endpoints(Endpoint** list, size_t id, size_t length) {
+    uint8_t type_id() final {
+        return FIBRE_TYPE_FUNCTION;
+    }
+
+    void register_endpoints(endpoint_dispatch_entry_t* table, size_t id, size_t length) {
         if (id < length)
-            list[id] = this;
-        input_properties_.register_endpoints(list, id + 1, length);
-        output_properties_.register_endpoints(list, id + 1 + decltype(input_properties_)::endpoint_count, length);
+            table[id] = { &handle_trampoline, static_cast<Endpoint*>(this) };
+        input_properties_.register_endpoints(table, id + 1, length);
+        output_properties_.register_endpoints(table, id + 1 + decltype(input_properties_)::endpoint_count, length);
+    }
+
+    void register_name_hashes(endpoint_name_hash_entry_t* table, size_t* table_pos, size_t table_length, uint32_t prefix, size_t id) {
+        // the trigger endpoint gets the function path itself; the argument
+        // properties hang off it like object members
+        uint32_t hash = fibre_name_hash(name_, prefix);
+        if (*table_pos < table_length)
+            table[(*table_pos)++] = { hash, (uint16_t)id };
+        uint32_t arg_prefix = fibre_name_hash(".", hash);
+        input_properties_.register_name_hashes(table, table_pos, table_length, arg_prefix, id + 1);
+        output_properties_.register_name_hashes(table, table_pos, table_length, arg_prefix, id + 1 + decltype(input_properties_)::endpoint_count);
+    }
+
+    static void handle_trampoline(void* ctx, const uint8_t* input, size_t input_length, StreamSink* output) {
+        static_cast<ProtocolFunction*>(static_cast<Endpoint*>(ctx))->ProtocolFunction::handle(input, input_length, output);
     }
 
     template<size_t i = sizeof...(TOutputs)> std::enable_if_t<i == 0>
@@ -1044,7 +1403,7 @@ public:
     virtual size_t get_endpoint_count() = 0;
     virtual void write_json(size_t id, StreamSink* output) = 0;
     virtual Endpoint* get_by_name(char * name, size_t length) = 0;
-    virtual void register_endpoints(Endpoint** list, size_t id, size_t length) = 0;
+    virtual void register_endpoints(endpoint_dispatch_entry_t* table, size_t id, size_t length) = 0;
 };
 
 template<typename T>
@@ -1057,8 +1416,8 @@ public:
     void write_json(size_t id, StreamSink* output) final {
         return member_list_.write_json(id, output);
     }
-    void register_endpoints(Endpoint** list, size_t id, size_t length) final {
-        return member_list_.register_endpoints(list, id, length);
+    void register_endpoints(endpoint_dispatch_entry_t* table, size_t id, size_t length) final {
+        return member_list_.register_endpoints(table, id, length);
     }
     Endpoint* get_by_name(char * name, size_t length) final {
         for (size_t i = 0; i < length; i++) {
@@ -1077,12 +1436,14 @@ class JSONDescriptorEndpoint : Endpoint {
 public:
     static constexpr size_t endpoint_count = 1;
     void write_json(size_t id, StreamSink* output);
-    void register_endpoints(Endpoint** list, size_t id, size_t length);
+    void register_endpoints(endpoint_dispatch_entry_t* table, size_t id, size_t length);
     void handle(const uint8_t* input, size_t input_length, StreamSink* output);
+    static void handle_trampoline(void* ctx, const uint8_t* input, size_t input_length, StreamSink* output);
+    uint8_t type_id() final { return FIBRE_TYPE_JSON | FIBRE_TYPE_RO_FLAG; }
 };
 
 // defined in protocol.cpp
-extern Endpoint** endpoint_list_;
+extern const endpoint_dispatch_entry_t* endpoint_table_;
 extern size_t n_endpoints_;
 extern uint16_t json_crc_;
 extern JSONDescriptorEndpoint json_file_endpoint_;
@@ -1090,6 +1451,58 @@ extern EndpointProvider* application_endpoints_;
 
 bool is_endpoint_ref_valid(endpoint_ref_t endpoint_ref);
 Endpoint* get_endpoint(endpoint_ref_t endpoint_ref);
+void fibre_cache_json_descriptor(void);
+
+// Name hash table, built and sorted by fibre_publish()
+extern const endpoint_name_hash_entry_t* endpoint_name_hash_table_;
+extern size_t n_name_hashes_;
+void fibre_sort_name_hash_table(endpoint_name_hash_entry_t* table, size_t length);
+// @brief Resolves the FNV-1a hash of a dot-separated endpoint path to its
+// endpoint ID, or 0xffff if no endpoint matches. On a (crazy unlikely)
+// hash collision the entry with the lower endpoint ID wins.
+uint16_t fibre_resolve_name_hash(uint32_t hash);
+// @brief Returns the fibre_endpoint_type_t code of an endpoint (with
+// FIBRE_TYPE_RO_FLAG set for read-only ones), or FIBRE_TYPE_NONE if the
+// ID is out of range.
+uint8_t fibre_get_endpoint_type(uint16_t endpoint_id);
+
+// @brief Installs the stable-ID manifest: entry i maps wire endpoint ID
+// STABLE_ENDPOINT_ID_BASE + i to the endpoint whose path hash is
+// name_hashes[i]. Must be called after fibre_publish(). Entries whose path
+// does not exist in this build (e.g. axis1 paths on a single-axis build)
+// are left unroutable and requests to them are rejected.
+void fibre_set_stable_id_map(const uint32_t* name_hashes, size_t count);
+
+// Aggregate endpoint access statistics, maintained by the packet dispatch
+// in protocol.cpp. Per-endpoint counters are kept in a separate array and
+// read out via fibre_get_endpoint_access_cnt().
+typedef struct {
+    uint32_t access_cnt;              // operations dispatched since last reset
+    uint32_t max_handler_us;          // worst-case single handler duration
+    uint32_t max_handler_endpoint_id; // endpoint that produced max_handler_us
+} fibre_endpoint_stats_t;
+extern fibre_endpoint_stats_t fibre_endpoint_stats_;
+
+// @brief Provides the microsecond clock used for handler duration tracking.
+// Not set by default since the protocol code is platform agnostic; without
+// it only the access counters are maintained.
+void fibre_set_us_clock(uint32_t (*us_clock)(void));
+// @brief Registers the lock serializing endpoint handler execution across
+// channel instances. Channels have independent buffers and serving threads;
+// only the shared endpoint handlers need mutual exclusion. The lock is held
+// per dispatched operation and released before the response is transmitted,
+// so the latency a busy interface adds to a competing one is bounded by one
+// handler duration, never by the busy interface's transport. Unset by
+// default (single-threaded hosts don't need it).
+void fibre_set_endpoint_lock(void (*lock)(void), void (*unlock)(void));
+// @brief Returns the us-clock timestamp taken when the packet currently
+// being dispatched entered process_packet. Meaningful only from within an
+// endpoint handler; an application-level ping endpoint can subtract this
+// from the current time to report its parse-to-response duration.
+uint32_t fibre_get_last_parse_us(void);
+void fibre_init_endpoint_stats(void);
+uint32_t fibre_get_endpoint_access_cnt(uint32_t endpoint_id);
+void fibre_reset_endpoint_stats(void);
 
 // @brief Registers the specified application object list using the provided endpoint table.
 // This function should only be called once during the lifetime of the application. TODO: fix this.
@@ -1097,23 +1510,36 @@ Endpoint* get_endpoint(endpoint_ref_t endpoint_ref);
 template<typename T>
 int fibre_publish(T& application_objects) {
     static constexpr size_t endpoint_list_size = 1 + T::endpoint_count;
-    static Endpoint* endpoint_list[endpoint_list_size];
+    static_assert(endpoint_list_size <= 0x7fff,
+            "endpoint IDs are 15 bits on the wire (the MSB requests a response)");
+    // zero-initialized, so unregistered IDs have a null handler
+    static endpoint_dispatch_entry_t endpoint_table[endpoint_list_size];
     static auto endpoint_provider = EndpointProvider_from_MemberList<T>(application_objects);
 
-    json_file_endpoint_.register_endpoints(endpoint_list, 0, endpoint_list_size);
-    application_objects.register_endpoints(endpoint_list, 1, endpoint_list_size);
+    json_file_endpoint_.register_endpoints(endpoint_table, 0, endpoint_list_size);
+    application_objects.register_endpoints(endpoint_table, 1, endpoint_list_size);
+
+    // Name hash table: one row per named endpoint (the JSON endpoint has no
+    // name). The top-level prefix is the plain FNV basis, i.e. the hash of
+    // the empty string.
+    static endpoint_name_hash_entry_t name_hash_table[endpoint_list_size];
+    size_t n_name_hashes = 0;
+    application_objects.register_name_hashes(name_hash_table, &n_name_hashes,
+            endpoint_list_size, fibre_name_hash(""), 1);
+    fibre_sort_name_hash_table(name_hash_table, n_name_hashes);
+    endpoint_name_hash_table_ = name_hash_table;
+    n_name_hashes_ = n_name_hashes;
 
     // Update the global endpoint table
-    endpoint_list_ = endpoint_list;
+    endpoint_table_ = endpoint_table;
     n_endpoints_ = endpoint_list_size;
     application_endpoints_ = &endpoint_provider;
-    
-    // Calculate the CRC16 of the JSON file.
-    // The init value is the protocol version.
-    CRC16Calculator crc16_calculator(PROTOCOL_VERSION);
-    uint8_t offset[4] = { 0 };
-    json_file_endpoint_.handle(offset, sizeof(offset), &crc16_calculator);
-    json_crc_ = crc16_calculator.get_crc16();
+
+    // Serialize the JSON descriptor into its cache and compute json_crc_.
+    fibre_cache_json_descriptor();
+
+    // Allocate the per-endpoint access counters now that the count is known.
+    fibre_init_endpoint_stats();
 
     return 0;
 }
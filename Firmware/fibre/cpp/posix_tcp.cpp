@@ -3,79 +3,162 @@
 #include <netinet/in.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/epoll.h>
 #include <unistd.h>
-#include <thread>
-#include <future>
-#include <vector>
+#include <fcntl.h>
+#include <errno.h>
 
 #include <fibre/protocol.hpp>
 
 
 #define TCP_RX_BUF_LEN	512
 
-class TCPStreamSink : public StreamSink {
+// Upper bound for per-client buffered output. A client that stops reading
+// (stalled dashboard) accumulates its own responses here and is dropped
+// when the backlog exceeds this, instead of blocking the whole server.
+#define TCP_TX_BACKLOG_LEN	65536
+
+// Simultaneous connections. Each slot owns a fixed arena that all of the
+// connection's state is carved from, so setup/teardown is O(1) and
+// steady-state packet handling performs zero heap allocations.
+#define TCP_MAX_CLIENTS	16
+
+// Stream sink with non-blocking sends and a per-client backlog ring. Bytes
+// that the socket can't take immediately are queued and flushed when epoll
+// reports the socket writable again. The ring storage is arena-allocated
+// at connection setup and never grows.
+class TCPBufferedStreamSink : public StreamSink {
 public:
-    TCPStreamSink(int socket_fd) :
-        socket_fd_(socket_fd)
+    TCPBufferedStreamSink(int socket_fd, uint8_t* backlog, size_t capacity) :
+        socket_fd_(socket_fd),
+        backlog_(backlog),
+        capacity_(capacity)
     {}
 
+    // Note: the protocol channel ignores the return value of its output
+    // sink, so errors are additionally latched in failed() for the event
+    // loop to pick up after packet processing.
     int process_bytes(const uint8_t* buffer, size_t length, size_t* processed_bytes) {
-        int bytes_sent = send(socket_fd_, buffer, length, 0);
+        size_t sent = 0;
+        if (!count_) {
+            // fast path: try the socket directly
+            ssize_t n = send(socket_fd_, buffer, length, MSG_NOSIGNAL);
+            if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+                failed_ = true;
+                return -1;
+            }
+            if (n > 0)
+                sent = (size_t)n;
+        }
+        if (sent < length) {
+            if (count_ + (length - sent) > capacity_) {
+                failed_ = true; // client isn't reading; the event loop drops it
+                return -1;
+            }
+            append(buffer + sent, length - sent);
+        }
         if (processed_bytes)
-            *processed_bytes = (bytes_sent == -1) ? 0 : bytes_sent;
-        return (bytes_sent == -1) ? -1 : 0;
+            *processed_bytes = length;
+        return 0;
     }
 
-    size_t get_free_space() { return SIZE_MAX; }
+    // @brief Attempts to drain the backlog.
+    // @return -1 on socket error, otherwise 0. Check has_backlog() to see
+    // whether EPOLLOUT interest is still needed.
+    int flush() {
+        while (count_) {
+            // send the contiguous span up to the ring's wrap point
+            size_t span = capacity_ - head_ < count_ ? capacity_ - head_ : count_;
+            ssize_t n = send(socket_fd_, backlog_ + head_, span, MSG_NOSIGNAL);
+            if (n < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK)
+                    return 0;
+                failed_ = true;
+                return -1;
+            }
+            head_ = (head_ + n) % capacity_;
+            count_ -= n;
+        }
+        return 0;
+    }
+
+    bool has_backlog() const { return count_ != 0; }
+    bool failed() const { return failed_; }
+
+    size_t get_free_space() {
+        return capacity_ - count_;
+    }
 
 private:
+    void append(const uint8_t* buffer, size_t length) {
+        size_t tail = (head_ + count_) % capacity_;
+        size_t span = capacity_ - tail < length ? capacity_ - tail : length;
+        memcpy(backlog_ + tail, buffer, span);
+        memcpy(backlog_, buffer + span, length - span);
+        count_ += length;
+    }
+
     int socket_fd_;
+    uint8_t* backlog_;
+    size_t capacity_;
+    size_t head_ = 0;  // read position
+    size_t count_ = 0; // buffered bytes
+    bool failed_ = false;
 };
 
+// Protocol stack of one connected client, fully arena-allocated.
+struct TCPClient {
+    TCPClient(int socket_fd, uint8_t* backlog, size_t backlog_capacity) :
+        fd(socket_fd),
+        sink(socket_fd, backlog, backlog_capacity),
+        packet2stream(sink),
+        channel(packet2stream),
+        stream2packet(channel)
+    {}
+    ~TCPClient() { close(fd); }
 
-int serve_client(int sock_fd) {
-    uint8_t buf[TCP_RX_BUF_LEN];
-
-    // initialize output stack for this client
-    TCPStreamSink tcp_packet_output(sock_fd);
-    StreamBasedPacketSink packet2stream(tcp_packet_output);
-    BidirectionalPacketBasedChannel channel(packet2stream);
-
-    StreamToPacketSegmenter stream2packet(channel);
+    int fd;
+    TCPBufferedStreamSink sink;
+    StreamBasedPacketSink packet2stream;
+    BidirectionalPacketBasedChannel channel;
+    StreamToPacketSegmenter stream2packet;
+};
 
-    // now listen for it
-    for (;;) {
-        memset(buf, 0, sizeof(buf));
-        // returns as soon as there is some data
-        ssize_t n_received = recv(sock_fd, buf, sizeof(buf), 0);
-
-        // -1 indicates error and 0 means that the client gracefully terminated
-        if (n_received == -1 || n_received == 0) {
-            close(sock_fd);
-            return n_received;
-        }
+// One pre-sized arena per connection slot. Everything a connection needs
+// (the TCPClient object and its backlog ring) is carved from the arena at
+// accept time, and teardown is one reset().
+struct ClientSlot {
+    ClientSlot() : arena(storage, sizeof(storage)) {}
+    uint8_t storage[sizeof(TCPClient) + TCP_TX_BACKLOG_LEN + alignof(max_align_t)];
+    Arena arena;
+    TCPClient* client = nullptr;
+};
 
-        // input processing stack
-        size_t processed = 0;
-        stream2packet.process_bytes(buf, n_received, &processed);
-    }
+static int set_nonblocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags == -1)
+        return -1;
+    return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
 }
 
-// function to check if a worker thread handling a single client is done
-template<typename T>
-bool future_is_ready(std::future<T>& t){
-    return t.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+static int update_epoll_interest(int epoll_fd, TCPClient* client) {
+    struct epoll_event evt;
+    evt.events = EPOLLIN | (client->sink.has_backlog() ? EPOLLOUT : 0);
+    evt.data.ptr = client;
+    return epoll_ctl(epoll_fd, EPOLL_CTL_MOD, client->fd, &evt);
 }
 
 int serve_on_tcp(unsigned int port) {
     struct sockaddr_in6 si_me, si_other;
     int s;
 
-
     if ((s=socket(AF_INET6, SOCK_STREAM, IPPROTO_TCP)) == -1) {
         return -1;
     }
 
+    int reuse = 1;
+    setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
     memset((char *) &si_me, 0, sizeof(si_me));
     si_me.sin6_family = AF_INET6;
     si_me.sin6_port = htons(port);
@@ -85,24 +168,115 @@ int serve_on_tcp(unsigned int port) {
         return -1;
     }
 
+    if (set_nonblocking(s) == -1)
+        return -1;
     listen(s, 128); // make this socket a passive socket
-    std::vector<std::future<int>> serv_pool;
+
+    int epoll_fd = epoll_create1(0);
+    if (epoll_fd == -1)
+        return -1;
+    struct epoll_event evt;
+    evt.events = EPOLLIN;
+    evt.data.ptr = nullptr; // nullptr marks the listening socket
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, s, &evt) == -1)
+        return -1;
+
+    static ClientSlot client_slots[TCP_MAX_CLIENTS];
+    uint8_t buf[TCP_RX_BUF_LEN];
+
     for (;;) {
-        memset(&si_other, 0, sizeof(si_other));
-
-        socklen_t silen = sizeof(si_other);
-        // TODO: Add a limit on accepting connections
-        int client_portal_fd = accept(s, reinterpret_cast<sockaddr *>(&si_other), &silen); // blocking call
-        serv_pool.push_back(std::async(std::launch::async, serve_client, client_portal_fd));
-        // do a little clean up on the pool
-        for (std::vector<std::future<int>>::iterator it = serv_pool.end()-1; it >= serv_pool.begin(); --it) {
-            if (future_is_ready(*it)) {
-                // we can erase this thread
-                serv_pool.erase(it);
+        struct epoll_event events[16];
+        int n_events = epoll_wait(epoll_fd, events, 16, -1);
+        if (n_events == -1) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+
+        for (int i = 0; i < n_events; ++i) {
+            TCPClient* client = static_cast<TCPClient*>(events[i].data.ptr);
+
+            if (client == nullptr) {
+                // listening socket: accept everything that's pending
+                for (;;) {
+                    socklen_t silen = sizeof(si_other);
+                    int client_fd = accept(s, reinterpret_cast<sockaddr *>(&si_other), &silen);
+                    if (client_fd == -1)
+                        break;
+                    ClientSlot* slot = nullptr;
+                    for (size_t j = 0; j < TCP_MAX_CLIENTS; ++j) {
+                        if (!client_slots[j].client) {
+                            slot = &client_slots[j];
+                            break;
+                        }
+                    }
+                    if (!slot || set_nonblocking(client_fd) == -1) {
+                        close(client_fd); // server full
+                        continue;
+                    }
+                    uint8_t* backlog = (uint8_t*)slot->arena.alloc(TCP_TX_BACKLOG_LEN, 1);
+                    TCPClient* new_client =
+                            slot->arena.make<TCPClient>(client_fd, backlog, (size_t)TCP_TX_BACKLOG_LEN);
+                    evt.events = EPOLLIN;
+                    evt.data.ptr = new_client;
+                    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, client_fd, &evt) == 0) {
+                        slot->client = new_client;
+                    } else {
+                        new_client->~TCPClient(); // closes the socket
+                        slot->arena.reset();
+                    }
+                }
+                continue;
+            }
+
+            bool drop = (events[i].events & (EPOLLERR | EPOLLHUP)) != 0;
+
+            if (!drop && (events[i].events & EPOLLOUT)) {
+                drop = client->sink.flush() != 0;
+            }
+
+            if (!drop && (events[i].events & EPOLLIN)) {
+                for (;;) {
+                    ssize_t n_received = recv(client->fd, buf, sizeof(buf), 0);
+                    if (n_received == 0) {
+                        drop = true; // client gracefully terminated
+                        break;
+                    }
+                    if (n_received < 0) {
+                        drop = (errno != EAGAIN && errno != EWOULDBLOCK);
+                        break;
+                    }
+                    size_t processed = 0;
+                    // malformed packets are dropped by the channel itself;
+                    // responses either go out directly or land in the
+                    // client's own backlog
+                    client->stream2packet.process_bytes(buf, n_received, &processed);
+                    if (client->sink.failed()) {
+                        // socket error or a stalled peer overflowed its backlog
+                        drop = true;
+                        break;
+                    }
+                }
+            }
+
+            if (!drop)
+                drop = update_epoll_interest(epoll_fd, client) != 0;
+
+            if (drop) {
+                epoll_ctl(epoll_fd, EPOLL_CTL_DEL, client->fd, nullptr);
+                client->~TCPClient(); // closes the socket
+                for (size_t j = 0; j < TCP_MAX_CLIENTS; ++j) {
+                    if (client_slots[j].client == client) {
+                        client_slots[j].arena.reset();
+                        client_slots[j].client = nullptr;
+                        break;
+                    }
+                }
             }
         }
     }
 
+    close(epoll_fd);
     close(s);
+    return -1;
 }
-
@@ -4,43 +4,121 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <unistd.h>
+#include <string.h>
+#include <errno.h>
 
 #include <fibre/protocol.hpp>
 
 #define UDP_RX_BUF_LEN	512
 #define UDP_TX_BUF_LEN	512
 
+// Datagrams per recvmmsg/sendmmsg syscall. At high packet rates the
+// batching amortizes the syscall cost; at low rates the coalescing
+// timeout below bounds the added latency.
+#define UDP_BATCH_SIZE	16
+#define UDP_BATCH_TIMEOUT_MS	2
 
-class UDPPacketSender : public PacketSink {
+// When enabled, responses to the same peer within one batch are packed
+// into a single datagram using the StreamBasedPacketSink framing (sync
+// byte, length, CRC). The peer must unpack with StreamToPacketSegmenter;
+// incoming datagrams are then also expected to carry framed packets.
+// Off by default for compatibility with raw-packet peers.
+#ifndef UDP_PACK_PACKETS
+#define UDP_PACK_PACKETS 0
+#endif
+
+
+// Collects outgoing datagrams and sends them with a single sendmmsg call.
+class UDPBatchSender : public PacketSink {
 public:
-    UDPPacketSender(int socket_fd, struct sockaddr_in6 *si_other) :
-        _socket_fd(socket_fd),
-        _si_other(si_other)
+    UDPBatchSender(int socket_fd) :
+        socket_fd_(socket_fd)
     {}
 
     size_t get_mtu() { return UDP_TX_BUF_LEN; }
 
+    // Responses of subsequently processed packets are addressed to this peer.
+    void set_destination(const struct sockaddr_in6* si_other) {
+        si_other_ = si_other;
+    }
+
     int process_packet(const uint8_t* buffer, size_t length) {
         // cannot send partial packets
         if (length > get_mtu())
             return -1;
 
-        int status = sendto(_socket_fd, buffer, length, 0, reinterpret_cast<struct sockaddr*>(_si_other), sizeof(*_si_other));
+#if UDP_PACK_PACKETS
+        // try to append to the pending datagram for the same peer
+        if (n_pending_) {
+            Slot& slot = slots_[n_pending_ - 1];
+            if (memcmp(&slot.addr, si_other_, sizeof(slot.addr)) == 0) {
+                MemoryStreamSink memory_sink(slot.buf + slot.len, UDP_TX_BUF_LEN - slot.len);
+                StreamBasedPacketSink framer(memory_sink);
+                if (framer.process_packet(buffer, length) == 0) {
+                    slot.len = UDP_TX_BUF_LEN - memory_sink.get_free_space();
+                    return 0;
+                }
+                // didn't fit; fall through into a fresh slot
+            }
+        }
+#endif
+
+        if (n_pending_ == UDP_BATCH_SIZE && flush() != 0)
+            return -1;
+
+        Slot& slot = slots_[n_pending_];
+        slot.addr = *si_other_;
+#if UDP_PACK_PACKETS
+        MemoryStreamSink memory_sink(slot.buf, UDP_TX_BUF_LEN);
+        StreamBasedPacketSink framer(memory_sink);
+        if (framer.process_packet(buffer, length) != 0)
+            return -1;
+        slot.len = UDP_TX_BUF_LEN - memory_sink.get_free_space();
+#else
+        memcpy(slot.buf, buffer, length);
+        slot.len = length;
+#endif
+        n_pending_++;
+        return 0;
+    }
+
+    // @brief Sends all pending datagrams with one syscall.
+    int flush() {
+        if (!n_pending_)
+            return 0;
+        struct mmsghdr msgs[UDP_BATCH_SIZE];
+        struct iovec iovs[UDP_BATCH_SIZE];
+        memset(msgs, 0, sizeof(msgs));
+        for (size_t i = 0; i < n_pending_; ++i) {
+            iovs[i].iov_base = slots_[i].buf;
+            iovs[i].iov_len = slots_[i].len;
+            msgs[i].msg_hdr.msg_iov = &iovs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+            msgs[i].msg_hdr.msg_name = &slots_[i].addr;
+            msgs[i].msg_hdr.msg_namelen = sizeof(slots_[i].addr);
+        }
+        int status = sendmmsg(socket_fd_, msgs, n_pending_, 0);
+        n_pending_ = 0;
         return (status == -1) ? -1 : 0;
     }
 
 private:
-    int _socket_fd;
-    struct sockaddr_in6 *_si_other;
+    struct Slot {
+        uint8_t buf[UDP_TX_BUF_LEN];
+        size_t len;
+        struct sockaddr_in6 addr;
+    };
+
+    int socket_fd_;
+    const struct sockaddr_in6* si_other_ = nullptr;
+    Slot slots_[UDP_BATCH_SIZE];
+    size_t n_pending_ = 0;
 };
 
 
-
 int serve_on_udp(unsigned int port) {
-    struct sockaddr_in6 si_me, si_other;
+    struct sockaddr_in6 si_me;
     int s;
-    socklen_t slen = sizeof(si_other);
-    uint8_t buf[UDP_RX_BUF_LEN];
 
     if ((s=socket(AF_INET6, SOCK_DGRAM, IPPROTO_UDP)) == -1)
         return -1;
@@ -50,21 +128,57 @@ int serve_on_udp(unsigned int port) {
     si_me.sin6_port = htons(port);
     si_me.sin6_flowinfo = 0;
     si_me.sin6_addr= in6addr_any;
-    if (bind(s, reinterpret_cast<struct sockaddr *>(&si_me), sizeof(si_me)) == -1) 
+    if (bind(s, reinterpret_cast<struct sockaddr *>(&si_me), sizeof(si_me)) == -1)
         return -1;
 
-    for (;;) {
-        ssize_t n_received = recvfrom(s, buf, sizeof(buf), 0, reinterpret_cast<struct sockaddr *>(&si_other), &slen);
-        if (n_received == -1)
-            return -1;
-        //printf("Received packet from %s:%d\nData: %s\n\n",
-        //    inet_ntoa(si_other.sin_addr), ntohs(si_other.sin_port), buf);
+    UDPBatchSender udp_packet_output(s);
+    BidirectionalPacketBasedChannel udp_channel(udp_packet_output);
 
-        UDPPacketSender udp_packet_output(s, &si_other);
-        BidirectionalPacketBasedChannel udp_channel(udp_packet_output);
-        udp_channel.process_packet(buf, n_received);
+    static uint8_t bufs[UDP_BATCH_SIZE][UDP_RX_BUF_LEN];
+    static struct sockaddr_in6 peers[UDP_BATCH_SIZE];
+    struct mmsghdr msgs[UDP_BATCH_SIZE];
+    struct iovec iovs[UDP_BATCH_SIZE];
+
+    for (;;) {
+        memset(msgs, 0, sizeof(msgs));
+        for (size_t i = 0; i < UDP_BATCH_SIZE; ++i) {
+            iovs[i].iov_base = bufs[i];
+            iovs[i].iov_len = UDP_RX_BUF_LEN;
+            msgs[i].msg_hdr.msg_iov = &iovs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+            msgs[i].msg_hdr.msg_name = &peers[i];
+            msgs[i].msg_hdr.msg_namelen = sizeof(peers[i]);
+        }
+
+        // Block for the first datagram, then keep harvesting whatever else
+        // arrives within the coalescing window, up to a full batch.
+        struct timespec timeout = { 0, UDP_BATCH_TIMEOUT_MS * 1000000L };
+        int n_received = recvmmsg(s, msgs, 1, 0, nullptr);
+        if (n_received == 1) {
+            int more = recvmmsg(s, msgs + 1, UDP_BATCH_SIZE - 1, MSG_DONTWAIT, &timeout);
+            if (more > 0)
+                n_received += more;
+        }
+        if (n_received <= 0) {
+            if (n_received == -1 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK))
+                continue;
+            break;
+        }
+
+        for (int i = 0; i < n_received; ++i) {
+            udp_packet_output.set_destination(&peers[i]);
+#if UDP_PACK_PACKETS
+            StreamToPacketSegmenter stream2packet(udp_channel);
+            stream2packet.process_bytes(bufs[i], msgs[i].msg_len, nullptr);
+#else
+            udp_channel.process_packet(bufs[i], msgs[i].msg_len);
+#endif
+        }
+
+        // one sendmmsg for all responses of this batch
+        udp_packet_output.flush();
     }
 
     close(s);
+    return -1;
 }
-
@@ -3,6 +3,7 @@
 
 #include <memory>
 #include <stdlib.h>
+#include <string.h>
 
 #include <fibre/protocol.hpp>
 #include <fibre/crc.hpp>
@@ -13,18 +14,90 @@
 /* Global constant data ------------------------------------------------------*/
 /* Global variables ----------------------------------------------------------*/
 
-Endpoint** endpoint_list_ = nullptr; // initialized by calling fibre_publish
+const endpoint_dispatch_entry_t* endpoint_table_ = nullptr; // initialized by calling fibre_publish
 size_t n_endpoints_ = 0; // initialized by calling fibre_publish
 uint16_t json_crc_; // initialized by calling fibre_publish
+const endpoint_name_hash_entry_t* endpoint_name_hash_table_ = nullptr; // initialized by calling fibre_publish
+size_t n_name_hashes_ = 0; // initialized by calling fibre_publish
 JSONDescriptorEndpoint json_file_endpoint_ = JSONDescriptorEndpoint();
 EndpointProvider* application_endpoints_;
 
 /* Private constant data -----------------------------------------------------*/
 /* Private variables ---------------------------------------------------------*/
+
+// One-time serialization of the JSON descriptor, built by
+// fibre_cache_json_descriptor(). nullptr until then (or if malloc failed),
+// in which case reads fall back to walking the endpoint tree.
+static const uint8_t* json_cache_ = nullptr;
+static size_t json_cache_length_ = 0;
+
+// Dictionary-compressed form of the descriptor, served by the extended
+// (CRC-pinned) read format of endpoint 0. The JSON is pure ASCII, so the
+// high-bit byte values are free: 0x80|i expands to json_dictionary_[i] and
+// every other byte is a literal. The table MUST stay in sync with
+// JSON_DICTIONARY in fibre/python/fibre/protocol.py.
+static const char* const json_dictionary_[] = {
+    "{\"name\":\"",
+    "\",\"id\":",
+    "},{\"name\":\"",
+    "]},{\"name\":\"",
+    "\",\"type\":\"object\",\"members\":[",
+    ",\"type\":\"function\",\"inputs\":[",
+    "],\"outputs\":[",
+    ",\"type\":\"json\",\"access\":\"r\"}",
+    ",\"type\":\"float\",\"access\":\"rw\"}",
+    ",\"type\":\"float\",\"access\":\"r\"}",
+    ",\"type\":\"bool\",\"access\":\"rw\"}",
+    ",\"type\":\"bool\",\"access\":\"r\"}",
+    ",\"type\":\"int64\",\"access\":\"rw\"}",
+    ",\"type\":\"int64\",\"access\":\"r\"}",
+    ",\"type\":\"uint64\",\"access\":\"rw\"}",
+    ",\"type\":\"uint64\",\"access\":\"r\"}",
+    ",\"type\":\"int32\",\"access\":\"rw\"}",
+    ",\"type\":\"int32\",\"access\":\"r\"}",
+    ",\"type\":\"uint32\",\"access\":\"rw\"}",
+    ",\"type\":\"uint32\",\"access\":\"r\"}",
+    ",\"type\":\"int16\",\"access\":\"rw\"}",
+    ",\"type\":\"int16\",\"access\":\"r\"}",
+    ",\"type\":\"uint16\",\"access\":\"rw\"}",
+    ",\"type\":\"uint16\",\"access\":\"r\"}",
+    ",\"type\":\"uint8\",\"access\":\"rw\"}",
+    ",\"type\":\"uint8\",\"access\":\"r\"}",
+    ",\"type\":\"endpoint_ref\",\"access\":\"rw\"}",
+    ",\"type\":\"array\",\"elem_type\":\"",
+    "\",\"access\":\"rw\",\"length\":",
+    "\",\"access\":\"r\",\"length\":",
+};
+constexpr size_t json_dictionary_size_ = sizeof(json_dictionary_) / sizeof(json_dictionary_[0]);
+static const uint8_t* json_zcache_ = nullptr;
+static size_t json_zcache_length_ = 0;
+
+// Endpoint access statistics. The per-endpoint counter array is malloc'd
+// by fibre_init_endpoint_stats() once the endpoint count is known; nullptr
+// if the allocation failed, in which case only the aggregates are kept.
+fibre_endpoint_stats_t fibre_endpoint_stats_ = {0, 0, 0};
+static uint32_t* endpoint_access_counters_ = nullptr;
+static uint32_t (*us_clock_)(void) = nullptr;
+
+// Serializes endpoint handler execution across channel instances (see
+// fibre_set_endpoint_lock). Unset by default: single-threaded hosts don't
+// need it and the protocol code has no thread primitives of its own.
+static void (*endpoint_lock_)(void) = nullptr;
+static void (*endpoint_unlock_)(void) = nullptr;
+// us-clock timestamp of the packet currently being dispatched, taken at
+// process_packet entry (see fibre_get_last_parse_us)
+static uint32_t last_parse_us_ = 0;
+
+// Stable-ID remap table: actual endpoint ID per manifest slot, 0xffff for
+// paths that don't resolve in this build. See fibre_set_stable_id_map().
+static uint16_t* stable_id_map_ = nullptr;
+static size_t n_stable_ids_ = 0;
+
 /* Private function prototypes -----------------------------------------------*/
 
 static void hexdump(const uint8_t* buf, size_t len);
 static inline int write_string(const char* str, StreamSink* output);
+static void write_json_descriptor(StreamSink* output);
 
 /* Function implementations --------------------------------------------------*/
 
@@ -49,42 +122,66 @@ void hexdump(const uint8_t* buf, size_t len) {
 int StreamToPacketSegmenter::process_bytes(const uint8_t *buffer, size_t length, size_t* processed_bytes) {
     int result = 0;
 
-    while (length--) {
-        if (header_index_ < sizeof(header_buffer_)) {
-            // Process header byte
-            header_buffer_[header_index_++] = *buffer;
-            if (header_index_ == 1 && header_buffer_[0] != CANONICAL_PREFIX) {
-                header_index_ = 0;
-            } else if (header_index_ == 2 && (header_buffer_[1] & 0x80)) {
-                header_index_ = 0; // TODO: support packets larger than 128 bytes
-            } else if (header_index_ == 3 && calc_crc8<CANONICAL_CRC8_POLYNOMIAL>(CANONICAL_CRC8_INIT, header_buffer_, 3)) {
+    // Each iteration consumes the longest span the current phase allows:
+    // the sync hunt skips garbage with a single memchr pass (word-at-a-
+    // time in the libc) and the payload phase bulk-copies what's
+    // available, so only the two validated header bytes are handled
+    // individually. This is the front door for every UART/USB byte, so
+    // large garbage gaps and back-to-back packets matter.
+    while (length) {
+        size_t chunk;
+        if (header_index_ == 0) {
+            // Hunt for the sync byte; consume everything up to and
+            // including the first candidate.
+            const uint8_t* sync = (const uint8_t*)memchr(buffer, CANONICAL_PREFIX, length);
+            chunk = sync ? (size_t)(sync - buffer) + 1 : length;
+            if (sync)
+                header_buffer_[header_index_++] = CANONICAL_PREFIX;
+        } else if (header_index_ == 1) {
+            // Second header byte: the payload length
+            chunk = 1;
+            if (buffer[0] & 0x80)
+                header_index_ = 0; // MSB is reserved, see STREAM_MAX_PAYLOAD
+            else
+                header_buffer_[header_index_++] = buffer[0];
+        } else if (header_index_ == 2) {
+            // Third header byte: the header checksum
+            chunk = 1;
+            header_buffer_[header_index_++] = buffer[0];
+            if (calc_crc8<CANONICAL_CRC8_POLYNOMIAL>(CANONICAL_CRC8_INIT, header_buffer_, 3)) {
                 header_index_ = 0;
-            } else if (header_index_ == 3) {
+            } else {
                 packet_length_ = header_buffer_[1] + 2;
+                if (packet_length_ > sizeof(packet_buffer_))
+                    header_index_ = 0; // doesn't fit; the old code wedged on this
             }
-        } else if (packet_index_ < sizeof(packet_buffer_)) {
-            // Process payload byte
-            packet_buffer_[packet_index_++] = *buffer;
-        }
-
-        // If both header and packet are fully received, hand it on to the packet processor
-        if (header_index_ == 3 && packet_index_ == packet_length_) {
-            if (calc_crc16<CANONICAL_CRC16_POLYNOMIAL>(CANONICAL_CRC16_INIT, packet_buffer_, packet_length_) == 0) {
-                result |= output_.process_packet(packet_buffer_, packet_length_ - 2);
+        } else {
+            // Payload (including the packet checksum): bulk-copy the
+            // available span
+            chunk = packet_length_ - packet_index_;
+            if (chunk > length)
+                chunk = length;
+            memcpy(packet_buffer_ + packet_index_, buffer, chunk);
+            packet_index_ += chunk;
+            if (packet_index_ == packet_length_) {
+                if (calc_crc16<CANONICAL_CRC16_POLYNOMIAL>(CANONICAL_CRC16_INIT, packet_buffer_, packet_length_) == 0) {
+                    result |= output_.process_packet(packet_buffer_, packet_length_ - 2);
+                }
+                header_index_ = packet_index_ = packet_length_ = 0;
             }
-            header_index_ = packet_index_ = packet_length_ = 0;
         }
-        buffer++;
+        buffer += chunk;
+        length -= chunk;
         if (processed_bytes)
-            (*processed_bytes)++;
+            (*processed_bytes) += chunk;
     }
 
     return result;
 }
 
 int StreamBasedPacketSink::process_packet(const uint8_t *buffer, size_t length) {
-    // TODO: support buffer size >= 128
-    if (length >= 128)
+    // the length byte of the frame header has only 7 usable bits
+    if (length > STREAM_MAX_PAYLOAD)
         return -1;
 
     LOG_FIBRE("send header\r\n");
@@ -128,32 +225,218 @@ void JSONDescriptorEndpoint::write_json(size_t id, StreamSink* output) {
     write_string(",\"type\":\"json\",\"access\":\"r\"}", output);
 }
 
-void JSONDescriptorEndpoint::register_endpoints(Endpoint** list, size_t id, size_t length) {
+void JSONDescriptorEndpoint::register_endpoints(endpoint_dispatch_entry_t* table, size_t id, size_t length) {
     if (id < length)
-        list[id] = this;
+        table[id] = { &handle_trampoline, static_cast<Endpoint*>(this) };
+}
+
+void JSONDescriptorEndpoint::handle_trampoline(void* ctx, const uint8_t* input, size_t input_length, StreamSink* output) {
+    static_cast<JSONDescriptorEndpoint*>(static_cast<Endpoint*>(ctx))->JSONDescriptorEndpoint::handle(input, input_length, output);
+}
+
+// Serializes the full JSON interface definition by walking the endpoint tree.
+static void write_json_descriptor(StreamSink* output) {
+    size_t id = 0;
+    write_string("[", output);
+    json_file_endpoint_.write_json(id, output);
+    id += decltype(json_file_endpoint_)::endpoint_count;
+    write_string(",", output);
+    application_endpoints_->write_json(id, output);
+    write_string("]", output);
+}
+
+// Counts the bytes of a stream without storing them.
+class LengthMeasuringSink : public StreamSink {
+public:
+    int process_bytes(const uint8_t* buffer, size_t length, size_t* processed_bytes) {
+        (void) buffer;
+        length_ += length;
+        if (processed_bytes)
+            *processed_bytes += length;
+        return 0;
+    }
+    size_t get_free_space() { return SIZE_MAX; }
+    size_t length_ = 0;
+};
+
+// Serializes the JSON descriptor once into a heap buffer and computes
+// json_crc_ over it. The descriptor is fully determined at compile time but
+// is expensive to emit: without the cache every chunked read at connect time
+// re-walks the whole tree through snprintf, which makes connects take
+// seconds. With the cache a read is a single memcpy.
+// @brief Greedy single-pass dictionary compression of the descriptor.
+// Returns the compressed length; fills `out` when it is non-null (call
+// once with nullptr to size the buffer). The repetitive boilerplate
+// (property names aside, nearly every emitted string is in the table)
+// typically shrinks the descriptor to about half.
+static size_t json_compress(const uint8_t* in, size_t in_length, uint8_t* out) {
+    size_t out_length = 0;
+    size_t i = 0;
+    while (i < in_length) {
+        size_t best_entry = json_dictionary_size_;
+        size_t best_length = 0;
+        for (size_t d = 0; d < json_dictionary_size_; ++d) {
+            size_t entry_length = strlen(json_dictionary_[d]);
+            if (entry_length > best_length && entry_length <= in_length - i
+                && memcmp(in + i, json_dictionary_[d], entry_length) == 0) {
+                best_entry = d;
+                best_length = entry_length;
+            }
+        }
+        if (best_entry < json_dictionary_size_) {
+            if (out)
+                out[out_length] = 0x80 | best_entry;
+            out_length += 1;
+            i += best_length;
+        } else {
+            if (out)
+                out[out_length] = in[i];
+            out_length += 1;
+            i += 1;
+        }
+    }
+    return out_length;
+}
+
+void fibre_cache_json_descriptor(void) {
+    LengthMeasuringSink length_sink;
+    write_json_descriptor(&length_sink);
+
+    uint8_t* buffer = (uint8_t*)malloc(length_sink.length_);
+    if (buffer) {
+        MemoryStreamSink memory_sink(buffer, length_sink.length_);
+        write_json_descriptor(&memory_sink);
+        json_cache_ = buffer;
+        json_cache_length_ = length_sink.length_;
+    }
+
+    // Calculate the CRC16 of the JSON file.
+    // The init value is the protocol version.
+    CRC16Calculator crc16_calculator(PROTOCOL_VERSION);
+    if (json_cache_)
+        crc16_calculator.process_bytes(json_cache_, json_cache_length_, nullptr);
+    else
+        write_json_descriptor(&crc16_calculator);
+    json_crc_ = crc16_calculator.get_crc16();
+
+    // Compressed copy for the extended read format. If this allocation
+    // fails the extended reads fall back to serving the raw bytes, which
+    // the decompressor passes through unchanged (no high-bit codes in
+    // ASCII JSON).
+    if (json_cache_) {
+        size_t compressed_length = json_compress(json_cache_, json_cache_length_, nullptr);
+        uint8_t* zbuffer = (uint8_t*)malloc(compressed_length);
+        if (zbuffer) {
+            json_compress(json_cache_, json_cache_length_, zbuffer);
+            json_zcache_ = zbuffer;
+            json_zcache_length_ = compressed_length;
+        }
+    }
 }
 
 // Returns part of the JSON interface definition.
+//
+// Two request formats:
+//  - 4 bytes (legacy): u32 byte offset into the raw JSON.
+//  - 8 bytes: u32 offset, u16 expected_crc, u16 flags. The response
+//    starts with the device's json_crc_ (2 bytes LE); payload bytes (the
+//    dictionary-compressed descriptor, from `offset`) follow only if bit
+//    0 of flags is set AND expected_crc matches. A client that cached the
+//    descriptor under its CRC revalidates with a single 2-byte read and
+//    skips the transfer entirely, and an ongoing fetch is pinned to one
+//    descriptor version even across a device reboot mid-transfer.
+//    If bit 1 of flags is set, the `offset` field instead carries the
+//    FNV-1a hash of a dot-separated endpoint path (fibre_name_hash) and
+//    the response is json_crc_ followed by the matching endpoint ID as
+//    u16 LE (0xffff if unknown), followed by the endpoint's type code
+//    (fibre_endpoint_type_t, one byte) - everything a JSON-less host
+//    needs to address that endpoint, in one bounded transaction instead
+//    of a full descriptor parse.
 void JSONDescriptorEndpoint::handle(const uint8_t* input, size_t input_length, StreamSink* output) {
     // The request must contain a 32 bit integer to specify an offset
     if (input_length < 4)
         return;
     uint32_t offset = 0;
     read_le<uint32_t>(&offset, input);
-    NullStreamSink output_with_offset = NullStreamSink(offset, *output);
 
-    size_t id = 0;
-    write_string("[", &output_with_offset);
-    json_file_endpoint_.write_json(id, &output_with_offset);
-    id += decltype(json_file_endpoint_)::endpoint_count;
-    write_string(",", &output_with_offset);
-    application_endpoints_->write_json(id, &output_with_offset);
-    write_string("]", &output_with_offset);
+    if (input_length >= 8) {
+        uint16_t expected_crc = 0;
+        uint16_t flags = 0;
+        read_le<uint16_t>(&expected_crc, input + 4);
+        read_le<uint16_t>(&flags, input + 6);
+
+        uint8_t crc_buf[2];
+        write_le<uint16_t>(json_crc_, crc_buf);
+        output->process_bytes(crc_buf, sizeof(crc_buf), nullptr);
+
+        if (flags & 0x0002) {
+            // name hash resolution; no CRC precondition since the whole
+            // point is that the client has never seen the JSON
+            uint16_t endpoint_id = fibre_resolve_name_hash(offset);
+            uint8_t id_buf[3];
+            write_le<uint16_t>(endpoint_id, id_buf);
+            id_buf[2] = (endpoint_id != 0xffff) ? fibre_get_endpoint_type(endpoint_id)
+                                                : FIBRE_TYPE_NONE;
+            output->process_bytes(id_buf, sizeof(id_buf), nullptr);
+            return;
+        }
+
+        if (!(flags & 0x0001) || (expected_crc != json_crc_))
+            return;
+        if (json_zcache_) {
+            if (offset < json_zcache_length_)
+                output->process_bytes(json_zcache_ + offset, json_zcache_length_ - offset, nullptr);
+        } else if (json_cache_) {
+            if (offset < json_cache_length_)
+                output->process_bytes(json_cache_ + offset, json_cache_length_ - offset, nullptr);
+        } else {
+            NullStreamSink output_with_offset = NullStreamSink(offset, *output);
+            write_json_descriptor(&output_with_offset);
+        }
+        return;
+    }
+
+    if (json_cache_) {
+        // Serve directly from the cached blob. The output sink truncates
+        // to whatever the response buffer can hold.
+        if (offset < json_cache_length_)
+            output->process_bytes(json_cache_ + offset, json_cache_length_ - offset, nullptr);
+    } else {
+        NullStreamSink output_with_offset = NullStreamSink(offset, *output);
+        write_json_descriptor(&output_with_offset);
+    }
+}
+
+// @brief Takes one operation's worth of credit out of the channel's token
+// bucket. Returns true if the operation may be dispatched. See RateLimit_t.
+bool BidirectionalPacketBasedChannel::consume_rate_limit_token() {
+    if (!rate_limit_.ops_per_sec || !us_clock_)
+        return true;
+    uint32_t cost_us = 1000000 / rate_limit_.ops_per_sec;
+    uint32_t cap_us = cost_us * rate_limit_.burst;
+    uint32_t now_us = us_clock_();
+    if (!rate_limit_armed_) {
+        // first operation since the limiter was configured: full burst budget
+        bucket_us_ = cap_us;
+        rate_limit_armed_ = true;
+    } else {
+        uint32_t elapsed_us = now_us - last_refill_us_;
+        bucket_us_ = (elapsed_us >= cap_us - bucket_us_) ? cap_us : (bucket_us_ + elapsed_us);
+    }
+    last_refill_us_ = now_us;
+    if (bucket_us_ < cost_us) {
+        if (rate_limit_.drop_cnt)
+            (*rate_limit_.drop_cnt)++;
+        return false;
+    }
+    bucket_us_ -= cost_us;
+    return true;
 }
 
 int BidirectionalPacketBasedChannel::process_packet(const uint8_t* buffer, size_t length) {
     LOG_FIBRE("got packet of length %d: \r\n", length);
     hexdump(buffer, length);
+    last_parse_us_ = us_clock_ ? us_clock_() : 0;
     if (length < 4)
         return -1;
 
@@ -165,15 +448,31 @@ int BidirectionalPacketBasedChannel::process_packet(const uint8_t* buffer, size_
         // TODO: think about some kind of ordering guarantees
         // currently the seq_no is just used to associate a response with a request
 
+        // A host flooding operations competes for the shared endpoint lock
+        // and the comm thread's CPU budget; shed its excess load here,
+        // before any dispatch work is done.
+        if (!consume_rate_limit_token())
+            return -1;
+
         uint16_t endpoint_id = read_le<uint16_t>(&buffer, &length);
         bool expect_response = endpoint_id & 0x8000;
         endpoint_id &= 0x7fff;
 
+        // Stable-ID space: remap the manifest slot to the actual endpoint
+        // ID of this build (see fibre_set_stable_id_map)
+        bool stable_addressed = endpoint_id >= STABLE_ENDPOINT_ID_BASE;
+        if (stable_addressed) {
+            size_t stable_idx = endpoint_id - STABLE_ENDPOINT_ID_BASE;
+            if (stable_idx >= n_stable_ids_)
+                return -1;
+            endpoint_id = stable_id_map_[stable_idx];
+        }
+
         if (endpoint_id >= n_endpoints_)
             return -1;
 
-        Endpoint* endpoint = endpoint_list_[endpoint_id];
-        if (!endpoint) {
+        const endpoint_dispatch_entry_t& endpoint = endpoint_table_[endpoint_id];
+        if (!endpoint.handler) {
             LOG_FIBRE("critical: no endpoint at %d", endpoint_id);
             return -1;
         }
@@ -181,7 +480,9 @@ int BidirectionalPacketBasedChannel::process_packet(const uint8_t* buffer, size_
         // Verify packet trailer. The expected trailer value depends on the selected endpoint.
         // For endpoint 0 this is just the protocol version, for all other endpoints it's a
         // CRC over the entire JSON descriptor tree (this may change in future versions).
-        uint16_t expected_trailer = endpoint_id ? json_crc_ : PROTOCOL_VERSION;
+        // Stable-ID requests also use the protocol version: the stable slot itself is the
+        // version-independent contract.
+        uint16_t expected_trailer = (endpoint_id && !stable_addressed) ? json_crc_ : PROTOCOL_VERSION;
         uint16_t actual_trailer = buffer[length - 2] | (buffer[length - 1] << 8);
         if (expected_trailer != actual_trailer) {
             LOG_FIBRE("trailer mismatch for endpoint %d: expected %04x, got %04x\r\n", endpoint_id, expected_trailer, actual_trailer);
@@ -193,12 +494,46 @@ int BidirectionalPacketBasedChannel::process_packet(const uint8_t* buffer, size_
 
         uint16_t expected_response_length = read_le<uint16_t>(&buffer, &length);
 
-        // Limit response length according to our local TX buffer size
+        // Limit response length according to our local TX buffer size and
+        // what the output transport can carry in one packet (2 bytes of
+        // the response are the sequence number).
         if (expected_response_length > sizeof(tx_buf_) - 2)
             expected_response_length = sizeof(tx_buf_) - 2;
+        size_t output_mtu = output_.get_mtu();
+        if (output_mtu != SIZE_MAX && expected_response_length > output_mtu - 2)
+            expected_response_length = output_mtu - 2;
+
+        // Every channel instance owns its RX/TX buffers, but the endpoint
+        // handlers (and the state they touch) are shared between all of
+        // them. Serialize only the handler execution, per operation: a
+        // burst on one interface then delays another by at most a single
+        // handler duration, and the lock is dropped again before the
+        // response is transmitted so a stalled transport can never extend
+        // the hold time.
+        if (endpoint_lock_)
+            endpoint_lock_();
+
+        // Access statistics: counts every dispatched operation and tracks
+        // the worst-case handler duration, which includes any property
+        // read/write callback the endpoint runs. Resettable from the
+        // application so a slow odrivetool session can be profiled live.
+        fibre_endpoint_stats_.access_cnt++;
+        if (endpoint_access_counters_)
+            endpoint_access_counters_[endpoint_id]++;
 
         MemoryStreamSink output(tx_buf_ + 2, expected_response_length);
-        endpoint->handle(buffer, length - 2, &output);
+        uint32_t start_us = us_clock_ ? us_clock_() : 0;
+        endpoint.handler(endpoint.ctx, buffer, length - 2, &output);
+        if (us_clock_) {
+            uint32_t duration_us = us_clock_() - start_us;
+            if (duration_us > fibre_endpoint_stats_.max_handler_us) {
+                fibre_endpoint_stats_.max_handler_us = duration_us;
+                fibre_endpoint_stats_.max_handler_endpoint_id = endpoint_id;
+            }
+        }
+
+        if (endpoint_unlock_)
+            endpoint_unlock_();
 
         // Send response
         if (expect_response) {
@@ -214,14 +549,93 @@ int BidirectionalPacketBasedChannel::process_packet(const uint8_t* buffer, size_
     return 0;
 }
 
+static int name_hash_entry_cmp(const void* a, const void* b) {
+    const endpoint_name_hash_entry_t* entry_a = (const endpoint_name_hash_entry_t*)a;
+    const endpoint_name_hash_entry_t* entry_b = (const endpoint_name_hash_entry_t*)b;
+    if (entry_a->hash != entry_b->hash)
+        return (entry_a->hash > entry_b->hash) ? 1 : -1;
+    // tie-break on the ID so a collision deterministically resolves to the
+    // lower endpoint (qsort is not stable)
+    return (entry_a->endpoint_id > entry_b->endpoint_id) ? 1 : -1;
+}
+
+void fibre_sort_name_hash_table(endpoint_name_hash_entry_t* table, size_t length) {
+    qsort(table, length, sizeof(table[0]), name_hash_entry_cmp);
+}
+
+void fibre_set_stable_id_map(const uint32_t* name_hashes, size_t count) {
+    uint16_t* map = (uint16_t*)malloc(count * sizeof(uint16_t));
+    if (!map)
+        return;
+    for (size_t i = 0; i < count; ++i)
+        map[i] = fibre_resolve_name_hash(name_hashes[i]);
+    stable_id_map_ = map;
+    n_stable_ids_ = count;
+}
+
+uint16_t fibre_resolve_name_hash(uint32_t hash) {
+    size_t lo = 0, hi = n_name_hashes_;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (endpoint_name_hash_table_[mid].hash < hash)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (lo < n_name_hashes_ && endpoint_name_hash_table_[lo].hash == hash)
+        return endpoint_name_hash_table_[lo].endpoint_id;
+    return 0xffff;
+}
+
+uint8_t fibre_get_endpoint_type(uint16_t endpoint_id) {
+    if (endpoint_id >= n_endpoints_)
+        return FIBRE_TYPE_NONE;
+    // register_endpoints() stores every ctx as an Endpoint base pointer
+    Endpoint* endpoint = static_cast<Endpoint*>(endpoint_table_[endpoint_id].ctx);
+    return endpoint ? endpoint->type_id() : FIBRE_TYPE_NONE;
+}
+
 bool is_endpoint_ref_valid(endpoint_ref_t endpoint_ref) {
     return (endpoint_ref.json_crc == json_crc_)
         && (endpoint_ref.endpoint_id < n_endpoints_);
 }
 
+void fibre_set_us_clock(uint32_t (*us_clock)(void)) {
+    us_clock_ = us_clock;
+}
+
+void fibre_set_endpoint_lock(void (*lock)(void), void (*unlock)(void)) {
+    endpoint_lock_ = lock;
+    endpoint_unlock_ = unlock;
+}
+
+uint32_t fibre_get_last_parse_us(void) {
+    return last_parse_us_;
+}
+
+void fibre_init_endpoint_stats(void) {
+    endpoint_access_counters_ = (uint32_t*)calloc(n_endpoints_, sizeof(uint32_t));
+}
+
+uint32_t fibre_get_endpoint_access_cnt(uint32_t endpoint_id) {
+    if (!endpoint_access_counters_ || endpoint_id >= n_endpoints_)
+        return 0;
+    return endpoint_access_counters_[endpoint_id];
+}
+
+void fibre_reset_endpoint_stats(void) {
+    fibre_endpoint_stats_.access_cnt = 0;
+    fibre_endpoint_stats_.max_handler_us = 0;
+    fibre_endpoint_stats_.max_handler_endpoint_id = 0;
+    if (endpoint_access_counters_)
+        memset(endpoint_access_counters_, 0, n_endpoints_ * sizeof(uint32_t));
+}
+
 Endpoint* get_endpoint(endpoint_ref_t endpoint_ref) {
+    // ctx is the endpoint object itself (every concrete endpoint class has
+    // Endpoint as its primary base), so it doubles as the named access path.
     if (is_endpoint_ref_valid(endpoint_ref))
-        return endpoint_list_[endpoint_ref.endpoint_id];
+        return static_cast<Endpoint*>(endpoint_table_[endpoint_ref.endpoint_id].ctx);
     else
         return nullptr;
 }
@@ -3,8 +3,10 @@ Provides functions for the discovery of Fibre nodes
 """
 
 import sys
+import os
 import json
 import time
+import struct
 import threading
 import traceback
 import fibre.protocol
@@ -44,6 +46,78 @@ except ImportError:
 def noprint(text):
     pass
 
+def _descriptor_cache_path(json_crc16):
+    return os.path.join(os.path.expanduser("~"), ".odrive", "descriptor_cache",
+                        "{:04x}.json".format(json_crc16))
+
+def _load_cached_descriptor(json_crc16, logger):
+    try:
+        with open(_descriptor_cache_path(json_crc16), "rb") as f:
+            json_bytes = f.read()
+        if fibre.protocol.calc_crc16(fibre.protocol.PROTOCOL_VERSION, json_bytes) == json_crc16:
+            return json_bytes
+        logger.debug("cached descriptor for {:04x} is corrupt".format(json_crc16))
+    except IOError:
+        pass
+    return None
+
+def _store_cached_descriptor(json_crc16, json_bytes, logger):
+    try:
+        path = _descriptor_cache_path(json_crc16)
+        if not os.path.isdir(os.path.dirname(path)):
+            os.makedirs(os.path.dirname(path))
+        with open(path, "wb") as f:
+            f.write(json_bytes)
+    except IOError:
+        logger.debug("could not store descriptor cache: " + traceback.format_exc())
+
+def fetch_json_descriptor(channel, logger):
+    """
+    Fetches the JSON interface descriptor of a device.
+
+    Tries the extended (CRC-pinned) read format of endpoint 0 first: a
+    2-byte probe returns the device's descriptor CRC, which either hits the
+    on-disk cache (skipping the transfer entirely) or pins the subsequent
+    compressed transfer to one descriptor version. Devices that predate the
+    extended format answer the probe with raw JSON instead of a 2-byte CRC,
+    in which case this falls back to the legacy full fetch.
+    """
+    try:
+        probe = channel.remote_endpoint_operation(0, struct.pack("<IHH", 0, 0, 0), True, 512)
+    except (TimeoutError, ChannelBrokenException):
+        probe = None
+
+    if probe is not None and len(probe) == 2:
+        json_crc16 = struct.unpack("<H", probe)[0]
+        json_bytes = _load_cached_descriptor(json_crc16, logger)
+        if json_bytes is not None:
+            logger.debug("descriptor {:04x} served from cache".format(json_crc16))
+            return json_bytes
+        # fetch the compressed descriptor, pinned to the probed CRC
+        compressed = bytes()
+        while True:
+            chunk = channel.remote_endpoint_operation(
+                    0, struct.pack("<IHH", len(compressed), json_crc16, 1), True, 512)
+            if len(chunk) < 2 or struct.unpack("<H", chunk[:2])[0] != json_crc16:
+                compressed = None  # descriptor changed underneath us
+                break
+            if len(chunk) == 2:
+                break  # end of descriptor
+            compressed += chunk[2:]
+        if compressed:
+            try:
+                json_bytes = fibre.protocol.decompress_json(compressed)
+            except ValueError:
+                json_bytes = None
+            if json_bytes is not None and \
+                    fibre.protocol.calc_crc16(fibre.protocol.PROTOCOL_VERSION, json_bytes) == json_crc16:
+                _store_cached_descriptor(json_crc16, json_bytes, logger)
+                return json_bytes
+            logger.debug("compressed descriptor fetch failed, falling back to legacy read")
+
+    # legacy devices (or a failed extended fetch): read the raw JSON
+    return channel.remote_endpoint_read_buffer(0)
+
 def find_all(path, serial_number,
          did_discover_object_callback,
          search_cancellation_token,
@@ -65,7 +139,7 @@ def find_all(path, serial_number,
         try:
             logger.debug("Connecting to device on " + channel._name)
             try:
-                json_bytes = channel.remote_endpoint_read_buffer(0)
+                json_bytes = fetch_json_descriptor(channel, logger)
             except (TimeoutError, ChannelBrokenException):
                 logger.debug("no response - probably incompatible")
                 return
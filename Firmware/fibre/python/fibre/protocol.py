@@ -28,6 +28,60 @@ CRC16_DEFAULT = 0x3d65 # this must match the polynomial in the C++ implementatio
 
 MAX_PACKET_SIZE = 128
 
+# Dictionary for the compressed JSON descriptor transfer (extended read
+# format of endpoint 0). A byte with the high bit set expands to the entry
+# indexed by its low 7 bits; all other bytes are literals. This table MUST
+# stay in sync with json_dictionary_ in fibre/cpp/protocol.cpp.
+JSON_DICTIONARY = [
+    b'{"name":"',
+    b'","id":',
+    b'},{"name":"',
+    b']},{"name":"',
+    b'","type":"object","members":[',
+    b',"type":"function","inputs":[',
+    b'],"outputs":[',
+    b',"type":"json","access":"r"}',
+    b',"type":"float","access":"rw"}',
+    b',"type":"float","access":"r"}',
+    b',"type":"bool","access":"rw"}',
+    b',"type":"bool","access":"r"}',
+    b',"type":"int64","access":"rw"}',
+    b',"type":"int64","access":"r"}',
+    b',"type":"uint64","access":"rw"}',
+    b',"type":"uint64","access":"r"}',
+    b',"type":"int32","access":"rw"}',
+    b',"type":"int32","access":"r"}',
+    b',"type":"uint32","access":"rw"}',
+    b',"type":"uint32","access":"r"}',
+    b',"type":"int16","access":"rw"}',
+    b',"type":"int16","access":"r"}',
+    b',"type":"uint16","access":"rw"}',
+    b',"type":"uint16","access":"r"}',
+    b',"type":"uint8","access":"rw"}',
+    b',"type":"uint8","access":"r"}',
+    b',"type":"endpoint_ref","access":"rw"}',
+    b',"type":"array","elem_type":"',
+    b'","access":"rw","length":',
+    b'","access":"r","length":',
+]
+
+def decompress_json(data):
+    """
+    Expands a dictionary-compressed JSON descriptor. Raw (uncompressed)
+    descriptors pass through unchanged since ASCII JSON contains no
+    high-bit bytes.
+    """
+    out = bytearray()
+    for byte in data:
+        if byte & 0x80:
+            index = byte & 0x7F
+            if index >= len(JSON_DICTIONARY):
+                raise ValueError("unknown dictionary code 0x{:02X}".format(byte))
+            out += JSON_DICTIONARY[index]
+        else:
+            out.append(byte)
+    return bytes(out)
+
 def calc_crc(remainder, value, polynomial, bitwidth):
     topbit = (1 << (bitwidth - 1))
 
@@ -275,16 +329,7 @@ class Channel(PacketSink):
         finally:
             self._my_lock.release()
         seq_no |= 0x80 # FIXME: we hardwire one bit of the seq-no to 1 to avoid conflicts with the ascii protocol
-        packet = struct.pack('<HHH', seq_no, endpoint_id, output_length)
-        packet = packet + input
-
-        crc16 = calc_crc16(CRC16_INIT, packet)
-        if (endpoint_id & 0x7fff == 0):
-            trailer = PROTOCOL_VERSION
-        else:
-            trailer = self._interface_definition_crc
-        #print("append trailer " + trailer)
-        packet = packet + struct.pack('<H', trailer)
+        packet = self._pack_request(seq_no, endpoint_id, input, output_length)
 
         if (expect_ack):
             ack_event = Event()
@@ -320,7 +365,78 @@ class Channel(PacketSink):
             # fire and forget
             self._output.process_packet(packet)
             return None
-    
+
+    def _pack_request(self, seq_no, endpoint_id, input, output_length):
+        packet = struct.pack('<HHH', seq_no, endpoint_id, output_length)
+        packet = packet + input
+        if (endpoint_id & 0x7fff == 0):
+            trailer = PROTOCOL_VERSION
+        else:
+            trailer = self._interface_definition_crc
+        return packet + struct.pack('<H', trailer)
+
+    def remote_endpoint_operation_async(self, endpoint_id, input, output_length):
+        """
+        Sends a request without waiting for its response, so that several
+        requests can be in flight at once. The device processes and answers
+        requests in arrival order; responses are matched to requests by
+        sequence number. Returns a handle to pass to await_response().
+        """
+        if input is None:
+            input = bytearray(0)
+        if (len(input) >= 128):
+            raise Exception("packet larger than 127 currently not supported")
+
+        self._my_lock.acquire()
+        try:
+            self._outbound_seq_no = ((self._outbound_seq_no + 1) & 0x7fff)
+            seq_no = self._outbound_seq_no
+        finally:
+            self._my_lock.release()
+        seq_no |= 0x80 # FIXME: we hardwire one bit of the seq-no to 1 to avoid conflicts with the ascii protocol
+        packet = self._pack_request(seq_no, endpoint_id | 0x8000, input, output_length)
+
+        self._expected_acks[seq_no] = Event()
+        self._my_lock.acquire()
+        try:
+            self._output.process_packet(packet)
+        finally:
+            self._my_lock.release()
+        return seq_no
+
+    def await_response(self, seq_no):
+        """
+        Waits for the response to a request issued with
+        remote_endpoint_operation_async. Unlike the synchronous path there
+        are no resend attempts: a lost packet breaks the whole window.
+        """
+        ack_event = self._expected_acks[seq_no]
+        try:
+            if wait_any(self._resend_timeout, ack_event, self._channel_broken) != 0:
+                raise ChannelBrokenException()
+            return self._responses.pop(seq_no)
+        finally:
+            self._expected_acks.pop(seq_no)
+            self._responses.pop(seq_no, None)
+
+    def remote_endpoint_operation_pipelined(self, operations, window_size=8):
+        """
+        Executes a list of (endpoint_id, input, output_length) operations
+        while keeping up to window_size requests outstanding. Returns the
+        responses in operation order. This turns N serialized round trips
+        into roughly N/window_size, which matters for bulk configuration
+        reads/writes.
+        """
+        pending = []
+        responses = []
+        for operation in operations:
+            if len(pending) >= window_size:
+                responses.append(self.await_response(pending.pop(0)))
+            pending.append(self.remote_endpoint_operation_async(*operation))
+        while pending:
+            responses.append(self.await_response(pending.pop(0)))
+        return responses
+
     def remote_endpoint_read_buffer(self, endpoint_id):
         """
         Handles reads from long endpoints
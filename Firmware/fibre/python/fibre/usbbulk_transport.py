@@ -122,7 +122,10 @@ class USBBulkTransport(fibre.protocol.PacketSource, fibre.protocol.PacketSink):
 
   def get_packet(self, deadline):
     try:
-      bufferLen = self.epr.wMaxPacketSize
+      # Request more than one max-size packet so a multi-packet transfer
+      # (responses larger than wMaxPacketSize) is returned whole; the
+      # transfer is terminated by a short packet or ZLP either way.
+      bufferLen = max(self.epr.wMaxPacketSize, 512)
       timeout = max(int((deadline - time.monotonic()) * 1000), 0)
       ret = self.epr.read(bufferLen, timeout)
       if self._was_damaged:
@@ -0,0 +1,184 @@
+/*
+* In-process loopback transport for protocol benchmarking and fuzzing.
+*
+* Connects a client-side packet source to the full server-side protocol
+* stack (stream framing, segmenter, channel, endpoint dispatch) through
+* SpscRingBuffer byte rings, so the whole request/response path runs at
+* memory speed without sockets or network noise. The rings are pumped
+* explicitly, which also makes the harness suitable for exercising
+* multiple queued packets (windowed pipelining) deterministically.
+*/
+
+#ifndef __LOOPBACK_TRANSPORT_HPP
+#define __LOOPBACK_TRANSPORT_HPP
+
+#include <fibre/protocol.hpp>
+
+// Byte ring with the StreamSink interface on the write side and an
+// explicit drain into a consumer on the read side.
+template<size_t SIZE>
+class LoopbackStream : public StreamSink {
+public:
+    int process_bytes(const uint8_t* buffer, size_t length, size_t* processed_bytes) {
+        for (size_t i = 0; i < length; ++i) {
+            if (!ring_.push(buffer[i]))
+                return -1;
+            if (processed_bytes)
+                (*processed_bytes)++;
+        }
+        return 0;
+    }
+
+    size_t get_free_space() { return ring_.free_space(); }
+
+    // @brief Feeds everything currently in the ring to the consumer.
+    // @return number of bytes moved
+    size_t drain(StreamSink& consumer) {
+        uint8_t chunk[64];
+        size_t total = 0;
+        for (;;) {
+            size_t n = 0;
+            while (n < sizeof(chunk) && ring_.pop(&chunk[n]))
+                n++;
+            if (!n)
+                return total;
+            consumer.process_bytes(chunk, n, nullptr);
+            total += n;
+        }
+    }
+
+private:
+    SpscRingBuffer<uint8_t, SIZE> ring_;
+};
+
+// Captures the most recent packet emitted by a segmenter.
+class CapturePacketSink : public PacketSink {
+public:
+    int process_packet(const uint8_t* buffer, size_t length) {
+        if (length > sizeof(packet_))
+            return -1;
+        memcpy(packet_, buffer, length);
+        length_ = length;
+        n_packets_++;
+        return 0;
+    }
+    const uint8_t* packet() const { return packet_; }
+    size_t length() const { return length_; }
+    uint32_t n_packets() const { return n_packets_; }
+    void reset() { length_ = 0; }
+private:
+    uint8_t packet_[RX_BUF_SIZE];
+    size_t length_ = 0;
+    uint32_t n_packets_ = 0;
+};
+
+// Client and server stacks wired back-to-back:
+//
+//   request()  --framer--> [request ring]  --segmenter--> channel
+//   response() <--segmenter-- [response ring] <--framer-- channel
+//
+// fibre_publish() must have been called before the first request.
+class LoopbackHarness {
+public:
+    LoopbackHarness() :
+        response_framer_(response_ring_),
+        channel_(response_framer_),
+        request_segmenter_(channel_),
+        response_segmenter_(response_capture_)
+    {}
+
+    // @brief Runs one request packet through the full server stack.
+    // @return response payload length (excluding the seq-no), or -1 if no
+    // valid response frame came back
+    int request(const uint8_t* packet, size_t length,
+            uint8_t* response, size_t max_response_length) {
+        StreamBasedPacketSink request_framer(request_ring_);
+        if (request_framer.process_packet(packet, length) != 0)
+            return -1;
+        pump();
+        if (!response_capture_.length())
+            return -1;
+        size_t payload_length = response_capture_.length() - 2;
+        if (payload_length > max_response_length)
+            payload_length = max_response_length;
+        if (response)
+            memcpy(response, response_capture_.packet() + 2, payload_length);
+        response_capture_.reset();
+        return (int)payload_length;
+    }
+
+    // @brief Convenience wrapper: reads an endpoint into a typed value.
+    // @return 0 on success, -1 otherwise
+    template<typename T>
+    int read_endpoint(uint16_t endpoint_id, T* value) {
+        uint8_t packet[10];
+        size_t pos = 0;
+        pos += write_le<uint16_t>(next_seq_no(), packet + pos);
+        pos += write_le<uint16_t>(endpoint_id | 0x8000, packet + pos);
+        pos += write_le<uint16_t>(sizeof(T), packet + pos);
+        pos += write_le<uint16_t>(trailer_for(endpoint_id), packet + pos);
+        uint8_t response[sizeof(T)];
+        if (request(packet, pos, response, sizeof(response)) != (int)sizeof(T))
+            return -1;
+        read_le<T>(value, response);
+        return 0;
+    }
+
+    template<typename T>
+    int write_endpoint(uint16_t endpoint_id, T value) {
+        uint8_t packet[10 + sizeof(T)];
+        size_t pos = 0;
+        pos += write_le<uint16_t>(next_seq_no(), packet + pos);
+        pos += write_le<uint16_t>(endpoint_id | 0x8000, packet + pos);
+        pos += write_le<uint16_t>(0, packet + pos);
+        pos += write_le<T>(value, packet + pos);
+        pos += write_le<uint16_t>(trailer_for(endpoint_id), packet + pos);
+        return request(packet, pos, nullptr, 0) < 0 ? -1 : 0;
+    }
+
+    // endpoint 0 and stable IDs take the protocol version, everything else
+    // is pinned to the current descriptor
+    static uint16_t trailer_for(uint16_t endpoint_id) {
+        return (endpoint_id && endpoint_id < STABLE_ENDPOINT_ID_BASE)
+                ? json_crc_ : PROTOCOL_VERSION;
+    }
+
+    // @brief Feeds arbitrary bytes into the server-side segmenter, as a
+    // fuzzer would. Responses (if the bytes happen to form valid frames)
+    // are drained and discarded.
+    void feed_raw(const uint8_t* buffer, size_t length) {
+        while (length) {
+            size_t chunk = length < 32 ? length : 32;
+            request_segmenter_.process_bytes(buffer, chunk, nullptr);
+            buffer += chunk;
+            length -= chunk;
+            response_ring_.drain(response_segmenter_);
+            response_capture_.reset();
+        }
+    }
+
+    uint16_t next_seq_no() {
+        seq_no_ = (seq_no_ + 1) & 0x7fff;
+        return seq_no_ | 0x0080; // see remote_endpoint_operation in protocol.py
+    }
+
+    // direct access for tests that configure per-channel state (rate limiting)
+    BidirectionalPacketBasedChannel& channel() { return channel_; }
+
+private:
+    void pump() {
+        request_ring_.drain(request_segmenter_);
+        response_ring_.drain(response_segmenter_);
+    }
+
+    LoopbackStream<512> request_ring_;
+    LoopbackStream<512> response_ring_;
+    StreamBasedPacketSink response_framer_;
+    BidirectionalPacketBasedChannel channel_;
+    StreamToPacketSegmenter request_segmenter_;
+    CapturePacketSink response_capture_;
+    StreamToPacketSegmenter response_segmenter_;
+    uint16_t seq_no_ = 0;
+};
+
+#endif // __LOOPBACK_TRANSPORT_HPP
@@ -7,9 +7,15 @@
 //#define DEBUG_PROTOCOL
 void hexdump(const uint8_t* buf, size_t len);
 
+#include <string.h>
+#include <chrono>
+
 #include <fibre/crc.hpp>
 #include <fibre/decoders.hpp>
 #include <fibre/encoders.hpp>
+#include <fibre/protocol.hpp>
+
+#include "loopback_transport.hpp"
 
 void hexdump(const uint8_t* buf, size_t len) {
     for (size_t pos = 0; pos < len; ++pos) {
@@ -22,6 +28,125 @@ void hexdump(const uint8_t* buf, size_t len) {
 
 
 
+bool spsc_ring_buffer_test() {
+    SpscRingBuffer<int, 8> ring;
+    if (!ring.empty() || ring.free_space() != 7)
+        return false;
+
+    // fill to capacity (SIZE - 1), then one more push must fail
+    for (int i = 0; i < 7; ++i) {
+        if (!ring.push(i)) {
+            printf("ring: push %d unexpectedly failed\n", i);
+            return false;
+        }
+    }
+    if (ring.push(7)) {
+        printf("ring: push into full buffer unexpectedly succeeded\n");
+        return false;
+    }
+
+    // drain in FIFO order
+    for (int i = 0; i < 7; ++i) {
+        int value = -1;
+        if (!ring.pop(&value) || value != i) {
+            printf("ring: expected %d but got %d\n", i, value);
+            return false;
+        }
+    }
+    int value;
+    if (ring.pop(&value)) {
+        printf("ring: pop from empty buffer unexpectedly succeeded\n");
+        return false;
+    }
+
+    // wrap-around across the index boundary
+    for (int pass = 0; pass < 5; ++pass) {
+        for (int i = 0; i < 3; ++i)
+            if (!ring.push(pass * 3 + i))
+                return false;
+        for (int i = 0; i < 3; ++i)
+            if (!ring.pop(&value) || value != pass * 3 + i)
+                return false;
+    }
+    return true;
+}
+
+bool crc_test() {
+    // The table-driven implementation must match the bit-serial reference
+    // for all polynomials used by the packet framing.
+    uint8_t data[37];
+    for (size_t i = 0; i < sizeof(data); ++i)
+        data[i] = (uint8_t)(i * 7 + 13);
+
+    uint8_t crc8_ref = CANONICAL_CRC8_INIT;
+    uint16_t crc16_ref = CANONICAL_CRC16_INIT;
+    for (size_t i = 0; i < sizeof(data); ++i) {
+        crc8_ref = calc_crc_bitwise<uint8_t, CANONICAL_CRC8_POLYNOMIAL>(crc8_ref, data[i]);
+        crc16_ref = calc_crc_bitwise<uint16_t, CANONICAL_CRC16_POLYNOMIAL>(crc16_ref, data[i]);
+    }
+
+    uint8_t crc8 = calc_crc8<CANONICAL_CRC8_POLYNOMIAL>(CANONICAL_CRC8_INIT, data, sizeof(data));
+    uint16_t crc16 = calc_crc16<CANONICAL_CRC16_POLYNOMIAL>(CANONICAL_CRC16_INIT, data, sizeof(data));
+    if (crc8 != crc8_ref) {
+        printf("crc8: expected %02x but got %02x\n", crc8_ref, crc8);
+        return false;
+    }
+    if (crc16 != crc16_ref) {
+        printf("crc16: expected %04x but got %04x\n", crc16_ref, crc16);
+        return false;
+    }
+    return true;
+}
+
+bool array_endpoint_test() {
+    float data[8];
+    for (int i = 0; i < 8; ++i)
+        data[i] = i * 1.5f;
+    auto prop = make_protocol_array_property("arr", data, 8);
+
+    // ranged read: 3 elements starting at offset 2
+    uint8_t request[8 + 2 * sizeof(float)];
+    write_le<uint32_t>(2, request);
+    write_le<uint32_t>(3, request + 4);
+    uint8_t response[3 * sizeof(float)];
+    MemoryStreamSink sink(response, sizeof(response));
+    prop.handle(request, 8, &sink);
+    if (sink.get_free_space() != 0) {
+        printf("array: read returned %zu bytes too few\n", sink.get_free_space());
+        return false;
+    }
+    for (int i = 0; i < 3; ++i) {
+        float value;
+        read_le<float>(&value, response + i * sizeof(float));
+        if (value != data[2 + i]) {
+            printf("array: read element %d mismatch\n", i);
+            return false;
+        }
+    }
+
+    // ranged write: 2 elements starting at offset 4
+    write_le<uint32_t>(4, request);
+    write_le<uint32_t>(2, request + 4);
+    write_le<float>(10.0f, request + 8);
+    write_le<float>(11.0f, request + 12);
+    prop.handle(request, sizeof(request), nullptr);
+    if (data[4] != 10.0f || data[5] != 11.0f || data[3] != 4.5f || data[6] != 9.0f) {
+        printf("array: write touched the wrong elements\n");
+        return false;
+    }
+
+    // count beyond the end must be clamped to the buffer bounds
+    write_le<uint32_t>(6, request);
+    write_le<uint32_t>(100, request + 4);
+    MemoryStreamSink sink2(response, sizeof(response));
+    prop.handle(request, 8, &sink2);
+    if (sink2.get_free_space() != sizeof(response) - 2 * sizeof(float)) {
+        printf("array: clamped read returned wrong number of elements\n");
+        return false;
+    }
+    return true;
+}
+
 bool varint_decoder_test() {
     struct test_case_t {
         uint8_t encoded[10];
@@ -72,7 +197,586 @@ bool varint_decoder_test() {
 
 
 
-int main(void) {
+// endpoints published for the loopback tests (ids 1 and 2)
+static float loopback_prop_ = 12.5f;
+static int32_t loopback_counter_ = 0;
+
+bool protocol_loopback_test() {
+    LoopbackHarness harness;
+
+    // read/write round trip through framing, segmenter and dispatch
+    float value = 0.0f;
+    if (harness.read_endpoint<float>(1, &value) != 0 || value != 12.5f) {
+        printf("loopback: initial read failed (got %f)\n", (double)value);
+        return false;
+    }
+    if (harness.write_endpoint<float>(1, 99.0f) != 0) {
+        printf("loopback: write failed\n");
+        return false;
+    }
+    if (harness.read_endpoint<float>(1, &value) != 0 || value != 99.0f) {
+        printf("loopback: read-back failed (got %f)\n", (double)value);
+        return false;
+    }
+    loopback_prop_ = 12.5f;
+
+    // a request with a bad trailer CRC must be rejected
+    uint8_t packet[10];
+    size_t pos = 0;
+    pos += write_le<uint16_t>(harness.next_seq_no(), packet + pos);
+    pos += write_le<uint16_t>(1 | 0x8000, packet + pos);
+    pos += write_le<uint16_t>(sizeof(float), packet + pos);
+    pos += write_le<uint16_t>(json_crc_ ^ 0xffff, packet + pos);
+    uint8_t response[4];
+    if (harness.request(packet, pos, response, sizeof(response)) != -1) {
+        printf("loopback: request with bad trailer was answered\n");
+        return false;
+    }
+    return true;
+}
+
+bool name_hash_test() {
+    // hashing a dotted path is the same as chaining its segments, so hosts
+    // can precompute fnv("axis0.motor") without string concatenation
+    static_assert(fibre_name_hash("ab.cd") ==
+            fibre_name_hash("cd", fibre_name_hash(".", fibre_name_hash("ab"))),
+            "path hash does not chain across segments");
+    // reference value pinned so the wire format can't drift silently
+    static_assert(fibre_name_hash("") == 2166136261u, "FNV-1a basis mismatch");
+
+    LoopbackHarness harness;
+
+    // resolve both published endpoints and a bogus hash via endpoint 0
+    const struct { uint32_t hash; uint16_t expected_id; uint8_t expected_type; } cases[] = {
+        { fibre_name_hash("prop"), 1, FIBRE_TYPE_FLOAT },
+        { fibre_name_hash("counter"), 2, FIBRE_TYPE_INT32 },
+        { fibre_name_hash("does_not_exist"), 0xffff, FIBRE_TYPE_NONE },
+    };
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i) {
+        uint8_t packet[16];
+        size_t pos = 0;
+        pos += write_le<uint16_t>(harness.next_seq_no(), packet + pos);
+        pos += write_le<uint16_t>(0 | 0x8000, packet + pos);
+        pos += write_le<uint16_t>(5, packet + pos); // expect json_crc + id + type
+        pos += write_le<uint32_t>(cases[i].hash, packet + pos);
+        pos += write_le<uint16_t>(0, packet + pos); // expected_crc unused
+        pos += write_le<uint16_t>(0x0002, packet + pos); // flags: resolve hash
+        pos += write_le<uint16_t>(PROTOCOL_VERSION, packet + pos);
+
+        uint8_t response[5];
+        if (harness.request(packet, pos, response, sizeof(response)) != 5) {
+            printf("name hash: no response for case %zu\n", i);
+            return false;
+        }
+        uint16_t crc, id;
+        read_le<uint16_t>(&crc, response);
+        read_le<uint16_t>(&id, response + 2);
+        uint8_t type = response[4];
+        if (crc != json_crc_ || id != cases[i].expected_id || type != cases[i].expected_type) {
+            printf("name hash: case %zu resolved to %04x type %02x (crc %04x)\n", i, id, type, crc);
+            return false;
+        }
+    }
+    return true;
+}
+
+bool stable_id_test() {
+    // manifest: slot 0 and 1 resolve, slot 2 points at a path this "build"
+    // doesn't have
+    static const uint32_t manifest[] = {
+        fibre_name_hash("prop"),
+        fibre_name_hash("counter"),
+        fibre_name_hash("removed_in_this_version"),
+    };
+    fibre_set_stable_id_map(manifest, sizeof(manifest) / sizeof(manifest[0]));
+
+    LoopbackHarness harness;
+
+    // stable slots reach the same endpoints as the tree IDs, with a
+    // descriptor-independent trailer
+    float value = 0.0f;
+    if (harness.read_endpoint<float>(STABLE_ENDPOINT_ID_BASE + 0, &value) != 0 || value != 12.5f) {
+        printf("stable id: read via slot 0 failed (got %f)\n", (double)value);
+        return false;
+    }
+    if (harness.write_endpoint<int32_t>(STABLE_ENDPOINT_ID_BASE + 1, 42) != 0)
+        return false;
+    int32_t counter = 0;
+    if (harness.read_endpoint<int32_t>(2, &counter) != 0 || counter != 42) {
+        printf("stable id: write via slot 1 not visible at tree ID (got %d)\n", counter);
+        return false;
+    }
+    loopback_counter_ = 0;
+
+    // unresolvable and out-of-range slots must be rejected
+    if (harness.read_endpoint<float>(STABLE_ENDPOINT_ID_BASE + 2, &value) != -1) {
+        printf("stable id: unresolvable slot was answered\n");
+        return false;
+    }
+    if (harness.read_endpoint<float>(STABLE_ENDPOINT_ID_BASE + 3, &value) != -1) {
+        printf("stable id: out-of-range slot was answered\n");
+        return false;
+    }
+    return true;
+}
+
+static int endpoint_lock_cnt_ = 0;
+static int endpoint_unlock_cnt_ = 0;
+static bool endpoint_lock_balanced_ = true;
+static void counting_lock() {
+    if (endpoint_lock_cnt_ != endpoint_unlock_cnt_)
+        endpoint_lock_balanced_ = false; // re-entered while held
+    endpoint_lock_cnt_++;
+}
+static void counting_unlock() {
+    endpoint_unlock_cnt_++;
+}
+
+bool endpoint_lock_test() {
+    endpoint_lock_cnt_ = 0;
+    endpoint_unlock_cnt_ = 0;
+    endpoint_lock_balanced_ = true;
+    fibre_set_endpoint_lock(counting_lock, counting_unlock);
+
+    LoopbackHarness harness;
+    float value = 0.0f;
+    bool ok = true;
+    for (int i = 0; i < 10; ++i) {
+        if (harness.read_endpoint<float>(1, &value) != 0) {
+            printf("endpoint lock: read %d failed\n", i);
+            ok = false;
+            break;
+        }
+    }
+    fibre_set_endpoint_lock(nullptr, nullptr);
+
+    if (ok && (endpoint_lock_cnt_ != 10 || endpoint_unlock_cnt_ != 10 || !endpoint_lock_balanced_)) {
+        printf("endpoint lock: %d locks / %d unlocks for 10 operations (balanced: %d)\n",
+                endpoint_lock_cnt_, endpoint_unlock_cnt_, (int)endpoint_lock_balanced_);
+        ok = false;
+    }
+    return ok;
+}
+
+static uint32_t fake_us_ = 0;
+static uint32_t fake_us_clock() { return fake_us_; }
+
+bool rate_limit_test() {
+    LoopbackHarness harness;
+    fake_us_ = 0;
+    fibre_set_us_clock(fake_us_clock);
+    uint32_t drop_cnt = 0;
+    harness.channel().rate_limit_.ops_per_sec = 1000; // one op per 1000us of credit
+    harness.channel().rate_limit_.burst = 4;
+    harness.channel().rate_limit_.drop_cnt = &drop_cnt;
+
+    bool ok = true;
+    float value = 0.0f;
+    // a fresh bucket holds the full burst budget, not one op more
+    for (int i = 0; ok && i < 4; ++i) {
+        if (harness.read_endpoint<float>(1, &value) != 0) {
+            printf("rate limit: read %d within burst budget failed\n", i);
+            ok = false;
+        }
+    }
+    if (ok && harness.read_endpoint<float>(1, &value) != -1) {
+        printf("rate limit: read over burst budget was answered\n");
+        ok = false;
+    }
+    // refill grants exactly one op per 1000us
+    fake_us_ += 1000;
+    if (ok && harness.read_endpoint<float>(1, &value) != 0) {
+        printf("rate limit: read after refill failed\n");
+        ok = false;
+    }
+    if (ok && harness.read_endpoint<float>(1, &value) != -1) {
+        printf("rate limit: second read after single refill was answered\n");
+        ok = false;
+    }
+    // a long idle period refills at most the burst budget
+    fake_us_ += 10000000;
+    for (int i = 0; ok && i < 4; ++i) {
+        if (harness.read_endpoint<float>(1, &value) != 0) {
+            printf("rate limit: read %d after idle failed\n", i);
+            ok = false;
+        }
+    }
+    if (ok && harness.read_endpoint<float>(1, &value) != -1) {
+        printf("rate limit: burst budget not capped after idle\n");
+        ok = false;
+    }
+    if (ok && drop_cnt != 3) {
+        printf("rate limit: %u drops counted, expected 3\n", drop_cnt);
+        ok = false;
+    }
+
+    fibre_set_us_clock(nullptr);
+    return ok;
+}
+
+bool protocol_fuzz_test() {
+    LoopbackHarness harness;
+
+    // deterministic garbage must neither crash nor wedge the stack
+    uint32_t rng = 0xdecafbad;
+    uint8_t noise[256];
+    for (int pass = 0; pass < 400; ++pass) {
+        for (size_t i = 0; i < sizeof(noise); ++i) {
+            rng ^= rng << 13; rng ^= rng >> 17; rng ^= rng << 5; // xorshift32
+            noise[i] = (uint8_t)rng;
+        }
+        harness.feed_raw(noise, sizeof(noise));
+    }
+
+    // single-byte corruptions of a valid framed request must be rejected
+    uint8_t packet[10];
+    size_t pos = 0;
+    pos += write_le<uint16_t>(harness.next_seq_no(), packet + pos);
+    pos += write_le<uint16_t>(1 | 0x8000, packet + pos);
+    pos += write_le<uint16_t>(sizeof(float), packet + pos);
+    pos += write_le<uint16_t>(json_crc_, packet + pos);
+    uint8_t framed[32];
+    MemoryStreamSink framed_sink(framed, sizeof(framed));
+    StreamBasedPacketSink framer(framed_sink);
+    if (framer.process_packet(packet, pos) != 0)
+        return false;
+    size_t framed_length = sizeof(framed) - framed_sink.get_free_space();
+    for (size_t i = 0; i < framed_length; ++i) {
+        uint8_t mutated[32];
+        memcpy(mutated, framed, framed_length);
+        mutated[i] ^= 0xa5;
+        harness.feed_raw(mutated, framed_length);
+    }
+
+    // ...and a pristine request must still go through afterwards
+    float value = 0.0f;
+    if (harness.read_endpoint<float>(1, &value) != 0 || value != 12.5f) {
+        printf("fuzz: stack wedged after corrupted input\n");
+        return false;
+    }
+    return true;
+}
+
+// Counts the frames a segmenter delivers and remembers the last payload.
+class CountingPacketSink : public PacketSink {
+public:
+    int process_packet(const uint8_t* buffer, size_t length) {
+        packet_cnt_++;
+        last_length_ = length;
+        if (length <= sizeof(last_payload_))
+            memcpy(last_payload_, buffer, length);
+        return 0;
+    }
+    size_t packet_cnt_ = 0;
+    size_t last_length_ = 0;
+    uint8_t last_payload_[RX_BUF_SIZE];
+};
+
+// Wraps a payload in the stream framing (sync byte, length, header CRC,
+// payload, packet CRC). Returns the frame length, 0 on failure.
+static size_t frame_payload(const uint8_t* payload, size_t length, uint8_t* out, size_t out_size) {
+    MemoryStreamSink sink(out, out_size);
+    StreamBasedPacketSink framer(sink);
+    if (framer.process_packet(payload, length) != 0)
+        return 0;
+    return out_size - sink.get_free_space();
+}
+
+bool segmenter_robustness_test() {
+    CountingPacketSink sink;
+    StreamToPacketSegmenter segmenter(sink);
+
+    uint8_t payload[8] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+    uint8_t frame[64];
+    size_t frame_length = frame_payload(payload, sizeof(payload), frame, sizeof(frame));
+    if (!frame_length)
+        return false;
+
+    // a clean frame decodes
+    segmenter.process_bytes(frame, frame_length, nullptr);
+    if (sink.packet_cnt_ != 1 || sink.last_length_ != sizeof(payload)
+        || memcmp(sink.last_payload_, payload, sizeof(payload))) {
+        printf("segmenter: clean frame not decoded\n");
+        return false;
+    }
+
+    // chunking must not matter: the same frame one byte at a time
+    for (size_t i = 0; i < frame_length; ++i)
+        segmenter.process_bytes(frame + i, 1, nullptr);
+    if (sink.packet_cnt_ != 2) {
+        printf("segmenter: single-byte chunking broke the frame\n");
+        return false;
+    }
+
+    // sync-free garbage must be skipped without losing the next frame
+    uint8_t garbage[64];
+    for (size_t i = 0; i < sizeof(garbage); ++i) {
+        garbage[i] = (uint8_t)(i * 41 + 7);
+        if (garbage[i] == CANONICAL_PREFIX)
+            garbage[i] ^= 1;
+    }
+    segmenter.process_bytes(garbage, sizeof(garbage), nullptr);
+    segmenter.process_bytes(frame, frame_length, nullptr);
+    if (sink.packet_cnt_ != 3) {
+        printf("segmenter: resync after garbage failed\n");
+        return false;
+    }
+
+    // hostile length (reserved MSB set) must be rejected without wedging
+    uint8_t bad_length_header[] = { CANONICAL_PREFIX, 0xff, 0x00 };
+    segmenter.process_bytes(bad_length_header, sizeof(bad_length_header), nullptr);
+    segmenter.process_bytes(frame, frame_length, nullptr);
+    if (sink.packet_cnt_ != 4) {
+        printf("segmenter: reserved length bit wedged the stream\n");
+        return false;
+    }
+
+    // Hostile-but-valid header announcing the maximum payload, then no
+    // payload: one following frame may be eaten as bogus payload (and
+    // must fail the packet CRC), but the frame after that must decode.
+    uint8_t max_header[] = { CANONICAL_PREFIX, STREAM_MAX_PAYLOAD, 0x00 };
+    max_header[2] = calc_crc8<CANONICAL_CRC8_POLYNOMIAL>(CANONICAL_CRC8_INIT, max_header, 2);
+    segmenter.process_bytes(max_header, sizeof(max_header), nullptr);
+    for (size_t fed = 0; fed < STREAM_MAX_PAYLOAD + 2; fed += frame_length)
+        segmenter.process_bytes(frame, frame_length, nullptr);
+    if (sink.packet_cnt_ != 4) {
+        printf("segmenter: bogus payload passed the packet CRC\n");
+        return false;
+    }
+    segmenter.process_bytes(frame, frame_length, nullptr);
+    segmenter.process_bytes(frame, frame_length, nullptr);
+    if (sink.packet_cnt_ < 5) {
+        printf("segmenter: no recovery after truncated max-length frame\n");
+        return false;
+    }
+
+    // random fuzz against a parallel reference: frames interleaved with
+    // garbage bursts; every frame sent after the segmenter went idle
+    // (requested_bytes() == 0 and no partial garbage pending) must arrive
+    uint32_t rng = 0x5eed1e55;
+    size_t expected_min = sink.packet_cnt_;
+    for (int pass = 0; pass < 1000; ++pass) {
+        rng ^= rng << 13; rng ^= rng >> 17; rng ^= rng << 5; // xorshift32
+        uint8_t noise[32];
+        size_t noise_length = rng % sizeof(noise);
+        for (size_t i = 0; i < noise_length; ++i) {
+            rng ^= rng << 13; rng ^= rng >> 17; rng ^= rng << 5;
+            noise[i] = (uint8_t)rng;
+        }
+        segmenter.process_bytes(noise, noise_length, nullptr);
+        segmenter.process_bytes(frame, frame_length, nullptr);
+    }
+    // garbage may eat adjacent frames but the stream must keep flowing:
+    // require at least half of the interleaved frames to get through and
+    // a final clean exchange to work
+    if (sink.packet_cnt_ < expected_min + 500) {
+        printf("segmenter: only %zu of 1000 interleaved frames survived\n",
+                sink.packet_cnt_ - expected_min);
+        return false;
+    }
+    size_t before = sink.packet_cnt_;
+    segmenter.process_bytes(frame, frame_length, nullptr);
+    segmenter.process_bytes(frame, frame_length, nullptr);
+    if (sink.packet_cnt_ < before + 1) {
+        printf("segmenter: stream wedged after fuzzing\n");
+        return false;
+    }
+    return true;
+}
+
+bool frame_encoder_test() {
+    // the zero-copy encoder must emit byte-identical frames to the
+    // StreamBasedPacketSink framing
+    uint8_t packet[12];
+    size_t pos = 0;
+    pos += write_le<uint16_t>(0x1234, packet + pos);
+    pos += write_le<uint16_t>(0x8001, packet + pos);
+    pos += write_le<uint16_t>(4, packet + pos);
+    pos += write_le<float>(3.75f, packet + pos);
+    pos += write_le<uint16_t>(0xbeef, packet + pos);
+
+    uint8_t reference[32];
+    MemoryStreamSink reference_sink(reference, sizeof(reference));
+    StreamBasedPacketSink framer(reference_sink);
+    if (framer.process_packet(packet, pos) != 0)
+        return false;
+    size_t reference_length = sizeof(reference) - reference_sink.get_free_space();
+
+    uint8_t frame[32];
+    FrameEncoder encoder(frame, sizeof(frame));
+    encoder.write<uint16_t>(0x1234);
+    encoder.write<uint16_t>(0x8001);
+    encoder.write<uint16_t>(4);
+    encoder.write<float>(3.75f);
+    encoder.write<uint16_t>(0xbeef);
+    int frame_length = encoder.finalize();
+    if (frame_length != (int)reference_length ||
+            memcmp(frame, reference, reference_length)) {
+        printf("frame encoder: output differs from the stream framing\n");
+        hexdump(reference, reference_length);
+        hexdump(frame, frame_length > 0 ? frame_length : 0);
+        return false;
+    }
+
+    // overflow must be reported, not silently truncated
+    uint8_t tiny[6];
+    FrameEncoder overflowing(tiny, sizeof(tiny));
+    overflowing.write<uint32_t>(0);
+    if (overflowing.write<uint32_t>(0) == 0 || overflowing.finalize() != -1) {
+        printf("frame encoder: overflow not detected\n");
+        return false;
+    }
+    return true;
+}
+
+// global allocation counter: every path through the replaceable global
+// operator new ends up here, so steady-state code paths can be checked
+// for heap traffic
+static size_t n_heap_allocs_ = 0;
+void* operator new(size_t size) {
+    n_heap_allocs_++;
+    void* ptr = malloc(size);
+    if (!ptr)
+        abort();
+    return ptr;
+}
+void operator delete(void* ptr) noexcept { free(ptr); }
+void operator delete(void* ptr, size_t size) noexcept { (void)size; free(ptr); }
+
+bool arena_allocator_test() {
+    alignas(max_align_t) uint8_t storage[64];
+    Arena arena(storage, sizeof(storage));
+
+    // allocations are bump-style, aligned and counted
+    void* a = arena.alloc(1, 1);
+    void* b = arena.alloc(4, 4);
+    if (a != storage || b != storage + 4 || arena.n_allocs() != 2) {
+        printf("arena: alignment or accounting broken\n");
+        return false;
+    }
+
+    // exhaustion yields nullptr instead of overrunning the buffer
+    if (arena.alloc(sizeof(storage), 1) != nullptr) {
+        printf("arena: overran its buffer\n");
+        return false;
+    }
+
+    // reset recycles the whole block in O(1)
+    arena.reset();
+    if (arena.used() != 0 || arena.n_allocs() != 0 || arena.alloc(1, 1) != storage) {
+        printf("arena: reset did not recycle the buffer\n");
+        return false;
+    }
+
+    // make<T> constructs in place without touching the heap
+    arena.reset();
+    size_t heap_allocs_before = n_heap_allocs_;
+    uint32_t* obj = arena.make<uint32_t>(0xcafef00d);
+    if (!obj || *obj != 0xcafef00d || n_heap_allocs_ != heap_allocs_before) {
+        printf("arena: make<T> failed or hit the heap\n");
+        return false;
+    }
+
+    // steady-state packet handling must perform zero heap allocations:
+    // after a warmup request the full request/dispatch/response cycle
+    // may not call operator new
+    LoopbackHarness harness;
+    float value = 0.0f;
+    if (harness.read_endpoint<float>(1, &value) != 0)
+        return false;
+    heap_allocs_before = n_heap_allocs_;
+    for (int i = 0; i < 1000; ++i) {
+        if (harness.read_endpoint<float>(1, &value) != 0)
+            return false;
+    }
+    if (n_heap_allocs_ != heap_allocs_before) {
+        printf("arena: steady-state packet handling made %zu heap allocations\n",
+                n_heap_allocs_ - heap_allocs_before);
+        return false;
+    }
+    return true;
+}
+
+void protocol_loopback_bench() {
+    LoopbackHarness harness;
+    constexpr int iterations = 200000;
+
+    float value;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        if (harness.read_endpoint<float>(1, &value) != 0) {
+            printf("bench: read failed at iteration %d\n", i);
+            return;
+        }
+    }
+    auto stop = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(stop - start).count();
+    printf("loopback bench: %d property reads in %.3f s (%.0f ops/s, %.0f ns/op)\n",
+            iterations, seconds, iterations / seconds, seconds / iterations * 1e9);
+}
+
+// Adversarial segmenter benchmark: a corrupted byte stream must cost O(n)
+// to chew through, so the interesting numbers are the per-byte cost of the
+// two resync paths (the memchr hunt over sync-free garbage and the
+// worst case where every byte is a sync candidate) and how many frames a
+// burst of corruption costs before the stream flows again.
+void segmenter_resync_bench() {
+    CountingPacketSink sink;
+    StreamToPacketSegmenter segmenter(sink);
+    constexpr size_t total_bytes = 64 * 1024 * 1024;
+    static uint8_t buf[4096];
+
+    // sync-free garbage: pure hunt
+    uint32_t rng = 0xdecafbad;
+    for (size_t i = 0; i < sizeof(buf); ++i) {
+        rng ^= rng << 13; rng ^= rng >> 17; rng ^= rng << 5; // xorshift32
+        buf[i] = (uint8_t)rng;
+        if (buf[i] == CANONICAL_PREFIX)
+            buf[i] ^= 1;
+    }
+    auto start = std::chrono::steady_clock::now();
+    for (size_t fed = 0; fed < total_bytes; fed += sizeof(buf))
+        segmenter.process_bytes(buf, sizeof(buf), nullptr);
+    auto stop = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(stop - start).count();
+    printf("segmenter bench: sync-free garbage: %.3f ns/byte (%.0f MB/s)\n",
+            seconds / total_bytes * 1e9, total_bytes / seconds / 1e6);
+
+    // every byte a sync candidate: each one costs a header attempt
+    memset(buf, CANONICAL_PREFIX, sizeof(buf));
+    start = std::chrono::steady_clock::now();
+    for (size_t fed = 0; fed < total_bytes; fed += sizeof(buf))
+        segmenter.process_bytes(buf, sizeof(buf), nullptr);
+    stop = std::chrono::steady_clock::now();
+    seconds = std::chrono::duration<double>(stop - start).count();
+    printf("segmenter bench: all-sync stream:    %.3f ns/byte (%.0f MB/s)\n",
+            seconds / total_bytes * 1e9, total_bytes / seconds / 1e6);
+
+    // resync latency: frames lost after various kinds of corruption burst
+    uint8_t payload[8] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+    uint8_t frame[64];
+    size_t frame_length = frame_payload(payload, sizeof(payload), frame, sizeof(frame));
+    struct { const char* name; uint8_t bytes[4]; size_t length; } bursts[] = {
+        { "truncated header",  { CANONICAL_PREFIX }, 1 },
+        { "hostile length",    { CANONICAL_PREFIX, STREAM_MAX_PAYLOAD, 0 }, 3 },
+        { "all-sync run",      { CANONICAL_PREFIX, CANONICAL_PREFIX, CANONICAL_PREFIX, CANONICAL_PREFIX }, 4 },
+    };
+    bursts[1].bytes[2] = calc_crc8<CANONICAL_CRC8_POLYNOMIAL>(CANONICAL_CRC8_INIT, bursts[1].bytes, 2);
+    for (auto& burst : bursts) {
+        // drain any leftover state from the previous case
+        for (int i = 0; i < 8; ++i)
+            segmenter.process_bytes(frame, frame_length, nullptr);
+        constexpr int frames = 16;
+        size_t before = sink.packet_cnt_;
+        segmenter.process_bytes(burst.bytes, burst.length, nullptr);
+        for (int i = 0; i < frames; ++i)
+            segmenter.process_bytes(frame, frame_length, nullptr);
+        printf("segmenter bench: %-17s loses %zu of %d back-to-back frames\n",
+                burst.name, frames - (sink.packet_cnt_ - before), frames);
+    }
+}
+
+int main(int argc, char** argv) {
     /***** Decoder demo (remove or move somewhere else) *****/
     printf("Running decoder... ");
     // prepare raw data
@@ -129,7 +833,22 @@ int main(void) {
 
 
     /***** run automated test *****/
-    bool test_result = varint_decoder_test();
+    auto definitions = make_protocol_member_list(
+        make_protocol_property("prop", &loopback_prop_),
+        make_protocol_property("counter", &loopback_counter_));
+    fibre_publish(definitions);
+
+    if (argc > 1 && !strcmp(argv[1], "--bench")) {
+        protocol_loopback_bench();
+        segmenter_resync_bench();
+        return 0;
+    }
+
+    bool test_result = spsc_ring_buffer_test() && crc_test() && array_endpoint_test()
+            && varint_decoder_test() && protocol_loopback_test() && name_hash_test()
+            && stable_id_test() && endpoint_lock_test() && rate_limit_test()
+            && protocol_fuzz_test() && segmenter_robustness_test()
+            && frame_encoder_test() && arena_allocator_test();
     if (test_result) {
         printf("all tests passed\n");
         return 0;
@@ -0,0 +1,127 @@
+#!/usr/bin/env python3
+"""
+Decoder for the ODrive ITM/SWO trace stream (see Firmware/MotorControl/trace.h).
+
+Feed it the raw SWO byte stream as captured by the debug probe, e.g.:
+
+    openocd ... -c "tpiu config internal swo.bin uart off 168000000 2000000"
+    python3 tools/itm_decode.py swo.bin
+
+    st-trace -c168 -o swo.bin
+    python3 tools/itm_decode.py swo.bin
+
+The firmware emits one event class per stimulus port:
+
+    port 0: control loop start/end (bit 7: 0 = start, 1 = end; low bits: axis)
+    port 1: error transitions (bits 24-30: axis, bits 0-23: new error bits)
+    port 2: comm packet boundaries (bit 15: 0 = start, 1 = end; low bits: length)
+
+Timestamps come from the ITM's own local timestamp packets and are printed
+as CPU cycles since the first event (divide by the core clock for seconds).
+Unknown packet types (hardware source packets, extensions) are skipped.
+"""
+
+import argparse
+import sys
+
+
+def decode_events(data):
+    """Yields (timestamp_cycles, port, value, size) tuples from raw SWO bytes."""
+    i = 0
+    timestamp = 0
+    n = len(data)
+    while i < n:
+        header = data[i]
+        i += 1
+
+        if header == 0x00:
+            # sync packet: run of zero bytes terminated by 0x80
+            while i < n and data[i] == 0x00:
+                i += 1
+            if i < n and data[i] == 0x80:
+                i += 1
+            continue
+
+        if header == 0x70:
+            # overflow packet: events were lost in the ITM FIFO
+            yield (timestamp, None, None, 'overflow')
+            continue
+
+        if (header & 0x0F) == 0x00:
+            # local timestamp packet
+            if header & 0x80:
+                # multi-byte: 7 bits per continuation byte, LSB first
+                ts = 0
+                shift = 0
+                while i < n:
+                    byte = data[i]
+                    i += 1
+                    ts |= (byte & 0x7F) << shift
+                    shift += 7
+                    if not (byte & 0x80):
+                        break
+                timestamp += ts
+            else:
+                # single-byte: value in bits 6:4
+                timestamp += (header >> 4) & 0x07
+            continue
+
+        size_code = header & 0x03
+        if size_code != 0 and not (header & 0x04):
+            # instrumentation (SWIT) packet from a stimulus port
+            size = {1: 1, 2: 2, 3: 4}[size_code]
+            port = header >> 3
+            if i + size > n:
+                return  # truncated capture
+            value = int.from_bytes(data[i:i + size], 'little')
+            i += size
+            yield (timestamp, port, value, size)
+            continue
+
+        if size_code != 0 and (header & 0x04):
+            # hardware source packet (DWT event) - skip the payload
+            i += {1: 1, 2: 2, 3: 4}[size_code]
+            continue
+
+        # protocol/extension packet with continuation bits - skip it
+        while i < n and data[i - 1] & 0x80:
+            i += 1
+
+
+def format_event(port, value, size):
+    if port == 0:
+        kind = 'end' if value & 0x80 else 'start'
+        return 'loop axis%d %s' % (value & 0x7F, kind)
+    if port == 1:
+        return 'error axis%d bits=0x%06x' % ((value >> 24) & 0x7F, value & 0xFFFFFF)
+    if port == 2:
+        kind = 'end' if value & 0x8000 else 'start'
+        return 'comm packet %s len=%d' % (kind, value & 0x7FFF)
+    return 'port%d value=0x%0*x' % (port, size * 2, value)
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description='Decode an ODrive ITM/SWO trace capture')
+    parser.add_argument('file', nargs='?', default='-',
+                        help='raw SWO capture file ("-" for stdin)')
+    args = parser.parse_args()
+
+    if args.file == '-':
+        data = sys.stdin.buffer.read()
+    else:
+        with open(args.file, 'rb') as f:
+            data = f.read()
+
+    t0 = None
+    for timestamp, port, value, size in decode_events(data):
+        if size == 'overflow':
+            print('%12s  !! trace overflow, events lost' % '')
+            continue
+        if t0 is None:
+            t0 = timestamp
+        print('%12d  %s' % (timestamp - t0, format_event(port, value, size)))
+
+
+if __name__ == '__main__':
+    main()
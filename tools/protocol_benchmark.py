@@ -0,0 +1,155 @@
+#!/usr/bin/env python3
+"""
+Protocol throughput and latency benchmark against a live ODrive.
+
+Measures, on whatever transport the device is reached through (USB native
+protocol or UART, selected with --path like everywhere else):
+
+ - descriptor fetch time: reading the endpoint 0 JSON, which dominates
+   connection time on slow links
+ - round-trip latency distribution of single endpoint reads (p50/p99/max)
+ - sustained sequential read and write throughput in operations/s
+ - pipelined read throughput, if the channel supports windowed operations
+
+Results are emitted as JSON so regression runs can be diffed in CI instead
+of being noticed in the field.
+
+Usage:
+  python3 protocol_benchmark.py                       # first USB device
+  python3 protocol_benchmark.py --path serial:/dev/ttyUSB0
+  python3 protocol_benchmark.py --duration 5 --output results.json
+"""
+
+from __future__ import print_function
+
+import argparse
+import json
+import sys
+import time
+
+import odrive
+
+
+def percentile(sorted_samples, fraction):
+    if not sorted_samples:
+        return None
+    index = int(round(fraction * (len(sorted_samples) - 1)))
+    return sorted_samples[index]
+
+
+def latency_stats(samples):
+    samples = sorted(samples)
+    return {
+        "n": len(samples),
+        "mean_s": sum(samples) / len(samples),
+        "p50_s": percentile(samples, 0.50),
+        "p99_s": percentile(samples, 0.99),
+        "max_s": samples[-1],
+    }
+
+
+def bench_descriptor_fetch(channel, repeats):
+    times = []
+    size = 0
+    for _ in range(repeats):
+        start = time.monotonic()
+        json_bytes = channel.remote_endpoint_read_buffer(0)
+        times.append(time.monotonic() - start)
+        size = len(json_bytes)
+    return {"size_bytes": size, **latency_stats(times)}
+
+
+def bench_read_latency(device, repeats):
+    times = []
+    for _ in range(repeats):
+        start = time.monotonic()
+        device.vbus_voltage  # noqa: B018 - attribute read is a remote op
+        times.append(time.monotonic() - start)
+    return latency_stats(times)
+
+
+def bench_read_throughput(device, duration):
+    count = 0
+    start = time.monotonic()
+    while time.monotonic() - start < duration:
+        device.vbus_voltage  # noqa: B018
+        count += 1
+    elapsed = time.monotonic() - start
+    return {"ops": count, "elapsed_s": elapsed, "ops_per_s": count / elapsed}
+
+
+def bench_write_throughput(device, duration):
+    # test_property is a writable scratch u32 with no side effects
+    count = 0
+    start = time.monotonic()
+    while time.monotonic() - start < duration:
+        device.test_property = count & 0xffffffff
+        count += 1
+    elapsed = time.monotonic() - start
+    return {"ops": count, "elapsed_s": elapsed, "ops_per_s": count / elapsed}
+
+
+def bench_pipelined_read_throughput(device, duration, window_size):
+    channel = device.__channel__
+    if not hasattr(channel, "remote_endpoint_operation_pipelined"):
+        return None
+    prop = device._remote_attributes["vbus_voltage"]
+    length = prop._codec.get_length()
+    count = 0
+    start = time.monotonic()
+    while time.monotonic() - start < duration:
+        operations = [(prop._id, None, length)] * window_size
+        channel.remote_endpoint_operation_pipelined(operations, window_size)
+        count += window_size
+    elapsed = time.monotonic() - start
+    return {
+        "ops": count,
+        "elapsed_s": elapsed,
+        "ops_per_s": count / elapsed,
+        "window_size": window_size,
+    }
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="ODrive protocol throughput/latency benchmark")
+    parser.add_argument("--path", default="usb",
+                        help="connection path, e.g. usb or serial:/dev/ttyUSB0")
+    parser.add_argument("--serial-number", default=None,
+                        help="connect only to the specified serial number")
+    parser.add_argument("--duration", type=float, default=2.0,
+                        help="seconds per throughput phase (default 2)")
+    parser.add_argument("--latency-samples", type=int, default=200,
+                        help="round trips for the latency distribution")
+    parser.add_argument("--window-size", type=int, default=8,
+                        help="in-flight operations for the pipelined phase")
+    parser.add_argument("--output", default=None,
+                        help="write the JSON results to this file")
+    args = parser.parse_args()
+
+    print("finding an odrive on {}...".format(args.path), file=sys.stderr)
+    device = odrive.find_any(args.path, args.serial_number)
+
+    results = {
+        "path": args.path,
+        "serial_number": "{:012X}".format(device.serial_number),
+        "fw_version": "{}.{}.{}".format(device.fw_version_major,
+                                        device.fw_version_minor,
+                                        device.fw_version_revision),
+        "descriptor_fetch": bench_descriptor_fetch(device.__channel__, 3),
+        "read_latency": bench_read_latency(device, args.latency_samples),
+        "read_throughput": bench_read_throughput(device, args.duration),
+        "write_throughput": bench_write_throughput(device, args.duration),
+        "pipelined_read_throughput": bench_pipelined_read_throughput(
+            device, args.duration, args.window_size),
+    }
+
+    text = json.dumps(results, indent=2)
+    if args.output:
+        with open(args.output, "w") as output_file:
+            output_file.write(text + "\n")
+    print(text)
+
+
+if __name__ == "__main__":
+    main()
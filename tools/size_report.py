@@ -0,0 +1,229 @@
+#!/usr/bin/env python3
+"""
+Per-subsystem flash/RAM breakdown from the firmware linker map file.
+
+`arm-none-eabi-size` only gives one global number; this tool attributes
+every input section in the .map file to the subsystem its object file came
+from (MotorControl, fibre, communication, Board/HAL, FreeRTOS, toolchain
+libraries) and reports flash, RAM and CCMRAM bytes per subsystem, so the
+cost of a feature shows up in review instead of when the link finally
+fails. It runs automatically as part of the link step (see
+Firmware/build.lua) and writes the report next to the .elf; with a budget
+file it exits non-zero when a threshold is exceeded, failing the build.
+
+    python3 tools/size_report.py Firmware/build/ODriveFirmware.map
+    python3 tools/size_report.py ODriveFirmware.map --budget size_budget.conf
+
+Budget file syntax (one rule per line, '#' comments):
+
+    <subsystem|total> <flash|ram|ccmram> <limit>
+
+where <limit> is bytes, or a percentage of the memory region when suffixed
+with '%' (only meaningful for 'total'). Example:
+
+    total flash 90%
+    MotorControl flash 131072
+"""
+
+import argparse
+import re
+import sys
+
+# First matching rule wins. Object files are named after their source path
+# with '/' replaced by '_' (see build.lua), archives keep their lib name.
+SUBSYSTEM_RULES = [
+    ('FreeRTOS', 'FreeRTOS'),
+    ('MotorControl_', 'MotorControl'),
+    ('fibre_', 'fibre'),
+    ('communication_', 'communication'),
+    ('Board_', 'Board/HAL'),
+    ('Drivers_', 'Board/HAL'),
+    ('.a(', 'libraries'),
+    ('.o)', 'libraries'),
+]
+
+# Output sections that occupy the flash image. .data appears at its RAM
+# address in the map but its initializer load image lives in flash too.
+FLASH_SECTIONS = ('.isr_vector', '.text', '.rodata', '.ARM', '.preinit_array',
+                  '.init_array', '.fini_array', '.data')
+
+
+def classify_object(path):
+    name = path.rsplit('/obj/', 1)[-1]
+    for needle, subsystem in SUBSYSTEM_RULES:
+        if needle in name:
+            return subsystem
+    return 'other'
+
+
+def parse_memory_config(lines):
+    """Returns {region: (origin, length)} from the Memory Configuration block."""
+    regions = {}
+    in_block = False
+    for line in lines:
+        if line.startswith('Memory Configuration'):
+            in_block = True
+        elif in_block and line.startswith('Linker script'):
+            break
+        elif in_block:
+            m = re.match(r'(\w+)\s+(0x[0-9a-fA-F]+)\s+(0x[0-9a-fA-F]+)', line)
+            if m and m.group(1) != 'Name':
+                regions[m.group(1)] = (int(m.group(2), 16), int(m.group(3), 16))
+    return regions
+
+
+def parse_map(lines, regions):
+    """Returns {subsystem: {metric: bytes}} with metrics flash/ram/ccmram."""
+    usage = {}
+
+    def account(section, addr, size, obj):
+        if size == 0:
+            return
+        in_region = None
+        for region, (origin, length) in regions.items():
+            if origin <= addr < origin + length:
+                in_region = region
+                break
+        metrics = []
+        if in_region == 'FLASH':
+            metrics.append('flash')
+        elif in_region == 'RAM':
+            metrics.append('ram')
+            # .data is copied out of flash by the startup code
+            if section.startswith('.data'):
+                metrics.append('flash')
+        elif in_region == 'CCMRAM':
+            metrics.append('ccmram')
+        else:
+            return  # debug info, NVM placeholders etc.
+        subsystem = classify_object(obj)
+        for metric in metrics:
+            usage.setdefault(subsystem, {}).setdefault(metric, 0)
+            usage[subsystem][metric] += size
+
+    # Input section records look like
+    #   .text._ZN4Axis6updateEv
+    #                  0x08001234      0x1c4 build/obj/MotorControl_axis.cpp.o
+    # where the address/size move to the next line when the name is long.
+    # Alignment fill is charged to the object preceding it.
+    record_re = re.compile(
+        r'^ (\S+)\s+(0x[0-9a-fA-F]+)\s+(0x[0-9a-fA-F]+)\s+(\S+\.(?:o|obj)\)?)\s*$')
+    fill_re = re.compile(r'^ \*fill\*\s+(0x[0-9a-fA-F]+)\s+(0x[0-9a-fA-F]+)')
+    pending_name = None
+    last = None
+    in_map = False
+    for line in lines:
+        if line.startswith('Linker script and memory map'):
+            in_map = True
+            continue
+        if not in_map:
+            continue
+        if pending_name is not None:
+            m = re.match(r'^\s+(0x[0-9a-fA-F]+)\s+(0x[0-9a-fA-F]+)\s+(\S+\.(?:o|obj)\)?)\s*$', line)
+            if m:
+                last = (pending_name, int(m.group(1), 16), int(m.group(2), 16), m.group(3))
+                account(*last)
+            pending_name = None
+            continue
+        m = record_re.match(line)
+        if m:
+            last = (m.group(1), int(m.group(2), 16), int(m.group(3), 16), m.group(4))
+            account(*last)
+            continue
+        m = fill_re.match(line)
+        if m and last is not None:
+            account(last[0], int(m.group(1), 16), int(m.group(2), 16), last[3])
+            continue
+        # a lone section name: address and size follow on the next line
+        if re.match(r'^ \.\S+$', line.rstrip()):
+            pending_name = line.strip()
+    return usage
+
+
+def parse_budget(path):
+    rules = []
+    with open(path) as f:
+        for lineno, line in enumerate(f, 1):
+            line = line.split('#', 1)[0].strip()
+            if not line:
+                continue
+            parts = line.split()
+            if len(parts) != 3 or parts[1] not in ('flash', 'ram', 'ccmram'):
+                raise ValueError('%s:%d: expected "<subsystem|total> <flash|ram|ccmram> <limit>"'
+                                 % (path, lineno))
+            rules.append((parts[0], parts[1], parts[2]))
+    return rules
+
+
+def check_budget(rules, usage, regions):
+    region_of = {'flash': 'FLASH', 'ram': 'RAM', 'ccmram': 'CCMRAM'}
+    totals = {}
+    for metrics in usage.values():
+        for metric, size in metrics.items():
+            totals[metric] = totals.get(metric, 0) + size
+    failures = []
+    for scope, metric, limit in rules:
+        if limit.endswith('%'):
+            length = regions.get(region_of[metric], (0, 0))[1]
+            limit_bytes = length * float(limit[:-1]) / 100.0
+        else:
+            limit_bytes = float(limit)
+        actual = totals.get(metric, 0) if scope == 'total' \
+            else usage.get(scope, {}).get(metric, 0)
+        if actual > limit_bytes:
+            failures.append('%s %s: %d bytes exceeds budget of %s (%d bytes)'
+                            % (scope, metric, actual, limit, int(limit_bytes)))
+    return failures
+
+
+def format_report(usage, regions):
+    lines = []
+    metrics = ('flash', 'ram', 'ccmram')
+    lines.append('%-16s %10s %10s %10s' % ('subsystem', 'flash', 'ram', 'ccmram'))
+    totals = dict.fromkeys(metrics, 0)
+    order = sorted(usage, key=lambda s: -usage[s].get('flash', 0))
+    for subsystem in order:
+        row = [usage[subsystem].get(m, 0) for m in metrics]
+        for metric, size in zip(metrics, row):
+            totals[metric] += size
+        lines.append('%-16s %10d %10d %10d' % (subsystem, *row))
+    lines.append('%-16s %10d %10d %10d' % ('total', *(totals[m] for m in metrics)))
+    region_of = {'flash': 'FLASH', 'ram': 'RAM', 'ccmram': 'CCMRAM'}
+    pct = []
+    for metric in metrics:
+        length = regions.get(region_of[metric], (0, 0))[1]
+        pct.append('%9.1f%%' % (100.0 * totals[metric] / length) if length else '%10s' % '-')
+    lines.append('%-16s %s %s %s' % ('of region', *pct))
+    return '\n'.join(lines)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='per-subsystem size report from a GNU ld map file')
+    parser.add_argument('mapfile', help='linker map file (-Wl,-Map output)')
+    parser.add_argument('--budget', help='budget file; exceeding a rule fails with exit code 1')
+    parser.add_argument('--output', help='also write the report to this file')
+    args = parser.parse_args()
+
+    with open(args.mapfile) as f:
+        lines = f.read().splitlines()
+    regions = parse_memory_config(lines)
+    usage = parse_map(lines, regions)
+    if not usage:
+        print('size_report: no input sections found in %s' % args.mapfile, file=sys.stderr)
+        return 1
+
+    report = format_report(usage, regions)
+    failures = []
+    if args.budget:
+        failures = check_budget(parse_budget(args.budget), usage, regions)
+        for failure in failures:
+            report += '\nBUDGET EXCEEDED: ' + failure
+    print(report)
+    if args.output:
+        with open(args.output, 'w') as f:
+            f.write(report + '\n')
+    return 1 if failures else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())